@@ -0,0 +1,68 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/byte_buffer.h"
+
+#include <string.h>
+
+#include "omaha/base/debug.h"
+
+namespace omaha {
+
+void AppendBytes(const void* data, size_t len, std::vector<uint8>* buffer) {
+  ASSERT1(buffer);
+  const uint8* p = static_cast<const uint8*>(data);
+  buffer->insert(buffer->end(), p, p + len);
+}
+
+void AppendUint32(uint32 value, std::vector<uint8>* buffer) {
+  AppendBytes(&value, sizeof(value), buffer);
+}
+
+void AppendUint64(uint64 value, std::vector<uint8>* buffer) {
+  AppendBytes(&value, sizeof(value), buffer);
+}
+
+void AppendString(const CString& str, std::vector<uint8>* buffer) {
+  AppendUint32(static_cast<uint32>(str.GetLength()), buffer);
+  AppendBytes(str.GetString(), str.GetLength() * sizeof(TCHAR), buffer);
+}
+
+bool BufferReader::ReadBytes(void* out, size_t len) {
+  if (len > remaining_) {
+    return false;
+  }
+  if (len) {
+    memcpy(out, data_, len);
+  }
+  data_ += len;
+  remaining_ -= len;
+  return true;
+}
+
+bool BufferReader::ReadString(CString* str, uint32 max_length) {
+  ASSERT1(str);
+
+  uint32 length = 0;
+  if (!ReadUint32(&length) || length > max_length) {
+    return false;
+  }
+  const bool is_read = ReadBytes(str->GetBufferSetLength(length),
+                                 length * sizeof(TCHAR));
+  str->ReleaseBufferSetLength(is_read ? length : 0);
+  return is_read;
+}
+
+}  // namespace omaha
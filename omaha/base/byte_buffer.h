@@ -0,0 +1,62 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Helpers to write fixed size values to a byte buffer and to read them back,
+// for the small binary files the client keeps on disk. Integers are stored in
+// the byte order of the machine. Strings are stored as their length followed
+// by their characters.
+
+#ifndef OMAHA_BASE_BYTE_BUFFER_H_
+#define OMAHA_BASE_BYTE_BUFFER_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include <vector>
+
+#include "base/basictypes.h"
+
+namespace omaha {
+
+void AppendBytes(const void* data, size_t len, std::vector<uint8>* buffer);
+void AppendUint32(uint32 value, std::vector<uint8>* buffer);
+void AppendUint64(uint64 value, std::vector<uint8>* buffer);
+void AppendString(const CString& str, std::vector<uint8>* buffer);
+
+// Reads fixed size values from a buffer, failing once the buffer is exhausted.
+class BufferReader {
+ public:
+  BufferReader(const uint8* data, size_t len) : data_(data), remaining_(len) {}
+
+  bool ReadBytes(void* out, size_t len);
+
+  bool ReadUint8(uint8* value) { return ReadBytes(value, sizeof(*value)); }
+  bool ReadUint32(uint32* value) { return ReadBytes(value, sizeof(*value)); }
+  bool ReadUint64(uint64* value) { return ReadBytes(value, sizeof(*value)); }
+
+  // Fails if the string is longer than |max_length| characters.
+  bool ReadString(CString* str, uint32 max_length);
+
+  size_t remaining() const { return remaining_; }
+
+ private:
+  const uint8* data_;
+  size_t remaining_;
+
+  DISALLOW_COPY_AND_ASSIGN(BufferReader);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_BASE_BYTE_BUFFER_H_
@@ -0,0 +1,88 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <vector>
+
+#include "omaha/base/byte_buffer.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+TEST(ByteBufferTest, RoundTrip) {
+  std::vector<uint8> buffer;
+  const uint8 kBytes[] = {1, 2, 3};
+  AppendBytes(kBytes, arraysize(kBytes), &buffer);
+  AppendUint32(0x12345678, &buffer);
+  AppendUint64(0x123456789abcdef0ULL, &buffer);
+  AppendString(_T("omaha"), &buffer);
+  AppendString(_T(""), &buffer);
+
+  BufferReader reader(&buffer.front(), buffer.size());
+  uint8 bytes[arraysize(kBytes)] = {0};
+  uint32 value32 = 0;
+  uint64 value64 = 0;
+  CString str;
+  CString empty_str(_T("not empty"));
+  EXPECT_TRUE(reader.ReadBytes(bytes, arraysize(bytes)));
+  EXPECT_EQ(0, memcmp(kBytes, bytes, arraysize(kBytes)));
+  EXPECT_TRUE(reader.ReadUint32(&value32));
+  EXPECT_EQ(0x12345678, value32);
+  EXPECT_TRUE(reader.ReadUint64(&value64));
+  EXPECT_EQ(0x123456789abcdef0ULL, value64);
+  EXPECT_TRUE(reader.ReadString(&str, 5));
+  EXPECT_STREQ(_T("omaha"), str);
+  EXPECT_TRUE(reader.ReadString(&empty_str, 5));
+  EXPECT_TRUE(empty_str.IsEmpty());
+  EXPECT_EQ(0, reader.remaining());
+}
+
+TEST(ByteBufferTest, ReadFailsPastTheEnd) {
+  std::vector<uint8> buffer;
+  AppendUint32(1, &buffer);
+
+  BufferReader reader(&buffer.front(), buffer.size());
+  uint64 value64 = 0;
+  EXPECT_FALSE(reader.ReadUint64(&value64));
+  EXPECT_EQ(4, reader.remaining());
+
+  uint32 value32 = 0;
+  EXPECT_TRUE(reader.ReadUint32(&value32));
+  EXPECT_EQ(1, value32);
+  uint8 value8 = 0;
+  EXPECT_FALSE(reader.ReadUint8(&value8));
+}
+
+TEST(ByteBufferTest, ReadString_TooLong) {
+  std::vector<uint8> buffer;
+  AppendString(_T("omaha"), &buffer);
+
+  BufferReader reader(&buffer.front(), buffer.size());
+  CString str;
+  EXPECT_FALSE(reader.ReadString(&str, 4));
+}
+
+// A string that claims more characters than the buffer holds is not read.
+TEST(ByteBufferTest, ReadString_Truncated) {
+  std::vector<uint8> buffer;
+  AppendString(_T("omaha"), &buffer);
+  buffer.pop_back();
+
+  BufferReader reader(&buffer.front(), buffer.size());
+  CString str;
+  EXPECT_FALSE(reader.ReadString(&str, 5));
+  EXPECT_TRUE(str.IsEmpty());
+}
+
+}  // namespace omaha
@@ -353,6 +353,31 @@ const TCHAR* const kRegValueAlwaysAllowCrashUploads =
 const TCHAR* const kRegValueMaxCrashUploadsPerDay =
     _T("MaxCrashUploadsPerDay");
 
+// Makes the package cache hash a cached file every time it is used instead of
+// trusting the hash recorded in its index when the file is unchanged.
+const TCHAR* const kRegValueAlwaysVerifyCachedPackages =
+    _T("AlwaysVerifyCachedPackages");
+
+// Makes the package cache compress the packages not used for this many days.
+// Cached packages are never compressed if the value is 0 or missing.
+const TCHAR* const kRegValueCompressCachedPackagesAfterDays =
+    _T("CompressCachedPackagesAfterDays");
+
+// Makes large packages download over this many connections at once from
+// servers that support range requests. Packages are downloaded over a single
+// connection if the value is 0, 1, or missing.
+const TCHAR* const kRegValueDownloadConnections = _T("DownloadConnections");
+
+// Makes the worker download up to this many apps of a bundle ahead of the app
+// being installed. Apps are downloaded and installed one at a time if the value
+// is 0 or missing.
+const TCHAR* const kRegValueDownloadAheadApps = _T("DownloadAheadApps");
+
+// Makes the download of a package race this many of its urls at once, and keep
+// the one that answers first. The urls are tried one at a time if the value is
+// 0, 1, or missing.
+const TCHAR* const kRegValueMirrorRaceCount = _T("MirrorRaceCount");
+
 const TCHAR* const kRegValueDisableUpdateAppsHourlyJitter =
     _T("DisableUpdateAppsHourlyJitter");
 
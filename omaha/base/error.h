@@ -414,6 +414,11 @@ const ULONG kFacilityOmaha = 67;
 #define OMAHA_NET_E_EXCEEDED_MAX_RETRY_DELAY        \
     MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x892)
 
+// The request was not sent because its host failed the requests before it, or
+// asked to be left alone for a while. See HostHealth.
+#define OMAHA_NET_E_HOST_UNAVAILABLE                \
+    MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x893)
+
 // Install Manager custom error codes.
 #define GOOPDATEINSTALL_E_FILENAME_INVALID         \
     MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x900)
@@ -810,11 +810,12 @@ HRESULT File::SeekToBegin() {
   return SeekFromBegin(0);
 }
 
-HRESULT File::SeekFromBegin(uint32 n) {
+HRESULT File::SeekFromBegin(uint64 n) {
   ASSERT1(handle_ != INVALID_HANDLE_VALUE);
 
-  if (::SetFilePointer(handle_, n, NULL, FILE_BEGIN) ==
-      INVALID_SET_FILE_POINTER) {
+  LARGE_INTEGER distance = {0};
+  distance.QuadPart = static_cast<LONGLONG>(n);
+  if (!::SetFilePointerEx(handle_, distance, NULL, FILE_BEGIN)) {
     HRESULT hr = HRESULTFromLastError();
     UTIL_LOG(LEVEL_ERROR, (_T("[File::SeekFromBegin]")
                            _T("[SetFilePointer failed][%s][0x%x]"),
@@ -836,7 +837,7 @@ HRESULT File::SeekFromBegin(uint32 n) {
 // if it is in progress we do nothing
 // if it has been completed we return the data
 // does not delete async data entry
-HRESULT File::ReadAt(const uint32 offset, byte* buf, const uint32 len,
+HRESULT File::ReadAt(const uint64 offset, byte* buf, const uint32 len,
                      const uint32, uint32* bytes_read) {
   ASSERT1(handle_ != INVALID_HANDLE_VALUE);
   ASSERT1(buf);
@@ -872,7 +873,7 @@ HRESULT File::ReadFromStartOfFile(const uint32 max_len,
 
   RET_IF_FAILED(SeekFromBegin(0));
 
-  uint32 file_len = 0;
+  uint64 file_len = 0;
   RET_IF_FAILED(GetLength(&file_len));
 
   if (!file_len) {
@@ -944,7 +945,7 @@ HRESULT File::Read(const uint32 len, byte* buf, uint32* bytes_read) {
 
 
 // returns number of bytes written
-HRESULT File::WriteAt(const uint32 offset,
+HRESULT File::WriteAt(const uint64 offset,
                       const byte* buf,
                       const uint32 len,
                       uint32,
@@ -1028,21 +1029,21 @@ HRESULT File::Write(const byte* buf, const uint32 len, uint32* bytes_written) {
   return (wrote == len) ? S_OK : E_FAIL;
 }
 
-HRESULT File::ClearAt(const uint32 offset,
-                      const uint32 len,
-                      uint32* bytes_written) {
+HRESULT File::ClearAt(const uint64 offset,
+                      const uint64 len,
+                      uint64* bytes_written) {
   ASSERT1(handle_ != INVALID_HANDLE_VALUE);
   ASSERT1(!read_only_);
   ASSERT1(len);
 
   byte zero[kZeroSize] = {0};
-  uint32 to_go = len;
-  uint32 written = 0;
-  uint32 pos = offset;
+  uint64 to_go = len;
+  uint64 written = 0;
+  uint64 pos = offset;
 
   while (to_go) {
     uint32 wrote = 0;
-    uint32 write_len = std::min(to_go, kZeroSize);
+    uint32 write_len = static_cast<uint32>(std::min<uint64>(to_go, kZeroSize));
     RET_IF_FAILED(WriteAt(pos, zero, write_len, 0, &wrote));
 
     if (wrote != write_len) {
@@ -1061,14 +1062,14 @@ HRESULT File::ClearAt(const uint32 offset,
 
 // returns true on failure
 // zeros new data if zero_data == true
-HRESULT File::SetLength(const uint32 n, bool zero_data) {
+HRESULT File::SetLength(const uint64 n, bool zero_data) {
   ASSERT1(handle_ != INVALID_HANDLE_VALUE);
   ASSERT1(!read_only_);
-  ASSERT1(n <= kMaxFileSize);
+  ASSERT1(n <= static_cast<uint64>(kMaxFileSize));
 
   HRESULT hr = S_OK;
 
-  uint32 len = 0;
+  uint64 len = 0;
   VERIFY_SUCCEEDED(GetLength(&len));
 
   if (len == n) {
@@ -1079,7 +1080,7 @@ HRESULT File::SetLength(const uint32 n, bool zero_data) {
   // new space will not be initialized
   if (n > len) {
     if (zero_data) {
-      uint32 bytes_written = 0;
+      uint64 bytes_written = 0;
       RET_IF_FAILED(ClearAt(len, n - len, &bytes_written));
       if (bytes_written != n - len) {
         return E_FAIL;
@@ -1102,8 +1103,8 @@ HRESULT File::SetLength(const uint32 n, bool zero_data) {
   return S_OK;
 }
 
-HRESULT File::ExtendInBlocks(const uint32 block_size, uint32 size_needed,
-                             uint32* new_size, bool clear_new_space) {
+HRESULT File::ExtendInBlocks(const uint32 block_size, uint64 size_needed,
+                             uint64* new_size, bool clear_new_space) {
   ASSERT1(new_size);
 
   *new_size = size_needed;
@@ -1118,16 +1119,16 @@ HRESULT File::ExtendInBlocks(const uint32 block_size, uint32 size_needed,
 }
 
 // returns S_OK on success
-HRESULT File::GetLength(uint32* length) {
+HRESULT File::GetLength(uint64* length) {
   ASSERT1(length);
   ASSERT1(handle_ != INVALID_HANDLE_VALUE);
 
-  DWORD len = GetFileSize(handle_, NULL);
-  if (len == INVALID_FILE_SIZE) {
+  LARGE_INTEGER len = {0};
+  if (!::GetFileSizeEx(handle_, &len)) {
     ASSERT(false, (_T("cannot get file length")));
     return E_FAIL;
   }
-  *length = len;
+  *length = static_cast<uint64>(len.QuadPart);
   return S_OK;
 }
 
@@ -1187,7 +1188,7 @@ HRESULT File::GetSizeOnDisk(uint64* size_on_disk) {
   ASSERT1(size_on_disk);
   ASSERT1(handle_ != INVALID_HANDLE_VALUE);
 
-  uint32 len = 0;
+  uint64 len = 0;
   RET_IF_FAILED(GetLength(&len));
 
   *size_on_disk = len;
@@ -1199,7 +1200,7 @@ HRESULT File::GetReloadDiskSpaceNeeded(uint64* bytes_needed) {
   ASSERT1(bytes_needed);
   ASSERT1(handle_ != INVALID_HANDLE_VALUE);
 
-  uint32 len = 0;
+  uint64 len = 0;
   RET_IF_FAILED(GetLength(&len));
 
   *bytes_needed = len;
@@ -1207,7 +1208,7 @@ HRESULT File::GetReloadDiskSpaceNeeded(uint64* bytes_needed) {
 }
 
 // Get the file size
-HRESULT File::GetFileSizeUnopen(const TCHAR* filename, uint32* out_size) {
+HRESULT File::GetFileSizeUnopen(const TCHAR* filename, uint64* out_size) {
   ASSERT1(filename);
   ASSERT1(out_size);
 
@@ -1218,7 +1219,8 @@ HRESULT File::GetFileSizeUnopen(const TCHAR* filename, uint32* out_size) {
     return HRESULTFromLastError();
   }
 
-  *out_size = data.nFileSizeLow;
+  *out_size = (static_cast<uint64>(data.nFileSizeHigh) << 32) |
+              data.nFileSizeLow;
 
   return S_OK;
 }
@@ -1264,14 +1266,14 @@ HRESULT File::GetLastWriteTimeAndSize(const TCHAR* file_path,
 bool File::AreFilesIdentical(const TCHAR* filename1, const TCHAR* filename2) {
   UTIL_LOG(L4, (_T("[File::AreFilesIdentical][%s][%s]"), filename1, filename2));
 
-  uint32 file_size1 = 0;
+  uint64 file_size1 = 0;
   HRESULT hr = File::GetFileSizeUnopen(filename1, &file_size1);
   if (FAILED(hr)) {
     UTIL_LOG(LE, (_T("[GetFileSizeUnopen failed file_size1][0x%x]"), hr));
     return false;
   }
 
-  uint32 file_size2 = 0;
+  uint64 file_size2 = 0;
   hr = File::GetFileSizeUnopen(filename2, &file_size2);
   if (FAILED(hr)) {
     UTIL_LOG(LE, (_T("[GetFileSizeUnopen failed file_size2][0x%x]"), hr));
@@ -1279,7 +1281,7 @@ bool File::AreFilesIdentical(const TCHAR* filename1, const TCHAR* filename2) {
   }
 
   if (file_size1 != file_size2) {
-    UTIL_LOG(L3, (_T("[file_size1 != file_size2][%d][%d]"),
+    UTIL_LOG(L3, (_T("[file_size1 != file_size2][%I64u][%I64u]"),
                   file_size1, file_size2));
     return false;
   }
@@ -1301,23 +1303,24 @@ bool File::AreFilesIdentical(const TCHAR* filename1, const TCHAR* filename2) {
   static const uint32 kBufferSize = 0x10000;
   std::vector<uint8> buffer1(kBufferSize);
   std::vector<uint8> buffer2(kBufferSize);
-  uint32 bytes_left = file_size1;
+  uint64 bytes_left = file_size1;
 
   while (bytes_left > 0) {
-    uint32 bytes_to_read = std::min(bytes_left, kBufferSize);
+    uint32 bytes_to_read =
+        static_cast<uint32>(std::min<uint64>(bytes_left, kBufferSize));
     uint32 bytes_read1 = 0;
     uint32 bytes_read2 = 0;
 
     hr = file1.Read(bytes_to_read, &buffer1.front(), &bytes_read1);
     if (FAILED(hr)) {
-      UTIL_LOG(LE, (_T("[file1.Read failed][%d][%d][0x%x]"),
+      UTIL_LOG(LE, (_T("[file1.Read failed][%I64u][%d][0x%x]"),
                     bytes_left, bytes_to_read, hr));
       return false;
     }
 
     hr = file2.Read(bytes_to_read, &buffer2.front(), &bytes_read2);
     if (FAILED(hr)) {
-      UTIL_LOG(LE, (_T("[file2.Read failed][%d][%d][0x%x]"),
+      UTIL_LOG(LE, (_T("[file2.Read failed][%I64u][%d][0x%x]"),
                     bytes_left, bytes_to_read, hr));
       return false;
     }
@@ -1330,12 +1333,13 @@ bool File::AreFilesIdentical(const TCHAR* filename1, const TCHAR* filename2) {
     }
 
     if (memcmp(&buffer1.front(), &buffer2.front(), bytes_read1) != 0) {
-      UTIL_LOG(L3, (_T("[memcmp failed][%d][%d]"), bytes_left, bytes_read1));
+      UTIL_LOG(L3, (_T("[memcmp failed][%I64u][%d]"),
+                    bytes_left, bytes_read1));
       return false;
     }
 
     if (bytes_left < bytes_to_read) {
-      UTIL_LOG(LE, (_T("[bytes_left < bytes_to_read][%d][%d]"),
+      UTIL_LOG(LE, (_T("[bytes_left < bytes_to_read][%I64u][%d]"),
                     bytes_left, bytes_to_read));
       return false;
     }
@@ -103,7 +103,7 @@ class File {
     // static HRESULT SyncAllFiles();
 
     HRESULT SeekToBegin();
-    HRESULT SeekFromBegin(uint32 n);
+    HRESULT SeekFromBegin(uint64 n);
 
     HRESULT ReadFromStartOfFile(const uint32 max_len, byte *buf,
                                 uint32 *bytes_read);
@@ -112,13 +112,13 @@ class File {
     // read len bytes, reading 0 bytes is invalid
     HRESULT Read(const uint32 len, byte *buf, uint32 *bytes_read);
     // read len bytes starting at position n, reading 0 bytes is invalid
-    HRESULT ReadAt(const uint32 offset, byte *buf, const uint32 len,
+    HRESULT ReadAt(const uint64 offset, byte *buf, const uint32 len,
                     const uint32 async_id, uint32 *bytes_read);
 
     // write len bytes, writing 0 bytes is invalid
     HRESULT Write(const byte *buf, const uint32 len, uint32 *bytes_written);
     // write len bytes, writing 0 bytes is invalid
-    HRESULT WriteAt(const uint32 offset, const byte *buf, const uint32 len,
+    HRESULT WriteAt(const uint64 offset, const byte *buf, const uint32 len,
                      const uint32 async_id, uint32 *bytes_written);
 
     // write buffer n times
@@ -126,16 +126,16 @@ class File {
                     uint32 *bytes_written);
 
     // zeros section of file
-    HRESULT ClearAt(const uint32 offset, const uint32 len,
-                     uint32 *bytes_written);
+    HRESULT ClearAt(const uint64 offset, const uint64 len,
+                     uint64 *bytes_written);
 
     // set length of file
     // if new length is greater than current length, new data is undefined
     // unless zero_data == true in which case the new data is zeroed.
-    HRESULT SetLength(const uint32 n, bool zero_data);
-    HRESULT ExtendInBlocks(const uint32 block_size, uint32 size_needed,
-                            uint32 *new_size, bool clear_new_space);
-    HRESULT GetLength(uint32 *len);
+    HRESULT SetLength(const uint64 n, bool zero_data);
+    HRESULT ExtendInBlocks(const uint32 block_size, uint64 size_needed,
+                            uint64 *new_size, bool clear_new_space);
+    HRESULT GetLength(uint64 *len);
 
     // Sets the last write time to the current time
     HRESULT Touch();
@@ -153,7 +153,7 @@ class File {
     // requires a file handle, which conflicts if the file is already opened
     // and locked]
     static HRESULT GetFileSizeUnopen(const TCHAR * filename,
-                                     uint32 * out_size);
+                                     uint64 * out_size);
 
     // Optimized function that gets the last write time and size
     static HRESULT GetLastWriteTimeAndSize(const TCHAR* file_path,
@@ -187,11 +187,11 @@ class File {
     CString file_name_;
     bool read_only_;
     bool sync_write_done_;
-    uint32 pos_;
+    uint64 pos_;
     uint32 encryption_seed_;
     uint32 sequence_id_;
 
-    static const int kMaxFileSize = std::numeric_limits<int32_t>::max();
+    static const int64 kMaxFileSize = std::numeric_limits<int64_t>::max();
 
     DISALLOW_COPY_AND_ASSIGN(File);
 };
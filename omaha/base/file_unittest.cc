@@ -13,7 +13,11 @@
 // limitations under the License.
 // ========================================================================
 
+#include <winioctl.h>
+#include <vector>
+
 #include "base/rand_util.h"
+#include "omaha/base/error.h"
 #include "omaha/base/file.h"
 #include "omaha/base/logging.h"
 #include "omaha/base/path.h"
@@ -22,6 +26,7 @@
 #include "omaha/base/timer.h"
 #include "omaha/base/utils.h"
 #include "omaha/testing/unit_test.h"
+#include "omaha/third_party/smartany/scoped_any.h"
 
 namespace omaha {
 
@@ -35,6 +40,26 @@ namespace {
 #define kIEBrowserQuotedExe \
   _T("\"") kIEBrowserExe _T("\"")
 
+const uint64 kFourGigabytes = 4ULL * 1024 * 1024 * 1024;
+
+// Creates an empty sparse file, so that the tests of large files do not
+// write gigabytes to the disk.
+HRESULT CreateSparseFile(const CString& filename) {
+  scoped_hfile file(::CreateFile(filename, GENERIC_READ | GENERIC_WRITE, 0,
+                                 NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+                                 NULL));
+  if (!file) {
+    return HRESULTFromLastError();
+  }
+
+  DWORD bytes_returned = 0;
+  if (!::DeviceIoControl(get(file), FSCTL_SET_SPARSE, NULL, 0, NULL, 0,
+                         &bytes_returned, NULL)) {
+    return HRESULTFromLastError();
+  }
+  return S_OK;
+}
+
 }  // namespace
 
 void SimpleTest(bool async) {
@@ -227,9 +252,9 @@ TEST(FileTest, File) {
     CString known_file2(windows_dir + L"\\REGEDIT.EXE");
     CString temp_file1(temp_dir + L"\\FOO.TMP");
     CString temp_file2(temp_dir + L"\\BAR.TMP");
-    uint32 known_size1 = 0;
-    uint32 known_size2 = 0;
-    uint32 temp_size1 = 0;
+    uint64 known_size1 = 0;
+    uint64 known_size2 = 0;
+    uint64 temp_size1 = 0;
 
     // Start with neither file existing
     if (File::Exists(temp_file1))
@@ -426,4 +451,58 @@ TEST(FileTest, AreFilesIdentical) {
   EXPECT_FALSE(File::AreFilesIdentical(known_file1, known_file2));
 }
 
+TEST(FileTest, LargeFile) {
+  const CString filename(GetTempFilename(_T("FLT")));
+  ASSERT_FALSE(filename.IsEmpty());
+  ASSERT_SUCCEEDED(CreateSparseFile(filename));
+
+  const uint64 kFileSize = kFourGigabytes + 1024 * 1024;
+  const uint64 kOffset = kFourGigabytes + 10;
+  const byte kData[] = {1, 2, 3, 4, 5};
+
+  File file;
+  ASSERT_SUCCEEDED(file.Open(filename, true, false));
+  EXPECT_SUCCEEDED(file.SetLength(kFileSize, false));
+
+  uint64 length = 0;
+  EXPECT_SUCCEEDED(file.GetLength(&length));
+  EXPECT_EQ(kFileSize, length);
+
+  // The offsets past 4 GB do not wrap around to the start of the file.
+  uint32 bytes_written = 0;
+  EXPECT_SUCCEEDED(file.WriteAt(kOffset, kData, arraysize(kData), 0,
+                                &bytes_written));
+  EXPECT_EQ(arraysize(kData), bytes_written);
+
+  byte data[arraysize(kData)] = {0};
+  uint32 bytes_read = 0;
+  EXPECT_SUCCEEDED(file.ReadAt(kOffset, data, arraysize(data), 0,
+                               &bytes_read));
+  EXPECT_EQ(arraysize(data), bytes_read);
+  EXPECT_EQ(0, memcmp(kData, data, arraysize(kData)));
+
+  EXPECT_SUCCEEDED(file.ReadAt(kOffset - kFourGigabytes, data,
+                               arraysize(data), 0, &bytes_read));
+  EXPECT_EQ(0, data[0]);
+
+  uint64 size_on_disk = 0;
+  EXPECT_SUCCEEDED(file.GetSizeOnDisk(&size_on_disk));
+  EXPECT_EQ(kFileSize, size_on_disk);
+
+  EXPECT_SUCCEEDED(file.SetLength(kOffset + 1, false));
+  EXPECT_SUCCEEDED(file.GetLength(&length));
+  EXPECT_EQ(kOffset + 1, length);
+  EXPECT_SUCCEEDED(file.Close());
+
+  uint64 file_size = 0;
+  EXPECT_SUCCEEDED(File::GetFileSizeUnopen(filename, &file_size));
+  EXPECT_EQ(kOffset + 1, file_size);
+
+  // A file this large does not fit in a buffer.
+  std::vector<byte> buffer;
+  EXPECT_EQ(MEM_E_INVALID_SIZE, ReadEntireFile(filename, 0, &buffer));
+
+  EXPECT_SUCCEEDED(File::Remove(filename));
+}
+
 }  // namespace omaha
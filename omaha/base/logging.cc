@@ -1087,7 +1087,7 @@ bool FileLogWriter::CreateLoggingMutex() {
 }
 
 bool FileLogWriter::CreateLoggingFile() {
-  uint32 file_size(0);
+  uint64 file_size(0);
   File::GetFileSizeUnopen(file_name_, &file_size);
   if (file_size > max_file_size_) {
     ArchiveLoggingFile();
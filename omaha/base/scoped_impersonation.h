@@ -168,6 +168,18 @@ R CallAsSelfAndImpersonate3(T* object, R (T::*pm)(P1, P2, P3),
   return (object->*pm)(p1, p2, p3);
 }
 
+// Callers for function members with four arguments.
+template <class T, typename P1, typename P2, typename P3, typename P4,
+          typename R>
+R CallAsSelfAndImpersonate4(T* object, R (T::*pm)(P1, P2, P3, P4),
+                            P1 p1, P2 p2, P3 p3, P4 p4) {
+  ASSERT1(object);
+  ASSERT1(pm);
+
+  scoped_revert_to_self revert_to_self;
+  return (object->*pm)(p1, p2, p3, p4);
+}
+
 }  // namespace omaha
 
 #endif  // OMAHA_BASE_SCOPED_IMPERSONATION_H_
@@ -48,6 +48,7 @@ static void HMAC_init(LITE_HMAC_CTX* ctx, const void* key, unsigned int len) {
 void HMAC_SHA256_init(LITE_HMAC_CTX* ctx, const void* key, unsigned int len) {
   SHA256_init(&ctx->hash);
   HMAC_init(ctx, key, len);
+  ctx->key = NULL;
 }
 
 const uint8_t* HMAC_final(LITE_HMAC_CTX* ctx) {
@@ -55,9 +56,55 @@ const uint8_t* HMAC_final(LITE_HMAC_CTX* ctx) {
   memcpy(digest, HASH_final(&ctx->hash),
          (HASH_size(&ctx->hash) <= sizeof(digest) ?
              HASH_size(&ctx->hash) : sizeof(digest)));
-  HASH_init(&ctx->hash);
-  HASH_update(&ctx->hash, ctx->opad, sizeof(ctx->opad));
+  if (ctx->key) {
+    memcpy(&ctx->hash, &ctx->key->outer, sizeof(ctx->hash));
+    ctx->key = NULL;
+  } else {
+    HASH_init(&ctx->hash);
+    HASH_update(&ctx->hash, ctx->opad, sizeof(ctx->opad));
+    always_memset(&ctx->opad[0], 0, sizeof(ctx->opad));  // wipe key
+  }
   HASH_update(&ctx->hash, digest, HASH_size(&ctx->hash));
-  always_memset(&ctx->opad[0], 0, sizeof(ctx->opad));  // wipe key
   return HASH_final(&ctx->hash);
 }
+
+void HMAC_SHA256_key_init(HMAC_KEY* key, const void* key_data,
+                          unsigned int len) {
+  LITE_HMAC_CTX ctx;
+  HMAC_SHA256_init(&ctx, key_data, len);
+  memcpy(&key->inner, &ctx.hash, sizeof(key->inner));
+
+  SHA256_init(&key->outer);
+  HASH_update(&key->outer, ctx.opad, sizeof(ctx.opad));
+
+  always_memset(&ctx, 0, sizeof(ctx));  // wipe key
+}
+
+void HMAC_key_wipe(HMAC_KEY* key) {
+  always_memset(key, 0, sizeof(*key));
+}
+
+void HMAC_start(LITE_HMAC_CTX* ctx, const HMAC_KEY* key) {
+  memcpy(&ctx->hash, &key->inner, sizeof(ctx->hash));
+  ctx->key = key;
+}
+
+void HMAC_updatev(LITE_HMAC_CTX* ctx, const HMAC_IOVEC* iov, size_t count) {
+  size_t i;
+  for (i = 0; i < count; ++i) {
+    if (iov[i].len) {
+      HASH_update(&ctx->hash, iov[i].data, iov[i].len);
+    }
+  }
+}
+
+const uint8_t* HMAC_SHA256_keyed(const HMAC_KEY* key,
+                                 const HMAC_IOVEC* iov,
+                                 size_t count,
+                                 uint8_t* mac) {
+  LITE_HMAC_CTX ctx;
+  HMAC_start(&ctx, key);
+  HMAC_updatev(&ctx, iov, count);
+  memcpy(mac, HMAC_final(&ctx), SHA256_DIGEST_SIZE);
+  return mac;
+}
@@ -16,6 +16,7 @@
 #ifndef OMAHA_BASE_SECURITY_HMAC_H_
 #define OMAHA_BASE_SECURITY_HMAC_H_
 
+#include <stddef.h>
 #include <stdint.h>
 #include "hash-internal.h"
 
@@ -23,14 +24,49 @@
 extern "C" {
 #endif
 
+// Hash states after absorbing the inner and outer padded key blocks. Deriving
+// them once lets every later MAC under the same key skip both key blocks. A
+// key is not modified by HMAC_start, so it may be shared between threads.
+typedef struct HMAC_KEY {
+  HASH_CTX inner;
+  HASH_CTX outer;
+} HMAC_KEY;
+
 typedef struct LITE_HMAC_CTX {
   HASH_CTX hash;
   uint8_t opad[64];
+  const HMAC_KEY* key;  // Set by HMAC_start, NULL after HMAC_*_init.
 } LITE_HMAC_CTX;
 
+// One piece of a message passed to HMAC_updatev.
+typedef struct HMAC_IOVEC {
+  const void* data;
+  size_t len;
+} HMAC_IOVEC;
+
 void HMAC_SHA256_init(LITE_HMAC_CTX* ctx, const void* key, unsigned int len);
 const uint8_t* HMAC_final(LITE_HMAC_CTX* ctx);
 
+void HMAC_SHA256_key_init(HMAC_KEY* key, const void* key_data,
+                          unsigned int len);
+
+// Clears the cached pad states, which are as sensitive as the key itself.
+void HMAC_key_wipe(HMAC_KEY* key);
+
+// Starts a MAC with a key from HMAC_SHA256_key_init. |key| must outlive the
+// call to HMAC_final.
+void HMAC_start(LITE_HMAC_CTX* ctx, const HMAC_KEY* key);
+
+// Same as calling HMAC_update for each of the |count| pieces in order.
+void HMAC_updatev(LITE_HMAC_CTX* ctx, const HMAC_IOVEC* iov, size_t count);
+
+// Convenience method. MACs the |count| pieces of |iov| under |key| and writes
+// the result to |mac|. Returns mac address.
+const uint8_t* HMAC_SHA256_keyed(const HMAC_KEY* key,
+                                 const HMAC_IOVEC* iov,
+                                 size_t count,
+                                 uint8_t* mac);
+
 #define HMAC_update(ctx, data, len) HASH_update(&(ctx)->hash, data, len)
 #define HMAC_size(ctx) HASH_size(&(ctx)->hash)
 
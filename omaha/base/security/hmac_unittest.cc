@@ -14,8 +14,11 @@
 // ========================================================================
 
 #include <string>
+#include <vector>
 
+#include "omaha/base/highres_timer-win32.h"
 #include "omaha/base/security/hmac.h"
+#include "omaha/base/security/sha256.h"
 #include "omaha/base/string.h"
 #include "omaha/testing/unit_test.h"
 
@@ -120,4 +123,86 @@ TEST_F(HmacTest, RFC2202andRFC4131) {
   }
 }
 
+TEST_F(HmacTest, KeyedRFC4131) {
+  for (const struct KAT* katp = KATS; katp->key; ++katp) {
+    if (!katp->sha256) {
+      continue;
+    }
+    string key = katp->key[0] ==
+        'x' ? omaha::a2b_hex(katp->key + 1) : katp->key;
+    string data = katp->data[0] ==
+        'x' ? omaha::a2b_hex(katp->data + 1) : katp->data;
+
+    HMAC_KEY hmac_key;
+    HMAC_SHA256_key_init(&hmac_key, key.data(), key.size());
+
+    // The same key is reused for every split of the message, including empty
+    // pieces.
+    for (size_t split = 0; split <= data.size(); ++split) {
+      const HMAC_IOVEC iov[] = {
+        {data.data(), split},
+        {nullptr, 0},
+        {data.data() + split, data.size() - split},
+      };
+      uint8_t mac[SHA256_DIGEST_SIZE] = {0};
+      EXPECT_EQ(mac, HMAC_SHA256_keyed(&hmac_key, iov, arraysize(iov), mac));
+      EXPECT_EQ(omaha::b2a_hex(reinterpret_cast<const char*>(mac),
+                               sizeof(mac)),
+                katp->sha256);
+    }
+
+    LITE_HMAC_CTX hmac;
+    HMAC_start(&hmac, &hmac_key);
+    for (size_t i = 0; i < data.size(); ++i) {
+      HMAC_update(&hmac, &data[i], 1);
+    }
+    EXPECT_EQ(omaha::b2a_hex(
+        reinterpret_cast<const char*>(HMAC_final(&hmac)),
+        HMAC_size(&hmac)),
+        katp->sha256);
+
+    HMAC_key_wipe(&hmac_key);
+  }
+}
+
+TEST_F(HmacTest, DISABLED_SmallMessageBenchmark) {
+  const size_t kIterations = 200000;
+  const uint8_t kKey[32] = {0x0b};
+  const size_t kSizes[] = {16, 64, 256, 1024};
+
+  HMAC_KEY hmac_key;
+  HMAC_SHA256_key_init(&hmac_key, kKey, sizeof(kKey));
+
+  for (size_t i = 0; i < arraysize(kSizes); ++i) {
+    const std::vector<uint8_t> message(kSizes[i], 0x5a);
+    const HMAC_IOVEC iov[] = {{&message.front(), message.size()}};
+    uint8_t mac[SHA256_DIGEST_SIZE] = {0};
+
+    for (int keyed = 0; keyed <= 1; ++keyed) {
+      omaha::HighresTimer timer;
+      for (size_t n = 0; n < kIterations; ++n) {
+        if (keyed) {
+          HMAC_SHA256_keyed(&hmac_key, iov, arraysize(iov), mac);
+        } else {
+          LITE_HMAC_CTX hmac;
+          HMAC_SHA256_init(&hmac, kKey, sizeof(kKey));
+          HMAC_update(&hmac, &message.front(), message.size());
+          memcpy(mac, HMAC_final(&hmac), sizeof(mac));
+        }
+      }
+      const ULONGLONG elapsed_ms =
+          timer.GetElapsedMs() > 0 ? timer.GetElapsedMs() : 1;
+
+      printf("[%-6s] %5zu bytes x %zu: %6llu ms, %9.1f MACs/s\n",
+             keyed ? "keyed" : "init",
+             kSizes[i],
+             kIterations,
+             elapsed_ms,
+             kIterations * 1000.0 / elapsed_ms);
+    }
+  }
+
+  HMAC_key_wipe(&hmac_key);
+}
+
 }  // namespace
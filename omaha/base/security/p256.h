@@ -135,6 +135,28 @@ void p256_points_mul_vartime(
     const p256_int *in_x, const p256_int *in_y,
     p256_int *out_x, p256_int *out_y);
 
+// Number of odd multiples held in a p256_precomp.
+#define P256_PRECOMP_POINTS 16
+
+// The odd multiples P, 3P, ..., (2 * P256_PRECOMP_POINTS - 1)P of a point P,
+// in affine coordinates scaled by 2^256 mod p. Building it is about as
+// expensive as one p256_points_mul_vartime, so it pays off for a public key
+// that verifies more than one signature.
+typedef struct {
+  p256_int x[P256_PRECOMP_POINTS];
+  p256_int y[P256_PRECOMP_POINTS];
+} p256_precomp;
+
+// table := odd multiples of {in_x,in_y}, which must be on the curve.
+void p256_precomp_init(const p256_int *in_x, const p256_int *in_y,
+                       p256_precomp *table);
+
+// {out_x,out_y} := n1G + n2P, where table was built from P.
+void p256_points_mul_precomp_vartime(
+    const p256_int *n1, const p256_int *n2,
+    const p256_precomp *table,
+    p256_int *out_x, p256_int *out_y);
+
 // Return whether point {x,y} is on curve.
 int p256_is_valid_point(const p256_int* x, const p256_int* y);
 
@@ -14,7 +14,8 @@
 // ========================================================================
 //
 // This is an implementation of the P256 elliptic curve group. It's written to
-// be portable 32-bit, although it's still constant-time.
+// be portable 32-bit, although it's still constant-time. On 64-bit targets the
+// field arithmetic uses 64-bit limbs instead; see P256_FIELD_64BIT.
 //
 // WARNING: Implementing these functions in a constant-time manner is far from
 //          obvious. Be careful when touching this code.
@@ -31,6 +32,187 @@ typedef uint32_t u32;
 typedef int32_t s32;
 typedef uint64_t u64;
 
+/* P256_FIELD_64BIT selects the field element representation. By default
+ * targets with a 64x64->128-bit multiply use four 64-bit limbs, which needs a
+ * quarter of the limb products of the nine 32-bit limb form. Define it to 0 or
+ * 1 to override. */
+#ifndef P256_FIELD_64BIT
+#if defined(_M_X64) || defined(_M_ARM64) || \
+    ((defined(__x86_64__) || defined(__aarch64__)) && defined(__SIZEOF_INT128__))
+#define P256_FIELD_64BIT 1
+#else
+#define P256_FIELD_64BIT 0
+#endif
+#endif
+
+#if P256_FIELD_64BIT
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/* Our field elements are represented as four 64-bit limbs in little-endian
+ * order, always fully reduced modulo p.
+ *
+ * The values stored in an felem are in Montgomery form. So the value |y| is
+ * stored as (y*R) mod p, where p is the P-256 prime and R is 2**256.
+ */
+typedef u64 limb;
+#define NLIMBS 4
+typedef limb felem[NLIMBS];
+
+/* kOne is the number 1 as an felem. It's 2**256 mod p. */
+static const felem kOne = {
+    0x0000000000000001ULL, 0xffffffff00000000ULL,
+    0xffffffffffffffffULL, 0x00000000fffffffeULL
+};
+static const felem kZero = {0};
+static const felem kP = {
+    0xffffffffffffffffULL, 0x00000000ffffffffULL,
+    0x0000000000000000ULL, 0xffffffff00000001ULL
+};
+/* kRR is 2**512 mod p, which to_montgomery multiplies by. */
+static const felem kRR = {
+    0x0000000000000003ULL, 0xfffffffbffffffffULL,
+    0xfffffffffffffffeULL, 0x00000004fffffffdULL
+};
+
+/* kPrecomputed holds the same two tables of multiples of G as in the 32-bit
+ * representation below, with each coordinate in the 64-bit representation. */
+static const limb kPrecomputed[NLIMBS * 2 * 15 * 2] = {
+    0x79e730d418a9143cULL, 0x75ba95fc5fedb601ULL, 0x79fb732b77622510ULL, 0x18905f76a53755c6ULL,
+    0xddf25357ce95560aULL, 0x8b4ab8e4ba19e45cULL, 0xd2e88688dd21f325ULL, 0x8571ff1825885d85ULL,
+    0x4f922fc516a0d2bbULL, 0x0d5cc16c1a623499ULL, 0x9241cf3a57c62c8bULL, 0x2f5e6961fd1b667fULL,
+    0x5c15c70bf5a01797ULL, 0x3d20b44d60956192ULL, 0x04911b37071fdb52ULL, 0xf648f9168d6f0f7bULL,
+    0x9e566847e137bbbcULL, 0xe434469e8a6a0becULL, 0xb1c4276179d73463ULL, 0x5abe0285133d0015ULL,
+    0x92aa837cc04c7dabULL, 0x573d9f4c43260c07ULL, 0x0c93156278e6cc37ULL, 0x94bb725b6b6f7383ULL,
+    0x62a8c244bfe20925ULL, 0x91c19ac38fdce867ULL, 0x5a96a5d5dd387063ULL, 0x61d587d421d324f6ULL,
+    0xe87673a2a37173eaULL, 0x2384800853778b65ULL, 0x10f8441e05bab43eULL, 0xfa11fe124621efbeULL,
+    0x1c891f2b2cb19ffdULL, 0x01ba8d5bb1923c23ULL, 0xb6d03d678ac5ca8eULL, 0x586eb04c1f13bedcULL,
+    0x0c35c6e527e8ed09ULL, 0x1e81a33c1819ede2ULL, 0x278fd6c056c652faULL, 0x19d5ac0870864f11ULL,
+    0x62577734d2b533d5ULL, 0x673b8af6a1bdddc0ULL, 0x577e7c9aa79ec293ULL, 0xbb6de651c3b266b1ULL,
+    0xe7e9303ab65259b3ULL, 0xd6a0afd3d03a7480ULL, 0xc5ac83d19b3cfc27ULL, 0x60b4619a5d18b99bULL,
+    0xbd6a38e11ae5aa1cULL, 0xb8b7652b49e73658ULL, 0x0b130014ee5f87edULL, 0x9d0f27b2aeebffcdULL,
+    0xca9246317a730a55ULL, 0x9c955b2fddbbc83aULL, 0x07c1dfe0ac019a71ULL, 0x244a566d356ec48dULL,
+    0x56f8410ef4f8b16aULL, 0x97241afec47b266aULL, 0x0a406b8e6d9c87c1ULL, 0x803f3e02cd42ab1bULL,
+    0x7f0309a804dbec69ULL, 0xa83b85f73bbad05fULL, 0xc6097273ad8e197fULL, 0xc097440e5067adc1ULL,
+    0x846a56f2c379ab34ULL, 0xa8ee068b841df8d1ULL, 0x20314459176c68efULL, 0xf1af32d5915f1f30ULL,
+    0x99c375315d75bd50ULL, 0x837cffbaf72f67bcULL, 0x0613a41848d7723fULL, 0x23d0f130e2d41c8bULL,
+    0xed93e225d5be5a2bULL, 0x6fe799835934f3c6ULL, 0x4314092622626ffcULL, 0x50bbb4d97990216aULL,
+    0x378191c6e57ec63eULL, 0x65422c40181dcdb2ULL, 0x41a8099b0236e0f6ULL, 0x2b10011801fe49c3ULL,
+    0xfc68b5c59b391593ULL, 0xc385f5a2598270fcULL, 0x7144f3aad19adcbbULL, 0xdd55899983fbae0cULL,
+    0x93b88b8e74b82ff4ULL, 0xd2e03c4071e734c9ULL, 0x9a7a9eaf43c0322aULL, 0xe6e4c551149d6041ULL,
+    0x5fe14bfe80ec21feULL, 0xf6ce116ac255be82ULL, 0x98bc5a072f4a5d67ULL, 0xfad27148db7e63afULL,
+    0x90c0b6ac29ab05b3ULL, 0x37a9a83c4e251ae6ULL, 0x0a7dc875c2aade7dULL, 0x77387de39f0e1a84ULL,
+    0x1e9ecc49a56c0dd7ULL, 0xa5cffcd846086c74ULL, 0x8f7a1408f505aeceULL, 0xb37b85c0bef0c47eULL,
+    0x3596b6e4cc0e6a8fULL, 0xfd6d4bbf6b388f23ULL, 0xaba453fac39cef4eULL, 0x9c135ac8f9f628d5ULL,
+    0x0a1c729495c8f8beULL, 0x2961c4803bf362bfULL, 0x9e418403df63d4acULL, 0xc109f9cb91ece900ULL,
+    0xc2d095d058945705ULL, 0xb9083d96ddeb85c0ULL, 0x84692b8d7a40449bULL, 0x9bc3344f2eee1ee1ULL,
+    0x0d5ae35642913074ULL, 0x55491b2748a542b1ULL, 0x469ca665b310732aULL, 0x29591d525f1a4cc1ULL,
+    0xe76f5b6bb84f983fULL, 0xbe7eef419f5f84e1ULL, 0x1200d49680baa189ULL, 0x6376551f18ef332cULL,
+    0x202886024147519aULL, 0xd0981eac26b372f0ULL, 0xa9d4a7caa785ebc8ULL, 0xd953c50ddbdf58e9ULL,
+    0x9d6361ccfd590f8fULL, 0x72e9626b44e6c917ULL, 0x7fd9611022eb64cfULL, 0x863ebb7e9eb288f3ULL,
+    0x4fe7ee31b0e63d34ULL, 0xf4600572a9e54fabULL, 0xc0493334d5e7b5a4ULL, 0x8589fb9206d54831ULL,
+    0xaa70f5cc6583553aULL, 0x0879094ae25649e5ULL, 0xcc90450710044652ULL, 0xebb0696d02541c4fULL,
+    0xabbaa0c03b89da99ULL, 0xa6f2d79eb8284022ULL, 0x27847862b81c05e8ULL, 0x337a4b5905e54d63ULL,
+    0x3c67500d21f7794aULL, 0x207005b77d6d7f61ULL, 0x0a5a378104cfd6e8ULL, 0x0d65e0d5f4c2fbd6ULL,
+    0xd433e50f6d3549cfULL, 0x6f33696ffacd665eULL, 0x695bfdacce11fcb4ULL, 0x810ee252af7c9860ULL,
+    0x65450fe17159bb2cULL, 0xf7dfbebe758b357bULL, 0x2b057e74d69fea72ULL, 0xd485717a92731745ULL,
+    0xce1f69bbe83f7669ULL, 0x09f8ae8272877d6bULL, 0x9548ae543244278dULL, 0x207755dee3c2c19cULL,
+    0x87bd61d96fef1945ULL, 0x18813cefb12d28c3ULL, 0x9fbcd1d672df64aaULL, 0x48dc5ee57154b00dULL,
+    0xef0f469ef49a3154ULL, 0x3e85a5956e2b2e9aULL, 0x45aaec1eaa924a9cULL, 0xaa12dfc8a09e4719ULL,
+    0x26f272274df69f1dULL, 0xe0e4c82ca2ff5e73ULL, 0xb9d8ce73b7a9dd44ULL, 0x6c036e73e48ca901ULL,
+    0xe1e421e1a47153f0ULL, 0xb86c3b79920418c9ULL, 0x93bdce87705d7672ULL, 0xf25ae793cab79a77ULL,
+    0x1f3194a36d869d0cULL, 0x9d55c8824986c264ULL, 0x49fb5ea3096e945eULL, 0x39b8e65313db0a3eULL,
+    0xe3417bc035d0b34aULL, 0x440b386b8327c0a7ULL, 0x8fb7262dac0362d1ULL, 0x2c41114ce0cdf943ULL,
+    0x2ba5cef1ad95a0b1ULL, 0xc09b37a867d54362ULL, 0x26d6cdd201e486c9ULL, 0x20477abf42ff9297ULL,
+    0x0f121b41bc0a67d2ULL, 0x62d4760a444d248aULL, 0x0e044f1d659b4737ULL, 0x08fde365250bb4a8ULL,
+    0xaceec3da848bf287ULL, 0xc2a62182d3369d6eULL, 0x3582dfdc92449482ULL, 0x2f7e2fd2565d6cd7ULL,
+    0x0a0122b5178a876bULL, 0x51ff96ff085104b4ULL, 0x050b31ab14f29f76ULL, 0x84abb28b5f87d4e6ULL,
+    0xd5ed439f8270790aULL, 0x2d6cb59d85e3f46bULL, 0x75f55c1b6c1e2212ULL, 0xe5436f6717655640ULL,
+    0xc2965ecc9aeb596dULL, 0x01ea03e7023c92b4ULL, 0x4704b4b62e013961ULL, 0x0ca8fd3f905ea367ULL,
+    0x92523a42551b2b61ULL, 0x1eb7a89c390fcd06ULL, 0xe7f1d2be0392a63eULL, 0x96dca2644ddb0c33ULL,
+    0x231c210e15339848ULL, 0xe87a28e870778c8dULL, 0x9d1de6616956e170ULL, 0x4ac3c9382bb09c0bULL,
+    0x19be05516998987dULL, 0x8b2376c4ae09f4d6ULL, 0x1de0b7651a3f933dULL, 0x380d94c7e39705f4ULL,
+    0x3685954b8c31c31dULL, 0x68533d005bf21a0cULL, 0x0bd7626e75c79ec9ULL, 0xca17754742c69d54ULL,
+    0xcc6edafff6d2dbb2ULL, 0xfd0d8cbd174a9d18ULL, 0x875e8793aa4578e8ULL, 0xa976a7139cab2ce6ULL,
+    0xce37ab11b43ea1dbULL, 0x0a7ff1a95259d292ULL, 0x851b02218f84f186ULL, 0xa7222beadefaad13ULL,
+    0xa2ac78ec2b0a9144ULL, 0x5a024051f2fa59c5ULL, 0x91d1eca56147ce38ULL, 0xbe94d523bc2ac690ULL,
+    0x2d8daefd79ec1a0fULL, 0x3bbcd6fdceb39c97ULL, 0xf5575ffc58f61a95ULL, 0xdbd986c4adf7b420ULL,
+    0x81aa881415f39eb7ULL, 0x6ee2fcf5b98d976cULL, 0x5465475dcf2f717dULL, 0x8e24d3c46860bbd0ULL,
+};
+
+/* kOddMultiplesG holds G, 3G, 5G, ..., 63G as affine (x,y) felem pairs for the
+ * width-7 wNAF used by points_mul_wnaf_vartime. */
+static const limb kOddMultiplesG[NLIMBS * 2 * 32] = {
+    0x79e730d418a9143cULL, 0x75ba95fc5fedb601ULL, 0x79fb732b77622510ULL, 0x18905f76a53755c6ULL,
+    0xddf25357ce95560aULL, 0x8b4ab8e4ba19e45cULL, 0xd2e88688dd21f325ULL, 0x8571ff1825885d85ULL,
+    0xffac3f904eebc127ULL, 0xb027f84a087d81fbULL, 0x66ad77dd87cbbc98ULL, 0x26936a3fb6ff747eULL,
+    0xb04c5c1fc983a7ebULL, 0x583e47ad0861fe1aULL, 0x788208311a2ee98eULL, 0xd5f06a29e587cc07ULL,
+    0xbe1b8aaec45c61f5ULL, 0x90ec649a94b9537dULL, 0x941cb5aad076c20cULL, 0xc9079605890523c8ULL,
+    0xeb309b4ae7ba4f10ULL, 0x73c568efe5eb882bULL, 0x3540a9877e7a1f68ULL, 0x73a076bb2dd1e916ULL,
+    0x0746354ea0173b4fULL, 0x2bd20213d23c00f7ULL, 0xf43eaab50c23bb08ULL, 0x13ba5119c3123e03ULL,
+    0x2847d0303f5b9d4dULL, 0x6742f2f25da67bddULL, 0xef933bdc77c94195ULL, 0xeaedd9156e240867ULL,
+    0x75c96e8f264e20e8ULL, 0xabe6bfed59a7a841ULL, 0x2cc09c0444c8eb00ULL, 0xe05b3080f0c4e16bULL,
+    0x1eb7777aa45f3314ULL, 0x56af7bedce5d45e3ULL, 0x2b6e019a88b12f1aULL, 0x086659cdfd835f9bULL,
+    0xea7d260a6245e404ULL, 0x9de407956e7fdfe0ULL, 0x1ff3a4158dac1ab5ULL, 0x3e7090f1649c9073ULL,
+    0x1a7685612b944e88ULL, 0x250f939ee57f61c8ULL, 0x0c0daa891ead643dULL, 0x68930023e125b88eULL,
+    0xccc425634b2ed709ULL, 0x0e356769856fd30dULL, 0xbcbcd43f559e9811ULL, 0x738477ac5395b759ULL,
+    0x35752b90c00ee17fULL, 0x68748390742ed2e3ULL, 0x7cd06422bd1f5bc1ULL, 0xfbc08769c9e7b797ULL,
+    0x72bcd8b7bc60055bULL, 0x03cc23ee56e27e4bULL, 0xee337424e4819370ULL, 0xe2aa0e430ad3da09ULL,
+    0x40b8524f6383c45dULL, 0xd766355442a41b25ULL, 0x64efa6de778a4797ULL, 0x2042170a7079adf4ULL,
+    0x97091dcbd53c5c9dULL, 0xf17624b6ac0a177bULL, 0xb0f139752cfe2dffULL, 0xc1a35c0a6c7a574eULL,
+    0x227d314693e79987ULL, 0x0575bf30e89cb80eULL, 0x2f4e247f0d1883bbULL, 0xebd512263274c3d0ULL,
+    0xfea912baa5659ae8ULL, 0x68363aba25e1a16eULL, 0xb8842277752c41acULL, 0xfe545c282897c3fcULL,
+    0x2d36e9e7dc4c696bULL, 0x5806244afba977c5ULL, 0x85665e9be39508c1ULL, 0xf720ee256d12597bULL,
+    0x562e4cecc135b208ULL, 0x74e1b2654783f47dULL, 0x6d2a506c5a3f3b30ULL, 0xecead9f4c16762fcULL,
+    0xf29dd4b2e286e5b9ULL, 0x1b0fadc083bb3c61ULL, 0x7a75023e7fac29a4ULL, 0xc086d5f1c9477fa3ULL,
+    0xf4f876532de45068ULL, 0x37c7a7e89e2e1f6eULL, 0xd0825fa2a3584069ULL, 0xaf2cea7c1727bf42ULL,
+    0x0360a4fb9e4785a9ULL, 0xe5fda49c27299f4aULL, 0x48068e1371ac2f71ULL, 0x83d0687b9077666fULL,
+    0xa4a319acd837879fULL, 0x6fc1b49eed6b67b0ULL, 0xe395993332f1f3afULL, 0x966742eb65432a2eULL,
+    0x4b8dc9feb4966228ULL, 0x96cc631243f43950ULL, 0x12068859c9b731eeULL, 0x7b948dc356f79968ULL,
+    0x042c2af497e2feb4ULL, 0xd36a42d7aebf7313ULL, 0x49d2c9eb084ffdd7ULL, 0x9f8aa54b2ef7c76aULL,
+    0x9200b7ba09895e70ULL, 0x3bd0c66fddb7fb58ULL, 0x2d97d10878eb4cbbULL, 0x2d431068d84bde31ULL,
+    0x5e5db46acb66e132ULL, 0xf1be963a0d925880ULL, 0x944a70270317b9e2ULL, 0xe266f95948603d48ULL,
+    0x98db66735c208899ULL, 0x90472447a2fb18a3ULL, 0x8a966939777c619fULL, 0x3798142a2a3be21bULL,
+    0xe2f73c696755ff89ULL, 0xdd3cf7e7473017e6ULL, 0x8ef5689d3cf7600dULL, 0x948dc4f8b1fc87b4ULL,
+    0xd9e9fe814ea53299ULL, 0x2d921ca298eb6028ULL, 0xfaecedfd0c9803fcULL, 0xf38ae8914d7b4745ULL,
+    0x871514560f664534ULL, 0x85ceae7c4b68f103ULL, 0xac09c4ae65578ab9ULL, 0x33ec6868f044b10cULL,
+    0x6ac4832b3a8ec1f1ULL, 0x5509d1285847d5efULL, 0xf909604f763f1574ULL, 0xb16c4303c32f63c4ULL,
+    0xfd16847fdec67ef5ULL, 0x742ee464233e76b7ULL, 0x0b8e4134efc2b4c8ULL, 0xca640b8642a3e521ULL,
+    0x653a01908ceb6aa9ULL, 0x313c300c547852d5ULL, 0x24e4ab126b237af7ULL, 0x2ba901628bb47af8ULL,
+    0x00467bc58cce08b5ULL, 0xb636458c7f178d55ULL, 0xc5748baea677d806ULL, 0x2763a387dfa394ebULL,
+    0xa12b448a7d3cebb6ULL, 0xe7adda3e6f20d850ULL, 0xf63ebce51558462cULL, 0x58b36143620088a8ULL,
+    0xa9d89488a059c142ULL, 0x6f5ae714ff0b9346ULL, 0x068f237d16fb3664ULL, 0x5853e4c4363186acULL,
+    0xe2d87d2363c52f98ULL, 0x2ec4a76681828876ULL, 0x47b864fae14e7b1cULL, 0x0c0bc0e569192408ULL,
+    0x624d60492ed22e91ULL, 0x6fdfe0b56f072822ULL, 0xeeca111539ce2271ULL, 0x98100a4fdb01614fULL,
+    0xb6b0daa2a35c628fULL, 0xb6f94d2ec87e9a47ULL, 0xc67732591d57d9ceULL, 0xf70bfeec03884a7bULL,
+    0x4ff23ffd248a7d06ULL, 0x80c5bfb4878873faULL, 0xb7d9ad9005745981ULL, 0x179c85db3db01994ULL,
+    0xba41b06261a6966cULL, 0x4d82d052eadce5a8ULL, 0x9e91cd3ba5e6a318ULL, 0x47795f4f95b2dda0ULL,
+    0x1ee426ccd5cd79bfULL, 0x0032940b946c6e18ULL, 0x1b1e8ae057477f58ULL, 0xe94f7d346d823278ULL,
+    0xc747cb96782ba21aULL, 0xc5254469f72b33a5ULL, 0x772ef6dec7f80c81ULL, 0xd73acbfe2cd9e6b5ULL,
+    0x283c7513caa76097ULL, 0x0a624fa936c83906ULL, 0x6b20afec715af2c7ULL, 0x4b969974eba78bfdULL,
+    0x220755ccd921d60eULL, 0x9b944e107baeca13ULL, 0x04819d515ded93d4ULL, 0x9bbff86e6dddfd27ULL,
+    0x21950b421ff6acd3ULL, 0xffe7048453dc6909ULL, 0xff4cd0b228766127ULL, 0xabdbe6084fb7db2bULL,
+    0x837c92285e1109e8ULL, 0x26147d27f4645b5aULL, 0x4d78f592f7818ed8ULL, 0xd394077ef247fa36ULL,
+    0x508cec1c3b3f64c9ULL, 0xe20bc0ba1e5edf3fULL, 0xda1deb852f4318d4ULL, 0xd20ebe0d5c3fa443ULL,
+    0x370b4ea773241ea3ULL, 0x61f1511c5e1a5f65ULL, 0x99a5e23d82681c62ULL, 0xd731e383a2f54c2dULL,
+    0x97359638546c4d8dULL, 0x5f9c3fc492f24679ULL, 0x912e8beda8c8acd9ULL, 0xec3a318d306634b0ULL,
+    0x80167f41c31cb264ULL, 0x3db82f6f522113f2ULL, 0xb155bcd2dcafe197ULL, 0xfba1da5943465283ULL,
+    0x258bbbf9e7305683ULL, 0x31eea5bf07ef5be6ULL, 0x0deb0e4a46c814c1ULL, 0x5cee8449a7b730ddULL,
+    0xeab495c5a0182bdeULL, 0xee759f879e27a6b4ULL, 0xc2cf6a6880e518caULL, 0x25e8013ff14cf3f4ULL,
+    0x3ec832e77acaca28ULL, 0x1bfeea57c7385b29ULL, 0x068212e3fd1eaf38ULL, 0xc13298306acf8cccULL,
+    0xb909f2db2aac9e59ULL, 0x5748060db661782aULL, 0xc5ab2632c79b7a01ULL, 0xda44c6c600017626ULL,
+    0x69d44ed65c46aa8eULL, 0x2100d5d3a8d063d1ULL, 0xcb9727eaa2d17c36ULL, 0x4c2bab1b8add53b7ULL,
+    0xa084e90c15426704ULL, 0x778afcd3a837ebeaULL, 0x6651f7017ce477f8ULL, 0xa062499846fb7a8bULL,
+    0x3667eb1a7f4c04ccULL, 0x59556621a9404f84ULL, 0x71cdf6537eceb50aULL, 0x994a44a69b8335faULL,
+    0xd7faf819dbeb9b69ULL, 0x473c5680eed4350dULL, 0xb6658466da44bba2ULL, 0x0d1bc780872bdbf3ULL,
+    0xb8d3d9319ff91fe5ULL, 0x039c4800f0518eedULL, 0x95c376329182cb26ULL, 0x0763a43482fc568dULL,
+    0x707c04d5383e76baULL, 0xac98b930824e8197ULL, 0x92bf7c8f91230de0ULL, 0x90876a0140959b70ULL,
+};
+
+#else  /* P256_FIELD_64BIT */
+
 /* Our field elements are represented as nine 32-bit limbs.
  *
  * The value of an felem (field element) is:
@@ -164,9 +346,297 @@ static const limb kPrecomputed[NLIMBS * 2 * 15 * 2] = {
     0xbe73d6f, 0xaa88141, 0xd976c81, 0x7e7a9cc, 0x18beb771, 0xd773cbd, 0x13f51951, 0x9d0c177, 0x1c49a78,
 };
 
+/* kOddMultiplesG holds G, 3G, 5G, ..., 63G as affine (x,y) felem pairs for the
+ * width-7 wNAF used by points_mul_wnaf_vartime. */
+static const limb kOddMultiplesG[NLIMBS * 2 * 32] = {
+    0x11522878, 0xe730d41, 0xdb60179, 0x4afe2ff, 0x12883add, 0xcaddd88, 0x119e7edc, 0xd4a6eab, 0x3120bee,
+    0x1d2aac15, 0xf25357c, 0x19e45cdd, 0x5c721d0, 0x1992c5a5, 0xa237487, 0x154ba21, 0x14b10bb, 0xae3fe3,
+    0x1dd7824e, 0xac3f904, 0x1d81fbff, 0xfc25043, 0x1e4c5813, 0xf761f2e, 0x1f99ab5d, 0xf6dfee8, 0x4d26d47,
+    0x13074fd7, 0x4c5c1fc, 0x1fe1ab0, 0x23d6443, 0x14c72c1f, 0xc468bb, 0x1be2082, 0x4cb0f98, 0xabe0d45,
+    0x8b8c3eb, 0x1b8aaec, 0x19537dbe, 0x324d0a5, 0x1064876, 0x6ab41db, 0x1205072d, 0xc120a47, 0x920f2c0,
+    0xf749e20, 0x309b4ae, 0xb882beb, 0xb477f2f, 0xfb439e2, 0x61df9e8, 0x58d502a, 0x65ba3d2, 0xe740ed7,
+    0x2e769e, 0x46354ea, 0x1c00f707, 0x109e91, 0x1d8415e9, 0xad4308e, 0xfd0faa, 0x386247c, 0x2774a23,
+    0x1eb73a9b, 0x47d0303, 0x67bdd28, 0x7978eed, 0xcab3a1, 0xf71df25, 0x19dbe4ce, 0xbdc4810, 0xd5dbb22,
+    0xc9c41d1, 0xc96e8f2, 0x7a84175, 0x5ff66cd, 0x158055f3, 0x111323, 0x1aab3027, 0x2e189c2, 0xc0b6610,
+    0x8be6628, 0xb7777aa, 0x1d45e31e, 0xbdf6e72, 0x178d2b57, 0x66a22c4, 0x6cadb80, 0xbfb06bf, 0x10ccb39,
+    0x48bc808, 0x7d260a6, 0x1fdfe0ea, 0x3cab73, 0xd5acef2, 0x5636b0, 0x1cc7fce9, 0x2c93920, 0x7ce121e,
+    0x17289d10, 0x7685612, 0x1f61c81a, 0xc9cf72b, 0x121e9287, 0xa247ab5, 0x383036a, 0x7c24b71, 0xd126004,
+    0x165dae12, 0xc425634, 0xfd30dcc, 0xb3b4c2b, 0xc08871a, 0xfd567a, 0x166f2f35, 0x8a72b6e, 0xe708ef5,
+    0x1dc2ff, 0x752b90c, 0xed2e335, 0x41c7fa1, 0xde0b43a, 0x8af47d, 0x5bf3419, 0x493cf6f, 0xf7810ed,
+    0x18c00ab7, 0xbcd8b7b, 0x27e4b72, 0x11f6eb7, 0x9b801e6, 0x939206, 0x25b8cdd, 0x715a7b4, 0xc5541c8,
+    0x70788ba, 0xb8524f6, 0x41b2540, 0x1aaa215, 0x3cbebb3, 0xb79de29, 0x1d193be9, 0x4e0f35b, 0x40842e1,
+    0xa78b93b, 0x91dcbd, 0xa177b97, 0x125b160, 0x16fff8bb, 0x5d4b3f8, 0x138c3c4e, 0x5d8f4ae, 0x8346b81,
+    0x7cf330f, 0x7d31469, 0x1cb80e22, 0xdf98344, 0x1dd82ba, 0x1fc3462, 0x13ebd389, 0xd64e987, 0xd7aa244,
+    0xacb35d1, 0xa912baa, 0x1a16efe, 0x1d5cd2f, 0xd6341b, 0x9ddd4b1, 0x1f0e2108, 0x1512f87, 0xfca8b85,
+    0x1898d2d7, 0x36e9e7d, 0x977c52d, 0x12253dd, 0x460ac03, 0xa6f8e54, 0x1ec15997, 0xbda24b2, 0xee41dc4,
+    0x26b6411, 0x2e4cecc, 0x3f47d56, 0xd93263c, 0x1d983a70, 0x1b168fc, 0x1efb4a94, 0xa82cec5, 0xd9d5b3e,
+    0x50dcb73, 0x9dd4b2e, 0x1b3c61f2, 0xd6e001d, 0x14d20d87, 0x8f9feb0, 0x8be9d40, 0x4928eff, 0x810dabe,
+    0x1bc8a0d1, 0xf876532, 0xe1f6ef4, 0xd3f40f1, 0x349be3, 0xe8a8d61, 0x10942097, 0x92e4f7e, 0x5e59d4f,
+    0x1c8f0b53, 0x60a4fb9, 0x99f4a03, 0xd24dd39, 0x17b8f2fe, 0x84dc6b0, 0x1bb201a3, 0x820eecc, 0x7a0d0f,
+    0x106f0f3f, 0xa319acd, 0xb67b0a4, 0xda4f36b, 0x19d7b7e0, 0x4cccbc7, 0xb98e566, 0x7ca8654, 0x2cce85d,
+    0x92cc450, 0x8dc9feb, 0x1439504b, 0x318921f, 0x18f74b66, 0x16726dc, 0x1a0481a2, 0x6adef32, 0xf7291b8,
+    0xfc5fd69, 0x2c2af49, 0x1f731304, 0x216b975, 0x1eebe9b5, 0x7ac213f, 0x1a7274b2, 0x75def8e, 0x3f154a9,
+    0x1312bce0, 0xb7ba0, 0x17fb5892, 0x6337eed, 0x65d9de8, 0x421e3ad, 0xc4b65f4, 0x1b097bc, 0x5a8620d,
+    0x16cdc265, 0x5db46ac, 0x1258805e, 0x4b1cc6c, 0x1cf178df, 0x9c0c5e, 0x1205129c, 0x390c07a, 0xc4cdf2b,
+    0x18411132, 0xdb66735, 0x1b18a398, 0x9223d17, 0x10cfc823, 0x4e5ddf1, 0x6e2a59a, 0x45477c4, 0x6f30285,
+    0xeabff13, 0xf73c696, 0x1017e6e2, 0x7bf3639, 0x1006ee9e, 0x274f3dd, 0xd03bd5a, 0x263f90f, 0x291b89f,
+    0x1d4a6533, 0xe9fe814, 0xb6028d9, 0xe510c7, 0x1fe16c9, 0x7f43260, 0x115ebb3b, 0x39af68e, 0xe715d12,
+    0x1ecc8a68, 0x1514560, 0x8f10387, 0x573e25b, 0x55cc2e7, 0x2b9955e, 0x32b0271, 0x1e08962, 0x67d8d0d,
+    0x151d83e3, 0xc4832b3, 0x7d5ef6a, 0xe893ec2, 0xaba2a84, 0x13dd8fc, 0x111e4258, 0x8865ec7, 0x62d8860,
+    0x1d8cfdeb, 0x16847fd, 0x1e76b7fd, 0x7231d19, 0x1a643a17, 0x4d3bf0a, 0x822e390, 0xd8547ca, 0x94c8170,
+    0x19d6d552, 0x3a01908, 0x1852d565, 0x18062a3, 0x1d7b989e, 0xc49ac8d, 0x1e09392a, 0x51768f5, 0x575202c,
+    0x199c116a, 0x467bc58, 0x178d5500, 0x22c63f8, 0xc035b1b, 0xeba99df, 0x1af15d22, 0xfbf4729, 0x4ec7470,
+    0x1a79d76c, 0x2b448a7, 0xd850a1, 0xed1f379, 0x31673d6, 0x3945561, 0xa3d8faf, 0x6c40111, 0xb166c28,
+    0xb38284, 0xd89488a, 0xb9346a9, 0x738a7f8, 0x1b3237ad, 0xdf45bec, 0xb01a3c8, 0x86c630d, 0xb0a7c98,
+    0x78a5f30, 0xd87d236, 0x28876e2, 0x53b340c, 0x1d8e1762, 0x3eb8539, 0x211ee19, 0xad23248, 0x181781c,
+    0x1da45d23, 0x4d60492, 0x7282262, 0xf05a778, 0x1138b7ef, 0x454e738, 0x13dbb284, 0xb602c2, 0x302014a,
+    0x6b8c51f, 0xb0daa2a, 0x1e9a47b6, 0xa697243, 0xce75b7c, 0x964755f, 0x1ed19dcc, 0x9071094, 0xee17fdd,
+    0x914fa0c, 0xf23ffd2, 0x873fa4f, 0xdfda43c, 0xcc0c062, 0x64015d1, 0x52df66b, 0x67b6033, 0x2f390bb,
+    0x34d2cd8, 0x41b0626, 0x1ce5a8ba, 0x6829756, 0x118c26c1, 0x4ee979a, 0x827a473, 0xf2b65bb, 0x8ef2be9,
+    0xb9af37f, 0xe426ccd, 0xc6e181e, 0x4a058a3, 0x1fac0019, 0xb815d1d, 0x1de6c7a2, 0x9db0464, 0xd29efa6,
+    0x10574435, 0x47cb967, 0xb33a5c7, 0xa234bb9, 0x640e292, 0xb7b1fe0, 0xd3dcbbd, 0xd59b3cd, 0xae7597f,
+    0x154ec12e, 0x3c7513c, 0x8390628, 0x27d49b6, 0x19638531, 0xfb1c56b, 0x1f5ac82b, 0x9d74f17, 0x972d32e,
+    0x1243ac1d, 0x755ccd, 0xeca1322, 0x2707fdd, 0x9ea4dca, 0x54577b6, 0x9a12067, 0xddbbbfa, 0x377ff0d,
+    0x1fed59a7, 0x950b421, 0x1c690921, 0x8241e9e, 0x1093fff3, 0x2c8a1d9, 0xadfd334, 0x19f6fb6, 0x57b7cc1,
+    0x1c2213d1, 0x7c92285, 0x45b5a83, 0x3e93ba3, 0x76c130a, 0x64bde06, 0xd735e3d, 0xee48ff4, 0xa7280ef,
+    0x167ec993, 0x8cec1c3, 0x1edf3f50, 0xe05ccf2, 0xc6a7105, 0xe14bd0c, 0x10d6877a, 0xbb87f48, 0xa41d7c1,
+    0x6483d47, 0xb4ea77, 0x1a5f6537, 0xa88def0, 0xe3130f8, 0x8f609a0, 0xb466978, 0x845ea98, 0xae63c70,
+    0x8d89b1b, 0x3596385, 0x12467997, 0x1fe2097, 0x166cafce, 0xfb6a322, 0xc044ba2, 0xb60cc69, 0xd874631,
+    0x63964c9, 0x167f41c, 0x113f280, 0x17b7691, 0x10cb9edc, 0x34b72bf, 0xcc556f, 0x3868ca5, 0xf743b4b,
+    0xe60ad06, 0x8bbbf9e, 0xf5be625, 0x52df83f, 0xa6098f7, 0x9291b20, 0x17437ac3, 0x34f6e61, 0xb9dd089,
+    0x3057bc, 0xb495c5a, 0x7a6b4ea, 0xcfc3cf1, 0xc65773a, 0x9a20394, 0x1d30b3da, 0xfe299e7, 0x4bd0027,
+    0x15959451, 0xc832e77, 0x185b293e, 0x752ba39, 0x179c0dff, 0xb8ff47a, 0x12e1a084, 0x1d59f19, 0x8265306,
+    0x15593cb3, 0x9f2db2, 0x1782ab9, 0x3069b3, 0x1d00aba4, 0x8cb1e6d, 0x9916ac9, 0xd0002ec, 0xb4898d8,
+    0x188d551c, 0xd44ed65, 0x1063d169, 0x6ae9d46, 0x1e1b1080, 0xfaa8b45, 0xdf2e5c9, 0x715baa7, 0x9857563,
+    0xa84ce09, 0x84e90c1, 0x17ebeaa0, 0x7e69941, 0x1bfc3bc5, 0xc05f391, 0x2b9947d, 0x18df6f5, 0x40c4933,
+    0x1e980999, 0x67eb1a7, 0x4f8436, 0xb31094a, 0x1a852caa, 0x94dfb3a, 0x1e7c737d, 0xe37066b, 0x3294894,
+    0x17d736d2, 0xfaf819d, 0x14350dd7, 0x2b40776, 0x1dd1239e, 0x19b6912, 0x1ced9961, 0x10e57b7, 0x1a378f0,
+    0x1ff23fca, 0xd3d9319, 0x118eedb8, 0x2400782, 0x59301ce, 0x8ca460b, 0x36570dd, 0x905f8ad, 0xec7486,
+    0x107ced75, 0x7c04d53, 0xe819770, 0x5c98012, 0x6f0564c, 0x23e448c, 0x1c04afdf, 0x3812b36, 0x210ed40,
+};
+
+#endif  /* P256_FIELD_64BIT */
 
 /* Field element operations: */
 
+static void felem_assign(felem out, const felem in) {
+  memcpy(out, in, sizeof(felem));
+}
+
+#if P256_FIELD_64BIT
+
+/* NON_ZERO_TO_ALL_ONES returns:
+ *   all ones for 0 < x <= 2**31
+ *   0 for x == 0 or x > 2**31. */
+#define NON_ZERO_TO_ALL_ONES(x) ((limb)0 - (limb)((((u32)(x) - 1) >> 31) ^ 1))
+
+/* mul_64x64 returns the low half of a*b and sets |*hi| to the high half. */
+static u64 mul_64x64(u64 a, u64 b, u64* hi) {
+#if defined(_MSC_VER) && defined(_M_X64)
+  return _umul128(a, b, hi);
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+  *hi = __umulh(a, b);
+  return a * b;
+#else
+  const unsigned __int128 product = (unsigned __int128) a * b;
+  *hi = (u64) (product >> 64);
+  return (u64) product;
+#endif
+}
+
+/* felem_reduce_once sets out = {in, top} mod p, where in holds the low 256
+ * bits and top the 257th.
+ *
+ * On entry: {in, top} < 2*p. */
+static void felem_reduce_once(felem out, const limb in[NLIMBS], limb top) {
+  limb tmp[NLIMBS], borrow = 0, mask;
+  int i;
+
+  for (i = 0; i < NLIMBS; i++) {
+    const limb d = in[i] - kP[i];
+    const limb b = in[i] < kP[i];
+    tmp[i] = d - borrow;
+    borrow = b | (d < borrow);
+  }
+
+  /* The subtraction went negative, and |in| is already reduced, exactly when
+   * top is zero and there was a borrow. */
+  mask = ((~top & borrow) & 1) - 1;
+  for (i = 0; i < NLIMBS; i++) {
+    out[i] = (tmp[i] & mask) | (in[i] & ~mask);
+  }
+}
+
+/* felem_sum sets out = in+in2. */
+static void felem_sum(felem out, const felem in, const felem in2) {
+  limb tmp[NLIMBS], carry = 0;
+  int i;
+
+  for (i = 0; i < NLIMBS; i++) {
+    const limb s = in[i] + in2[i];
+    const limb c = s < in[i];
+    tmp[i] = s + carry;
+    carry = c | (tmp[i] < s);
+  }
+
+  felem_reduce_once(out, tmp, carry);
+}
+
+/* felem_diff sets out = in-in2. */
+static void felem_diff(felem out, const felem in, const felem in2) {
+  limb borrow = 0, carry = 0, mask;
+  int i;
+
+  for (i = 0; i < NLIMBS; i++) {
+    const limb d = in[i] - in2[i];
+    const limb b = in[i] < in2[i];
+    out[i] = d - borrow;
+    borrow = b | (d < borrow);
+  }
+
+  /* Add p back if the result went negative. */
+  mask = 0 - borrow;
+  for (i = 0; i < NLIMBS; i++) {
+    const limb s = out[i] + (kP[i] & mask);
+    const limb c = s < out[i];
+    out[i] = s + carry;
+    carry = c | (out[i] < s);
+  }
+}
+
+/* felem_reduce_degree sets out = tmp/R mod p where tmp contains the 512-bit
+ * product of two felems.
+ *
+ * This is word-by-word Montgomery reduction. Since p = -1 mod 2**64, the
+ * multiple of p that clears each low word is that word itself.
+ *
+ * On entry: tmp < 2**256 * p. */
+static void felem_reduce_degree(felem out, limb tmp[NLIMBS * 2]) {
+  limb top = 0;
+  int i, j;
+
+  for (i = 0; i < NLIMBS; i++) {
+    const limb m = tmp[i];
+    limb carry = 0, hi, lo;
+
+    for (j = 0; j < NLIMBS; j++) {
+      lo = mul_64x64(m, kP[j], &hi);
+      lo += carry;
+      hi += lo < carry;
+      tmp[i + j] += lo;
+      hi += tmp[i + j] < lo;
+      carry = hi;
+    }
+    for (j = i + NLIMBS; j < NLIMBS * 2; j++) {
+      tmp[j] += carry;
+      carry = tmp[j] < carry;
+    }
+    top += carry;
+  }
+
+  /* The result is < 2*p, so at most one subtraction is needed. */
+  felem_reduce_once(out, tmp + NLIMBS, top);
+}
+
+/* felem_square sets out=in*in. */
+static void felem_square(felem out, const felem in) {
+  limb tmp[NLIMBS * 2];
+  limb carry, hi, lo;
+  int i, j;
+
+  memset(tmp, 0, sizeof(tmp));
+
+  /* The products in[i]*in[j] with i < j ... */
+  for (i = 0; i < NLIMBS - 1; i++) {
+    carry = 0;
+    for (j = i + 1; j < NLIMBS; j++) {
+      lo = mul_64x64(in[i], in[j], &hi);
+      lo += carry;
+      hi += lo < carry;
+      tmp[i + j] += lo;
+      hi += tmp[i + j] < lo;
+      carry = hi;
+    }
+    tmp[i + NLIMBS] = carry;
+  }
+
+  /* ... appear twice ... */
+  for (i = NLIMBS * 2 - 1; i > 0; i--) {
+    tmp[i] = (tmp[i] << 1) | (tmp[i - 1] >> 63);
+  }
+  tmp[0] <<= 1;
+
+  /* ... and the squares once. */
+  carry = 0;
+  for (i = 0; i < NLIMBS; i++) {
+    limb c;
+    lo = mul_64x64(in[i], in[i], &hi);
+    tmp[2 * i] += carry;
+    c = tmp[2 * i] < carry;
+    tmp[2 * i] += lo;
+    c += tmp[2 * i] < lo;
+    tmp[2 * i + 1] += c;
+    carry = tmp[2 * i + 1] < c;
+    tmp[2 * i + 1] += hi;
+    carry += tmp[2 * i + 1] < hi;
+  }
+
+  felem_reduce_degree(out, tmp);
+}
+
+/* felem_mul sets out=in*in2. */
+static void felem_mul(felem out, const felem in, const felem in2) {
+  limb tmp[NLIMBS * 2];
+  int i, j;
+
+  memset(tmp, 0, sizeof(tmp));
+
+  for (i = 0; i < NLIMBS; i++) {
+    limb carry = 0, hi, lo;
+    for (j = 0; j < NLIMBS; j++) {
+      lo = mul_64x64(in[i], in2[j], &hi);
+      lo += carry;
+      hi += lo < carry;
+      tmp[i + j] += lo;
+      hi += tmp[i + j] < lo;
+      carry = hi;
+    }
+    tmp[i + NLIMBS] = carry;
+  }
+
+  felem_reduce_degree(out, tmp);
+}
+
+/* felem_scalar_3 sets out=3*out. */
+static void felem_scalar_3(felem out) {
+  felem tmp;
+
+  felem_sum(tmp, out, out);
+  felem_sum(out, tmp, out);
+}
+
+/* felem_scalar_4 sets out=4*out. */
+static void felem_scalar_4(felem out) {
+  felem_sum(out, out, out);
+  felem_sum(out, out, out);
+}
+
+/* felem_scalar_8 sets out=8*out. */
+static void felem_scalar_8(felem out) {
+  felem_sum(out, out, out);
+  felem_sum(out, out, out);
+  felem_sum(out, out, out);
+}
+
+/* felem_is_zero_vartime returns 1 iff |in| == 0. It takes a variable amount of
+ * time depending on the value of |in|. */
+static char felem_is_zero_vartime(const felem in) {
+  /* felems are kept fully reduced, so zero has a single representation. */
+  return (in[0] | in[1] | in[2] | in[3]) == 0;
+}
+
+#else  /* P256_FIELD_64BIT */
+
 /* NON_ZERO_TO_ALL_ONES returns:
  *   0xffffffff for 0 < x <= 2**31
  *   0 for x == 0 or x > 2**31.
@@ -580,79 +1050,6 @@ static void felem_mul(felem out, const felem in, const felem in2) {
 
   felem_reduce_degree(out, tmp);
 }
-
-static void felem_assign(felem out, const felem in) {
-  memcpy(out, in, sizeof(felem));
-}
-
-/* felem_inv calculates |out| = |in|^{-1}
- *
- * Based on Fermat's Little Theorem:
- *   a^p = a (mod p)
- *   a^{p-1} = 1 (mod p)
- *   a^{p-2} = a^{-1} (mod p)
- */
-static void felem_inv(felem out, const felem in) {
-  felem ftmp, ftmp2;
-  /* each e_I will hold |in|^{2^I - 1} */
-  felem e2, e4, e8, e16, e32, e64;
-  unsigned i;
-
-  felem_square(ftmp, in); /* 2^1 */
-  felem_mul(ftmp, in, ftmp); /* 2^2 - 2^0 */
-  felem_assign(e2, ftmp);
-  felem_square(ftmp, ftmp); /* 2^3 - 2^1 */
-  felem_square(ftmp, ftmp); /* 2^4 - 2^2 */
-  felem_mul(ftmp, ftmp, e2); /* 2^4 - 2^0 */
-  felem_assign(e4, ftmp);
-  felem_square(ftmp, ftmp); /* 2^5 - 2^1 */
-  felem_square(ftmp, ftmp); /* 2^6 - 2^2 */
-  felem_square(ftmp, ftmp); /* 2^7 - 2^3 */
-  felem_square(ftmp, ftmp); /* 2^8 - 2^4 */
-  felem_mul(ftmp, ftmp, e4); /* 2^8 - 2^0 */
-  felem_assign(e8, ftmp);
-  for (i = 0; i < 8; i++) {
-    felem_square(ftmp, ftmp);
-  } /* 2^16 - 2^8 */
-  felem_mul(ftmp, ftmp, e8); /* 2^16 - 2^0 */
-  felem_assign(e16, ftmp);
-  for (i = 0; i < 16; i++) {
-    felem_square(ftmp, ftmp);
-  } /* 2^32 - 2^16 */
-  felem_mul(ftmp, ftmp, e16); /* 2^32 - 2^0 */
-  felem_assign(e32, ftmp);
-  for (i = 0; i < 32; i++) {
-    felem_square(ftmp, ftmp);
-  } /* 2^64 - 2^32 */
-  felem_assign(e64, ftmp);
-  felem_mul(ftmp, ftmp, in); /* 2^64 - 2^32 + 2^0 */
-  for (i = 0; i < 192; i++) {
-    felem_square(ftmp, ftmp);
-  } /* 2^256 - 2^224 + 2^192 */
-
-  felem_mul(ftmp2, e64, e32); /* 2^64 - 2^0 */
-  for (i = 0; i < 16; i++) {
-    felem_square(ftmp2, ftmp2);
-  } /* 2^80 - 2^16 */
-  felem_mul(ftmp2, ftmp2, e16); /* 2^80 - 2^0 */
-  for (i = 0; i < 8; i++) {
-    felem_square(ftmp2, ftmp2);
-  } /* 2^88 - 2^8 */
-  felem_mul(ftmp2, ftmp2, e8); /* 2^88 - 2^0 */
-  for (i = 0; i < 4; i++) {
-    felem_square(ftmp2, ftmp2);
-  } /* 2^92 - 2^4 */
-  felem_mul(ftmp2, ftmp2, e4); /* 2^92 - 2^0 */
-  felem_square(ftmp2, ftmp2); /* 2^93 - 2^1 */
-  felem_square(ftmp2, ftmp2); /* 2^94 - 2^2 */
-  felem_mul(ftmp2, ftmp2, e2); /* 2^94 - 2^0 */
-  felem_square(ftmp2, ftmp2); /* 2^95 - 2^1 */
-  felem_square(ftmp2, ftmp2); /* 2^96 - 2^2 */
-  felem_mul(ftmp2, ftmp2, in); /* 2^96 - 3 */
-
-  felem_mul(out, ftmp2, ftmp); /* 2^256 - 2^224 + 2^192 + 2^96 - 3 */
-}
-
 /* felem_scalar_3 sets out=3*out.
  *
  * On entry: out[0,2,...] < 2**30, out[1,3,...] < 2**29.
@@ -777,6 +1174,76 @@ static char felem_is_zero_vartime(const felem in) {
          memcmp(tmp, k2P, sizeof(tmp)) == 0;
 }
 
+#endif  /* P256_FIELD_64BIT */
+
+/* felem_inv calculates |out| = |in|^{-1}
+ *
+ * Based on Fermat's Little Theorem:
+ *   a^p = a (mod p)
+ *   a^{p-1} = 1 (mod p)
+ *   a^{p-2} = a^{-1} (mod p)
+ */
+static void felem_inv(felem out, const felem in) {
+  felem ftmp, ftmp2;
+  /* each e_I will hold |in|^{2^I - 1} */
+  felem e2, e4, e8, e16, e32, e64;
+  unsigned i;
+
+  felem_square(ftmp, in); /* 2^1 */
+  felem_mul(ftmp, in, ftmp); /* 2^2 - 2^0 */
+  felem_assign(e2, ftmp);
+  felem_square(ftmp, ftmp); /* 2^3 - 2^1 */
+  felem_square(ftmp, ftmp); /* 2^4 - 2^2 */
+  felem_mul(ftmp, ftmp, e2); /* 2^4 - 2^0 */
+  felem_assign(e4, ftmp);
+  felem_square(ftmp, ftmp); /* 2^5 - 2^1 */
+  felem_square(ftmp, ftmp); /* 2^6 - 2^2 */
+  felem_square(ftmp, ftmp); /* 2^7 - 2^3 */
+  felem_square(ftmp, ftmp); /* 2^8 - 2^4 */
+  felem_mul(ftmp, ftmp, e4); /* 2^8 - 2^0 */
+  felem_assign(e8, ftmp);
+  for (i = 0; i < 8; i++) {
+    felem_square(ftmp, ftmp);
+  } /* 2^16 - 2^8 */
+  felem_mul(ftmp, ftmp, e8); /* 2^16 - 2^0 */
+  felem_assign(e16, ftmp);
+  for (i = 0; i < 16; i++) {
+    felem_square(ftmp, ftmp);
+  } /* 2^32 - 2^16 */
+  felem_mul(ftmp, ftmp, e16); /* 2^32 - 2^0 */
+  felem_assign(e32, ftmp);
+  for (i = 0; i < 32; i++) {
+    felem_square(ftmp, ftmp);
+  } /* 2^64 - 2^32 */
+  felem_assign(e64, ftmp);
+  felem_mul(ftmp, ftmp, in); /* 2^64 - 2^32 + 2^0 */
+  for (i = 0; i < 192; i++) {
+    felem_square(ftmp, ftmp);
+  } /* 2^256 - 2^224 + 2^192 */
+
+  felem_mul(ftmp2, e64, e32); /* 2^64 - 2^0 */
+  for (i = 0; i < 16; i++) {
+    felem_square(ftmp2, ftmp2);
+  } /* 2^80 - 2^16 */
+  felem_mul(ftmp2, ftmp2, e16); /* 2^80 - 2^0 */
+  for (i = 0; i < 8; i++) {
+    felem_square(ftmp2, ftmp2);
+  } /* 2^88 - 2^8 */
+  felem_mul(ftmp2, ftmp2, e8); /* 2^88 - 2^0 */
+  for (i = 0; i < 4; i++) {
+    felem_square(ftmp2, ftmp2);
+  } /* 2^92 - 2^4 */
+  felem_mul(ftmp2, ftmp2, e4); /* 2^92 - 2^0 */
+  felem_square(ftmp2, ftmp2); /* 2^93 - 2^1 */
+  felem_square(ftmp2, ftmp2); /* 2^94 - 2^2 */
+  felem_mul(ftmp2, ftmp2, e2); /* 2^94 - 2^0 */
+  felem_square(ftmp2, ftmp2); /* 2^95 - 2^1 */
+  felem_square(ftmp2, ftmp2); /* 2^96 - 2^2 */
+  felem_mul(ftmp2, ftmp2, in); /* 2^96 - 3 */
+
+  felem_mul(out, ftmp2, ftmp); /* 2^256 - 2^224 + 2^192 + 2^96 - 3 */
+}
+
 /* Group operations:
  *
  * Elements of the elliptic curve group are represented in Jacobian
@@ -956,9 +1423,9 @@ static void point_add_or_double_vartime(
   felem_diff(y_out, y_out, tmp);
 }
 
-/* copy_conditional sets out=in if mask = 0xffffffff in constant time.
+/* copy_conditional sets out=in if mask is all ones in constant time.
  *
- * On entry: mask is either 0 or 0xffffffff. */
+ * On entry: mask is either 0 or all ones. */
 static void copy_conditional(felem out, const felem in, limb mask) {
   int i;
 
@@ -1153,56 +1620,349 @@ static void scalar_mult(felem nx, felem ny, felem nz, const felem x,
   }
 }
 
+/* The coordinates in a p256_precomp are stored as x*2**256 mod p, which is
+ * cheap to convert to and from either felem representation. */
+
+#if P256_FIELD_64BIT
+
+/* felem_from_precomp sets out to the felem of a p256_precomp coordinate.
+ * With R = 2**256 that is just the limbs of |in|. */
+static void felem_from_precomp(felem out, const p256_int* in) {
+  int i;
+
+  for (i = 0; i < NLIMBS; i++) {
+    out[i] = ((limb) P256_DIGIT(in, 2 * i + 1) << 32) | P256_DIGIT(in, 2 * i);
+  }
+}
+
+/* precomp_from_felem sets out to the p256_precomp coordinate of |in|. */
+static void precomp_from_felem(p256_int* out, const felem in) {
+  int i;
+
+  for (i = 0; i < NLIMBS; i++) {
+    P256_DIGIT(out, 2 * i) = (p256_digit) in[i];
+    P256_DIGIT(out, 2 * i + 1) = (p256_digit) (in[i] >> 32);
+  }
+}
+
+/* to_montgomery sets out = R*in. */
+static void to_montgomery(felem out, const p256_int* in) {
+  felem tmp;
+
+  felem_from_precomp(tmp, in);
+  /* |tmp| may not be reduced, but tmp*kRR < 2**256 * p still holds. */
+  felem_mul(out, tmp, kRR);
+}
+
+/* from_montgomery sets out=in/R. */
+static void from_montgomery(p256_int* out, const felem in) {
+  static const felem kRawOne = {1};
+  felem tmp;
+
+  felem_mul(tmp, in, kRawOne);
+  precomp_from_felem(out, tmp);
+}
+
+#else  /* P256_FIELD_64BIT */
+
 #define kRDigits {2, 0, 0, 0xfffffffe, 0xffffffff, 0xffffffff, 0xfffffffd, 1} // 2^257 mod p256.p
 
 #define kRInvDigits {0x80000000, 1, 0xffffffff, 0, 0x80000001, 0xfffffffe, 1, 0x7fffffff}  // 1 / 2^257 mod p256.p
 
+#define kTwoInvDigits {0, 0, 0x80000000, 0, 0, 0x80000000, 0x80000000, 0x7fffffff}  // 1 / 2 mod p256.p
+
 static const p256_int kR = { kRDigits };
 static const p256_int kRInv = { kRInvDigits };
+static const p256_int kTwoInv = { kTwoInvDigits };
 
-/* to_montgomery sets out = R*in. */
-static void to_montgomery(felem out, const p256_int* in) {
-  p256_int in_shifted;
+/* felem_from_reduced sets out to the limbs of |in|, which must be < p. |in|
+ * is overwritten. */
+static void felem_from_reduced(felem out, p256_int* in) {
   int i;
 
-  p256_init(&in_shifted);
-  p256_modmul(&SECP256r1_p, in, 0, &kR, &in_shifted);
-
   for (i = 0; i < NLIMBS; i++) {
     if ((i & 1) == 0) {
-      out[i] = P256_DIGIT(&in_shifted, 0) & kBottom29Bits;
-      p256_shr(&in_shifted, 29, &in_shifted);
+      out[i] = P256_DIGIT(in, 0) & kBottom29Bits;
+      p256_shr(in, 29, in);
     } else {
-      out[i] = P256_DIGIT(&in_shifted, 0) & kBottom28Bits;
-      p256_shr(&in_shifted, 28, &in_shifted);
+      out[i] = P256_DIGIT(in, 0) & kBottom28Bits;
+      p256_shr(in, 28, in);
     }
   }
-
-  p256_clear(&in_shifted);
 }
 
-/* from_montgomery sets out=in/R. */
-static void from_montgomery(p256_int* out, const felem in) {
-  p256_int result, tmp;
-  int i, top;
+/* felem_to_p256 sets out to the low 256 bits of the value of |in| and returns
+ * bit 256. */
+static int felem_to_p256(p256_int* out, const felem in) {
+  p256_int tmp;
+  int i, top = 0;
 
-  p256_init(&result);
+  p256_init(out);
   p256_init(&tmp);
 
-  p256_add_d(&tmp, in[NLIMBS - 1], &result);
+  p256_add_d(&tmp, in[NLIMBS - 1], out);
   for (i = NLIMBS - 2; i >= 0; i--) {
     if ((i & 1) == 0) {
-      top = p256_shl(&result, 29, &tmp);
+      top = p256_shl(out, 29, &tmp);
     } else {
-      top = p256_shl(&result, 28, &tmp);
+      top = p256_shl(out, 28, &tmp);
     }
-    top |= p256_add_d(&tmp, in[i], &result);
+    top |= p256_add_d(&tmp, in[i], out);
   }
 
+  p256_clear(&tmp);
+  return top;
+}
+
+/* to_montgomery sets out = R*in. */
+static void to_montgomery(felem out, const p256_int* in) {
+  p256_int in_shifted;
+
+  p256_init(&in_shifted);
+  p256_modmul(&SECP256r1_p, in, 0, &kR, &in_shifted);
+  felem_from_reduced(out, &in_shifted);
+  p256_clear(&in_shifted);
+}
+
+/* from_montgomery sets out=in/R. */
+static void from_montgomery(p256_int* out, const felem in) {
+  p256_int result;
+  int top;
+
+  top = felem_to_p256(&result, in);
   p256_modmul(&SECP256r1_p, &kRInv, top, &result, out);
+  p256_clear(&result);
+}
+
+/* felem_from_precomp sets out to the felem of a p256_precomp coordinate,
+ * i.e. out = 2*in mod p. */
+static void felem_from_precomp(felem out, const p256_int* in) {
+  p256_int doubled;
+  int top;
 
+  top = p256_shl(in, 1, &doubled);
+  if (top || p256_cmp(&doubled, &SECP256r1_p) >= 0) {
+    p256_sub(&doubled, &SECP256r1_p, &doubled);
+  }
+  felem_from_reduced(out, &doubled);
+}
+
+/* precomp_from_felem sets out to the p256_precomp coordinate of |in|, i.e.
+ * out = in/2 mod p. */
+static void precomp_from_felem(p256_int* out, const felem in) {
+  p256_int result;
+  int top;
+
+  top = felem_to_p256(&result, in);
+  p256_modmul(&SECP256r1_p, &kTwoInv, top, &result, out);
   p256_clear(&result);
-  p256_clear(&tmp);
+}
+
+#endif  /* P256_FIELD_64BIT */
+
+/* Variable-time double scalar multiplication:
+ *
+ * n1*G + n2*P is computed with Strauss-Shamir: one chain of 257 doublings
+ * shared by both scalars, each of which is recoded in width-w non-adjacent
+ * form (wNAF) so that only about one in w+1 positions needs an addition of
+ * an odd multiple from a table. The table for G is kOddMultiplesG; tables for
+ * other points are built by odd_multiples_affine_vartime. */
+
+#define WNAF_WINDOW_G 7
+#define WNAF_LENGTH 257
+
+/* wnaf_recode sets naf[0..256] to the width-|w| non-adjacent form of
+ * |scalar|, least significant digit first. Every non-zero digit is odd and
+ * less than 2**(w-1) in magnitude. */
+static void wnaf_recode(signed char naf[WNAF_LENGTH], const p256_int* scalar,
+                        int w) {
+  u32 k[P256_NDIGITS + 1];
+  const int mask = (1 << w) - 1;
+  int i, j;
+
+  for (i = 0; i < P256_NDIGITS; i++) {
+    k[i] = P256_DIGIT(scalar, i);
+  }
+  k[P256_NDIGITS] = 0;
+
+  for (i = 0; i < WNAF_LENGTH; i++) {
+    int digit = 0;
+
+    if (k[0] & 1) {
+      digit = k[0] & mask;
+      if (digit >= (1 << (w - 1))) {
+        digit -= 1 << w;
+      }
+      if (digit > 0) {
+        /* Only clears the low bits of k[0]; there is no borrow. */
+        k[0] -= (u32) digit;
+      } else {
+        u32 carry = (u32) -digit;
+        for (j = 0; j <= P256_NDIGITS && carry; j++) {
+          k[j] += carry;
+          carry = k[j] < carry;
+        }
+      }
+    }
+    naf[i] = (signed char) digit;
+
+    for (j = 0; j < P256_NDIGITS; j++) {
+      k[j] = (k[j] >> 1) | (k[j + 1] << 31);
+    }
+    k[P256_NDIGITS] >>= 1;
+  }
+}
+
+/* point_add_mixed_or_double_vartime sets {x_out,y_out,z_out} = {x1,y1,z1} +
+ * {x2,y2,1}.
+ *
+ * Unlike point_add_mixed this handles P+P. P+(-P) yields z_out = 0. The
+ * output must not alias the inputs. */
+static void point_add_mixed_or_double_vartime(
+    felem x_out, felem y_out, felem z_out, const felem x1, const felem y1,
+    const felem z1, const felem x2, const felem y2) {
+  felem z1z1, z1z1z1, s2, u2, h, i, j, r, rr, v, tmp;
+
+  felem_square(z1z1, z1);
+  felem_sum(tmp, z1, z1);
+
+  felem_mul(u2, x2, z1z1);
+  felem_mul(z1z1z1, z1, z1z1);
+  felem_mul(s2, y2, z1z1z1);
+  felem_diff(h, u2, x1);
+  felem_diff(r, s2, y1);
+  if (felem_is_zero_vartime(h) && felem_is_zero_vartime(r)) {
+    point_double(x_out, y_out, z_out, x2, y2, kOne);
+    return;
+  }
+  felem_sum(i, h, h);
+  felem_square(i, i);
+  felem_mul(j, h, i);
+  felem_sum(r, r, r);
+  felem_mul(v, x1, i);
+
+  felem_mul(z_out, tmp, h);
+  felem_square(rr, r);
+  felem_diff(x_out, rr, j);
+  felem_diff(x_out, x_out, v);
+  felem_diff(x_out, x_out, v);
+
+  felem_diff(tmp, v, x_out);
+  felem_mul(y_out, tmp, r);
+  felem_mul(tmp, y1, j);
+  felem_diff(y_out, y_out, tmp);
+  felem_diff(y_out, y_out, tmp);
+}
+
+/* odd_multiples_affine_vartime sets the |n| entries of |table| to
+ * {x,y}, 3*{x,y}, ..., (2n-1)*{x,y} as affine (x,y) felem pairs. All the
+ * Z coordinates are inverted together with a single felem_inv.
+ *
+ * On entry: {x,y} is a point on the curve and n <= P256_PRECOMP_POINTS. */
+static void odd_multiples_affine_vartime(limb* table, int n, const felem x,
+                                         const felem y) {
+  felem jacobian[P256_PRECOMP_POINTS][3];
+  felem products[P256_PRECOMP_POINTS];
+  felem dx, dy, dz, inv, z_inv, z_inv_sq;
+  int i;
+
+  felem_assign(jacobian[0][0], x);
+  felem_assign(jacobian[0][1], y);
+  felem_assign(jacobian[0][2], kOne);
+  point_double(dx, dy, dz, x, y, kOne);
+  for (i = 1; i < n; i++) {
+    point_add_or_double_vartime(jacobian[i][0], jacobian[i][1], jacobian[i][2],
+                                jacobian[i - 1][0], jacobian[i - 1][1],
+                                jacobian[i - 1][2], dx, dy, dz);
+  }
+
+  /* products[i] = z_0 * ... * z_i, so that one inversion of the full product
+   * yields every 1/z_i on the way back down. */
+  felem_assign(products[0], jacobian[0][2]);
+  for (i = 1; i < n; i++) {
+    felem_mul(products[i], products[i - 1], jacobian[i][2]);
+  }
+  felem_inv(inv, products[n - 1]);
+
+  for (i = n - 1; i >= 0; i--) {
+    limb* entry = table + i * 2 * NLIMBS;
+
+    if (i > 0) {
+      felem_mul(z_inv, inv, products[i - 1]);
+      felem_mul(inv, inv, jacobian[i][2]);
+    } else {
+      felem_assign(z_inv, inv);
+    }
+    felem_square(z_inv_sq, z_inv);
+    felem_mul(entry, jacobian[i][0], z_inv_sq);
+    felem_mul(z_inv, z_inv, z_inv_sq);
+    felem_mul(entry + NLIMBS, jacobian[i][1], z_inv);
+  }
+}
+
+/* add_odd_multiple_vartime adds digit*P to {nx,ny,nz}, where |table| holds
+ * the odd multiples of P and |digit| is an odd wNAF digit. |*is_infinity|
+ * tracks whether {nx,ny,nz} is the point at infinity. */
+static void add_odd_multiple_vartime(felem nx, felem ny, felem nz,
+                                     char* is_infinity, const limb* table,
+                                     int digit) {
+  const limb* entry = table + ((digit < 0 ? -digit : digit) >> 1) * 2 * NLIMBS;
+  felem y, tx, ty, tz;
+
+  if (digit > 0) {
+    felem_assign(y, entry + NLIMBS);
+  } else {
+    felem_diff(y, kZero, entry + NLIMBS);
+  }
+
+  if (*is_infinity) {
+    felem_assign(nx, entry);
+    felem_assign(ny, y);
+    felem_assign(nz, kOne);
+    *is_infinity = 0;
+    return;
+  }
+
+  point_add_mixed_or_double_vartime(tx, ty, tz, nx, ny, nz, entry, y);
+  felem_assign(nx, tx);
+  felem_assign(ny, ty);
+  felem_assign(nz, tz);
+  *is_infinity = felem_is_zero_vartime(nz);
+}
+
+/* points_mul_wnaf_vartime sets {x_out,y_out} = n1*G + n2*P in affine
+ * coordinates, where |table| holds the 2**(w2-2) odd multiples of P built by
+ * odd_multiples_affine_vartime. The point at infinity yields (0, 0). */
+static void points_mul_wnaf_vartime(felem x_out, felem y_out,
+                                    const p256_int* n1, const p256_int* n2,
+                                    const limb* table, int w2) {
+  signed char naf1[WNAF_LENGTH], naf2[WNAF_LENGTH];
+  felem nx, ny, nz;
+  char is_infinity = 1;
+  int i;
+
+  wnaf_recode(naf1, n1, WNAF_WINDOW_G);
+  wnaf_recode(naf2, n2, w2);
+
+  for (i = WNAF_LENGTH - 1; i >= 0; i--) {
+    if (!is_infinity) {
+      point_double(nx, ny, nz, nx, ny, nz);
+    }
+    if (naf1[i]) {
+      add_odd_multiple_vartime(nx, ny, nz, &is_infinity, kOddMultiplesG,
+                               naf1[i]);
+    }
+    if (naf2[i]) {
+      add_odd_multiple_vartime(nx, ny, nz, &is_infinity, table, naf2[i]);
+    }
+  }
+
+  if (is_infinity) {
+    memset(x_out, 0, sizeof(felem));
+    memset(y_out, 0, sizeof(felem));
+    return;
+  }
+  point_to_affine(x_out, y_out, nx, ny, nz);
 }
 
 /* p256_base_point_mul sets {out_x,out_y} = nG, where n is < the
@@ -1246,7 +2006,10 @@ void p256_point_mul(const p256_int* n, const p256_int* in_x,
 void p256_points_mul_vartime(
     const p256_int* n1, const p256_int* n2, const p256_int* in_x,
     const p256_int* in_y, p256_int* out_x, p256_int* out_y) {
-  felem x1, y1, z1, x2, y2, z2, px, py;
+  /* A table of 8 odd multiples (width-5 wNAF) is the cheapest to build for a
+   * point that is only used once. */
+  limb table[NLIMBS * 2 * 8];
+  felem px, py;
 
   /* If both scalars are zero, then the result is the point at infinity. */
   if (p256_is_zero(n1) != 0 && p256_is_zero(n2) != 0) {
@@ -1257,24 +2020,46 @@ void p256_points_mul_vartime(
 
   to_montgomery(px, in_x);
   to_montgomery(py, in_y);
-  scalar_base_mult(x1, y1, z1, n1);
-  scalar_mult(x2, y2, z2, px, py, n2);
-
-  if (p256_is_zero(n2) != 0) {
-    /* If n2 == 0, then {x2,y2,z2} is zero and the result is just
-         * {x1,y1,z1}. */
-  } else if (p256_is_zero(n1) != 0) {
-    /* If n1 == 0, then {x1,y1,z1} is zero and the result is just
-         * {x2,y2,z2}. */
-    memcpy(x1, x2, sizeof(x2));
-    memcpy(y1, y2, sizeof(y2));
-    memcpy(z1, z2, sizeof(z2));
-  } else {
-    /* This function handles the case where {x1,y1,z1} == {x2,y2,z2}. */
-    point_add_or_double_vartime(x1, y1, z1, x1, y1, z1, x2, y2, z2);
+  odd_multiples_affine_vartime(table, 8, px, py);
+
+  points_mul_wnaf_vartime(px, py, n1, n2, table, 5);
+  from_montgomery(out_x, px);
+  from_montgomery(out_y, py);
+}
+
+/* p256_precomp_init fills |table| with the odd multiples of {in_x,in_y}. */
+void p256_precomp_init(const p256_int* in_x, const p256_int* in_y,
+                       p256_precomp* table) {
+  limb multiples[NLIMBS * 2 * P256_PRECOMP_POINTS];
+  felem px, py;
+  int i;
+
+  to_montgomery(px, in_x);
+  to_montgomery(py, in_y);
+  odd_multiples_affine_vartime(multiples, P256_PRECOMP_POINTS, px, py);
+
+  for (i = 0; i < P256_PRECOMP_POINTS; i++) {
+    precomp_from_felem(&table->x[i], multiples + i * 2 * NLIMBS);
+    precomp_from_felem(&table->y[i], multiples + i * 2 * NLIMBS + NLIMBS);
+  }
+}
+
+/* p256_points_mul_precomp_vartime sets {out_x,out_y} = n1*G + n2*P, where P
+ * is the point |table| was built from and n1 and n2 are < the order of the
+ * group. Variable time, like p256_points_mul_vartime. */
+void p256_points_mul_precomp_vartime(
+    const p256_int* n1, const p256_int* n2, const p256_precomp* table,
+    p256_int* out_x, p256_int* out_y) {
+  limb multiples[NLIMBS * 2 * P256_PRECOMP_POINTS];
+  felem px, py;
+  int i;
+
+  for (i = 0; i < P256_PRECOMP_POINTS; i++) {
+    felem_from_precomp(multiples + i * 2 * NLIMBS, &table->x[i]);
+    felem_from_precomp(multiples + i * 2 * NLIMBS + NLIMBS, &table->y[i]);
   }
 
-  point_to_affine(px, py, x1, y1, z1);
+  points_mul_wnaf_vartime(px, py, n1, n2, multiples, 6);
   from_montgomery(out_x, px);
   from_montgomery(out_y, py);
 }
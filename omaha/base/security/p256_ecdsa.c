@@ -74,6 +74,22 @@ void p256_ecdsa_sign(const p256_int* key,
   }
 }
 
+// Computes u = message / s and v = r / s mod n. Returns 0 if r or s is 0 mod
+// n, i.e. if the signature is malformed.
+static int ecdsa_verify_scalars(const p256_int* message,
+                                const p256_int* r, const p256_int* s,
+                                p256_int* u, p256_int* v) {
+  // Check r and s are != 0 % n.
+  p256_mod(&SECP256r1_n, r, u);
+  p256_mod(&SECP256r1_n, s, v);
+  if (p256_is_zero(u) || p256_is_zero(v)) return 0;
+
+  p256_modinv_vartime(&SECP256r1_n, s, v);
+  p256_modmul(&SECP256r1_n, message, 0, v, u);  // message / s % n
+  p256_modmul(&SECP256r1_n, r, 0, v, v);  // r / s % n
+  return 1;
+}
+
 int p256_ecdsa_verify(const p256_int* key_x, const p256_int* key_y,
                       const p256_int* message,
                       const p256_int* r, const p256_int* s) {
@@ -82,14 +98,7 @@ int p256_ecdsa_verify(const p256_int* key_x, const p256_int* key_y,
   // Check public key.
   if (!p256_is_valid_point(key_x, key_y)) return 0;
 
-  // Check r and s are != 0 % n.
-  p256_mod(&SECP256r1_n, r, &u);
-  p256_mod(&SECP256r1_n, s, &v);
-  if (p256_is_zero(&u) || p256_is_zero(&v)) return 0;
-
-  p256_modinv_vartime(&SECP256r1_n, s, &v);
-  p256_modmul(&SECP256r1_n, message, 0, &v, &u);  // message / s % n
-  p256_modmul(&SECP256r1_n, r, 0, &v, &v);  // r / s % n
+  if (!ecdsa_verify_scalars(message, r, s, &u, &v)) return 0;
 
   p256_points_mul_vartime(&u, &v,
                           key_x, key_y,
@@ -98,3 +107,16 @@ int p256_ecdsa_verify(const p256_int* key_x, const p256_int* key_y,
   p256_mod(&SECP256r1_n, &u, &u);  // (x coord % p) % n
   return p256_cmp(r, &u) == 0;
 }
+
+int p256_ecdsa_verify_precomp(const p256_precomp* key,
+                              const p256_int* message,
+                              const p256_int* r, const p256_int* s) {
+  p256_int u, v;
+
+  if (!ecdsa_verify_scalars(message, r, s, &u, &v)) return 0;
+
+  p256_points_mul_precomp_vartime(&u, &v, key, &u, &v);
+
+  p256_mod(&SECP256r1_n, &u, &u);  // (x coord % p) % n
+  return p256_cmp(r, &u) == 0;
+}
@@ -43,6 +43,13 @@ int p256_ecdsa_verify(const p256_int* key_x,
                       const p256_int* message,
                       const p256_int* r, const p256_int* s);
 
+// Same as p256_ecdsa_verify, for the public key that |key| was built from
+// with p256_precomp_init. The key is not re-validated; callers must have
+// checked it with p256_is_valid_point before building the table.
+int p256_ecdsa_verify_precomp(const p256_precomp* key,
+                              const p256_int* message,
+                              const p256_int* r, const p256_int* s);
+
 #ifdef __cplusplus
 }
 #endif
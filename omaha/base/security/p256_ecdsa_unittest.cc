@@ -23,6 +23,7 @@
 #include "p256.h"
 #include "p256_ecdsa.h"
 #include "p256_prng.h"
+#include "omaha/base/highres_timer-win32.h"
 #include "omaha/testing/unit_test.h"
 
 
@@ -107,6 +108,133 @@ TEST(P256_ECDSA, InvalidSigsTest) {
     p256_ecdsa_sign(&a, &b, &r, &s);
 
     EXPECT_TRUE(p256_ecdsa_verify(&Gx, &Gy, &b, &r, &s));
+
+    p256_precomp key;
+    p256_precomp_init(&Gx, &Gy, &key);
+    EXPECT_TRUE(p256_ecdsa_verify_precomp(&key, &b, &r, &s));
+
+    // A different message must not verify.
+    p256_add_d(&b, 1, &b);
+    EXPECT_FALSE(p256_ecdsa_verify_precomp(&key, &b, &r, &s));
   }
 }
 
+// Checks the precomputed-table double scalar multiplication against the
+// generic one, including the zero scalar and point at infinity edge cases.
+TEST(P256_ECDSA, PointsMulPrecomp) {
+  P256_PRNG_CTX prng;
+  uint8_t tmp[P256_PRNG_SIZE];
+  p256_int a, a_inv, Qx, Qy;
+  p256_precomp table;
+
+  p256_prng_init(&prng, "points_mul_precomp_test", 23, 0);
+
+  do {
+    p256_prng_draw(&prng, tmp);
+    p256_from_bin(tmp, &a);
+    p256_mod(&SECP256r1_n, &a, &a);
+  } while (p256_is_zero(&a));
+  p256_modinv(&SECP256r1_n, &a, &a_inv);
+
+  // Q = aG.
+  p256_base_point_mul(&a, &Qx, &Qy);
+  p256_precomp_init(&Qx, &Qy, &table);
+
+  for (int n = 0; n < 50; ++n) {
+    p256_int n1, n2, x1, y1, x2, y2;
+    p256_prng_draw(&prng, tmp);
+    p256_from_bin(tmp, &n1);
+    p256_mod(&SECP256r1_n, &n1, &n1);
+    p256_prng_draw(&prng, tmp);
+    p256_from_bin(tmp, &n2);
+    p256_mod(&SECP256r1_n, &n2, &n2);
+
+    p256_points_mul_vartime(&n1, &n2, &Qx, &Qy, &x1, &y1);
+    p256_points_mul_precomp_vartime(&n1, &n2, &table, &x2, &y2);
+    EXPECT_EQ(0, p256_cmp(&x1, &x2));
+    EXPECT_EQ(0, p256_cmp(&y1, &y2));
+    EXPECT_TRUE(p256_is_valid_point(&x2, &y2));
+
+    // n1G + 0Q = n1G.
+    p256_int zero = P256_ZERO;
+    p256_base_point_mul(&n1, &x1, &y1);
+    p256_points_mul_precomp_vartime(&n1, &zero, &table, &x2, &y2);
+    EXPECT_EQ(0, p256_cmp(&x1, &x2));
+    EXPECT_EQ(0, p256_cmp(&y1, &y2));
+
+    // 0G + n2Q = n2Q.
+    p256_point_mul(&n2, &Qx, &Qy, &x1, &y1);
+    p256_points_mul_precomp_vartime(&zero, &n2, &table, &x2, &y2);
+    EXPECT_EQ(0, p256_cmp(&x1, &x2));
+    EXPECT_EQ(0, p256_cmp(&y1, &y2));
+
+    // n1G + (n1/a)Q = 2n1G.
+    p256_int two = P256_ONE, m;
+    p256_add_d(&two, 1, &two);
+    p256_modmul(&SECP256r1_n, &n1, 0, &a_inv, &m);
+    p256_points_mul_precomp_vartime(&n1, &m, &table, &x1, &y1);
+    p256_modmul(&SECP256r1_n, &n1, 0, &two, &m);
+    p256_base_point_mul(&m, &x2, &y2);
+    EXPECT_EQ(0, p256_cmp(&x1, &x2));
+    EXPECT_EQ(0, p256_cmp(&y1, &y2));
+
+    // n1G + (-n1/a)Q is the point at infinity.
+    p256_modmul(&SECP256r1_n, &n1, 0, &a_inv, &m);
+    p256_sub(&SECP256r1_n, &m, &m);
+    p256_mod(&SECP256r1_n, &m, &m);
+    p256_points_mul_precomp_vartime(&n1, &m, &table, &x1, &y1);
+    EXPECT_TRUE(p256_is_zero(&x1));
+    EXPECT_TRUE(p256_is_zero(&y1));
+  }
+}
+
+// Measures signature verifications per second with the field representation
+// selected by P256_FIELD_64BIT, for a key checked on every call and for a key
+// with a precomputed table. Rebuild with P256_FIELD_64BIT=0 to compare against
+// the 32-bit limbs. Run with --gtest_also_run_disabled_tests
+// --gtest_filter=*VerifyBenchmark*.
+TEST(P256_ECDSA, DISABLED_VerifyBenchmark) {
+  const int kIterations = 5000;
+  P256_PRNG_CTX prng;
+  uint8_t tmp[P256_PRNG_SIZE];
+  p256_int a, b, Gx, Gy;
+  p256_int r, s;
+  p256_precomp key;
+
+  p256_prng_init(&prng, "verify_benchmark", 16, 0);
+
+  do {
+    p256_int p1, p2;
+    p256_prng_draw(&prng, tmp);
+    p256_from_bin(tmp, &p1);
+    p256_prng_draw(&prng, tmp);
+    p256_from_bin(tmp, &p2);
+    p256_modmul(&SECP256r1_n, &p1, 0, &p2, &a);
+  } while (p256_is_zero(&a));
+
+  p256_base_point_mul(&a, &Gx, &Gy);
+  p256_prng_draw(&prng, tmp);
+  p256_from_bin(tmp, &b);
+  p256_ecdsa_sign(&a, &b, &r, &s);
+  p256_precomp_init(&Gx, &Gy, &key);
+
+  for (int precomp = 0; precomp <= 1; ++precomp) {
+    omaha::HighresTimer timer;
+    int verified = 0;
+    for (int i = 0; i < kIterations; ++i) {
+      const int result = precomp ?
+          p256_ecdsa_verify_precomp(&key, &b, &r, &s) :
+          p256_ecdsa_verify(&Gx, &Gy, &b, &r, &s);
+      verified += result ? 1 : 0;
+    }
+    const ULONGLONG elapsed_ms =
+        timer.GetElapsedMs() > 0 ? timer.GetElapsedMs() : 1;
+
+    EXPECT_EQ(kIterations, verified);
+    printf("[%-7s] %d verifies: %6llu ms, %8.1f verifies/s\n",
+           precomp ? "precomp" : "generic",
+           kIterations,
+           elapsed_ms,
+           kIterations * 1000.0 / elapsed_ms);
+  }
+}
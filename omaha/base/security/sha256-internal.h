@@ -0,0 +1,126 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// SHA-256 block transform backends. The backend is selected at runtime the
+// first time a LITE_SHA256_CTX is initialized, based on the features reported
+// by the CPU. Callers should use the API in sha256.h; the functions below are
+// exposed for unit tests and benchmarks.
+
+#ifndef OMAHA_BASE_SECURITY_SHA256_INTERNAL_H_
+#define OMAHA_BASE_SECURITY_SHA256_INTERNAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || \
+    defined(__i386__) || defined(__x86_64__)
+#define SHA256_X86_BACKENDS 1
+#endif
+
+#if defined(_M_ARM64) || defined(__aarch64__)
+#define SHA256_ARMV8_BACKENDS 1
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif  // __cplusplus
+
+// Processes |num_blocks| consecutive 64-byte blocks from |data| into |state|.
+typedef void (*SHA256_TRANSFORM_FN)(uint32_t* state,
+                                    const uint8_t* data,
+                                    size_t num_blocks);
+
+typedef enum SHA256_BACKEND {
+  SHA256_BACKEND_AUTO = 0,
+  SHA256_BACKEND_PORTABLE,  // Plain C, any CPU.
+  SHA256_BACKEND_SHANI,     // x86 SHA extensions.
+  SHA256_BACKEND_ARMV8,     // ARMv8 cryptography extensions.
+  SHA256_BACKEND_COUNT
+} SHA256_BACKEND;
+
+extern const uint32_t SHA256_K[64];
+
+void SHA256_transform_portable(uint32_t* state,
+                               const uint8_t* data,
+                               size_t num_blocks);
+
+#ifdef SHA256_X86_BACKENDS
+// Returns EAX, EBX, ECX and EDX of CPUID |leaf|/|subleaf| in |regs|, or zeros
+// if the leaf is not supported.
+void SHA256_x86_cpuid(uint32_t leaf, uint32_t subleaf, uint32_t* regs);
+
+int SHA256_shani_supported(void);
+void SHA256_transform_shani(uint32_t* state,
+                            const uint8_t* data,
+                            size_t num_blocks);
+#endif  // SHA256_X86_BACKENDS
+
+#ifdef SHA256_ARMV8_BACKENDS
+int SHA256_armv8_supported(void);
+void SHA256_transform_armv8(uint32_t* state,
+                            const uint8_t* data,
+                            size_t num_blocks);
+#endif  // SHA256_ARMV8_BACKENDS
+
+// Returns non-zero if |backend| can run on this CPU.
+int SHA256_backend_supported(SHA256_BACKEND backend);
+
+// Forces all subsequent hashing to use |backend|. SHA256_BACKEND_AUTO restores
+// the CPU-based selection. Returns zero and leaves the current selection
+// unchanged if the backend is not supported. Not thread-safe; intended for
+// tests and benchmarks.
+int SHA256_set_backend(SHA256_BACKEND backend);
+
+// Returns the backend currently used for hashing.
+SHA256_BACKEND SHA256_get_backend(void);
+
+// Multi-buffer transforms. Processes |num_blocks| consecutive 64-byte blocks
+// from each of data[0..lanes-1] into the matching states[0..lanes-1], one
+// stream per SIMD lane.
+typedef void (*SHA256_MB_TRANSFORM_FN)(uint32_t* const* states,
+                                       const uint8_t* const* data,
+                                       size_t num_blocks);
+
+typedef enum SHA256_MB_BACKEND {
+  SHA256_MB_BACKEND_AUTO = 0,
+  SHA256_MB_BACKEND_SERIAL,  // One stream at a time with SHA256_get_backend().
+  SHA256_MB_BACKEND_SSE2,    // 4 lanes.
+  SHA256_MB_BACKEND_AVX2,    // 8 lanes.
+  SHA256_MB_BACKEND_COUNT
+} SHA256_MB_BACKEND;
+
+#define SHA256_MB_MAX_LANES 8
+
+#ifdef SHA256_X86_BACKENDS
+int SHA256_avx2_supported(void);
+void SHA256_mb_transform_sse2(uint32_t* const* states,
+                              const uint8_t* const* data,
+                              size_t num_blocks);
+void SHA256_mb_transform_avx2(uint32_t* const* states,
+                              const uint8_t* const* data,
+                              size_t num_blocks);
+#endif  // SHA256_X86_BACKENDS
+
+int SHA256_mb_backend_supported(SHA256_MB_BACKEND backend);
+
+// Same contract as SHA256_set_backend, for SHA256_update_multi.
+int SHA256_mb_set_backend(SHA256_MB_BACKEND backend);
+SHA256_MB_BACKEND SHA256_mb_get_backend(void);
+
+#ifdef __cplusplus
+}
+#endif  // __cplusplus
+
+#endif  // OMAHA_BASE_SECURITY_SHA256_INTERNAL_H_
@@ -13,9 +13,12 @@
 // limitations under the License.
 // ========================================================================
 //
-// Optimized for minimal code size.
+// Optimized for minimal code size. The portable block transform below is used
+// unless the CPU supports one of the accelerated transforms in sha256_shani.c
+// or sha256_armv8.c.
 
 #include "sha256.h"
+#include "sha256-internal.h"
 
 #include <stdint.h>
 #include <string.h>
@@ -23,7 +26,7 @@
 #define ror(value, bits) (((value) >> (bits)) | ((value) << (32 - (bits))))
 #define shr(value, bits) ((value) >> (bits))
 
-static const uint32_t K[64] = {
+const uint32_t SHA256_K[64] = {
   0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
   0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
   0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
@@ -41,61 +44,138 @@ static const uint32_t K[64] = {
   0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
   0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
 
-static void SHA256_Transform(LITE_SHA256_CTX* ctx) {
+void SHA256_transform_portable(uint32_t* state,
+                               const uint8_t* data,
+                               size_t num_blocks) {
   uint32_t W[64];
   uint32_t A, B, C, D, E, F, G, H;
-  uint8_t* p = ctx->buf;
+  const uint8_t* p = data;
   int t;
 
-  for(t = 0; t < 16; ++t) {
-    uint32_t tmp =  (uint32_t)*p++ << 24;
-    tmp |= (uint32_t)*p++ << 16;
-    tmp |= (uint32_t)*p++ << 8;
-    tmp |= (uint32_t)*p++;
-    W[t] = tmp;
+  while (num_blocks--) {
+    for(t = 0; t < 16; ++t) {
+      uint32_t tmp =  (uint32_t)*p++ << 24;
+      tmp |= (uint32_t)*p++ << 16;
+      tmp |= (uint32_t)*p++ << 8;
+      tmp |= (uint32_t)*p++;
+      W[t] = tmp;
+    }
+
+    for(; t < 64; t++) {
+      uint32_t s0 = ror(W[t-15], 7) ^ ror(W[t-15], 18) ^ shr(W[t-15], 3);
+      uint32_t s1 = ror(W[t-2], 17) ^ ror(W[t-2], 19) ^ shr(W[t-2], 10);
+      W[t] = W[t-16] + s0 + W[t-7] + s1;
+    }
+
+    A = state[0];
+    B = state[1];
+    C = state[2];
+    D = state[3];
+    E = state[4];
+    F = state[5];
+    G = state[6];
+    H = state[7];
+
+    for(t = 0; t < 64; t++) {
+      uint32_t s0 = ror(A, 2) ^ ror(A, 13) ^ ror(A, 22);
+      uint32_t maj = (A & B) ^ (A & C) ^ (B & C);
+      uint32_t t2 = s0 + maj;
+      uint32_t s1 = ror(E, 6) ^ ror(E, 11) ^ ror(E, 25);
+      uint32_t ch = (E & F) ^ ((~E) & G);
+      uint32_t t1 = H + s1 + ch + SHA256_K[t] + W[t];
+
+      H = G;
+      G = F;
+      F = E;
+      E = D + t1;
+      D = C;
+      C = B;
+      B = A;
+      A = t1 + t2;
+    }
+
+    state[0] += A;
+    state[1] += B;
+    state[2] += C;
+    state[3] += D;
+    state[4] += E;
+    state[5] += F;
+    state[6] += G;
+    state[7] += H;
   }
+}
 
-  for(; t < 64; t++) {
-    uint32_t s0 = ror(W[t-15], 7) ^ ror(W[t-15], 18) ^ shr(W[t-15], 3);
-    uint32_t s1 = ror(W[t-2], 17) ^ ror(W[t-2], 19) ^ shr(W[t-2], 10);
-    W[t] = W[t-16] + s0 + W[t-7] + s1;
+// The transform in use. Resolved lazily by SHA256_init. Concurrent first
+// calls may race to store the same value, which is benign.
+static SHA256_TRANSFORM_FN sha256_transform = NULL;
+static SHA256_BACKEND sha256_backend = SHA256_BACKEND_AUTO;
+
+static SHA256_TRANSFORM_FN SHA256_transform_for(SHA256_BACKEND backend) {
+  switch (backend) {
+    case SHA256_BACKEND_PORTABLE:
+      return SHA256_transform_portable;
+#ifdef SHA256_X86_BACKENDS
+    case SHA256_BACKEND_SHANI:
+      return SHA256_transform_shani;
+#endif
+#ifdef SHA256_ARMV8_BACKENDS
+    case SHA256_BACKEND_ARMV8:
+      return SHA256_transform_armv8;
+#endif
+    default:
+      return NULL;
   }
+}
 
-  A = ctx->state[0];
-  B = ctx->state[1];
-  C = ctx->state[2];
-  D = ctx->state[3];
-  E = ctx->state[4];
-  F = ctx->state[5];
-  G = ctx->state[6];
-  H = ctx->state[7];
-
-  for(t = 0; t < 64; t++) {
-    uint32_t s0 = ror(A, 2) ^ ror(A, 13) ^ ror(A, 22);
-    uint32_t maj = (A & B) ^ (A & C) ^ (B & C);
-    uint32_t t2 = s0 + maj;
-    uint32_t s1 = ror(E, 6) ^ ror(E, 11) ^ ror(E, 25);
-    uint32_t ch = (E & F) ^ ((~E) & G);
-    uint32_t t1 = H + s1 + ch + K[t] + W[t];
-
-    H = G;
-    G = F;
-    F = E;
-    E = D + t1;
-    D = C;
-    C = B;
-    B = A;
-    A = t1 + t2;
+static SHA256_BACKEND SHA256_select_backend(void) {
+#ifdef SHA256_X86_BACKENDS
+  if (SHA256_shani_supported()) {
+    return SHA256_BACKEND_SHANI;
   }
+#endif
+#ifdef SHA256_ARMV8_BACKENDS
+  if (SHA256_armv8_supported()) {
+    return SHA256_BACKEND_ARMV8;
+  }
+#endif
+  return SHA256_BACKEND_PORTABLE;
+}
 
-  ctx->state[0] += A;
-  ctx->state[1] += B;
-  ctx->state[2] += C;
-  ctx->state[3] += D;
-  ctx->state[4] += E;
-  ctx->state[5] += F;
-  ctx->state[6] += G;
-  ctx->state[7] += H;
+int SHA256_backend_supported(SHA256_BACKEND backend) {
+  switch (backend) {
+    case SHA256_BACKEND_AUTO:
+    case SHA256_BACKEND_PORTABLE:
+      return 1;
+#ifdef SHA256_X86_BACKENDS
+    case SHA256_BACKEND_SHANI:
+      return SHA256_shani_supported();
+#endif
+#ifdef SHA256_ARMV8_BACKENDS
+    case SHA256_BACKEND_ARMV8:
+      return SHA256_armv8_supported();
+#endif
+    default:
+      return 0;
+  }
+}
+
+int SHA256_set_backend(SHA256_BACKEND backend) {
+  if (!SHA256_backend_supported(backend)) {
+    return 0;
+  }
+  if (backend == SHA256_BACKEND_AUTO) {
+    backend = SHA256_select_backend();
+  }
+  sha256_backend = backend;
+  sha256_transform = SHA256_transform_for(backend);
+  return 1;
+}
+
+SHA256_BACKEND SHA256_get_backend(void) {
+  if (!sha256_transform) {
+    SHA256_set_backend(SHA256_BACKEND_AUTO);
+  }
+  return sha256_backend;
 }
 
 static const HASH_VTAB SHA256_VTAB = {
@@ -117,21 +197,42 @@ void SHA256_init(LITE_SHA256_CTX* ctx) {
   ctx->state[6] = 0x1f83d9ab;
   ctx->state[7] = 0x5be0cd19;
   ctx->count = 0;
+
+  if (!sha256_transform) {
+    SHA256_set_backend(SHA256_BACKEND_AUTO);
+  }
 }
 
 
 void SHA256_update(LITE_SHA256_CTX* ctx, const void* data, size_t len) {
-  int i = (int) (ctx->count & 63);
+  size_t i = (size_t) (ctx->count & 63);
   const uint8_t* p = (const uint8_t*)data;
 
   ctx->count += len;
 
-  while (len--) {
-    ctx->buf[i++] = *p++;
-    if (i == 64) {
-      SHA256_Transform(ctx);
-      i = 0;
+  // Top up a partially filled block first.
+  if (i) {
+    size_t n = 64 - i;
+    if (len < n) {
+      memcpy(ctx->buf + i, p, len);
+      return;
     }
+    memcpy(ctx->buf + i, p, n);
+    sha256_transform(ctx->state, ctx->buf, 1);
+    p += n;
+    len -= n;
+  }
+
+  // Hash whole blocks straight from the caller's buffer.
+  if (len >= 64) {
+    size_t blocks = len / 64;
+    sha256_transform(ctx->state, p, blocks);
+    p += blocks * 64;
+    len -= blocks * 64;
+  }
+
+  if (len) {
+    memcpy(ctx->buf, p, len);
   }
 }
 
@@ -33,6 +33,15 @@ const uint8_t* SHA256_final(LITE_SHA256_CTX* ctx);
 // Convenience method. Returns digest address.
 const uint8_t* SHA256_hash(const void* data, size_t len, uint8_t* digest);
 
+// Updates |count| independent contexts: ctx[i] with len[i] bytes of data[i].
+// Equivalent to calling SHA256_update for each context, but whole blocks of
+// different contexts are hashed together in SIMD lanes when the CPU supports
+// it.
+void SHA256_update_multi(LITE_SHA256_CTX* const* ctx,
+                         const void* const* data,
+                         const size_t* len,
+                         size_t count);
+
 #define SHA256_DIGEST_SIZE 32
 
 #ifdef __cplusplus
@@ -0,0 +1,110 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// SHA-256 block transform using the ARMv8 cryptography extensions. Each
+// vsha256hq_u32/vsha256h2q_u32 pair performs four rounds.
+
+#include "sha256-internal.h"
+
+#ifdef SHA256_ARMV8_BACKENDS
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#include <arm64_neon.h>
+#define SHA256_TARGET_ARMV8
+#else
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#define SHA256_TARGET_ARMV8 __attribute__((target("+crypto")))
+#endif
+
+int SHA256_armv8_supported(void) {
+#if defined(_WIN32)
+  return IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE) ?
+         1 : 0;
+#elif defined(__APPLE__)
+  return 1;
+#elif defined(__linux__) && defined(HWCAP_SHA2)
+  return (getauxval(AT_HWCAP) & HWCAP_SHA2) ? 1 : 0;
+#else
+  return 0;
+#endif
+}
+
+// Four rounds using message words |m| and round constants K[k..k+3].
+#define ARMV8_ROUNDS(m, k)                                  \
+  tmp = vaddq_u32((m), vld1q_u32(&SHA256_K[(k)]));          \
+  abcd = state0;                                            \
+  state0 = vsha256hq_u32(state0, state1, tmp);              \
+  state1 = vsha256h2q_u32(state1, abcd, tmp)
+
+// Replaces |m0| with the message words four positions later.
+#define ARMV8_SCHEDULE(m0, m1, m2, m3)                      \
+  m0 = vsha256su1q_u32(vsha256su0q_u32((m0), (m1)), (m2), (m3))
+
+#define ARMV8_LOAD(offset)                                  \
+  vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + (offset))))
+
+SHA256_TARGET_ARMV8
+void SHA256_transform_armv8(uint32_t* state,
+                            const uint8_t* data,
+                            size_t num_blocks) {
+  uint32x4_t state0 = vld1q_u32(&state[0]);
+  uint32x4_t state1 = vld1q_u32(&state[4]);
+  uint32x4_t abcd, tmp;
+  uint32x4_t m0, m1, m2, m3;
+  uint32x4_t abcd_save, efgh_save;
+  int k;
+
+  while (num_blocks--) {
+    abcd_save = state0;
+    efgh_save = state1;
+
+    m0 = ARMV8_LOAD(0);
+    m1 = ARMV8_LOAD(16);
+    m2 = ARMV8_LOAD(32);
+    m3 = ARMV8_LOAD(48);
+
+    // Rounds 0 to 47.
+    for (k = 0; k < 48; k += 16) {
+      ARMV8_ROUNDS(m0, k);
+      ARMV8_SCHEDULE(m0, m1, m2, m3);
+      ARMV8_ROUNDS(m1, k + 4);
+      ARMV8_SCHEDULE(m1, m2, m3, m0);
+      ARMV8_ROUNDS(m2, k + 8);
+      ARMV8_SCHEDULE(m2, m3, m0, m1);
+      ARMV8_ROUNDS(m3, k + 12);
+      ARMV8_SCHEDULE(m3, m0, m1, m2);
+    }
+
+    // Rounds 48 to 63.
+    ARMV8_ROUNDS(m0, 48);
+    ARMV8_ROUNDS(m1, 52);
+    ARMV8_ROUNDS(m2, 56);
+    ARMV8_ROUNDS(m3, 60);
+
+    state0 = vaddq_u32(state0, abcd_save);
+    state1 = vaddq_u32(state1, efgh_save);
+    data += 64;
+  }
+
+  vst1q_u32(&state[0], state0);
+  vst1q_u32(&state[4], state1);
+}
+
+#endif  // SHA256_ARMV8_BACKENDS
@@ -0,0 +1,179 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Multi-buffer front end for SHA-256. Whole blocks that several contexts have
+// available at the same time are handed to a SIMD transform that hashes one
+// stream per lane; everything else goes through SHA256_update.
+
+#include "sha256.h"
+#include "sha256-internal.h"
+
+#include <string.h>
+
+static SHA256_MB_TRANSFORM_FN sha256_mb_transform = NULL;
+static size_t sha256_mb_lanes = 1;
+static SHA256_MB_BACKEND sha256_mb_backend = SHA256_MB_BACKEND_AUTO;
+
+static SHA256_MB_BACKEND SHA256_mb_select_backend(void) {
+#ifdef SHA256_X86_BACKENDS
+  // A single SHA-NI stream outruns eight AVX2 lanes of the plain compression
+  // function, so only go wide when the CPU lacks the SHA extensions.
+  if (SHA256_shani_supported()) {
+    return SHA256_MB_BACKEND_SERIAL;
+  }
+  if (SHA256_avx2_supported()) {
+    return SHA256_MB_BACKEND_AVX2;
+  }
+  return SHA256_MB_BACKEND_SSE2;
+#else
+  return SHA256_MB_BACKEND_SERIAL;
+#endif
+}
+
+int SHA256_mb_backend_supported(SHA256_MB_BACKEND backend) {
+  switch (backend) {
+    case SHA256_MB_BACKEND_AUTO:
+    case SHA256_MB_BACKEND_SERIAL:
+      return 1;
+#ifdef SHA256_X86_BACKENDS
+    case SHA256_MB_BACKEND_SSE2:
+      return 1;
+    case SHA256_MB_BACKEND_AVX2:
+      return SHA256_avx2_supported();
+#endif
+    default:
+      return 0;
+  }
+}
+
+int SHA256_mb_set_backend(SHA256_MB_BACKEND backend) {
+  if (!SHA256_mb_backend_supported(backend)) {
+    return 0;
+  }
+  if (backend == SHA256_MB_BACKEND_AUTO) {
+    backend = SHA256_mb_select_backend();
+  }
+
+  switch (backend) {
+#ifdef SHA256_X86_BACKENDS
+    case SHA256_MB_BACKEND_SSE2:
+      sha256_mb_lanes = 4;
+      sha256_mb_transform = SHA256_mb_transform_sse2;
+      break;
+    case SHA256_MB_BACKEND_AVX2:
+      sha256_mb_lanes = 8;
+      sha256_mb_transform = SHA256_mb_transform_avx2;
+      break;
+#endif
+    default:
+      sha256_mb_lanes = 1;
+      sha256_mb_transform = NULL;
+      break;
+  }
+  sha256_mb_backend = backend;
+  return 1;
+}
+
+SHA256_MB_BACKEND SHA256_mb_get_backend(void) {
+  if (sha256_mb_backend == SHA256_MB_BACKEND_AUTO) {
+    SHA256_mb_set_backend(SHA256_MB_BACKEND_AUTO);
+  }
+  return sha256_mb_backend;
+}
+
+void SHA256_update_multi(LITE_SHA256_CTX* const* ctx,
+                         const void* const* data,
+                         const size_t* len,
+                         size_t count) {
+  const uint8_t* p[SHA256_MB_MAX_LANES];
+  size_t blocks[SHA256_MB_MAX_LANES];
+  uint32_t scratch_state[8];
+  size_t start, i;
+
+  if (SHA256_mb_get_backend() == SHA256_MB_BACKEND_SERIAL) {
+    for (i = 0; i < count; ++i) {
+      SHA256_update(ctx[i], data[i], len[i]);
+    }
+    return;
+  }
+
+  for (start = 0; start < count; start += SHA256_MB_MAX_LANES) {
+    const size_t n = (count - start < SHA256_MB_MAX_LANES) ?
+                     count - start : SHA256_MB_MAX_LANES;
+
+    // Top up partially filled blocks so that every stream is block aligned,
+    // then count the whole blocks left in each stream.
+    for (i = 0; i < n; ++i) {
+      LITE_SHA256_CTX* c = ctx[start + i];
+      size_t fill = (size_t)(64 - (c->count & 63)) & 63;
+      size_t remaining = len[start + i];
+      if (fill > remaining) {
+        fill = remaining;
+      }
+      p[i] = (const uint8_t*)data[start + i];
+      SHA256_update(c, p[i], fill);
+      p[i] += fill;
+      remaining -= fill;
+      blocks[i] = ((c->count & 63) == 0) ? remaining / 64 : 0;
+    }
+
+    for (;;) {
+      uint32_t* lane_state[SHA256_MB_MAX_LANES];
+      const uint8_t* lane_data[SHA256_MB_MAX_LANES];
+      size_t lane_index[SHA256_MB_MAX_LANES];
+      size_t lanes = 0;
+      size_t common = 0;
+      size_t j;
+
+      for (i = 0; i < n && lanes < sha256_mb_lanes; ++i) {
+        if (blocks[i]) {
+          lane_index[lanes++] = i;
+          if (!common || blocks[i] < common) {
+            common = blocks[i];
+          }
+        }
+      }
+      if (lanes < 2) {
+        break;  // Not worth a SIMD pass; finished below.
+      }
+
+      for (j = 0; j < lanes; ++j) {
+        lane_state[j] = ctx[start + lane_index[j]]->state;
+        lane_data[j] = p[lane_index[j]];
+      }
+      // Idle lanes hash the first stream again into a scratch state.
+      for (; j < sha256_mb_lanes; ++j) {
+        memcpy(scratch_state, lane_state[0], sizeof(scratch_state));
+        lane_state[j] = scratch_state;
+        lane_data[j] = lane_data[0];
+      }
+
+      sha256_mb_transform(lane_state, lane_data, common);
+
+      for (j = 0; j < lanes; ++j) {
+        const size_t k = lane_index[j];
+        ctx[start + k]->count += common * 64;
+        p[k] += common * 64;
+        blocks[k] -= common;
+      }
+    }
+
+    // Whatever is left: a lone stream's blocks and every stream's tail.
+    for (i = 0; i < n; ++i) {
+      const uint8_t* end = (const uint8_t*)data[start + i] + len[start + i];
+      SHA256_update(ctx[start + i], p[i], (size_t)(end - p[i]));
+    }
+  }
+}
@@ -0,0 +1,250 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Multi-buffer SHA-256 block transforms. Each 32-bit SIMD lane runs the plain
+// SHA-256 compression function for a different stream, so an SSE2 register
+// hashes 4 streams at once and an AVX2 register hashes 8.
+
+#include "sha256-internal.h"
+
+#ifdef SHA256_X86_BACKENDS
+
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define SHA256_TARGET_AVX2
+#else
+#define SHA256_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#define LOAD_BE32(p) (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | \
+                      ((uint32_t)(p)[2] << 8) | ((uint32_t)(p)[3]))
+
+static uint64_t SHA256_xgetbv0(void) {
+#if defined(_MSC_VER)
+  return _xgetbv(0);
+#else
+  uint32_t lo = 0, hi = 0;
+  __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+int SHA256_avx2_supported(void) {
+  uint32_t leaf1[4];
+  uint32_t leaf7[4];
+  SHA256_x86_cpuid(1, 0, leaf1);
+
+  // AVX (ECX bit 28) and OSXSAVE (ECX bit 27), and the OS must save the YMM
+  // registers (XCR0 bits 1 and 2).
+  if (!(leaf1[2] & (1u << 27)) || !(leaf1[2] & (1u << 28))) {
+    return 0;
+  }
+  if ((SHA256_xgetbv0() & 6) != 6) {
+    return 0;
+  }
+
+  // AVX2 (EBX bit 5) in leaf 7.
+  SHA256_x86_cpuid(7, 0, leaf7);
+  return (leaf7[1] & (1u << 5)) ? 1 : 0;
+}
+
+#define V4_ADD(a, b) _mm_add_epi32((a), (b))
+#define V4_XOR(a, b) _mm_xor_si128((a), (b))
+#define V4_ROR(x, n) \
+  _mm_or_si128(_mm_srli_epi32((x), (n)), _mm_slli_epi32((x), 32 - (n)))
+
+void SHA256_mb_transform_sse2(uint32_t* const* states,
+                              const uint8_t* const* data,
+                              size_t num_blocks) {
+  __m128i s[8], w[16];
+  __m128i a, b, c, d, e, f, g, h;
+  uint32_t out[4];
+  size_t offset = 0;
+  int i, t;
+
+  for (i = 0; i < 8; ++i) {
+    s[i] = _mm_set_epi32(states[3][i], states[2][i],
+                         states[1][i], states[0][i]);
+  }
+
+  while (num_blocks--) {
+    a = s[0];
+    b = s[1];
+    c = s[2];
+    d = s[3];
+    e = s[4];
+    f = s[5];
+    g = s[6];
+    h = s[7];
+
+    for (t = 0; t < 64; ++t) {
+      __m128i wt, s0, s1, t1, t2;
+      if (t < 16) {
+        wt = _mm_set_epi32(LOAD_BE32(data[3] + offset + 4 * t),
+                           LOAD_BE32(data[2] + offset + 4 * t),
+                           LOAD_BE32(data[1] + offset + 4 * t),
+                           LOAD_BE32(data[0] + offset + 4 * t));
+      } else {
+        // w[t & 15] still holds W[t - 16].
+        const __m128i w15 = w[(t - 15) & 15];
+        const __m128i w2 = w[(t - 2) & 15];
+        s0 = V4_XOR(V4_XOR(V4_ROR(w15, 7), V4_ROR(w15, 18)),
+                    _mm_srli_epi32(w15, 3));
+        s1 = V4_XOR(V4_XOR(V4_ROR(w2, 17), V4_ROR(w2, 19)),
+                    _mm_srli_epi32(w2, 10));
+        wt = V4_ADD(V4_ADD(w[t & 15], s0), V4_ADD(w[(t - 7) & 15], s1));
+      }
+      w[t & 15] = wt;
+
+      s1 = V4_XOR(V4_XOR(V4_ROR(e, 6), V4_ROR(e, 11)), V4_ROR(e, 25));
+      t1 = V4_XOR(_mm_and_si128(e, f), _mm_andnot_si128(e, g));
+      t1 = V4_ADD(V4_ADD(h, s1), V4_ADD(t1, wt));
+      t1 = V4_ADD(t1, _mm_set1_epi32((int)SHA256_K[t]));
+      s0 = V4_XOR(V4_XOR(V4_ROR(a, 2), V4_ROR(a, 13)), V4_ROR(a, 22));
+      t2 = V4_XOR(V4_XOR(_mm_and_si128(a, b), _mm_and_si128(a, c)),
+                  _mm_and_si128(b, c));
+      t2 = V4_ADD(s0, t2);
+
+      h = g;
+      g = f;
+      f = e;
+      e = V4_ADD(d, t1);
+      d = c;
+      c = b;
+      b = a;
+      a = V4_ADD(t1, t2);
+    }
+
+    s[0] = V4_ADD(s[0], a);
+    s[1] = V4_ADD(s[1], b);
+    s[2] = V4_ADD(s[2], c);
+    s[3] = V4_ADD(s[3], d);
+    s[4] = V4_ADD(s[4], e);
+    s[5] = V4_ADD(s[5], f);
+    s[6] = V4_ADD(s[6], g);
+    s[7] = V4_ADD(s[7], h);
+    offset += 64;
+  }
+
+  for (i = 0; i < 8; ++i) {
+    _mm_storeu_si128((__m128i*)out, s[i]);
+    states[0][i] = out[0];
+    states[1][i] = out[1];
+    states[2][i] = out[2];
+    states[3][i] = out[3];
+  }
+}
+
+#define V8_ADD(a, b) _mm256_add_epi32((a), (b))
+#define V8_XOR(a, b) _mm256_xor_si256((a), (b))
+#define V8_ROR(x, n) \
+  _mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32 - (n)))
+#define V8_LOAD_W(t)                                   \
+  _mm256_set_epi32(LOAD_BE32(data[7] + offset + 4 * (t)), \
+                   LOAD_BE32(data[6] + offset + 4 * (t)), \
+                   LOAD_BE32(data[5] + offset + 4 * (t)), \
+                   LOAD_BE32(data[4] + offset + 4 * (t)), \
+                   LOAD_BE32(data[3] + offset + 4 * (t)), \
+                   LOAD_BE32(data[2] + offset + 4 * (t)), \
+                   LOAD_BE32(data[1] + offset + 4 * (t)), \
+                   LOAD_BE32(data[0] + offset + 4 * (t)))
+
+SHA256_TARGET_AVX2
+void SHA256_mb_transform_avx2(uint32_t* const* states,
+                              const uint8_t* const* data,
+                              size_t num_blocks) {
+  __m256i s[8], w[16];
+  __m256i a, b, c, d, e, f, g, h;
+  uint32_t out[8];
+  size_t offset = 0;
+  int i, t;
+
+  for (i = 0; i < 8; ++i) {
+    s[i] = _mm256_set_epi32(states[7][i], states[6][i],
+                            states[5][i], states[4][i],
+                            states[3][i], states[2][i],
+                            states[1][i], states[0][i]);
+  }
+
+  while (num_blocks--) {
+    a = s[0];
+    b = s[1];
+    c = s[2];
+    d = s[3];
+    e = s[4];
+    f = s[5];
+    g = s[6];
+    h = s[7];
+
+    for (t = 0; t < 64; ++t) {
+      __m256i wt, s0, s1, t1, t2;
+      if (t < 16) {
+        wt = V8_LOAD_W(t);
+      } else {
+        // w[t & 15] still holds W[t - 16].
+        const __m256i w15 = w[(t - 15) & 15];
+        const __m256i w2 = w[(t - 2) & 15];
+        s0 = V8_XOR(V8_XOR(V8_ROR(w15, 7), V8_ROR(w15, 18)),
+                    _mm256_srli_epi32(w15, 3));
+        s1 = V8_XOR(V8_XOR(V8_ROR(w2, 17), V8_ROR(w2, 19)),
+                    _mm256_srli_epi32(w2, 10));
+        wt = V8_ADD(V8_ADD(w[t & 15], s0), V8_ADD(w[(t - 7) & 15], s1));
+      }
+      w[t & 15] = wt;
+
+      s1 = V8_XOR(V8_XOR(V8_ROR(e, 6), V8_ROR(e, 11)), V8_ROR(e, 25));
+      t1 = V8_XOR(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+      t1 = V8_ADD(V8_ADD(h, s1), V8_ADD(t1, wt));
+      t1 = V8_ADD(t1, _mm256_set1_epi32((int)SHA256_K[t]));
+      s0 = V8_XOR(V8_XOR(V8_ROR(a, 2), V8_ROR(a, 13)), V8_ROR(a, 22));
+      t2 = V8_XOR(V8_XOR(_mm256_and_si256(a, b), _mm256_and_si256(a, c)),
+                  _mm256_and_si256(b, c));
+      t2 = V8_ADD(s0, t2);
+
+      h = g;
+      g = f;
+      f = e;
+      e = V8_ADD(d, t1);
+      d = c;
+      c = b;
+      b = a;
+      a = V8_ADD(t1, t2);
+    }
+
+    s[0] = V8_ADD(s[0], a);
+    s[1] = V8_ADD(s[1], b);
+    s[2] = V8_ADD(s[2], c);
+    s[3] = V8_ADD(s[3], d);
+    s[4] = V8_ADD(s[4], e);
+    s[5] = V8_ADD(s[5], f);
+    s[6] = V8_ADD(s[6], g);
+    s[7] = V8_ADD(s[7], h);
+    offset += 64;
+  }
+
+  for (i = 0; i < 8; ++i) {
+    _mm256_storeu_si256((__m256i*)out, s[i]);
+    states[0][i] = out[0];
+    states[1][i] = out[1];
+    states[2][i] = out[2];
+    states[3][i] = out[3];
+    states[4][i] = out[4];
+    states[5][i] = out[5];
+    states[6][i] = out[6];
+    states[7][i] = out[7];
+  }
+}
+
+#endif  // SHA256_X86_BACKENDS
@@ -0,0 +1,164 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// SHA-256 block transform using the x86 SHA extensions (SHA-NI). Each
+// _mm_sha256rnds2_epu32 performs two rounds; the message schedule is computed
+// four words at a time with _mm_sha256msg1_epu32/_mm_sha256msg2_epu32.
+
+#include "sha256-internal.h"
+
+#ifdef SHA256_X86_BACKENDS
+
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SHA256_TARGET_SHANI
+#else
+#include <cpuid.h>
+#define SHA256_TARGET_SHANI __attribute__((target("sha,sse4.1")))
+#endif
+
+void SHA256_x86_cpuid(uint32_t leaf, uint32_t subleaf, uint32_t* regs) {
+#if defined(_MSC_VER)
+  int info[4] = {0};
+  __cpuid(info, 0);
+  if ((uint32_t)info[0] < leaf) {
+    regs[0] = regs[1] = regs[2] = regs[3] = 0;
+    return;
+  }
+  __cpuidex(info, (int)leaf, (int)subleaf);
+  regs[0] = (uint32_t)info[0];
+  regs[1] = (uint32_t)info[1];
+  regs[2] = (uint32_t)info[2];
+  regs[3] = (uint32_t)info[3];
+#else
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (__get_cpuid_max(0, NULL) < leaf) {
+    regs[0] = regs[1] = regs[2] = regs[3] = 0;
+    return;
+  }
+  __cpuid_count(leaf, subleaf, eax, ebx, ecx, edx);
+  regs[0] = eax;
+  regs[1] = ebx;
+  regs[2] = ecx;
+  regs[3] = edx;
+#endif
+}
+
+int SHA256_shani_supported(void) {
+  uint32_t leaf1[4];
+  uint32_t leaf7[4];
+  SHA256_x86_cpuid(1, 0, leaf1);
+  SHA256_x86_cpuid(7, 0, leaf7);
+
+  // SSSE3 (ECX bit 9) and SSE4.1 (ECX bit 19) in leaf 1, SHA (EBX bit 29) in
+  // leaf 7.
+  return (leaf1[2] & (1u << 9)) && (leaf1[2] & (1u << 19)) &&
+         (leaf7[1] & (1u << 29));
+}
+
+// Four rounds using message words |m| and round constants K[k..k+3].
+#define SHANI_ROUNDS(m, k)                                             \
+  msg = _mm_add_epi32((m),                                             \
+      _mm_loadu_si128((const __m128i*)&SHA256_K[(k)]));                \
+  state1 = _mm_sha256rnds2_epu32(state1, state0, msg);                 \
+  msg = _mm_shuffle_epi32(msg, 0x0E);                                  \
+  state0 = _mm_sha256rnds2_epu32(state0, state1, msg)
+
+// Completes the schedule of |next| from the two preceding message vectors.
+#define SHANI_SCHEDULE(next, cur, prev)                                \
+  next = _mm_sha256msg2_epu32(                                         \
+      _mm_add_epi32((next), _mm_alignr_epi8((cur), (prev), 4)), (cur))
+
+#define SHANI_LOAD(offset)                                             \
+  _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + (offset))), \
+                   byte_swap)
+
+SHA256_TARGET_SHANI
+void SHA256_transform_shani(uint32_t* state,
+                            const uint8_t* data,
+                            size_t num_blocks) {
+  const __m128i byte_swap =
+      _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i state0, state1, msg, tmp;
+  __m128i m0, m1, m2, m3;
+  __m128i abef_save, cdgh_save;
+  int k;
+
+  // The SHA instructions want the state as ABEF/CDGH rather than ABCD/EFGH.
+  tmp = _mm_loadu_si128((const __m128i*)&state[0]);
+  state1 = _mm_loadu_si128((const __m128i*)&state[4]);
+  tmp = _mm_shuffle_epi32(tmp, 0xB1);              // CDAB
+  state1 = _mm_shuffle_epi32(state1, 0x1B);        // EFGH
+  state0 = _mm_alignr_epi8(tmp, state1, 8);        // ABEF
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0);     // CDGH
+
+  while (num_blocks--) {
+    abef_save = state0;
+    cdgh_save = state1;
+
+    m0 = SHANI_LOAD(0);
+    SHANI_ROUNDS(m0, 0);
+    m1 = SHANI_LOAD(16);
+    SHANI_ROUNDS(m1, 4);
+    m0 = _mm_sha256msg1_epu32(m0, m1);
+    m2 = SHANI_LOAD(32);
+    SHANI_ROUNDS(m2, 8);
+    m1 = _mm_sha256msg1_epu32(m1, m2);
+    m3 = SHANI_LOAD(48);
+    SHANI_ROUNDS(m3, 12);
+    SHANI_SCHEDULE(m0, m3, m2);
+    m2 = _mm_sha256msg1_epu32(m2, m3);
+
+    // Rounds 16 to 47.
+    for (k = 16; k < 48; k += 16) {
+      SHANI_ROUNDS(m0, k);
+      SHANI_SCHEDULE(m1, m0, m3);
+      m3 = _mm_sha256msg1_epu32(m3, m0);
+      SHANI_ROUNDS(m1, k + 4);
+      SHANI_SCHEDULE(m2, m1, m0);
+      m0 = _mm_sha256msg1_epu32(m0, m1);
+      SHANI_ROUNDS(m2, k + 8);
+      SHANI_SCHEDULE(m3, m2, m1);
+      m1 = _mm_sha256msg1_epu32(m1, m2);
+      SHANI_ROUNDS(m3, k + 12);
+      SHANI_SCHEDULE(m0, m3, m2);
+      m2 = _mm_sha256msg1_epu32(m2, m3);
+    }
+
+    // Rounds 48 to 63.
+    SHANI_ROUNDS(m0, 48);
+    SHANI_SCHEDULE(m1, m0, m3);
+    m3 = _mm_sha256msg1_epu32(m3, m0);
+    SHANI_ROUNDS(m1, 52);
+    SHANI_SCHEDULE(m2, m1, m0);
+    SHANI_ROUNDS(m2, 56);
+    SHANI_SCHEDULE(m3, m2, m1);
+    SHANI_ROUNDS(m3, 60);
+
+    state0 = _mm_add_epi32(state0, abef_save);
+    state1 = _mm_add_epi32(state1, cdgh_save);
+    data += 64;
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1B);           // FEBA
+  state1 = _mm_shuffle_epi32(state1, 0xB1);        // DCHG
+  state0 = _mm_blend_epi16(tmp, state1, 0xF0);     // DCBA
+  state1 = _mm_alignr_epi8(state1, tmp, 8);        // HGFE
+  _mm_storeu_si128((__m128i*)&state[0], state0);
+  _mm_storeu_si128((__m128i*)&state[4], state1);
+}
+
+#endif  // SHA256_X86_BACKENDS
@@ -14,8 +14,11 @@
 // ========================================================================
 
 #include "omaha/base/security/sha256.h"
+#include <algorithm>
 #include <cstring>
 #include <vector>
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/security/sha256-internal.h"
 #include "omaha/testing/unit_test.h"
 
 namespace omaha {
@@ -66,5 +69,244 @@ TEST(Security, Sha256) {
   }
 }
 
+const char* const kBackendNames[SHA256_BACKEND_COUNT] = {
+  "auto", "portable", "sha-ni", "armv8",
+};
+
+// Restores CPU-based backend selection when a test forces a backend.
+class ScopedSha256Backend {
+ public:
+  ScopedSha256Backend() {}
+  ~ScopedSha256Backend() {
+    SHA256_set_backend(SHA256_BACKEND_AUTO);
+  }
+
+  bool Set(SHA256_BACKEND backend) {
+    return !!SHA256_set_backend(backend);
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ScopedSha256Backend);
+};
+
+std::vector<uint8_t> MakeTestData(size_t size) {
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i != size; ++i) {
+    data[i] = static_cast<uint8_t>(i * 131 + 7);
+  }
+  return data;
+}
+
+// Feeds |data| in irregular chunk sizes so that the buffering of partial
+// blocks in SHA256_update is exercised along with the bulk path.
+std::vector<uint8_t> HashInChunks(const std::vector<uint8_t>& data) {
+  LITE_SHA256_CTX context = {0};
+  SHA256_init(&context);
+  size_t offset = 0;
+  size_t chunk = 1;
+  while (offset < data.size()) {
+    const size_t len = std::min(chunk, data.size() - offset);
+    SHA256_update(&context, &data[offset], len);
+    offset += len;
+    chunk = (chunk * 7 + 3) % 1000 + 1;
+  }
+  const uint8_t* result = SHA256_final(&context);
+  return std::vector<uint8_t>(result, result + SHA256_DIGEST_SIZE);
+}
+
+TEST(Security, Sha256AllBackends) {
+  ScopedSha256Backend scoped_backend;
+  ASSERT_TRUE(scoped_backend.Set(SHA256_BACKEND_PORTABLE));
+
+  const std::vector<uint8_t> data(MakeTestData(1024 * 1024 + 17));
+  const std::vector<uint8_t> expected(HashInChunks(data));
+
+  for (int backend = SHA256_BACKEND_PORTABLE;
+       backend != SHA256_BACKEND_COUNT;
+       ++backend) {
+    if (!scoped_backend.Set(static_cast<SHA256_BACKEND>(backend))) {
+      continue;
+    }
+
+    for (size_t i = 0; i != arraysize(test_hash256); ++i) {
+      uint8_t hash[SHA256_DIGEST_SIZE] = {0};
+      SHA256_hash(test_hash256[i].binary,
+                  strlen(test_hash256[i].binary),
+                  hash);
+      EXPECT_EQ(0, memcmp(hash, test_hash256[i].hash, SHA256_DIGEST_SIZE))
+          << kBackendNames[backend];
+    }
+
+    EXPECT_TRUE(expected == HashInChunks(data)) << kBackendNames[backend];
+  }
+}
+
+TEST(Security, Sha256SetBackend) {
+  ScopedSha256Backend scoped_backend;
+
+  EXPECT_TRUE(scoped_backend.Set(SHA256_BACKEND_PORTABLE));
+  EXPECT_EQ(SHA256_BACKEND_PORTABLE, SHA256_get_backend());
+
+  EXPECT_FALSE(scoped_backend.Set(SHA256_BACKEND_COUNT));
+  EXPECT_EQ(SHA256_BACKEND_PORTABLE, SHA256_get_backend());
+
+  EXPECT_TRUE(scoped_backend.Set(SHA256_BACKEND_AUTO));
+  EXPECT_NE(SHA256_BACKEND_AUTO, SHA256_get_backend());
+}
+
+TEST(Security, Sha256UpdateMulti) {
+  // More streams than SIMD lanes, with lengths that are not block multiples
+  // and differ from each other so that lanes drain at different times.
+  const size_t kNumStreams = 13;
+  std::vector<std::vector<uint8_t>> streams;
+  std::vector<std::vector<uint8_t>> expected;
+  for (size_t i = 0; i != kNumStreams; ++i) {
+    streams.push_back(MakeTestData((i * 77777 + (i % 3) * 100003) % 300000 + i));
+    expected.push_back(HashInChunks(streams[i]));
+  }
+
+  for (int backend = SHA256_MB_BACKEND_SERIAL;
+       backend != SHA256_MB_BACKEND_COUNT;
+       ++backend) {
+    if (!SHA256_mb_set_backend(static_cast<SHA256_MB_BACKEND>(backend))) {
+      continue;
+    }
+
+    std::vector<LITE_SHA256_CTX> contexts(kNumStreams);
+    std::vector<LITE_SHA256_CTX*> context_ptrs(kNumStreams);
+    std::vector<size_t> offsets(kNumStreams);
+    for (size_t i = 0; i != kNumStreams; ++i) {
+      SHA256_init(&contexts[i]);
+      context_ptrs[i] = &contexts[i];
+    }
+
+    for (size_t round = 0; ; ++round) {
+      std::vector<const void*> data(kNumStreams);
+      std::vector<size_t> len(kNumStreams);
+      bool done = true;
+      for (size_t i = 0; i != kNumStreams; ++i) {
+        len[i] = std::min(4096 + 37 * i + round,
+                          streams[i].size() - offsets[i]);
+        data[i] = streams[i].data() + offsets[i];
+        offsets[i] += len[i];
+        done = done && !len[i];
+      }
+      if (done) {
+        break;
+      }
+      SHA256_update_multi(&context_ptrs[0], &data[0], &len[0], kNumStreams);
+    }
+
+    for (size_t i = 0; i != kNumStreams; ++i) {
+      EXPECT_EQ(0, memcmp(SHA256_final(&contexts[i]),
+                          &expected[i][0],
+                          SHA256_DIGEST_SIZE)) << backend << " " << i;
+    }
+  }
+
+  SHA256_mb_set_backend(SHA256_MB_BACKEND_AUTO);
+}
+
+// Compares the throughput of the backends available on this machine. Run with
+// --gtest_also_run_disabled_tests --gtest_filter=*Sha256BackendBenchmark*.
+TEST(Security, DISABLED_Sha256BackendBenchmark) {
+  const struct {
+    size_t buffer_size;
+    size_t iterations;
+  } kCases[] = {
+    {4 * 1024, 64 * 1024},     // 4 KB, repeated to get a measurable time.
+    {1024 * 1024, 256},        // 1 MB.
+    {1024 * 1024, 1024},       // 1 GB, hashed as a single stream.
+  };
+
+  ScopedSha256Backend scoped_backend;
+  const std::vector<uint8_t> data(MakeTestData(1024 * 1024));
+
+  for (int backend = SHA256_BACKEND_PORTABLE;
+       backend != SHA256_BACKEND_COUNT;
+       ++backend) {
+    if (!scoped_backend.Set(static_cast<SHA256_BACKEND>(backend))) {
+      continue;
+    }
+
+    for (size_t i = 0; i != arraysize(kCases); ++i) {
+      const bool single_stream = i == arraysize(kCases) - 1;
+      HighresTimer timer;
+      LITE_SHA256_CTX context = {0};
+      SHA256_init(&context);
+      for (size_t j = 0; j != kCases[i].iterations; ++j) {
+        if (!single_stream) {
+          SHA256_init(&context);
+        }
+        SHA256_update(&context, &data[0], kCases[i].buffer_size);
+        if (!single_stream) {
+          SHA256_final(&context);
+        }
+      }
+      if (single_stream) {
+        SHA256_final(&context);
+      }
+      const ULONGLONG elapsed_ms = std::max<ULONGLONG>(timer.GetElapsedMs(), 1);
+      const double megabytes =
+          kCases[i].buffer_size * kCases[i].iterations / (1024.0 * 1024.0);
+      printf("[%-8s] %9zu bytes x %6zu: %6llu ms, %8.1f MB/s\n",
+             kBackendNames[backend],
+             kCases[i].buffer_size,
+             kCases[i].iterations,
+             elapsed_ms,
+             megabytes * 1000 / elapsed_ms);
+    }
+  }
+}
+
+// Compares hashing eight 1 MB streams one after the other against hashing
+// them together with SHA256_update_multi.
+TEST(Security, DISABLED_Sha256MultiBufferBenchmark) {
+  const char* const kMbBackendNames[SHA256_MB_BACKEND_COUNT] = {
+    "auto", "serial", "sse2", "avx2",
+  };
+  const size_t kNumStreams = 8;
+  const size_t kIterations = 64;
+  const std::vector<uint8_t> data(MakeTestData(1024 * 1024));
+
+  for (int backend = SHA256_MB_BACKEND_SERIAL;
+       backend != SHA256_MB_BACKEND_COUNT;
+       ++backend) {
+    if (!SHA256_mb_set_backend(static_cast<SHA256_MB_BACKEND>(backend))) {
+      continue;
+    }
+
+    LITE_SHA256_CTX contexts[kNumStreams];
+    LITE_SHA256_CTX* context_ptrs[kNumStreams];
+    const void* data_ptrs[kNumStreams];
+    size_t len[kNumStreams];
+    for (size_t i = 0; i != kNumStreams; ++i) {
+      context_ptrs[i] = &contexts[i];
+      data_ptrs[i] = &data[0];
+      len[i] = data.size();
+    }
+
+    HighresTimer timer;
+    for (size_t j = 0; j != kIterations; ++j) {
+      for (size_t i = 0; i != kNumStreams; ++i) {
+        SHA256_init(&contexts[i]);
+      }
+      SHA256_update_multi(context_ptrs, data_ptrs, len, kNumStreams);
+      for (size_t i = 0; i != kNumStreams; ++i) {
+        SHA256_final(&contexts[i]);
+      }
+    }
+    const ULONGLONG elapsed_ms = std::max<ULONGLONG>(timer.GetElapsedMs(), 1);
+    printf("[%-8s] %zu streams x %zu MB: %6llu ms, %8.1f MB/s\n",
+           kMbBackendNames[backend],
+           kNumStreams,
+           kIterations,
+           elapsed_ms,
+           kNumStreams * kIterations * 1000.0 / elapsed_ms);
+  }
+
+  SHA256_mb_set_backend(SHA256_MB_BACKEND_AUTO);
+}
+
 }  // namespace omaha
 
@@ -20,6 +20,7 @@
 
 #include "omaha/base/signatures.h"
 #include <intsafe.h>
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -32,12 +33,25 @@
 
 namespace omaha {
 
-// Maximum file size allowed for performing authentication.
-constexpr size_t kMaxFileSizeForAuthentication = 1024 * 1024 * 1024;  // 1GB.
+// Maximum file size allowed for performing authentication. Packages such as
+// VM images and toolchains are several GB.
+constexpr uint64 kMaxFileSizeForAuthentication =
+    64ULL * 1024 * 1024 * 1024;  // 64GB.
 
 // Buffer size used to read files from disk.
 constexpr size_t kFileReadBufferSize = 1024 * 1024;  // 1MB.
 
+// Size of each view mapped by HASH_READ_MAPPED. Views are mapped one at a time
+// so that large files fit in the address space of a 32-bit process. Must be a
+// multiple of the allocation granularity.
+constexpr size_t kMappedViewSize = 16 * 1024 * 1024;  // 16MB.
+
+// Buffer size per stream used to read files when hashing several at once.
+constexpr size_t kMultiFileReadBufferSize = 256 * 1024;  // 256KB.
+
+// Number of streams hashed at once by the multi-buffer hasher.
+constexpr size_t kMultiHashStreams = 8;
+
 namespace CryptDetails {
 
 class SHA256Hash : public HashInterface {
@@ -69,8 +83,221 @@ CryptDetails::HashInterface* CreateHasher() {
   return new CryptDetails::SHA256Hash;
 }
 
+class SHA256MultiHash : public MultiHashInterface {
+ public:
+  SHA256MultiHash() {
+    for (size_t i = 0; i != kMultiHashStreams; ++i) {
+      SHA256_init(&ctx_[i]);
+    }
+  }
+  virtual ~SHA256MultiHash() {}
+
+  virtual size_t num_streams() const {
+    return kMultiHashStreams;
+  }
+
+  virtual void reset(size_t stream) {
+    ASSERT1(stream < kMultiHashStreams);
+    SHA256_init(&ctx_[stream]);
+  }
+
+  virtual void update(const void* const* data, const unsigned int* len) {
+    LITE_SHA256_CTX* ctx[kMultiHashStreams] = {};
+    const void* active_data[kMultiHashStreams] = {};
+    size_t active_len[kMultiHashStreams] = {};
+    size_t count = 0;
+    for (size_t i = 0; i != kMultiHashStreams; ++i) {
+      if (len[i]) {
+        ctx[count] = &ctx_[i];
+        active_data[count] = data[i];
+        active_len[count] = len[i];
+        ++count;
+      }
+    }
+    SHA256_update_multi(ctx, active_data, active_len, count);
+  }
+
+  virtual const uint8_t* final(size_t stream) {
+    ASSERT1(stream < kMultiHashStreams);
+    return SHA256_final(&ctx_[stream]);
+  }
+
+  virtual size_t hash_size() const {
+    return SHA256_DIGEST_SIZE;
+  }
+
+ private:
+  LITE_SHA256_CTX ctx_[kMultiHashStreams];
+
+  DISALLOW_COPY_AND_ASSIGN(SHA256MultiHash);
+};
+
+CryptDetails::MultiHashInterface* CreateMultiHasher() {
+  return new CryptDetails::SHA256MultiHash;
+}
+
 }  // namespace CryptDetails
 
+namespace {
+
+HRESULT HashFileSynchronous(HANDLE file_handle,
+                            CryptDetails::HashInterface* hasher) {
+  std::vector<byte> buf(kFileReadBufferSize);
+  static_assert(kFileReadBufferSize <= INT_MAX);
+
+  DWORD bytes_read = 0;
+  do {
+    if (!::ReadFile(file_handle,
+                    &buf[0],
+                    static_cast<DWORD>(buf.size()),
+                    &bytes_read,
+                    NULL)) {
+      return HRESULTFromLastError();
+    }
+
+    if (bytes_read > 0) {
+      hasher->update(&buf[0], bytes_read);
+    }
+  } while (bytes_read == buf.size());
+
+  return S_OK;
+}
+
+// Starts an overlapped read of |buf| from |offset|. Returns S_FALSE if
+// |offset| is at the end of the file.
+HRESULT StartOverlappedRead(HANDLE file_handle,
+                            uint64 offset,
+                            std::vector<byte>* buf,
+                            OVERLAPPED* overlapped) {
+  overlapped->Offset = static_cast<DWORD>(offset);
+  overlapped->OffsetHigh = static_cast<DWORD>(offset >> 32);
+  if (::ReadFile(file_handle,
+                 &buf->front(),
+                 static_cast<DWORD>(buf->size()),
+                 NULL,
+                 overlapped)) {
+    return S_OK;
+  }
+
+  const DWORD error = ::GetLastError();
+  if (error == ERROR_IO_PENDING) {
+    return S_OK;
+  }
+  return error == ERROR_HANDLE_EOF ? S_FALSE : HRESULT_FROM_WIN32(error);
+}
+
+// |file_handle| must be opened with FILE_FLAG_OVERLAPPED. At most one read is
+// in flight at a time and it always targets the buffer that is not being
+// hashed, so no read is outstanding when this function returns.
+HRESULT HashFilePipelined(HANDLE file_handle,
+                          CryptDetails::HashInterface* hasher) {
+  std::vector<byte> bufs[2] = {std::vector<byte>(kFileReadBufferSize),
+                               std::vector<byte>(kFileReadBufferSize)};
+  scoped_event events[2];
+  OVERLAPPED overlapped[2] = {};
+  for (size_t i = 0; i != arraysize(events); ++i) {
+    reset(events[i], ::CreateEvent(NULL, true, false, NULL));
+    if (!events[i]) {
+      return HRESULTFromLastError();
+    }
+    overlapped[i].hEvent = get(events[i]);
+  }
+
+  uint64 offset = 0;
+  size_t current = 0;
+  HRESULT hr = StartOverlappedRead(file_handle, offset,
+                                   &bufs[current], &overlapped[current]);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  while (hr == S_OK) {
+    DWORD bytes_read = 0;
+    if (!::GetOverlappedResult(file_handle,
+                               &overlapped[current],
+                               &bytes_read,
+                               true)) {
+      const DWORD error = ::GetLastError();
+      return error == ERROR_HANDLE_EOF ? S_OK : HRESULT_FROM_WIN32(error);
+    }
+
+    // As in the synchronous case, a short read is the end of the file.
+    const size_t next = 1 - current;
+    offset += bytes_read;
+    hr = S_FALSE;
+    if (bytes_read == bufs[current].size()) {
+      hr = StartOverlappedRead(file_handle, offset,
+                               &bufs[next], &overlapped[next]);
+    }
+    if (FAILED(hr)) {
+      return hr;
+    }
+
+    if (bytes_read > 0) {
+      hasher->update(&bufs[current][0], bytes_read);
+    }
+    current = next;
+  }
+
+  return S_OK;
+}
+
+// Hashes |len| bytes of a mapped view. Returns false if touching the view
+// raises an in-page error, which happens when the file cannot be read, for
+// instance because it was truncated or its volume went away. This function
+// must not have objects with destructors because of the __try.
+bool HashMappedView(CryptDetails::HashInterface* hasher,
+                    const void* view,
+                    size_t len) {
+  __try {
+    hasher->update(view, static_cast<unsigned int>(len));
+  } __except(::GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ?
+             EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+    return false;
+  }
+  return true;
+}
+
+HRESULT HashFileMapped(HANDLE file_handle,
+                       uint64 file_size,
+                       CryptDetails::HashInterface* hasher) {
+  // Empty files cannot be mapped.
+  if (!file_size) {
+    return S_OK;
+  }
+
+  scoped_file_mapping mapping(::CreateFileMapping(file_handle,
+                                                  NULL,
+                                                  PAGE_READONLY,
+                                                  0,
+                                                  0,
+                                                  NULL));
+  if (!mapping) {
+    return HRESULTFromLastError();
+  }
+
+  static_assert(kMappedViewSize <= INT_MAX);
+  for (uint64 offset = 0; offset < file_size; offset += kMappedViewSize) {
+    const size_t len = static_cast<size_t>(
+        std::min<uint64>(kMappedViewSize, file_size - offset));
+    scoped_file_view view(::MapViewOfFile(get(mapping),
+                                          FILE_MAP_READ,
+                                          static_cast<DWORD>(offset >> 32),
+                                          static_cast<DWORD>(offset),
+                                          len));
+    if (!view) {
+      return HRESULTFromLastError();
+    }
+    if (!HashMappedView(hasher, get(view), len)) {
+      return HRESULT_FROM_WIN32(ERROR_READ_FAULT);
+    }
+  }
+
+  return S_OK;
+}
+
+}  // namespace
+
 HRESULT CryptoHash::Compute(const TCHAR* filepath,
                             uint64 max_len,
                             std::vector<byte>* hash_out) {
@@ -85,10 +312,17 @@ HRESULT CryptoHash::Compute(const TCHAR* filepath,
 HRESULT CryptoHash::Compute(const std::vector<CString>& filepaths,
                             uint64 max_len,
                             std::vector<byte>* hash_out) {
+  return Compute(filepaths, max_len, HASH_READ_SYNCHRONOUS, hash_out);
+}
+
+HRESULT CryptoHash::Compute(const std::vector<CString>& filepaths,
+                            uint64 max_len,
+                            HashReadPolicy policy,
+                            std::vector<byte>* hash_out) {
   ASSERT1(filepaths.size() > 0);
   ASSERT1(hash_out);
 
-  return ComputeOrValidate(filepaths, max_len, NULL, hash_out);
+  return ComputeOrValidate(filepaths, max_len, policy, NULL, hash_out);
 }
 
 HRESULT CryptoHash::Compute(const std::vector<byte>& buffer_in,
@@ -112,9 +346,16 @@ HRESULT CryptoHash::Validate(const TCHAR* filepath,
 HRESULT CryptoHash::Validate(const std::vector<CString>& filepaths,
                              uint64 max_len,
                              const std::vector<byte>& hash_in) {
+  return Validate(filepaths, max_len, HASH_READ_SYNCHRONOUS, hash_in);
+}
+
+HRESULT CryptoHash::Validate(const std::vector<CString>& filepaths,
+                             uint64 max_len,
+                             HashReadPolicy policy,
+                             const std::vector<byte>& hash_in) {
   ASSERT1(IsValidSize(hash_in.size()));
 
-  return ComputeOrValidate(filepaths, max_len, &hash_in, NULL);
+  return ComputeOrValidate(filepaths, max_len, policy, &hash_in, NULL);
 }
 
 
@@ -125,60 +366,218 @@ HRESULT CryptoHash::Validate(const std::vector<byte>& buffer_in,
   return ComputeOrValidate(buffer_in, &hash_in, NULL);
 }
 
+HRESULT CryptoHash::Validate(
+    const std::vector<std::pair<CString, std::vector<byte>>>& files,
+    uint64 max_file_len,
+    std::vector<HRESULT>* results) {
+  UTIL_LOG(L1, (_T("[CryptoHash::Validate][%Iu files]"), files.size()));
+
+  // A file only succeeds once its hash has been found to match, so that a
+  // file the loop never gets to fails.
+  std::vector<HRESULT> file_results(files.size(), E_UNEXPECTED);
+
+  std::unique_ptr<CryptDetails::MultiHashInterface> hasher(
+      CryptDetails::CreateMultiHasher());
+  const size_t num_streams = hasher->num_streams();
+
+  // Each stream hashes one file at a time. When a file is done, the stream
+  // picks up the next pending file so that all the lanes stay busy.
+  struct HashStream {
+    size_t file_index;
+    scoped_hfile file_handle;
+    std::vector<byte> buf;
+  };
+  std::unique_ptr<HashStream[]> streams(new HashStream[num_streams]);
+  std::vector<const void*> data(num_streams);
+  std::vector<unsigned int> len(num_streams);
+  size_t next_file = 0;
+
+  // A round where every lane fails to read has no active lane, but the lanes
+  // pick up the pending files in the next round.
+  bool active = true;
+  while (active || next_file < files.size()) {
+    active = false;
+
+    for (size_t i = 0; i != num_streams; ++i) {
+      HashStream& stream = streams[i];
+      len[i] = 0;
+
+      while (!stream.file_handle && next_file < files.size()) {
+        const size_t file_index = next_file++;
+        const CString& filepath = files[file_index].first;
+        if (!IsValidSize(files[file_index].second.size())) {
+          file_results[file_index] = E_INVALIDARG;
+          continue;
+        }
+
+        reset(stream.file_handle, ::CreateFile(filepath,
+                                               FILE_READ_DATA,
+                                               FILE_SHARE_READ,
+                                               NULL,
+                                               OPEN_EXISTING,
+                                               FILE_ATTRIBUTE_NORMAL,
+                                               NULL));
+        if (!stream.file_handle) {
+          file_results[file_index] = HRESULTFromLastError();
+          continue;
+        }
+
+        if (max_file_len) {
+          LARGE_INTEGER file_size = {0};
+          if (!::GetFileSizeEx(get(stream.file_handle), &file_size)) {
+            file_results[file_index] = HRESULTFromLastError();
+            reset(stream.file_handle);
+            continue;
+          }
+          if (static_cast<uint64>(file_size.QuadPart) > max_file_len) {
+            UTIL_LOG(LE, (_T("[exceed max len][%s][max_file_len=%I64u]"),
+                          filepath, max_file_len));
+            file_results[file_index] = SIGS_E_FILE_SIZE_TOO_BIG;
+            reset(stream.file_handle);
+            continue;
+          }
+        }
+
+        stream.file_index = file_index;
+        stream.buf.resize(kMultiFileReadBufferSize);
+        hasher->reset(i);
+      }
+
+      if (!stream.file_handle) {
+        continue;
+      }
+
+      DWORD bytes_read = 0;
+      if (!::ReadFile(get(stream.file_handle),
+                      &stream.buf[0],
+                      static_cast<DWORD>(stream.buf.size()),
+                      &bytes_read,
+                      NULL)) {
+        file_results[stream.file_index] = HRESULTFromLastError();
+        reset(stream.file_handle);
+        continue;
+      }
+
+      data[i] = &stream.buf[0];
+      len[i] = bytes_read;
+      active = true;
+    }
+
+    if (!active) {
+      continue;
+    }
+
+    hasher->update(&data[0], &len[0]);
+
+    for (size_t i = 0; i != num_streams; ++i) {
+      HashStream& stream = streams[i];
+      if (!stream.file_handle || len[i] == stream.buf.size()) {
+        continue;
+      }
+
+      // A short read is the end of the file.
+      const std::vector<byte>& hash_in = files[stream.file_index].second;
+      if (memcmp(&hash_in.front(), hasher->final(i), hash_size()) != 0) {
+        REPORT_LOG(L1, (_T("[hash mismatch][%s]"),
+                        files[stream.file_index].first));
+        file_results[stream.file_index] = SIGS_E_INVALID_SIGNATURE;
+      } else {
+        file_results[stream.file_index] = S_OK;
+      }
+      reset(stream.file_handle);
+    }
+  }
+
+  HRESULT hr = S_OK;
+  for (size_t i = 0; i != file_results.size(); ++i) {
+    if (FAILED(file_results[i])) {
+      hr = file_results[i];
+      break;
+    }
+  }
+
+  if (results) {
+    results->swap(file_results);
+  }
+  return hr;
+}
+
 HRESULT CryptoHash::ComputeOrValidate(const std::vector<CString>& filepaths,
                                       uint64 max_len,
+                                      HashReadPolicy policy,
                                       const std::vector<byte>* hash_in,
                                       std::vector<byte>* hash_out) {
   ASSERT1(filepaths.size() > 0);
   ASSERT1(hash_in && !hash_out || !hash_in && hash_out);
-  UTIL_LOG(L1, (_T("[CryptoHash::ComputeOrValidate]")));
+  UTIL_LOG(L1, (_T("[CryptoHash::ComputeOrValidate][policy=%d]"), policy));
 
   uint64 curr_len = 0;
-  std::vector<byte> buf(kFileReadBufferSize);
-  static_assert(kFileReadBufferSize <= INT_MAX);
 
   std::unique_ptr<CryptDetails::HashInterface> hasher(
       CryptDetails::CreateHasher());
 
+  // Every policy but the synchronous one may read with overlapped I/O. The
+  // handle can be mapped as well, which needs GENERIC_READ.
+  const bool synchronous = policy == HASH_READ_SYNCHRONOUS;
+  const DWORD desired_access = synchronous ? FILE_READ_DATA : GENERIC_READ;
+  const DWORD flags = synchronous ?
+      FILE_ATTRIBUTE_NORMAL :
+      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN;
+
   for (size_t i = 0; i < filepaths.size(); ++i) {
     scoped_hfile file_handle(::CreateFile(filepaths[i],
-                                          FILE_READ_DATA,
+                                          desired_access,
                                           FILE_SHARE_READ,
                                           NULL,
                                           OPEN_EXISTING,
-                                          FILE_ATTRIBUTE_NORMAL,
+                                          flags,
                                           NULL));
     if (!file_handle) {
       return HRESULTFromLastError();
     }
 
+    LARGE_INTEGER file_size = {0};
+    if (!::GetFileSizeEx(get(file_handle), &file_size)) {
+      return HRESULTFromLastError();
+    }
+
     if (max_len) {
-      LARGE_INTEGER file_size = {0};
-      if (!::GetFileSizeEx(get(file_handle), &file_size)) {
-        return HRESULTFromLastError();
-      }
       curr_len += file_size.QuadPart;
       if (curr_len > max_len) {
-        UTIL_LOG(LE, (_T("[exceed max len][curr_len=%lu][max_len=%lu]"),
+        UTIL_LOG(LE, (_T("[exceed max len][curr_len=%I64u][max_len=%I64u]"),
                       curr_len, max_len));
         return SIGS_E_FILE_SIZE_TOO_BIG;
       }
     }
 
-    DWORD bytes_read = 0;
-    do {
-      if (!::ReadFile(get(file_handle),
-                      &buf[0],
-                      static_cast<DWORD>(buf.size()),
-                      &bytes_read,
-                      NULL)) {
-        return HRESULTFromLastError();
-      }
+    HashReadPolicy file_policy = policy;
+    if (file_policy == HASH_READ_AUTO) {
+      file_policy =
+          static_cast<uint64>(file_size.QuadPart) >= kMappedHashThreshold ?
+          HASH_READ_MAPPED : HASH_READ_PIPELINED;
+    }
 
-      if (bytes_read > 0) {
-        hasher->update(&buf[0], bytes_read);
-      }
-    } while (bytes_read == buf.size());
+    HRESULT hr = E_INVALIDARG;
+    switch (file_policy) {
+      case HASH_READ_SYNCHRONOUS:
+        hr = HashFileSynchronous(get(file_handle), hasher.get());
+        break;
+      case HASH_READ_PIPELINED:
+        hr = HashFilePipelined(get(file_handle), hasher.get());
+        break;
+      case HASH_READ_MAPPED:
+        hr = HashFileMapped(get(file_handle),
+                            static_cast<uint64>(file_size.QuadPart),
+                            hasher.get());
+        break;
+      default:
+        ASSERT1(false);
+        break;
+    }
+    if (FAILED(hr)) {
+      UTIL_LOG(LE, (_T("[hashing failed][%s][0x%08x]"), filepaths[i], hr));
+      return hr;
+    }
   }
 
   DWORD digest_size = static_cast<DWORD>(hash_size());
@@ -238,6 +637,12 @@ HRESULT CryptoHash::ComputeOrValidate(const std::vector<byte>& buffer_in,
 
 HRESULT VerifyFileHashSha256(const std::vector<CString>& files,
                              const CString& expected_hash) {
+  return VerifyFileHashSha256(files, expected_hash, HASH_READ_SYNCHRONOUS);
+}
+
+HRESULT VerifyFileHashSha256(const std::vector<CString>& files,
+                             const CString& expected_hash,
+                             HashReadPolicy policy) {
   ASSERT1(!files.empty());
 
   std::vector<uint8> hash_vector;
@@ -249,7 +654,10 @@ HRESULT VerifyFileHashSha256(const std::vector<CString>& files,
   if (!crypto.IsValidSize(hash_vector.size())) {
     return E_INVALIDARG;
   }
-  return crypto.Validate(files, kMaxFileSizeForAuthentication, hash_vector);
+  return crypto.Validate(files,
+                         kMaxFileSizeForAuthentication,
+                         policy,
+                         hash_vector);
 }
 
 }  // namespace omaha
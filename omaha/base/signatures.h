@@ -25,6 +25,7 @@
 #include <windows.h>
 #include <wincrypt.h>
 #include <atlstr.h>
+#include <utility>
 #include <vector>
 #include "base/basictypes.h"
 #include "omaha/base/security/sha256.h"
@@ -47,14 +48,57 @@ class HashInterface {
 
 HashInterface* CreateHasher();
 
+// Hashes several independent streams at once. Blocks from different streams
+// are processed together in SIMD lanes when the CPU supports it.
+class MultiHashInterface {
+ public:
+  virtual ~MultiHashInterface() {}
+
+  // The number of streams. Streams are numbered 0 to num_streams() - 1.
+  virtual size_t num_streams() const = 0;
+
+  // Starts a new hash in |stream|.
+  virtual void reset(size_t stream) = 0;
+
+  // Adds len[i] bytes of data[i] to stream i, for every stream. The arrays
+  // have num_streams() entries; streams with a zero length are left as is.
+  virtual void update(const void* const* data, const unsigned int* len) = 0;
+
+  virtual const uint8_t* final(size_t stream) = 0;
+  virtual size_t hash_size() const = 0;
+};
+
+MultiHashInterface* CreateMultiHasher();
+
 }  // namespace CryptDetails
 
+// How CryptoHash reads the files that it hashes.
+enum HashReadPolicy {
+  // Reads a buffer, hashes it, and repeats.
+  HASH_READ_SYNCHRONOUS = 0,
+
+  // Overlapped reads into two buffers: the next buffer is read from disk while
+  // the current one is hashed.
+  HASH_READ_PIPELINED,
+
+  // Hashes the file through read-only views of a file mapping and lets the
+  // memory manager read ahead.
+  HASH_READ_MAPPED,
+
+  // HASH_READ_MAPPED for files of at least kMappedHashThreshold bytes,
+  // otherwise HASH_READ_PIPELINED.
+  HASH_READ_AUTO,
+};
+
 // Compute and validate SHA256 hashes of data.
 class CryptoHash {
  public:
   CryptoHash() = default;
   ~CryptoHash() = default;
 
+  // Files at least this large are mapped into memory by HASH_READ_AUTO.
+  static constexpr uint64 kMappedHashThreshold = 64 * 1024 * 1024;  // 64MB.
+
   // Hash a file
   HRESULT Compute(const TCHAR * filepath,
                   uint64 max_len,
@@ -65,6 +109,13 @@ class CryptoHash {
                   uint64 max_len,
                   std::vector<byte>* hash_out);
 
+  // Hash a list of files, reading them as |policy| specifies. The overloads
+  // without a policy use HASH_READ_SYNCHRONOUS.
+  HRESULT Compute(const std::vector<CString>& filepaths,
+                  uint64 max_len,
+                  HashReadPolicy policy,
+                  std::vector<byte>* hash_out);
+
   // Hash a buffer
   HRESULT Compute(const std::vector<byte>& buffer_in,
                   std::vector<byte>* hash_out);
@@ -79,10 +130,27 @@ class CryptoHash {
                    uint64 max_len,
                    const std::vector<byte>& hash_in);
 
+  // Verify hash of a list of files, reading them as |policy| specifies.
+  HRESULT Validate(const std::vector<CString>& filepaths,
+                   uint64 max_len,
+                   HashReadPolicy policy,
+                   const std::vector<byte>& hash_in);
+
   // Verify hash of a buffer
   HRESULT Validate(const std::vector<byte>& buffer_in,
                    const std::vector<byte>& hash_in);
 
+  // Verify the hashes of several files, each against its own expected hash.
+  // The files are hashed concurrently with a MultiHashInterface. Unlike the
+  // overloads above, which limit the total size of the files, |max_file_len|
+  // limits the size of each file; 0 means no limit. If |results| is not NULL,
+  // it receives the outcome for each file, in order. Returns S_OK if every
+  // file matches, otherwise the first failure.
+  HRESULT Validate(
+      const std::vector<std::pair<CString, std::vector<byte>>>& files,
+      uint64 max_file_len,
+      std::vector<HRESULT>* results);
+
   bool IsValidSize(size_t size) const {
     return size == hash_size();
   }
@@ -95,6 +163,7 @@ class CryptoHash {
   // Compute or verify hash of a file
   HRESULT ComputeOrValidate(const std::vector<CString>& filepaths,
                             uint64 max_len,
+                            HashReadPolicy policy,
                             const std::vector<byte>* hash_in,
                             std::vector<byte>* hash_out);
 
@@ -111,6 +180,11 @@ class CryptoHash {
 HRESULT VerifyFileHashSha256(const std::vector<CString>& files,
                              const CString& expected_hash);
 
+// Same as above, reading the files as |policy| specifies.
+HRESULT VerifyFileHashSha256(const std::vector<CString>& files,
+                             const CString& expected_hash,
+                             HashReadPolicy policy);
+
 }  // namespace omaha
 
 #endif  // OMAHA_BASE_SIGNATURES_H_
@@ -21,15 +21,22 @@
 // empty vector iterators were being dereferenced. Ensure that all these are
 // being tested.
 
+#include <algorithm>
 #include <cstring>
+#include <iostream>
+#include <memory>
+#include <utility>
 #include <vector>
 #include "omaha/base/app_util.h"
 #include "omaha/base/error.h"
+#include "omaha/base/file.h"
+#include "omaha/base/highres_timer-win32.h"
 #include "omaha/base/path.h"
 #include "omaha/base/signatures.h"
 #include "omaha/base/string.h"
 #include "omaha/base/utils.h"
 #include "omaha/testing/unit_test.h"
+#include "omaha/third_party/smartany/scoped_any.h"
 
 namespace omaha {
 
@@ -58,6 +65,41 @@ struct {
 };
 
 
+// Writes |size| bytes of a pattern that depends on |seed| to |filename|. The
+// data is written in chunks so that large files do not need a large buffer.
+void WriteTestFile(const CString& filename, size_t size, int seed) {
+  const size_t kChunkSize = 1024 * 1024;
+  std::vector<byte> data(std::min(size, kChunkSize));
+
+  File file;
+  ASSERT_HRESULT_SUCCEEDED(file.Open(filename, true, false));
+  for (size_t offset = 0; offset < size; offset += data.size()) {
+    const size_t len = std::min(size - offset, data.size());
+    for (size_t i = 0; i != len; ++i) {
+      data[i] = static_cast<byte>((offset + i) * 31 + seed);
+    }
+
+    uint32 bytes_written = 0;
+    ASSERT_HRESULT_SUCCEEDED(file.Write(&data[0],
+                                        static_cast<uint32>(len),
+                                        &bytes_written));
+    ASSERT_EQ(len, bytes_written);
+  }
+}
+
+// Drops the cached pages of |filename|. Opening a file without buffering makes
+// the cache manager flush and purge the file.
+void EvictFromFileCache(const CString& filename) {
+  scoped_hfile file_handle(::CreateFile(filename,
+                                        FILE_READ_DATA,
+                                        FILE_SHARE_READ,
+                                        NULL,
+                                        OPEN_EXISTING,
+                                        FILE_FLAG_NO_BUFFERING,
+                                        NULL));
+  EXPECT_TRUE(file_handle);
+}
+
 }  // namespace
 
 TEST(SignaturesTest, CryptoHashSha256) {
@@ -128,5 +170,267 @@ TEST(SignaturesTest, VerifyFileHashSha256) {
   EXPECT_STREQ(hash_files, CString(actual_hash_files.c_str()));
 }
 
+TEST(SignaturesTest, CryptoHashValidateMultipleFiles) {
+  const CString temp_dir(GetUniqueTempDirectoryName());
+  ASSERT_HRESULT_SUCCEEDED(CreateDir(temp_dir, NULL));
+
+  // More files than streams, with sizes around the read buffer size so that
+  // streams finish at different times and pick up the pending files.
+  const size_t kSizes[] = {
+    0, 1, 63, 64, 65, 1000, 256 * 1024, 256 * 1024 + 1, 512 * 1024,
+    3 * 1024 * 1024 + 7, 100, 200 * 1024,
+  };
+
+  CryptoHash crypto;
+  std::vector<std::pair<CString, std::vector<byte>>> files;
+  for (size_t i = 0; i != arraysize(kSizes); ++i) {
+    CString filename;
+    filename.Format(_T("file%Iu.bin"), i);
+    filename = ConcatenatePath(temp_dir, filename);
+    WriteTestFile(filename, kSizes[i], static_cast<int>(i));
+
+    std::vector<byte> hash;
+    ASSERT_HRESULT_SUCCEEDED(crypto.Compute(filename, 0, &hash));
+    files.push_back(std::make_pair(filename, hash));
+  }
+
+  std::vector<HRESULT> results;
+  EXPECT_HRESULT_SUCCEEDED(crypto.Validate(files, 0, &results));
+  ASSERT_EQ(files.size(), results.size());
+  for (size_t i = 0; i != results.size(); ++i) {
+    EXPECT_HRESULT_SUCCEEDED(results[i]) << i;
+  }
+
+  // Mismatched hash, missing file, and a file over the per-file size limit.
+  // The other files must still validate.
+  files[2].second[0] ^= 0xff;
+  files[5].first += _T(".missing");
+  EXPECT_EQ(SIGS_E_INVALID_SIGNATURE,
+            crypto.Validate(files, 3 * 1024 * 1024, &results));
+  ASSERT_EQ(files.size(), results.size());
+  for (size_t i = 0; i != results.size(); ++i) {
+    if (i == 2) {
+      EXPECT_EQ(SIGS_E_INVALID_SIGNATURE, results[i]);
+    } else if (i == 5) {
+      EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND), results[i]);
+    } else if (i == 9) {
+      EXPECT_EQ(SIGS_E_FILE_SIZE_TOO_BIG, results[i]);
+    } else {
+      EXPECT_HRESULT_SUCCEEDED(results[i]) << i;
+    }
+  }
+
+  EXPECT_HRESULT_SUCCEEDED(DeleteDirectory(temp_dir));
+}
+
+// Every lane fails to read in the same round while files are still pending.
+// The pending files must still be hashed, and none of them may pass unchecked.
+TEST(SignaturesTest, CryptoHashValidateMultipleFiles_ReadFailsInEveryLane) {
+  const CString temp_dir(GetUniqueTempDirectoryName());
+  ASSERT_HRESULT_SUCCEEDED(CreateDir(temp_dir, NULL));
+
+  std::unique_ptr<CryptDetails::MultiHashInterface> hasher(
+      CryptDetails::CreateMultiHasher());
+  const size_t num_streams = hasher->num_streams();
+  const size_t num_files = 2 * num_streams + 1;
+
+  CryptoHash crypto;
+  std::vector<std::pair<CString, std::vector<byte>>> files;
+  for (size_t i = 0; i != num_files; ++i) {
+    CString filename;
+    filename.Format(_T("file%Iu.bin"), i);
+    filename = ConcatenatePath(temp_dir, filename);
+    WriteTestFile(filename, 1000, static_cast<int>(i));
+
+    std::vector<byte> hash;
+    ASSERT_HRESULT_SUCCEEDED(crypto.Compute(filename, 0, &hash));
+    files.push_back(std::make_pair(filename, hash));
+  }
+
+  // The files the lanes open first can be opened but not read.
+  std::vector<std::unique_ptr<scoped_hfile>> locked_files;
+  for (size_t i = 0; i != num_streams; ++i) {
+    locked_files.push_back(std::make_unique<scoped_hfile>(
+        ::CreateFile(files[i].first,
+                     GENERIC_READ,
+                     FILE_SHARE_READ,
+                     NULL,
+                     OPEN_EXISTING,
+                     FILE_ATTRIBUTE_NORMAL,
+                     NULL)));
+    ASSERT_TRUE(valid(*locked_files.back()));
+    OVERLAPPED overlapped = {0};
+    ASSERT_TRUE(::LockFileEx(get(*locked_files.back()),
+                             LOCKFILE_EXCLUSIVE_LOCK |
+                                 LOCKFILE_FAIL_IMMEDIATELY,
+                             0,
+                             MAXDWORD,
+                             MAXDWORD,
+                             &overlapped));
+  }
+
+  // One of the pending files does not match.
+  files[num_files - 1].second[0] ^= 0xff;
+
+  std::vector<HRESULT> results;
+  EXPECT_HRESULT_FAILED(crypto.Validate(files, 0, &results));
+  ASSERT_EQ(files.size(), results.size());
+  for (size_t i = 0; i != results.size(); ++i) {
+    if (i < num_streams) {
+      EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_LOCK_VIOLATION), results[i]) << i;
+    } else if (i == num_files - 1) {
+      EXPECT_EQ(SIGS_E_INVALID_SIGNATURE, results[i]);
+    } else {
+      EXPECT_HRESULT_SUCCEEDED(results[i]) << i;
+    }
+  }
+
+  locked_files.clear();
+  EXPECT_HRESULT_SUCCEEDED(DeleteDirectory(temp_dir));
+}
+
+TEST(SignaturesTest, CryptoHashReadPolicies) {
+  const CString temp_dir(GetUniqueTempDirectoryName());
+  ASSERT_HRESULT_SUCCEEDED(CreateDir(temp_dir, NULL));
+
+  // Sizes around the read buffer and mapped view sizes.
+  const size_t kSizes[] = {
+    0, 1, 1024 * 1024 - 1, 1024 * 1024, 1024 * 1024 + 1,
+    2 * 1024 * 1024, 16 * 1024 * 1024 + 3,
+  };
+  const HashReadPolicy kPolicies[] = {
+    HASH_READ_SYNCHRONOUS, HASH_READ_PIPELINED, HASH_READ_MAPPED,
+    HASH_READ_AUTO,
+  };
+
+  CryptoHash crypto;
+  std::vector<CString> all_files;
+  std::vector<byte> all_data;
+  for (size_t i = 0; i != arraysize(kSizes); ++i) {
+    CString filename;
+    filename.Format(_T("file%Iu.bin"), i);
+    filename = ConcatenatePath(temp_dir, filename);
+    WriteTestFile(filename, kSizes[i], static_cast<int>(i));
+    all_files.push_back(filename);
+
+    std::vector<byte> data;
+    for (size_t j = 0; j != kSizes[i]; ++j) {
+      data.push_back(static_cast<byte>(j * 31 + i));
+    }
+    all_data.insert(all_data.end(), data.begin(), data.end());
+
+    std::vector<byte> expected_hash;
+    ASSERT_HRESULT_SUCCEEDED(crypto.Compute(data, &expected_hash));
+
+    const std::vector<CString> files(1, filename);
+    for (size_t j = 0; j != arraysize(kPolicies); ++j) {
+      std::vector<byte> hash;
+      EXPECT_HRESULT_SUCCEEDED(crypto.Compute(files, 0, kPolicies[j], &hash));
+      EXPECT_TRUE(hash == expected_hash) << kSizes[i] << _T(" ") << j;
+      EXPECT_HRESULT_SUCCEEDED(crypto.Validate(files, 0, kPolicies[j],
+                                               expected_hash));
+    }
+  }
+
+  // All the files hashed as one stream.
+  std::vector<byte> expected_hash;
+  ASSERT_HRESULT_SUCCEEDED(crypto.Compute(all_data, &expected_hash));
+  for (size_t j = 0; j != arraysize(kPolicies); ++j) {
+    EXPECT_HRESULT_SUCCEEDED(crypto.Validate(all_files, 0, kPolicies[j],
+                                             expected_hash));
+    EXPECT_EQ(SIGS_E_FILE_SIZE_TOO_BIG,
+              crypto.Validate(all_files, 1024, kPolicies[j], expected_hash));
+  }
+
+  EXPECT_HRESULT_SUCCEEDED(DeleteDirectory(temp_dir));
+}
+
+// Hashes a 500 MB file with each read policy, with the file evicted from the
+// file cache and then with the file cached. Run with
+// --gtest_also_run_disabled_tests.
+TEST(SignaturesTest, DISABLED_CryptoHashReadPolicyBenchmark) {
+  const size_t kFileSize = 500 * 1024 * 1024;
+  const HashReadPolicy kPolicies[] = {
+    HASH_READ_SYNCHRONOUS, HASH_READ_PIPELINED, HASH_READ_MAPPED,
+  };
+  const TCHAR* const kPolicyNames[] = {
+    _T("synchronous"), _T("pipelined"), _T("mapped"),
+  };
+
+  const CString temp_dir(GetUniqueTempDirectoryName());
+  ASSERT_HRESULT_SUCCEEDED(CreateDir(temp_dir, NULL));
+  const CString filename(ConcatenatePath(temp_dir, _T("file.bin")));
+  WriteTestFile(filename, kFileSize, 0);
+  const std::vector<CString> files(1, filename);
+
+  CryptoHash crypto;
+  std::vector<byte> hash;
+  ASSERT_HRESULT_SUCCEEDED(crypto.Compute(files, 0, HASH_READ_SYNCHRONOUS,
+                                          &hash));
+
+  for (int cold = 1; cold >= 0; --cold) {
+    for (size_t i = 0; i != arraysize(kPolicies); ++i) {
+      if (cold) {
+        EvictFromFileCache(filename);
+      }
+
+      HighresTimer timer;
+      EXPECT_HRESULT_SUCCEEDED(crypto.Validate(files, 0, kPolicies[i], hash));
+      const ULONGLONG elapsed_ms =
+          timer.GetElapsedMs() > 0 ? timer.GetElapsedMs() : 1;
+
+      std::wcout << (cold ? _T("[cold] ") : _T("[warm] "))
+                 << kPolicyNames[i] << _T(": ") << elapsed_ms << _T(" ms, ")
+                 << kFileSize / (1024 * 1024) * 1000 / elapsed_ms
+                 << _T(" MB/s")
+                 << std::endl;
+    }
+  }
+
+  EXPECT_HRESULT_SUCCEEDED(DeleteDirectory(temp_dir));
+}
+
+// Compares validating 32 files of 8 MB one at a time against validating them
+// in a single batch. Run with --gtest_also_run_disabled_tests.
+TEST(SignaturesTest, DISABLED_CryptoHashValidateMultipleFilesBenchmark) {
+  const size_t kNumFiles = 32;
+  const size_t kFileSize = 8 * 1024 * 1024;
+
+  const CString temp_dir(GetUniqueTempDirectoryName());
+  ASSERT_HRESULT_SUCCEEDED(CreateDir(temp_dir, NULL));
+
+  CryptoHash crypto;
+  std::vector<std::pair<CString, std::vector<byte>>> files;
+  for (size_t i = 0; i != kNumFiles; ++i) {
+    CString filename;
+    filename.Format(_T("file%Iu.bin"), i);
+    filename = ConcatenatePath(temp_dir, filename);
+    WriteTestFile(filename, kFileSize, static_cast<int>(i));
+
+    std::vector<byte> hash;
+    ASSERT_HRESULT_SUCCEEDED(crypto.Compute(filename, 0, &hash));
+    files.push_back(std::make_pair(filename, hash));
+  }
+
+  HighresTimer per_file_timer;
+  for (size_t i = 0; i != files.size(); ++i) {
+    EXPECT_HRESULT_SUCCEEDED(crypto.Validate(files[i].first,
+                                             0,
+                                             files[i].second));
+  }
+  const ULONGLONG per_file_ms = per_file_timer.GetElapsedMs();
+
+  HighresTimer batch_timer;
+  EXPECT_HRESULT_SUCCEEDED(crypto.Validate(files, 0, NULL));
+  const ULONGLONG batch_ms = batch_timer.GetElapsedMs();
+
+  std::wcout << _T("Validated ") << kNumFiles << _T(" x ")
+             << kFileSize / (1024 * 1024) << _T(" MB: per file ")
+             << per_file_ms << _T(" ms, batch ") << batch_ms << _T(" ms")
+             << std::endl;
+
+  EXPECT_HRESULT_SUCCEEDED(DeleteDirectory(temp_dir));
+}
+
 }  // namespace omaha
 
@@ -216,6 +216,49 @@ DWORD_PTR LLock::GetOwner() const {
          reinterpret_cast<DWORD_PTR>(critical_section_.OwningThread) : 0;
 }
 
+RWLock::RWLock() {
+  ::InitializeSRWLock(&srw_lock_);
+}
+
+RWLock::~RWLock() {
+}
+
+bool RWLock::Lock() const {
+  ::AcquireSRWLockExclusive(&srw_lock_);
+  return true;
+}
+
+bool RWLock::Unlock() const {
+  ::ReleaseSRWLockExclusive(&srw_lock_);
+  return true;
+}
+
+bool RWLock::LockShared() const {
+  ::AcquireSRWLockShared(&srw_lock_);
+  return true;
+}
+
+bool RWLock::UnlockShared() const {
+  ::ReleaseSRWLockShared(&srw_lock_);
+  return true;
+}
+
+bool RWLock::TryLock() const {
+  return !!::TryAcquireSRWLockExclusive(&srw_lock_);
+}
+
+bool RWLock::TryLockShared() const {
+  return !!::TryAcquireSRWLockShared(&srw_lock_);
+}
+
+AutoSharedSync::AutoSharedSync(const RWLock& lock) : lock_(lock) {
+  VERIFY(lock_.LockShared(), (L"Failed to lock in constructor"));
+}
+
+AutoSharedSync::~AutoSharedSync() {
+  VERIFY(lock_.UnlockShared(), (L"Failed to unlock in destructor"));
+}
+
 // Use this c-tor for interprocess gates.
 Gate::Gate(const TCHAR * event_name) : gate_(NULL) {
   VERIFY(Initialize(event_name), (_T("")));
@@ -169,6 +169,43 @@ class LLock : public Lockable {
   DISALLOW_COPY_AND_ASSIGN(LLock);
 };
 
+// RWLock is a slim reader-writer lock, local to the process. Lock and Unlock
+// acquire the lock in exclusive mode, so the lock works with __mutexScope.
+// LockShared and UnlockShared acquire it in shared mode, which is what
+// __sharedMutexScope does. Unlike LLock, the lock is not recursive in either
+// mode.
+class RWLock : public Lockable {
+ public:
+  RWLock();
+  virtual ~RWLock();
+  virtual bool Lock() const;
+  virtual bool Unlock() const;
+  bool LockShared() const;
+  bool UnlockShared() const;
+
+  // Return false without waiting if the lock cannot be acquired.
+  bool TryLock() const;
+  bool TryLockShared() const;
+
+ private:
+  mutable SRWLOCK srw_lock_;
+  DISALLOW_COPY_AND_ASSIGN(RWLock);
+};
+
+// Scope based shared access to a RWLock.
+class AutoSharedSync {
+ public:
+  explicit AutoSharedSync(const RWLock& lock);
+  ~AutoSharedSync();
+
+ private:
+  const RWLock& lock_;
+  DISALLOW_COPY_AND_ASSIGN(AutoSharedSync);
+};
+
+#define __sharedMutexScope(lock) \
+    AutoSharedSync MAKE_NAME(hiddenSharedLock)(lock)
+
 // A gate is a synchronization object used to either stop all
 // threads from proceeding through a point or to allow them all to proceed.
 class Gate {
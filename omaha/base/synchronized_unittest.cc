@@ -30,6 +30,35 @@ TEST(LLockTest, GetOwner) {
   EXPECT_EQ(0, lock.GetOwner());
 }
 
+TEST(RWLockTest, SharedAndExclusive) {
+  RWLock lock;
+
+  // Readers share the lock, and keep writers out.
+  EXPECT_TRUE(lock.LockShared());
+  EXPECT_TRUE(lock.TryLockShared());
+  EXPECT_FALSE(lock.TryLock());
+  EXPECT_TRUE(lock.UnlockShared());
+  EXPECT_FALSE(lock.TryLock());
+  EXPECT_TRUE(lock.UnlockShared());
+
+  // A writer keeps everyone out.
+  EXPECT_TRUE(lock.TryLock());
+  EXPECT_FALSE(lock.TryLock());
+  EXPECT_FALSE(lock.TryLockShared());
+  EXPECT_TRUE(lock.Unlock());
+
+  {
+    __sharedMutexScope(lock);
+    EXPECT_FALSE(lock.TryLock());
+  }
+  {
+    __mutexScope(lock);
+    EXPECT_FALSE(lock.TryLockShared());
+  }
+  EXPECT_TRUE(lock.TryLock());
+  EXPECT_TRUE(lock.Unlock());
+}
+
 TEST(GateTest, WaitAny) {
   const DWORD kTimeout = 100;
   const size_t kFewGates = 10;
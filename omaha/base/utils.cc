@@ -1372,17 +1372,19 @@ HRESULT ReadEntireFileShareMode(const TCHAR* filepath,
 
   ON_SCOPE_EXIT_OBJ(file, &File::Close);
 
-  uint32 file_len = 0;
-  hr = file.GetLength(&file_len);
+  uint64 file_len64 = 0;
+  hr = file.GetLength(&file_len64);
   if (FAILED(hr)) {
     // Should never happen
     return hr;
   }
 
-  if (max_len != 0 && file_len > max_len) {
+  if ((max_len != 0 && file_len64 > max_len) ||
+      file_len64 > std::numeric_limits<uint32_t>::max()) {
     // Too large to consider
     return MEM_E_INVALID_SIZE;
   }
+  const uint32 file_len = static_cast<uint32>(file_len64);
 
   if (file_len == 0) {
     buffer_out->clear();
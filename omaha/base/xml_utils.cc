@@ -179,6 +179,41 @@ HRESULT LoadXMLFromRawData(const std::vector<byte>& xmldata,
   return S_OK;
 }
 
+HRESULT LoadXMLFromStream(ISequentialStream* xmlstream,
+                          bool preserve_whitespace,
+                          IXMLDOMDocument** xmldoc) {
+  ASSERT1(xmldoc);
+  ASSERT1(!*xmldoc);
+
+  *xmldoc = NULL;
+  if (!xmlstream) {
+    return E_INVALIDARG;
+  }
+
+  CComPtr<IXMLDOMDocument> my_xmldoc;
+  RET_IF_FAILED(CoCreateSafeDOMDocument(&my_xmldoc));
+  RET_IF_FAILED(my_xmldoc->put_preserveWhiteSpace(
+                              VARIANT_BOOL(preserve_whitespace)));
+
+  CComVariant xmlvar(static_cast<IUnknown*>(xmlstream));
+
+  VARIANT_BOOL is_successful(VARIANT_FALSE);
+  RET_IF_FAILED(my_xmldoc->load(xmlvar, &is_successful));
+  if (!is_successful) {
+    CComPtr<IXMLDOMParseError> error;
+    CString error_message;
+    RET_IF_FAILED(GetXMLParseError(my_xmldoc, &error));
+    ASSERT1(error);
+    HRESULT error_code = 0;
+    RET_IF_FAILED(InterpretXMLParseError(error, &error_code, &error_message));
+    UTIL_LOG(LE, (_T("[LoadXMLFromStream][parse error: %s]"), error_message));
+    ASSERT1(FAILED(error_code));
+    return FAILED(error_code) ? error_code : CI_E_XML_LOAD_ERROR;
+  }
+  *xmldoc = my_xmldoc.Detach();
+  return S_OK;
+}
+
 HRESULT SaveXMLToFile(IXMLDOMDocument* xmldoc, const TCHAR* xmlfile) {
   ASSERT1(xmldoc);
   ASSERT1(xmlfile);
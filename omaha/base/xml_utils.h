@@ -51,6 +51,12 @@ HRESULT LoadXMLFromRawData(const std::vector<byte>& xmldata,
                            bool preserve_whitespace,
                            IXMLDOMDocument** xmldoc);
 
+// xmlstream is read by the xml parser as it parses, so the data does not need
+// to be contiguous in memory. It can be in any encoding the parser supports.
+HRESULT LoadXMLFromStream(ISequentialStream* xmlstream,
+                          bool preserve_whitespace,
+                          IXMLDOMDocument** xmldoc);
+
 // xmlfile is in encoding specified in the XML document.
 HRESULT SaveXMLToFile(IXMLDOMDocument* xmldoc, const TCHAR * xmlfile);
 
@@ -24,6 +24,7 @@
 #include <atlsecurity.h>
 #include <atltime.h>
 #include <math.h>
+#include <algorithm>
 #include "base/rand_util.h"
 #include "omaha/base/app_util.h"
 #include "omaha/base/constants.h"
@@ -359,6 +360,16 @@ HRESULT OmahaPolicyManager::GetPackageCacheExpirationTimeDays(
   return S_OK;
 }
 
+HRESULT OmahaPolicyManager::GetBackgroundDownloadRateLimitKBps(
+    DWORD* rate_limit) {
+  if (!policy_.is_initialized || policy_.background_download_rate_limit == -1) {
+    return E_FAIL;
+  }
+
+  *rate_limit = static_cast<DWORD>(policy_.background_download_rate_limit);
+  return S_OK;
+}
+
 HRESULT OmahaPolicyManager::GetProxyMode(CString* proxy_mode) {
   if (!policy_.is_initialized || policy_.proxy_mode.IsEmpty()) {
     return E_FAIL;
@@ -718,6 +729,32 @@ int ConfigManager::GetPackageCacheExpirationTimeDays(
   return v.value();
 }
 
+int ConfigManager::GetBackgroundDownloadRateLimitKBps(
+    IPolicyStatusValue** policy_status_value) const {
+  const DWORD kMaxRateLimit = kMaxBackgroundDownloadRateLimitKBps;
+
+  PolicyValue<DWORD> v;
+
+  for (size_t i = 0; i != policies_.size(); ++i) {
+    DWORD rate_limit = 0;
+    HRESULT hr = policies_[i]->GetBackgroundDownloadRateLimitKBps(&rate_limit);
+
+    if (SUCCEEDED(hr)) {
+      if (rate_limit <= kMaxRateLimit && rate_limit > 0) {
+        v.Update(policies_[i]->IsManaged(),
+                 policies_[i]->source(),
+                 rate_limit);
+      }
+    }
+  }
+
+  v.UpdateFinal(0, policy_status_value);
+
+  OPT_LOG(L5, (_T("[GetBackgroundDownloadRateLimitKBps][%s]"), v.ToString()));
+
+  return v.value();
+}
+
 HRESULT ConfigManager::GetProxyMode(
     CString* proxy_mode,
     IPolicyStatusValue** policy_status_value) const {
@@ -1056,6 +1093,8 @@ HRESULT ConfigManager::LoadGroupPolicies(bool should_acquire_critical_section) {
   GetPolicyDword(kRegValueCacheSizeLimitMBytes,
                  &group_policies.cache_size_limit);
   GetPolicyDword(kRegValueCacheLifeLimitDays, &group_policies.cache_life_limit);
+  GetPolicyDword(kRegValueBackgroundDownloadRateLimitKBps,
+                 &group_policies.background_download_rate_limit);
 
   GetPolicyDword(kRegValueUpdatesSuppressedStartHour,
                  &group_policies.updates_suppressed.start_hour);
@@ -1834,6 +1873,58 @@ bool ConfigManager::AlwaysAllowCrashUploads() const {
   return always_allow_crash_uploads != 0;
 }
 
+bool ConfigManager::ShouldAlwaysVerifyCachedPackages() const {
+  DWORD always_verify = 0;
+  RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
+                   kRegValueAlwaysVerifyCachedPackages,
+                   &always_verify);
+  return always_verify != 0;
+}
+
+int ConfigManager::GetPackageCacheCompressionTimeDays() const {
+  DWORD compression_time_days = 0;
+  RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
+                   kRegValueCompressCachedPackagesAfterDays,
+                   &compression_time_days);
+
+  // Packages older than the longest cache life time are purged anyway.
+  const DWORD kMaxCompressionTimeDays = 1800;
+  return compression_time_days <= kMaxCompressionTimeDays ?
+      static_cast<int>(compression_time_days) : 0;
+}
+
+int ConfigManager::GetDownloadConnections() const {
+  DWORD num_connections = 0;
+  RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
+                   kRegValueDownloadConnections,
+                   &num_connections);
+
+  const DWORD kMaxDownloadConnections = 8;
+  return static_cast<int>(
+      std::max<DWORD>(1, std::min(num_connections, kMaxDownloadConnections)));
+}
+
+int ConfigManager::GetDownloadAheadApps() const {
+  DWORD num_apps = 0;
+  RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
+                   kRegValueDownloadAheadApps,
+                   &num_apps);
+
+  const DWORD kMaxDownloadAheadApps = 4;
+  return static_cast<int>(std::min(num_apps, kMaxDownloadAheadApps));
+}
+
+int ConfigManager::GetMirrorRaceCount() const {
+  DWORD num_mirrors = 0;
+  RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
+                   kRegValueMirrorRaceCount,
+                   &num_mirrors);
+
+  const DWORD kMaxMirrorRaceCount = 4;
+  return static_cast<int>(
+      std::max<DWORD>(1, std::min(num_mirrors, kMaxMirrorRaceCount)));
+}
+
 bool ConfigManager::ShouldVerifyPayloadAuthenticodeSignature() const {
 #ifdef VERIFY_PAYLOAD_AUTHENTICODE_SIGNATURE
   DWORD disabled_in_registry = 0;
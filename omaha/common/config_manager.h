@@ -58,6 +58,7 @@ class PolicyManagerInterface {
   virtual HRESULT GetPackageCacheSizeLimitMBytes(DWORD* cache_size_limit) = 0;
   virtual HRESULT GetPackageCacheExpirationTimeDays(
       DWORD* cache_life_limit) = 0;
+  virtual HRESULT GetBackgroundDownloadRateLimitKBps(DWORD* rate_limit) = 0;
   virtual HRESULT GetProxyMode(CString* proxy_mode) = 0;
   virtual HRESULT GetProxyPacUrl(CString* proxy_pac_url) = 0;
   virtual HRESULT GetProxyServer(CString* proxy_server) = 0;
@@ -90,6 +91,7 @@ class OmahaPolicyManager : public PolicyManagerInterface {
       CString* download_preference) override;
   HRESULT GetPackageCacheSizeLimitMBytes(DWORD* cache_size_limit) override;
   HRESULT GetPackageCacheExpirationTimeDays(DWORD* cache_life_limit) override;
+  HRESULT GetBackgroundDownloadRateLimitKBps(DWORD* rate_limit) override;
   HRESULT GetProxyMode(CString* proxy_mode) override;
   HRESULT GetProxyPacUrl(CString* proxy_pac_url) override;
   HRESULT GetProxyServer(CString* proxy_server) override;
@@ -184,6 +186,11 @@ class ConfigManager {
   int GetPackageCacheExpirationTimeDays(
       IPolicyStatusValue** policy_status_value) const;
 
+  // Gets the rate limit of background update downloads, in kilobytes per
+  // second. Returns 0 if background downloads are not limited.
+  int GetBackgroundDownloadRateLimitKBps(
+      IPolicyStatusValue** policy_status_value) const;
+
   // Gets the proxy policy values.
   HRESULT GetProxyMode(CString* proxy_mode,
                        IPolicyStatusValue** policy_status_value) const;
@@ -439,6 +446,26 @@ class ConfigManager {
   // build flavor or other configuration parameters.
   bool AlwaysAllowCrashUploads() const;
 
+  // Returns true if cached packages must be hashed every time they are used,
+  // even when the package cache index says they have not changed.
+  bool ShouldAlwaysVerifyCachedPackages() const;
+
+  // Returns the number of days after which an unused cached package is
+  // compressed, or 0 if cached packages are never compressed.
+  int GetPackageCacheCompressionTimeDays() const;
+
+  // Returns the number of connections over which large packages are
+  // downloaded at once. Returns 1 if they are downloaded over one connection.
+  int GetDownloadConnections() const;
+
+  // Returns the number of apps of a bundle downloaded ahead of the app being
+  // installed. Returns 0 if apps are downloaded and installed one at a time.
+  int GetDownloadAheadApps() const;
+
+  // Returns the number of urls of a package raced against each other. Returns
+  // 1 if the urls are tried one at a time.
+  int GetMirrorRaceCount() const;
+
   // Returns whether the Authenticode signature of update payloads should be
   // verified.
   bool ShouldVerifyPayloadAuthenticodeSignature() const;
@@ -1973,6 +1973,22 @@ TEST_P(ConfigManagerTest, GetPackageCacheExpirationTimeDays_Override_Valid) {
             cm_->GetPackageCacheExpirationTimeDays(NULL));
 }
 
+TEST_P(ConfigManagerTest, GetBackgroundDownloadRateLimitKBps_Default) {
+  EXPECT_EQ(0, cm_->GetBackgroundDownloadRateLimitKBps(NULL));
+}
+
+TEST_P(ConfigManagerTest, GetBackgroundDownloadRateLimitKBps_Override_TooBig) {
+  EXPECT_SUCCEEDED(SetPolicy(kRegValueBackgroundDownloadRateLimitKBps,
+                             kMaxBackgroundDownloadRateLimitKBps + 1));
+  EXPECT_EQ(0, cm_->GetBackgroundDownloadRateLimitKBps(NULL));
+}
+
+TEST_P(ConfigManagerTest, GetBackgroundDownloadRateLimitKBps_Override_Valid) {
+  EXPECT_SUCCEEDED(SetPolicy(kRegValueBackgroundDownloadRateLimitKBps, 256));
+  EXPECT_EQ(IsDomain() ? 256 : 0,
+            cm_->GetBackgroundDownloadRateLimitKBps(NULL));
+}
+
 TEST_P(ConfigManagerTest, LastCheckedTime) {
   DWORD time = 500;
   EXPECT_SUCCEEDED(cm_->SetLastCheckedTime(true, time));
@@ -259,6 +259,14 @@ const TCHAR* const kRegValueLastOSVersion         = _T("LastOSVersion");
 // for update checks. See the explanation of kHeaderXRetryAfter in constants.h.
 const TCHAR* const kRegValueRetryAfter            = _T("RetryAfter");
 
+// The download history of the hosts packages are downloaded from, kept in a
+// subkey per host. See MirrorScoreboard.
+const TCHAR* const kRegSubkeyMirrors              = _T("mirrors");
+const TCHAR* const kRegValueMirrorBytesPerSec     = _T("BytesPerSec");
+const TCHAR* const kRegValueMirrorDownloads       = _T("Downloads");
+const TCHAR* const kRegValueMirrorErrorRate       = _T("ErrorRate");
+const TCHAR* const kRegValueMirrorLastDownload    = _T("LastDownload");
+
 // UID registry entries.
 const TCHAR* const kRegValueUserId                = _T("uid");
 const TCHAR* const kRegValueOldUserId             = _T("old-uid");
@@ -70,6 +70,15 @@ const TCHAR* const kRegValueDownloadPreference = _T("DownloadPreference");
 // Specifies that urls that can be cached by proxies are preferred.
 const TCHAR* const kDownloadPreferenceCacheable = _T("cacheable");
 
+// This policy limits the rate at which background updates are downloaded, in
+// kilobytes per second. Downloads of installs the user is waiting for are not
+// limited.
+const TCHAR* const kRegValueBackgroundDownloadRateLimitKBps =
+    _T("BackgroundDownloadRateLimit");
+
+// The maximum value allowed for policy BackgroundDownloadRateLimit.
+const int kMaxBackgroundDownloadRateLimitKBps = 1024 * 1024;
+
 #if defined(HAS_DEVICE_MANAGEMENT)
 
 // The name of the policy holding a token used to enroll in cloud-based
@@ -30,11 +30,26 @@ const TCHAR* DownloaderToString(DownloadMetrics::Downloader d) {
       return _T("winhttp");
     case DownloadMetrics::kBits:
       return _T("bits");
+    case DownloadMetrics::kSocket:
+      return _T("socket");
     default:
       return _T("unknown");
   }
 }
 
+// Adds the attribute |name| with the |time_ms| value if the time is known.
+HRESULT AddTimeAttribute(IXMLDOMNode* parent_node,
+                         const TCHAR* name,
+                         int64 time_ms) {
+  if (time_ms < 0) {
+    return S_OK;
+  }
+  return AddXMLAttributeNode(parent_node,
+                             xml::kXmlNamespace,
+                             name,
+                             String_Int64ToString(time_ms, 10));
+}
+
 }  // namespace
 
 CString DownloadMetricsToString(const DownloadMetrics& download_metrics) {
@@ -42,13 +57,20 @@ CString DownloadMetricsToString(const DownloadMetrics& download_metrics) {
   SafeCStringFormat(
       &result,
       _T("url=%s, downloader=%s, error=0x%x, ")
-      _T("downloaded_bytes=%I64i, total_bytes=%I64i, download_time=%I64i"),
+      _T("downloaded_bytes=%I64i, total_bytes=%I64i, download_time=%I64i, ")
+      _T("dns_time=%I64i, connect_time=%I64i, tls_time=%I64i, ttfb=%I64i, ")
+      _T("connection_reused=%d"),
       download_metrics.url,
       DownloaderToString(download_metrics.downloader),
       download_metrics.error,
       download_metrics.downloaded_bytes,
       download_metrics.total_bytes,
-      download_metrics.download_time_ms);
+      download_metrics.download_time_ms,
+      download_metrics.dns_time_ms,
+      download_metrics.connect_time_ms,
+      download_metrics.tls_time_ms,
+      download_metrics.ttfb_ms,
+      download_metrics.is_connection_reused);
   return result;
 }
 
@@ -57,7 +79,12 @@ DownloadMetrics::DownloadMetrics()
       error(0),
       downloaded_bytes(0),
       total_bytes(0),
-      download_time_ms(0) {
+      download_time_ms(0),
+      dns_time_ms(-1),
+      connect_time_ms(-1),
+      tls_time_ms(-1),
+      ttfb_ms(-1),
+      is_connection_reused(false) {
 }
 
 PingEventDownloadMetrics::PingEventDownloadMetrics(
@@ -122,6 +149,33 @@ HRESULT PingEventDownloadMetrics::ToXml(IXMLDOMNode* parent_node) const {
     return hr;
   }
 
+  // The latency breakdown is only known for some downloaders.
+  const struct {
+    const TCHAR* name;
+    int64 time_ms;
+  } kTimes[] = {
+    {xml::attribute::kDnsTime, download_metrics_.dns_time_ms},
+    {xml::attribute::kConnectTime, download_metrics_.connect_time_ms},
+    {xml::attribute::kTlsTime, download_metrics_.tls_time_ms},
+    {xml::attribute::kTtfb, download_metrics_.ttfb_ms},
+  };
+  for (size_t i = 0; i != arraysize(kTimes); ++i) {
+    hr = AddTimeAttribute(parent_node, kTimes[i].name, kTimes[i].time_ms);
+    if (FAILED(hr)) {
+      return hr;
+    }
+  }
+
+  if (download_metrics_.is_connection_reused) {
+    hr = AddXMLAttributeNode(parent_node,
+                             xml::kXmlNamespace,
+                             xml::attribute::kReused,
+                             _T("1"));
+    if (FAILED(hr)) {
+      return hr;
+    }
+  }
+
   return S_OK;
 }
 
@@ -23,7 +23,7 @@
 namespace omaha {
 
 struct DownloadMetrics {
-  enum Downloader { kNone = 0, kWinHttp, kBits };
+  enum Downloader { kNone = 0, kWinHttp, kBits, kSocket };
 
   DownloadMetrics();
 
@@ -39,6 +39,16 @@ struct DownloadMetrics {
   int64 total_bytes;
 
   int64 download_time_ms;
+
+  // The latency breakdown of the request, in milliseconds. -1 means that the
+  // step did not happen or that its time is unknown. A request on a reused
+  // connection neither resolves the name of the server nor connects to it.
+  int64 dns_time_ms;
+  int64 connect_time_ms;
+  int64 tls_time_ms;
+  int64 ttfb_ms;
+
+  bool is_connection_reused;
 };
 
 CString DownloadMetricsToString(const DownloadMetrics& download_metrics);
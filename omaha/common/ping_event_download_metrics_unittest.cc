@@ -99,4 +99,41 @@ TEST_F(PingEventDownloadMetricsTest, BuildPing) {
     << expected_ping_request_substring.GetString();
 }
 
+TEST_F(PingEventDownloadMetricsTest, BuildPing_LatencyBreakdown) {
+  SetUpRegistry();
+
+  DownloadMetrics download_metrics;
+  download_metrics.url = _T("https:\\\\host\\path");
+  download_metrics.downloader = DownloadMetrics::kWinHttp;
+  download_metrics.downloaded_bytes = 10;
+  download_metrics.total_bytes = 10;
+  download_metrics.download_time_ms = 500;
+  download_metrics.tls_time_ms = 40;
+  download_metrics.ttfb_ms = 120;
+  download_metrics.is_connection_reused = true;
+
+  PingEventPtr ping_event(
+      new PingEventDownloadMetrics(true,
+                                   PingEvent::EVENT_RESULT_SUCCESS,
+                                   download_metrics));
+
+  Ping ping(false, _T("unittest"), _T("InstallSource_Foo"));
+  std::vector<CString> apps;
+  apps.push_back(GOOPDATE_APP_ID);
+  ping.LoadAppDataFromRegistry(apps);
+  ping.BuildAppsPing(ping_event);
+
+  // The unknown times are left out.
+  const CString expected_ping_request_substring(
+      _T("downloaded=\"10\" total=\"10\" download_time_ms=\"500\" ")
+      _T("tls_time_ms=\"40\" ttfb_ms=\"120\" reused=\"1\"/>"));
+
+  CString actual_ping_request;
+  ping.BuildRequestString(&actual_ping_request);
+  EXPECT_NE(-1, actual_ping_request.Find(expected_ping_request_substring))
+    << actual_ping_request.GetString()
+    << _T("\n\r\n\r")
+    << expected_ping_request_substring.GetString();
+}
+
 }  // namespace omaha
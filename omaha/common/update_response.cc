@@ -35,6 +35,10 @@ HRESULT UpdateResponse::Deserialize(const std::vector<uint8>& buffer) {
   return XmlParser::DeserializeResponse(buffer, this);
 }
 
+HRESULT UpdateResponse::DeserializeFromStream(ISequentialStream* stream) {
+  return XmlParser::DeserializeResponse(stream, this);
+}
+
 HRESULT UpdateResponse::DeserializeFromFile(const CString& filename) {
   std::vector<uint8> buffer;
   HRESULT hr = ReadEntireFile(filename, 0, &buffer);
@@ -20,6 +20,7 @@
 #define OMAHA_COMMON_UPDATE_RESPONSE_H_
 
 #include <windows.h>
+#include <objidl.h>
 #include <utility>
 #include <vector>
 #include "base/basictypes.h"
@@ -39,6 +40,9 @@ class UpdateResponse {
   // Initializes an update response from a xml document in a buffer.
   HRESULT Deserialize(const std::vector<uint8>& buffer);
 
+  // Initializes an update response from a xml document read from a stream.
+  HRESULT DeserializeFromStream(ISequentialStream* stream);
+
   // Initializes an update response from a xml document in a file.
   HRESULT DeserializeFromFile(const CString& filename);
 
@@ -15,6 +15,7 @@
 
 #include "omaha/common/web_services_client.h"
 
+#include <atlbase.h>
 #include <atlstr.h>
 #include <algorithm>
 
@@ -29,9 +30,11 @@
 #include "omaha/common/update_request.h"
 #include "omaha/common/update_response.h"
 #include "omaha/net/cup_ecdsa_request.h"
+#include "omaha/net/host_health.h"
 #include "omaha/net/net_utils.h"
 #include "omaha/net/network_config.h"
 #include "omaha/net/network_request.h"
+#include "omaha/net/response_buffer.h"
 #include "omaha/net/simple_request.h"
 
 namespace omaha {
@@ -101,6 +104,7 @@ HRESULT WebServicesClient::CreateRequest() {
 
   network_request_->set_num_retries(1);
   network_request_->set_proxy_auth_config(proxy_auth_config_);
+  network_request_->set_host_health(&HostHealth::Instance());
 
   return S_OK;
 }
@@ -239,13 +243,15 @@ HRESULT WebServicesClient::SendStringInternal(
     return hr;
   }
 
-  std::vector<uint8> response_buffer;
+  // The response shares the bytes the http request received, and the parser
+  // reads them as a stream, so the response is not made contiguous.
+  ResponseBuffer response_buffer;
   hr = network_request_->PostUtf8String(actual_url,
                                         utf8_request_string,
                                         &response_buffer);
   CORE_LOG(L3, (_T("[the request returned 0x%x]"), hr));
-  const CString response_string(Utf8BufferToWideChar(response_buffer));
-  CORE_LOG(L3, (_T("[response received][%s]"), response_string));
+  CORE_LOG(L3, (_T("[response received][%s]"),
+                ResponseBufferToPrintableString(response_buffer)));
 
   // Save the values of the custom headers if the values are found.
   CaptureCustomHeaderValues();
@@ -266,7 +272,13 @@ HRESULT WebServicesClient::SendStringInternal(
   // The web services server is expected to reply with 200 OK if the
   // transaction has been successful.
   ASSERT1(is_http_success());
-  hr = update_response->Deserialize(response_buffer);
+  CComPtr<ISequentialStream> response_stream;
+  hr = response_buffer.CreateStream(&response_stream);
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[CreateStream failed][0x%x]"), hr));
+    return hr;
+  }
+  hr = update_response->DeserializeFromStream(response_stream);
   if (FAILED(hr)) {
     CORE_LOG(L3, (_T("[Deserialize failed][0x%x]"), hr));
     // If we received a 200 response that doesn't successfully parse, one
@@ -278,6 +290,8 @@ HRESULT WebServicesClient::SendStringInternal(
     //
     // If CUP is used, this case will be detected at the network layer, and the
     // call to PostUtf8String call will return OMAHA_NET_E_CAPTIVEPORTAL.
+    const CString response_string(
+        Utf8BufferToWideChar(response_buffer.ToVector()));
     if (NULL == stristrW(response_string, L"<response") &&
         NULL != stristrW(response_string, L"<html")) {
       CORE_LOG(LE, (_T("[HTML body detected - possibly a captive portal]")));
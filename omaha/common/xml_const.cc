@@ -71,12 +71,14 @@ const TCHAR* const kCodebase = _T("codebase");
 const TCHAR* const kCohort = _T("cohort");
 const TCHAR* const kCohortHint = _T("cohorthint");
 const TCHAR* const kCohortName = _T("cohortname");
+const TCHAR* const kConnectTime = _T("connect_time_ms");
 const TCHAR* const kCountry = _T("country");
 const TCHAR* const kDaysSinceLastActivePing = _T("a");
 const TCHAR* const kDaysSinceLastRollCall = _T("r");
 const TCHAR* const kDayOfLastActivity = _T("ad");
 const TCHAR* const kDayOfLastRollCall = _T("rd");
 const TCHAR* const kDedup = _T("dedup");
+const TCHAR* const kDnsTime = _T("dns_time_ms");
 const TCHAR* const kDlPref = _T("dlpref");
 const TCHAR* const kDomainJoined = _T("domainjoined");
 const TCHAR* const kDownloaded = _T("downloaded");
@@ -114,6 +116,7 @@ const TCHAR* const kPlatform = _T("platform");
 const TCHAR* const kProtocol = _T("protocol");
 const TCHAR* const kRequestId = _T("requestid");
 const TCHAR* const kRequired = _T("required");
+const TCHAR* const kReused = _T("reused");
 const TCHAR* const kRollbackAllowed = _T("rollback_allowed");
 const TCHAR* const kRun = _T("run");
 const TCHAR* const kServicePack = _T("sp");
@@ -139,7 +142,9 @@ const TCHAR* const kTerminateAllBrowsers = _T("terminateallbrowsers");
 const TCHAR* const kTimeSinceDownloadStart = _T("time_since_download_start_ms");
 const TCHAR* const kTimeSinceUpdateAvailable =
     _T("time_since_update_available_ms");
+const TCHAR* const kTlsTime = _T("tls_time_ms");
 const TCHAR* const kTotal = _T("total");
+const TCHAR* const kTtfb = _T("ttfb_ms");
 const TCHAR* const kTTToken = _T("tttoken");
 const TCHAR* const kUpdateCheckTime= _T("update_check_time_ms");
 const TCHAR* const kUpdateDisabled = _T("updatedisabled");
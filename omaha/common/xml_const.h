@@ -71,12 +71,14 @@ extern const TCHAR* const kCodebase;
 extern const TCHAR* const kCohort;
 extern const TCHAR* const kCohortHint;
 extern const TCHAR* const kCohortName;
+extern const TCHAR* const kConnectTime;
 extern const TCHAR* const kCountry;
 extern const TCHAR* const kDaysSinceLastActivePing;
 extern const TCHAR* const kDaysSinceLastRollCall;
 extern const TCHAR* const kDayOfLastActivity;
 extern const TCHAR* const kDayOfLastRollCall;
 extern const TCHAR* const kDedup;
+extern const TCHAR* const kDnsTime;
 extern const TCHAR* const kDlPref;
 extern const TCHAR* const kDomainJoined;
 extern const TCHAR* const kDownloaded;
@@ -114,6 +116,7 @@ extern const TCHAR* const kPlatform;
 extern const TCHAR* const kProtocol;
 extern const TCHAR* const kRequestId;
 extern const TCHAR* const kRequired;
+extern const TCHAR* const kReused;
 extern const TCHAR* const kRollbackAllowed;
 extern const TCHAR* const kRun;
 extern const TCHAR* const kServicePack;
@@ -138,7 +141,9 @@ extern const TCHAR* const kTestSource;
 extern const TCHAR* const kTerminateAllBrowsers;
 extern const TCHAR* const kTimeSinceDownloadStart;
 extern const TCHAR* const kTimeSinceUpdateAvailable;
+extern const TCHAR* const kTlsTime;
 extern const TCHAR* const kTotal;
+extern const TCHAR* const kTtfb;
 extern const TCHAR* const kTTToken;
 extern const TCHAR* const kUpdateCheckTime;
 extern const TCHAR* const kUpdateDisabled;
@@ -1716,10 +1716,31 @@ HRESULT XmlParser::DeserializeResponse(const std::vector<uint8>& buffer,
     return hr;
   }
 
+  return xml_parser.ParseResponse(update_response);
+}
+
+HRESULT XmlParser::DeserializeResponse(ISequentialStream* stream,
+                                       UpdateResponse* update_response) {
+  ASSERT1(stream);
+  ASSERT1(update_response);
+
+  XmlParser xml_parser;
+  HRESULT hr = LoadXMLFromStream(stream, false, &xml_parser.document_);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  return xml_parser.ParseResponse(update_response);
+}
+
+HRESULT XmlParser::ParseResponse(UpdateResponse* update_response) {
+  ASSERT1(update_response);
+  ASSERT1(document_);
+
   response::Response response;
-  xml_parser.response_ = &response;
+  response_ = &response;
 
-  hr = xml_parser.Parse();
+  HRESULT hr = Parse();
   if (FAILED(hr)) {
     return hr;
   }
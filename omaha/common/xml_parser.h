@@ -51,6 +51,10 @@ class XmlParser {
   static HRESULT DeserializeResponse(const std::vector<uint8>& buffer,
                                      UpdateResponse* update_response);
 
+  // Parses the update response as the parser reads it from the stream.
+  static HRESULT DeserializeResponse(ISequentialStream* stream,
+                                     UpdateResponse* update_response);
+
   // Generates the update request from the request node.
   static HRESULT SerializeRequest(const UpdateRequest& update_request,
                                   CString* buffer);
@@ -113,6 +117,9 @@ class XmlParser {
   // Starts parsing of the xml document.
   HRESULT Parse();
 
+  // Parses the loaded response document and fills in the UpdateResponse.
+  HRESULT ParseResponse(UpdateResponse* update_response);
+
   // Does a DFS traversal of the dom.
   HRESULT TraverseDOM(IXMLDOMNode* node);
 
@@ -468,7 +468,7 @@ class MockHttpRequest : public HttpRequestInterface {
   MOCK_METHOD0(Cancel, HRESULT());
   MOCK_METHOD0(Pause, HRESULT());
   MOCK_METHOD0(Resume, HRESULT());
-  MOCK_CONST_METHOD0(GetResponse, std::vector<uint8>());
+  MOCK_CONST_METHOD0(GetResponse, ResponseBuffer());
   MOCK_CONST_METHOD0(GetHttpStatusCode, int());
   MOCK_CONST_METHOD3(QueryHeadersString,
                      HRESULT(uint32 info_level,
@@ -489,6 +489,7 @@ class MockHttpRequest : public HttpRequestInterface {
   MOCK_METHOD1(set_user_agent, void(const CString& user_agent));
   MOCK_METHOD1(set_proxy_auth_config, void(const ProxyAuthConfig& config));
   MOCK_CONST_METHOD1(download_metrics, bool(DownloadMetrics* download_metrics));
+  MOCK_CONST_METHOD1(download_digest, bool(std::vector<uint8>* digest));
 };
 
 }  // namespace
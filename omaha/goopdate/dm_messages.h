@@ -178,6 +178,7 @@ struct CachedOmahaPolicy {
   CString download_preference;
   int64_t cache_size_limit = -1;
   int64_t cache_life_limit = -1;
+  int64_t background_download_rate_limit = -1;
   UpdatesSuppressed updates_suppressed;
   CString proxy_mode;
   CString proxy_server;
@@ -201,6 +202,9 @@ struct CachedOmahaPolicy {
                             cache_size_limit);
     SafeCStringAppendFormat(&result, _T("[cache_life_limit][%" _T(PRId64) "]"),
                             cache_life_limit);
+    SafeCStringAppendFormat(
+        &result, _T("[background_download_rate_limit][%" _T(PRId64) "]"),
+        background_download_rate_limit);
     SafeCStringAppendFormat(
         &result,
         _T("[updates_suppressed]") _T(
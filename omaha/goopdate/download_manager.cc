@@ -26,6 +26,7 @@
 #include <shlwapi.h>
 
 #include <algorithm>
+#include <memory>
 #include <vector>
 
 #include "omaha/base/debug.h"
@@ -42,6 +43,7 @@
 #include "omaha/common/config_manager.h"
 #include "omaha/common/const_goopdate.h"
 #include "omaha/common/google_signaturevalidator.h"
+#include "omaha/goopdate/mirror_scoreboard.h"
 #include "omaha/goopdate/model.h"
 #include "omaha/goopdate/package_cache.h"
 #include "omaha/goopdate/server_resource.h"
@@ -49,9 +51,13 @@
 #include "omaha/goopdate/worker_metrics.h"
 #include "omaha/goopdate/worker_utils.h"
 #include "omaha/net/bits_request.h"
+#include "omaha/net/download_checkpoint.h"
+#include "omaha/net/host_health.h"
 #include "omaha/net/http_client.h"
+#include "omaha/net/mirror_race.h"
 #include "omaha/net/network_request.h"
 #include "omaha/net/net_utils.h"
+#include "omaha/net/segmented_download.h"
 #include "omaha/net/simple_request.h"
 
 namespace omaha {
@@ -87,22 +93,58 @@ HRESULT CreateNetworkRequest(NetworkRequest** network_request_ptr) {
     ++metric_worker_download_skipped_bits_machine;
   }
 
-  network_request->AddHttpRequest(new SimpleRequest);
+  // WinHttp downloads resume from where an earlier session left them.
+  SimpleRequest* simple_request(new SimpleRequest);
+  simple_request->set_resumable(true);
+  network_request->AddHttpRequest(simple_request);
 
   network_request->set_num_retries(1);
+  network_request->set_host_health(&HostHealth::Instance());
   *network_request_ptr = network_request;
   return S_OK;
 }
 
+// Packages smaller than this are downloaded over a single connection.
+const uint64 kMinSegmentedDownloadSize = 8 * 1024 * 1024;
+
+// Creates the requests for the ranges of segmented downloads, and for the
+// racers of mirror races. They use WinHttp only, since each BITS job would
+// download in the background at its own pace. The segmented download retries
+// the ranges, and a failed race falls back to trying the urls one at a time.
+class SegmentRequestFactory : public SegmentedDownload::RequestFactory {
+ public:
+  SegmentRequestFactory(const NetworkConfig::Session& session,
+                        const ProxyAuthConfig& proxy_auth_config,
+                        bool low_priority)
+      : session_(session),
+        proxy_auth_config_(proxy_auth_config),
+        low_priority_(low_priority) {}
+
+  virtual NetworkRequest* CreateRequest() {
+    NetworkRequest* network_request(new NetworkRequest(session_));
+    network_request->AddHttpRequest(new SimpleRequest);
+    network_request->set_num_retries(0);
+    network_request->set_low_priority(low_priority_);
+    network_request->set_proxy_auth_config(proxy_auth_config_);
+    network_request->set_host_health(&HostHealth::Instance());
+    return network_request;
+  }
+
+ private:
+  const NetworkConfig::Session session_;
+  const ProxyAuthConfig proxy_auth_config_;
+  const bool low_priority_;
+
+  DISALLOW_COPY_AND_ASSIGN(SegmentRequestFactory);
+};
+
 // TODO(omaha): Unit test this method.
 HRESULT ValidateSize(File* source_file, uint64 expected_size) {
   CORE_LOG(L3, (_T("[ValidateSize][%lld]"), expected_size));
   ASSERT1(source_file);
   ASSERT1(expected_size != 0);
-  ASSERT(expected_size <= UINT_MAX,
-         (_T("TODO(omaha): Add uint64 support to GetFileSizeUnopen().")));
 
-  uint32 file_size(0);
+  uint64 file_size(0);
   HRESULT hr = source_file->GetLength(&file_size);
   ASSERT1(SUCCEEDED(hr));
   if (FAILED(hr)) {
@@ -158,6 +200,8 @@ DownloadManager::DownloadManager(bool is_machine)
   CORE_LOG(L3, (_T("[package_cache_root][%s]"), package_cache_root()));
 
   package_cache_.reset(new PackageCache);
+  mirror_scoreboard_.reset(
+      new MirrorScoreboard(MirrorScoreboard::GetKeyName(is_machine)));
 }
 
 DownloadManager::~DownloadManager() {
@@ -262,6 +306,22 @@ HRESULT DownloadManager::DownloadApp(App* app) {
 
   app->Downloading();
 
+  // The cached packages of the app are verified together before each of
+  // them is checked on its own.
+  std::vector<std::unique_ptr<PackageCache::Key>> keys;
+  std::vector<const PackageCache::Key*> key_ptrs;
+  std::vector<CString> hashes;
+  for (size_t i = 0; i < num_packages; ++i) {
+    const Package* package(app_version->GetPackage(i));
+    keys.push_back(std::unique_ptr<PackageCache::Key>(
+        new PackageCache::Key(app->app_guid_string(),
+                              app_version->version(),
+                              package->filename())));
+    key_ptrs.push_back(keys.back().get());
+    hashes.push_back(package->expected_hash());
+  }
+  package_cache()->VerifyPackages(key_ptrs, hashes);
+
   CString message;
   hr = S_OK;
 
@@ -355,7 +415,12 @@ HRESULT DownloadManager::DoDownloadPackage(Package* package, State* state) {
   OPT_LOG(L3, (_T("[DownloadManager::DoDownloadPackage][%s]"),
       key.ToString()));
 
-  if (!package_cache()->IsCached(key, package->expected_hash())) {
+  // The same package may be cached for another app or version, in which case
+  // it does not have to be downloaded again.
+  const bool is_cached =
+      package_cache()->IsCached(key, package->expected_hash()) ||
+      SUCCEEDED(package_cache()->Link(key, package->expected_hash()));
+  if (!is_cached) {
     CORE_LOG(L3, (_T("[The package is not cached]")));
 
     // TODO(omaha3): May need to consider the DownloadPackage case. Also, we may
@@ -374,22 +439,33 @@ HRESULT DownloadManager::DoDownloadPackage(Package* package, State* state) {
       return GOOPDATE_E_CANNOT_USE_NETWORK;
     }
 
-    CString unique_filename_path;
-    HRESULT hr = BuildUniqueFileName(package_name, &unique_filename_path);
+    CString download_file_path;
+    HRESULT hr = BuildResumableFileName(app_id,
+                                        package->expected_hash(),
+                                        package_name,
+                                        &download_file_path);
     if (FAILED(hr)) {
-      CORE_LOG(LE, (_T("[BuildUniqueFileName failed][0x%08x]"), hr));
+      CORE_LOG(LE, (_T("[BuildResumableFileName failed][0x%08x]"), hr));
       return hr;
     }
+    DeleteStalePartialDownloads(app_id, package_name, download_file_path);
 
     NetworkRequest* network_request = state->network_request();
 
     network_request->set_callback(package);
+    if (state->segmented_download()) {
+      state->segmented_download()->set_callback(package);
+    }
+    if (state->mirror_race()) {
+      state->mirror_race()->set_callback(package);
+    }
 
     const std::vector<CString> download_base_urls(
         package->app_version()->download_base_urls());
 
     hr = E_FAIL;
-    app->SetCurrentTimeAs(App::TIME_DOWNLOAD_START);
+    std::vector<CString> urls;
+    std::vector<int> url_indexes;
     for (size_t i = 0; i != download_base_urls.size(); ++i) {
       CString url;
       DWORD url_length(INTERNET_MAX_URL_LENGTH);
@@ -403,17 +479,67 @@ HRESULT DownloadManager::DoDownloadPackage(Package* package, State* state) {
       }
 
       ASSERT1(static_cast<DWORD>(url.GetLength()) == url_length);
+      urls.push_back(url);
+      url_indexes.push_back(static_cast<int>(i));
+    }
+
+    // When mirror racing is on, the hosts that served well in earlier sessions
+    // are tried first. Otherwise the urls keep the order the server gave them.
+    const size_t num_racers = static_cast<size_t>(cm.GetMirrorRaceCount());
+    std::vector<size_t> order;
+    if (num_racers > 1) {
+      mirror_scoreboard_->Rank(urls, &order);
+    } else {
+      for (size_t i = 0; i != urls.size(); ++i) {
+        order.push_back(i);
+      }
+    }
+    std::vector<CString> ranked_urls;
+    for (size_t i = 0; i != order.size(); ++i) {
+      ranked_urls.push_back(urls[order[i]]);
+    }
+
+    app->SetCurrentTimeAs(App::TIME_DOWNLOAD_START);
+
+    // The first urls race each other, unless a partial download from an
+    // earlier attempt can resume. Any failure other than a cancellation falls
+    // back to trying the urls one at a time.
+    if (state->mirror_race() &&
+        ranked_urls.size() > 1 &&
+        !DownloadCheckpoint::Exists(download_file_path)) {
+      const std::vector<CString> racer_urls(
+          ranked_urls.begin(),
+          ranked_urls.begin() + std::min(num_racers, ranked_urls.size()));
+      int winner = -1;
+      hr = DoDownloadPackageFromMirrors(racer_urls,
+                                        download_file_path,
+                                        package,
+                                        state,
+                                        &winner);
+      if (SUCCEEDED(hr)) {
+        app->set_source_url_index(url_indexes[order[winner]]);
+      }
+    }
 
-      hr = DoDownloadPackageFromUrl(url, unique_filename_path, package, state);
-      AddDownloadMetricsPingEvents(network_request->download_metrics(), app);
+    for (size_t i = 0;
+         FAILED(hr) && hr != GOOPDATE_E_CANCELLED && i != ranked_urls.size();
+         ++i) {
+      hr = DoDownloadPackageFromUrl(ranked_urls[i],
+                                    download_file_path,
+                                    package,
+                                    state);
       if (SUCCEEDED(hr)) {
-        app->set_source_url_index(static_cast<int>(i));
-        break;
+        app->set_source_url_index(url_indexes[order[i]]);
       }
     }
 
     VERIFY_SUCCEEDED(network_request->Close());
-    DeleteBeforeOrAfterReboot(unique_filename_path);
+
+    // A failed download that can resume is kept for the next attempt.
+    if (SUCCEEDED(hr) || !DownloadCheckpoint::Exists(download_file_path)) {
+      VERIFY_SUCCEEDED(DownloadCheckpoint::Delete(download_file_path));
+      DeleteBeforeOrAfterReboot(download_file_path);
+    }
     app->SetCurrentTimeAs(App::TIME_DOWNLOAD_COMPLETE);
 
     if (FAILED(hr)) {
@@ -449,39 +575,115 @@ HRESULT DownloadManager::DoDownloadPackageFromUrl(const CString& url,
   // to access the model until the file download is complete.
   ASSERT1(!package->model()->IsLockedByCaller());
 
+  App* app = package->app_version()->app();
   NetworkRequest* network_request = state->network_request();
+  SegmentedDownload* segmented_download = state->segmented_download();
+
+  // The digest computed while downloading, if any, lets the package cache
+  // reject a bad file without copying it first.
+  std::vector<uint8> download_digest;
+  bool has_digest = false;
+
+  // Large packages are downloaded in ranges over several connections, if the
+  // server supports it. Any failure other than a cancellation falls back to
+  // downloading the package over a single connection, which also resumes a
+  // partial download from an earlier attempt.
+  HRESULT hr = E_FAIL;
+  if (segmented_download &&
+      package->expected_size() >= kMinSegmentedDownloadSize &&
+      !DownloadCheckpoint::Exists(filename)) {
+    hr = segmented_download->DownloadFile(url,
+                                          package->expected_size(),
+                                          filename);
+    ReportDownloadMetrics(segmented_download->download_metrics(), app);
+    if (hr == GOOPDATE_E_CANCELLED) {
+      return hr;
+    }
+    if (SUCCEEDED(hr)) {
+      has_digest = segmented_download->download_digest(&download_digest);
+    } else {
+      OPT_LOG(LW, (_T("[segmented download failed][%#x]"), hr));
+    }
+  }
 
-  HRESULT hr = network_request->DownloadFile(url, filename);
   if (FAILED(hr)) {
-    OPT_LOG(LE, (_T("[DownloadFile failed][%#x]"), hr));
-    worker_utils::AddHttpRequestDataToEventLog(
-        hr,
-        S_OK,
-        network_request->http_status_code(),
-        network_request->trace(),
-        is_machine_);
-    return hr;
+    hr = network_request->DownloadFile(url, filename);
+    ReportDownloadMetrics(network_request->download_metrics(), app);
+    if (FAILED(hr)) {
+      OPT_LOG(LE, (_T("[DownloadFile failed][%#x]"), hr));
+      worker_utils::AddHttpRequestDataToEventLog(
+          hr,
+          S_OK,
+          network_request->http_status_code(),
+          network_request->trace(),
+          is_machine_);
+      return hr;
+    }
+    has_digest = network_request->download_digest(&download_digest);
   }
 
   // A file has been successfully downloaded from current url. Validate the file
   // and cache it.
+  return CacheDownloadedPackage(filename,
+                                package,
+                                has_digest ? &download_digest : NULL);
+}
+
+HRESULT DownloadManager::DoDownloadPackageFromMirrors(
+    const std::vector<CString>& urls,
+    const CString& filename,
+    Package* package,
+    State* state,
+    int* winner) {
+  OPT_LOG(L3, (_T("[starting mirror race][%Iu urls][to '%s']"),
+               urls.size(), filename));
+
+  // The race blocks like the download of a single url does.
+  ASSERT1(!package->model()->IsLockedByCaller());
 
+  App* app = package->app_version()->app();
+  MirrorRace* mirror_race = state->mirror_race();
+  ASSERT1(mirror_race);
+
+  HRESULT hr = mirror_race->DownloadFile(urls, filename, winner);
+  ReportDownloadMetrics(mirror_race->download_metrics(), app);
+  if (FAILED(hr)) {
+    OPT_LOG(LW, (_T("[mirror race failed][%#x]"), hr));
+    return hr;
+  }
+
+  std::vector<uint8> download_digest;
+  const bool has_digest = mirror_race->download_digest(&download_digest);
+  return CacheDownloadedPackage(filename,
+                                package,
+                                has_digest ? &download_digest : NULL);
+}
+
+HRESULT DownloadManager::CacheDownloadedPackage(
+    const CString& filename,
+    Package* package,
+    const std::vector<uint8>* download_digest) {
   // We open the downloaded file as the current (impersonated) user. This
   // ensures that we are not reading any privileged files that are otherwise
   // inaccessible to the impersonated user.
   File source_file;
-  hr = source_file.OpenShareMode(filename, false, false, FILE_SHARE_READ);
+  HRESULT hr = source_file.OpenShareMode(filename,
+                                         false,
+                                         false,
+                                         FILE_SHARE_READ);
   if (FAILED(hr)) {
     return hr;
   }
 
   // We copy the file to the Package Cache unimpersonated, since the package
   // cache is in a privileged location.
-  hr = CallAsSelfAndImpersonate3(this,
-                                 &DownloadManager::CachePackage,
-                                 static_cast<const Package*>(package),
-                                 &source_file,
-                                 &filename);
+  hr = CallAsSelfAndImpersonate4(
+      this,
+      &DownloadManager::DoCachePackage,
+      static_cast<const Package*>(package),
+      &source_file,
+      &filename,
+      download_digest);
   if (FAILED(hr)) {
     OPT_LOG(LE, (_T("[DownloadManager::CachePackage failed][%#x]"), hr));
   }
@@ -489,6 +691,32 @@ HRESULT DownloadManager::DoDownloadPackageFromUrl(const CString& url,
   return hr;
 }
 
+void DownloadManager::ReportDownloadMetrics(
+    const std::vector<DownloadMetrics>& download_metrics,
+    App* app) {
+  AddDownloadMetricsPingEvents(download_metrics, app);
+
+  // The download history is only used to rank the mirrors that race.
+  if (ConfigManager::Instance()->GetMirrorRaceCount() <= 1) {
+    return;
+  }
+
+  // The download history is kept in a privileged location.
+  HRESULT hr = CallAsSelfAndImpersonate1(
+      this,
+      &DownloadManager::RecordMirrorScores,
+      &download_metrics);
+  if (FAILED(hr)) {
+    OPT_LOG(LW, (_T("[RecordMirrorScores failed][%#x]"), hr));
+  }
+}
+
+HRESULT DownloadManager::RecordMirrorScores(
+    const std::vector<DownloadMetrics>* download_metrics) {
+  ASSERT1(download_metrics);
+  return mirror_scoreboard_->Record(*download_metrics);
+}
+
 
 void DownloadManager::Cancel(App* app) {
   CORE_LOG(L3, (_T("[DownloadManager::Cancel][0x%p]"), app));
@@ -523,9 +751,21 @@ HRESULT DownloadManager::PurgeAppLowerVersions(const CString& app_id,
   return package_cache()->PurgeAppLowerVersions(app_id, version);
 }
 
+HRESULT DownloadManager::CompressColdPackages(HANDLE stop_event) {
+  return package_cache()->CompressColdPackages(stop_event);
+}
+
 HRESULT DownloadManager::CachePackage(const Package* package,
                                       File* source_file,
                                       const CString* source_file_path) {
+  return DoCachePackage(package, source_file, source_file_path, NULL);
+}
+
+HRESULT DownloadManager::DoCachePackage(
+    const Package* package,
+    File* source_file,
+    const CString* source_file_path,
+    const std::vector<uint8>* computed_digest) {
   ASSERT1(package);
   ASSERT1(source_file);
 
@@ -545,8 +785,12 @@ HRESULT DownloadManager::CachePackage(const Package* package,
     }
   }
 
-  hr = package_cache()->Put(
-      key, source_file, package->expected_hash());
+  hr = computed_digest ?
+      package_cache()->Put(key,
+                           source_file,
+                           package->expected_hash(),
+                           *computed_digest) :
+      package_cache()->Put(key, source_file, package->expected_hash());
   if (hr != SIGS_E_INVALID_SIGNATURE) {
     if (FAILED(hr)) {
       set_error_extra_code1(static_cast<int>(hr));
@@ -609,6 +853,57 @@ HRESULT DownloadManager::BuildUniqueFileName(const CString& filename,
          GOOPDATEDOWNLOAD_E_UNIQUE_FILE_PATH_EMPTY : S_OK;
 }
 
+HRESULT DownloadManager::BuildResumableFileName(const CString& app_id,
+                                                const CString& hash,
+                                                const CString& filename,
+                                                CString* resumable_filename) {
+  ASSERT1(resumable_filename);
+
+  if (hash.IsEmpty()) {
+    return BuildUniqueFileName(filename, resumable_filename);
+  }
+
+  const CString temp_dir(ConfigManager::Instance()->GetTempDownloadDir());
+  if (temp_dir.IsEmpty()) {
+    return E_UNEXPECTED;
+  }
+
+  // Format of the file name is: <temp_download_dir>/<app_id>-<hash>-<filename>.
+  CString temp_filename;
+  SafeCStringFormat(&temp_filename, _T("%s-%s-%s"), app_id, hash, filename);
+  *resumable_filename = ConcatenatePath(temp_dir, temp_filename);
+
+  return resumable_filename->IsEmpty() ?
+         GOOPDATEDOWNLOAD_E_UNIQUE_FILE_PATH_EMPTY : S_OK;
+}
+
+void DownloadManager::DeleteStalePartialDownloads(
+    const CString& app_id,
+    const CString& filename,
+    const CString& resumable_filename) {
+  const CString temp_dir(ConfigManager::Instance()->GetTempDownloadDir());
+  if (temp_dir.IsEmpty()) {
+    return;
+  }
+
+  CString wildcard;
+  SafeCStringFormat(&wildcard, _T("%s-*-%s"), app_id, filename);
+  std::vector<CString> partial_files;
+  if (FAILED(File::GetWildcards(temp_dir, wildcard, &partial_files))) {
+    return;
+  }
+
+  for (size_t i = 0; i != partial_files.size(); ++i) {
+    if (partial_files[i].CompareNoCase(resumable_filename) == 0) {
+      continue;
+    }
+    CORE_LOG(L3, (_T("[deleting stale partial download][%s]"),
+                  partial_files[i]));
+    VERIFY_SUCCEEDED(DownloadCheckpoint::Delete(partial_files[i]));
+    DeleteBeforeOrAfterReboot(partial_files[i]);
+  }
+}
+
 HRESULT DownloadManager::CreateStateForApp(App* app, State** state) {
   ASSERT1(app);
   ASSERT1(state);
@@ -630,7 +925,21 @@ HRESULT DownloadManager::CreateStateForApp(App* app, State** state) {
   network_request->set_proxy_auth_config(
       app->app_bundle()->GetProxyAuthConfig());
 
-  std::unique_ptr<State> state_ptr(new State(app, network_request));
+  const ConfigManager& cm = *ConfigManager::Instance();
+  SegmentRequestFactory* segment_request_factory = NULL;
+  if (cm.GetDownloadConnections() > 1 || cm.GetMirrorRaceCount() > 1) {
+    NetworkConfig* network_config = NULL;
+    hr = NetworkConfigManager::Instance().GetUserNetworkConfig(&network_config);
+    if (SUCCEEDED(hr)) {
+      segment_request_factory = new SegmentRequestFactory(
+          network_config->session(),
+          app->app_bundle()->GetProxyAuthConfig(),
+          use_background_priority);
+    }
+  }
+
+  std::unique_ptr<State> state_ptr(
+      new State(app, network_request, segment_request_factory));
 
   __mutexBlock(lock()) {
     download_state_.push_back(state_ptr.release());
@@ -659,10 +968,25 @@ HRESULT DownloadManager::DeleteStateForApp(App* app) {
   return E_UNEXPECTED;
 }
 
-DownloadManager::State::State(App* app, NetworkRequest* network_request)
-    : app_(app), network_request_(network_request) {
+DownloadManager::State::State(
+    App* app,
+    NetworkRequest* network_request,
+    SegmentedDownload::RequestFactory* segment_request_factory)
+    : app_(app),
+      network_request_(network_request),
+      segment_request_factory_(segment_request_factory) {
   ASSERT1(app);
   ASSERT1(network_request);
+
+  const ConfigManager& cm = *ConfigManager::Instance();
+  if (segment_request_factory && cm.GetDownloadConnections() > 1) {
+    segmented_download_.reset(new SegmentedDownload(
+        segment_request_factory,
+        cm.GetDownloadConnections()));
+  }
+  if (segment_request_factory && cm.GetMirrorRaceCount() > 1) {
+    mirror_race_.reset(new MirrorRace(segment_request_factory));
+  }
 }
 
 DownloadManager::State::~State() {
@@ -675,7 +999,21 @@ NetworkRequest* DownloadManager::State::network_request() const {
   return network_request_.get();
 }
 
+SegmentedDownload* DownloadManager::State::segmented_download() const {
+  return segmented_download_.get();
+}
+
+MirrorRace* DownloadManager::State::mirror_race() const {
+  return mirror_race_.get();
+}
+
 HRESULT DownloadManager::State::CancelNetworkRequest() {
+  if (segmented_download_.get()) {
+    VERIFY_SUCCEEDED(segmented_download_->Cancel());
+  }
+  if (mirror_race_.get()) {
+    VERIFY_SUCCEEDED(mirror_race_->Cancel());
+  }
   return network_request_->Cancel();
 }
 
@@ -22,6 +22,7 @@
 #include <vector>
 
 #include "base/basictypes.h"
+#include "omaha/net/segmented_download.h"
 
 namespace omaha {
 
@@ -30,6 +31,8 @@ struct ErrorContext;
 class File;
 class HttpClient;
 struct Lockable;        // TODO(omaha): make Lockable a class.
+class MirrorRace;
+class MirrorScoreboard;
 class NetworkRequest;
 class Package;
 class PackageCache;
@@ -44,6 +47,7 @@ class DownloadManagerInterface {
   virtual HRESULT CachePackage(const Package* package,
                                File* source_file,
                                const CString* source_file_path) = 0;
+  virtual HRESULT CompressColdPackages(HANDLE stop_event) = 0;
   virtual HRESULT DownloadApp(App* app) = 0;
   virtual HRESULT GetPackage(const Package* package,
                              const CString& dir) const = 0;
@@ -67,6 +71,10 @@ class DownloadManager : public DownloadManagerInterface {
                                File* source_file,
                                const CString* source_file_path);
 
+  // Compresses the cached packages that were not used for a while. Returns
+  // E_ABORT if |stop_event| is signaled before it completes.
+  virtual HRESULT CompressColdPackages(HANDLE stop_event);
+
   // Downloads the specified app and stores its packages in the package cache.
   //
   // This is a blocking call. All errors are reported through the return value.
@@ -100,13 +108,23 @@ class DownloadManager : public DownloadManagerInterface {
   // Maintains per-app download state.
   class State {
    public:
-    State(App* app, NetworkRequest* network_request);
+    // |segment_request_factory| is NULL if packages are downloaded over a
+    // single connection, from one url at a time.
+    State(App* app,
+          NetworkRequest* network_request,
+          SegmentedDownload::RequestFactory* segment_request_factory);
     ~State();
 
     App* app() const { return app_; }
 
     NetworkRequest* network_request() const;
 
+    // Returns NULL if packages are downloaded over a single connection.
+    SegmentedDownload* segmented_download() const;
+
+    // Returns NULL if the urls of a package are tried one at a time.
+    MirrorRace* mirror_race() const;
+
     HRESULT CancelNetworkRequest();
 
    private:
@@ -115,6 +133,10 @@ class DownloadManager : public DownloadManagerInterface {
 
     std::unique_ptr<NetworkRequest> network_request_;
 
+    std::unique_ptr<SegmentedDownload::RequestFactory> segment_request_factory_;
+    std::unique_ptr<SegmentedDownload> segmented_download_;
+    std::unique_ptr<MirrorRace> mirror_race_;
+
     DISALLOW_COPY_AND_ASSIGN(State);
   };
 
@@ -131,6 +153,35 @@ class DownloadManager : public DownloadManagerInterface {
                                    Package* package,
                                    State* state);
 
+  // Races the mirrors in |urls| and returns the index of the url the package
+  // came from in |winner|.
+  HRESULT DoDownloadPackageFromMirrors(const std::vector<CString>& urls,
+                                       const CString& filename,
+                                       Package* package,
+                                       State* state,
+                                       int* winner);
+
+  // Validates the package downloaded to |filename| and caches it.
+  HRESULT CacheDownloadedPackage(const CString& filename,
+                                 Package* package,
+                                 const std::vector<uint8>* download_digest);
+
+  // Adds the ping events of the downloads in |download_metrics|, and records
+  // them in the download history of the mirrors.
+  void ReportDownloadMetrics(
+      const std::vector<DownloadMetrics>& download_metrics,
+      App* app);
+
+  HRESULT RecordMirrorScores(
+      const std::vector<DownloadMetrics>* download_metrics);
+
+  // Same as CachePackage. |computed_digest| is the SHA-256 digest of
+  // |source_file| if the caller has it, or NULL.
+  HRESULT DoCachePackage(const Package* package,
+                         File* source_file,
+                         const CString* source_file_path,
+                         const std::vector<uint8>* computed_digest);
+
   HRESULT EnsureSignatureIsValid(const CString& file_path);
 
   bool is_machine() const;
@@ -146,6 +197,21 @@ class DownloadManager : public DownloadManagerInterface {
   static HRESULT BuildUniqueFileName(const CString& filename,
                                      CString* unique_filename);
 
+  // Returns the full path to the file that the package with |hash| of
+  // |app_id| is downloaded to. The path is the same in every session, so
+  // that a partial download can resume. Returns a unique filename if the
+  // hash of the package is not known.
+  static HRESULT BuildResumableFileName(const CString& app_id,
+                                        const CString& hash,
+                                        const CString& filename,
+                                        CString* resumable_filename);
+
+  // Deletes the partial downloads of other versions of the package
+  // |filename| of |app_id|, which will not resume anymore.
+  static void DeleteStalePartialDownloads(const CString& app_id,
+                                          const CString& filename,
+                                          const CString& resumable_filename);
+
   // Locks shared instance state for concurrent downloads. This lock is
   // owned by this class.
   mutable Lockable* volatile lock_;
@@ -159,6 +225,8 @@ class DownloadManager : public DownloadManagerInterface {
 
   std::unique_ptr<PackageCache> package_cache_;
 
+  std::unique_ptr<MirrorScoreboard> mirror_scoreboard_;
+
   friend class DownloadManagerTest;
   DISALLOW_COPY_AND_ASSIGN(DownloadManager);
 };
@@ -80,6 +80,16 @@ class DownloadManagerTest : public AppTestBase {
                                                 unique_filename);
   }
 
+  static HRESULT BuildResumableFileName(const CString& app_id,
+                                        const CString& hash,
+                                        const CString& filename,
+                                        CString* resumable_filename) {
+    return DownloadManager::BuildResumableFileName(app_id,
+                                                   hash,
+                                                   filename,
+                                                   resumable_filename);
+  }
+
  protected:
   explicit DownloadManagerTest(bool is_machine)
       : AppTestBase(is_machine, true) {}
@@ -137,7 +147,7 @@ class DownloadManagerTest : public AppTestBase {
     HRESULT hr = file.OpenShareMode(file_path, false, false, FILE_SHARE_READ);
     ASSERT_SUCCEEDED(hr);
 
-    uint32 file_size(0);
+    uint64 file_size(0);
     ASSERT_SUCCEEDED(file.GetLength(&file_size));
 
     CryptoHash crypto;
@@ -1309,6 +1319,31 @@ TEST(DownloadManagerTest, BuildUniqueFileName) {
   EXPECT_STRNE(file1, file2);
 }
 
+TEST(DownloadManagerTest, BuildResumableFileName) {
+  const TCHAR* const kAppId = _T("{0B35E146-D9CB-4145-8A91-43FDCAEBCD1E}");
+  const TCHAR* const kHash =
+      _T("e6d4c3b1a0d5cbb4d3a0de73e9c8f1d0a7ab4a3ec0e5a4b6cd8a4c3ef2bd1f05");
+
+  // The same package is downloaded to the same file in every session.
+  CString file1, file2;
+  EXPECT_SUCCEEDED(DownloadManagerTest::BuildResumableFileName(
+      kAppId, kHash, _T("a"), &file1));
+  EXPECT_SUCCEEDED(DownloadManagerTest::BuildResumableFileName(
+      kAppId, kHash, _T("a"), &file2));
+  EXPECT_STREQ(file1, file2);
+
+  EXPECT_SUCCEEDED(DownloadManagerTest::BuildResumableFileName(
+      kAppId, kHash, _T("b"), &file2));
+  EXPECT_STRNE(file1, file2);
+
+  // Without a hash, the package can't be told from another version.
+  EXPECT_SUCCEEDED(DownloadManagerTest::BuildResumableFileName(
+      kAppId, CString(), _T("a"), &file1));
+  EXPECT_SUCCEEDED(DownloadManagerTest::BuildResumableFileName(
+      kAppId, CString(), _T("a"), &file2));
+  EXPECT_STRNE(file1, file2);
+}
+
 TEST(DownloadManagerTest, GetMessageForError) {
   const TCHAR* kEnglish = _T("en");
   EXPECT_SUCCEEDED(ResourceManager::Create(
@@ -86,6 +86,12 @@
 #include "omaha/goopdate/goopdate_internal.h"
 #include "omaha/goopdate/goopdate_metrics.h"
 #include "omaha/goopdate/resource_manager.h"
+#include "omaha/net/connection_pool.h"
+#include "omaha/net/host_health.h"
+#include "omaha/net/network_request_dispatcher.h"
+#include "omaha/net/response_buffer.h"
+#include "omaha/net/socket_connection.h"
+#include "omaha/net/transfer_scheduler.h"
 #include "omaha/service/service_main.h"
 #include "omaha/setup/setup_google_update.h"
 #include "omaha/setup/setup_service.h"
@@ -513,7 +519,13 @@ HRESULT GoopdateImpl::Main(HINSTANCE instance,
   // Uninitializing the network configuration must happen after reporting the
   // metrics. The call succeeds even if the network has not been initialized
   // due to errors up the execution path.
+  NetworkRequestDispatcher::DeleteInstance();
   NetworkConfigManager::DeleteInstance();
+  TransferScheduler::DeleteInstance();
+  ConnectionPool::DeleteInstance();
+  HostHealth::DeleteInstance();
+  SocketConnectionPool::DeleteInstance();
+  SlabPool::DeleteInstance();
 
   if (COMMANDLINE_MODE_INSTALL == args_.mode &&
       args_.is_oem_set &&
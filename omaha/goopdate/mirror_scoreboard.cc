@@ -0,0 +1,286 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/goopdate/mirror_scoreboard.h"
+
+#include <algorithm>
+#include <memory>
+
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/reg_key.h"
+#include "omaha/base/time.h"
+#include "omaha/base/utils.h"
+#include "omaha/common/config_manager.h"
+#include "omaha/common/const_goopdate.h"
+#include "omaha/net/http_client.h"
+
+namespace omaha {
+
+namespace {
+
+// The weight of a new download in the moving averages, as a divisor.
+const int64 kDecay = 4;
+
+// Moves |average| a 1/kDecay of the way toward |sample|.
+DWORD UpdateAverage(DWORD average, int64 sample) {
+  const int64 delta = sample - static_cast<int64>(average);
+  return static_cast<DWORD>(static_cast<int64>(average) + delta / kDecay);
+}
+
+uint64 GetRank(const MirrorScoreboard::Score& score) {
+  const DWORD success_rate = 100 - std::min<DWORD>(score.error_rate, 100);
+  return static_cast<uint64>(score.bytes_per_sec) * success_rate / 100;
+}
+
+struct RankedUrl {
+  size_t index;
+  uint64 rank;
+
+  bool operator<(const RankedUrl& other) const {
+    return rank > other.rank;
+  }
+};
+
+struct HostTime {
+  CString host;
+  uint64 last_download;
+
+  bool operator<(const HostTime& other) const {
+    return last_download < other.last_download;
+  }
+};
+
+}  // namespace
+
+MirrorScoreboard::MirrorScoreboard(const CString& key_name)
+    : key_name_(key_name) {
+  ASSERT1(!key_name.IsEmpty());
+}
+
+CString MirrorScoreboard::GetKeyName(bool is_machine) {
+  return AppendRegKeyPath(
+      ConfigManager::Instance()->registry_update(is_machine),
+      kRegSubkeyMirrors);
+}
+
+CString MirrorScoreboard::GetHost(const CString& url) {
+  std::unique_ptr<HttpClient> http_client(CreateHttpClient());
+  if (!http_client.get() || FAILED(http_client->Initialize())) {
+    return CString();
+  }
+
+  CString scheme, server, url_path, extra_info;
+  int port = 0;
+  HRESULT hr = http_client->CrackUrl(url,
+                                     0,
+                                     &scheme,
+                                     &server,
+                                     &port,
+                                     &url_path,
+                                     &extra_info);
+  if (FAILED(hr)) {
+    OPT_LOG(LW, (_T("[CrackUrl failed][%s][0x%08x]"), url, hr));
+    return CString();
+  }
+  return server.MakeLower();
+}
+
+HRESULT MirrorScoreboard::Record(
+    const std::vector<DownloadMetrics>& download_metrics) {
+  HRESULT result = S_OK;
+  for (size_t i = 0; i != download_metrics.size(); ++i) {
+    const DownloadMetrics& metrics = download_metrics[i];
+    if (metrics.error == GOOPDATE_E_CANCELLED) {
+      continue;
+    }
+
+    const CString host(GetHost(metrics.url));
+    if (host.IsEmpty()) {
+      continue;
+    }
+
+    HRESULT hr = RecordDownload(host,
+                                metrics.error == S_OK,
+                                metrics.downloaded_bytes,
+                                metrics.download_time_ms);
+    if (FAILED(hr)) {
+      OPT_LOG(LW, (_T("[RecordDownload failed][%s][0x%08x]"), host, hr));
+      result = hr;
+    }
+  }
+  return result;
+}
+
+HRESULT MirrorScoreboard::RecordDownload(const CString& host,
+                                         bool succeeded,
+                                         int64 bytes,
+                                         int64 time_ms) {
+  const CString host_key_name(AppendRegKeyPath(key_name_, host));
+
+  __mutexScope(lock_);
+
+  Score score;
+  const bool is_known = GetScore(host, &score);
+
+  // Only the successful downloads tell the throughput of the host.
+  if (succeeded && bytes > 0 && time_ms > 0) {
+    const int64 bytes_per_sec =
+        std::min<int64>(bytes * 1000 / time_ms, ULONG_MAX);
+    score.bytes_per_sec = is_known && score.bytes_per_sec ?
+        UpdateAverage(score.bytes_per_sec, bytes_per_sec) :
+        static_cast<DWORD>(bytes_per_sec);
+  }
+
+  const int64 error_rate = succeeded ? 0 : 100;
+  score.error_rate = is_known ?
+      UpdateAverage(score.error_rate, error_rate) :
+      static_cast<DWORD>(error_rate);
+  ++score.num_downloads;
+
+  OPT_LOG(L3, (_T("[MirrorScoreboard::RecordDownload][%s][%u B/s][%u%%][%u]"),
+               host, score.bytes_per_sec, score.error_rate,
+               score.num_downloads));
+
+  const uint64 now = GetCurrent100NSTime();
+  HRESULT hr = RegKey::SetValue(host_key_name,
+                                kRegValueMirrorBytesPerSec,
+                                score.bytes_per_sec);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  hr = RegKey::SetValue(host_key_name,
+                        kRegValueMirrorErrorRate,
+                        score.error_rate);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  hr = RegKey::SetValue(host_key_name,
+                        kRegValueMirrorDownloads,
+                        score.num_downloads);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  hr = RegKey::SetValue(host_key_name,
+                        kRegValueMirrorLastDownload,
+                        static_cast<DWORD64>(now));
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  PruneHosts(now);
+  return S_OK;
+}
+
+void MirrorScoreboard::PruneHosts(uint64 now) {
+  __mutexScope(lock_);
+
+  RegKey key;
+  if (FAILED(key.Open(key_name_))) {
+    return;
+  }
+
+  const uint64 max_age = kMaxHostAgeDays * kDaysTo100ns;
+  std::vector<HostTime> hosts;
+  std::vector<CString> stale_hosts;
+  const int num_hosts = static_cast<int>(key.GetSubkeyCount());
+  for (int i = 0; i < num_hosts; ++i) {
+    HostTime host_time = {CString(), 0};
+    if (FAILED(key.GetSubkeyNameAt(i, &host_time.host))) {
+      continue;
+    }
+
+    DWORD64 last_download = 0;
+    RegKey::GetValue(AppendRegKeyPath(key_name_, host_time.host),
+                     kRegValueMirrorLastDownload,
+                     &last_download);
+    host_time.last_download = last_download;
+    if (!last_download ||
+        (now > last_download && now - last_download > max_age)) {
+      stale_hosts.push_back(host_time.host);
+    } else {
+      hosts.push_back(host_time);
+    }
+  }
+
+  if (hosts.size() > static_cast<size_t>(kMaxHosts)) {
+    std::sort(hosts.begin(), hosts.end());
+    for (size_t i = 0; i != hosts.size() - kMaxHosts; ++i) {
+      stale_hosts.push_back(hosts[i].host);
+    }
+  }
+
+  for (size_t i = 0; i != stale_hosts.size(); ++i) {
+    OPT_LOG(L3, (_T("[MirrorScoreboard::PruneHosts][%s]"), stale_hosts[i]));
+    HRESULT hr = key.RecurseDeleteSubKey(stale_hosts[i]);
+    if (FAILED(hr)) {
+      OPT_LOG(LW, (_T("[RecurseDeleteSubKey failed][%s][0x%08x]"),
+                   stale_hosts[i], hr));
+    }
+  }
+}
+
+bool MirrorScoreboard::GetScore(const CString& host, Score* score) {
+  ASSERT1(score);
+
+  const CString host_key_name(AppendRegKeyPath(key_name_, host));
+
+  __mutexScope(lock_);
+
+  Score host_score;
+  if (FAILED(RegKey::GetValue(host_key_name,
+                              kRegValueMirrorDownloads,
+                              &host_score.num_downloads)) ||
+      !host_score.num_downloads) {
+    return false;
+  }
+  RegKey::GetValue(host_key_name,
+                   kRegValueMirrorBytesPerSec,
+                   &host_score.bytes_per_sec);
+  RegKey::GetValue(host_key_name,
+                   kRegValueMirrorErrorRate,
+                   &host_score.error_rate);
+  *score = host_score;
+  return true;
+}
+
+void MirrorScoreboard::Rank(const std::vector<CString>& urls,
+                            std::vector<size_t>* order) {
+  ASSERT1(order);
+
+  order->clear();
+  std::vector<size_t> known_positions;
+  std::vector<RankedUrl> known_urls;
+  for (size_t i = 0; i != urls.size(); ++i) {
+    order->push_back(i);
+
+    Score score;
+    const CString host(GetHost(urls[i]));
+    if (host.IsEmpty() || !GetScore(host, &score)) {
+      continue;
+    }
+    known_positions.push_back(i);
+    RankedUrl ranked_url = {i, GetRank(score)};
+    known_urls.push_back(ranked_url);
+  }
+
+  std::stable_sort(known_urls.begin(), known_urls.end());
+  for (size_t i = 0; i != known_urls.size(); ++i) {
+    (*order)[known_positions[i]] = known_urls[i].index;
+  }
+}
+
+}  // namespace omaha
@@ -0,0 +1,101 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// MirrorScoreboard keeps the download history of the hosts packages are
+// downloaded from, so that the download of a package tries the hosts that
+// served well in earlier sessions first. For each host, the registry keeps a
+// moving average of the throughput of its downloads, a moving average of its
+// error rate, and the number of downloads recorded. Each new download moves
+// the averages a quarter of the way toward its own values.
+//
+// The score of a host is its throughput weighted by its success rate. Hosts
+// without history keep the position the server gave them.
+//
+// The history is bounded: the hosts not downloaded from in kMaxHostAgeDays are
+// dropped, and only the kMaxHosts most recently used hosts are kept.
+
+#ifndef OMAHA_GOOPDATE_MIRROR_SCOREBOARD_H_
+#define OMAHA_GOOPDATE_MIRROR_SCOREBOARD_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "omaha/base/synchronized.h"
+#include "omaha/common/ping_event_download_metrics.h"
+
+namespace omaha {
+
+class MirrorScoreboard {
+ public:
+  struct Score {
+    Score() : bytes_per_sec(0), error_rate(0), num_downloads(0) {}
+
+    DWORD bytes_per_sec;
+    DWORD error_rate;      // In percent.
+    DWORD num_downloads;
+  };
+
+  // The maximum number of hosts the history is kept for.
+  static const int kMaxHosts = 32;
+
+  // The number of days the history of a host is kept after its last download.
+  static const int kMaxHostAgeDays = 90;
+
+  // Keeps the history under the registry key |key_name|.
+  explicit MirrorScoreboard(const CString& key_name);
+
+  // Returns the registry key the history of the machine or the user is kept
+  // under.
+  static CString GetKeyName(bool is_machine);
+
+  // Returns the host |url| points to, in lower case, or an empty string if
+  // |url| can't be parsed.
+  static CString GetHost(const CString& url);
+
+  // Records the outcome of the downloads in |download_metrics|. Canceled
+  // downloads are not recorded.
+  HRESULT Record(const std::vector<DownloadMetrics>& download_metrics);
+
+  // Returns in |order| the indexes of |urls| in the order they should be
+  // tried. The urls of known hosts are sorted by descending score among the
+  // positions they occupy. The other urls keep their positions.
+  void Rank(const std::vector<CString>& urls, std::vector<size_t>* order);
+
+  // Returns false if |host| has no history.
+  bool GetScore(const CString& host, Score* score);
+
+ private:
+  HRESULT RecordDownload(const CString& host,
+                         bool succeeded,
+                         int64 bytes,
+                         int64 time_ms);
+
+  // Deletes the history of the stale hosts and of the least recently used
+  // hosts beyond kMaxHosts. Hosts without a time of last download are stale.
+  void PruneHosts(uint64 now);
+
+  const CString key_name_;
+
+  // Serializes the updates of the history of a host.
+  LLock lock_;
+
+  DISALLOW_COPY_AND_ASSIGN(MirrorScoreboard);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_GOOPDATE_MIRROR_SCOREBOARD_H_
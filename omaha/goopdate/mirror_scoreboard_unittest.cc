@@ -0,0 +1,210 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <memory>
+#include <vector>
+
+#include "omaha/base/error.h"
+#include "omaha/base/reg_key.h"
+#include "omaha/base/time.h"
+#include "omaha/base/utils.h"
+#include "omaha/common/const_goopdate.h"
+#include "omaha/goopdate/mirror_scoreboard.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+const TCHAR kFastUrl[] = _T("https://fast.example.com/package");
+const TCHAR kSlowUrl[] = _T("https://slow.example.com/package");
+const TCHAR kFlakyUrl[] = _T("https://flaky.example.com/package");
+const TCHAR kUnknownUrl[] = _T("https://unknown.example.com/package");
+
+DownloadMetrics MakeDownloadMetrics(const CString& url,
+                                    int error,
+                                    int64 bytes,
+                                    int64 time_ms) {
+  DownloadMetrics download_metrics;
+  download_metrics.url = url;
+  download_metrics.error = error;
+  download_metrics.downloaded_bytes = bytes;
+  download_metrics.download_time_ms = time_ms;
+  return download_metrics;
+}
+
+}  // namespace
+
+class MirrorScoreboardTest : public RegistryProtectedTest {
+ protected:
+  virtual void SetUp() {
+    RegistryProtectedTest::SetUp();
+    scoreboard_.reset(
+        new MirrorScoreboard(MirrorScoreboard::GetKeyName(false)));
+  }
+
+  virtual void TearDown() {
+    scoreboard_.reset();
+    RegistryProtectedTest::TearDown();
+  }
+
+  void RecordDownload(const CString& url,
+                      int error,
+                      int64 bytes,
+                      int64 time_ms) {
+    std::vector<DownloadMetrics> download_metrics;
+    download_metrics.push_back(
+        MakeDownloadMetrics(url, error, bytes, time_ms));
+    EXPECT_HRESULT_SUCCEEDED(scoreboard_->Record(download_metrics));
+  }
+
+  // Sets the time of the last download from |host| to |time|.
+  void SetLastDownload(const CString& host, uint64 time) {
+    EXPECT_HRESULT_SUCCEEDED(RegKey::SetValue(
+        AppendRegKeyPath(MirrorScoreboard::GetKeyName(false), host),
+        kRegValueMirrorLastDownload,
+        static_cast<DWORD64>(time)));
+  }
+
+  std::unique_ptr<MirrorScoreboard> scoreboard_;
+};
+
+TEST_F(MirrorScoreboardTest, GetHost) {
+  EXPECT_STREQ(_T("fast.example.com"), MirrorScoreboard::GetHost(kFastUrl));
+  EXPECT_STREQ(_T("dl.google.com"),
+               MirrorScoreboard::GetHost(_T("http://DL.Google.com:80/x")));
+  EXPECT_TRUE(MirrorScoreboard::GetHost(_T("not a url")).IsEmpty());
+}
+
+TEST_F(MirrorScoreboardTest, Record) {
+  MirrorScoreboard::Score score;
+  EXPECT_FALSE(scoreboard_->GetScore(_T("fast.example.com"), &score));
+
+  RecordDownload(kFastUrl, S_OK, 4000000, 1000);
+  ASSERT_TRUE(scoreboard_->GetScore(_T("fast.example.com"), &score));
+  EXPECT_EQ(4000000, score.bytes_per_sec);
+  EXPECT_EQ(0, score.error_rate);
+  EXPECT_EQ(1, score.num_downloads);
+
+  // The averages move a quarter of the way toward each new download. A
+  // failure does not change the throughput.
+  RecordDownload(kFastUrl, S_OK, 8000000, 1000);
+  RecordDownload(kFastUrl, HRESULTFromHttpStatusCode(503), 0, 0);
+  ASSERT_TRUE(scoreboard_->GetScore(_T("fast.example.com"), &score));
+  EXPECT_EQ(5000000, score.bytes_per_sec);
+  EXPECT_EQ(25, score.error_rate);
+  EXPECT_EQ(3, score.num_downloads);
+}
+
+TEST_F(MirrorScoreboardTest, Record_IgnoresCanceledDownloads) {
+  RecordDownload(kFastUrl, GOOPDATE_E_CANCELLED, 1000, 1000);
+
+  MirrorScoreboard::Score score;
+  EXPECT_FALSE(scoreboard_->GetScore(_T("fast.example.com"), &score));
+}
+
+TEST_F(MirrorScoreboardTest, Rank) {
+  RecordDownload(kSlowUrl, S_OK, 100000, 1000);
+  RecordDownload(kFastUrl, S_OK, 4000000, 1000);
+
+  // The flaky host is fast when it works.
+  RecordDownload(kFlakyUrl, HRESULTFromHttpStatusCode(503), 0, 0);
+  RecordDownload(kFlakyUrl, S_OK, 8000000, 1000);
+
+  // The known hosts are sorted among the positions they occupy. The unknown
+  // host keeps its position.
+  std::vector<CString> urls;
+  urls.push_back(kSlowUrl);
+  urls.push_back(kUnknownUrl);
+  urls.push_back(kFlakyUrl);
+  urls.push_back(kFastUrl);
+
+  std::vector<size_t> order;
+  scoreboard_->Rank(urls, &order);
+  ASSERT_EQ(4, order.size());
+  EXPECT_EQ(3, order[0]);
+  EXPECT_EQ(1, order[1]);
+  EXPECT_EQ(2, order[2]);
+  EXPECT_EQ(0, order[3]);
+}
+
+TEST_F(MirrorScoreboardTest, Rank_NoHistory) {
+  std::vector<CString> urls;
+  urls.push_back(kSlowUrl);
+  urls.push_back(kFastUrl);
+
+  std::vector<size_t> order;
+  scoreboard_->Rank(urls, &order);
+  ASSERT_EQ(2, order.size());
+  EXPECT_EQ(0, order[0]);
+  EXPECT_EQ(1, order[1]);
+}
+
+// The history is kept across instances, as it is across sessions.
+TEST_F(MirrorScoreboardTest, Persisted) {
+  RecordDownload(kSlowUrl, S_OK, 100000, 1000);
+  RecordDownload(kFastUrl, S_OK, 4000000, 1000);
+  scoreboard_.reset(new MirrorScoreboard(MirrorScoreboard::GetKeyName(false)));
+
+  std::vector<CString> urls;
+  urls.push_back(kSlowUrl);
+  urls.push_back(kFastUrl);
+
+  std::vector<size_t> order;
+  scoreboard_->Rank(urls, &order);
+  ASSERT_EQ(2, order.size());
+  EXPECT_EQ(1, order[0]);
+  EXPECT_EQ(0, order[1]);
+}
+
+// Only the most recently used hosts are kept.
+TEST_F(MirrorScoreboardTest, Record_KeepsMostRecentHosts) {
+  const int max_hosts = MirrorScoreboard::kMaxHosts;
+  const uint64 now = GetCurrent100NSTime();
+  for (int i = 0; i != max_hosts; ++i) {
+    CString host;
+    host.Format(_T("host%d.example.com"), i);
+    RecordDownload(_T("https://") + host + _T("/package"), S_OK, 1000, 1000);
+    SetLastDownload(host, now - (max_hosts - i) * kMinsTo100ns);
+  }
+
+  RecordDownload(kFastUrl, S_OK, 4000000, 1000);
+
+  RegKey key;
+  ASSERT_HRESULT_SUCCEEDED(key.Open(MirrorScoreboard::GetKeyName(false)));
+  EXPECT_EQ(static_cast<uint32>(max_hosts), key.GetSubkeyCount());
+
+  MirrorScoreboard::Score score;
+  EXPECT_FALSE(scoreboard_->GetScore(_T("host0.example.com"), &score));
+  EXPECT_TRUE(scoreboard_->GetScore(_T("host1.example.com"), &score));
+  EXPECT_TRUE(scoreboard_->GetScore(_T("fast.example.com"), &score));
+}
+
+TEST_F(MirrorScoreboardTest, Record_DropsStaleHosts) {
+  RecordDownload(kSlowUrl, S_OK, 100000, 1000);
+  RecordDownload(kFlakyUrl, S_OK, 8000000, 1000);
+  SetLastDownload(_T("slow.example.com"),
+                  GetCurrent100NSTime() -
+                  (MirrorScoreboard::kMaxHostAgeDays + 1) * kDaysTo100ns);
+
+  RecordDownload(kFastUrl, S_OK, 4000000, 1000);
+
+  MirrorScoreboard::Score score;
+  EXPECT_FALSE(scoreboard_->GetScore(_T("slow.example.com"), &score));
+  EXPECT_TRUE(scoreboard_->GetScore(_T("flaky.example.com"), &score));
+  EXPECT_TRUE(scoreboard_->GetScore(_T("fast.example.com"), &score));
+}
+
+}  // namespace omaha
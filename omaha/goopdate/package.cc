@@ -67,10 +67,8 @@ STDMETHODIMP Package::get_filename(BSTR* filename_as_bstr) const {
 }
 
 // status_text can be NULL.
-// TODO(omaha): Change bytes and bytes_total to uint64. Any logging will
-// need to use %llu.
-void Package::OnProgress(int bytes,
-                         int bytes_total,
+void Package::OnProgress(uint64 bytes,
+                         uint64 bytes_total,
                          int status,
                          const TCHAR* status_text) {
   __mutexScope(model()->lock());
@@ -80,8 +78,8 @@ void Package::OnProgress(int bytes,
   ASSERT1(status == WINHTTP_CALLBACK_STATUS_READ_COMPLETE ||
           status == WINHTTP_CALLBACK_STATUS_CONNECTING_TO_SERVER);
 
-  CORE_LOG(L5, (_T("[Package::OnProgress][bytes %d][bytes_total %d][status %d]")
-                _T("[status_text '%s']"),
+  CORE_LOG(L5, (_T("[Package::OnProgress][bytes %llu][bytes_total %llu]")
+                _T("[status %d][status_text '%s']"),
                 bytes, bytes_total, status, status_text));
 
   // TODO(omaha): What do we do if the following condition - bytes_total
@@ -97,7 +95,7 @@ void Package::OnProgress(int bytes,
   // successive calls?
 
   // ASSERT1(bytes_total == 0 ||
-  //         bytes_total == static_cast<int>(expected_size_));
+  //         bytes_total == expected_size_);
   ASSERT1(bytes <= bytes_total);
 
   bytes_downloaded_ = bytes;
@@ -175,8 +173,8 @@ LONG Package::GetEstimatedRemainingDownloadTimeMs() const {
   }
 
   LONG time_remaining_ms = kUnknownRemainingTime;
-  int average_speed = progress_sampler_.GetAverageProgressPerMs();
-  if (average_speed == ProgressSampler<int>::kUnknownProgressPerMs) {
+  const uint64 average_speed = progress_sampler_.GetAverageProgressPerMs();
+  if (average_speed == ProgressSampler<uint64>::kUnknownProgressPerMs) {
     return kUnknownRemainingTime;
   }
 
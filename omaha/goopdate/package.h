@@ -52,8 +52,8 @@ class Package
   STDMETHOD(get_filename)(BSTR* filename) const;
 
   // NetworkRequestCallback.
-  virtual void OnProgress(int bytes,
-                          int bytes_total,
+  virtual void OnProgress(uint64 bytes,
+                          uint64 bytes_total,
                           int status,
                           const TCHAR* status_text);
   virtual void OnRequestBegin();
@@ -86,11 +86,11 @@ class Package
   uint64 expected_size_;
   CString expected_hash_;
 
-  int bytes_downloaded_;
-  int bytes_total_;
+  uint64 bytes_downloaded_;
+  uint64 bytes_total_;
   time64 next_download_retry_time_;
 
-  ProgressSampler<int> progress_sampler_;
+  ProgressSampler<uint64> progress_sampler_;
 
   // True if the package is being downloaded.
   // TODO(omaha): implement this.
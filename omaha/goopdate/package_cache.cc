@@ -16,7 +16,9 @@
 #include "omaha/goopdate/package_cache.h"
 
 #include <shlwapi.h>
+#include <winioctl.h>
 #include <algorithm>
+#include <memory>
 #include <vector>
 
 #include "omaha/base/debug.h"
@@ -24,6 +26,7 @@
 #include "omaha/base/file.h"
 #include "omaha/base/logging.h"
 #include "omaha/base/path.h"
+#include "omaha/base/security/sha256.h"
 #include "omaha/base/string.h"
 #include "omaha/base/signatures.h"
 #include "omaha/base/signaturevalidator.h"
@@ -31,9 +34,213 @@
 #include "omaha/common/config_manager.h"
 #include "omaha/goopdate/package_cache_internal.h"
 #include "omaha/goopdate/worker_metrics.h"
+#include "third_party/lzma/files/C/LzmaDec.h"
+#include "third_party/lzma/files/C/LzmaEnc.h"
 
 namespace omaha {
 
+namespace {
+
+// The directory under the cache root that holds the content of the packages.
+// App ids are guids, so it cannot collide with the directory of an app.
+const TCHAR* const kContentDirectoryName = _T("content");
+
+// Clones the extents of a file on file systems with block cloning, such as
+// ReFS. The SDK only declares these for Windows 10.
+const DWORD kFsctlDuplicateExtentsToFile =
+    CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 209, METHOD_BUFFERED, FILE_WRITE_DATA);
+
+struct DuplicateExtentsData {
+  HANDLE file_handle;
+  LARGE_INTEGER source_file_offset;
+  LARGE_INTEGER target_file_offset;
+  LARGE_INTEGER byte_count;
+};
+
+// The byte count of a single clone request must be smaller than 4 GB.
+const uint64 kMaxCloneRequestBytes = 0xFFFFFFFF;
+
+HRESULT GetClusterSize(const CString& filename, uint64* cluster_size) {
+  ASSERT1(cluster_size);
+
+  TCHAR volume_path[MAX_PATH] = {0};
+  if (!::GetVolumePathName(filename, volume_path, arraysize(volume_path))) {
+    return HRESULTFromLastError();
+  }
+
+  DWORD sectors_per_cluster = 0;
+  DWORD bytes_per_sector = 0;
+  DWORD free_clusters = 0;
+  DWORD total_clusters = 0;
+  if (!::GetDiskFreeSpace(volume_path,
+                          &sectors_per_cluster,
+                          &bytes_per_sector,
+                          &free_clusters,
+                          &total_clusters)) {
+    return HRESULTFromLastError();
+  }
+
+  *cluster_size = static_cast<uint64>(sectors_per_cluster) * bytes_per_sector;
+  return *cluster_size ? S_OK : E_UNEXPECTED;
+}
+
+// The compressed form of the content is stored next to it, with this suffix.
+const TCHAR* const kCompressedContentSuffix = _T(".lzma");
+
+// A compressed package is only kept if it saves at least a tenth of the space.
+const uint64 kMaxCompressedSizePercent = 90;
+
+// The LZMA dictionary is no larger than the package, and no larger than this,
+// which bounds the memory used by the encoder to about 100 MB.
+const uint32 kMinLzmaDictionarySize = 1 << 16;
+const uint32 kMaxLzmaDictionarySize = 1 << 23;
+
+// The header of a compressed package is the LZMA properties followed by the
+// size of the package, as in .lzma files.
+const size_t kLzmaHeaderSize = LZMA_PROPS_SIZE + sizeof(uint64);
+
+const uint32 kLzmaBufferSize = 64 * 1024;
+
+void* LzmaAlloc(void* p, size_t size) {
+  UNREFERENCED_PARAMETER(p);
+  return ::malloc(size);
+}
+
+void LzmaFree(void* p, void* address) {
+  UNREFERENCED_PARAMETER(p);
+  ::free(address);
+}
+
+ISzAlloc lzma_allocator = { &LzmaAlloc, &LzmaFree };
+
+// Adapts a File, and the hasher of the bytes read or written, to the LZMA
+// stream interfaces. The interface must be the first member.
+struct LzmaInStream {
+  ISeqInStream stream;
+  File* file;
+  CryptDetails::HashInterface* hasher;
+};
+
+struct LzmaOutStream {
+  ISeqOutStream stream;
+  File* file;
+  CryptDetails::HashInterface* hasher;
+};
+
+struct LzmaProgress {
+  ICompressProgress progress;
+  HANDLE stop_event;
+};
+
+SRes ReadLzmaInStream(void* p, void* buf, size_t* size) {
+  LzmaInStream* in_stream = static_cast<LzmaInStream*>(p);
+  uint32 bytes_read = 0;
+  if (FAILED(in_stream->file->Read(
+          static_cast<uint32>(std::min<size_t>(*size, kLzmaBufferSize)),
+          static_cast<byte*>(buf),
+          &bytes_read))) {
+    return SZ_ERROR_READ;
+  }
+
+  if (in_stream->hasher) {
+    in_stream->hasher->update(buf, bytes_read);
+  }
+  *size = bytes_read;
+  return SZ_OK;
+}
+
+size_t WriteLzmaOutStream(void* p, const void* buf, size_t size) {
+  LzmaOutStream* out_stream = static_cast<LzmaOutStream*>(p);
+  uint32 bytes_written = 0;
+  if (FAILED(out_stream->file->Write(static_cast<const byte*>(buf),
+                                     static_cast<uint32>(size),
+                                     &bytes_written))) {
+    return 0;
+  }
+
+  if (out_stream->hasher) {
+    out_stream->hasher->update(buf, bytes_written);
+  }
+  return bytes_written;
+}
+
+SRes OnLzmaProgress(void* p, UInt64 in_size, UInt64 out_size) {
+  UNREFERENCED_PARAMETER(in_size);
+  UNREFERENCED_PARAMETER(out_size);
+  const LzmaProgress* progress = static_cast<LzmaProgress*>(p);
+  return progress->stop_event &&
+         ::WaitForSingleObject(progress->stop_event, 0) == WAIT_OBJECT_0 ?
+      SZ_ERROR_PROGRESS : SZ_OK;
+}
+
+HRESULT WriteAll(File* file,
+                 const void* buf,
+                 uint32 size,
+                 CryptDetails::HashInterface* hasher) {
+  uint32 bytes_written = 0;
+  HRESULT hr = file->Write(static_cast<const byte*>(buf), size, &bytes_written);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  if (bytes_written != size) {
+    return E_UNEXPECTED;
+  }
+
+  if (hasher) {
+    hasher->update(buf, size);
+  }
+  return S_OK;
+}
+
+HRESULT LzmaResultToHResult(SRes result) {
+  switch (result) {
+    case SZ_OK:
+      return S_OK;
+    case SZ_ERROR_MEM:
+      return E_OUTOFMEMORY;
+    case SZ_ERROR_PROGRESS:
+      return E_ABORT;
+    case SZ_ERROR_READ:
+      return HRESULT_FROM_WIN32(ERROR_READ_FAULT);
+    case SZ_ERROR_WRITE:
+      return HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+    default:
+      return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+}
+
+FILETIME GetTimeDaysAgo(int days) {
+  FILETIME current_time = {0};
+  ::GetSystemTimeAsFileTime(&current_time);
+  ULARGE_INTEGER now = {0};
+  now.LowPart = current_time.dwLowDateTime;
+  now.HighPart = current_time.dwHighDateTime;
+
+  const uint64 kNum100NanoSecondsInDay = 1000LL * 1000 * 10 * kSecondsPerDay;
+  now.QuadPart -= kNum100NanoSecondsInDay * days;
+
+  FILETIME time = {0};
+  time.dwLowDateTime = now.LowPart;
+  time.dwHighDateTime = now.HighPart;
+
+  return time;
+}
+
+// Cache file names are not case sensitive, so neither are the lock stripes
+// they map to.
+size_t HashStringIgnoreCase(const CString& str) {
+  CString lower_str(str);
+  lower_str.MakeLower();
+
+  size_t hash = 0;
+  for (int i = 0; i != lower_str.GetLength(); ++i) {
+    hash = hash * 31 + lower_str[i];
+  }
+  return hash;
+}
+
+}  // namespace
+
 namespace internal {
 
 bool PackageSortByTimePredicate(const PackageInfo& package1,
@@ -141,7 +348,33 @@ void SortPackageInfoByTime(std::vector<PackageInfo>* packages_info) {
             PackageSortByTimePredicate);
 }
 
-HRESULT FileCopy(File* source_file, const CString& destination) {
+HRESULT GetFileLinkCount(const CString& filename, DWORD* link_count) {
+  ASSERT1(link_count);
+
+  scoped_hfile file(::CreateFile(filename,
+                                 FILE_READ_ATTRIBUTES,
+                                 FILE_SHARE_READ | FILE_SHARE_WRITE |
+                                     FILE_SHARE_DELETE,
+                                 NULL,
+                                 OPEN_EXISTING,
+                                 FILE_ATTRIBUTE_NORMAL,
+                                 NULL));
+  if (!file) {
+    return HRESULTFromLastError();
+  }
+
+  BY_HANDLE_FILE_INFORMATION info = {0};
+  if (!::GetFileInformationByHandle(get(file), &info)) {
+    return HRESULTFromLastError();
+  }
+
+  *link_count = info.nNumberOfLinks;
+  return S_OK;
+}
+
+HRESULT FileCopy(File* source_file,
+                 const CString& destination,
+                 CryptDetails::HashInterface* hasher) {
   ASSERT1(source_file);
 
   File destination_file;
@@ -167,6 +400,10 @@ HRESULT FileCopy(File* source_file, const CString& destination) {
       return S_OK;
     }
 
+    if (hasher) {
+      hasher->update(buffer, bytes_read);
+    }
+
     uint32 bytes_written(0);
     hr = destination_file.Write(buffer, bytes_read, &bytes_written);
     if (FAILED(hr)) {
@@ -181,6 +418,284 @@ HRESULT FileCopy(File* source_file, const CString& destination) {
   return S_OK;
 }
 
+HRESULT CloneFile(const CString& source, const CString& destination) {
+  scoped_hfile source_file(::CreateFile(source,
+                                        GENERIC_READ,
+                                        FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                        NULL,
+                                        OPEN_EXISTING,
+                                        FILE_ATTRIBUTE_NORMAL,
+                                        NULL));
+  if (!source_file) {
+    return HRESULTFromLastError();
+  }
+
+  LARGE_INTEGER file_size = {0};
+  if (!::GetFileSizeEx(get(source_file), &file_size)) {
+    return HRESULTFromLastError();
+  }
+
+  uint64 cluster_size = 0;
+  HRESULT hr = GetClusterSize(destination, &cluster_size);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  scoped_hfile destination_file(::CreateFile(destination,
+                                             GENERIC_READ | GENERIC_WRITE |
+                                                 DELETE,
+                                             0,
+                                             NULL,
+                                             CREATE_NEW,
+                                             FILE_ATTRIBUTE_NORMAL,
+                                             NULL));
+  if (!destination_file) {
+    return HRESULTFromLastError();
+  }
+
+  // The clone covers whole clusters, so the last one may extend past the end
+  // of the file. The file is sized first so that it ends where the source
+  // does.
+  hr = S_OK;
+  if (!::SetFilePointerEx(get(destination_file), file_size, NULL, FILE_BEGIN) ||
+      !::SetEndOfFile(get(destination_file))) {
+    hr = HRESULTFromLastError();
+  }
+
+  // Every request but the last starts and ends on a cluster, so the requests
+  // are as large as the limit allows once rounded down to whole clusters.
+  const uint64 max_clone_bytes =
+      kMaxCloneRequestBytes / cluster_size * cluster_size;
+  ASSERT1(max_clone_bytes);
+
+  const uint64 size = static_cast<uint64>(file_size.QuadPart);
+  for (uint64 offset = 0; SUCCEEDED(hr) && offset < size;
+       offset += max_clone_bytes) {
+    const uint64 bytes = std::min(size - offset, max_clone_bytes);
+
+    DuplicateExtentsData data = {0};
+    data.file_handle = get(source_file);
+    data.source_file_offset.QuadPart = offset;
+    data.target_file_offset.QuadPart = offset;
+    data.byte_count.QuadPart =
+        (bytes + cluster_size - 1) / cluster_size * cluster_size;
+
+    DWORD bytes_returned = 0;
+    if (!::DeviceIoControl(get(destination_file),
+                           kFsctlDuplicateExtentsToFile,
+                           &data,
+                           sizeof(data),
+                           NULL,
+                           0,
+                           &bytes_returned,
+                           NULL)) {
+      hr = HRESULTFromLastError();
+    }
+  }
+
+  if (FAILED(hr)) {
+    // The handle is the only one open, so the file can be deleted through it.
+    FILE_DISPOSITION_INFO disposition = {TRUE};
+    VERIFY1(::SetFileInformationByHandle(get(destination_file),
+                                         FileDispositionInfo,
+                                         &disposition,
+                                         sizeof(disposition)));
+  }
+
+  return hr;
+}
+
+HRESULT CompressFile(File* source_file,
+                     const CString& destination,
+                     CryptDetails::HashInterface* source_hasher,
+                     CryptDetails::HashInterface* destination_hasher,
+                     HANDLE stop_event) {
+  ASSERT1(source_file);
+
+  if (stop_event && ::WaitForSingleObject(stop_event, 0) == WAIT_OBJECT_0) {
+    return E_ABORT;
+  }
+
+  uint64 size = 0;
+  HRESULT hr = source_file->GetLength(&size);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  hr = source_file->SeekToBegin();
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  // Opening the file does not truncate it.
+  if (File::Exists(destination)) {
+    hr = File::Remove(destination);
+    if (FAILED(hr)) {
+      return hr;
+    }
+  }
+
+  File destination_file;
+  hr = destination_file.Open(destination, true, false);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  CLzmaEncProps props;
+  LzmaEncProps_Init(&props);
+  props.level = 5;
+  props.numThreads = 1;
+  props.dictSize = kMinLzmaDictionarySize;
+  while (props.dictSize < size && props.dictSize < kMaxLzmaDictionarySize) {
+    props.dictSize <<= 1;
+  }
+
+  CLzmaEncHandle encoder = LzmaEnc_Create(&lzma_allocator);
+  if (!encoder) {
+    return E_OUTOFMEMORY;
+  }
+
+  uint8 header[kLzmaHeaderSize] = {0};
+  SizeT props_size = LZMA_PROPS_SIZE;
+  SRes result = LzmaEnc_SetProps(encoder, &props);
+  if (result == SZ_OK) {
+    result = LzmaEnc_WriteProperties(encoder, header, &props_size);
+  }
+  if (result == SZ_OK) {
+    memcpy(header + LZMA_PROPS_SIZE, &size, sizeof(size));
+    hr = WriteAll(&destination_file,
+                  header,
+                  sizeof(header),
+                  destination_hasher);
+  }
+
+  if (result == SZ_OK && SUCCEEDED(hr)) {
+    LzmaInStream in_stream = {{&ReadLzmaInStream}, source_file, source_hasher};
+    LzmaOutStream out_stream = {
+        {&WriteLzmaOutStream}, &destination_file, destination_hasher};
+    LzmaProgress progress = {{&OnLzmaProgress}, stop_event};
+    result = LzmaEnc_Encode(encoder,
+                            &out_stream.stream,
+                            &in_stream.stream,
+                            &progress.progress,
+                            &lzma_allocator,
+                            &lzma_allocator);
+  }
+  LzmaEnc_Destroy(encoder, &lzma_allocator, &lzma_allocator);
+
+  return FAILED(hr) ? hr : LzmaResultToHResult(result);
+}
+
+HRESULT DecompressFile(const CString& source, const CString& destination) {
+  File source_file;
+  HRESULT hr = source_file.OpenShareMode(source, false, false, FILE_SHARE_READ);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  uint8 header[kLzmaHeaderSize] = {0};
+  uint32 bytes_read = 0;
+  hr = source_file.Read(sizeof(header), header, &bytes_read);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  if (bytes_read != sizeof(header)) {
+    return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+  uint64 remaining_size = 0;
+  memcpy(&remaining_size, header + LZMA_PROPS_SIZE, sizeof(remaining_size));
+
+  // The destination may be a link to another file, which must not be written
+  // through.
+  if (File::Exists(destination)) {
+    hr = File::Remove(destination);
+    if (FAILED(hr)) {
+      return hr;
+    }
+  }
+
+  File destination_file;
+  hr = destination_file.Open(destination, true, false);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  CLzmaDec decoder;
+  LzmaDec_Construct(&decoder);
+  SRes result = LzmaDec_Allocate(&decoder,
+                                 header,
+                                 LZMA_PROPS_SIZE,
+                                 &lzma_allocator);
+  if (result != SZ_OK) {
+    return LzmaResultToHResult(result);
+  }
+  LzmaDec_Init(&decoder);
+
+  std::vector<uint8> in_buffer(kLzmaBufferSize);
+  std::vector<uint8> out_buffer(kLzmaBufferSize);
+  uint32 in_size = 0;
+  uint32 in_position = 0;
+  while (SUCCEEDED(hr) && remaining_size) {
+    if (in_position == in_size) {
+      in_position = 0;
+      hr = source_file.Read(kLzmaBufferSize, &in_buffer.front(), &in_size);
+      if (FAILED(hr)) {
+        break;
+      }
+    }
+
+    SizeT in_processed = in_size - in_position;
+    SizeT out_processed = static_cast<SizeT>(
+        std::min<uint64>(out_buffer.size(), remaining_size));
+    const ELzmaFinishMode finish_mode = out_processed == remaining_size ?
+                                        LZMA_FINISH_END : LZMA_FINISH_ANY;
+    ELzmaStatus status = LZMA_STATUS_NOT_SPECIFIED;
+    result = LzmaDec_DecodeToBuf(&decoder,
+                                 &out_buffer.front(),
+                                 &out_processed,
+                                 &in_buffer[in_position],
+                                 &in_processed,
+                                 finish_mode,
+                                 &status);
+    in_position += static_cast<uint32>(in_processed);
+    remaining_size -= out_processed;
+    if (result != SZ_OK) {
+      hr = LzmaResultToHResult(result);
+    } else if (!in_processed && !out_processed) {
+      // The compressed file ends early.
+      hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    } else if (out_processed) {
+      hr = WriteAll(&destination_file,
+                    &out_buffer.front(),
+                    static_cast<uint32>(out_processed),
+                    NULL);
+    }
+  }
+  LzmaDec_Free(&decoder, &lzma_allocator);
+
+  if (FAILED(hr)) {
+    destination_file.Close();
+    ::DeleteFile(destination);
+  }
+  return hr;
+}
+
+HRESULT CloneOrCopyFile(const CString& source, const CString& destination) {
+  if (File::Exists(destination)) {
+    HRESULT hr = File::Remove(destination);
+    if (FAILED(hr)) {
+      return hr;
+    }
+  }
+
+  HRESULT hr = CloneFile(source, destination);
+  if (SUCCEEDED(hr)) {
+    return S_OK;
+  }
+  CORE_LOG(L3, (_T("[CloneFile failed][0x%08x][%s]"), hr, destination));
+
+  return File::Copy(source, destination, true);
+}
+
 }  // namespace internal
 
 PackageCache::PackageCache() {
@@ -189,6 +704,12 @@ PackageCache::PackageCache() {
 
   cache_size_limit_bytes_ = 1024 * 1024 * static_cast<uint64>(
     ConfigManager::Instance()->GetPackageCacheSizeLimitMBytes(NULL));
+
+  always_verify_hash_ =
+    ConfigManager::Instance()->ShouldAlwaysVerifyCachedPackages();
+
+  cache_compression_time_days_ =
+    ConfigManager::Instance()->GetPackageCacheCompressionTimeDays();
 }
 
 PackageCache::~PackageCache() {
@@ -211,6 +732,13 @@ HRESULT PackageCache::Initialize(const CString& cache_root) {
 
   cache_root_ = cache_root;
 
+  // A rebuilt index knows nothing about the content that was left without
+  // names before it was lost, nor about the names that are compressed.
+  if (digest_index_.Load(cache_root_) == S_FALSE) {
+    DeleteUnreferencedContent();
+    RecordCompressedContent();
+  }
+
   return S_OK;
 }
 
@@ -218,7 +746,9 @@ bool PackageCache::IsCached(const Key& key, const CString& hash) const {
   CORE_LOG(L3, (_T("[PackageCache::IsCached][key '%s'][hash %s]"),
                 key.ToString(), hash));
 
-  __mutexScope(cache_lock_);
+  __sharedMutexScope(cache_lock_);
+  __sharedMutexScope(GetAppLock(key.app_id()));
+  __sharedMutexScope(GetKeyLock(key));
 
   CString filename;
   HRESULT hr = BuildCacheFileNameForKey(key, &filename);
@@ -226,55 +756,151 @@ bool PackageCache::IsCached(const Key& key, const CString& hash) const {
     return false;
   }
 
-  return File::Exists(filename) && SUCCEEDED(VerifyHash(filename, hash));
+  return File::Exists(filename) && SUCCEEDED(VerifyCachedFile(filename, hash));
+}
+
+void PackageCache::VerifyPackages(const std::vector<const Key*>& keys,
+                                  const std::vector<CString>& hashes) const {
+  CORE_LOG(L3, (_T("[PackageCache::VerifyPackages][%Iu]"), keys.size()));
+  ASSERT1(keys.size() == hashes.size());
+
+  // IsCached hashes every package anyway.
+  if (always_verify_hash_) {
+    return;
+  }
+
+  __sharedMutexScope(cache_lock_);
+
+  // The key locks are not held while the packages are hashed. A package that
+  // changes meanwhile no longer has the stamp that is recorded for it.
+  std::vector<std::pair<CString, std::vector<byte>>> files;
+  std::vector<PackageCacheIndex::FileStamp> stamps;
+  std::vector<PackageCacheIndex::Storage> storages;
+  for (size_t i = 0; i != keys.size(); ++i) {
+    ASSERT1(keys[i]);
+
+    CString filename;
+    std::vector<uint8> expected_digest;
+    PackageCacheIndex::FileStamp stamp;
+    if (FAILED(BuildCacheFileNameForKey(*keys[i], &filename)) ||
+        !SafeHexStringToVector(hashes[i], &expected_digest) ||
+        expected_digest.size() != SHA256_DIGEST_SIZE ||
+        FAILED(PackageCacheIndex::GetFileStamp(filename, &stamp)) ||
+        digest_index_.IsVerified(filename, stamp, expected_digest)) {
+      continue;
+    }
+
+    // A compressed package is verified against its compressed digest.
+    std::vector<uint8> digest;
+    std::vector<uint8> compressed_digest;
+    const PackageCacheIndex::Storage storage =
+        digest_index_.GetStorage(filename, &digest, &compressed_digest);
+    if (storage == PackageCacheIndex::STORAGE_COMPRESSED) {
+      continue;
+    }
+
+    files.push_back(std::make_pair(filename, expected_digest));
+    stamps.push_back(stamp);
+    storages.push_back(storage);
+  }
+
+  // A single package gains nothing from being hashed ahead of IsCached.
+  if (files.size() < 2) {
+    return;
+  }
+
+  HighresTimer verification_timer;
+  std::vector<HRESULT> results;
+  CryptoHash crypto_hash;
+  crypto_hash.Validate(files, 0, &results);
+  CORE_LOG(L3, (_T("[PackageCache::VerifyPackages completed][%Iu][%d ms]"),
+                files.size(), verification_timer.GetElapsedMs()));
+
+  ASSERT1(results.size() == files.size());
+  for (size_t i = 0; i != files.size(); ++i) {
+    if (SUCCEEDED(results[i])) {
+      digest_index_.Record(files[i].first,
+                           stamps[i],
+                           files[i].second,
+                           storages[i],
+                           std::vector<uint8>());
+    }
+  }
 }
 
 HRESULT PackageCache::Put(const Key& key,
                           File* source_file,
                           const CString& hash) {
+  return DoPut(key, source_file, hash, NULL);
+}
+
+HRESULT PackageCache::Put(const Key& key,
+                          File* source_file,
+                          const CString& hash,
+                          const std::vector<uint8>& computed_digest) {
+  return DoPut(key, source_file, hash, &computed_digest);
+}
+
+HRESULT PackageCache::DoPut(const Key& key,
+                            File* source_file,
+                            const CString& hash,
+                            const std::vector<uint8>* computed_digest) {
   ASSERT1(source_file);
 
   ++metric_worker_package_cache_put_total;
-  CORE_LOG(L3, (_T("[PackageCache::Put][key '%s'][hash %s]"),
-                key.ToString(), hash));
-
-  __mutexScope(cache_lock_);
+  CORE_LOG(L3, (_T("[PackageCache::Put][key '%s'][hash %s][digest %d]"),
+                key.ToString(), hash, computed_digest != NULL));
 
   if (key.app_id().IsEmpty() || key.version().IsEmpty() ||
       key.package_name().IsEmpty() ) {
     return E_INVALIDARG;
   }
 
-  CString destination_file;
-  HRESULT hr = BuildCacheFileNameForKey(key, &destination_file);
-  CORE_LOG(L3, (_T("[destination file '%s']"), destination_file));
-  if (FAILED(hr)) {
-    return hr;
+  std::vector<uint8> expected_digest;
+  if (!SafeHexStringToVector(hash, &expected_digest)) {
+    return E_INVALIDARG;
   }
 
-  hr = CreateDir(GetDirectoryFromPath(destination_file), NULL);
-  if (FAILED(hr)) {
-    CORE_LOG(LE, (_T("[failed to create cache directory][0x%08x][%s]"),
-                  hr, destination_file));
-    return hr;
+  std::unique_ptr<CryptDetails::HashInterface> hasher(
+      CryptDetails::CreateHasher());
+  if (expected_digest.size() != hasher->hash_size()) {
+    return E_INVALIDARG;
+  }
+
+  // A digest computed by the caller lets a bad download be rejected before
+  // anything is written to the cache.
+  if (computed_digest && *computed_digest != expected_digest) {
+    CORE_LOG(LE, (_T("[computed digest does not match][expected hash %s]"),
+                  hash));
+    return SIGS_E_INVALID_SIGNATURE;
   }
 
-  // TODO(omaha): consider not overwriting the file if the file is
-  // in the cache and it is valid.
+  __sharedMutexScope(cache_lock_);
+  __sharedMutexScope(GetAppLock(key.app_id()));
+  __mutexScope(GetKeyLock(key));
 
-  hr = internal::FileCopy(source_file, destination_file);
+  CString destination_file;
+  HRESULT hr = BuildCacheFileNameForKey(key, &destination_file);
+  CORE_LOG(L3, (_T("[destination file '%s']"), destination_file));
   if (FAILED(hr)) {
-    CORE_LOG(LE, (_T("[failed to copy file to cache][0x%08x][%s]"),
-                  hr, destination_file));
     return hr;
   }
 
-  hr = VerifyHash(destination_file, hash);
+  // The content lock is released before the content left without names is
+  // deleted, which takes other content locks.
+  std::vector<std::vector<uint8> > released_digests;
+  const CString content_file(BuildContentFileName(expected_digest));
+  __mutexBlock(GetContentLock(expected_digest)) {
+    hr = PutContent(source_file, hasher.get(), expected_digest, content_file);
+    if (SUCCEEDED(hr)) {
+      hr = LinkName(content_file,
+                    destination_file,
+                    expected_digest,
+                    &released_digests);
+    }
+  }
+  ReleaseContent(released_digests);
   if (FAILED(hr)) {
-    CORE_LOG(LE,
-        (_T("[failed to verify hash for file '%s'][expected hash %s]"),
-        destination_file, hash));
-    VERIFY1(::DeleteFile(destination_file));
     return hr;
   }
 
@@ -288,7 +914,9 @@ HRESULT PackageCache::Get(const Key& key,
   CORE_LOG(L3, (_T("[PackageCache::Get][key '%s'][dest file '%s'][hash '%s']"),
       key.ToString(), destination_file, hash));
 
-  __mutexScope(cache_lock_);
+  __sharedMutexScope(cache_lock_);
+  __sharedMutexScope(GetAppLock(key.app_id()));
+  __sharedMutexScope(GetKeyLock(key));
 
   if (key.app_id().IsEmpty() || key.version().IsEmpty() ||
       key.package_name().IsEmpty() ) {
@@ -306,20 +934,87 @@ HRESULT PackageCache::Get(const Key& key,
     return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
   }
 
-  hr = VerifyHash(source_file, hash);
+  hr = VerifyCachedFile(source_file, hash);
   if (FAILED(hr)) {
     CORE_LOG(LE, (_T("[failed to verify hash for file '%s'][expected hash %s]"),
         source_file, hash));
     return hr;
   }
 
-  return File::Copy(source_file, destination_file, true);
+  // The cached file was just verified, so the file handed out needs no
+  // verification of its own whether it is a clone, a copy, or the
+  // decompressed package. It is never a link to the cached file, which would
+  // let the installer write to the cache through it.
+  std::vector<uint8> digest;
+  std::vector<uint8> compressed_digest;
+  if (digest_index_.GetStorage(source_file, &digest, &compressed_digest) ==
+      PackageCacheIndex::STORAGE_COMPRESSED) {
+    HighresTimer decompression_timer;
+    hr = internal::DecompressFile(source_file, destination_file);
+    CORE_LOG(L3, (_T("[decompressed cached file][0x%08x][%d ms]"),
+                  hr, decompression_timer.GetElapsedMs()));
+  } else {
+    hr = internal::CloneOrCopyFile(source_file, destination_file);
+  }
+  if (SUCCEEDED(hr)) {
+    digest_index_.Touch(source_file);
+  }
+
+  return hr;
+}
+
+HRESULT PackageCache::Link(const Key& key, const CString& hash) {
+  CORE_LOG(L3, (_T("[PackageCache::Link][key '%s'][hash %s]"),
+                key.ToString(), hash));
+
+  if (key.app_id().IsEmpty() || key.version().IsEmpty() ||
+      key.package_name().IsEmpty() ) {
+    return E_INVALIDARG;
+  }
+
+  std::vector<uint8> expected_digest;
+  if (!SafeHexStringToVector(hash, &expected_digest) ||
+      expected_digest.size() != SHA256_DIGEST_SIZE) {
+    return E_INVALIDARG;
+  }
+
+  __sharedMutexScope(cache_lock_);
+  __sharedMutexScope(GetAppLock(key.app_id()));
+  __mutexScope(GetKeyLock(key));
+
+  CString filename;
+  HRESULT hr = BuildCacheFileNameForKey(key, &filename);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  std::vector<std::vector<uint8> > released_digests;
+  const CString content_file(BuildContentFileName(expected_digest));
+  __mutexBlock(GetContentLock(expected_digest)) {
+    if (!File::Exists(content_file)) {
+      return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+
+    hr = VerifyContentFile(content_file, expected_digest);
+    if (FAILED(hr)) {
+      CORE_LOG(LE, (_T("[failed to verify content][0x%08x][%s]"),
+                    hr, content_file));
+      return hr;
+    }
+
+    hr = LinkName(content_file, filename, expected_digest, &released_digests);
+  }
+  ReleaseContent(released_digests);
+
+  return hr;
 }
 
 HRESULT PackageCache::Purge(const Key& key) {
   CORE_LOG(L3, (_T("[PackageCache::Purge][key '%s']"), key.ToString()));
 
-  __mutexScope(cache_lock_);
+  __sharedMutexScope(cache_lock_);
+  __sharedMutexScope(GetAppLock(key.app_id()));
+  __mutexScope(GetKeyLock(key));
 
   return Delete(key.app_id(), key.version(), key.package_name());
 }
@@ -329,7 +1024,8 @@ HRESULT PackageCache::PurgeVersion(const CString& app_id,
   CORE_LOG(L3, (_T("[PackageCache::PurgeVersion][app_id '%s'][version '%s']"),
                 app_id, version));
 
-  __mutexScope(cache_lock_);
+  __sharedMutexScope(cache_lock_);
+  __mutexScope(GetAppLock(app_id));
 
   return Delete(app_id, version, _T(""));
 }
@@ -337,7 +1033,8 @@ HRESULT PackageCache::PurgeVersion(const CString& app_id,
 HRESULT PackageCache::PurgeApp(const CString& app_id) {
   CORE_LOG(L3, (_T("[PackageCache::PurgeApp][app_id '%s']"), app_id));
 
-  __mutexScope(cache_lock_);
+  __sharedMutexScope(cache_lock_);
+  __mutexScope(GetAppLock(app_id));
 
   return Delete(app_id, _T(""), _T(""));
 }
@@ -347,7 +1044,8 @@ HRESULT PackageCache::PurgeAppLowerVersions(const CString& app_id,
   CORE_LOG(L3, (_T("[PackageCache::PurgeAppLowerVersions][%s][%s]"),
                 app_id, version));
 
-  __mutexScope(cache_lock_);
+  __sharedMutexScope(cache_lock_);
+  __mutexScope(GetAppLock(app_id));
 
   ULONGLONG my_version = VersionFromString(version);
   if (!my_version) {
@@ -383,6 +1081,7 @@ HRESULT PackageCache::PurgeAppLowerVersions(const CString& app_id,
 
     CString version_dir = ConcatenatePath(app_id_path, find_data.cFileName);
     hr = DeleteBeforeOrAfterReboot(version_dir);
+    RemoveFromIndex(version_dir);
     CORE_LOG(L3, (_T("[Purge version][%s][0x%x]"), version_dir, hr));
   } while (::FindNextFile(get(hfind), &find_data));
 
@@ -411,54 +1110,216 @@ HRESULT PackageCache::PurgeAll() {
 }
 
 FILETIME PackageCache::GetCacheExpirationTime() const {
-  FILETIME current_time = {0};
-  ::GetSystemTimeAsFileTime(&current_time);
-  ULARGE_INTEGER now = {0};
-  now.LowPart = current_time.dwLowDateTime;
-  now.HighPart = current_time.dwHighDateTime;
-
-  const uint64 kNum100NanoSecondsInDay = 1000LL * 1000 * 10 * kSecondsPerDay;
-  now.QuadPart -= kNum100NanoSecondsInDay * cache_time_limit_days_;
-
-  FILETIME expiration_time = {0};
-  expiration_time.dwLowDateTime = now.LowPart;
-  expiration_time.dwHighDateTime = now.HighPart;
+  return GetTimeDaysAgo(cache_time_limit_days_);
+}
 
-  return expiration_time;
+FILETIME PackageCache::GetCacheCompressionTime() const {
+  return GetTimeDaysAgo(cache_compression_time_days_);
 }
 
 HRESULT PackageCache::PurgeOldPackagesIfNecessary() const {
   __mutexScope(cache_lock_);
 
-  std::vector<internal::PackageInfo> packages_info;
-  HRESULT hr = internal::FindAllPackagesInfo(cache_root_, &packages_info);
+  // The index keeps the packages ordered from the most to the least recently
+  // used one, so only the packages to delete are visited.
+  std::vector<CString> files_to_purge;
+  digest_index_.GetFilesToPurge(cache_size_limit_bytes_,
+                                GetCacheExpirationTime(),
+                                &files_to_purge);
+
+  HRESULT hr = S_OK;
+  for (size_t i = 0; i != files_to_purge.size(); ++i) {
+    hr = DeleteBeforeOrAfterReboot(files_to_purge[i]);
+    RemoveFromIndex(files_to_purge[i]);
+  }
+
+  return hr;
+}
+
+HRESULT PackageCache::CompressColdPackages(HANDLE stop_event) {
+  if (!cache_compression_time_days_) {
+    return S_FALSE;
+  }
+
+  __sharedMutexScope(cache_lock_);
 
+  HighresTimer compression_timer;
+  std::vector<PackageCacheIndex::ColdFile> cold_files;
+  digest_index_.GetColdFiles(GetCacheCompressionTime(), &cold_files);
+
+  HRESULT hr = S_OK;
+  for (size_t i = 0; i != cold_files.size(); ++i) {
+    if (stop_event && ::WaitForSingleObject(stop_event, 0) == WAIT_OBJECT_0) {
+      hr = E_ABORT;
+      break;
+    }
+
+    // A package that cannot be compressed stays as it is.
+    HRESULT hr_compress = CompressColdFile(cold_files[i], stop_event);
+    if (FAILED(hr_compress)) {
+      CORE_LOG(LW, (_T("[failed to compress cold package][0x%08x][%s]"),
+                    hr_compress, cold_files[i].filenames.front()));
+    }
+  }
+
+  CORE_LOG(L3, (_T("[PackageCache::CompressColdPackages]")
+                _T("[%Iu packages][0x%08x][%d ms]"),
+                cold_files.size(), hr, compression_timer.GetElapsedMs()));
+  return hr;
+}
+
+HRESULT PackageCache::CompressColdFile(
+    const PackageCacheIndex::ColdFile& cold_file,
+    HANDLE stop_event) {
+  ASSERT1(!cold_file.filenames.empty());
+  const std::vector<uint8>& digest = cold_file.digest;
+
+  // Compressing takes a while, so it is done without holding the locks of
+  // the package. The package is hashed as it is read, which tells if it
+  // changed meanwhile.
+  const CString compressed_file(BuildCompressedContentFileName(digest));
+  const CString temp_file(compressed_file + _T(".tmp"));
+  std::unique_ptr<CryptDetails::HashInterface> hasher(
+      CryptDetails::CreateHasher());
+  std::unique_ptr<CryptDetails::HashInterface> compressed_hasher(
+      CryptDetails::CreateHasher());
+  uint64 size = 0;
+  {
+    File source_file;
+    HRESULT hr = source_file.OpenShareMode(cold_file.filenames.front(),
+                                           false,
+                                           false,
+                                           FILE_SHARE_READ |
+                                               FILE_SHARE_DELETE);
+    if (SUCCEEDED(hr)) {
+      hr = source_file.GetLength(&size);
+    }
+    if (SUCCEEDED(hr)) {
+      hr = CreateDir(GetDirectoryFromPath(temp_file), NULL);
+    }
+    if (SUCCEEDED(hr)) {
+      hr = internal::CompressFile(&source_file,
+                                  temp_file,
+                                  hasher.get(),
+                                  compressed_hasher.get(),
+                                  stop_event);
+    }
+    if (FAILED(hr)) {
+      ::DeleteFile(temp_file);
+      return hr;
+    }
+  }
+
+  if (memcmp(&digest.front(), hasher->final(), digest.size()) != 0) {
+    VERIFY1(::DeleteFile(temp_file));
+    return SIGS_E_INVALID_SIGNATURE;
+  }
+
+  PackageCacheIndex::FileStamp compressed_stamp;
+  HRESULT hr = PackageCacheIndex::GetFileStamp(temp_file, &compressed_stamp);
   if (FAILED(hr)) {
-    CORE_LOG(LE, (_T("[internal::FindAllPackagesInfo failed][0x%x]"), hr));
+    ::DeleteFile(temp_file);
     return hr;
   }
-  internal::SortPackageInfoByTime(&packages_info);
-
-  FILETIME expiration_time = GetCacheExpirationTime();
 
-  // Delete cached package based on the package info.
-  std::vector<internal::PackageInfo>::const_iterator it;
-  uint64 total_cache_size = 0;
-  for (it = packages_info.begin(); it != packages_info.end(); ++it) {
-    total_cache_size += it->file_size.QuadPart;
-    if (total_cache_size > cache_size_limit_bytes_) {
-      break;  // Remaining packages should be deleted as size limit is reached.
+  PackageCacheIndex::Storage storage =
+      PackageCacheIndex::STORAGE_INCOMPRESSIBLE;
+  std::vector<uint8> compressed_digest;
+  if (compressed_stamp.size * 100 <= size * kMaxCompressedSizePercent) {
+    storage = PackageCacheIndex::STORAGE_COMPRESSED;
+    compressed_digest.assign(
+        compressed_hasher->final(),
+        compressed_hasher->final() + compressed_hasher->hash_size());
+    __mutexBlock(GetContentLock(digest)) {
+      hr = File::Move(temp_file, compressed_file, true);
     }
-    if (::CompareFileTime(&it->file_time, &expiration_time) < 0) {
-      break;  // Remaining packages should be deleted as they are expired.
+    if (FAILED(hr)) {
+      VERIFY1(::DeleteFile(temp_file));
+      return hr;
     }
+  } else {
+    VERIFY1(::DeleteFile(temp_file));
   }
 
-  for (; it != packages_info.end(); ++it) {
-    hr = DeleteBeforeOrAfterReboot(it->file_name);
+  CORE_LOG(L3, (_T("[compressed cold package][%s][%I64u to %I64u bytes]"),
+                cold_file.filenames.front(), size, compressed_stamp.size));
+
+  for (size_t i = 0; i != cold_file.filenames.size(); ++i) {
+    const CString& filename = cold_file.filenames[i];
+    CString app_id;
+    CString version;
+    CString package_name;
+    if (!SplitCacheFileName(filename, &app_id, &version, &package_name)) {
+      continue;
+    }
+
+    const Key key(app_id, version, package_name);
+    __sharedMutexScope(GetAppLock(app_id));
+    __mutexScope(GetKeyLock(key));
+    __mutexScope(GetContentLock(digest));
+    ReplaceWithCompressedFile(filename,
+                              digest,
+                              storage,
+                              compressed_file,
+                              compressed_digest);
   }
 
-  return hr;
+  // The plain content is deleted if all its names were replaced, and the
+  // compressed file if none was.
+  ReleaseContent(std::vector<std::vector<uint8> >(1, digest));
+  return S_OK;
+}
+
+void PackageCache::ReplaceWithCompressedFile(
+    const CString& filename,
+    const std::vector<uint8>& digest,
+    PackageCacheIndex::Storage storage,
+    const CString& compressed_file,
+    const std::vector<uint8>& compressed_digest) {
+  // The package may have been replaced since it was found to be cold.
+  PackageCacheIndex::FileStamp stamp;
+  std::vector<uint8> recorded_digest;
+  std::vector<uint8> recorded_compressed_digest;
+  if (FAILED(PackageCacheIndex::GetFileStamp(filename, &stamp)) ||
+      !digest_index_.IsVerified(filename, stamp, digest) ||
+      digest_index_.GetStorage(filename,
+                               &recorded_digest,
+                               &recorded_compressed_digest) !=
+          PackageCacheIndex::STORAGE_PLAIN) {
+    return;
+  }
+
+  if (storage == PackageCacheIndex::STORAGE_INCOMPRESSIBLE) {
+    digest_index_.Record(filename, stamp, digest, storage, compressed_digest);
+    return;
+  }
+
+  // The name is replaced atomically by a link to the compressed file, or a
+  // copy of it where links are not supported.
+  const CString temp_file(filename + _T(".tmp"));
+  HRESULT hr = S_OK;
+  if (!::CreateHardLink(temp_file, compressed_file, NULL)) {
+    hr = File::Copy(compressed_file, temp_file, true);
+  }
+  if (SUCCEEDED(hr)) {
+    hr = File::Move(temp_file, filename, true);
+  }
+  if (FAILED(hr)) {
+    CORE_LOG(LW, (_T("[failed to replace cold package][0x%08x][%s]"),
+                  hr, filename));
+    ::DeleteFile(temp_file);
+    return;
+  }
+
+  PackageCacheIndex::FileStamp compressed_stamp;
+  if (SUCCEEDED(PackageCacheIndex::GetFileStamp(filename,
+                                                &compressed_stamp))) {
+    digest_index_.Record(filename,
+                         compressed_stamp,
+                         digest,
+                         storage,
+                         compressed_digest);
+  }
 }
 
 HRESULT PackageCache::Delete(const CString& app_id,
@@ -471,11 +1332,13 @@ HRESULT PackageCache::Delete(const CString& app_id,
     return hr;
   }
 
-  return DeleteBeforeOrAfterReboot(filename);
+  hr = DeleteBeforeOrAfterReboot(filename);
+  RemoveFromIndex(filename);
+  return hr;
 }
 
 CString PackageCache::cache_root() const {
-  __mutexScope(cache_lock_);
+  __sharedMutexScope(cache_lock_);
 
   ASSERT1(!cache_root_.IsEmpty());
   ASSERT1(File::Exists(cache_root_));
@@ -484,8 +1347,9 @@ CString PackageCache::cache_root() const {
 }
 
 uint64 PackageCache::Size() const {
-  uint64 result(0);
-  return SUCCEEDED(GetDirectorySize(cache_root_, &result)) ? result : 0;
+  // The index has its own lock, so the size can be read while packages are
+  // being cached.
+  return digest_index_.total_size();
 }
 
 HRESULT PackageCache::BuildCacheFileNameForKey(const Key& key,
@@ -519,6 +1383,336 @@ HRESULT PackageCache::BuildCacheFileName(const CString& app_id,
   return S_OK;
 }
 
+CString PackageCache::BuildContentFileName(
+    const std::vector<uint8>& digest) const {
+  const CString content_dir(ConcatenatePath(cache_root_,
+                                            kContentDirectoryName));
+  return ConcatenatePath(content_dir, BytesToHex(digest));
+}
+
+CString PackageCache::BuildCompressedContentFileName(
+    const std::vector<uint8>& digest) const {
+  return BuildContentFileName(digest) + kCompressedContentSuffix;
+}
+
+bool PackageCache::SplitCacheFileName(const CString& filename,
+                                      CString* app_id,
+                                      CString* version,
+                                      CString* package_name) const {
+  ASSERT1(app_id);
+  ASSERT1(version);
+  ASSERT1(package_name);
+
+  const CString root_prefix(cache_root_ + _T("\\"));
+  if (!String_StartsWith(filename, root_prefix, true)) {
+    return false;
+  }
+
+  const CString name(filename.Mid(root_prefix.GetLength()));
+  const int app_end = name.Find(_T('\\'));
+  const int version_end = app_end == -1 ? -1 : name.Find(_T('\\'),
+                                                          app_end + 1);
+  if (app_end <= 0 || version_end <= app_end + 1 ||
+      version_end + 1 == name.GetLength()) {
+    return false;
+  }
+
+  *app_id = name.Left(app_end);
+  *version = name.Mid(app_end + 1, version_end - app_end - 1);
+  *package_name = name.Mid(version_end + 1);
+  return true;
+}
+
+const RWLock& PackageCache::GetAppLock(const CString& app_id) const {
+  return app_locks_[HashStringIgnoreCase(app_id) % kNumLockStripes];
+}
+
+const RWLock& PackageCache::GetKeyLock(const Key& key) const {
+  const CString key_name(key.app_id() + _T("\\") +
+                         key.version() + _T("\\") +
+                         key.package_name());
+  return key_locks_[HashStringIgnoreCase(key_name) % kNumLockStripes];
+}
+
+const RWLock& PackageCache::GetContentLock(
+    const std::vector<uint8>& digest) const {
+  ASSERT1(!digest.empty());
+  return content_locks_[digest.front() % kNumLockStripes];
+}
+
+HRESULT PackageCache::VerifyCachedFile(const CString& filename,
+                                       const CString& expected_hash) const {
+  std::vector<uint8> expected_digest;
+  PackageCacheIndex::FileStamp stamp;
+  const bool can_use_index =
+      SafeHexStringToVector(expected_hash, &expected_digest) &&
+      expected_digest.size() == SHA256_DIGEST_SIZE &&
+      SUCCEEDED(PackageCacheIndex::GetFileStamp(filename, &stamp));
+
+  if (can_use_index &&
+      !always_verify_hash_ &&
+      digest_index_.IsVerified(filename, stamp, expected_digest)) {
+    CORE_LOG(L3, (_T("[hash verified by the cache index][%s]"), filename));
+    return S_OK;
+  }
+
+  // A compressed file is verified against the digest of the compressed file
+  // recorded along with the digest of the package.
+  std::vector<uint8> digest;
+  std::vector<uint8> compressed_digest;
+  const PackageCacheIndex::Storage storage =
+      digest_index_.GetStorage(filename, &digest, &compressed_digest);
+  if (storage == PackageCacheIndex::STORAGE_COMPRESSED &&
+      (!can_use_index || digest != expected_digest)) {
+    return SIGS_E_INVALID_SIGNATURE;
+  }
+
+  // The stamp is taken before the file is hashed. If the file changes while
+  // it is hashed, its stamp no longer matches the one recorded below.
+  HRESULT hr = VerifyHash(filename,
+                          storage == PackageCacheIndex::STORAGE_COMPRESSED ?
+                              BytesToHex(compressed_digest) : expected_hash);
+  if (SUCCEEDED(hr) && can_use_index) {
+    digest_index_.Record(filename,
+                         stamp,
+                         expected_digest,
+                         storage,
+                         compressed_digest);
+  }
+
+  return hr;
+}
+
+HRESULT PackageCache::VerifyContentFile(
+    const CString& content_file,
+    const std::vector<uint8>& expected_digest) const {
+  PackageCacheIndex::FileStamp stamp;
+  HRESULT hr = PackageCacheIndex::GetFileStamp(content_file, &stamp);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  if (!always_verify_hash_ &&
+      digest_index_.IsFileVerified(stamp, expected_digest)) {
+    return S_OK;
+  }
+
+  return VerifyHash(content_file, BytesToHex(expected_digest));
+}
+
+HRESULT PackageCache::PutContent(File* source_file,
+                                 CryptDetails::HashInterface* hasher,
+                                 const std::vector<uint8>& expected_digest,
+                                 const CString& content_file) {
+  ASSERT1(source_file);
+  ASSERT1(hasher);
+
+  // The content may already be cached under another name, for instance by
+  // another app, in which case only a new name is added for it.
+  if (SUCCEEDED(VerifyContentFile(content_file, expected_digest))) {
+    CORE_LOG(L3, (_T("[content is already cached][%s]"), content_file));
+    return S_OK;
+  }
+
+  HRESULT hr = CreateDir(GetDirectoryFromPath(content_file), NULL);
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[failed to create content directory][0x%08x][%s]"),
+                  hr, content_file));
+    return hr;
+  }
+
+  // The bytes are hashed as they are copied, so the file that ends up in the
+  // cache is verified without reading it back from disk. The copy is only
+  // moved in place once verified.
+  const CString temp_file(content_file + _T(".tmp"));
+  hr = internal::FileCopy(source_file, temp_file, hasher);
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[failed to copy file to cache][0x%08x][%s]"),
+                  hr, temp_file));
+    ::DeleteFile(temp_file);
+    return hr;
+  }
+
+  if (memcmp(&expected_digest.front(),
+             hasher->final(),
+             expected_digest.size()) != 0) {
+    CORE_LOG(LE, (_T("[failed to verify hash for file '%s']"), temp_file));
+    VERIFY1(::DeleteFile(temp_file));
+    return SIGS_E_INVALID_SIGNATURE;
+  }
+
+  // Replacing a corrupt content file leaves the names linked to it alone.
+  hr = File::Move(temp_file, content_file, true);
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[failed to move content in place][0x%08x][%s]"),
+                  hr, content_file));
+    VERIFY1(::DeleteFile(temp_file));
+    return hr;
+  }
+
+  return S_OK;
+}
+
+HRESULT PackageCache::LinkName(
+    const CString& content_file,
+    const CString& filename,
+    const std::vector<uint8>& digest,
+    std::vector<std::vector<uint8> >* released_digests) {
+  ASSERT1(released_digests);
+
+  // The previous file may be a link to other content. It is deleted rather
+  // than written over, which would change that content for all its names.
+  digest_index_.Remove(filename, released_digests);
+  if (File::Exists(filename)) {
+    HRESULT hr = File::Remove(filename);
+    if (FAILED(hr)) {
+      CORE_LOG(LE, (_T("[failed to delete cached file][0x%08x][%s]"),
+                    hr, filename));
+      return hr;
+    }
+  }
+
+  HRESULT hr = CreateDir(GetDirectoryFromPath(filename), NULL);
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[failed to create cache directory][0x%08x][%s]"),
+                  hr, filename));
+    return hr;
+  }
+
+  if (!::CreateHardLink(filename, content_file, NULL)) {
+    hr = HRESULTFromLastError();
+    CORE_LOG(LW, (_T("[CreateHardLink failed, copying][0x%08x][%s]"),
+                  hr, filename));
+
+    // Without links the name gets its own copy, and the content file is of
+    // no further use.
+    hr = File::Copy(content_file, filename, true);
+    if (FAILED(hr)) {
+      CORE_LOG(LE, (_T("[failed to copy content][0x%08x][%s]"),
+                    hr, filename));
+      return hr;
+    }
+    released_digests->push_back(digest);
+  }
+
+  PackageCacheIndex::FileStamp stamp;
+  if (SUCCEEDED(PackageCacheIndex::GetFileStamp(filename, &stamp))) {
+    digest_index_.Record(filename, stamp, digest);
+  }
+
+  return S_OK;
+}
+
+void PackageCache::RemoveFromIndex(const CString& path) const {
+  std::vector<std::vector<uint8> > released_digests;
+  digest_index_.Remove(path, &released_digests);
+  ReleaseContent(released_digests);
+}
+
+void PackageCache::ReleaseContent(
+    const std::vector<std::vector<uint8> >& digests) const {
+  for (size_t i = 0; i != digests.size(); ++i) {
+    __mutexScope(GetContentLock(digests[i]));
+    DeleteContentIfUnreferenced(BuildContentFileName(digests[i]));
+    DeleteContentIfUnreferenced(BuildCompressedContentFileName(digests[i]));
+  }
+}
+
+void PackageCache::DeleteContentIfUnreferenced(
+    const CString& content_file) const {
+  // Only the names in the cache count.
+  PackageCacheIndex::FileStamp stamp;
+  if (FAILED(PackageCacheIndex::GetFileStamp(content_file, &stamp)) ||
+      digest_index_.HasFile(stamp)) {
+    return;
+  }
+
+  HRESULT hr = DeleteBeforeOrAfterReboot(content_file);
+  CORE_LOG(L3, (_T("[deleted unreferenced content][%s][0x%x]"),
+                content_file, hr));
+}
+
+void PackageCache::DeleteUnreferencedContent() const {
+  const CString content_dir(ConcatenatePath(cache_root_,
+                                            kContentDirectoryName));
+
+  WIN32_FIND_DATA find_data = {0};
+  scoped_hfind hfind(::FindFirstFile(content_dir + _T("\\*"), &find_data));
+  if (!hfind) {
+    return;
+  }
+
+  do {
+    if (internal::IsFileFindData(find_data)) {
+      DeleteContentIfUnreferenced(ConcatenatePath(content_dir,
+                                                  find_data.cFileName));
+    }
+  } while (::FindNextFile(get(hfind), &find_data));
+}
+
+void PackageCache::RecordCompressedContent() {
+  const CString content_dir(ConcatenatePath(cache_root_,
+                                            kContentDirectoryName));
+
+  WIN32_FIND_DATA find_data = {0};
+  scoped_hfind hfind(::FindFirstFile(
+      content_dir + _T("\\*") + kCompressedContentSuffix, &find_data));
+  if (!hfind) {
+    return;
+  }
+
+  std::vector<internal::PackageInfo> packages_info;
+  if (FAILED(internal::FindAllPackagesInfo(cache_root_, &packages_info))) {
+    return;
+  }
+
+  std::vector<PackageCacheIndex::FileStamp> stamps(packages_info.size());
+  for (size_t i = 0; i != packages_info.size(); ++i) {
+    PackageCacheIndex::GetFileStamp(packages_info[i].file_name, &stamps[i]);
+  }
+
+  do {
+    if (!internal::IsFileFindData(find_data)) {
+      continue;
+    }
+
+    // The compressed content is named after the digest of the package.
+    const CString compressed_file(ConcatenatePath(content_dir,
+                                                  find_data.cFileName));
+    CString hash(find_data.cFileName);
+    hash.Truncate(hash.GetLength() - lstrlen(kCompressedContentSuffix));
+    std::vector<uint8> digest;
+    PackageCacheIndex::FileStamp compressed_stamp;
+    if (!SafeHexStringToVector(hash, &digest) ||
+        digest.size() != SHA256_DIGEST_SIZE ||
+        FAILED(PackageCacheIndex::GetFileStamp(compressed_file,
+                                               &compressed_stamp))) {
+      continue;
+    }
+
+    std::vector<uint8> compressed_digest;
+    CryptoHash crypto_hash;
+    HRESULT hr = crypto_hash.Compute(compressed_file, 0, &compressed_digest);
+    if (FAILED(hr)) {
+      CORE_LOG(LW, (_T("[failed to hash compressed content][%s][0x%08x]"),
+                    compressed_file, hr));
+      continue;
+    }
+
+    for (size_t i = 0; i != packages_info.size(); ++i) {
+      if (stamps[i].file_index == compressed_stamp.file_index &&
+          stamps[i].volume_serial_number ==
+              compressed_stamp.volume_serial_number) {
+        digest_index_.Record(packages_info[i].file_name,
+                             stamps[i],
+                             digest,
+                             PackageCacheIndex::STORAGE_COMPRESSED,
+                             compressed_digest);
+      }
+    }
+  } while (::FindNextFile(get(hfind), &find_data));
+}
+
 HRESULT PackageCache::VerifyHash(const CString& filename,
                                  const CString& expected_hash) {
   CORE_LOG(L3, (_T("[PackageCache::VerifyHash][%s][%s]"),
@@ -528,7 +1722,9 @@ HRESULT PackageCache::VerifyHash(const CString& filename,
   std::vector<CString> files;
   files.push_back(filename);
 
-  HRESULT hr = VerifyFileHashSha256(files, expected_hash);
+  // Packages can be hundreds of megabytes, so the disk reads overlap the
+  // hashing.
+  HRESULT hr = VerifyFileHashSha256(files, expected_hash, HASH_READ_AUTO);
   CORE_LOG(L3, (_T("[PackageCache::VerifyHash completed][0x%08x][%d ms]"),
                 hr, verification_timer.GetElapsedMs()));
   return hr;
@@ -12,6 +12,17 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 // ========================================================================
+//
+// The package cache stores each distinct package once, in a content directory
+// where the package is named after its SHA-256 hash. The packages are found
+// by their app id, version, and package name, which are hard links to the
+// content. Caching a package whose content is already cached under another
+// name only adds a link, and the content is deleted along with its last name.
+// On file systems without hard links, each name is a copy of the content.
+//
+// Packages not used for a configurable number of days may be compressed in
+// the background. Their names then link to the compressed content, and the
+// packages are decompressed as they are copied out of the cache.
 
 #ifndef OMAHA_GOOPDATE_PACKAGE_CACHE_H_
 #define OMAHA_GOOPDATE_PACKAGE_CACHE_H_
@@ -22,9 +33,16 @@
 #include "base/basictypes.h"
 #include "base/synchronized.h"
 #include "omaha/base/safe_format.h"
+#include "omaha/goopdate/package_cache_index.h"
 
 namespace omaha {
 
+namespace CryptDetails {
+
+class HashInterface;
+
+}  // namespace CryptDetails
+
 class File;
 
 class PackageCache {
@@ -65,16 +83,47 @@ class PackageCache {
 
   HRESULT Initialize(const CString& cache_root);
 
+  // Copies |source_file| into the cache if its SHA-256 hash matches |hash|,
+  // which is hex-digit encoded. The file is hashed as it is copied. If the
+  // content is already cached, |source_file| is not read at all.
   HRESULT Put(const Key& key,
               File* source_file,
               const CString& hash);
 
+  // Same as above, with the digest of |source_file| already computed by the
+  // caller, for instance while downloading it. A |computed_digest| that does
+  // not match |hash| fails without copying the file.
+  HRESULT Put(const Key& key,
+              File* source_file,
+              const CString& hash,
+              const std::vector<uint8>& computed_digest);
+
+  // Verifies the cached package against |hash| and makes |destination_file|
+  // a clone of it, on file systems with block cloning. The package is only
+  // copied when it cannot be cloned, for instance when |destination_file| is
+  // on another volume. Either way, writing to |destination_file| leaves the
+  // cached package unchanged. A compressed package is decompressed to
+  // |destination_file| instead.
   HRESULT Get(const Key& key,
               const CString& destination_file,
               const CString& hash) const;
 
+  // Caches the package for |key| from the cached content with |hash|, if the
+  // package was cached under another key. Returns ERROR_FILE_NOT_FOUND if
+  // there is no such content, or if the content is only cached compressed.
+  HRESULT Link(const Key& key, const CString& hash);
+
+  // Returns true if the package is in the cache and its hash matches |hash|.
+  // The file is only hashed if it changed since its hash was last verified.
   bool IsCached(const Key& key, const CString& hash) const;
 
+  // Verifies the packages for |keys| against |hashes| in one pass, so that
+  // the IsCached calls for them that follow do not hash them one by one. The
+  // packages that changed since they were last verified are hashed
+  // concurrently. Missing and mismatched packages are left for IsCached.
+  void VerifyPackages(const std::vector<const Key*>& keys,
+                      const std::vector<CString>& hashes) const;
+
   HRESULT Purge(const Key& key);
 
   HRESULT PurgeVersion(const CString& app_id, const CString& version);
@@ -87,12 +136,18 @@ class PackageCache {
 
   HRESULT PurgeAll();
 
-  // Purges expired packages and keeps total cache size below the limit by
-  // purging oldest ones.
+  // Purges packages not used within the cache time limit and keeps the total
+  // cache size below the limit by purging the least recently used ones. A
+  // package is used when it is put in the cache or copied out of it.
   HRESULT PurgeOldPackagesIfNecessary() const;
 
-  // Returns the total size of all files in the cache. Returns 0 if the size
-  // cannot be determined or the cache is empty.
+  // Compresses the packages not used within the cache compression time
+  // limit, if there is one. Returns S_FALSE if compression is disabled, and
+  // E_ABORT if |stop_event| is signaled before all packages are compressed.
+  HRESULT CompressColdPackages(HANDLE stop_event);
+
+  // Returns the total size of all packages in the cache, as tracked by the
+  // cache index. Returns 0 if the cache is empty.
   uint64 Size() const;
 
   CString cache_root() const;
@@ -103,11 +158,90 @@ class PackageCache {
  private:
   friend class PackageCacheTest;
 
+  HRESULT DoPut(const Key& key,
+                File* source_file,
+                const CString& hash,
+                const std::vector<uint8>* computed_digest);
+
+  // Verifies the hash of the cached |filename|, using the digest index to
+  // avoid hashing the file when possible.
+  HRESULT VerifyCachedFile(const CString& filename,
+                           const CString& expected_hash) const;
+
+  // Verifies that |content_file| exists and hashes to |expected_digest|. The
+  // content is not in the digest index, but it shares the stamp of its names.
+  HRESULT VerifyContentFile(const CString& content_file,
+                            const std::vector<uint8>& expected_digest) const;
+
+  // Copies |source_file| to |content_file| through |hasher| unless the
+  // content is already cached. Called with the content lock held.
+  HRESULT PutContent(File* source_file,
+                     CryptDetails::HashInterface* hasher,
+                     const std::vector<uint8>& expected_digest,
+                     const CString& content_file);
+
+  // Makes |filename| a link to |content_file|, replacing any previous file.
+  // Called with the content lock held. |released_digests| receives the
+  // content left without names, which must be released once the lock is.
+  HRESULT LinkName(const CString& content_file,
+                   const CString& filename,
+                   const std::vector<uint8>& digest,
+                   std::vector<std::vector<uint8> >* released_digests);
+
+  // Removes |path| from the digest index after it is deleted, and deletes
+  // the content that is left without names.
+  void RemoveFromIndex(const CString& path) const;
+
+  // Deletes the content for |digests| that is left without names. Takes the
+  // content locks, so none may be held by the caller.
+  void ReleaseContent(const std::vector<std::vector<uint8> >& digests) const;
+
+  // Deletes |content_file| if no name links to it anymore.
+  void DeleteContentIfUnreferenced(const CString& content_file) const;
+
+  // Deletes all the content without names, for instance after a crash
+  // between deleting the last name of some content and the content itself.
+  void DeleteUnreferencedContent() const;
+
+  // Records the names of the compressed content in a rebuilt index as
+  // compressed, with the digest of the package the name of the content
+  // carries.
+  void RecordCompressedContent();
+
   HRESULT BuildCacheFileNameForKey(const Key& key, CString* filename) const;
   HRESULT BuildCacheFileName(const CString& app_id,
                              const CString& version,
                              const CString& package_name,
                              CString* filename) const;
+  CString BuildContentFileName(const std::vector<uint8>& digest) const;
+  CString BuildCompressedContentFileName(
+      const std::vector<uint8>& digest) const;
+
+  // Splits a |filename| built by BuildCacheFileName into its parts. Returns
+  // false if |filename| is not a package in the cache.
+  bool SplitCacheFileName(const CString& filename,
+                          CString* app_id,
+                          CString* version,
+                          CString* package_name) const;
+
+  // Compresses the content of |cold_file| and replaces its names with links
+  // to the compressed content, or records it as incompressible.
+  HRESULT CompressColdFile(const PackageCacheIndex::ColdFile& cold_file,
+                           HANDLE stop_event);
+
+  // Replaces |filename| with |compressed_file|, unless the package changed
+  // since it was compressed. Called with the key and content locks held.
+  void ReplaceWithCompressedFile(const CString& filename,
+                                 const std::vector<uint8>& digest,
+                                 PackageCacheIndex::Storage storage,
+                                 const CString& compressed_file,
+                                 const std::vector<uint8>& compressed_digest);
+
+  // Return the lock stripes that guard an app, a package, and the content of
+  // a package.
+  const RWLock& GetAppLock(const CString& app_id) const;
+  const RWLock& GetKeyLock(const Key& key) const;
+  const RWLock& GetContentLock(const std::vector<uint8>& digest) const;
 
   // Deletes the cache entries that match the app_id, version, and package_name.
   // If the parameters are empty, the function deletes the packages of versions
@@ -116,21 +250,48 @@ class PackageCache {
                  const CString& version,
                  const CString& package_name);
 
-  // Returns the cache expiration time. All files in the cache before that time
-  // are considered as expired and should be purged.
+  // Returns the cache expiration time. All files in the cache last used before
+  // that time are considered as expired and should be purged.
   FILETIME GetCacheExpirationTime() const;
 
+  // Returns the time before which the files in the cache were last used are
+  // compressed.
+  FILETIME GetCacheCompressionTime() const;
+
   // The cache duration, specified as a count of days.  (This is converted to
   // an absolute time by GetCacheExpirationTime().)
   int cache_time_limit_days_;
 
   // The maximum allowed cache size, in bytes. If the cache grows over this
-  // size, files will be purged using a least-recently-added metric.
+  // size, files will be purged using a least-recently-used metric.
   uint64 cache_size_limit_bytes_;
 
+  // Packages not used for this count of days are compressed. Zero disables
+  // compression.
+  int cache_compression_time_days_;
+
   CString cache_root_;
 
-  LLock cache_lock_;
+  // When true, cached files are always hashed and the digest index is only
+  // kept up to date.
+  bool always_verify_hash_;
+
+  // Updated as files are verified and used, hence mutable.
+  mutable PackageCacheIndex digest_index_;
+
+  // The locks are always taken in this order: the cache lock, an app lock,
+  // a key lock, and a content lock. The cache lock is only held exclusively
+  // to purge packages across apps; everything else holds it shared and locks
+  // the stripes it needs, so that operations on different packages do not
+  // wait for each other. A purge within an app holds its app lock
+  // exclusively. Content is shared between apps, so its locks come last and
+  // at most one of them is held at a time. The digest index has its own lock.
+  static const size_t kNumLockStripes = 64;
+
+  RWLock cache_lock_;
+  RWLock app_locks_[kNumLockStripes];
+  RWLock key_locks_[kNumLockStripes];
+  RWLock content_locks_[kNumLockStripes];
 
   DISALLOW_COPY_AND_ASSIGN(PackageCache);
 };
@@ -0,0 +1,994 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// The snapshot is a header (magic, format version, generation, entry count),
+// followed by the entries from the most to the least recently used one, and
+// by the SHA-256 of everything before it. An entry is the relative name, the
+// file stamp, the last used time, the digest, the storage, and the digest of
+// the compressed file.
+//
+// The journal is a header (magic, format version, generation) followed by
+// records. Each record is the length of its payload, the payload, and the
+// first four bytes of the SHA-256 of the payload. The payload is an operation
+// and its arguments.
+//
+// Integers are stored little-endian. Strings and digests are stored as their
+// length followed by their contents.
+
+#include "omaha/goopdate/package_cache_index.h"
+
+#include <string.h>
+
+#include "omaha/base/byte_buffer.h"
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/file.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/path.h"
+#include "omaha/base/scoped_any.h"
+#include "omaha/base/security/sha256.h"
+#include "omaha/base/utils.h"
+#include "omaha/goopdate/package_cache_internal.h"
+
+namespace omaha {
+
+namespace {
+
+const uint32 kIndexMagic = 0x49435050;    // "PPCI".
+const uint32 kJournalMagic = 0x4a435050;  // "PPCJ".
+const uint32 kIndexVersion = 3;
+
+enum JournalOperation {
+  JOURNAL_RECORD = 1,
+  JOURNAL_TOUCH,
+  JOURNAL_REMOVE,
+};
+
+// Large enough for any sane cache; protects against reading garbage.
+const uint32 kMaxIndexFileSize = 64 * 1024 * 1024;
+const uint32 kMaxEntryNameLength = MAX_PATH;
+const size_t kJournalChecksumSize = 4;
+
+// The journal is compacted once it has more records than this and than there
+// are entries in the index, which keeps the amortized cost of a change O(1).
+const size_t kMinJournalRecordsToCompact = 256;
+
+void AppendFileTime(const FILETIME& time, std::vector<uint8>* buffer) {
+  AppendUint32(time.dwLowDateTime, buffer);
+  AppendUint32(time.dwHighDateTime, buffer);
+}
+
+void AppendDigest(const std::vector<uint8>& digest,
+                  std::vector<uint8>* buffer) {
+  AppendUint32(static_cast<uint32>(digest.size()), buffer);
+  if (!digest.empty()) {
+    AppendBytes(&digest.front(), digest.size(), buffer);
+  }
+}
+
+void AppendEntry(const CString& name,
+                 const PackageCacheIndex::FileStamp& stamp,
+                 const FILETIME& last_used_time,
+                 const std::vector<uint8>& digest,
+                 PackageCacheIndex::Storage storage,
+                 const std::vector<uint8>& compressed_digest,
+                 std::vector<uint8>* buffer) {
+  AppendString(name, buffer);
+  AppendUint64(stamp.size, buffer);
+  AppendFileTime(stamp.last_write_time, buffer);
+  AppendUint32(stamp.volume_serial_number, buffer);
+  AppendUint64(stamp.file_index, buffer);
+  AppendFileTime(last_used_time, buffer);
+  AppendDigest(digest, buffer);
+  buffer->push_back(static_cast<uint8>(storage));
+  AppendDigest(compressed_digest, buffer);
+}
+
+bool ReadFileTime(BufferReader* reader, FILETIME* time) {
+  uint32 low = 0;
+  uint32 high = 0;
+  if (!reader->ReadUint32(&low) || !reader->ReadUint32(&high)) {
+    return false;
+  }
+  time->dwLowDateTime = low;
+  time->dwHighDateTime = high;
+  return true;
+}
+
+bool ReadDigest(BufferReader* reader, std::vector<uint8>* digest) {
+  uint32 digest_size = 0;
+  if (!reader->ReadUint32(&digest_size) ||
+      (digest_size != 0 && digest_size != SHA256_DIGEST_SIZE)) {
+    return false;
+  }
+
+  digest->resize(digest_size);
+  return digest_size == 0 || reader->ReadBytes(&digest->front(), digest_size);
+}
+
+bool ReadEntry(BufferReader* reader,
+               CString* name,
+               PackageCacheIndex::FileStamp* stamp,
+               FILETIME* last_used_time,
+               std::vector<uint8>* digest,
+               PackageCacheIndex::Storage* storage,
+               std::vector<uint8>* compressed_digest) {
+  uint32 volume_serial_number = 0;
+  uint8 storage_value = 0;
+  if (!reader->ReadString(name, kMaxEntryNameLength) || name->IsEmpty() ||
+      !reader->ReadUint64(&stamp->size) ||
+      !ReadFileTime(reader, &stamp->last_write_time) ||
+      !reader->ReadUint32(&volume_serial_number) ||
+      !reader->ReadUint64(&stamp->file_index) ||
+      !ReadFileTime(reader, last_used_time) ||
+      !ReadDigest(reader, digest) ||
+      !reader->ReadUint8(&storage_value) ||
+      storage_value > PackageCacheIndex::STORAGE_INCOMPRESSIBLE ||
+      !ReadDigest(reader, compressed_digest) ||
+      compressed_digest->empty() !=
+          (storage_value != PackageCacheIndex::STORAGE_COMPRESSED)) {
+    return false;
+  }
+  stamp->volume_serial_number = volume_serial_number;
+  *storage = static_cast<PackageCacheIndex::Storage>(storage_value);
+  return true;
+}
+
+bool IsSameStamp(const PackageCacheIndex::FileStamp& stamp1,
+                 const PackageCacheIndex::FileStamp& stamp2) {
+  return stamp1.size == stamp2.size &&
+         ::CompareFileTime(&stamp1.last_write_time,
+                           &stamp2.last_write_time) == 0 &&
+         stamp1.volume_serial_number == stamp2.volume_serial_number &&
+         stamp1.file_index == stamp2.file_index;
+}
+
+HRESULT DeleteFileIfExists(const CString& filename) {
+  return File::Exists(filename) ? File::Remove(filename) : S_OK;
+}
+
+}  // namespace
+
+const TCHAR* const PackageCacheIndex::kIndexFileName = _T("cache_index.dat");
+const TCHAR* const PackageCacheIndex::kJournalFileName = _T("cache_index.log");
+
+PackageCacheIndex::PackageCacheIndex()
+    : total_size_(0),
+      generation_(0),
+      journal_records_(0) {
+}
+
+PackageCacheIndex::~PackageCacheIndex() {
+}
+
+HRESULT PackageCacheIndex::Load(const CString& cache_root) {
+  __mutexScope(lock_);
+
+  HighresTimer load_timer;
+
+  cache_root_ = cache_root;
+  cache_root_.MakeLower();
+  cache_root_.TrimRight(_T('\\'));
+  Clear();
+  generation_ = 0;
+  journal_records_ = 0;
+
+  const CString index_file = ConcatenatePath(cache_root_, kIndexFileName);
+  const CString journal_file = ConcatenatePath(cache_root_, kJournalFileName);
+  const bool has_index_file = File::Exists(index_file);
+  const bool has_journal_file = File::Exists(journal_file);
+
+  if (!has_index_file && !has_journal_file) {
+    Rebuild();
+    return S_FALSE;
+  }
+
+  if (has_index_file) {
+    std::vector<uint8> buffer;
+    HRESULT hr = ReadEntireFileShareMode(index_file,
+                                         kMaxIndexFileSize,
+                                         FILE_SHARE_READ,
+                                         &buffer);
+    if (FAILED(hr) || !Deserialize(buffer)) {
+      CORE_LOG(LW, (_T("[cache index is corrupt, rebuilding it][0x%08x]"), hr));
+      Rebuild();
+      return S_FALSE;
+    }
+  }
+
+  if (has_journal_file && !ReplayJournal()) {
+    // Fold what could be replayed into a snapshot, which also discards the
+    // damaged journal.
+    CORE_LOG(LW, (_T("[cache index journal is damaged]")));
+    WriteSnapshot();
+  }
+
+  CORE_LOG(L3, (_T("[PackageCacheIndex::Load]")
+                _T("[%Iu entries][%Iu records][%d ms]"),
+                entries_.size(), journal_records_,
+                load_timer.GetElapsedMs()));
+  return S_OK;
+}
+
+bool PackageCacheIndex::IsVerified(const CString& filename,
+                                   const FileStamp& stamp,
+                                   const std::vector<uint8>& digest) const {
+  __mutexScope(lock_);
+
+  CString name;
+  if (!MakeRelativeName(filename, &name)) {
+    return false;
+  }
+
+  EntryMap::const_iterator it = entries_.find(name);
+  if (it == entries_.end() || it->second.digest.empty()) {
+    return false;
+  }
+
+  return IsSameStamp(it->second.stamp, stamp) && it->second.digest == digest;
+}
+
+bool PackageCacheIndex::IsFileVerified(const FileStamp& stamp,
+                                       const std::vector<uint8>& digest) const {
+  __mutexScope(lock_);
+
+  if (!stamp.file_index || digest.empty()) {
+    return false;
+  }
+
+  FileRefMap::const_iterator it = file_refs_.find(
+      FileId(stamp.volume_serial_number, stamp.file_index));
+  if (it == file_refs_.end() || it->second.digest.empty()) {
+    return false;
+  }
+
+  return IsSameStamp(it->second.stamp, stamp) && it->second.digest == digest;
+}
+
+bool PackageCacheIndex::HasFile(const FileStamp& stamp) const {
+  __mutexScope(lock_);
+
+  if (!stamp.file_index) {
+    return false;
+  }
+
+  return file_refs_.find(FileId(stamp.volume_serial_number,
+                                stamp.file_index)) != file_refs_.end();
+}
+
+HRESULT PackageCacheIndex::Record(const CString& filename,
+                                  const FileStamp& stamp,
+                                  const std::vector<uint8>& digest) {
+  return Record(filename, stamp, digest, STORAGE_PLAIN, std::vector<uint8>());
+}
+
+HRESULT PackageCacheIndex::Record(
+    const CString& filename,
+    const FileStamp& stamp,
+    const std::vector<uint8>& digest,
+    Storage storage,
+    const std::vector<uint8>& compressed_digest) {
+  __mutexScope(lock_);
+
+  ASSERT1(digest.empty() || digest.size() == SHA256_DIGEST_SIZE);
+  ASSERT1((storage == STORAGE_COMPRESSED) ==
+          (compressed_digest.size() == SHA256_DIGEST_SIZE));
+  ASSERT1(storage == STORAGE_PLAIN || !digest.empty());
+
+  CString name;
+  if (!MakeRelativeName(filename, &name) || name.IsEmpty() ||
+      static_cast<uint32>(name.GetLength()) > kMaxEntryNameLength) {
+    return E_INVALIDARG;
+  }
+
+  Entry entry;
+  entry.stamp = stamp;
+  entry.digest = digest;
+  entry.storage = storage;
+  entry.compressed_digest = compressed_digest;
+  ::GetSystemTimeAsFileTime(&entry.last_used_time);
+  ApplyRecord(name, entry);
+
+  std::vector<uint8> record(1, static_cast<uint8>(JOURNAL_RECORD));
+  AppendEntry(name,
+              entry.stamp,
+              entry.last_used_time,
+              entry.digest,
+              entry.storage,
+              entry.compressed_digest,
+              &record);
+  return Journal(record);
+}
+
+PackageCacheIndex::Storage PackageCacheIndex::GetStorage(
+    const CString& filename,
+    std::vector<uint8>* digest,
+    std::vector<uint8>* compressed_digest) const {
+  __mutexScope(lock_);
+
+  ASSERT1(digest);
+  ASSERT1(compressed_digest);
+  digest->clear();
+  compressed_digest->clear();
+
+  CString name;
+  if (!MakeRelativeName(filename, &name)) {
+    return STORAGE_PLAIN;
+  }
+
+  EntryMap::const_iterator it = entries_.find(name);
+  if (it == entries_.end()) {
+    return STORAGE_PLAIN;
+  }
+
+  *digest = it->second.digest;
+  *compressed_digest = it->second.compressed_digest;
+  return it->second.storage;
+}
+
+HRESULT PackageCacheIndex::Touch(const CString& filename) {
+  __mutexScope(lock_);
+
+  CString name;
+  if (!MakeRelativeName(filename, &name)) {
+    return E_INVALIDARG;
+  }
+  if (entries_.find(name) == entries_.end()) {
+    return S_FALSE;
+  }
+
+  FILETIME now = {0};
+  ::GetSystemTimeAsFileTime(&now);
+  ApplyTouch(name, now);
+
+  std::vector<uint8> record(1, static_cast<uint8>(JOURNAL_TOUCH));
+  AppendString(name, &record);
+  AppendFileTime(now, &record);
+  return Journal(record);
+}
+
+HRESULT PackageCacheIndex::Remove(const CString& path) {
+  return Remove(path, NULL);
+}
+
+HRESULT PackageCacheIndex::Remove(
+    const CString& path,
+    std::vector<std::vector<uint8> >* released_digests) {
+  __mutexScope(lock_);
+
+  CString name;
+  if (!MakeRelativeName(path, &name)) {
+    return E_INVALIDARG;
+  }
+
+  ApplyRemove(name, released_digests);
+
+  std::vector<uint8> record(1, static_cast<uint8>(JOURNAL_REMOVE));
+  AppendString(name, &record);
+  return Journal(record);
+}
+
+void PackageCacheIndex::GetFilesToPurge(uint64 size_limit,
+                                        const FILETIME& expiration_time,
+                                        std::vector<CString>* filenames) const {
+  __mutexScope(lock_);
+
+  ASSERT1(filenames);
+  filenames->clear();
+
+  // Only the least recently used files are visited, and the walk stops at the
+  // first file that can stay. The space of a file with several names is only
+  // freed along with its last name.
+  std::map<FileId, int> purged_refs;
+  uint64 remaining_size = total_size_;
+  for (LruList::const_reverse_iterator it = lru_list_.rbegin();
+       it != lru_list_.rend();
+       ++it) {
+    const Entry& entry = entries_.find(*it)->second;
+    if (remaining_size <= size_limit &&
+        ::CompareFileTime(&entry.last_used_time, &expiration_time) >= 0) {
+      break;
+    }
+    filenames->push_back(ConcatenatePath(cache_root_, *it));
+
+    if (!entry.stamp.file_index) {
+      remaining_size -= entry.stamp.size;
+      continue;
+    }
+    const FileId file_id(entry.stamp.volume_serial_number,
+                         entry.stamp.file_index);
+    const FileRef& file_ref = file_refs_.find(file_id)->second;
+    if (++purged_refs[file_id] == file_ref.ref_count) {
+      remaining_size -= file_ref.size;
+    }
+  }
+}
+
+void PackageCacheIndex::GetColdFiles(const FILETIME& cold_time,
+                                     std::vector<ColdFile>* cold_files) const {
+  __mutexScope(lock_);
+
+  ASSERT1(cold_files);
+  cold_files->clear();
+
+  // Names with a zero file index are files of their own. The other names are
+  // grouped by file, which is only cold if all its names are visited, that
+  // is, none of them was used since |cold_time|.
+  std::map<FileId, size_t> positions;
+  std::vector<ColdFile> files;
+  std::vector<int> unvisited_names;
+  std::vector<bool> is_cold;
+  for (LruList::const_reverse_iterator it = lru_list_.rbegin();
+       it != lru_list_.rend();
+       ++it) {
+    const Entry& entry = entries_.find(*it)->second;
+    if (::CompareFileTime(&entry.last_used_time, &cold_time) >= 0) {
+      break;
+    }
+
+    size_t position = files.size();
+    int ref_count = 1;
+    if (entry.stamp.file_index) {
+      const FileId file_id(entry.stamp.volume_serial_number,
+                           entry.stamp.file_index);
+      position = positions.insert(std::make_pair(file_id, position))
+                     .first->second;
+      ref_count = file_refs_.find(file_id)->second.ref_count;
+    }
+
+    if (position == files.size()) {
+      files.push_back(ColdFile());
+      files.back().digest = entry.digest;
+      unvisited_names.push_back(ref_count);
+      is_cold.push_back(true);
+    }
+
+    files[position].filenames.push_back(ConcatenatePath(cache_root_, *it));
+    --unvisited_names[position];
+    if (entry.digest.empty() ||
+        entry.storage != STORAGE_PLAIN ||
+        entry.digest != files[position].digest) {
+      is_cold[position] = false;
+    }
+  }
+
+  for (size_t i = 0; i != files.size(); ++i) {
+    if (is_cold[i] && !unvisited_names[i]) {
+      cold_files->push_back(files[i]);
+    }
+  }
+}
+
+size_t PackageCacheIndex::size() const {
+  __mutexScope(lock_);
+  return entries_.size();
+}
+
+uint64 PackageCacheIndex::total_size() const {
+  __mutexScope(lock_);
+  return total_size_;
+}
+
+void PackageCacheIndex::Clear() {
+  __mutexScope(lock_);
+
+  entries_.clear();
+  lru_list_.clear();
+  file_refs_.clear();
+  total_size_ = 0;
+}
+
+HRESULT PackageCacheIndex::GetFileStamp(const CString& filename,
+                                        FileStamp* stamp) {
+  ASSERT1(stamp);
+
+  scoped_hfile file(::CreateFile(filename,
+                                 FILE_READ_ATTRIBUTES,
+                                 FILE_SHARE_READ | FILE_SHARE_WRITE |
+                                     FILE_SHARE_DELETE,
+                                 NULL,
+                                 OPEN_EXISTING,
+                                 FILE_ATTRIBUTE_NORMAL,
+                                 NULL));
+  if (!file) {
+    return HRESULTFromLastError();
+  }
+
+  BY_HANDLE_FILE_INFORMATION info = {0};
+  if (!::GetFileInformationByHandle(get(file), &info)) {
+    return HRESULTFromLastError();
+  }
+
+  ULARGE_INTEGER size = {0};
+  size.LowPart = info.nFileSizeLow;
+  size.HighPart = info.nFileSizeHigh;
+  ULARGE_INTEGER file_index = {0};
+  file_index.LowPart = info.nFileIndexLow;
+  file_index.HighPart = info.nFileIndexHigh;
+
+  stamp->size = size.QuadPart;
+  stamp->last_write_time = info.ftLastWriteTime;
+  stamp->volume_serial_number = info.dwVolumeSerialNumber;
+  stamp->file_index = file_index.QuadPart;
+  return S_OK;
+}
+
+bool PackageCacheIndex::MakeRelativeName(const CString& path,
+                                         CString* name) const {
+  ASSERT1(name);
+  if (cache_root_.IsEmpty()) {
+    return false;
+  }
+
+  CString lower_path(path);
+  lower_path.MakeLower();
+  lower_path.TrimRight(_T('\\'));
+
+  if (lower_path == cache_root_) {
+    name->Empty();
+    return true;
+  }
+
+  const CString root_prefix = cache_root_ + _T("\\");
+  if (lower_path.Left(root_prefix.GetLength()) != root_prefix) {
+    return false;
+  }
+
+  *name = lower_path.Mid(root_prefix.GetLength());
+  return true;
+}
+
+void PackageCacheIndex::ApplyRecord(const CString& name, const Entry& entry) {
+  EntryMap::iterator it = entries_.find(name);
+  if (it == entries_.end()) {
+    InsertFront(name, entry);
+    return;
+  }
+
+  ReleaseFileRef(it->second, NULL);
+  it->second.stamp = entry.stamp;
+  it->second.digest = entry.digest;
+  it->second.storage = entry.storage;
+  it->second.compressed_digest = entry.compressed_digest;
+  AddFileRef(it->second);
+}
+
+void PackageCacheIndex::ApplyTouch(const CString& name, const FILETIME& time) {
+  EntryMap::iterator it = entries_.find(name);
+  if (it == entries_.end()) {
+    return;
+  }
+
+  it->second.last_used_time = time;
+  lru_list_.splice(lru_list_.begin(), lru_list_, it->second.lru_position);
+}
+
+void PackageCacheIndex::ApplyRemove(
+    const CString& name,
+    std::vector<std::vector<uint8> >* released_digests) {
+  if (name.IsEmpty()) {
+    while (!entries_.empty()) {
+      Erase(entries_.begin(), released_digests);
+    }
+    return;
+  }
+
+  EntryMap::iterator it = entries_.find(name);
+  if (it != entries_.end()) {
+    Erase(it, released_digests);
+  }
+
+  const CString dir_prefix = name + _T("\\");
+  it = entries_.lower_bound(dir_prefix);
+  while (it != entries_.end() &&
+         it->first.Left(dir_prefix.GetLength()) == dir_prefix) {
+    Erase(it++, released_digests);
+  }
+}
+
+void PackageCacheIndex::InsertFront(const CString& name, const Entry& entry) {
+  ASSERT1(entries_.find(name) == entries_.end());
+
+  lru_list_.push_front(name);
+  Entry& new_entry = entries_[name];
+  new_entry = entry;
+  new_entry.lru_position = lru_list_.begin();
+  AddFileRef(new_entry);
+}
+
+void PackageCacheIndex::Erase(
+    EntryMap::iterator it,
+    std::vector<std::vector<uint8> >* released_digests) {
+  ReleaseFileRef(it->second, released_digests);
+  lru_list_.erase(it->second.lru_position);
+  entries_.erase(it);
+}
+
+void PackageCacheIndex::AddFileRef(const Entry& entry) {
+  if (!entry.stamp.file_index) {
+    total_size_ += entry.stamp.size;
+    return;
+  }
+
+  FileRef& file_ref = file_refs_[FileId(entry.stamp.volume_serial_number,
+                                        entry.stamp.file_index)];
+  if (file_ref.ref_count++ == 0) {
+    file_ref.size = entry.stamp.size;
+    total_size_ += file_ref.size;
+  }
+  if (!entry.digest.empty()) {
+    file_ref.stamp = entry.stamp;
+    file_ref.digest = entry.digest;
+  }
+}
+
+void PackageCacheIndex::ReleaseFileRef(
+    const Entry& entry,
+    std::vector<std::vector<uint8> >* released_digests) {
+  if (!entry.stamp.file_index) {
+    ASSERT1(total_size_ >= entry.stamp.size);
+    total_size_ -= entry.stamp.size;
+    if (released_digests && !entry.digest.empty()) {
+      released_digests->push_back(entry.digest);
+    }
+    return;
+  }
+
+  FileRefMap::iterator it = file_refs_.find(
+      FileId(entry.stamp.volume_serial_number, entry.stamp.file_index));
+  ASSERT1(it != file_refs_.end());
+  if (--it->second.ref_count) {
+    return;
+  }
+
+  ASSERT1(total_size_ >= it->second.size);
+  total_size_ -= it->second.size;
+  if (released_digests && !it->second.digest.empty()) {
+    released_digests->push_back(it->second.digest);
+  }
+  file_refs_.erase(it);
+}
+
+HRESULT PackageCacheIndex::Journal(const std::vector<uint8>& record) {
+  // An empty cache has no index files, so that it takes no space at all.
+  if (entries_.empty()) {
+    return WriteSnapshot();
+  }
+
+  const CString journal_file = ConcatenatePath(cache_root_, kJournalFileName);
+  HANDLE handle = ::CreateFile(journal_file,
+                               FILE_APPEND_DATA,
+                               FILE_SHARE_READ,
+                               NULL,
+                               OPEN_ALWAYS,
+                               FILE_ATTRIBUTE_NORMAL,
+                               NULL);
+  const bool is_new_journal = ::GetLastError() != ERROR_ALREADY_EXISTS;
+  scoped_hfile file(handle);
+  if (!file) {
+    HRESULT hr = HRESULTFromLastError();
+    CORE_LOG(LW, (_T("[failed to open cache index journal][0x%08x]"), hr));
+    return WriteSnapshot();
+  }
+
+  std::vector<uint8> buffer;
+  if (is_new_journal) {
+    AppendUint32(kJournalMagic, &buffer);
+    AppendUint32(kIndexVersion, &buffer);
+    AppendUint32(generation_, &buffer);
+  }
+
+  uint8 checksum[SHA256_DIGEST_SIZE] = {0};
+  SHA256_hash(&record.front(), record.size(), checksum);
+  AppendUint32(static_cast<uint32>(record.size()), &buffer);
+  AppendBytes(&record.front(), record.size(), &buffer);
+  AppendBytes(checksum, kJournalChecksumSize, &buffer);
+
+  // The record is written with a single call, so that a crash leaves at most
+  // one partial record at the end of the journal.
+  DWORD bytes_written = 0;
+  if (!::WriteFile(get(file),
+                   &buffer.front(),
+                   static_cast<DWORD>(buffer.size()),
+                   &bytes_written,
+                   NULL) ||
+      bytes_written != buffer.size()) {
+    HRESULT hr = HRESULTFromLastError();
+    CORE_LOG(LW, (_T("[failed to write cache index journal][0x%08x]"), hr));
+    reset(file);
+    return WriteSnapshot();
+  }
+
+  ++journal_records_;
+  if (journal_records_ >= kMinJournalRecordsToCompact &&
+      journal_records_ >= entries_.size()) {
+    reset(file);
+    return WriteSnapshot();
+  }
+
+  return S_OK;
+}
+
+HRESULT PackageCacheIndex::WriteSnapshot() {
+  const CString index_file = ConcatenatePath(cache_root_, kIndexFileName);
+  const CString journal_file = ConcatenatePath(cache_root_, kJournalFileName);
+  journal_records_ = 0;
+
+  if (entries_.empty()) {
+    HRESULT hr = DeleteFileIfExists(index_file);
+    HRESULT hr_journal = DeleteFileIfExists(journal_file);
+    return FAILED(hr) ? hr : hr_journal;
+  }
+
+  ++generation_;
+  std::vector<uint8> buffer;
+  Serialize(&buffer);
+
+  // Replace the snapshot atomically so that a crash never leaves a partial
+  // file. Until the journal is deleted, its generation no longer matches.
+  const CString temp_file = index_file + _T(".tmp");
+  HRESULT hr = WriteEntireFile(temp_file, buffer);
+  if (FAILED(hr)) {
+    CORE_LOG(LW, (_T("[failed to write cache index][0x%08x]"), hr));
+    return hr;
+  }
+
+  hr = File::Move(temp_file, index_file, true);
+  if (FAILED(hr)) {
+    CORE_LOG(LW, (_T("[failed to replace cache index][0x%08x]"), hr));
+    VERIFY1(::DeleteFile(temp_file));
+    return hr;
+  }
+
+  return DeleteFileIfExists(journal_file);
+}
+
+bool PackageCacheIndex::ReplayJournal() {
+  const CString journal_file = ConcatenatePath(cache_root_, kJournalFileName);
+
+  std::vector<uint8> buffer;
+  if (FAILED(ReadEntireFileShareMode(journal_file,
+                                     kMaxIndexFileSize,
+                                     FILE_SHARE_READ,
+                                     &buffer)) ||
+      buffer.empty()) {
+    return false;
+  }
+
+  BufferReader reader(&buffer.front(), buffer.size());
+  uint32 magic = 0;
+  uint32 version = 0;
+  uint32 generation = 0;
+  if (!reader.ReadUint32(&magic) || magic != kJournalMagic ||
+      !reader.ReadUint32(&version) || version != kIndexVersion ||
+      !reader.ReadUint32(&generation) || generation != generation_) {
+    return false;
+  }
+
+  while (reader.remaining()) {
+    uint32 record_size = 0;
+    if (!reader.ReadUint32(&record_size) || record_size == 0 ||
+        record_size > reader.remaining()) {
+      return false;
+    }
+
+    std::vector<uint8> record(record_size);
+    uint8 expected_checksum[kJournalChecksumSize] = {0};
+    uint8 checksum[SHA256_DIGEST_SIZE] = {0};
+    if (!reader.ReadBytes(&record.front(), record_size) ||
+        !reader.ReadBytes(expected_checksum, sizeof(expected_checksum))) {
+      return false;
+    }
+    SHA256_hash(&record.front(), record.size(), checksum);
+    if (memcmp(checksum, expected_checksum, sizeof(expected_checksum)) != 0 ||
+        !ApplyJournalRecord(record)) {
+      return false;
+    }
+
+    ++journal_records_;
+  }
+
+  return true;
+}
+
+bool PackageCacheIndex::ApplyJournalRecord(const std::vector<uint8>& record) {
+  BufferReader reader(&record.front(), record.size());
+  uint8 operation = 0;
+  if (!reader.ReadUint8(&operation)) {
+    return false;
+  }
+
+  CString name;
+  switch (operation) {
+    case JOURNAL_RECORD: {
+      Entry entry;
+      if (!ReadEntry(&reader,
+                     &name,
+                     &entry.stamp,
+                     &entry.last_used_time,
+                     &entry.digest,
+                     &entry.storage,
+                     &entry.compressed_digest)) {
+        return false;
+      }
+      ApplyRecord(name, entry);
+      break;
+    }
+    case JOURNAL_TOUCH: {
+      FILETIME time = {0};
+      if (!reader.ReadString(&name, kMaxEntryNameLength) ||
+          !ReadFileTime(&reader, &time)) {
+        return false;
+      }
+      ApplyTouch(name, time);
+      break;
+    }
+    case JOURNAL_REMOVE:
+      if (!reader.ReadString(&name, kMaxEntryNameLength)) {
+        return false;
+      }
+      ApplyRemove(name, NULL);
+      break;
+    default:
+      return false;
+  }
+
+  return reader.remaining() == 0;
+}
+
+void PackageCacheIndex::Rebuild() {
+  HighresTimer rebuild_timer;
+  Clear();
+
+  std::vector<internal::PackageInfo> packages_info;
+  if (SUCCEEDED(internal::FindAllPackagesInfo(cache_root_, &packages_info))) {
+    // The packages are sorted from the newest to the oldest one, and each one
+    // is inserted in front of the ones before it.
+    internal::SortPackageInfoByTime(&packages_info);
+    for (std::vector<internal::PackageInfo>::const_reverse_iterator it =
+             packages_info.rbegin();
+         it != packages_info.rend();
+         ++it) {
+      CString name;
+      if (!MakeRelativeName(it->file_name, &name) || name.IsEmpty() ||
+          entries_.find(name) != entries_.end()) {
+        continue;
+      }
+
+      // The file is hashed again the first time it is used. Its stamp tells
+      // which names are links to the same file.
+      Entry entry;
+      if (FAILED(GetFileStamp(it->file_name, &entry.stamp))) {
+        entry.stamp = FileStamp();
+        entry.stamp.size = it->file_size.QuadPart;
+      }
+      entry.last_used_time = it->file_time;
+      InsertFront(name, entry);
+    }
+  }
+
+  CORE_LOG(L2, (_T("[PackageCacheIndex::Rebuild][%Iu entries][%d ms]"),
+                entries_.size(), rebuild_timer.GetElapsedMs()));
+  WriteSnapshot();
+}
+
+void PackageCacheIndex::SetLastUsedTime(const CString& filename,
+                                        const FILETIME& time) {
+  __mutexScope(lock_);
+
+  CString name;
+  VERIFY1(MakeRelativeName(filename, &name));
+  EntryMap::iterator it = entries_.find(name);
+  if (it == entries_.end()) {
+    return;
+  }
+
+  it->second.last_used_time = time;
+  lru_list_.erase(it->second.lru_position);
+
+  LruList::iterator position = lru_list_.begin();
+  while (position != lru_list_.end() &&
+         ::CompareFileTime(&entries_.find(*position)->second.last_used_time,
+                           &time) >= 0) {
+    ++position;
+  }
+  it->second.lru_position = lru_list_.insert(position, name);
+}
+
+void PackageCacheIndex::Serialize(std::vector<uint8>* buffer) const {
+  ASSERT1(buffer);
+  buffer->clear();
+
+  AppendUint32(kIndexMagic, buffer);
+  AppendUint32(kIndexVersion, buffer);
+  AppendUint32(generation_, buffer);
+  AppendUint32(static_cast<uint32>(entries_.size()), buffer);
+
+  for (LruList::const_iterator it = lru_list_.begin();
+       it != lru_list_.end();
+       ++it) {
+    const Entry& entry = entries_.find(*it)->second;
+    AppendEntry(*it,
+                entry.stamp,
+                entry.last_used_time,
+                entry.digest,
+                entry.storage,
+                entry.compressed_digest,
+                buffer);
+  }
+
+  uint8 checksum[SHA256_DIGEST_SIZE] = {0};
+  SHA256_hash(&buffer->front(), buffer->size(), checksum);
+  AppendBytes(checksum, sizeof(checksum), buffer);
+}
+
+bool PackageCacheIndex::Deserialize(const std::vector<uint8>& buffer) {
+  Clear();
+
+  if (buffer.size() < SHA256_DIGEST_SIZE) {
+    return false;
+  }
+
+  const size_t payload_size = buffer.size() - SHA256_DIGEST_SIZE;
+  uint8 checksum[SHA256_DIGEST_SIZE] = {0};
+  SHA256_hash(&buffer.front(), payload_size, checksum);
+  if (memcmp(checksum, &buffer[payload_size], SHA256_DIGEST_SIZE) != 0) {
+    return false;
+  }
+
+  BufferReader reader(&buffer.front(), payload_size);
+  uint32 magic = 0;
+  uint32 version = 0;
+  uint32 count = 0;
+  if (!reader.ReadUint32(&magic) || magic != kIndexMagic ||
+      !reader.ReadUint32(&version) || version != kIndexVersion ||
+      !reader.ReadUint32(&generation_) ||
+      !reader.ReadUint32(&count)) {
+    return false;
+  }
+
+  for (uint32 i = 0; i < count; ++i) {
+    CString name;
+    Entry entry;
+    if (!ReadEntry(&reader,
+                   &name,
+                   &entry.stamp,
+                   &entry.last_used_time,
+                   &entry.digest,
+                   &entry.storage,
+                   &entry.compressed_digest) ||
+        entries_.find(name) != entries_.end()) {
+      Clear();
+      return false;
+    }
+
+    // Entries are stored from the most recently used one.
+    lru_list_.push_back(name);
+    Entry& new_entry = entries_[name];
+    new_entry = entry;
+    new_entry.lru_position = --lru_list_.end();
+    AddFileRef(new_entry);
+  }
+
+  if (reader.remaining() != 0) {
+    Clear();
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace omaha
@@ -0,0 +1,277 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Index of the package cache. The index tracks every cached file, the total
+// size of the cache, and the order in which the files were last used, so that
+// the cache can be sized and purged without walking its directory tree.
+//
+// For each cached file whose hash has been verified, the index also records
+// the SHA-256 along with the size, the last write time, and the file id the
+// file had when it was hashed. As long as the file still has the same
+// metadata, the recorded hash can be trusted without reading the file again.
+//
+// A package that has not been used for a while may be stored compressed, in
+// which case the index also records the SHA-256 of the compressed file.
+//
+// Several names may be hard links to the same file. Such a file is counted
+// once in the size of the cache, and is only freed once all its names are
+// removed.
+//
+// The index is safe to use from several threads.
+//
+// The index is persisted as a snapshot and a journal. Changes are appended to
+// the journal, which is folded into a new snapshot once it grows larger than
+// the index itself. If both files are missing or the snapshot is corrupt, the
+// index is rebuilt from the files in the cache.
+
+#ifndef OMAHA_GOOPDATE_PACKAGE_CACHE_INDEX_H_
+#define OMAHA_GOOPDATE_PACKAGE_CACHE_INDEX_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include <list>
+#include <map>
+#include <utility>
+#include <vector>
+#include "base/basictypes.h"
+#include "base/synchronized.h"
+
+namespace omaha {
+
+class PackageCacheIndex {
+ public:
+  // Identifies a version of a file on disk. Any write to the file or
+  // replacement of the file changes at least one of the members.
+  struct FileStamp {
+    FileStamp()
+        : size(0),
+          volume_serial_number(0),
+          file_index(0) {
+      last_write_time.dwLowDateTime = 0;
+      last_write_time.dwHighDateTime = 0;
+    }
+
+    uint64 size;
+    FILETIME last_write_time;
+    DWORD volume_serial_number;
+    uint64 file_index;
+  };
+
+  // How a package is stored in its cached file.
+  enum Storage {
+    // The file is the package.
+    STORAGE_PLAIN = 0,
+
+    // The file is the package compressed with LZMA.
+    STORAGE_COMPRESSED,
+
+    // The file is the package, which does not compress well enough to be
+    // worth compressing.
+    STORAGE_INCOMPRESSIBLE,
+  };
+
+  // All the names of a file that is stored plain and not used since a given
+  // time. See GetColdFiles.
+  struct ColdFile {
+    std::vector<uint8> digest;
+    std::vector<CString> filenames;
+  };
+
+  // The names of the snapshot and of the journal in the cache root directory.
+  static const TCHAR* const kIndexFileName;
+  static const TCHAR* const kJournalFileName;
+
+  PackageCacheIndex();
+  ~PackageCacheIndex();
+
+  // Loads the index of the cache in |cache_root|, rebuilding it from the
+  // cached files if the index is missing or corrupt. Returns S_FALSE if the
+  // index was rebuilt.
+  HRESULT Load(const CString& cache_root);
+
+  // Returns true if |filename| was recorded with |digest| and its current
+  // |stamp| is the same as the recorded one.
+  bool IsVerified(const CString& filename,
+                  const FileStamp& stamp,
+                  const std::vector<uint8>& digest) const;
+
+  // Returns true if the file with |stamp| was recorded with |digest| under
+  // any of its names. This verifies a file that is not itself in the index
+  // but is a hard link to a file that is.
+  bool IsFileVerified(const FileStamp& stamp,
+                      const std::vector<uint8>& digest) const;
+
+  // Returns true if any name in the index is the file with |stamp|, verified
+  // or not. Only the file id in |stamp| is compared.
+  bool HasFile(const FileStamp& stamp) const;
+
+  // Records that |filename| with |stamp| hashes to |digest|. A file that is
+  // not in the index yet is added as the most recently used one.
+  HRESULT Record(const CString& filename,
+                 const FileStamp& stamp,
+                 const std::vector<uint8>& digest);
+
+  // Same as above, for a file stored as |storage|. |compressed_digest| is
+  // the SHA-256 of a compressed file, and empty otherwise.
+  HRESULT Record(const CString& filename,
+                 const FileStamp& stamp,
+                 const std::vector<uint8>& digest,
+                 Storage storage,
+                 const std::vector<uint8>& compressed_digest);
+
+  // Returns how |filename| is stored. |digest| receives the recorded SHA-256
+  // of the package and |compressed_digest| that of the file if it is
+  // compressed. Files that are not in the index are stored plain.
+  Storage GetStorage(const CString& filename,
+                     std::vector<uint8>* digest,
+                     std::vector<uint8>* compressed_digest) const;
+
+  // Marks |filename| as the most recently used file.
+  HRESULT Touch(const CString& filename);
+
+  // Removes the entries for |path| and, if it is a directory, all the files
+  // under it.
+  HRESULT Remove(const CString& path);
+
+  // Same as above. |released_digests| receives the digests of the verified
+  // files whose last name in the index was removed.
+  HRESULT Remove(const CString& path,
+                 std::vector<std::vector<uint8> >* released_digests);
+
+  // Returns the files to purge, least recently used first, so that the
+  // remaining ones add up to at most |size_limit| bytes and none of them was
+  // last used before |expiration_time|. Purging one of several names of a
+  // file frees no space.
+  void GetFilesToPurge(uint64 size_limit,
+                       const FILETIME& expiration_time,
+                       std::vector<CString>* filenames) const;
+
+  // Returns the verified files stored plain whose names were all last used
+  // before |cold_time|, least recently used first.
+  void GetColdFiles(const FILETIME& cold_time,
+                    std::vector<ColdFile>* cold_files) const;
+
+  // Forgets all entries without touching the index files.
+  void Clear();
+
+  size_t size() const;
+
+  // Returns the sum of the sizes of the files in the index, counting the
+  // files with several names once.
+  uint64 total_size() const;
+
+  // Returns the current stamp of |filename|.
+  static HRESULT GetFileStamp(const CString& filename, FileStamp* stamp);
+
+ private:
+  // Files are ordered from the most to the least recently used one.
+  typedef std::list<CString> LruList;
+
+  struct Entry {
+    Entry() : storage(STORAGE_PLAIN) {
+      last_used_time.dwLowDateTime = 0;
+      last_used_time.dwHighDateTime = 0;
+    }
+
+    FileStamp stamp;
+    FILETIME last_used_time;
+    std::vector<uint8> digest;  // Empty until the file is verified.
+    Storage storage;
+    std::vector<uint8> compressed_digest;
+    LruList::iterator lru_position;
+  };
+
+  // Entries are keyed by the lower case path relative to the cache root.
+  typedef std::map<CString, Entry> EntryMap;
+
+  // Files are identified by their volume serial number and file index. Names
+  // with a zero file index are counted as separate files.
+  typedef std::pair<DWORD, uint64> FileId;
+
+  struct FileRef {
+    FileRef() : ref_count(0), size(0) {}
+
+    int ref_count;
+    uint64 size;
+
+    // The stamp and digest of the last name verified for the file.
+    FileStamp stamp;
+    std::vector<uint8> digest;
+  };
+
+  typedef std::map<FileId, FileRef> FileRefMap;
+
+  // Returns false if |path| is not under the cache root.
+  bool MakeRelativeName(const CString& path, CString* name) const;
+
+  // Applies a change to the in-memory index. These are used both for new
+  // changes and when replaying the journal.
+  void ApplyRecord(const CString& name, const Entry& entry);
+  void ApplyTouch(const CString& name, const FILETIME& time);
+  void ApplyRemove(const CString& name,
+                   std::vector<std::vector<uint8> >* released_digests);
+  void InsertFront(const CString& name, const Entry& entry);
+  void Erase(EntryMap::iterator it,
+             std::vector<std::vector<uint8> >* released_digests);
+
+  // Counts a name of the file of |entry| and adds the file to the total size
+  // if it is its first name.
+  void AddFileRef(const Entry& entry);
+  void ReleaseFileRef(const Entry& entry,
+                      std::vector<std::vector<uint8> >* released_digests);
+
+  // Appends |record| to the journal, and compacts the journal when it grows
+  // too large or cannot be written.
+  HRESULT Journal(const std::vector<uint8>& record);
+
+  // Writes the whole index as a new snapshot and deletes the journal.
+  HRESULT WriteSnapshot();
+
+  // Replays the journal. Returns false if the journal ends with a partial or
+  // corrupt record.
+  bool ReplayJournal();
+
+  // Recreates the index from the files found in the cache.
+  void Rebuild();
+
+  // Sets the last used time of |filename| and moves it so that the files stay
+  // ordered by last used time. Only for tests that age entries.
+  void SetLastUsedTime(const CString& filename, const FILETIME& time);
+
+  void Serialize(std::vector<uint8>* buffer) const;
+  bool Deserialize(const std::vector<uint8>& buffer);
+  bool ApplyJournalRecord(const std::vector<uint8>& record);
+
+  CString cache_root_;
+  EntryMap entries_;
+  LruList lru_list_;
+  FileRefMap file_refs_;
+  uint64 total_size_;
+
+  // Incremented by each snapshot. A journal applies only to the snapshot with
+  // the same generation; an older journal is already part of the snapshot.
+  uint32 generation_;
+  size_t journal_records_;
+
+  LLock lock_;
+
+  friend class PackageCacheTest;
+
+  DISALLOW_COPY_AND_ASSIGN(PackageCacheIndex);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_GOOPDATE_PACKAGE_CACHE_INDEX_H_
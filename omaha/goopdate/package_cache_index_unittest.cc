@@ -0,0 +1,448 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/goopdate/package_cache_index.h"
+
+#include <vector>
+
+#include "omaha/base/constants.h"
+#include "omaha/base/file.h"
+#include "omaha/base/path.h"
+#include "omaha/base/time.h"
+#include "omaha/base/utils.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+class PackageCacheIndexTest : public testing::Test {
+ protected:
+  PackageCacheIndexTest() : cache_root_(GetUniqueTempDirectoryName()) {
+    digest1_.assign(32, 0x11);
+    digest2_.assign(32, 0x22);
+
+    stamp1_.size = 100;
+    stamp1_.last_write_time.dwLowDateTime = 1;
+    stamp1_.last_write_time.dwHighDateTime = 2;
+    stamp1_.volume_serial_number = 3;
+    stamp1_.file_index = 4;
+  }
+
+  virtual void SetUp() {
+    ASSERT_FALSE(cache_root_.IsEmpty());
+    ASSERT_HRESULT_SUCCEEDED(CreateDir(cache_root_, NULL));
+    index_.Load(cache_root_);
+  }
+
+  virtual void TearDown() {
+    EXPECT_HRESULT_SUCCEEDED(DeleteDirectory(cache_root_));
+  }
+
+  CString CacheFile(const TCHAR* name) const {
+    return ConcatenatePath(cache_root_, name);
+  }
+
+  CString IndexFile() const {
+    return CacheFile(PackageCacheIndex::kIndexFileName);
+  }
+
+  CString JournalFile() const {
+    return CacheFile(PackageCacheIndex::kJournalFileName);
+  }
+
+  PackageCacheIndex::FileStamp Stamp(uint64 size, uint64 file_index) const {
+    PackageCacheIndex::FileStamp stamp(stamp1_);
+    stamp.size = size;
+    stamp.file_index = file_index;
+    return stamp;
+  }
+
+  // Returns a time later than any last used time recorded so far.
+  static FILETIME Tomorrow() {
+    FILETIME now = {0};
+    ::GetSystemTimeAsFileTime(&now);
+    ULARGE_INTEGER time = {0};
+    time.LowPart = now.dwLowDateTime;
+    time.HighPart = now.dwHighDateTime;
+    time.QuadPart += kSecsTo100ns * kSecondsPerDay;
+
+    FILETIME tomorrow = {0};
+    tomorrow.dwLowDateTime = time.LowPart;
+    tomorrow.dwHighDateTime = time.HighPart;
+    return tomorrow;
+  }
+
+  const CString cache_root_;
+  std::vector<uint8> digest1_;
+  std::vector<uint8> digest2_;
+  PackageCacheIndex::FileStamp stamp1_;
+  PackageCacheIndex index_;
+};
+
+TEST_F(PackageCacheIndexTest, RecordAndVerify) {
+  const CString file = CacheFile(_T("app\\1.0\\setup.exe"));
+  EXPECT_FALSE(index_.IsVerified(file, stamp1_, digest1_));
+
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file, stamp1_, digest1_));
+  EXPECT_TRUE(index_.IsVerified(file, stamp1_, digest1_));
+
+  // Names are not case sensitive.
+  EXPECT_TRUE(index_.IsVerified(CacheFile(_T("APP\\1.0\\Setup.exe")),
+                                stamp1_,
+                                digest1_));
+
+  EXPECT_FALSE(index_.IsVerified(file, stamp1_, digest2_));
+
+  // Any change to the stamp makes the entry stale.
+  PackageCacheIndex::FileStamp stamp = stamp1_;
+  ++stamp.size;
+  EXPECT_FALSE(index_.IsVerified(file, stamp, digest1_));
+  stamp = stamp1_;
+  ++stamp.last_write_time.dwLowDateTime;
+  EXPECT_FALSE(index_.IsVerified(file, stamp, digest1_));
+  stamp = stamp1_;
+  ++stamp.volume_serial_number;
+  EXPECT_FALSE(index_.IsVerified(file, stamp, digest1_));
+  stamp = stamp1_;
+  ++stamp.file_index;
+  EXPECT_FALSE(index_.IsVerified(file, stamp, digest1_));
+
+  // Files outside of the cache root are never recorded.
+  EXPECT_EQ(E_INVALIDARG, index_.Record(_T("c:\\setup.exe"),
+                                        stamp1_,
+                                        digest1_));
+  EXPECT_FALSE(index_.IsVerified(_T("c:\\setup.exe"), stamp1_, digest1_));
+}
+
+TEST_F(PackageCacheIndexTest, Persistence) {
+  const CString file1 = CacheFile(_T("app\\1.0\\setup.exe"));
+  const CString file2 = CacheFile(_T("app\\1.0\\data.bin"));
+  const PackageCacheIndex::FileStamp stamp2(Stamp(stamp1_.size, 5));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file1, stamp1_, digest1_));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file2, stamp2, digest2_));
+
+  // Changes go to the journal until it is compacted.
+  EXPECT_FALSE(File::Exists(IndexFile()));
+  EXPECT_TRUE(File::Exists(JournalFile()));
+
+  PackageCacheIndex index;
+  index.Load(cache_root_ + _T("\\"));
+  EXPECT_EQ(2, index.size());
+  EXPECT_EQ(2 * stamp1_.size, index.total_size());
+  EXPECT_TRUE(index.IsVerified(file1, stamp1_, digest1_));
+  EXPECT_TRUE(index.IsVerified(file2, stamp2, digest2_));
+
+  // Removing the last entry removes the index files.
+  EXPECT_HRESULT_SUCCEEDED(index_.Remove(cache_root_));
+  EXPECT_EQ(0, index_.size());
+  EXPECT_EQ(0, index_.total_size());
+  EXPECT_FALSE(File::Exists(IndexFile()));
+  EXPECT_FALSE(File::Exists(JournalFile()));
+}
+
+TEST_F(PackageCacheIndexTest, JournalCompaction) {
+  const CString file1 = CacheFile(_T("app\\1.0\\setup.exe"));
+  const CString file2 = CacheFile(_T("app\\2.0\\setup.exe"));
+  const PackageCacheIndex::FileStamp stamp2(Stamp(stamp1_.size, 5));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file1, stamp1_, digest1_));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file2, stamp2, digest2_));
+
+  // Touching the files over and over eventually folds the journal into a
+  // snapshot, and then starts a new journal.
+  bool is_compacted = false;
+  for (int i = 0; i != 1000; ++i) {
+    EXPECT_HRESULT_SUCCEEDED(index_.Touch(i % 2 ? file1 : file2));
+    if (!File::Exists(JournalFile())) {
+      is_compacted = true;
+      EXPECT_TRUE(File::Exists(IndexFile()));
+    }
+  }
+  EXPECT_TRUE(is_compacted);
+  EXPECT_TRUE(File::Exists(JournalFile()));
+
+  // The last touch is file1, so file2 is the least recently used file.
+  PackageCacheIndex index;
+  index.Load(cache_root_);
+  EXPECT_EQ(2, index.size());
+  EXPECT_TRUE(index.IsVerified(file1, stamp1_, digest1_));
+  EXPECT_TRUE(index.IsVerified(file2, stamp2, digest2_));
+
+  std::vector<CString> files_to_purge;
+  index.GetFilesToPurge(stamp1_.size, FILETIME(), &files_to_purge);
+  ASSERT_EQ(1, files_to_purge.size());
+  EXPECT_STREQ(CString(file2).MakeLower(), files_to_purge[0]);
+}
+
+TEST_F(PackageCacheIndexTest, CorruptIndex) {
+  const CString file = CacheFile(_T("app\\1.0\\setup.exe"));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file, stamp1_, digest1_));
+
+  std::vector<byte> journal;
+  ASSERT_HRESULT_SUCCEEDED(ReadEntireFile(JournalFile(), 0, &journal));
+
+  // Flipping any byte of the only record, or of the journal header, loses the
+  // record.
+  for (size_t i = 0; i < journal.size(); i += 7) {
+    std::vector<byte> corrupt(journal);
+    corrupt[i] ^= 0x01;
+    ASSERT_HRESULT_SUCCEEDED(WriteEntireFile(JournalFile(), corrupt));
+
+    PackageCacheIndex index;
+    index.Load(cache_root_);
+    EXPECT_EQ(0, index.size()) << i;
+  }
+
+  // A partial record at the end of the journal is dropped, and the records
+  // before it are kept.
+  ASSERT_HRESULT_SUCCEEDED(WriteEntireFile(JournalFile(), journal));
+  index_.Load(cache_root_);
+  const CString file2 = CacheFile(_T("app\\2.0\\setup.exe"));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file2, stamp1_, digest2_));
+  ASSERT_HRESULT_SUCCEEDED(ReadEntireFile(JournalFile(), 0, &journal));
+  journal.resize(journal.size() - 1);
+  ASSERT_HRESULT_SUCCEEDED(WriteEntireFile(JournalFile(), journal));
+  {
+    PackageCacheIndex index;
+    index.Load(cache_root_);
+    EXPECT_EQ(1, index.size());
+    EXPECT_TRUE(index.IsVerified(file, stamp1_, digest1_));
+
+    // The damaged journal has been folded into a snapshot.
+    EXPECT_TRUE(File::Exists(IndexFile()));
+    EXPECT_FALSE(File::Exists(JournalFile()));
+  }
+
+  // Flipping any byte of the snapshot makes the index rebuilt from the cache,
+  // which has no files here.
+  std::vector<byte> snapshot;
+  ASSERT_HRESULT_SUCCEEDED(ReadEntireFile(IndexFile(), 0, &snapshot));
+  for (size_t i = 0; i < snapshot.size(); i += 7) {
+    std::vector<byte> corrupt(snapshot);
+    corrupt[i] ^= 0x01;
+    ASSERT_HRESULT_SUCCEEDED(WriteEntireFile(IndexFile(), corrupt));
+
+    PackageCacheIndex index;
+    index.Load(cache_root_);
+    EXPECT_EQ(0, index.size()) << i;
+  }
+}
+
+TEST_F(PackageCacheIndexTest, Remove) {
+  const CString file1 = CacheFile(_T("app\\1.0\\setup.exe"));
+  const CString file2 = CacheFile(_T("app\\2.0\\setup.exe"));
+  const CString file3 = CacheFile(_T("app-beta\\1.0\\setup.exe"));
+  const CString file4 = CacheFile(_T("app2\\1.0\\setup.exe"));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file1, stamp1_, digest1_));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file2, stamp1_, digest1_));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file3, stamp1_, digest1_));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file4, stamp1_, digest1_));
+
+  EXPECT_HRESULT_SUCCEEDED(index_.Remove(file1));
+  EXPECT_FALSE(index_.IsVerified(file1, stamp1_, digest1_));
+  EXPECT_EQ(3, index_.size());
+
+  // Removing a directory removes the files under it, and only those.
+  EXPECT_HRESULT_SUCCEEDED(index_.Remove(CacheFile(_T("app"))));
+  EXPECT_FALSE(index_.IsVerified(file2, stamp1_, digest1_));
+  EXPECT_TRUE(index_.IsVerified(file3, stamp1_, digest1_));
+  EXPECT_TRUE(index_.IsVerified(file4, stamp1_, digest1_));
+  EXPECT_EQ(2, index_.size());
+}
+
+TEST_F(PackageCacheIndexTest, GetFilesToPurge) {
+  const CString file1 = CacheFile(_T("app1\\1.0\\setup.exe"));
+  const CString file2 = CacheFile(_T("app2\\1.0\\setup.exe"));
+  const CString file3 = CacheFile(_T("app3\\1.0\\setup.exe"));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file1, Stamp(100, 1), digest1_));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file2, Stamp(200, 2), digest1_));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file3, Stamp(300, 3), digest1_));
+  EXPECT_EQ(600, index_.total_size());
+
+  // Recording a new stamp for a file adjusts the total without using it.
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file3, Stamp(400, 3), digest1_));
+  EXPECT_EQ(700, index_.total_size());
+
+  // file1 becomes the most recently used file.
+  EXPECT_HRESULT_SUCCEEDED(index_.Touch(file1));
+  EXPECT_EQ(S_FALSE, index_.Touch(CacheFile(_T("none"))));
+
+  const FILETIME kNoExpiration = {0};
+  std::vector<CString> files;
+  index_.GetFilesToPurge(700, kNoExpiration, &files);
+  EXPECT_TRUE(files.empty());
+
+  index_.GetFilesToPurge(500, kNoExpiration, &files);
+  ASSERT_EQ(1, files.size());
+  EXPECT_STREQ(CString(file2).MakeLower(), files[0]);
+
+  index_.GetFilesToPurge(100, kNoExpiration, &files);
+  ASSERT_EQ(2, files.size());
+  EXPECT_STREQ(CString(file2).MakeLower(), files[0]);
+  EXPECT_STREQ(CString(file3).MakeLower(), files[1]);
+
+  // Everything was used before tomorrow.
+  index_.GetFilesToPurge(700, Tomorrow(), &files);
+  EXPECT_EQ(3, files.size());
+
+  EXPECT_HRESULT_SUCCEEDED(index_.Remove(file2));
+  EXPECT_EQ(500, index_.total_size());
+  index_.GetFilesToPurge(400, kNoExpiration, &files);
+  ASSERT_EQ(1, files.size());
+  EXPECT_STREQ(CString(file3).MakeLower(), files[0]);
+}
+
+// Names that are hard links to the same file share its stamp.
+TEST_F(PackageCacheIndexTest, SharedFiles) {
+  const CString file1 = CacheFile(_T("app1\\1.0\\setup.exe"));
+  const CString file2 = CacheFile(_T("app2\\1.0\\setup.exe"));
+  const CString file3 = CacheFile(_T("app3\\1.0\\setup.exe"));
+  const PackageCacheIndex::FileStamp shared_stamp(Stamp(300, 1));
+  EXPECT_FALSE(index_.IsFileVerified(shared_stamp, digest1_));
+
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file1, shared_stamp, digest1_));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file2, Stamp(100, 2), digest2_));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file3, shared_stamp, digest1_));
+  EXPECT_EQ(3, index_.size());
+  EXPECT_EQ(400, index_.total_size());
+
+  EXPECT_TRUE(index_.IsFileVerified(shared_stamp, digest1_));
+  EXPECT_FALSE(index_.IsFileVerified(shared_stamp, digest2_));
+  PackageCacheIndex::FileStamp stamp(shared_stamp);
+  ++stamp.last_write_time.dwLowDateTime;
+  EXPECT_FALSE(index_.IsFileVerified(stamp, digest1_));
+
+  // Purging file1 alone frees nothing, so file2 has to go as well.
+  const FILETIME kNoExpiration = {0};
+  std::vector<CString> files;
+  index_.GetFilesToPurge(300, kNoExpiration, &files);
+  ASSERT_EQ(2, files.size());
+  EXPECT_STREQ(CString(file1).MakeLower(), files[0]);
+  EXPECT_STREQ(CString(file2).MakeLower(), files[1]);
+
+  index_.GetFilesToPurge(100, kNoExpiration, &files);
+  ASSERT_EQ(3, files.size());
+
+  // The file is released with its last name.
+  std::vector<std::vector<uint8> > released_digests;
+  EXPECT_HRESULT_SUCCEEDED(index_.Remove(file1, &released_digests));
+  EXPECT_TRUE(released_digests.empty());
+  EXPECT_EQ(400, index_.total_size());
+  EXPECT_TRUE(index_.IsFileVerified(shared_stamp, digest1_));
+
+  EXPECT_HRESULT_SUCCEEDED(index_.Remove(file3, &released_digests));
+  ASSERT_EQ(1, released_digests.size());
+  EXPECT_TRUE(digest1_ == released_digests[0]);
+  EXPECT_EQ(100, index_.total_size());
+  EXPECT_FALSE(index_.IsFileVerified(shared_stamp, digest1_));
+
+  // The sharing is restored when the index is loaded.
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file1, shared_stamp, digest1_));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file3, shared_stamp, digest1_));
+  PackageCacheIndex index;
+  index.Load(cache_root_);
+  EXPECT_EQ(400, index.total_size());
+  EXPECT_TRUE(index.IsFileVerified(shared_stamp, digest1_));
+
+  released_digests.clear();
+  EXPECT_HRESULT_SUCCEEDED(index.Remove(cache_root_, &released_digests));
+  EXPECT_EQ(2, released_digests.size());
+  EXPECT_EQ(0, index.total_size());
+}
+
+// A file is cold once all its names are, and only while it is stored plain.
+TEST_F(PackageCacheIndexTest, GetColdFiles) {
+  const CString file1 = CacheFile(_T("app1\\1.0\\setup.exe"));
+  const CString file2 = CacheFile(_T("app2\\1.0\\setup.exe"));
+  const CString file3 = CacheFile(_T("app3\\1.0\\setup.exe"));
+  const PackageCacheIndex::FileStamp shared_stamp(Stamp(300, 1));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file1, shared_stamp, digest1_));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file2, Stamp(100, 2), digest2_));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file3, shared_stamp, digest1_));
+
+  const FILETIME kNoColdTime = {0};
+  std::vector<PackageCacheIndex::ColdFile> cold_files;
+  index_.GetColdFiles(kNoColdTime, &cold_files);
+  EXPECT_TRUE(cold_files.empty());
+
+  index_.GetColdFiles(Tomorrow(), &cold_files);
+  ASSERT_EQ(2, cold_files.size());
+  EXPECT_TRUE(digest1_ == cold_files[0].digest);
+  ASSERT_EQ(2, cold_files[0].filenames.size());
+  EXPECT_STREQ(CString(file1).MakeLower(), cold_files[0].filenames[0]);
+  EXPECT_STREQ(CString(file3).MakeLower(), cold_files[0].filenames[1]);
+  EXPECT_TRUE(digest2_ == cold_files[1].digest);
+  ASSERT_EQ(1, cold_files[1].filenames.size());
+  EXPECT_STREQ(CString(file2).MakeLower(), cold_files[1].filenames[0]);
+
+  // The shared file is no longer cold once one of its names is compressed.
+  const PackageCacheIndex::FileStamp compressed_stamp(Stamp(30, 3));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(file1,
+                                         compressed_stamp,
+                                         digest1_,
+                                         PackageCacheIndex::STORAGE_COMPRESSED,
+                                         digest2_));
+  EXPECT_HRESULT_SUCCEEDED(index_.Record(
+      file2,
+      Stamp(100, 2),
+      digest2_,
+      PackageCacheIndex::STORAGE_INCOMPRESSIBLE,
+      std::vector<uint8>()));
+  index_.GetColdFiles(Tomorrow(), &cold_files);
+  ASSERT_EQ(1, cold_files.size());
+  EXPECT_STREQ(CString(file3).MakeLower(), cold_files[0].filenames[0]);
+
+  // The storage is persisted along with both digests.
+  PackageCacheIndex index;
+  index.Load(cache_root_);
+  std::vector<uint8> digest;
+  std::vector<uint8> compressed_digest;
+  EXPECT_EQ(PackageCacheIndex::STORAGE_COMPRESSED,
+            index.GetStorage(file1, &digest, &compressed_digest));
+  EXPECT_TRUE(digest1_ == digest);
+  EXPECT_TRUE(digest2_ == compressed_digest);
+  EXPECT_TRUE(index.IsVerified(file1, compressed_stamp, digest1_));
+  EXPECT_EQ(PackageCacheIndex::STORAGE_INCOMPRESSIBLE,
+            index.GetStorage(file2, &digest, &compressed_digest));
+  EXPECT_TRUE(compressed_digest.empty());
+  EXPECT_EQ(PackageCacheIndex::STORAGE_PLAIN,
+            index.GetStorage(file3, &digest, &compressed_digest));
+  EXPECT_EQ(PackageCacheIndex::STORAGE_PLAIN,
+            index.GetStorage(CacheFile(_T("none")),
+                             &digest,
+                             &compressed_digest));
+}
+
+TEST_F(PackageCacheIndexTest, GetFileStamp) {
+  const CString file = CacheFile(_T("file.bin"));
+  std::vector<byte> contents(10, 'a');
+  ASSERT_HRESULT_SUCCEEDED(WriteEntireFile(file, contents));
+
+  PackageCacheIndex::FileStamp stamp;
+  EXPECT_HRESULT_SUCCEEDED(PackageCacheIndex::GetFileStamp(file, &stamp));
+  EXPECT_EQ(10, stamp.size);
+  EXPECT_NE(0, stamp.file_index);
+
+  PackageCacheIndex::FileStamp same_stamp;
+  EXPECT_HRESULT_SUCCEEDED(PackageCacheIndex::GetFileStamp(file, &same_stamp));
+  EXPECT_EQ(stamp.size, same_stamp.size);
+  EXPECT_EQ(0, ::CompareFileTime(&stamp.last_write_time,
+                                 &same_stamp.last_write_time));
+  EXPECT_EQ(stamp.volume_serial_number, same_stamp.volume_serial_number);
+  EXPECT_EQ(stamp.file_index, same_stamp.file_index);
+
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND),
+            PackageCacheIndex::GetFileStamp(CacheFile(_T("none")), &stamp));
+}
+
+}  // namespace omaha
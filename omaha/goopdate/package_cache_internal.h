@@ -24,6 +24,14 @@
 
 namespace omaha {
 
+class File;
+
+namespace CryptDetails {
+
+class HashInterface;
+
+}  // namespace CryptDetails
+
 namespace internal {
 
 enum CacheDirectoryType {
@@ -77,7 +85,38 @@ HRESULT FindDirectoryPackagesInfo(const CString& dir_path,
 
 void SortPackageInfoByTime(std::vector<PackageInfo>* packages_info);
 
-HRESULT FileCopy(File* source_file, const CString& destination);
+// Returns the number of names, that is hard links, of |filename|.
+HRESULT GetFileLinkCount(const CString& filename, DWORD* link_count);
+
+// Copies |source_file| from its beginning to |destination|. If |hasher| is not
+// NULL, the bytes are also added to it as they are copied.
+HRESULT FileCopy(File* source_file,
+                 const CString& destination,
+                 CryptDetails::HashInterface* hasher);
+
+// Compresses |source_file| from its beginning into |destination| with LZMA,
+// replacing any previous |destination|.
+// The hashers, if not NULL, receive the bytes read and the bytes written.
+// Returns E_ABORT once |stop_event|, which may be NULL, is signaled.
+HRESULT CompressFile(File* source_file,
+                     const CString& destination,
+                     CryptDetails::HashInterface* source_hasher,
+                     CryptDetails::HashInterface* destination_hasher,
+                     HANDLE stop_event);
+
+// Decompresses the file written by CompressFile into |destination|, which is
+// replaced if it exists. The file is decompressed a buffer at a time.
+HRESULT DecompressFile(const CString& source, const CString& destination);
+
+// Clones |source| to the new file |destination| by sharing its blocks, on
+// file systems with block cloning.
+HRESULT CloneFile(const CString& source, const CString& destination);
+
+// Makes |destination| a clone of |source|, and only copies |source| when the
+// file system cannot clone or the files are on different volumes. Unlike a
+// hard link, writing to |destination| leaves |source| unchanged. Replaces any
+// previous |destination|.
+HRESULT CloneOrCopyFile(const CString& source, const CString& destination);
 
 }  // namespace internal
 
@@ -13,14 +13,21 @@
 // limitations under the License.
 // ========================================================================
 
+#include <iostream>
+
 #include "omaha/base/app_util.h"
 #include "omaha/base/error.h"
 #include "omaha/base/file.h"
+#include "omaha/base/highres_timer-win32.h"
 #include "omaha/base/path.h"
 #include "omaha/base/safe_format.h"
+#include "omaha/base/signatures.h"
 #include "omaha/base/string.h"
+#include "omaha/base/synchronized.h"
+#include "omaha/base/thread.h"
 #include "omaha/base/utils.h"
 #include "omaha/goopdate/package_cache.h"
+#include "omaha/goopdate/package_cache_internal.h"
 #include "omaha/testing/unit_test.h"
 
 namespace omaha {
@@ -32,6 +39,120 @@ const TCHAR* kFile1Sha256Hash =
 const TCHAR* kFile2Sha256Hash =
     _T("f0bbd84d7ec364f6c33161d781b49d840ed792b8b10668c4180b9e6e128d0bc9");
 
+// Checks whether a package is cached, from another thread.
+class IsCachedRunner : public Runnable {
+ public:
+  IsCachedRunner(const PackageCache* package_cache,
+                 const PackageCache::Key* key,
+                 const CString& hash)
+      : package_cache_(package_cache),
+        key_(key),
+        hash_(hash),
+        is_cached_(false) {}
+
+  virtual void Run() {
+    is_cached_ = package_cache_->IsCached(*key_, hash_);
+  }
+
+  bool is_cached() const { return is_cached_; }
+
+ private:
+  const PackageCache* package_cache_;
+  const PackageCache::Key* key_;
+  const CString hash_;
+  bool is_cached_;
+
+  DISALLOW_COPY_AND_ASSIGN(IsCachedRunner);
+};
+
+// Puts, checks, and gets the packages of its own app, and a package shared
+// by all the workers.
+class PackageCacheWorker : public Runnable {
+ public:
+  static const int kNumVersions = 4;
+
+  PackageCacheWorker(PackageCache* package_cache,
+                     int id,
+                     int iterations,
+                     const CString& own_file,
+                     const CString& own_hash,
+                     const CString& shared_file,
+                     const CString& shared_hash)
+      : package_cache_(package_cache),
+        iterations_(iterations),
+        own_file_(own_file),
+        own_hash_(own_hash),
+        shared_file_(shared_file),
+        shared_hash_(shared_hash),
+        destination_file_(GetTempFilename(_T("ut_"))),
+        num_operations_(0) {
+    app_id_.Format(_T("app%d"), id);
+  }
+
+  virtual ~PackageCacheWorker() {
+    ::DeleteFile(destination_file_);
+  }
+
+  virtual void Run() {
+    const PackageCache::Key shared_key(_T("shared_app"),
+                                       _T("1.0.0.0"),
+                                       _T("package.bin"));
+    for (int i = 0; i != iterations_; ++i) {
+      CString version;
+      version.Format(_T("1.0.0.%d"), i % kNumVersions);
+      const PackageCache::Key own_key(app_id_, version, _T("package.bin"));
+
+      if (i % (2 * kNumVersions) == kNumVersions) {
+        EXPECT_HRESULT_SUCCEEDED(package_cache_->PurgeVersion(app_id_,
+                                                              version));
+        ++num_operations_;
+      }
+
+      EXPECT_HRESULT_SUCCEEDED(Put(own_key, own_file_, own_hash_));
+      EXPECT_TRUE(package_cache_->IsCached(own_key, own_hash_));
+      EXPECT_HRESULT_SUCCEEDED(package_cache_->Get(own_key,
+                                                   destination_file_,
+                                                   own_hash_));
+
+      if (i % kNumVersions == 0) {
+        EXPECT_HRESULT_SUCCEEDED(Put(shared_key, shared_file_, shared_hash_));
+        ++num_operations_;
+      }
+      EXPECT_TRUE(package_cache_->IsCached(shared_key, shared_hash_));
+      EXPECT_HRESULT_SUCCEEDED(package_cache_->Get(shared_key,
+                                                   destination_file_,
+                                                   shared_hash_));
+      num_operations_ += 5;
+    }
+  }
+
+  int num_operations() const { return num_operations_; }
+
+ private:
+  HRESULT Put(const PackageCache::Key& key,
+              const CString& filename,
+              const CString& hash) {
+    File file;
+    HRESULT hr = file.OpenShareMode(filename, false, false, FILE_SHARE_READ);
+    if (FAILED(hr)) {
+      return hr;
+    }
+    return package_cache_->Put(key, &file, hash);
+  }
+
+  PackageCache* package_cache_;
+  CString app_id_;
+  const int iterations_;
+  const CString own_file_;
+  const CString own_hash_;
+  const CString shared_file_;
+  const CString shared_hash_;
+  const CString destination_file_;
+  int num_operations_;
+
+  DISALLOW_COPY_AND_ASSIGN(PackageCacheWorker);
+};
+
 }  // namespace
 
 class PackageCacheTest : public testing::TestWithParam<bool> {
@@ -102,6 +223,10 @@ class PackageCacheTest : public testing::TestWithParam<bool> {
     expiration_time.dwLowDateTime = file_time.LowPart;
     expiration_time.dwHighDateTime = file_time.HighPart;
 
+    // The cache index tracks when the package was last used.
+    package_cache_.digest_index_.SetLastUsedTime(cached_file_name,
+                                                 expiration_time);
+
     return File::SetFileTime(cached_file_name,
                              &expiration_time,
                              &expiration_time,
@@ -113,10 +238,169 @@ class PackageCacheTest : public testing::TestWithParam<bool> {
       static_cast<uint64>(limit_mb);
   }
 
+  void SetCacheSizeLimitBytes(uint64 limit_bytes) {
+    package_cache_.cache_size_limit_bytes_ = limit_bytes;
+  }
+
   void SetCacheTimeLimitDays(int limit_days) {
     package_cache_.cache_time_limit_days_ = limit_days;
   }
 
+  void SetCacheCompressionTimeDays(int days) {
+    package_cache_.cache_compression_time_days_ = days;
+  }
+
+  // Makes the package for |key| last used just before the compression time.
+  void MakeCold(const Key& key) {
+    ULARGE_INTEGER cold_time = {0};
+    const FILETIME compression_time = package_cache_.GetCacheCompressionTime();
+    cold_time.LowPart = compression_time.dwLowDateTime;
+    cold_time.HighPart = compression_time.dwHighDateTime;
+    cold_time.QuadPart -= 1;
+
+    FILETIME last_used_time = {0};
+    last_used_time.dwLowDateTime = cold_time.LowPart;
+    last_used_time.dwHighDateTime = cold_time.HighPart;
+
+    CString cached_file_name;
+    EXPECT_HRESULT_SUCCEEDED(BuildCacheFileNameForKey(key, &cached_file_name));
+    package_cache_.digest_index_.SetLastUsedTime(cached_file_name,
+                                                 last_used_time);
+  }
+
+  size_t NumColdFiles() const {
+    std::vector<PackageCacheIndex::ColdFile> cold_files;
+    package_cache_.digest_index_.GetColdFiles(
+        package_cache_.GetCacheCompressionTime(), &cold_files);
+    return cold_files.size();
+  }
+
+  void SetAlwaysVerifyHash(bool always_verify_hash) {
+    package_cache_.always_verify_hash_ = always_verify_hash;
+  }
+
+  const RWLock& GetKeyLock(const Key& key) const {
+    return package_cache_.GetKeyLock(key);
+  }
+
+  // Runs |num_threads| workers doing |iterations| rounds each, with the cache
+  // purged of old packages meanwhile. Returns the number of operations done.
+  int RunWorkers(int num_threads, int iterations, uint64 package_size) {
+    CString shared_hash;
+    const CString shared_file(CreatePackage(
+        static_cast<size_t>(package_size), -1, &shared_hash));
+
+    std::vector<CString> own_files(num_threads);
+    std::vector<PackageCacheWorker*> workers(num_threads);
+    std::vector<Thread*> threads(num_threads);
+    for (int i = 0; i != num_threads; ++i) {
+      CString own_hash;
+      own_files[i] = CreatePackage(static_cast<size_t>(package_size),
+                                   i,
+                                   &own_hash);
+      workers[i] = new PackageCacheWorker(&package_cache_,
+                                          i,
+                                          iterations,
+                                          own_files[i],
+                                          own_hash,
+                                          shared_file,
+                                          shared_hash);
+      threads[i] = new Thread;
+    }
+
+    for (int i = 0; i != num_threads; ++i) {
+      EXPECT_TRUE(threads[i]->Start(workers[i]));
+    }
+
+    // Nothing is over the limits, but the purge takes the cache lock
+    // exclusively while the workers run.
+    for (int i = 0; i != num_threads; ++i) {
+      while (!threads[i]->WaitTillExit(10)) {
+        EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeOldPackagesIfNecessary());
+      }
+    }
+
+    int num_operations = 0;
+    for (int i = 0; i != num_threads; ++i) {
+      num_operations += workers[i]->num_operations();
+      delete threads[i];
+      delete workers[i];
+      EXPECT_TRUE(::DeleteFile(own_files[i]));
+    }
+    EXPECT_TRUE(::DeleteFile(shared_file));
+
+    return num_operations;
+  }
+
+  // Returns true if the cache index vouches for the package for |key|.
+  bool IsVerifiedByIndex(const Key& key, const CString& hash) const {
+    CString filename;
+    std::vector<uint8> digest;
+    PackageCacheIndex::FileStamp stamp;
+    return SUCCEEDED(BuildCacheFileNameForKey(key, &filename)) &&
+           SafeHexStringToVector(hash, &digest) &&
+           SUCCEEDED(PackageCacheIndex::GetFileStamp(filename, &stamp)) &&
+           package_cache_.digest_index_.IsVerified(filename, stamp, digest);
+  }
+
+  size_t DigestIndexSize(const PackageCache& package_cache) const {
+    return package_cache.digest_index_.size();
+  }
+
+  CString BuildContentFileName(const CString& hash) const {
+    std::vector<uint8> digest;
+    EXPECT_TRUE(SafeHexStringToVector(hash, &digest));
+    return package_cache_.BuildContentFileName(digest);
+  }
+
+  CString BuildCompressedContentFileName(const CString& hash) const {
+    std::vector<uint8> digest;
+    EXPECT_TRUE(SafeHexStringToVector(hash, &digest));
+    return package_cache_.BuildCompressedContentFileName(digest);
+  }
+
+  // Creates a package of |size| bytes whose content depends on |seed|, so
+  // that packages with different seeds are not deduplicated.
+  static CString CreatePackage(size_t size, int seed, CString* hash) {
+    EXPECT_LE(sizeof(seed), size);
+    std::vector<byte> contents(size, static_cast<byte>(seed));
+    memcpy(&contents.front(), &seed, sizeof(seed));
+    return WritePackage(contents, hash);
+  }
+
+  // Creates a package of |size| pseudo-random bytes, which do not compress.
+  static CString CreateIncompressiblePackage(size_t size, CString* hash) {
+    std::vector<byte> contents(size);
+    uint32 state = 1;
+    for (size_t i = 0; i != size; ++i) {
+      state = state * 1103515245 + 12345;
+      contents[i] = static_cast<byte>(state >> 24);
+    }
+    return WritePackage(contents, hash);
+  }
+
+  static CString WritePackage(const std::vector<byte>& contents,
+                              CString* hash) {
+    const CString filename(GetTempFilename(_T("ut_")));
+    EXPECT_HRESULT_SUCCEEDED(WriteEntireFile(filename, contents));
+
+    std::vector<byte> digest;
+    EXPECT_HRESULT_SUCCEEDED(CryptoHash().Compute(filename, 0, &digest));
+    *hash = BytesToHex(digest);
+    return filename;
+  }
+
+  HRESULT PutPackage(const Key& key,
+                     const CString& filename,
+                     const CString& hash) {
+    File file;
+    HRESULT hr = file.OpenShareMode(filename, false, false, FILE_SHARE_READ);
+    if (FAILED(hr)) {
+      return hr;
+    }
+    return package_cache_.Put(key, &file, hash);
+  }
+
   const CString cache_root_;
   CString source_file1_;
   File source_file1_file_;
@@ -257,6 +541,138 @@ TEST_F(PackageCacheTest, PutBadHashTest) {
   EXPECT_FALSE(package_cache_.IsCached(key1, hash_file1_));
 }
 
+TEST_F(PackageCacheTest, PutWithComputedDigestTest) {
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+
+  std::vector<uint8> good_digest;
+  ASSERT_TRUE(SafeHexStringToVector(hash_file1_, &good_digest));
+
+  // A digest computed while downloading that does not match the expected hash
+  // fails before anything is copied into the cache.
+  std::vector<uint8> bad_digest(good_digest);
+  bad_digest[0] ^= 0xff;
+  EXPECT_EQ(SIGS_E_INVALID_SIGNATURE, package_cache_.Put(key1,
+                                                         &source_file1_file_,
+                                                         hash_file1_,
+                                                         bad_digest));
+  EXPECT_FALSE(package_cache_.IsCached(key1, hash_file1_));
+
+  EXPECT_SUCCEEDED(package_cache_.Put(key1,
+                                      &source_file1_file_,
+                                      hash_file1_,
+                                      good_digest));
+  EXPECT_TRUE(package_cache_.IsCached(key1, hash_file1_));
+  EXPECT_EQ(size_file1_, package_cache_.Size());
+}
+
+TEST_F(PackageCacheTest, DigestIndexTest) {
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+  EXPECT_EQ(0, DigestIndexSize(package_cache_));
+
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  Key key2(_T("app2"), _T("ver2"), _T("package2"));
+  EXPECT_SUCCEEDED(package_cache_.Put(key1, &source_file1_file_, hash_file1_));
+  EXPECT_SUCCEEDED(package_cache_.Put(key2, &source_file2_file_, hash_file2_));
+  EXPECT_EQ(2, DigestIndexSize(package_cache_));
+
+  // The index does not count towards the size of the cache.
+  EXPECT_EQ(size_file1_ + size_file2_, package_cache_.Size());
+
+  // The index is persisted with the cache.
+  PackageCache package_cache;
+  EXPECT_HRESULT_SUCCEEDED(package_cache.Initialize(cache_root_));
+  EXPECT_EQ(2, DigestIndexSize(package_cache));
+  EXPECT_TRUE(package_cache.IsCached(key1, hash_file1_));
+
+  // A recorded digest does not make a different hash match.
+  EXPECT_FALSE(package_cache_.IsCached(key1, hash_file2_));
+
+  // Modifying the cached file invalidates its index entry.
+  CString cached_file;
+  EXPECT_HRESULT_SUCCEEDED(BuildCacheFileNameForKey(key1, &cached_file));
+  {
+    File file;
+    EXPECT_HRESULT_SUCCEEDED(file.Open(cached_file, true, false));
+    const byte kGarbage[] = {0xde, 0xad, 0xbe, 0xef};
+    uint32 bytes_written = 0;
+    EXPECT_HRESULT_SUCCEEDED(file.WriteAt(0,
+                                          kGarbage,
+                                          arraysize(kGarbage),
+                                          0,
+                                          &bytes_written));
+  }
+  EXPECT_FALSE(package_cache_.IsCached(key1, hash_file1_));
+  EXPECT_TRUE(package_cache_.IsCached(key2, hash_file2_));
+
+  SetAlwaysVerifyHash(true);
+  EXPECT_FALSE(package_cache_.IsCached(key1, hash_file1_));
+  EXPECT_TRUE(package_cache_.IsCached(key2, hash_file2_));
+
+  // Purging removes the entries.
+  EXPECT_SUCCEEDED(package_cache_.PurgeApp(_T("app2")));
+  EXPECT_EQ(1, DigestIndexSize(package_cache_));
+  EXPECT_SUCCEEDED(package_cache_.PurgeAll());
+  EXPECT_EQ(0, DigestIndexSize(package_cache_));
+  EXPECT_EQ(0, package_cache_.Size());
+}
+
+// The packages that changed since they were last verified are verified
+// together.
+TEST_F(PackageCacheTest, VerifyPackages) {
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  Key key2(_T("app2"), _T("ver2"), _T("package2"));
+  Key key3(_T("app3"), _T("ver3"), _T("package3"));
+  EXPECT_SUCCEEDED(package_cache_.Put(key1, &source_file1_file_, hash_file1_));
+  EXPECT_SUCCEEDED(package_cache_.Put(key2, &source_file2_file_, hash_file2_));
+  EXPECT_SUCCEEDED(package_cache_.Put(key3, &source_file2_file_, hash_file2_));
+
+  // Changing the time of the first package invalidates its index entry, and
+  // changing the content of the second one makes it fail verification.
+  CString cached_file;
+  EXPECT_HRESULT_SUCCEEDED(BuildCacheFileNameForKey(key1, &cached_file));
+  FILETIME file_time = {0};
+  ::GetSystemTimeAsFileTime(&file_time);
+  --file_time.dwHighDateTime;
+  EXPECT_HRESULT_SUCCEEDED(File::SetFileTime(cached_file,
+                                             &file_time,
+                                             &file_time,
+                                             &file_time));
+  EXPECT_FALSE(IsVerifiedByIndex(key1, hash_file1_));
+
+  EXPECT_HRESULT_SUCCEEDED(BuildCacheFileNameForKey(key2, &cached_file));
+  {
+    File file;
+    EXPECT_HRESULT_SUCCEEDED(file.Open(cached_file, true, false));
+    const byte kGarbage[] = {0xde, 0xad, 0xbe, 0xef};
+    uint32 bytes_written = 0;
+    EXPECT_HRESULT_SUCCEEDED(file.WriteAt(0,
+                                          kGarbage,
+                                          arraysize(kGarbage),
+                                          0,
+                                          &bytes_written));
+  }
+  EXPECT_FALSE(IsVerifiedByIndex(key2, hash_file2_));
+  EXPECT_FALSE(IsVerifiedByIndex(key3, hash_file2_));
+
+  std::vector<const Key*> keys;
+  keys.push_back(&key1);
+  keys.push_back(&key2);
+  keys.push_back(&key3);
+  std::vector<CString> hashes;
+  hashes.push_back(hash_file1_);
+  hashes.push_back(hash_file2_);
+  hashes.push_back(hash_file2_);
+  package_cache_.VerifyPackages(keys, hashes);
+
+  EXPECT_TRUE(IsVerifiedByIndex(key1, hash_file1_));
+  EXPECT_FALSE(IsVerifiedByIndex(key2, hash_file2_));
+  EXPECT_FALSE(IsVerifiedByIndex(key3, hash_file2_));
+  EXPECT_TRUE(package_cache_.IsCached(key1, hash_file1_));
+  EXPECT_FALSE(package_cache_.IsCached(key2, hash_file2_));
+}
+
 // The key must include the app id, version, and package name for Put and Get
 // operations. If the version is not provided, "0.0.0.0" is used internally.
 TEST_F(PackageCacheTest, BadKeyTest) {
@@ -302,7 +718,8 @@ TEST_F(PackageCacheTest, PurgeVersionTest) {
   EXPECT_TRUE(package_cache_.IsCached(key21, hash_file1_));
   EXPECT_TRUE(package_cache_.IsCached(key22, hash_file2_));
 
-  EXPECT_EQ(2 * (size_file1_ + size_file2_), package_cache_.Size());
+  // Each package is stored once for both versions.
+  EXPECT_EQ(size_file1_ + size_file2_, package_cache_.Size());
 
   EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeVersion(_T("app1"), _T("ver1")));
 
@@ -348,7 +765,8 @@ TEST_F(PackageCacheTest, PurgeAppTest) {
   EXPECT_TRUE(package_cache_.IsCached(key21, hash_file1_));
   EXPECT_TRUE(package_cache_.IsCached(key22, hash_file2_));
 
-  EXPECT_EQ(2 * (size_file1_ + size_file2_), package_cache_.Size());
+  // Each package is stored once for both apps.
+  EXPECT_EQ(size_file1_ + size_file2_, package_cache_.Size());
 
   EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeApp(_T("app1")));
 
@@ -442,7 +860,7 @@ TEST_F(PackageCacheTest, PurgeAll) {
   EXPECT_TRUE(package_cache_.IsCached(key21, hash_file1_));
   EXPECT_TRUE(package_cache_.IsCached(key22, hash_file2_));
 
-  EXPECT_EQ(2 * (size_file1_ + size_file2_), package_cache_.Size());
+  EXPECT_EQ(size_file1_ + size_file2_, package_cache_.Size());
 
   EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
 
@@ -463,8 +881,10 @@ TEST_F(PackageCacheTest, PurgeOldPackagesIfOverSizeLimit) {
   const uint64 kSizeLimitBytes = 1024LL * 1024 * kCacheSizeLimitMB;
 
   Key key0(_T("app0"), _T("version0"), _T("package0"));
+  CString hash0;
 
-  // Keep adding packages until we exceed cache limit.
+  // Keep adding packages until we exceed cache limit. The packages differ,
+  // otherwise they would be stored once.
   uint64 current_size = 0;
   int i = 0;
   while (current_size <= kSizeLimitBytes) {
@@ -474,9 +894,17 @@ TEST_F(PackageCacheTest, PurgeOldPackagesIfOverSizeLimit) {
     app.Format(_T("app%d"), i);
     version.Format(_T("version%d"), i);
     package.Format(_T("package%d"), i);
-    EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(Key(app, version, package),
-                                                &source_file1_file_,
-                                                hash_file1_));
+    CString hash;
+    const CString source_file(CreatePackage(static_cast<size_t>(size_file1_),
+                                            i,
+                                            &hash));
+    EXPECT_HRESULT_SUCCEEDED(PutPackage(Key(app, version, package),
+                                        source_file,
+                                        hash));
+    EXPECT_TRUE(::DeleteFile(source_file));
+    if (!i) {
+      hash0 = hash;
+    }
     current_size += size_file1_;
     EXPECT_EQ(current_size, package_cache_.Size());
     ++i;
@@ -489,12 +917,13 @@ TEST_F(PackageCacheTest, PurgeOldPackagesIfOverSizeLimit) {
 
   // Verify that cache size limit is exceeded.
   EXPECT_GT(package_cache_.Size(), kSizeLimitBytes);
-  EXPECT_TRUE(package_cache_.IsCached(key0, hash_file1_));
+  EXPECT_TRUE(package_cache_.IsCached(key0, hash0));
 
   package_cache_.PurgeOldPackagesIfNecessary();
 
   // Verify that the oldes package is purged and the cache size is below limit.
-  EXPECT_FALSE(package_cache_.IsCached(key0, hash_file1_));
+  EXPECT_FALSE(package_cache_.IsCached(key0, hash0));
+  EXPECT_FALSE(File::Exists(BuildContentFileName(hash0)));
   EXPECT_LE(package_cache_.Size(), kSizeLimitBytes);
 }
 
@@ -528,6 +957,627 @@ TEST_F(PackageCacheTest, PurgeExpiredCacheFiles) {
   EXPECT_FALSE(package_cache_.IsCached(key2, hash_file2_));
 }
 
+// Copying a package out of the cache makes it the most recently used one.
+TEST_F(PackageCacheTest, PurgeLeastRecentlyUsedPackages) {
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+
+  const size_t kPackageSize = 1024 * 1024;
+  Key key1(_T("app1"), _T("version1"), _T("package1"));
+  Key key2(_T("app2"), _T("version2"), _T("package2"));
+  Key key3(_T("app3"), _T("version3"), _T("package3"));
+  CString hash1;
+  CString hash2;
+  CString hash3;
+  const CString source_file1(CreatePackage(kPackageSize, 1, &hash1));
+  const CString source_file2(CreatePackage(kPackageSize, 2, &hash2));
+  const CString source_file3(CreatePackage(kPackageSize, 3, &hash3));
+  EXPECT_SUCCEEDED(PutPackage(key1, source_file1, hash1));
+  EXPECT_SUCCEEDED(PutPackage(key2, source_file2, hash2));
+  EXPECT_SUCCEEDED(PutPackage(key3, source_file3, hash3));
+  EXPECT_TRUE(::DeleteFile(source_file1));
+  EXPECT_TRUE(::DeleteFile(source_file2));
+  EXPECT_TRUE(::DeleteFile(source_file3));
+  EXPECT_EQ(3 * kPackageSize, package_cache_.Size());
+
+  CString destination_file = GetTempFilename(_T("ut_"));
+  EXPECT_FALSE(destination_file.IsEmpty());
+  EXPECT_SUCCEEDED(package_cache_.Get(key1, destination_file, hash1));
+  EXPECT_TRUE(::DeleteFile(destination_file));
+
+  // Probing the cache is not a use.
+  EXPECT_TRUE(package_cache_.IsCached(key2, hash2));
+
+  // The order survives reloading the index.
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Initialize(cache_root_));
+  EXPECT_EQ(3 * kPackageSize, package_cache_.Size());
+
+  SetCacheSizeLimitBytes(2 * kPackageSize);
+  EXPECT_SUCCEEDED(package_cache_.PurgeOldPackagesIfNecessary());
+  EXPECT_TRUE(package_cache_.IsCached(key1, hash1));
+  EXPECT_FALSE(package_cache_.IsCached(key2, hash2));
+  EXPECT_TRUE(package_cache_.IsCached(key3, hash3));
+  EXPECT_EQ(2 * kPackageSize, package_cache_.Size());
+}
+
+// The index is rebuilt from the cached files when it is missing.
+TEST_F(PackageCacheTest, RebuildIndex) {
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+
+  Key key1(_T("app1"), _T("version1"), _T("package1"));
+  Key key2(_T("app2"), _T("version2"), _T("package2"));
+  EXPECT_SUCCEEDED(package_cache_.Put(key1, &source_file1_file_, hash_file1_));
+  EXPECT_SUCCEEDED(package_cache_.Put(key2, &source_file2_file_, hash_file2_));
+
+  ::DeleteFile(ConcatenatePath(cache_root_,
+                               PackageCacheIndex::kIndexFileName));
+  ::DeleteFile(ConcatenatePath(cache_root_,
+                               PackageCacheIndex::kJournalFileName));
+
+  PackageCache package_cache;
+  EXPECT_HRESULT_SUCCEEDED(package_cache.Initialize(cache_root_));
+  EXPECT_EQ(2, DigestIndexSize(package_cache));
+  EXPECT_EQ(size_file1_ + size_file2_, package_cache.Size());
+  EXPECT_TRUE(package_cache.IsCached(key1, hash_file1_));
+  EXPECT_TRUE(package_cache.IsCached(key2, hash_file2_));
+}
+
+// The compressed packages are still compressed in a rebuilt index.
+TEST_F(PackageCacheTest, RebuildIndexWithCompressedPackage) {
+  const size_t kPackageSize = 1024 * 1024;
+
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+  SetCacheCompressionTimeDays(30);
+
+  CString hash1;
+  CString hash2;
+  const CString source_file1(CreatePackage(kPackageSize, 1, &hash1));
+  const CString source_file2(CreatePackage(kPackageSize, 2, &hash2));
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  Key key2(_T("app2"), _T("ver2"), _T("package2"));
+  EXPECT_SUCCEEDED(PutPackage(key1, source_file1, hash1));
+  EXPECT_SUCCEEDED(PutPackage(key2, source_file2, hash2));
+  EXPECT_TRUE(::DeleteFile(source_file1));
+  EXPECT_TRUE(::DeleteFile(source_file2));
+
+  MakeCold(key1);
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.CompressColdPackages(NULL));
+  EXPECT_TRUE(File::Exists(BuildCompressedContentFileName(hash1)));
+  const uint64 size = package_cache_.Size();
+
+  ::DeleteFile(ConcatenatePath(cache_root_,
+                               PackageCacheIndex::kIndexFileName));
+  ::DeleteFile(ConcatenatePath(cache_root_,
+                               PackageCacheIndex::kJournalFileName));
+
+  PackageCache package_cache;
+  EXPECT_HRESULT_SUCCEEDED(package_cache.Initialize(cache_root_));
+  EXPECT_EQ(2, DigestIndexSize(package_cache));
+  EXPECT_EQ(size, package_cache.Size());
+  EXPECT_TRUE(package_cache.IsCached(key1, hash1));
+  EXPECT_FALSE(package_cache.IsCached(key1, hash2));
+  EXPECT_TRUE(package_cache.IsCached(key2, hash2));
+
+  const CString destination_file(GetTempFilename(_T("ut_")));
+  EXPECT_SUCCEEDED(package_cache.Get(key1, destination_file, hash1));
+  EXPECT_SUCCEEDED(PackageCache::VerifyHash(destination_file, hash1));
+  EXPECT_TRUE(::DeleteFile(destination_file));
+}
+
+// The content of the packages is stored once for all the keys it is cached
+// under, and deleted along with its last key.
+TEST_F(PackageCacheTest, DeduplicatePackages) {
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  Key key2(_T("app2"), _T("ver2"), _T("package2"));
+  EXPECT_SUCCEEDED(package_cache_.Put(key1, &source_file1_file_, hash_file1_));
+
+  // The content is already cached, so the source file is not even read.
+  EXPECT_SUCCEEDED(package_cache_.Put(key2, &source_file2_file_, hash_file1_));
+  EXPECT_TRUE(package_cache_.IsCached(key2, hash_file1_));
+  EXPECT_EQ(size_file1_, package_cache_.Size());
+
+  // Both keys are links to the content.
+  const CString content_file(BuildContentFileName(hash_file1_));
+  DWORD link_count = 0;
+  EXPECT_HRESULT_SUCCEEDED(internal::GetFileLinkCount(content_file,
+                                                      &link_count));
+  EXPECT_EQ(3, link_count);
+
+  CString destination_file = GetTempFilename(_T("ut_"));
+  EXPECT_FALSE(destination_file.IsEmpty());
+  EXPECT_SUCCEEDED(package_cache_.Get(key2, destination_file, hash_file1_));
+  EXPECT_SUCCEEDED(PackageCache::VerifyHash(destination_file, hash_file1_));
+  EXPECT_TRUE(::DeleteFile(destination_file));
+
+  EXPECT_SUCCEEDED(package_cache_.Purge(key1));
+  EXPECT_TRUE(package_cache_.IsCached(key2, hash_file1_));
+  EXPECT_EQ(size_file1_, package_cache_.Size());
+  EXPECT_TRUE(File::Exists(content_file));
+
+  // Caching other content under a key releases the previous content.
+  EXPECT_SUCCEEDED(package_cache_.Put(key2, &source_file2_file_, hash_file2_));
+  EXPECT_TRUE(package_cache_.IsCached(key2, hash_file2_));
+  EXPECT_EQ(size_file2_, package_cache_.Size());
+  EXPECT_FALSE(File::Exists(content_file));
+
+  EXPECT_SUCCEEDED(package_cache_.Purge(key2));
+  EXPECT_EQ(0, package_cache_.Size());
+  EXPECT_FALSE(File::Exists(BuildContentFileName(hash_file2_)));
+}
+
+// Get hands out a link to the cached file rather than a copy. The link does
+// not keep the content in the cache.
+// Writing to the file handed out by Get leaves the cached package unchanged.
+TEST_F(PackageCacheTest, GetDoesNotLinkPackage) {
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+
+  Key key(_T("app1"), _T("ver1"), _T("package1"));
+  EXPECT_SUCCEEDED(package_cache_.Put(key, &source_file1_file_, hash_file1_));
+
+  // The previous destination file is replaced.
+  const CString destination_file(GetTempFilename(_T("ut_")));
+  EXPECT_TRUE(File::Exists(destination_file));
+  EXPECT_SUCCEEDED(package_cache_.Get(key, destination_file, hash_file1_));
+  EXPECT_SUCCEEDED(PackageCache::VerifyHash(destination_file, hash_file1_));
+
+  DWORD link_count = 0;
+  EXPECT_HRESULT_SUCCEEDED(internal::GetFileLinkCount(destination_file,
+                                                      &link_count));
+  EXPECT_EQ(1, link_count);
+
+  {
+    File file;
+    EXPECT_HRESULT_SUCCEEDED(file.Open(destination_file, true, false));
+    const byte kGarbage[] = {0xde, 0xad, 0xbe, 0xef};
+    uint32 bytes_written = 0;
+    EXPECT_HRESULT_SUCCEEDED(file.WriteAt(0,
+                                          kGarbage,
+                                          arraysize(kGarbage),
+                                          0,
+                                          &bytes_written));
+  }
+  EXPECT_FAILED(PackageCache::VerifyHash(destination_file, hash_file1_));
+  SetAlwaysVerifyHash(true);
+  EXPECT_TRUE(package_cache_.IsCached(key, hash_file1_));
+  EXPECT_TRUE(::DeleteFile(destination_file));
+}
+
+TEST_F(PackageCacheTest, CloneFile) {
+  const CString destination_file(GetTempFilename(_T("ut_")));
+  EXPECT_TRUE(::DeleteFile(destination_file));
+
+  // Only some file systems, such as ReFS, can clone files. Failures leave no
+  // file behind.
+  if (SUCCEEDED(internal::CloneFile(source_file1_, destination_file))) {
+    EXPECT_SUCCEEDED(PackageCache::VerifyHash(destination_file, hash_file1_));
+    EXPECT_TRUE(::DeleteFile(destination_file));
+  } else {
+    EXPECT_FALSE(File::Exists(destination_file));
+  }
+
+  EXPECT_SUCCEEDED(internal::CloneOrCopyFile(source_file1_, destination_file));
+  EXPECT_SUCCEEDED(PackageCache::VerifyHash(destination_file, hash_file1_));
+  EXPECT_TRUE(::DeleteFile(destination_file));
+}
+
+// Measures Get of a large package against copying it, as Get did before.
+// Run with --gtest_also_run_disabled_tests.
+TEST_F(PackageCacheTest, DISABLED_GetBenchmark) {
+  const size_t kPackageSize = 256 * 1024 * 1024;
+  const int kNumGets = 10;
+
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+
+  CString hash;
+  const CString source_file(CreatePackage(kPackageSize, 0, &hash));
+  Key key(_T("app1"), _T("ver1"), _T("package1"));
+  EXPECT_HRESULT_SUCCEEDED(PutPackage(key, source_file, hash));
+  EXPECT_TRUE(::DeleteFile(source_file));
+
+  CString cached_file;
+  EXPECT_HRESULT_SUCCEEDED(BuildCacheFileNameForKey(key, &cached_file));
+  const CString destination_file(GetTempFilename(_T("ut_")));
+
+  HighresTimer get_timer;
+  for (int i = 0; i != kNumGets; ++i) {
+    EXPECT_HRESULT_SUCCEEDED(package_cache_.Get(key, destination_file, hash));
+  }
+  const double get_ms =
+      static_cast<double>(get_timer.GetElapsedMs()) / kNumGets;
+
+  HighresTimer copy_timer;
+  for (int i = 0; i != kNumGets; ++i) {
+    EXPECT_TRUE(::DeleteFile(destination_file));
+    EXPECT_HRESULT_SUCCEEDED(File::Copy(cached_file, destination_file, true));
+  }
+  const double copy_ms =
+      static_cast<double>(copy_timer.GetElapsedMs()) / kNumGets;
+
+  EXPECT_TRUE(::DeleteFile(destination_file));
+
+  std::wcout << kPackageSize / (1024 * 1024) << _T(" MB package: Get ")
+             << get_ms << _T(" ms, copy ") << copy_ms << _T(" ms")
+             << std::endl;
+}
+
+// Cold packages are replaced by their compressed content, and decompressed
+// as they are copied out of the cache.
+TEST_F(PackageCacheTest, CompressColdPackages) {
+  const size_t kPackageSize = 1024 * 1024;
+
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+  EXPECT_EQ(S_FALSE, package_cache_.CompressColdPackages(NULL));
+  SetCacheCompressionTimeDays(30);
+
+  CString hash1;
+  CString hash2;
+  const CString source_file1(CreatePackage(kPackageSize, 1, &hash1));
+  const CString source_file2(CreatePackage(kPackageSize, 2, &hash2));
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  Key key2(_T("app2"), _T("ver2"), _T("package2"));
+  Key key3(_T("app3"), _T("ver3"), _T("package3"));
+  EXPECT_SUCCEEDED(PutPackage(key1, source_file1, hash1));
+  EXPECT_SUCCEEDED(PutPackage(key2, source_file1, hash1));
+  EXPECT_SUCCEEDED(PutPackage(key3, source_file2, hash2));
+  EXPECT_TRUE(::DeleteFile(source_file1));
+  EXPECT_TRUE(::DeleteFile(source_file2));
+  EXPECT_EQ(2 * kPackageSize, package_cache_.Size());
+
+  // Nothing is cold yet, and the content of key1 is still used by key2.
+  const CString content_file1(BuildContentFileName(hash1));
+  const CString compressed_file1(BuildCompressedContentFileName(hash1));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.CompressColdPackages(NULL));
+  MakeCold(key1);
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.CompressColdPackages(NULL));
+  EXPECT_FALSE(File::Exists(compressed_file1));
+  EXPECT_EQ(2 * kPackageSize, package_cache_.Size());
+
+  MakeCold(key2);
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.CompressColdPackages(NULL));
+  EXPECT_TRUE(File::Exists(compressed_file1));
+  EXPECT_FALSE(File::Exists(content_file1));
+  EXPECT_GT(2 * kPackageSize, package_cache_.Size());
+  EXPECT_LT(kPackageSize, package_cache_.Size());
+
+  EXPECT_TRUE(package_cache_.IsCached(key1, hash1));
+  EXPECT_TRUE(package_cache_.IsCached(key2, hash1));
+  EXPECT_FALSE(package_cache_.IsCached(key1, hash2));
+
+  const CString destination_file(GetTempFilename(_T("ut_")));
+  EXPECT_SUCCEEDED(package_cache_.Get(key1, destination_file, hash1));
+  EXPECT_SUCCEEDED(PackageCache::VerifyHash(destination_file, hash1));
+  EXPECT_TRUE(::DeleteFile(destination_file));
+
+  // Only plain content is linked.
+  Key key4(_T("app4"), _T("ver4"), _T("package4"));
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND),
+            package_cache_.Link(key4, hash1));
+
+  // The compressed content goes with its last name.
+  EXPECT_SUCCEEDED(package_cache_.Purge(key1));
+  EXPECT_TRUE(File::Exists(compressed_file1));
+  EXPECT_SUCCEEDED(package_cache_.Purge(key2));
+  EXPECT_FALSE(File::Exists(compressed_file1));
+  EXPECT_EQ(kPackageSize, package_cache_.Size());
+}
+
+// A package that does not compress well stays plain and is not compressed
+// again.
+TEST_F(PackageCacheTest, CompressIncompressiblePackage) {
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+  SetCacheCompressionTimeDays(30);
+
+  CString hash;
+  const CString source_file(CreateIncompressiblePackage(64 * 1024, &hash));
+  Key key(_T("app1"), _T("ver1"), _T("package1"));
+  EXPECT_SUCCEEDED(PutPackage(key, source_file, hash));
+  EXPECT_TRUE(::DeleteFile(source_file));
+
+  MakeCold(key);
+  EXPECT_EQ(1, NumColdFiles());
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.CompressColdPackages(NULL));
+  EXPECT_FALSE(File::Exists(BuildCompressedContentFileName(hash)));
+  EXPECT_TRUE(File::Exists(BuildContentFileName(hash)));
+  EXPECT_EQ(64 * 1024, package_cache_.Size());
+  EXPECT_TRUE(package_cache_.IsCached(key, hash));
+
+  EXPECT_EQ(0, NumColdFiles());
+}
+
+TEST_F(PackageCacheTest, CompressFile) {
+  const CString compressed_file(GetTempFilename(_T("ut_")));
+  const CString destination_file(GetTempFilename(_T("ut_")));
+
+  EXPECT_HRESULT_SUCCEEDED(internal::CompressFile(&source_file1_file_,
+                                                  compressed_file,
+                                                  NULL,
+                                                  NULL,
+                                                  NULL));
+  EXPECT_HRESULT_SUCCEEDED(internal::DecompressFile(compressed_file,
+                                                    destination_file));
+  EXPECT_SUCCEEDED(PackageCache::VerifyHash(destination_file, hash_file1_));
+
+  // Truncated input fails and leaves no file behind.
+  std::vector<byte> contents;
+  EXPECT_HRESULT_SUCCEEDED(ReadEntireFile(compressed_file, 0, &contents));
+  contents.resize(contents.size() / 2);
+  EXPECT_HRESULT_SUCCEEDED(WriteEntireFile(compressed_file, contents));
+  EXPECT_HRESULT_FAILED(internal::DecompressFile(compressed_file,
+                                                 destination_file));
+  EXPECT_FALSE(File::Exists(destination_file));
+
+  // Compression stops once the stop event is signaled.
+  scoped_event stop_event(::CreateEvent(NULL, true, true, NULL));
+  EXPECT_EQ(E_ABORT, internal::CompressFile(&source_file1_file_,
+                                            compressed_file,
+                                            NULL,
+                                            NULL,
+                                            get(stop_event)));
+  EXPECT_TRUE(::DeleteFile(compressed_file));
+}
+
+// Reports the space saved by compressing cold packages against the time it
+// takes to get them out of the cache. Run with
+// --gtest_also_run_disabled_tests.
+TEST_F(PackageCacheTest, DISABLED_ColdTierBenchmark) {
+  const int kNumGets = 10;
+
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+  SetCacheCompressionTimeDays(30);
+
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  Key key2(_T("app2"), _T("ver2"), _T("package2"));
+  EXPECT_SUCCEEDED(package_cache_.Put(key1, &source_file1_file_, hash_file1_));
+  EXPECT_SUCCEEDED(package_cache_.Put(key2, &source_file2_file_, hash_file2_));
+  const CString destination_file(GetTempFilename(_T("ut_")));
+
+  HighresTimer plain_timer;
+  for (int i = 0; i != kNumGets; ++i) {
+    EXPECT_SUCCEEDED(package_cache_.Get(key1, destination_file, hash_file1_));
+    EXPECT_SUCCEEDED(package_cache_.Get(key2, destination_file, hash_file2_));
+  }
+  const double plain_ms =
+      static_cast<double>(plain_timer.GetElapsedMs()) / kNumGets;
+
+  const uint64 plain_size = package_cache_.Size();
+  MakeCold(key1);
+  MakeCold(key2);
+  HighresTimer compression_timer;
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.CompressColdPackages(NULL));
+  const int compression_ms = compression_timer.GetElapsedMs();
+  const uint64 compressed_size = package_cache_.Size();
+
+  HighresTimer compressed_timer;
+  for (int i = 0; i != kNumGets; ++i) {
+    EXPECT_SUCCEEDED(package_cache_.Get(key1, destination_file, hash_file1_));
+    EXPECT_SUCCEEDED(package_cache_.Get(key2, destination_file, hash_file2_));
+  }
+  const double compressed_ms =
+      static_cast<double>(compressed_timer.GetElapsedMs()) / kNumGets;
+
+  EXPECT_TRUE(::DeleteFile(destination_file));
+
+  std::wcout << _T("Cache size ") << plain_size << _T(" bytes, ")
+             << compressed_size << _T(" bytes compressed in ")
+             << compression_ms << _T(" ms (")
+             << 100 * (plain_size - compressed_size) / plain_size
+             << _T("% saved). Get ") << plain_ms << _T(" ms plain, ")
+             << compressed_ms << _T(" ms compressed") << std::endl;
+}
+
+TEST_F(PackageCacheTest, Link) {
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  Key key2(_T("app2"), _T("ver2"), _T("package2"));
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND),
+            package_cache_.Link(key2, hash_file1_));
+  EXPECT_EQ(E_INVALIDARG, package_cache_.Link(key2, _T("b")));
+
+  EXPECT_SUCCEEDED(package_cache_.Put(key1, &source_file1_file_, hash_file1_));
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND),
+            package_cache_.Link(key2, hash_file2_));
+
+  EXPECT_SUCCEEDED(package_cache_.Link(key2, hash_file1_));
+  EXPECT_TRUE(package_cache_.IsCached(key2, hash_file1_));
+  EXPECT_EQ(size_file1_, package_cache_.Size());
+
+  // Content that no longer matches its hash is not linked.
+  const CString content_file(BuildContentFileName(hash_file1_));
+  EXPECT_SUCCEEDED(package_cache_.PurgeApp(_T("app2")));
+  {
+    File file;
+    EXPECT_HRESULT_SUCCEEDED(file.Open(content_file, true, false));
+    const byte kGarbage[] = {0xde, 0xad, 0xbe, 0xef};
+    uint32 bytes_written = 0;
+    EXPECT_HRESULT_SUCCEEDED(file.WriteAt(0,
+                                          kGarbage,
+                                          arraysize(kGarbage),
+                                          0,
+                                          &bytes_written));
+  }
+  EXPECT_EQ(SIGS_E_INVALID_SIGNATURE, package_cache_.Link(key2, hash_file1_));
+  EXPECT_FALSE(package_cache_.IsCached(key2, hash_file1_));
+
+  // Caching the package again replaces the corrupt content.
+  EXPECT_SUCCEEDED(package_cache_.Put(key2, &source_file1_file_, hash_file1_));
+  EXPECT_TRUE(package_cache_.IsCached(key2, hash_file1_));
+}
+
+// Content left without keys is deleted when the index is rebuilt.
+TEST_F(PackageCacheTest, RebuildIndexDeletesUnreferencedContent) {
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+
+  Key key1(_T("app1"), _T("version1"), _T("package1"));
+  Key key2(_T("app2"), _T("version2"), _T("package2"));
+  EXPECT_SUCCEEDED(package_cache_.Put(key1, &source_file1_file_, hash_file1_));
+  EXPECT_SUCCEEDED(package_cache_.Put(key2, &source_file2_file_, hash_file2_));
+
+  CString cached_file;
+  EXPECT_HRESULT_SUCCEEDED(BuildCacheFileNameForKey(key1, &cached_file));
+  EXPECT_TRUE(::DeleteFile(cached_file));
+  ::DeleteFile(ConcatenatePath(cache_root_,
+                               PackageCacheIndex::kIndexFileName));
+  ::DeleteFile(ConcatenatePath(cache_root_,
+                               PackageCacheIndex::kJournalFileName));
+
+  PackageCache package_cache;
+  EXPECT_HRESULT_SUCCEEDED(package_cache.Initialize(cache_root_));
+  EXPECT_FALSE(File::Exists(BuildContentFileName(hash_file1_)));
+  EXPECT_TRUE(File::Exists(BuildContentFileName(hash_file2_)));
+  EXPECT_EQ(size_file2_, package_cache.Size());
+  EXPECT_TRUE(package_cache.IsCached(key2, hash_file2_));
+}
+
+// Holding the lock of a package only blocks the callers for that package.
+TEST_F(PackageCacheTest, KeyLockDoesNotBlockOtherKeys) {
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+
+  Key key1(_T("app1"), _T("version1"), _T("package1"));
+  EXPECT_SUCCEEDED(package_cache_.Put(key1, &source_file1_file_, hash_file1_));
+
+  // Finds a package of the same app under another lock stripe.
+  CString package_name;
+  for (int i = 2; ; ++i) {
+    package_name.Format(_T("package%d"), i);
+    if (&GetKeyLock(Key(_T("app1"), _T("version1"), package_name)) !=
+        &GetKeyLock(key1)) {
+      break;
+    }
+  }
+  Key key2(_T("app1"), _T("version1"), package_name);
+  EXPECT_SUCCEEDED(package_cache_.Put(key2, &source_file2_file_, hash_file2_));
+
+  IsCachedRunner runner1(&package_cache_, &key1, hash_file1_);
+  IsCachedRunner runner2(&package_cache_, &key2, hash_file2_);
+  Thread thread1;
+  Thread thread2;
+
+  const RWLock& key1_lock = GetKeyLock(key1);
+  EXPECT_TRUE(key1_lock.Lock());
+
+  EXPECT_TRUE(thread1.Start(&runner1));
+  EXPECT_TRUE(thread2.Start(&runner2));
+  EXPECT_TRUE(thread2.WaitTillExit(10000));
+  EXPECT_TRUE(runner2.is_cached());
+  EXPECT_FALSE(thread1.WaitTillExit(100));
+
+  EXPECT_TRUE(key1_lock.Unlock());
+  EXPECT_TRUE(thread1.WaitTillExit(10000));
+  EXPECT_TRUE(runner1.is_cached());
+}
+
+TEST_F(PackageCacheTest, ConcurrentAccess) {
+  const int kNumThreads = 8;
+  const int kNumIterations = 40;
+  const uint64 kPackageSize = 64 * 1024;
+
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+  RunWorkers(kNumThreads, kNumIterations, kPackageSize);
+
+  // Every version of an app is a link to the same content, which is counted
+  // once, as is the shared package.
+  EXPECT_EQ((kNumThreads + 1) * kPackageSize, package_cache_.Size());
+  EXPECT_EQ(kNumThreads * PackageCacheWorker::kNumVersions + 1,
+            DigestIndexSize(package_cache_));
+
+  // The index written by the workers matches the cache.
+  PackageCache package_cache;
+  EXPECT_HRESULT_SUCCEEDED(package_cache.Initialize(cache_root_));
+  EXPECT_EQ((kNumThreads + 1) * kPackageSize, package_cache.Size());
+}
+
+// Measures the throughput of mixed Put, IsCached, and Get calls as the number
+// of threads grows. Run with --gtest_also_run_disabled_tests.
+TEST_F(PackageCacheTest, DISABLED_ConcurrentAccessBenchmark) {
+  const int kNumOperations = 16000;
+  const uint64 kPackageSize = 16 * 1024;
+
+  for (int num_threads = 1; num_threads <= 16; num_threads *= 2) {
+    EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+
+    HighresTimer timer;
+    const int num_operations = RunWorkers(num_threads,
+                                          kNumOperations / 6 / num_threads,
+                                          kPackageSize);
+    const ULONGLONG elapsed_ms = timer.GetElapsedMs();
+
+    std::wcout << num_threads << _T(" threads: ") << num_operations
+               << _T(" operations in ") << elapsed_ms << _T(" ms, ")
+               << num_operations * 1000.0 / (elapsed_ms ? elapsed_ms : 1)
+               << _T(" operations/s") << std::endl;
+  }
+}
+
+// Measures the cost of sizing and purging a cache of 10000 small packages,
+// compared with walking the cache directory as the cache did before it had an
+// index. Run with --gtest_also_run_disabled_tests.
+TEST_F(PackageCacheTest, DISABLED_SizeAndPurgeBenchmark) {
+  const int kNumPackages = 10000;
+  const int kNumSizeCalls = 1000;
+
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+
+  // The packages differ, otherwise they would be stored once. Creating them
+  // is part of the fill time.
+  HighresTimer fill_timer;
+  for (int i = 0; i != kNumPackages; ++i) {
+    CString app;
+    CString version;
+    app.Format(_T("app%d"), i % 100);
+    version.Format(_T("1.0.0.%d"), i);
+    CString hash;
+    const CString source_file(CreatePackage(4096, i, &hash));
+    ASSERT_HRESULT_SUCCEEDED(PutPackage(Key(app, version, _T("package.bin")),
+                                        source_file,
+                                        hash));
+    EXPECT_TRUE(::DeleteFile(source_file));
+  }
+  const ULONGLONG fill_ms = fill_timer.GetElapsedMs();
+
+  HighresTimer size_timer;
+  uint64 size = 0;
+  for (int i = 0; i != kNumSizeCalls; ++i) {
+    size = package_cache_.Size();
+  }
+  const double size_us =
+      size_timer.GetElapsedMs() * 1000.0 / kNumSizeCalls;
+  EXPECT_EQ(4096ULL * kNumPackages, size);
+
+  HighresTimer walk_timer;
+  std::vector<internal::PackageInfo> packages_info;
+  EXPECT_HRESULT_SUCCEEDED(internal::FindAllPackagesInfo(cache_root_,
+                                                         &packages_info));
+  internal::SortPackageInfoByTime(&packages_info);
+  const ULONGLONG walk_ms = walk_timer.GetElapsedMs();
+  EXPECT_EQ(kNumPackages, packages_info.size());
+
+  HighresTimer load_timer;
+  PackageCache package_cache;
+  EXPECT_HRESULT_SUCCEEDED(package_cache.Initialize(cache_root_));
+  const ULONGLONG load_ms = load_timer.GetElapsedMs();
+  EXPECT_EQ(size, package_cache.Size());
+
+  // Purges half of the packages.
+  SetCacheSizeLimitBytes(size / 2);
+  HighresTimer purge_timer;
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeOldPackagesIfNecessary());
+  const ULONGLONG purge_ms = purge_timer.GetElapsedMs();
+  EXPECT_EQ(size / 2, package_cache_.Size());
+
+  // Nothing left to purge.
+  HighresTimer noop_purge_timer;
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeOldPackagesIfNecessary());
+  const ULONGLONG noop_purge_ms = noop_purge_timer.GetElapsedMs();
+
+  std::wcout << kNumPackages << _T(" packages: fill ") << fill_ms
+             << _T(" ms, Size() ") << size_us << _T(" us, directory walk ")
+             << walk_ms << _T(" ms, index load ") << load_ms
+             << _T(" ms, purge half ") << purge_ms << _T(" ms, purge none ")
+             << noop_purge_ms << _T(" ms") << std::endl;
+}
+
 TEST_F(PackageCacheTest, VerifyHash) {
   EXPECT_HRESULT_SUCCEEDED(PackageCache::VerifyHash(source_file1_,
                                                     hash_file1_));
@@ -18,7 +18,9 @@
 
 #include <atlbase.h>
 #include <atlstr.h>
+#include <algorithm>
 #include <memory>
+#include <vector>
 
 #include "omaha/base/app_util.h"
 #include "omaha/base/const_object_names.h"
@@ -34,6 +36,8 @@
 #include "omaha/base/scoped_impersonation.h"
 #include "omaha/base/system.h"
 #include "omaha/base/utils.h"
+#include "omaha/base/thread.h"
+#include "omaha/base/thread_pool.h"
 #include "omaha/base/thread_pool_callback.h"
 #include "omaha/base/vistautil.h"
 #include "omaha/common/app_registry_utils.h"
@@ -233,6 +237,89 @@ void SendCupFailurePing(bool is_machine,
 
 }  // namespace internal
 
+namespace {
+
+// Compresses the cold packages in the package cache at background priority,
+// stopping as soon as the thread pool shuts down.
+class CompressColdPackagesWorkItem : public UserWorkItem {
+ public:
+  explicit CompressColdPackagesWorkItem(
+      DownloadManagerInterface* download_manager)
+      : download_manager_(download_manager) {}
+
+ private:
+  void DoProcess() override {
+    VERIFY1(::SetThreadPriority(::GetCurrentThread(),
+                                THREAD_MODE_BACKGROUND_BEGIN));
+    HRESULT hr = download_manager_->CompressColdPackages(shutdown_event());
+    CORE_LOG(L3, (_T("[CompressColdPackages returned][0x%08x]"), hr));
+    VERIFY1(::SetThreadPriority(::GetCurrentThread(),
+                                THREAD_MODE_BACKGROUND_END));
+  }
+
+  DownloadManagerInterface* download_manager_;
+
+  DISALLOW_COPY_AND_ASSIGN(CompressColdPackagesWorkItem);
+};
+
+// Downloads an app on a thread of its own, so that the download overlaps the
+// installs of the apps before it in the bundle. The thread impersonates the
+// user of the bundle, like the thread that downloads the apps otherwise does.
+class AppDownloader : public Runnable {
+ public:
+  AppDownloader(App* app, DownloadManagerInterface* download_manager)
+      : app_(app),
+        download_manager_(download_manager),
+        is_download_done_(false) {
+    ASSERT1(app);
+    ASSERT1(download_manager);
+  }
+
+  bool Start() {
+    return thread_.Start(this);
+  }
+
+  // Waits for the download to complete. Returns false if the download did not
+  // run, in which case the caller must download the app.
+  bool Wait() {
+    if (thread_.GetThreadHandle()) {
+      VERIFY1(thread_.WaitTillExit(INFINITE));
+    }
+    return is_download_done_;
+  }
+
+ private:
+  void Run() override {
+    scoped_co_init init_com_apt(COINIT_MULTITHREADED);
+    HRESULT hr = init_com_apt.hresult();
+    if (FAILED(hr)) {
+      CORE_LOG(LE, (_T("[init_com_apt failed][0x%08x]"), hr));
+      return;
+    }
+
+    scoped_impersonation impersonate_user(
+        app_->app_bundle()->impersonation_token());
+    hr = impersonate_user.result();
+    if (FAILED(hr)) {
+      CORE_LOG(LE, (_T("[Impersonation failed][0x%08x]"), hr));
+      return;
+    }
+
+    // This is a blocking call on the network.
+    app_->Download(download_manager_);
+    is_download_done_ = true;
+  }
+
+  App* app_;
+  DownloadManagerInterface* download_manager_;
+  bool is_download_done_;
+  Thread thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(AppDownloader);
+};
+
+}  // namespace
+
 Worker::Worker()
     : is_machine_(false),
       lock_count_(0),
@@ -335,6 +422,17 @@ HRESULT Worker::Initialize(bool is_machine) {
     return hr;
   }
 
+  if (ConfigManager::Instance()->GetPackageCacheCompressionTimeDays() > 0) {
+    auto work_item = std::make_unique<CompressColdPackagesWorkItem>(
+        download_manager_.get());
+    hr = Goopdate::Instance().QueueUserWorkItem(std::move(work_item),
+                                                COINIT_MULTITHREADED,
+                                                WT_EXECUTELONGFUNCTION);
+    if (FAILED(hr)) {
+      CORE_LOG(LW, (_T("[failed to queue package compression][0x%08x]"), hr));
+    }
+  }
+
   install_manager_.reset(new InstallManager(&model_->lock(), is_machine_));
   hr = install_manager_->Initialize();
   if (FAILED(hr)) {
@@ -630,17 +728,46 @@ void Worker::DownloadAndInstallHelper(AppBundle* app_bundle) {
 
   const size_t num_apps = app_bundle->GetNumberOfApps();
 
+  // Up to |download_ahead| apps after the app being installed are downloaded
+  // on threads of their own while it installs. The apps are still installed
+  // one at a time and in order.
+  const size_t download_ahead = static_cast<size_t>(
+      ConfigManager::Instance()->GetDownloadAheadApps());
+  std::vector<std::unique_ptr<AppDownloader>> downloaders(num_apps);
+  size_t num_downloaders = 0;
+
   for (size_t i = 0; i != num_apps; ++i) {
     App* app = app_bundle->GetApp(i);
 
-    ASSERT1(app->state() == STATE_WAITING_TO_DOWNLOAD ||
-            app->state() == STATE_WAITING_TO_INSTALL ||
-            app->state() == STATE_NO_UPDATE ||
-            app->state() == STATE_ERROR);
+    const size_t last_download =
+        download_ahead ? std::min(i + download_ahead, num_apps - 1) : 0;
+    for (; download_ahead && num_downloaders <= last_download;
+         ++num_downloaders) {
+      App* next_app = app_bundle->GetApp(num_downloaders);
+      ASSERT1(next_app->state() == STATE_WAITING_TO_DOWNLOAD ||
+              next_app->state() == STATE_WAITING_TO_INSTALL ||
+              next_app->state() == STATE_NO_UPDATE ||
+              next_app->state() == STATE_ERROR);
+
+      downloaders[num_downloaders].reset(
+          new AppDownloader(next_app, download_manager_.get()));
+      if (!downloaders[num_downloaders]->Start()) {
+        CORE_LOG(LW, (_T("[AppDownloader::Start failed][%s]"),
+                      next_app->app_guid_string()));
+      }
+    }
 
-    // Download the app if it has not already been downloaded.
-    // This is a blocking call on the network.
-    app->Download(download_manager_.get());
+    const bool is_downloaded = downloaders[i].get() && downloaders[i]->Wait();
+    if (!is_downloaded) {
+      ASSERT1(app->state() == STATE_WAITING_TO_DOWNLOAD ||
+              app->state() == STATE_WAITING_TO_INSTALL ||
+              app->state() == STATE_NO_UPDATE ||
+              app->state() == STATE_ERROR);
+
+      // Download the app if it has not already been downloaded.
+      // This is a blocking call on the network.
+      app->Download(download_manager_.get());
+    }
 
     ASSERT1(app->state() == STATE_READY_TO_INSTALL ||    // Downloaded above.
             app->state() == STATE_WAITING_TO_INSTALL ||  // Downloaded earlier.
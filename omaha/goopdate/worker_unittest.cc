@@ -159,6 +159,8 @@ class MockDownloadManager : public DownloadManagerInterface {
       HRESULT(const CString&, const CString&));
   MOCK_METHOD3(CachePackage,
       HRESULT(const Package*, File*, const CString*));
+  MOCK_METHOD1(CompressColdPackages,
+      HRESULT(HANDLE stop_event));
   MOCK_METHOD1(DownloadApp,
       HRESULT(App* app));
   MOCK_METHOD1(DownloadPackage,
@@ -515,6 +517,51 @@ TEST_F(WorkerMockedManagersTest, DownloadAndInstallAsync_NotAlreadyDownloaded) {
   EXPECT_EQ(STATE_INSTALL_COMPLETE, app2_->state());
 }
 
+// The second app downloads while the first one installs. The apps are still
+// installed in order, each after its own download.
+TEST_F(WorkerMockedManagersTest, DownloadAndInstallAsync_DownloadAhead) {
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueDownloadAheadApps,
+                                    static_cast<DWORD>(1)));
+
+  SetAppStateUpdateAvailable(app1_);
+  SetAppStateUpdateAvailable(app2_);
+
+  EXPECT_CALL(*mock_install_manager_, install_working_dir())
+      .WillRepeatedly(Return(app_util::GetTempDir()));
+
+  {
+    ::testing::Sequence app1_sequence, app2_sequence;
+    EXPECT_CALL(*mock_download_manager_, DownloadApp(app1_))
+        .InSequence(app1_sequence)
+        .WillOnce(SimulateDownloadAppStateTransition());
+    EXPECT_CALL(*mock_download_manager_, DownloadApp(app2_))
+        .InSequence(app2_sequence)
+        .WillOnce(SimulateDownloadAppStateTransition());
+    EXPECT_CALL(*mock_install_manager_, InstallApp(app1_, _))
+        .InSequence(app1_sequence, app2_sequence)
+        .WillOnce(SimulateInstallAppStateTransition());
+    EXPECT_CALL(*mock_install_manager_, InstallApp(app2_, _))
+        .InSequence(app2_sequence)
+        .WillOnce(SimulateInstallAppStateTransition());
+  }
+
+  __mutexBlock(worker_->model()->lock()) {
+    EXPECT_SUCCEEDED(worker_->DownloadAndInstallAsync(app_bundle_.get()));
+
+    SetAppBundleStateForUnitTest(app_bundle_.get(),
+                                 new fsm::AppBundleStateBusy);
+    EXPECT_TRUE(app_bundle_->IsBusy());
+  }
+
+  WaitForBundleToBeReady(*app_bundle_, 5);
+  EXPECT_EQ(STATE_INSTALL_COMPLETE, app1_->state());
+  EXPECT_EQ(STATE_INSTALL_COMPLETE, app2_->state());
+
+  EXPECT_SUCCEEDED(RegKey::DeleteValue(MACHINE_REG_UPDATE_DEV,
+                                       kRegValueDownloadAheadApps));
+}
+
 TEST_F(WorkerMockedManagersTest, DownloadAsync_Then_DownloadAndInstallAsync) {
   SetAppStateUpdateAvailable(app1_);
   SetAppStateUpdateAvailable(app2_);
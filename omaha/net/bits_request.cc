@@ -727,10 +727,10 @@ HRESULT BitsRequest::NotifyProgress() {
   }
 
   ASSERT1(progress.FilesTotal == 1);
-  ASSERT1(progress.BytesTransferred <= INT_MAX);
-  ASSERT1(progress.BytesTotal <= INT_MAX);
-  callback_->OnProgress(static_cast<int>(progress.BytesTransferred),
-                        static_cast<int>(progress.BytesTotal),
+  const uint64 bytes_total = progress.BytesTotal == BG_SIZE_UNKNOWN ?
+                             0 : progress.BytesTotal;
+  callback_->OnProgress(progress.BytesTransferred,
+                        bytes_total,
                         WINHTTP_CALLBACK_STATUS_READ_COMPLETE,
                         NULL);
   return S_OK;
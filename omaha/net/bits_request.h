@@ -56,8 +56,8 @@ class BitsRequest : public HttpRequestInterface {
 
   virtual HRESULT Resume();
 
-  virtual std::vector<uint8> GetResponse() const {
-    return std::vector<uint8>();
+  virtual ResponseBuffer GetResponse() const {
+    return ResponseBuffer();
   }
 
   // TODO(omaha): BITS provides access to headers on Windows Vista.
@@ -120,6 +120,12 @@ class BitsRequest : public HttpRequestInterface {
 
   virtual bool download_metrics(DownloadMetrics* download_metrics) const;
 
+  // BITS writes the file, so there is no digest.
+  virtual bool download_digest(std::vector<uint8>* digest) const {
+    UNREFERENCED_PARAMETER(digest);
+    return false;
+  }
+
   // Sets the minimum length of time that BITS waits after encountering a
   // transient error condition before trying to transfer the file.
   // The default value is 600 seconds.
@@ -0,0 +1,227 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/net/connection_pool.h"
+
+#include "omaha/base/debug.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/time.h"
+#include "omaha/base/utils.h"
+
+namespace omaha {
+
+class ConnectionPool::WinHttpDelegate : public ConnectionPool::Delegate {
+ public:
+  WinHttpDelegate() : http_client_(CreateHttpClient()) {
+    ASSERT1(http_client_.get());
+    VERIFY_SUCCEEDED(http_client_->Initialize());
+  }
+
+  uint64 GetTimeMs() override {
+    return GetCurrentMsTime();
+  }
+
+  void CloseConnection(HINTERNET connection_handle) override {
+    VERIFY_SUCCEEDED(http_client_->Close(connection_handle));
+  }
+
+ private:
+  std::unique_ptr<HttpClient> http_client_;
+
+  DISALLOW_COPY_AND_ASSIGN(WinHttpDelegate);
+};
+
+ConnectionPool* ConnectionPool::instance_ = NULL;
+LLock ConnectionPool::instance_lock_;
+
+bool ConnectionPool::Key::operator<(const Key& other) const {
+  if (session_handle != other.session_handle) {
+    return session_handle < other.session_handle;
+  }
+  if (port != other.port) {
+    return port < other.port;
+  }
+  int result = scheme.CompareNoCase(other.scheme);
+  if (result) {
+    return result < 0;
+  }
+  result = server.CompareNoCase(other.server);
+  if (result) {
+    return result < 0;
+  }
+  return proxy.CompareNoCase(other.proxy) < 0;
+}
+
+ConnectionPool::ConnectionPool(Delegate* delegate)
+    : delegate_(delegate ? delegate : new WinHttpDelegate) {
+}
+
+ConnectionPool::~ConnectionPool() {
+  std::vector<HINTERNET> connections;
+  __mutexBlock(lock_) {
+    for (IdleConnectionMap::const_iterator it = idle_connections_.begin();
+         it != idle_connections_.end();
+         ++it) {
+      for (size_t i = 0; i != it->second.size(); ++i) {
+        connections.push_back(it->second[i].handle);
+      }
+    }
+    idle_connections_.clear();
+  }
+  CloseConnections(connections);
+}
+
+ConnectionPool& ConnectionPool::Instance() {
+  __mutexScope(instance_lock_);
+  if (!instance_) {
+    instance_ = new ConnectionPool(NULL);
+  }
+  return *instance_;
+}
+
+void ConnectionPool::DeleteInstance() {
+  ConnectionPool* instance = omaha::interlocked_exchange_pointer(
+      &instance_, static_cast<ConnectionPool*>(NULL));
+  delete instance;
+}
+
+void ConnectionPool::CloseSessionConnections(HINTERNET session_handle) {
+  __mutexScope(instance_lock_);
+  if (instance_) {
+    instance_->CloseSession(session_handle);
+  }
+}
+
+HINTERNET ConnectionPool::Borrow(const Key& key) {
+  std::vector<HINTERNET> expired;
+  HINTERNET connection_handle = NULL;
+
+  __mutexBlock(lock_) {
+    RemoveExpiredConnections(delegate_->GetTimeMs(), &expired);
+
+    // The most recently used handle is the most likely to still have a live
+    // connection.
+    IdleConnectionMap::iterator it = idle_connections_.find(key);
+    if (it != idle_connections_.end()) {
+      ASSERT1(!it->second.empty());
+      connection_handle = it->second.back().handle;
+      it->second.pop_back();
+      if (it->second.empty()) {
+        idle_connections_.erase(it);
+      }
+    }
+  }
+
+  CloseConnections(expired);
+
+  NET_LOG(L3, (_T("[ConnectionPool::Borrow][%s://%s:%d][0x%p]"),
+               key.scheme, key.server, key.port, connection_handle));
+  return connection_handle;
+}
+
+void ConnectionPool::Return(const Key& key, HINTERNET connection_handle) {
+  ASSERT1(connection_handle);
+
+  NET_LOG(L3, (_T("[ConnectionPool::Return][%s://%s:%d][0x%p]"),
+               key.scheme, key.server, key.port, connection_handle));
+
+  std::vector<HINTERNET> expired;
+  __mutexBlock(lock_) {
+    const uint64 now_ms = delegate_->GetTimeMs();
+    RemoveExpiredConnections(now_ms, &expired);
+
+    std::vector<IdleConnection>& connections = idle_connections_[key];
+    const size_t max_connections = kMaxIdleConnectionsPerKey;
+    if (connections.size() == max_connections) {
+      expired.push_back(connections.front().handle);
+      connections.erase(connections.begin());
+    }
+
+    IdleConnection connection = {connection_handle, now_ms};
+    connections.push_back(connection);
+  }
+
+  CloseConnections(expired);
+}
+
+void ConnectionPool::CloseSession(HINTERNET session_handle) {
+  std::vector<HINTERNET> connections;
+  __mutexBlock(lock_) {
+    IdleConnectionMap::iterator it = idle_connections_.begin();
+    while (it != idle_connections_.end()) {
+      if (it->first.session_handle != session_handle) {
+        ++it;
+        continue;
+      }
+      for (size_t i = 0; i != it->second.size(); ++i) {
+        connections.push_back(it->second[i].handle);
+      }
+      it = idle_connections_.erase(it);
+    }
+  }
+  CloseConnections(connections);
+}
+
+int ConnectionPool::num_idle_connections() const {
+  __mutexScope(lock_);
+  size_t num_connections = 0;
+  for (IdleConnectionMap::const_iterator it = idle_connections_.begin();
+       it != idle_connections_.end();
+       ++it) {
+    num_connections += it->second.size();
+  }
+  return static_cast<int>(num_connections);
+}
+
+void ConnectionPool::RemoveExpiredConnections(
+    uint64 now_ms,
+    std::vector<HINTERNET>* expired) {
+  ASSERT1(expired);
+
+  IdleConnectionMap::iterator it = idle_connections_.begin();
+  while (it != idle_connections_.end()) {
+    // The handles of a key are ordered from the least to the most recently
+    // returned one. A clock set back expires the handles too, since their
+    // idle time is no longer known.
+    std::vector<IdleConnection>& connections = it->second;
+    size_t num_expired = 0;
+    while (num_expired != connections.size()) {
+      const uint64 idle_since_ms = connections[num_expired].idle_since_ms;
+      if (now_ms >= idle_since_ms && now_ms - idle_since_ms < kIdleTimeoutMs) {
+        break;
+      }
+      expired->push_back(connections[num_expired].handle);
+      ++num_expired;
+    }
+    connections.erase(connections.begin(), connections.begin() + num_expired);
+
+    if (connections.empty()) {
+      it = idle_connections_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void ConnectionPool::CloseConnections(
+    const std::vector<HINTERNET>& connections) {
+  for (size_t i = 0; i != connections.size(); ++i) {
+    NET_LOG(L3, (_T("[ConnectionPool::CloseConnections][0x%p]"),
+                 connections[i]));
+    delegate_->CloseConnection(connections[i]);
+  }
+}
+
+}  // namespace omaha
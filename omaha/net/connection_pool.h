@@ -0,0 +1,128 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// ConnectionPool keeps the WinHttp connection handles of completed requests,
+// so that the next request to the same server borrows one instead of
+// connecting anew. WinHttp keeps the idle keep-alive connections of a server
+// for as long as the server has an open connection handle in the session. A
+// request on a borrowed handle reuses the TCP connection and the TLS session
+// of the request before it, and skips the name resolution, the connect and
+// the TLS handshake. Without the pool, the update check, the download and the
+// ping each close the last handle to the server when they complete.
+//
+// The handles are keyed by everything that makes two connections different:
+// the session, the scheme, the server, the port, and the proxy. A handle is
+// only returned to the pool when its request completed cleanly and the server
+// did not ask to close the connection. Handles idle for too long are closed,
+// since the server has most likely closed their connections by then.
+
+#ifndef OMAHA_NET_CONNECTION_POOL_H_
+#define OMAHA_NET_CONNECTION_POOL_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "omaha/base/synchronized.h"
+#include "omaha/net/winhttp.h"
+
+namespace omaha {
+
+class ConnectionPool {
+ public:
+  struct Key {
+    Key() : session_handle(NULL), port(0) {}
+
+    bool operator<(const Key& other) const;
+
+    HINTERNET session_handle;
+    CString scheme;
+    CString server;
+    int port;
+    CString proxy;
+  };
+
+  // Closes the handles and provides the time to the pool. Tests replace it.
+  class Delegate {
+   public:
+    virtual ~Delegate() {}
+    virtual uint64 GetTimeMs() = 0;
+    virtual void CloseConnection(HINTERNET connection_handle) = 0;
+  };
+
+  // A handle idle for this long is closed instead of being reused.
+  static const int kIdleTimeoutMs = 60000;
+
+  // The pool keeps this many idle handles per key at most.
+  static const int kMaxIdleConnectionsPerKey = 4;
+
+  // Takes ownership of |delegate|. Closes the handles with WinHttp if
+  // |delegate| is NULL.
+  explicit ConnectionPool(Delegate* delegate);
+  ~ConnectionPool();
+
+  static ConnectionPool& Instance();
+  static void DeleteInstance();
+
+  // Closes the pooled handles of a session before the session is closed. Does
+  // nothing if the pool of the process has not been created.
+  static void CloseSessionConnections(HINTERNET session_handle);
+
+  // Returns an idle connection handle for |key|, which the caller then owns,
+  // or NULL if there is none.
+  HINTERNET Borrow(const Key& key);
+
+  // Takes ownership of the |connection_handle| of a request that completed
+  // cleanly, for the next request with the same |key|.
+  void Return(const Key& key, HINTERNET connection_handle);
+
+  // Closes the idle handles of |session_handle|.
+  void CloseSession(HINTERNET session_handle);
+
+  int num_idle_connections() const;
+
+ private:
+  struct IdleConnection {
+    HINTERNET handle;
+    uint64 idle_since_ms;
+  };
+
+  typedef std::map<Key, std::vector<IdleConnection> > IdleConnectionMap;
+
+  // Moves the handles idle for too long to |expired|.
+  void RemoveExpiredConnections(uint64 now_ms,
+                                std::vector<HINTERNET>* expired);
+
+  void CloseConnections(const std::vector<HINTERNET>& connections);
+
+  class WinHttpDelegate;
+
+  std::unique_ptr<Delegate> delegate_;
+
+  LLock lock_;
+  IdleConnectionMap idle_connections_;
+
+  static ConnectionPool* instance_;
+  static LLock instance_lock_;
+
+  DISALLOW_COPY_AND_ASSIGN(ConnectionPool);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_NET_CONNECTION_POOL_H_
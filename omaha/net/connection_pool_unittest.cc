@@ -0,0 +1,208 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "omaha/net/connection_pool.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+// Fake handles. The pool never dereferences them.
+HINTERNET MakeHandle(int i) {
+  return reinterpret_cast<HINTERNET>(static_cast<DWORD_PTR>(0x1000 + i));
+}
+
+class FakeDelegate : public ConnectionPool::Delegate {
+ public:
+  FakeDelegate() : now_ms_(1000000), closed_on_delete_(NULL) {}
+
+  ~FakeDelegate() override {
+    if (closed_on_delete_) {
+      *closed_on_delete_ = closed_;
+    }
+  }
+
+  uint64 GetTimeMs() override { return now_ms_; }
+
+  void CloseConnection(HINTERNET connection_handle) override {
+    closed_.push_back(connection_handle);
+  }
+
+  void Advance(uint64 ms) { now_ms_ += ms; }
+  void SetBack(uint64 ms) { now_ms_ -= ms; }
+
+  bool IsClosed(HINTERNET connection_handle) const {
+    return std::find(closed_.begin(), closed_.end(), connection_handle) !=
+           closed_.end();
+  }
+
+  int num_closed() const { return static_cast<int>(closed_.size()); }
+
+  void set_closed_on_delete(std::vector<HINTERNET>* closed) {
+    closed_on_delete_ = closed;
+  }
+
+ private:
+  uint64 now_ms_;
+  std::vector<HINTERNET> closed_;
+  std::vector<HINTERNET>* closed_on_delete_;
+
+  DISALLOW_COPY_AND_ASSIGN(FakeDelegate);
+};
+
+}  // namespace
+
+class ConnectionPoolTest : public testing::Test {
+ protected:
+  ConnectionPoolTest() : delegate_(NULL) {}
+
+  virtual void SetUp() {
+    delegate_ = new FakeDelegate;
+    pool_.reset(new ConnectionPool(delegate_));
+
+    key_.session_handle = MakeHandle(0);
+    key_.scheme = _T("https");
+    key_.server = _T("update.googleapis.com");
+    key_.port = 443;
+  }
+
+  virtual void TearDown() {
+    pool_.reset();
+    delegate_ = NULL;
+  }
+
+  FakeDelegate* delegate_;    // Owned by |pool_|.
+  std::unique_ptr<ConnectionPool> pool_;
+  ConnectionPool::Key key_;
+};
+
+TEST_F(ConnectionPoolTest, BorrowAndReturn) {
+  EXPECT_EQ(NULL, pool_->Borrow(key_));
+
+  pool_->Return(key_, MakeHandle(1));
+  pool_->Return(key_, MakeHandle(2));
+  EXPECT_EQ(2, pool_->num_idle_connections());
+
+  // The most recently returned handle is borrowed first.
+  EXPECT_EQ(MakeHandle(2), pool_->Borrow(key_));
+  EXPECT_EQ(MakeHandle(1), pool_->Borrow(key_));
+  EXPECT_EQ(NULL, pool_->Borrow(key_));
+  EXPECT_EQ(0, pool_->num_idle_connections());
+  EXPECT_EQ(0, delegate_->num_closed());
+}
+
+TEST_F(ConnectionPoolTest, Keys) {
+  pool_->Return(key_, MakeHandle(1));
+
+  ConnectionPool::Key key(key_);
+  key.scheme = _T("http");
+  key.port = 80;
+  EXPECT_EQ(NULL, pool_->Borrow(key));
+
+  key = key_;
+  key.proxy = _T("proxy.example.com:8080");
+  EXPECT_EQ(NULL, pool_->Borrow(key));
+
+  key = key_;
+  key.session_handle = MakeHandle(100);
+  EXPECT_EQ(NULL, pool_->Borrow(key));
+
+  key = key_;
+  key.server = _T("dl.google.com");
+  EXPECT_EQ(NULL, pool_->Borrow(key));
+
+  // Host names are not case sensitive.
+  key = key_;
+  key.server = _T("Update.GoogleApis.com");
+  EXPECT_EQ(MakeHandle(1), pool_->Borrow(key));
+}
+
+TEST_F(ConnectionPoolTest, IdleTimeout) {
+  pool_->Return(key_, MakeHandle(1));
+  delegate_->Advance(ConnectionPool::kIdleTimeoutMs / 2);
+  pool_->Return(key_, MakeHandle(2));
+
+  // The first handle expires, and is closed.
+  delegate_->Advance(ConnectionPool::kIdleTimeoutMs / 2);
+  EXPECT_EQ(MakeHandle(2), pool_->Borrow(key_));
+  EXPECT_TRUE(delegate_->IsClosed(MakeHandle(1)));
+  EXPECT_EQ(0, pool_->num_idle_connections());
+
+  pool_->Return(key_, MakeHandle(2));
+  delegate_->Advance(ConnectionPool::kIdleTimeoutMs);
+  EXPECT_EQ(NULL, pool_->Borrow(key_));
+  EXPECT_TRUE(delegate_->IsClosed(MakeHandle(2)));
+}
+
+// The idle time of the handles is not known once the clock is set back.
+TEST_F(ConnectionPoolTest, ClockSetBack) {
+  pool_->Return(key_, MakeHandle(1));
+  delegate_->SetBack(1000);
+  EXPECT_EQ(NULL, pool_->Borrow(key_));
+  EXPECT_TRUE(delegate_->IsClosed(MakeHandle(1)));
+}
+
+TEST_F(ConnectionPoolTest, MaxIdleConnectionsPerKey) {
+  const int max_connections = ConnectionPool::kMaxIdleConnectionsPerKey;
+  for (int i = 0; i != max_connections + 1; ++i) {
+    pool_->Return(key_, MakeHandle(i));
+  }
+
+  // The least recently returned handle is closed to make room.
+  EXPECT_EQ(max_connections, pool_->num_idle_connections());
+  EXPECT_EQ(1, delegate_->num_closed());
+  EXPECT_TRUE(delegate_->IsClosed(MakeHandle(0)));
+}
+
+TEST_F(ConnectionPoolTest, CloseSession) {
+  ConnectionPool::Key other_key(key_);
+  other_key.session_handle = MakeHandle(100);
+
+  pool_->Return(key_, MakeHandle(1));
+  pool_->Return(other_key, MakeHandle(2));
+
+  pool_->CloseSession(key_.session_handle);
+  EXPECT_TRUE(delegate_->IsClosed(MakeHandle(1)));
+  EXPECT_FALSE(delegate_->IsClosed(MakeHandle(2)));
+  EXPECT_EQ(NULL, pool_->Borrow(key_));
+  EXPECT_EQ(MakeHandle(2), pool_->Borrow(other_key));
+}
+
+// The pool closes its idle handles when it is deleted.
+TEST_F(ConnectionPoolTest, Destructor) {
+  pool_->Return(key_, MakeHandle(1));
+  pool_->Return(key_, MakeHandle(2));
+  EXPECT_EQ(0, delegate_->num_closed());
+
+  // The delegate is deleted with the pool, so it reports its closed handles
+  // to the test first.
+  std::vector<HINTERNET> closed;
+  delegate_->set_closed_on_delete(&closed);
+  pool_.reset();
+  delegate_ = NULL;
+
+  ASSERT_EQ(2u, closed.size());
+  EXPECT_TRUE(std::find(closed.begin(), closed.end(), MakeHandle(1)) !=
+              closed.end());
+  EXPECT_TRUE(std::find(closed.begin(), closed.end(), MakeHandle(2)) !=
+              closed.end());
+}
+
+}  // namespace omaha
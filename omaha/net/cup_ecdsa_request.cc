@@ -50,17 +50,22 @@ const uint8 CupEcdsaRequestImpl::kCupTestPublicKey[] =
 #include "omaha/net/cup_ecdsa_pubkey.3.h"
 ;   // NOLINT
 
+const EcdsaPublicKey& CupEcdsaRequestImpl::GetPublicKey() {
+  if (NetworkConfig::IsUsingCupTestKeys()) {
+    static const EcdsaPublicKey test_key(kCupTestPublicKey);
+    return test_key;
+  }
+
+  static const EcdsaPublicKey production_key(kCupProductionPublicKey);
+  return production_key;
+}
+
 CupEcdsaRequestImpl::CupEcdsaRequestImpl(HttpRequestInterface* http_request)
     : request_buffer_(NULL),
-      request_buffer_length_(0) {
+      request_buffer_length_(0),
+      public_key_(GetPublicKey()) {
   ASSERT1(http_request);
 
-  // Load the appropriate ECC public key.
-  const uint8* const encoded_public_key =
-      NetworkConfig::IsUsingCupTestKeys() ? kCupTestPublicKey :
-                                            kCupProductionPublicKey;
-  public_key_.DecodeFromBuffer(encoded_public_key);
-
   // Store the inner HTTP request.
   http_request_.reset(http_request);
 
@@ -110,7 +115,7 @@ HRESULT CupEcdsaRequestImpl::Resume() {
   return http_request_->Resume();
 }
 
-std::vector<uint8> CupEcdsaRequestImpl::GetResponse() const {
+ResponseBuffer CupEcdsaRequestImpl::GetResponse() const {
   return http_request_->GetResponse();
 }
 
@@ -232,7 +237,7 @@ HRESULT CupEcdsaRequestImpl::DoSend() {
   }
 
   // Save the response body, and make sure we got an HTTP 200 or 206.
-  http_request_->GetResponse().swap(cup_->response);
+  cup_->response = http_request_->GetResponse();
   int status_code(http_request_->GetHttpStatusCode());
   if (status_code != HTTP_STATUS_OK &&
       status_code != HTTP_STATUS_PARTIAL_CONTENT) {
@@ -240,7 +245,7 @@ HRESULT CupEcdsaRequestImpl::DoSend() {
     return HRESULTFromHttpStatusCode(status_code);
   }
   NET_LOG(L5, (_T("[CUP-ECDSA response][%s]"),
-               VectorToPrintableString(cup_->response)));
+               ResponseBufferToPrintableString(cup_->response)));
 
   // Get the server signature out of the ETag string; it will contain the
   // ECDSA signature and the SHA-256 hash of the observed client request.
@@ -265,7 +270,8 @@ HRESULT CupEcdsaRequestImpl::AuthenticateResponse() {
   NET_LOG(L4, (_T("[CUP-ECDSA][etag:        %s]"), cup_->etag));
 
   if (cup_->etag.IsEmpty()) {
-    CString response_as_string = Utf8BufferToWideChar(cup_->response);
+    CString response_as_string =
+        Utf8BufferToWideChar(cup_->response.ToVector());
     if (NULL == stristrW(response_as_string, L"<response") &&
         NULL != stristrW(response_as_string, L"<html")) {
       NET_LOG(L4, (_T("[CUP-ECDSA][Captive portal detected, aborting]")));
@@ -278,9 +284,10 @@ HRESULT CupEcdsaRequestImpl::AuthenticateResponse() {
     }
   }
 
-  // Compute the hash of the response body.  (Should be in UTF-8.)
+  // The hash of the response body was computed as the body was received.
+  // (Should be in UTF-8.)
   std::vector<uint8> response_hash;
-  VERIFY1(SafeSHA256Hash(cup_->response, &response_hash));
+  cup_->response.GetDigest(&response_hash);
   NET_LOG(L4, (_T("[CUP-ECDSA][resp hash][%s]"), BytesToHex(response_hash)));
 
   // Parse the ETag into its respective components.
@@ -438,7 +445,7 @@ HRESULT CupEcdsaRequest::Resume() {
   return impl_->Resume();
 }
 
-std::vector<uint8> CupEcdsaRequest::GetResponse() const {
+ResponseBuffer CupEcdsaRequest::GetResponse() const {
   return impl_->GetResponse();
 }
 
@@ -511,4 +518,9 @@ bool CupEcdsaRequest::download_metrics(DownloadMetrics* dm) const {
   return false;
 }
 
+bool CupEcdsaRequest::download_digest(std::vector<uint8>* digest) const {
+  UNREFERENCED_PARAMETER(digest);
+  return false;
+}
+
 }   // namespace omaha
@@ -54,7 +54,7 @@ class CupEcdsaRequest : public HttpRequestInterface {
 
   virtual HRESULT Resume();
 
-  virtual std::vector<uint8> GetResponse() const;
+  virtual ResponseBuffer GetResponse() const;
 
   virtual HRESULT QueryHeadersString(uint32 info_level,
                                      const TCHAR* name,
@@ -90,6 +90,8 @@ class CupEcdsaRequest : public HttpRequestInterface {
 
   virtual bool download_metrics(DownloadMetrics* download_metrics) const;
 
+  virtual bool download_digest(std::vector<uint8>* digest) const;
+
  private:
   friend class CupEcdsaRequestTest;
 
@@ -22,6 +22,7 @@
 
 #include "base/basictypes.h"
 #include "omaha/net/cup_ecdsa_utils.h"
+#include "omaha/net/response_buffer.h"
 
 namespace omaha {
 
@@ -40,7 +41,7 @@ class CupEcdsaRequestImpl {
   HRESULT Cancel();
   HRESULT Pause();
   HRESULT Resume();
-  std::vector<uint8> GetResponse() const;
+  ResponseBuffer GetResponse() const;
   HRESULT QueryHeadersString(uint32 info_level,
                                     const TCHAR* name,
                                     CString* value) const;
@@ -71,6 +72,10 @@ class CupEcdsaRequestImpl {
                               EcdsaSignature* sig_out,
                               std::vector<uint8>* req_hash_out);
 
+  // Returns the server public key selected by NetworkConfig. Each key is
+  // decoded, along with its verification table, once per process.
+  static const EcdsaPublicKey& GetPublicKey();
+
   // The transient state of the request, so that we can start always with a
   // clean slate even though the same instance is being reuse across requests.
   struct TransientCupState {
@@ -82,7 +87,7 @@ class CupEcdsaRequestImpl {
     CString cup2hreq;                  // Query parameter: request hash
     CString request_url;               // Complete URL of the request.
 
-    std::vector<uint8> response;       // The received response body.
+    ResponseBuffer response;           // The received response body.
     CString etag;                      // The ETag header from the response.
 
     EcdsaSignature signature;          // The decoded ECDSA signature.
@@ -97,7 +102,7 @@ class CupEcdsaRequestImpl {
   typedef const uint8 PublicKeyInstance[];
   typedef const uint8* PublicKey;
 
-  EcdsaPublicKey public_key_;                      // Server public key.
+  const EcdsaPublicKey& public_key_;               // Server public key.
   std::unique_ptr<HttpRequestInterface> http_request_;  // Inner http request.
 
   static const PublicKeyInstance kCupProductionPublicKey;
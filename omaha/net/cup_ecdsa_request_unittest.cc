@@ -95,7 +95,7 @@ class CupEcdsaRequestTest : public testing::Test {
     int http_status = http_request->GetHttpStatusCode();
     EXPECT_TRUE(http_status == HTTP_STATUS_OK ||
                 http_status == HTTP_STATUS_PARTIAL_CONTENT);
-    std::vector<uint8> response(http_request->GetResponse());
+    std::vector<uint8> response(http_request->GetResponse().ToVector());
   }
 
   bool DoParseServerETag(const CString& etag) {
@@ -245,9 +245,15 @@ const uint8* EcdsaSignature::DecodeDerInt256(const uint8* buffer_begin,
   return int_data + int_data_len;
 }
 
-EcdsaPublicKey::EcdsaPublicKey() : version_(0) {
+EcdsaPublicKey::EcdsaPublicKey() : is_valid_(false), version_(0) {
   p256_init(&gx_);
   p256_init(&gy_);
+  memset(&precomp_, 0, sizeof(precomp_));
+}
+
+EcdsaPublicKey::EcdsaPublicKey(const uint8* encoded_pkey_in)
+    : is_valid_(false), version_(0) {
+  DecodeFromBuffer(encoded_pkey_in);
 }
 
 // Decodes a buffer produced by cup_ecdsa_tool into a public key and version
@@ -269,6 +275,8 @@ void EcdsaPublicKey::DecodeFromBuffer(const uint8* encoded_pkey_in) {
   // header byte. We don't bother implementing support for these encodings,
   // since we control the production of public keys.
 
+  is_valid_ = false;
+
   ASSERT1(encoded_pkey_in[0] > 0);
   version_ = encoded_pkey_in[0];
 
@@ -276,7 +284,15 @@ void EcdsaPublicKey::DecodeFromBuffer(const uint8* encoded_pkey_in) {
   p256_from_bin(&encoded_pkey_in[2], &gx_);
   p256_from_bin(&encoded_pkey_in[2 + P256_NBYTES], &gy_);
 
-  ASSERT1(p256_is_valid_point(&gx_, &gy_));
+  // p256_ecdsa_verify_precomp does not check the key, so a key that is not a
+  // point of the curve is rejected here, in release builds too.
+  if (!p256_is_valid_point(&gx_, &gy_)) {
+    ASSERT(false, (_T("[invalid ECDSA public key][%d]"), version_));
+    return;
+  }
+
+  p256_precomp_init(&gx_, &gy_, &precomp_);
+  is_valid_ = true;
 }
 
 // We expect |spki| to contain a DER-encoded SubjectPublicKeyInfo value holding
@@ -314,6 +330,8 @@ bool EcdsaPublicKey::DecodeSubjectPublicKeyInfo(
     const std::vector<uint8>& spki) {
   ASSERT1(!spki.empty());
 
+  is_valid_ = false;
+
   const uint8* const buffer_begin = &spki[0];
   const uint8* const buffer_end = buffer_begin + spki.size();
 
@@ -365,7 +383,13 @@ bool EcdsaPublicKey::DecodeSubjectPublicKeyInfo(
   p256_from_bin(&encoded_pkey_in[2], &gx_);
   p256_from_bin(&encoded_pkey_in[2 + P256_NBYTES], &gy_);
 
-  return !!p256_is_valid_point(&gx_, &gy_);
+  if (!p256_is_valid_point(&gx_, &gy_)) {
+    return false;
+  }
+
+  p256_precomp_init(&gx_, &gy_, &precomp_);
+  is_valid_ = true;
+  return true;
 }
 
 COMPILE_ASSERT(SHA256_DIGEST_SIZE == P256_NBYTES, sha256_digest_isnt_256_bits);
@@ -373,6 +397,10 @@ COMPILE_ASSERT(SHA256_DIGEST_SIZE == P256_NBYTES, sha256_digest_isnt_256_bits);
 bool VerifyEcdsaSignature(const EcdsaPublicKey& public_key,
                           const std::vector<uint8>& buffer,
                           const EcdsaSignature& signature) {
+  if (!public_key.is_valid()) {
+    return false;
+  }
+
   std::vector<uint8> digest;
   VERIFY1(SafeSHA256Hash(buffer, &digest));
   ASSERT1(digest.size() == P256_NBYTES);
@@ -380,9 +408,9 @@ bool VerifyEcdsaSignature(const EcdsaPublicKey& public_key,
   p256_int digest_as_int;
   p256_from_bin(&digest.front(), &digest_as_int);
 
-  return p256_ecdsa_verify(public_key.gx(), public_key.gy(),
-                           &digest_as_int,
-                           signature.r(), signature.s()) != 0;
+  return p256_ecdsa_verify_precomp(public_key.precomp(),
+                                   &digest_as_int,
+                                   signature.r(), signature.s()) != 0;
 }
 
 }  // namespace internal
@@ -68,19 +68,33 @@ class EcdsaPublicKey {
  public:
   EcdsaPublicKey();
 
+  // Same as calling DecodeFromBuffer() on a default-constructed key.
+  explicit EcdsaPublicKey(const uint8* encoded_pkey_in);
+
   void DecodeFromBuffer(const uint8* encoded_pkey_in);
 
   // Parses a DER-encoded SubjectPublicKeyInfo value holding a P-256 ECDSA key.
   bool DecodeSubjectPublicKeyInfo(const std::vector<uint8>& spki);
 
+  // Returns true if the key decoded is a point of the curve. Only a valid key
+  // has a table of odd multiples and can verify signatures.
+  bool is_valid() const { return is_valid_; }
+
   uint8 version() const { return version_; }
   const p256_int* gx() const { return &gx_; }
   const p256_int* gy() const { return &gy_; }
 
+  // Odd multiples of the key, built when the key is decoded. Reusing them
+  // makes each VerifyEcdsaSignature() call cheaper, so long-lived keys should
+  // be decoded once and shared.
+  const p256_precomp* precomp() const { return &precomp_; }
+
  private:
+  bool is_valid_;
   uint8 version_;
   p256_int gx_;
   p256_int gy_;
+  p256_precomp precomp_;
 
   DISALLOW_COPY_AND_ASSIGN(EcdsaPublicKey);
 };
@@ -17,6 +17,7 @@
 
 #include "omaha/base/string.h"
 #include "omaha/base/security/p256.h"
+#include "omaha/base/security/p256_ecdsa.h"
 #include "omaha/net/cup_ecdsa_utils.h"
 #include "omaha/testing/unit_test.h"
 
@@ -485,6 +486,7 @@ TEST(EcdsaPublicKey, DecodeFromBuffer_TestStagingKey) {
   ;   // NOLINT
 
   key.DecodeFromBuffer(kTestKey);
+  EXPECT_TRUE(key.is_valid());
 }
 
 TEST(EcdsaPublicKey, DecodeFromBuffer_ProdKey) {
@@ -495,6 +497,7 @@ TEST(EcdsaPublicKey, DecodeFromBuffer_ProdKey) {
   ;   // NOLINT
 
   key.DecodeFromBuffer(kProdKey);
+  EXPECT_TRUE(key.is_valid());
 }
 
 TEST(EcdsaPublicKey, DecodeSubjectPublicKeyInfo_Valid) {
@@ -519,7 +522,9 @@ TEST(EcdsaPublicKey, DecodeSubjectPublicKeyInfo_Valid) {
   };
 
   std::vector<uint8> spki(&kSPKI[0], &kSPKI[arraysize(kSPKI)]);
+  EXPECT_FALSE(key.is_valid());
   EXPECT_TRUE(key.DecodeSubjectPublicKeyInfo(spki));
+  EXPECT_TRUE(key.is_valid());
 }
 
 TEST(EcdsaPublicKey, DecodeSubjectPublicKeyInfo_InvalidSequenceLength) {
@@ -623,6 +628,121 @@ TEST(EcdsaPublicKey, DecodeSubjectPublicKeyInfo_UnsupportedEncoding) {
   EXPECT_FALSE(key.DecodeSubjectPublicKeyInfo(spki));
 }
 
+// Appends |value| to |der| as a minimal DER INTEGER.
+void AppendDerInt(const p256_int& value, std::vector<uint8>* der) {
+  uint8 bytes[P256_NBYTES] = {0};
+  p256_to_bin(&value, bytes);
+
+  size_t start = 0;
+  while (start < P256_NBYTES - 1 && bytes[start] == 0) {
+    ++start;
+  }
+  const bool pad = (bytes[start] & 0x80) != 0;
+
+  der->push_back(0x02);
+  der->push_back(static_cast<uint8>(P256_NBYTES - start + (pad ? 1 : 0)));
+  if (pad) {
+    der->push_back(0x00);
+  }
+  der->insert(der->end(), bytes + start, bytes + P256_NBYTES);
+}
+
+// Signs |buffer| with |private_key| and returns the DER-encoded signature.
+std::vector<uint8> SignBuffer(const p256_int& private_key,
+                              const std::vector<uint8>& buffer) {
+  std::vector<uint8> digest;
+  EXPECT_TRUE(SafeSHA256Hash(buffer, &digest));
+  p256_int digest_as_int, r, s;
+  p256_from_bin(&digest.front(), &digest_as_int);
+  p256_ecdsa_sign(&private_key, &digest_as_int, &r, &s);
+
+  std::vector<uint8> ints;
+  AppendDerInt(r, &ints);
+  AppendDerInt(s, &ints);
+  std::vector<uint8> der;
+  der.push_back(0x30);
+  der.push_back(static_cast<uint8>(ints.size()));
+  der.insert(der.end(), ints.begin(), ints.end());
+  return der;
+}
+
+TEST(EcdsaPublicKey, VerifyEcdsaSignature) {
+  p256_int private_key = {{0x1d2c3b4a, 0x5e6f7081, 0x92a3b4c5, 0xd6e7f809,
+                           0x1a2b3c4d, 0x5e6f7a8b, 0x9cadbecf, 0x0badf00d}};
+  p256_int gx, gy;
+  p256_base_point_mul(&private_key, &gx, &gy);
+
+  uint8 encoded_key[2 + 2 * P256_NBYTES] = {0x0a, 0x04};
+  p256_to_bin(&gx, &encoded_key[2]);
+  p256_to_bin(&gy, &encoded_key[2 + P256_NBYTES]);
+  const EcdsaPublicKey key(encoded_key);
+  EXPECT_TRUE(key.is_valid());
+  EXPECT_EQ(0x0a, key.version());
+  EXPECT_EQ(0, p256_cmp(&gx, key.gx()));
+  EXPECT_EQ(0, p256_cmp(&gy, key.gy()));
+
+  const char kMessage[] = "CUP-ECDSA signed message";
+  std::vector<uint8> buffer(kMessage, kMessage + arraysize(kMessage) - 1);
+  std::vector<uint8> digest;
+  ASSERT_TRUE(SafeSHA256Hash(buffer, &digest));
+  p256_int digest_as_int;
+  p256_from_bin(&digest.front(), &digest_as_int);
+
+  EcdsaSignature signature;
+  ASSERT_TRUE(signature.DecodeFromBuffer(SignBuffer(private_key, buffer)));
+
+  EXPECT_TRUE(VerifyEcdsaSignature(key, buffer, signature));
+  EXPECT_TRUE(p256_ecdsa_verify(key.gx(), key.gy(), &digest_as_int,
+                                signature.r(), signature.s()));
+
+  buffer.back() ^= 1;
+  EXPECT_FALSE(VerifyEcdsaSignature(key, buffer, signature));
+}
+
+TEST(EcdsaPublicKey, VerifyEcdsaSignature_InvalidKey) {
+  p256_int private_key = {{0x1d2c3b4a, 0x5e6f7081, 0x92a3b4c5, 0xd6e7f809,
+                           0x1a2b3c4d, 0x5e6f7a8b, 0x9cadbecf, 0x0badf00d}};
+  p256_int gx, gy;
+  p256_base_point_mul(&private_key, &gx, &gy);
+
+  const char kMessage[] = "CUP-ECDSA signed message";
+  const std::vector<uint8> buffer(kMessage, kMessage + arraysize(kMessage) - 1);
+  EcdsaSignature signature;
+  ASSERT_TRUE(signature.DecodeFromBuffer(SignBuffer(private_key, buffer)));
+
+  // A key that was never decoded does not verify anything.
+  const EcdsaPublicKey empty_key;
+  EXPECT_FALSE(empty_key.is_valid());
+  EXPECT_FALSE(VerifyEcdsaSignature(empty_key, buffer, signature));
+
+  // A key that is not a point of the curve is rejected when it is decoded.
+  uint8 encoded_key[2 + 2 * P256_NBYTES] = {0x0a, 0x04};
+  p256_to_bin(&gx, &encoded_key[2]);
+  p256_to_bin(&gy, &encoded_key[2 + P256_NBYTES]);
+  encoded_key[arraysize(encoded_key) - 1] ^= 1;
+
+  EcdsaPublicKey key;
+  {
+    ExpectAsserts expect_asserts;
+    key.DecodeFromBuffer(encoded_key);
+  }
+  EXPECT_FALSE(key.is_valid());
+  EXPECT_FALSE(VerifyEcdsaSignature(key, buffer, signature));
+
+  // Decoding a key that is not valid invalidates the key decoded before.
+  encoded_key[arraysize(encoded_key) - 1] ^= 1;
+  key.DecodeFromBuffer(encoded_key);
+  EXPECT_TRUE(key.is_valid());
+  EXPECT_TRUE(VerifyEcdsaSignature(key, buffer, signature));
+  encoded_key[arraysize(encoded_key) - 1] ^= 1;
+  {
+    ExpectAsserts expect_asserts;
+    key.DecodeFromBuffer(encoded_key);
+  }
+  EXPECT_FALSE(key.is_valid());
+  EXPECT_FALSE(VerifyEcdsaSignature(key, buffer, signature));
+}
+
 }  // namespace internal
 
 }  // namespace omaha
@@ -0,0 +1,188 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// The checkpoint file is a snapshot of the state below, followed by its
+// SHA-256 checksum:
+//
+//   magic, version                              uint32 each
+//   url, etag, last_modified                    uint32 length + UTF-16 chars
+//   content_length, committed_bytes             uint64 each
+//   has_digest                                  uint8
+//   digest count, buffer, state                 uint64, 64 bytes, 8 x uint32
+//
+// A checkpoint is replaced atomically, so a crash leaves either the previous
+// checkpoint or the new one. A checkpoint that does not load is ignored and
+// the download starts over.
+
+#include "omaha/net/download_checkpoint.h"
+
+#include <string.h>
+#include <limits>
+#include <vector>
+
+#include "omaha/base/byte_buffer.h"
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/file.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/utils.h"
+
+namespace omaha {
+
+namespace {
+
+const uint32 kCheckpointMagic = 0x50434f44;  // "DOCP".
+const uint32 kCheckpointVersion = 2;
+
+const TCHAR* const kCheckpointFileExtension = _T(".checkpoint");
+
+const uint32 kMaxCheckpointFileSize = 64 * 1024;
+const uint32 kMaxStringLength = 4096;
+
+const uint64 kMaxContentLength = std::numeric_limits<int64>::max();
+
+}  // namespace
+
+DownloadCheckpoint::DownloadCheckpoint()
+    : content_length(0),
+      committed_bytes(0),
+      has_digest(false) {
+  SHA256_init(&digest_ctx);
+}
+
+HRESULT DownloadCheckpoint::Load(const CString& filename) {
+  std::vector<uint8> buffer;
+  HRESULT hr = ReadEntireFileShareMode(GetFileName(filename),
+                                       kMaxCheckpointFileSize,
+                                       FILE_SHARE_READ,
+                                       &buffer);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  if (buffer.size() < SHA256_DIGEST_SIZE) {
+    return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+
+  const size_t payload_size = buffer.size() - SHA256_DIGEST_SIZE;
+  uint8 checksum[SHA256_DIGEST_SIZE] = {0};
+  SHA256_hash(&buffer.front(), payload_size, checksum);
+  if (memcmp(checksum, &buffer[payload_size], SHA256_DIGEST_SIZE) != 0) {
+    NET_LOG(LW, (_T("[corrupt download checkpoint][%s]"), filename));
+    return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+
+  BufferReader reader(&buffer.front(), payload_size);
+  uint32 magic = 0;
+  uint32 version = 0;
+  uint64 length = 0;
+  uint64 committed = 0;
+  uint8 digest_flag = 0;
+  DownloadCheckpoint checkpoint;
+  if (!reader.ReadUint32(&magic) || magic != kCheckpointMagic ||
+      !reader.ReadUint32(&version) || version != kCheckpointVersion ||
+      !reader.ReadString(&checkpoint.url, kMaxStringLength) ||
+      !reader.ReadString(&checkpoint.etag, kMaxStringLength) ||
+      !reader.ReadString(&checkpoint.last_modified, kMaxStringLength) ||
+      !reader.ReadUint64(&length) || length > kMaxContentLength ||
+      !reader.ReadUint64(&committed) || committed > length ||
+      !reader.ReadUint8(&digest_flag) ||
+      !reader.ReadBytes(&checkpoint.digest_ctx.count,
+                        sizeof(checkpoint.digest_ctx.count)) ||
+      !reader.ReadBytes(checkpoint.digest_ctx.buf,
+                        sizeof(checkpoint.digest_ctx.buf)) ||
+      !reader.ReadBytes(checkpoint.digest_ctx.state,
+                        sizeof(checkpoint.digest_ctx.state)) ||
+      reader.remaining() != 0) {
+    return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+
+  checkpoint.content_length = static_cast<int64>(length);
+  checkpoint.committed_bytes = static_cast<int64>(committed);
+  checkpoint.has_digest = digest_flag != 0 &&
+                          checkpoint.digest_ctx.count == committed;
+
+  url = checkpoint.url;
+  etag = checkpoint.etag;
+  last_modified = checkpoint.last_modified;
+  content_length = checkpoint.content_length;
+  committed_bytes = checkpoint.committed_bytes;
+  has_digest = checkpoint.has_digest;
+  digest_ctx = checkpoint.digest_ctx;
+  return S_OK;
+}
+
+HRESULT DownloadCheckpoint::Save(const CString& filename) const {
+  ASSERT1(content_length > 0);
+  ASSERT1(committed_bytes >= 0 && committed_bytes <= content_length);
+
+  std::vector<uint8> buffer;
+  AppendUint32(kCheckpointMagic, &buffer);
+  AppendUint32(kCheckpointVersion, &buffer);
+  AppendString(url, &buffer);
+  AppendString(etag, &buffer);
+  AppendString(last_modified, &buffer);
+  AppendUint64(static_cast<uint64>(content_length), &buffer);
+  AppendUint64(static_cast<uint64>(committed_bytes), &buffer);
+  buffer.push_back(has_digest ? 1 : 0);
+  AppendBytes(&digest_ctx.count, sizeof(digest_ctx.count), &buffer);
+  AppendBytes(digest_ctx.buf, sizeof(digest_ctx.buf), &buffer);
+  AppendBytes(digest_ctx.state, sizeof(digest_ctx.state), &buffer);
+
+  uint8 checksum[SHA256_DIGEST_SIZE] = {0};
+  SHA256_hash(&buffer.front(), buffer.size(), checksum);
+  AppendBytes(checksum, sizeof(checksum), &buffer);
+
+  const CString checkpoint_file = GetFileName(filename);
+  const CString temp_file = checkpoint_file + _T(".tmp");
+  HRESULT hr = WriteEntireFile(temp_file, buffer);
+  if (FAILED(hr)) {
+    NET_LOG(LW, (_T("[failed to write download checkpoint][0x%08x]"), hr));
+    return hr;
+  }
+
+  hr = File::Move(temp_file, checkpoint_file, true);
+  if (FAILED(hr)) {
+    NET_LOG(LW, (_T("[failed to replace download checkpoint][0x%08x]"), hr));
+    VERIFY1(::DeleteFile(temp_file));
+    return hr;
+  }
+
+  return S_OK;
+}
+
+CString DownloadCheckpoint::GetFileName(const CString& filename) {
+  ASSERT1(!filename.IsEmpty());
+  return filename + kCheckpointFileExtension;
+}
+
+bool DownloadCheckpoint::Exists(const CString& filename) {
+  return File::Exists(GetFileName(filename));
+}
+
+HRESULT DownloadCheckpoint::Delete(const CString& filename) {
+  const CString checkpoint_file = GetFileName(filename);
+  return File::Exists(checkpoint_file) ? File::Remove(checkpoint_file) : S_OK;
+}
+
+CString DownloadCheckpoint::GetIfRangeValue(const CString& etag,
+                                            const CString& last_modified) {
+  if (!etag.IsEmpty() && etag.Find(_T("W/")) != 0) {
+    return etag;
+  }
+  return last_modified;
+}
+
+}  // namespace omaha
@@ -0,0 +1,75 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// DownloadCheckpoint records how much of a file download is safely on disk,
+// in a checkpoint file next to the downloaded file. A download interrupted by
+// a crash, a restart of the process, or a lost connection resumes from the
+// checkpoint with a range request, instead of starting over.
+//
+// The checkpoint keeps the validators of the response, so that the resumed
+// request only continues the download if the file on the server is still the
+// same one, and the state of the hash of the bytes written so far, so that the
+// resumed download still produces the digest of the whole file.
+
+#ifndef OMAHA_NET_DOWNLOAD_CHECKPOINT_H_
+#define OMAHA_NET_DOWNLOAD_CHECKPOINT_H_
+
+#include <windows.h>
+#include <atlstr.h>
+
+#include "base/basictypes.h"
+#include "omaha/base/security/sha256.h"
+
+namespace omaha {
+
+struct DownloadCheckpoint {
+  DownloadCheckpoint();
+
+  // Reads the checkpoint of the download to |filename|. Fails if there is no
+  // checkpoint or if it is corrupt.
+  HRESULT Load(const CString& filename);
+
+  // Replaces the checkpoint of the download to |filename|. The bytes the
+  // checkpoint counts must be flushed to the file first.
+  HRESULT Save(const CString& filename) const;
+
+  // Returns the name of the checkpoint file of |filename|.
+  static CString GetFileName(const CString& filename);
+
+  static bool Exists(const CString& filename);
+
+  static HRESULT Delete(const CString& filename);
+
+  // Returns the value of the If-Range header of a resumed request for a
+  // response with |etag| and |last_modified|, or an empty string if the
+  // download cannot be resumed safely. A weak entity tag cannot validate a
+  // range request.
+  static CString GetIfRangeValue(const CString& etag,
+                                 const CString& last_modified);
+
+  CString url;
+  CString etag;
+  CString last_modified;
+  int64 content_length;
+  int64 committed_bytes;
+
+  // The hash of the committed bytes, if it is known.
+  bool has_digest;
+  LITE_SHA256_CTX digest_ctx;
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_NET_DOWNLOAD_CHECKPOINT_H_
@@ -0,0 +1,155 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <string.h>
+#include <vector>
+
+#include "omaha/base/app_util.h"
+#include "omaha/base/error.h"
+#include "omaha/base/file.h"
+#include "omaha/base/utils.h"
+#include "omaha/net/download_checkpoint.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+class DownloadCheckpointTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    filename_ = GetTempFilenameAt(app_util::GetModuleDirectory(NULL),
+                                  _T("DCT"));
+    ASSERT_FALSE(filename_.IsEmpty());
+  }
+
+  virtual void TearDown() {
+    ::DeleteFile(filename_);
+    EXPECT_SUCCEEDED(DownloadCheckpoint::Delete(filename_));
+  }
+
+  // Returns a checkpoint of a download that received the first |bytes| bytes
+  // of |content|.
+  static DownloadCheckpoint MakeCheckpoint(const std::vector<uint8>& content,
+                                           int bytes) {
+    DownloadCheckpoint checkpoint;
+    checkpoint.url = _T("http://dl.google.com/update2/installers/app.exe");
+    checkpoint.etag = _T("\"8a3f\"");
+    checkpoint.last_modified = _T("Tue, 01 Sep 2026 10:00:00 GMT");
+    checkpoint.content_length = static_cast<int64>(content.size());
+    checkpoint.committed_bytes = bytes;
+    checkpoint.has_digest = true;
+    SHA256_update(&checkpoint.digest_ctx, &content.front(), bytes);
+    return checkpoint;
+  }
+
+  CString filename_;
+};
+
+TEST_F(DownloadCheckpointTest, SaveAndLoad) {
+  std::vector<uint8> content(1000);
+  for (size_t i = 0; i != content.size(); ++i) {
+    content[i] = static_cast<uint8>(i * 13);
+  }
+
+  EXPECT_FALSE(DownloadCheckpoint::Exists(filename_));
+  const DownloadCheckpoint saved(MakeCheckpoint(content, 333));
+  EXPECT_SUCCEEDED(saved.Save(filename_));
+  EXPECT_TRUE(DownloadCheckpoint::Exists(filename_));
+
+  DownloadCheckpoint loaded;
+  EXPECT_SUCCEEDED(loaded.Load(filename_));
+  EXPECT_STREQ(saved.url, loaded.url);
+  EXPECT_STREQ(saved.etag, loaded.etag);
+  EXPECT_STREQ(saved.last_modified, loaded.last_modified);
+  EXPECT_EQ(1000, loaded.content_length);
+  EXPECT_EQ(333, loaded.committed_bytes);
+  EXPECT_TRUE(loaded.has_digest);
+
+  // Hashing the rest of the file from the loaded checkpoint produces the
+  // digest of the whole file.
+  SHA256_update(&loaded.digest_ctx, &content[333], content.size() - 333);
+  uint8 expected_digest[SHA256_DIGEST_SIZE] = {0};
+  SHA256_hash(&content.front(), content.size(), expected_digest);
+  EXPECT_EQ(0, memcmp(expected_digest,
+                      SHA256_final(&loaded.digest_ctx),
+                      SHA256_DIGEST_SIZE));
+
+  // A later checkpoint replaces the previous one.
+  EXPECT_SUCCEEDED(MakeCheckpoint(content, 999).Save(filename_));
+  EXPECT_SUCCEEDED(loaded.Load(filename_));
+  EXPECT_EQ(999, loaded.committed_bytes);
+
+  EXPECT_SUCCEEDED(DownloadCheckpoint::Delete(filename_));
+  EXPECT_FALSE(DownloadCheckpoint::Exists(filename_));
+  EXPECT_FAILED(loaded.Load(filename_));
+}
+
+TEST_F(DownloadCheckpointTest, SaveAndLoad_LargeFile) {
+  const int64 kGigabyte = 1024 * 1024 * 1024;
+
+  DownloadCheckpoint saved;
+  saved.url = _T("http://dl.google.com/update2/installers/vm_image.bin");
+  saved.etag = _T("\"8a3f\"");
+  saved.content_length = 6 * kGigabyte + 1;
+  saved.committed_bytes = 5 * kGigabyte;
+  EXPECT_SUCCEEDED(saved.Save(filename_));
+
+  DownloadCheckpoint loaded;
+  EXPECT_SUCCEEDED(loaded.Load(filename_));
+  EXPECT_EQ(6 * kGigabyte + 1, loaded.content_length);
+  EXPECT_EQ(5 * kGigabyte, loaded.committed_bytes);
+  EXPECT_FALSE(loaded.has_digest);
+}
+
+TEST_F(DownloadCheckpointTest, Load_Corrupt) {
+  const std::vector<uint8> content(100, 7);
+  EXPECT_SUCCEEDED(MakeCheckpoint(content, 50).Save(filename_));
+
+  const CString checkpoint_file(DownloadCheckpoint::GetFileName(filename_));
+  std::vector<uint8> buffer;
+  EXPECT_SUCCEEDED(ReadEntireFile(checkpoint_file, 0, &buffer));
+
+  // Any change to the checkpoint makes it fail to load, and leaves the
+  // loaded checkpoint unchanged.
+  std::vector<uint8> corrupt_buffer(buffer);
+  corrupt_buffer[buffer.size() / 2] ^= 1;
+  EXPECT_SUCCEEDED(WriteEntireFile(checkpoint_file, corrupt_buffer));
+  DownloadCheckpoint loaded;
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), loaded.Load(filename_));
+  EXPECT_TRUE(loaded.url.IsEmpty());
+  EXPECT_EQ(0, loaded.committed_bytes);
+
+  corrupt_buffer.assign(buffer.begin(), buffer.end() - 1);
+  EXPECT_SUCCEEDED(WriteEntireFile(checkpoint_file, corrupt_buffer));
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), loaded.Load(filename_));
+}
+
+TEST_F(DownloadCheckpointTest, GetIfRangeValue) {
+  const CString kLastModified(_T("Tue, 01 Sep 2026 10:00:00 GMT"));
+
+  EXPECT_STREQ(_T("\"8a3f\""),
+               DownloadCheckpoint::GetIfRangeValue(_T("\"8a3f\""),
+                                                   kLastModified));
+  EXPECT_STREQ(kLastModified,
+               DownloadCheckpoint::GetIfRangeValue(_T("W/\"8a3f\""),
+                                                   kLastModified));
+  EXPECT_STREQ(kLastModified,
+               DownloadCheckpoint::GetIfRangeValue(CString(), kLastModified));
+  EXPECT_TRUE(DownloadCheckpoint::GetIfRangeValue(_T("W/\"8a3f\""),
+                                                  CString()).IsEmpty());
+  EXPECT_TRUE(DownloadCheckpoint::GetIfRangeValue(CString(),
+                                                  CString()).IsEmpty());
+}
+
+}  // namespace omaha
@@ -0,0 +1,229 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/net/host_health.h"
+
+#include <limits.h>
+#include <algorithm>
+
+#include "base/rand_util.h"
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/time.h"
+#include "omaha/base/utils.h"
+
+namespace omaha {
+
+class HostHealth::SystemDelegate : public HostHealth::Delegate {
+ public:
+  SystemDelegate() {}
+
+  uint64 GetTimeMs() override {
+    return GetCurrentMsTime();
+  }
+
+  uint32 GetRandom() override {
+    unsigned int random = 0;
+    if (!RandUint32(&random)) {
+      random = static_cast<unsigned int>(::GetTickCount());
+    }
+    return random;
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SystemDelegate);
+};
+
+HostHealth* HostHealth::instance_ = NULL;
+LLock HostHealth::instance_lock_;
+
+HostHealth::HostHealth(Delegate* delegate)
+    : delegate_(delegate ? delegate : new SystemDelegate) {
+}
+
+HostHealth::~HostHealth() {
+}
+
+HostHealth& HostHealth::Instance() {
+  __mutexScope(instance_lock_);
+  if (!instance_) {
+    instance_ = new HostHealth(NULL);
+  }
+  return *instance_;
+}
+
+void HostHealth::DeleteInstance() {
+  HostHealth* instance = omaha::interlocked_exchange_pointer(
+      &instance_, static_cast<HostHealth*>(NULL));
+  delete instance;
+}
+
+int HostHealth::GetDecorrelatedJitterMs(int base_ms,
+                                        int previous_ms,
+                                        uint32 random) {
+  ASSERT1(base_ms > 0);
+
+  const int64 high_ms = std::min<int64>(
+      std::max<int64>(static_cast<int64>(previous_ms) * 3, base_ms),
+      INT_MAX);
+  const int64 range_ms = high_ms - base_ms + 1;
+  return static_cast<int>(base_ms + random % range_ms);
+}
+
+HRESULT HostHealth::BeginRequest(const CString& host, int* wait_ms) {
+  ASSERT1(!host.IsEmpty());
+  ASSERT1(wait_ms);
+
+  *wait_ms = 0;
+
+  __mutexScope(lock_);
+
+  HostStateMap::iterator it = hosts_.find(host);
+  if (it == hosts_.end()) {
+    return S_OK;
+  }
+
+  HostState& host_state = it->second;
+  const uint64 now_ms = delegate_->GetTimeMs();
+  const uint64 max_retry_after_ms = kMaxRetryAfterSec * 1000ULL;
+  if (IsPending(now_ms, host_state.retry_after_until_ms, max_retry_after_ms)) {
+    *wait_ms = static_cast<int>(host_state.retry_after_until_ms - now_ms);
+    NET_LOG(L3, (_T("[HostHealth][%s][retry after %d ms]"), host, *wait_ms));
+    return OMAHA_NET_E_HOST_UNAVAILABLE;
+  }
+  host_state.retry_after_until_ms = 0;
+
+  switch (host_state.state) {
+    case STATE_CLOSED:
+      return S_OK;
+
+    case STATE_OPEN:
+      if (IsPending(now_ms, host_state.open_until_ms, kMaxOpenTimeMs)) {
+        *wait_ms = static_cast<int>(host_state.open_until_ms - now_ms);
+        NET_LOG(L3, (_T("[HostHealth][%s][open for %d ms]"), host, *wait_ms));
+        return OMAHA_NET_E_HOST_UNAVAILABLE;
+      }
+      NET_LOG(L3, (_T("[HostHealth][%s][half-open]"), host));
+      host_state.state = STATE_HALF_OPEN;
+      host_state.is_probing = true;
+      return S_OK;
+
+    case STATE_HALF_OPEN:
+      // Another request is probing the host.
+      if (host_state.is_probing) {
+        *wait_ms = kMinOpenTimeMs;
+        return OMAHA_NET_E_HOST_UNAVAILABLE;
+      }
+      host_state.is_probing = true;
+      return S_OK;
+
+    default:
+      ASSERT1(false);
+      return S_OK;
+  }
+}
+
+void HostHealth::EndRequest(const CString& host, Result result) {
+  ASSERT1(!host.IsEmpty());
+
+  __mutexScope(lock_);
+
+  HostStateMap::iterator it = hosts_.find(host);
+  if (it == hosts_.end()) {
+    if (result != RESULT_FAILURE) {
+      return;
+    }
+    it = hosts_.insert(std::make_pair(host, HostState())).first;
+  }
+
+  HostState& host_state = it->second;
+  host_state.is_probing = false;
+
+  switch (result) {
+    case RESULT_SUCCESS:
+      if (host_state.state != STATE_CLOSED) {
+        NET_LOG(L3, (_T("[HostHealth][%s][closed]"), host));
+      }
+      host_state.state = STATE_CLOSED;
+      host_state.num_failures = 0;
+      host_state.open_time_ms = 0;
+      if (!host_state.retry_after_until_ms) {
+        hosts_.erase(it);
+      }
+      break;
+
+    case RESULT_FAILURE:
+      ++host_state.num_failures;
+      if (host_state.state == STATE_HALF_OPEN ||
+          (host_state.state == STATE_CLOSED &&
+           host_state.num_failures >= kFailureThreshold)) {
+        Open(delegate_->GetTimeMs(), &host_state);
+      }
+      break;
+
+    case RESULT_NONE:
+      break;
+
+    default:
+      ASSERT1(false);
+      break;
+  }
+}
+
+void HostHealth::SetRetryAfter(const CString& host, int retry_after_sec) {
+  ASSERT1(!host.IsEmpty());
+
+  if (retry_after_sec <= 0) {
+    return;
+  }
+
+  const int64 retry_after_ms =
+      std::min(retry_after_sec, static_cast<int>(kMaxRetryAfterSec)) * 1000LL;
+
+  __mutexScope(lock_);
+  NET_LOG(L3, (_T("[HostHealth][%s][retry after %d s]"),
+               host, retry_after_sec));
+  hosts_[host].retry_after_until_ms = delegate_->GetTimeMs() + retry_after_ms;
+}
+
+HostHealth::State HostHealth::GetState(const CString& host) const {
+  __mutexScope(lock_);
+  HostStateMap::const_iterator it = hosts_.find(host);
+  return it == hosts_.end() ? STATE_CLOSED : it->second.state;
+}
+
+bool HostHealth::IsPending(uint64 now_ms, uint64 until_ms, uint64 max_wait_ms) {
+  return now_ms < until_ms && until_ms - now_ms <= max_wait_ms;
+}
+
+void HostHealth::Open(uint64 now_ms, HostState* host_state) {
+  ASSERT1(host_state);
+
+  const int min_open_time_ms = kMinOpenTimeMs;
+  const int max_open_time_ms = kMaxOpenTimeMs;
+  host_state->open_time_ms = std::min(
+      GetDecorrelatedJitterMs(min_open_time_ms,
+                              host_state->open_time_ms,
+                              delegate_->GetRandom()),
+      max_open_time_ms);
+  host_state->open_until_ms = now_ms + host_state->open_time_ms;
+  host_state->state = STATE_OPEN;
+
+  NET_LOG(L3, (_T("[HostHealth][open for %d ms][%d failures]"),
+               host_state->open_time_ms, host_state->num_failures));
+}
+
+}  // namespace omaha
@@ -0,0 +1,148 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// HostHealth tracks the health of the hosts the requests of the process are
+// sent to, so that the requests to a host that is down fail at once instead of
+// each one waiting out its own retries. The caller can then move on to another
+// url, for instance another mirror of a package.
+//
+// Each host has a circuit breaker. The circuit is closed while the host works.
+// It opens after kFailureThreshold requests in a row fail because of the host:
+// the host could not be reached, or it answered with a server error. Requests
+// fail at once while the circuit is open. Once the open time has passed, the
+// circuit is half-open: one request at a time is let through as a probe. A
+// probe that succeeds closes the circuit, and one that fails opens it again.
+// The open time grows with a decorrelated-jitter backoff each time the circuit
+// opens, so that the clients that found the host down together do not come
+// back together.
+//
+// A host that answers with X-Retry-After is left alone for that long by all
+// the requests, and not only by the request that received the header.
+
+#ifndef OMAHA_NET_HOST_HEALTH_H_
+#define OMAHA_NET_HOST_HEALTH_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include <map>
+#include <memory>
+
+#include "base/basictypes.h"
+#include "omaha/base/synchronized.h"
+
+namespace omaha {
+
+class HostHealth {
+ public:
+  enum State {
+    STATE_CLOSED,
+    STATE_OPEN,
+    STATE_HALF_OPEN,
+  };
+
+  enum Result {
+    RESULT_SUCCESS,   // The host answered.
+    RESULT_FAILURE,   // The host could not be reached, or answered 5xx.
+    RESULT_NONE,      // The request says nothing about the host.
+  };
+
+  // Provides the time and the randomness to the tracker. Tests replace it.
+  class Delegate {
+   public:
+    virtual ~Delegate() {}
+    virtual uint64 GetTimeMs() = 0;
+    virtual uint32 GetRandom() = 0;
+  };
+
+  // The circuit of a host opens after this many failures in a row.
+  static const int kFailureThreshold = 3;
+
+  // The bounds of the time the circuit of a host stays open.
+  static const int kMinOpenTimeMs = 5000;
+  static const int kMaxOpenTimeMs = 5 * 60 * 1000;
+
+  // X-Retry-After values are capped to a day.
+  static const int kMaxRetryAfterSec = 24 * 60 * 60;
+
+  // Takes ownership of |delegate|. Uses the system clock and random number
+  // generator if |delegate| is NULL.
+  explicit HostHealth(Delegate* delegate);
+  ~HostHealth();
+
+  static HostHealth& Instance();
+  static void DeleteInstance();
+
+  // Returns a random delay between |base_ms| and three times |previous_ms|,
+  // drawn from |random|. Does not cap the delay.
+  static int GetDecorrelatedJitterMs(int base_ms,
+                                     int previous_ms,
+                                     uint32 random);
+
+  // Returns S_OK if a request to |host| can be sent. The caller then reports
+  // the result of the request with EndRequest. Returns
+  // OMAHA_NET_E_HOST_UNAVAILABLE otherwise, and the time in milliseconds until
+  // the host can be tried again in |wait_ms|.
+  HRESULT BeginRequest(const CString& host, int* wait_ms);
+
+  void EndRequest(const CString& host, Result result);
+
+  // Leaves |host| alone for |retry_after_sec| seconds.
+  void SetRetryAfter(const CString& host, int retry_after_sec);
+
+  State GetState(const CString& host) const;
+
+ private:
+  struct HostState {
+    HostState()
+        : state(STATE_CLOSED),
+          num_failures(0),
+          open_time_ms(0),
+          open_until_ms(0),
+          retry_after_until_ms(0),
+          is_probing(false) {}
+
+    State state;
+    int num_failures;
+    int open_time_ms;
+    uint64 open_until_ms;
+    uint64 retry_after_until_ms;
+    bool is_probing;
+  };
+
+  typedef std::map<CString, HostState> HostStateMap;
+
+  // Returns true if |until_ms| is in the future. A time too far in the future
+  // is taken as the result of the clock being set back, and is not waited
+  // for.
+  static bool IsPending(uint64 now_ms, uint64 until_ms, uint64 max_wait_ms);
+
+  void Open(uint64 now_ms, HostState* host_state);
+
+  class SystemDelegate;
+
+  std::unique_ptr<Delegate> delegate_;
+
+  LLock lock_;
+  HostStateMap hosts_;
+
+  static HostHealth* instance_;
+  static LLock instance_lock_;
+
+  DISALLOW_COPY_AND_ASSIGN(HostHealth);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_NET_HOST_HEALTH_H_
@@ -0,0 +1,254 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <limits.h>
+#include <memory>
+
+#include "omaha/base/error.h"
+#include "omaha/net/host_health.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+const TCHAR kHost[] = _T("dl.google.com");
+const TCHAR kOtherHost[] = _T("redirector.gvt1.com");
+
+class FakeDelegate : public HostHealth::Delegate {
+ public:
+  FakeDelegate() : now_ms_(1000000), random_(0) {}
+
+  uint64 GetTimeMs() override { return now_ms_; }
+  uint32 GetRandom() override { return random_; }
+
+  void Advance(uint64 ms) { now_ms_ += ms; }
+  void SetBack(uint64 ms) { now_ms_ -= ms; }
+
+  void set_random(uint32 random) { random_ = random; }
+
+ private:
+  uint64 now_ms_;
+  uint32 random_;
+
+  DISALLOW_COPY_AND_ASSIGN(FakeDelegate);
+};
+
+}  // namespace
+
+class HostHealthTest : public testing::Test {
+ protected:
+  HostHealthTest() : delegate_(NULL) {}
+
+  virtual void SetUp() {
+    delegate_ = new FakeDelegate;
+    host_health_.reset(new HostHealth(delegate_));
+  }
+
+  virtual void TearDown() {
+    host_health_.reset();
+    delegate_ = NULL;
+  }
+
+  HRESULT BeginRequest(const CString& host) {
+    int wait_ms = 0;
+    return host_health_->BeginRequest(host, &wait_ms);
+  }
+
+  void Fail(const CString& host, int num_failures) {
+    for (int i = 0; i != num_failures; ++i) {
+      EXPECT_HRESULT_SUCCEEDED(BeginRequest(host));
+      host_health_->EndRequest(host, HostHealth::RESULT_FAILURE);
+    }
+  }
+
+  std::unique_ptr<HostHealth> host_health_;
+  FakeDelegate* delegate_;    // Owned by |host_health_|.
+};
+
+TEST_F(HostHealthTest, GetDecorrelatedJitterMs) {
+  EXPECT_EQ(1000, HostHealth::GetDecorrelatedJitterMs(1000, 0, 0));
+  EXPECT_EQ(1000, HostHealth::GetDecorrelatedJitterMs(1000, 1000, 0));
+  EXPECT_EQ(3000, HostHealth::GetDecorrelatedJitterMs(1000, 1000, 2000));
+  EXPECT_EQ(1000, HostHealth::GetDecorrelatedJitterMs(1000, 1000, 2001));
+
+  // The delay is drawn between the base and three times the previous delay.
+  for (uint32 random = 0; random != 100000; random += 997) {
+    const int delay_ms =
+        HostHealth::GetDecorrelatedJitterMs(1000, 8000, random);
+    EXPECT_LE(1000, delay_ms);
+    EXPECT_GE(24000, delay_ms);
+  }
+
+  // Large delays do not overflow.
+  EXPECT_LE(1000, HostHealth::GetDecorrelatedJitterMs(1000, INT_MAX, 12345));
+}
+
+TEST_F(HostHealthTest, OpensAfterThreshold) {
+  const int failure_threshold = HostHealth::kFailureThreshold;
+  Fail(kHost, failure_threshold - 1);
+  EXPECT_EQ(HostHealth::STATE_CLOSED, host_health_->GetState(kHost));
+  EXPECT_HRESULT_SUCCEEDED(BeginRequest(kHost));
+
+  host_health_->EndRequest(kHost, HostHealth::RESULT_FAILURE);
+  EXPECT_EQ(HostHealth::STATE_OPEN, host_health_->GetState(kHost));
+  EXPECT_EQ(OMAHA_NET_E_HOST_UNAVAILABLE, BeginRequest(kHost));
+
+  // The other hosts are not affected.
+  EXPECT_EQ(HostHealth::STATE_CLOSED, host_health_->GetState(kOtherHost));
+  EXPECT_HRESULT_SUCCEEDED(BeginRequest(kOtherHost));
+}
+
+TEST_F(HostHealthTest, SuccessResetsFailures) {
+  const int failure_threshold = HostHealth::kFailureThreshold;
+  Fail(kHost, failure_threshold - 1);
+  EXPECT_HRESULT_SUCCEEDED(BeginRequest(kHost));
+  host_health_->EndRequest(kHost, HostHealth::RESULT_SUCCESS);
+
+  Fail(kHost, failure_threshold - 1);
+  EXPECT_EQ(HostHealth::STATE_CLOSED, host_health_->GetState(kHost));
+}
+
+TEST_F(HostHealthTest, NoneResultIgnored) {
+  const int failure_threshold = HostHealth::kFailureThreshold;
+  for (int i = 0; i != failure_threshold * 2; ++i) {
+    EXPECT_HRESULT_SUCCEEDED(BeginRequest(kHost));
+    host_health_->EndRequest(kHost, HostHealth::RESULT_NONE);
+  }
+  EXPECT_EQ(HostHealth::STATE_CLOSED, host_health_->GetState(kHost));
+}
+
+TEST_F(HostHealthTest, FailsFastWhileOpen) {
+  const int min_open_time_ms = HostHealth::kMinOpenTimeMs;
+  delegate_->set_random(0);
+  Fail(kHost, HostHealth::kFailureThreshold);
+
+  int wait_ms = 0;
+  EXPECT_EQ(OMAHA_NET_E_HOST_UNAVAILABLE,
+            host_health_->BeginRequest(kHost, &wait_ms));
+  EXPECT_EQ(min_open_time_ms, wait_ms);
+
+  delegate_->Advance(min_open_time_ms - 1000);
+  EXPECT_EQ(OMAHA_NET_E_HOST_UNAVAILABLE,
+            host_health_->BeginRequest(kHost, &wait_ms));
+  EXPECT_EQ(1000, wait_ms);
+}
+
+TEST_F(HostHealthTest, HalfOpenProbe) {
+  const int min_open_time_ms = HostHealth::kMinOpenTimeMs;
+  delegate_->set_random(0);
+  Fail(kHost, HostHealth::kFailureThreshold);
+  delegate_->Advance(min_open_time_ms);
+
+  // One request at a time probes the host.
+  EXPECT_HRESULT_SUCCEEDED(BeginRequest(kHost));
+  EXPECT_EQ(HostHealth::STATE_HALF_OPEN, host_health_->GetState(kHost));
+  EXPECT_EQ(OMAHA_NET_E_HOST_UNAVAILABLE, BeginRequest(kHost));
+
+  host_health_->EndRequest(kHost, HostHealth::RESULT_SUCCESS);
+  EXPECT_EQ(HostHealth::STATE_CLOSED, host_health_->GetState(kHost));
+  EXPECT_HRESULT_SUCCEEDED(BeginRequest(kHost));
+  EXPECT_HRESULT_SUCCEEDED(BeginRequest(kHost));
+}
+
+TEST_F(HostHealthTest, HalfOpenProbeFails) {
+  const int min_open_time_ms = HostHealth::kMinOpenTimeMs;
+  delegate_->set_random(0);
+  Fail(kHost, HostHealth::kFailureThreshold);
+  delegate_->Advance(min_open_time_ms);
+
+  // A probe that fails opens the circuit again, for a time drawn between the
+  // minimum and three times the previous open time.
+  delegate_->set_random(min_open_time_ms * 2);
+  EXPECT_HRESULT_SUCCEEDED(BeginRequest(kHost));
+  host_health_->EndRequest(kHost, HostHealth::RESULT_FAILURE);
+  EXPECT_EQ(HostHealth::STATE_OPEN, host_health_->GetState(kHost));
+
+  int wait_ms = 0;
+  EXPECT_EQ(OMAHA_NET_E_HOST_UNAVAILABLE,
+            host_health_->BeginRequest(kHost, &wait_ms));
+  EXPECT_EQ(min_open_time_ms * 3, wait_ms);
+}
+
+TEST_F(HostHealthTest, HalfOpenProbeCanceled) {
+  const int min_open_time_ms = HostHealth::kMinOpenTimeMs;
+  Fail(kHost, HostHealth::kFailureThreshold);
+  delegate_->Advance(min_open_time_ms);
+
+  // A probe that says nothing about the host lets another request probe.
+  EXPECT_HRESULT_SUCCEEDED(BeginRequest(kHost));
+  host_health_->EndRequest(kHost, HostHealth::RESULT_NONE);
+  EXPECT_EQ(HostHealth::STATE_HALF_OPEN, host_health_->GetState(kHost));
+  EXPECT_HRESULT_SUCCEEDED(BeginRequest(kHost));
+}
+
+TEST_F(HostHealthTest, OpenTimeIsCapped) {
+  const int max_open_time_ms = HostHealth::kMaxOpenTimeMs;
+  delegate_->set_random(0xffffffff);
+  Fail(kHost, HostHealth::kFailureThreshold);
+
+  for (int i = 0; i != 20; ++i) {
+    int wait_ms = 0;
+    EXPECT_EQ(OMAHA_NET_E_HOST_UNAVAILABLE,
+              host_health_->BeginRequest(kHost, &wait_ms));
+    EXPECT_GE(max_open_time_ms, wait_ms);
+
+    delegate_->Advance(wait_ms);
+    Fail(kHost, 1);
+  }
+}
+
+TEST_F(HostHealthTest, RetryAfterShared) {
+  host_health_->SetRetryAfter(kHost, 60);
+
+  int wait_ms = 0;
+  EXPECT_EQ(OMAHA_NET_E_HOST_UNAVAILABLE,
+            host_health_->BeginRequest(kHost, &wait_ms));
+  EXPECT_EQ(60000, wait_ms);
+  EXPECT_HRESULT_SUCCEEDED(BeginRequest(kOtherHost));
+
+  delegate_->Advance(30000);
+  EXPECT_EQ(OMAHA_NET_E_HOST_UNAVAILABLE,
+            host_health_->BeginRequest(kHost, &wait_ms));
+  EXPECT_EQ(30000, wait_ms);
+
+  delegate_->Advance(30000);
+  EXPECT_HRESULT_SUCCEEDED(BeginRequest(kHost));
+}
+
+TEST_F(HostHealthTest, RetryAfterIsCapped) {
+  const int max_retry_after_sec = HostHealth::kMaxRetryAfterSec;
+  host_health_->SetRetryAfter(kHost, max_retry_after_sec * 2);
+
+  int wait_ms = 0;
+  EXPECT_EQ(OMAHA_NET_E_HOST_UNAVAILABLE,
+            host_health_->BeginRequest(kHost, &wait_ms));
+  EXPECT_EQ(max_retry_after_sec * 1000, wait_ms);
+}
+
+// A circuit opened before the clock was set back does not stay open for the
+// time the clock was set back by.
+TEST_F(HostHealthTest, ClockSetBack) {
+  const int max_open_time_ms = HostHealth::kMaxOpenTimeMs;
+  Fail(kHost, HostHealth::kFailureThreshold);
+  host_health_->SetRetryAfter(kOtherHost, 60);
+
+  delegate_->SetBack(24 * 60 * 60 * 1000ULL + max_open_time_ms);
+  EXPECT_HRESULT_SUCCEEDED(BeginRequest(kHost));
+  EXPECT_EQ(HostHealth::STATE_HALF_OPEN, host_health_->GetState(kHost));
+  EXPECT_HRESULT_SUCCEEDED(BeginRequest(kOtherHost));
+}
+
+}  // namespace omaha
@@ -30,6 +30,7 @@
 #include <vector>
 #include "base/basictypes.h"
 #include "omaha/net/network_config.h"
+#include "omaha/net/response_buffer.h"
 
 namespace omaha {
 
@@ -52,7 +53,9 @@ class HttpRequestInterface {
 
   virtual HRESULT Resume() = 0;
 
-  virtual std::vector<uint8> GetResponse() const = 0;
+  // Returns a view of the response body, which shares the bytes of the
+  // response instead of copying them.
+  virtual ResponseBuffer GetResponse() const = 0;
 
   virtual int GetHttpStatusCode() const = 0;
 
@@ -100,6 +103,12 @@ class HttpRequestInterface {
   // they are meaningful for download requests only. Download requests are the
   // requests where the response goes to a file.
   virtual bool download_metrics(DownloadMetrics* download_metrics) const = 0;
+
+  // Returns true if the SHA-256 digest of the file written by the last Send()
+  // is available and copies it in |digest|. The digest is computed while the
+  // response is written to the file, which only requests that see the bytes
+  // of the response can do.
+  virtual bool download_digest(std::vector<uint8>* digest) const = 0;
 };
 
 }   // namespace omaha
@@ -0,0 +1,346 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/net/mirror_race.h"
+
+#include <memory>
+
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/safe_format.h"
+#include "omaha/base/thread.h"
+#include "omaha/base/time.h"
+#include "omaha/net/network_request.h"
+
+namespace omaha {
+
+class MirrorRace::Racer : public Runnable, public NetworkRequestCallback {
+ public:
+  Racer(MirrorRace* race,
+        int index,
+        const CString& url,
+        const CString& filename)
+      : race_(race),
+        index_(index),
+        url_(url),
+        filename_(filename),
+        request_(NULL),
+        hr_(E_FAIL),
+        has_digest_(false) {
+    ASSERT1(race);
+  }
+  virtual ~Racer() {}
+
+  Thread* thread() { return &thread_; }
+
+  int index() const { return index_; }
+  const CString& filename() const { return filename_; }
+  HRESULT hr() const { return hr_; }
+
+  // The request in flight, if any. Guarded by the lock of the race.
+  NetworkRequest* request() const { return request_; }
+  void set_request(NetworkRequest* request) { request_ = request; }
+
+  const std::vector<DownloadMetrics>& download_metrics() const {
+    return download_metrics_;
+  }
+
+  bool download_digest(std::vector<uint8>* digest) const {
+    ASSERT1(digest);
+    if (!has_digest_) {
+      return false;
+    }
+    *digest = download_digest_;
+    return true;
+  }
+
+  // NetworkRequestCallback interface. Only the progress of the winner is
+  // reported to the observer of the race.
+  void OnRequestBegin() override {}
+
+  void OnProgress(uint64 bytes,
+                  uint64 bytes_total,
+                  int status,
+                  const TCHAR* status_text) override {
+    if (!bytes || !race_->ClaimWin(this)) {
+      return;
+    }
+    if (race_->callback_) {
+      race_->callback_->OnProgress(bytes, bytes_total, status, status_text);
+    }
+  }
+
+  void OnRequestRetryScheduled(time64 next_retry_time) override {
+    UNREFERENCED_PARAMETER(next_retry_time);
+  }
+
+ private:
+  void Run() override {
+    std::unique_ptr<NetworkRequest> request(race_->factory_->CreateRequest());
+    if (race_->OnRacerStart(this, request.get())) {
+      NET_LOG(L3, (_T("[racer %d starting][%s]"), index_, url_));
+      request->set_callback(this);
+      hr_ = request->DownloadFile(url_, filename_);
+      download_metrics_ = request->download_metrics();
+      has_digest_ = request->download_digest(&download_digest_);
+      NET_LOG(L3, (_T("[racer %d done][0x%08x]"), index_, hr_));
+    } else {
+      hr_ = GOOPDATE_E_CANCELLED;
+    }
+    race_->OnRacerDone(this);
+  }
+
+  MirrorRace* race_;
+  const int index_;
+  const CString url_;
+  const CString filename_;
+  NetworkRequest* request_;
+
+  HRESULT hr_;
+  std::vector<DownloadMetrics> download_metrics_;
+  bool has_digest_;
+  std::vector<uint8> download_digest_;
+
+  Thread thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(Racer);
+};
+
+MirrorRace::MirrorRace(RequestFactory* factory)
+    : factory_(factory),
+      stagger_ms_(kDefaultStaggerMs),
+      callback_(NULL),
+      winner_(NULL),
+      num_done_(0),
+      is_canceled_(false) {
+  ASSERT1(factory);
+  reset(race_event_, ::CreateEvent(NULL, false, false, NULL));
+  ASSERT1(valid(race_event_));
+}
+
+MirrorRace::~MirrorRace() {
+  ASSERT1(racers_.empty());
+}
+
+void MirrorRace::set_stagger_ms(int stagger_ms) {
+  ASSERT1(stagger_ms >= 0);
+  stagger_ms_ = stagger_ms;
+}
+
+CString MirrorRace::GetRacerFileName(const CString& filename,
+                                     int racer_index) {
+  CString racer_filename;
+  SafeCStringFormat(&racer_filename, _T("%s.race%d"), filename, racer_index);
+  return racer_filename;
+}
+
+HRESULT MirrorRace::DownloadFile(const std::vector<CString>& urls,
+                                 const CString& filename,
+                                 int* winner) {
+  NET_LOG(L3, (_T("[MirrorRace::DownloadFile][%Iu urls][%s]"),
+               urls.size(), filename));
+  ASSERT1(!urls.empty());
+  ASSERT1(winner);
+
+  *winner = -1;
+  __mutexBlock(lock_) {
+    ASSERT1(racers_.empty());
+    winner_ = NULL;
+    num_done_ = 0;
+  }
+  download_metrics_.clear();
+  download_digest_.clear();
+  VERIFY1(::ResetEvent(get(race_event_)));
+
+  if (callback_) {
+    callback_->OnRequestBegin();
+  }
+
+  // A racer is tracked before its thread starts, so that a racer winning in
+  // the meantime cancels it.
+  HRESULT start_hr = S_OK;
+  for (int i = 0; i != static_cast<int>(urls.size()); ++i) {
+    if (i && !WaitForNextRacer(i)) {
+      break;
+    }
+
+    Racer* racer = new Racer(this, i, urls[i], GetRacerFileName(filename, i));
+    __mutexBlock(lock_) {
+      racers_.push_back(racer);
+    }
+    if (!racer->thread()->Start(racer)) {
+      start_hr = HRESULTFromLastError();
+      __mutexBlock(lock_) {
+        racers_.pop_back();
+      }
+      delete racer;
+      break;
+    }
+  }
+
+  std::vector<Racer*> racers;
+  __mutexBlock(lock_) {
+    racers = racers_;
+  }
+  for (size_t i = 0; i != racers.size(); ++i) {
+    VERIFY1(racers[i]->thread()->WaitTillExit(INFINITE));
+  }
+
+  Racer* race_winner = NULL;
+  bool is_canceled = false;
+  __mutexBlock(lock_) {
+    race_winner = winner_;
+    is_canceled = is_canceled_;
+    racers_.clear();
+  }
+
+  HRESULT hr = racers.empty() ? start_hr : racers.front()->hr();
+  if (is_canceled) {
+    hr = GOOPDATE_E_CANCELLED;
+  } else if (race_winner) {
+    hr = race_winner->hr();
+    if (SUCCEEDED(hr) &&
+        !::MoveFileEx(race_winner->filename(),
+                      filename,
+                      MOVEFILE_REPLACE_EXISTING)) {
+      hr = HRESULTFromLastError();
+    }
+    if (SUCCEEDED(hr)) {
+      *winner = race_winner->index();
+      race_winner->download_digest(&download_digest_);
+    }
+  }
+
+  for (size_t i = 0; i != racers.size(); ++i) {
+    Racer* racer = racers[i];
+    const HRESULT racer_hr = racer->hr();
+    if (racer == race_winner ||
+        (FAILED(racer_hr) && racer_hr != GOOPDATE_E_CANCELLED)) {
+      download_metrics_.insert(download_metrics_.end(),
+                               racer->download_metrics().begin(),
+                               racer->download_metrics().end());
+    }
+    if (racer != race_winner || FAILED(hr)) {
+      ::DeleteFile(racer->filename());
+    }
+    delete racer;
+  }
+
+  NET_LOG(L3, (_T("[MirrorRace::DownloadFile][0x%08x][winner %d]"),
+               hr, *winner));
+  return hr;
+}
+
+bool MirrorRace::WaitForNextRacer(int num_started) {
+  const uint64 begin_ms = GetCurrentMsTime();
+  for (;;) {
+    bool is_over = false;
+    bool have_all_failed = false;
+    __mutexBlock(lock_) {
+      is_over = is_canceled_ || winner_ != NULL;
+      have_all_failed = num_done_ == num_started;
+    }
+    if (is_over) {
+      return false;
+    }
+    if (have_all_failed) {
+      return true;
+    }
+
+    const uint64 elapsed_ms = GetCurrentMsTime() - begin_ms;
+    if (elapsed_ms >= static_cast<uint64>(stagger_ms_)) {
+      return true;
+    }
+    ::WaitForSingleObject(get(race_event_),
+                          static_cast<DWORD>(stagger_ms_ - elapsed_ms));
+  }
+}
+
+bool MirrorRace::OnRacerStart(Racer* racer, NetworkRequest* request) {
+  ASSERT1(racer);
+  ASSERT1(request);
+
+  __mutexScope(lock_);
+  if (is_canceled_ || winner_) {
+    return false;
+  }
+  racer->set_request(request);
+  return true;
+}
+
+bool MirrorRace::ClaimWin(Racer* racer) {
+  ASSERT1(racer);
+
+  __mutexScope(lock_);
+  if (winner_ || is_canceled_) {
+    return winner_ == racer;
+  }
+
+  NET_LOG(L3, (_T("[racer %d won]"), racer->index()));
+  winner_ = racer;
+  for (size_t i = 0; i != racers_.size(); ++i) {
+    if (racers_[i] != racer && racers_[i]->request()) {
+      racers_[i]->request()->Cancel();
+    }
+  }
+  VERIFY1(::SetEvent(get(race_event_)));
+  return true;
+}
+
+void MirrorRace::OnRacerDone(Racer* racer) {
+  ASSERT1(racer);
+
+  // A server that does not report progress, for instance because it does not
+  // send the length of the file, wins when its download completes.
+  if (SUCCEEDED(racer->hr())) {
+    ClaimWin(racer);
+  }
+
+  __mutexScope(lock_);
+  racer->set_request(NULL);
+  ++num_done_;
+  VERIFY1(::SetEvent(get(race_event_)));
+}
+
+HRESULT MirrorRace::Cancel() {
+  NET_LOG(L3, (_T("[MirrorRace::Cancel]")));
+
+  __mutexScope(lock_);
+  is_canceled_ = true;
+  HRESULT hr = S_OK;
+  for (size_t i = 0; i != racers_.size(); ++i) {
+    if (racers_[i]->request()) {
+      hr = racers_[i]->request()->Cancel();
+    }
+  }
+  VERIFY1(::SetEvent(get(race_event_)));
+  return hr;
+}
+
+std::vector<DownloadMetrics> MirrorRace::download_metrics() const {
+  return download_metrics_;
+}
+
+bool MirrorRace::download_digest(std::vector<uint8>* digest) const {
+  ASSERT1(digest);
+  if (download_digest_.empty()) {
+    return false;
+  }
+  *digest = download_digest_;
+  return true;
+}
+
+}  // namespace omaha
@@ -0,0 +1,125 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// MirrorRace downloads a file from whichever of several mirrors answers
+// first. The racers start a short time after each other, so that a mirror
+// that answers quickly is the only one contacted. The first racer to receive
+// bytes of the file wins the race, and the others are canceled. The winner
+// then downloads the whole file.
+//
+// A racer starts early if all the racers before it have failed. The race
+// fails if all the racers fail, or if the winner fails after it won.
+//
+// Like the files downloaded by NetworkRequest, the file is not verified. The
+// caller verifies it as a whole once the download completes.
+
+#ifndef OMAHA_NET_MIRROR_RACE_H_
+#define OMAHA_NET_MIRROR_RACE_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "omaha/base/synchronized.h"
+#include "omaha/common/ping_event_download_metrics.h"
+#include "omaha/net/segmented_download.h"
+#include "omaha/third_party/smartany/scoped_any.h"
+
+namespace omaha {
+
+class NetworkRequest;
+class NetworkRequestCallback;
+
+class MirrorRace {
+ public:
+  // Creates the request of each racer, from the thread of the racer.
+  typedef SegmentedDownload::RequestFactory RequestFactory;
+
+  // The time between the starts of the racers, unless set otherwise.
+  static const int kDefaultStaggerMs = 500;
+
+  // |factory| is not owned and must outlive this object.
+  explicit MirrorRace(RequestFactory* factory);
+  ~MirrorRace();
+
+  // Downloads the same file from each of |urls| to |filename|. Returns the
+  // index in |urls| of the mirror the file came from in |winner|, or -1 if no
+  // racer won.
+  HRESULT DownloadFile(const std::vector<CString>& urls,
+                       const CString& filename,
+                       int* winner);
+
+  // Cancels the race. Cancel can be called from a different thread, and makes
+  // DownloadFile return GOOPDATE_E_CANCELLED. The object can't be reused once
+  // it is canceled.
+  HRESULT Cancel();
+
+  // Returns the metrics of the winner of the last race, and of the racers that
+  // failed. The racers that lost the race are not counted.
+  std::vector<DownloadMetrics> download_metrics() const;
+
+  // Returns true if the winner computed the SHA-256 digest of the file as it
+  // was written.
+  bool download_digest(std::vector<uint8>* digest) const;
+
+  // Sets an external observer of the progress of the winner.
+  void set_callback(NetworkRequestCallback* callback) { callback_ = callback; }
+
+  void set_stagger_ms(int stagger_ms);
+
+ private:
+  // Downloads the file from one mirror on a thread of its own.
+  class Racer;
+
+  // Returns the name of the file |racer_index| downloads to.
+  static CString GetRacerFileName(const CString& filename, int racer_index);
+
+  // Waits until the next racer is due, or no more racers are needed. Returns
+  // true if the next racer should start.
+  bool WaitForNextRacer(int num_started);
+
+  // Called by the racers. Returns false if the race is over for |racer|.
+  bool OnRacerStart(Racer* racer, NetworkRequest* request);
+
+  // Claims the win for |racer| and cancels the other racers, unless another
+  // racer won already. Returns true if |racer| is the winner.
+  bool ClaimWin(Racer* racer);
+
+  void OnRacerDone(Racer* racer);
+
+  RequestFactory* factory_;
+  int stagger_ms_;
+  NetworkRequestCallback* callback_;
+
+  // Signaled when a racer wins or finishes, or the race is canceled.
+  scoped_event race_event_;
+
+  // The state below is shared by the racers.
+  LLock lock_;
+  std::vector<Racer*> racers_;
+  Racer* winner_;
+  int num_done_;
+  bool is_canceled_;
+
+  std::vector<DownloadMetrics> download_metrics_;
+  std::vector<uint8> download_digest_;
+
+  DISALLOW_COPY_AND_ASSIGN(MirrorRace);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_NET_MIRROR_RACE_H_
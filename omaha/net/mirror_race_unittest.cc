@@ -0,0 +1,440 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <windows.h>
+#include <winhttp.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "omaha/base/app_util.h"
+#include "omaha/base/error.h"
+#include "omaha/base/file.h"
+#include "omaha/base/synchronized.h"
+#include "omaha/base/thread.h"
+#include "omaha/base/utils.h"
+#include "omaha/net/http_request.h"
+#include "omaha/net/mirror_race.h"
+#include "omaha/net/network_config.h"
+#include "omaha/net/network_request.h"
+#include "omaha/testing/unit_test.h"
+#include "omaha/third_party/smartany/scoped_any.h"
+
+namespace omaha {
+
+namespace {
+
+const int kNumMirrors = 3;
+
+// The time a mirror that does not answer waits before the test gives up on
+// the racer being canceled.
+const int kHangMs = 10000;
+
+// Stands in for a mirror that answers after |latency_ms|, or fails. A mirror
+// that is canceled while it waits stops waiting.
+class MirrorServer {
+ public:
+  MirrorServer(const std::vector<uint8>& content, int latency_ms)
+      : content_(content),
+        latency_ms_(latency_ms),
+        is_unavailable_(false),
+        num_requests_(0),
+        num_canceled_(0) {}
+
+  // Makes the mirror answer 503.
+  void set_is_unavailable(bool is_unavailable) {
+    is_unavailable_ = is_unavailable;
+  }
+
+  int num_requests() const {
+    __mutexScope(lock_);
+    return num_requests_;
+  }
+
+  int num_canceled() const {
+    __mutexScope(lock_);
+    return num_canceled_;
+  }
+
+  HRESULT Serve(HANDLE cancel_event,
+                int* http_status_code,
+                std::vector<uint8>* body) {
+    __mutexBlock(lock_) {
+      ++num_requests_;
+    }
+
+    if (latency_ms_ &&
+        ::WaitForSingleObject(cancel_event, latency_ms_) == WAIT_OBJECT_0) {
+      __mutexBlock(lock_) {
+        ++num_canceled_;
+      }
+      return GOOPDATE_E_CANCELLED;
+    }
+
+    if (is_unavailable_) {
+      *http_status_code = HTTP_STATUS_SERVICE_UNAVAIL;
+      return S_OK;
+    }
+
+    *http_status_code = HTTP_STATUS_OK;
+    *body = content_;
+    return S_OK;
+  }
+
+ private:
+  const std::vector<uint8> content_;
+  const int latency_ms_;
+  bool is_unavailable_;
+
+  LLock lock_;
+  int num_requests_;
+  int num_canceled_;
+
+  DISALLOW_COPY_AND_ASSIGN(MirrorServer);
+};
+
+typedef std::map<CString, MirrorServer*> MirrorMap;
+
+// An HttpRequestInterface that sends its requests to the MirrorServer of its
+// url.
+class MirrorServerRequest : public HttpRequestInterface {
+ public:
+  explicit MirrorServerRequest(const MirrorMap* mirrors)
+      : mirrors_(mirrors),
+        callback_(NULL),
+        http_status_code_(0),
+        error_(S_OK),
+        cancel_event_(::CreateEvent(NULL, true, false, NULL)) {
+    EXPECT_TRUE(cancel_event_);
+  }
+
+  virtual HRESULT Close() { return S_OK; }
+
+  virtual HRESULT Send() {
+    http_status_code_ = 0;
+    response_.clear();
+
+    MirrorMap::const_iterator it = mirrors_->find(url_);
+    EXPECT_TRUE(it != mirrors_->end());
+    if (it == mirrors_->end()) {
+      return E_UNEXPECTED;
+    }
+
+    HRESULT hr = it->second->Serve(get(cancel_event_),
+                                   &http_status_code_,
+                                   &response_);
+    if (SUCCEEDED(hr) && !response_.empty()) {
+      hr = WriteEntireFile(filename_, response_);
+      if (SUCCEEDED(hr) && callback_) {
+        const uint64 size = response_.size();
+        callback_->OnProgress(size, size,
+                              WINHTTP_CALLBACK_STATUS_READ_COMPLETE, NULL);
+      }
+      response_.clear();
+    }
+    error_ = hr;
+    if (SUCCEEDED(hr) && http_status_code_ != HTTP_STATUS_OK) {
+      error_ = HRESULTFromHttpStatusCode(http_status_code_);
+    }
+    return hr;
+  }
+
+  virtual HRESULT Cancel() {
+    return ::SetEvent(get(cancel_event_)) ? S_OK : HRESULTFromLastError();
+  }
+
+  virtual HRESULT Pause() { return E_NOTIMPL; }
+  virtual HRESULT Resume() { return E_NOTIMPL; }
+
+  virtual ResponseBuffer GetResponse() const { return response_; }
+
+  virtual int GetHttpStatusCode() const { return http_status_code_; }
+
+  virtual HRESULT QueryHeadersString(uint32,
+                                     const TCHAR*,
+                                     CString*) const {
+    return HRESULT_FROM_WIN32(ERROR_WINHTTP_HEADER_NOT_FOUND);
+  }
+
+  virtual CString GetResponseHeaders() const { return CString(); }
+  virtual CString ToString() const { return _T("mirror server"); }
+
+  virtual void set_session_handle(HINTERNET) {}
+  virtual void set_url(const CString& url) { url_ = url; }
+  virtual void set_request_buffer(const void*, size_t) {}
+  virtual void set_proxy_configuration(const ProxyConfig&) {}
+
+  virtual void set_filename(const CString& filename) { filename_ = filename; }
+
+  virtual void set_low_priority(bool) {}
+
+  virtual void set_callback(NetworkRequestCallback* callback) {
+    callback_ = callback;
+  }
+
+  virtual void set_additional_headers(const CString&) {}
+
+  virtual CString user_agent() const { return CString(); }
+  virtual void set_user_agent(const CString&) {}
+  virtual void set_proxy_auth_config(const ProxyAuthConfig&) {}
+
+  virtual bool download_metrics(DownloadMetrics* download_metrics) const {
+    download_metrics->url = url_;
+    download_metrics->error = error_;
+    return true;
+  }
+
+  virtual bool download_digest(std::vector<uint8>*) const { return false; }
+
+ private:
+  const MirrorMap* mirrors_;
+  CString url_;
+  CString filename_;
+  NetworkRequestCallback* callback_;
+
+  int http_status_code_;
+  HRESULT error_;
+  std::vector<uint8> response_;
+  scoped_event cancel_event_;
+
+  DISALLOW_COPY_AND_ASSIGN(MirrorServerRequest);
+};
+
+class MirrorServerRequestFactory : public MirrorRace::RequestFactory {
+ public:
+  MirrorServerRequestFactory(const NetworkConfig::Session& session,
+                             const MirrorMap* mirrors)
+      : session_(session), mirrors_(mirrors) {}
+
+  virtual NetworkRequest* CreateRequest() {
+    NetworkRequest* network_request(new NetworkRequest(session_));
+    network_request->AddHttpRequest(new MirrorServerRequest(mirrors_));
+    network_request->set_num_retries(0);
+
+    ProxyConfig direct_config;
+    network_request->set_proxy_configuration(&direct_config);
+    return network_request;
+  }
+
+ private:
+  const NetworkConfig::Session session_;
+  const MirrorMap* mirrors_;
+
+  DISALLOW_COPY_AND_ASSIGN(MirrorServerRequestFactory);
+};
+
+}  // namespace
+
+class MirrorRaceTest : public testing::Test {
+ protected:
+  MirrorRaceTest() {
+    for (size_t i = 0; i != 1000; ++i) {
+      content_.push_back(static_cast<uint8>(i * 7 % 251));
+    }
+  }
+
+  virtual void SetUp() {
+    NetworkConfig* network_config = NULL;
+    EXPECT_HRESULT_SUCCEEDED(
+        NetworkConfigManager::Instance().GetUserNetworkConfig(&network_config));
+
+    factory_.reset(new MirrorServerRequestFactory(network_config->session(),
+                                                  &mirror_map_));
+    race_.reset(new MirrorRace(factory_.get()));
+
+    filename_ = GetTempFilenameAt(app_util::GetModuleDirectory(NULL),
+                                  _T("MRT"));
+    ASSERT_FALSE(filename_.IsEmpty());
+  }
+
+  virtual void TearDown() {
+    race_.reset();
+    for (size_t i = 0; i != mirrors_.size(); ++i) {
+      delete mirrors_[i];
+    }
+    mirrors_.clear();
+    mirror_map_.clear();
+    ::DeleteFile(filename_);
+  }
+
+  // Adds the mirrors in the order they are raced.
+  MirrorServer* AddMirror(int latency_ms) {
+    CString url;
+    url.Format(_T("http://mirror%Iu.example.com/package"), mirrors_.size());
+    MirrorServer* mirror = new MirrorServer(content_, latency_ms);
+    mirrors_.push_back(mirror);
+    mirror_map_[url] = mirror;
+    urls_.push_back(url);
+    return mirror;
+  }
+
+  void ExpectFileIsContent() const {
+    std::vector<uint8> file;
+    EXPECT_HRESULT_SUCCEEDED(ReadEntireFile(filename_, 0, &file));
+    EXPECT_TRUE(file == content_);
+  }
+
+  // Returns true if a file a racer downloaded to is left behind.
+  bool HasRacerFiles() const {
+    for (size_t i = 0; i != urls_.size(); ++i) {
+      CString racer_filename;
+      racer_filename.Format(_T("%s.race%Iu"), filename_, i);
+      if (File::Exists(racer_filename)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::vector<uint8> content_;
+  std::vector<MirrorServer*> mirrors_;
+  MirrorMap mirror_map_;
+  std::vector<CString> urls_;
+  std::unique_ptr<MirrorServerRequestFactory> factory_;
+  std::unique_ptr<MirrorRace> race_;
+  CString filename_;
+};
+
+// The second mirror answers first. The first mirror is canceled, and the third
+// one is never contacted.
+TEST_F(MirrorRaceTest, FastestMirrorWins) {
+  AddMirror(kHangMs);
+  AddMirror(0);
+  AddMirror(0);
+  race_->set_stagger_ms(50);
+
+  int winner = -1;
+  EXPECT_HRESULT_SUCCEEDED(race_->DownloadFile(urls_, filename_, &winner));
+  EXPECT_EQ(1, winner);
+  ExpectFileIsContent();
+  EXPECT_FALSE(HasRacerFiles());
+
+  EXPECT_EQ(1, mirrors_[0]->num_requests());
+  EXPECT_EQ(1, mirrors_[0]->num_canceled());
+  EXPECT_EQ(1, mirrors_[1]->num_requests());
+  EXPECT_EQ(0, mirrors_[2]->num_requests());
+
+  // The metrics of the canceled mirror are left out.
+  const std::vector<DownloadMetrics> download_metrics(
+      race_->download_metrics());
+  ASSERT_EQ(1, download_metrics.size());
+  EXPECT_STREQ(urls_[1], download_metrics[0].url);
+  EXPECT_EQ(S_OK, download_metrics[0].error);
+}
+
+// A mirror that answers before the next racer is due is the only one
+// contacted.
+TEST_F(MirrorRaceTest, FastFirstMirror) {
+  for (int i = 0; i != kNumMirrors; ++i) {
+    AddMirror(0);
+  }
+  race_->set_stagger_ms(kHangMs);
+
+  int winner = -1;
+  EXPECT_HRESULT_SUCCEEDED(race_->DownloadFile(urls_, filename_, &winner));
+  EXPECT_EQ(0, winner);
+  ExpectFileIsContent();
+
+  EXPECT_EQ(1, mirrors_[0]->num_requests());
+  EXPECT_EQ(0, mirrors_[1]->num_requests());
+  EXPECT_EQ(0, mirrors_[2]->num_requests());
+}
+
+// The next racer starts as soon as the racers before it have failed, instead
+// of waiting for its turn.
+TEST_F(MirrorRaceTest, FailedMirrorStartsNextRacer) {
+  AddMirror(0)->set_is_unavailable(true);
+  AddMirror(0);
+  race_->set_stagger_ms(kHangMs * 10);
+
+  int winner = -1;
+  EXPECT_HRESULT_SUCCEEDED(race_->DownloadFile(urls_, filename_, &winner));
+  EXPECT_EQ(1, winner);
+  ExpectFileIsContent();
+  EXPECT_FALSE(HasRacerFiles());
+
+  // The failure of the first mirror is reported.
+  const std::vector<DownloadMetrics> download_metrics(
+      race_->download_metrics());
+  ASSERT_EQ(2, download_metrics.size());
+  EXPECT_STREQ(urls_[0], download_metrics[0].url);
+  EXPECT_EQ(HRESULTFromHttpStatusCode(HTTP_STATUS_SERVICE_UNAVAIL),
+            download_metrics[0].error);
+  EXPECT_STREQ(urls_[1], download_metrics[1].url);
+}
+
+TEST_F(MirrorRaceTest, AllMirrorsFail) {
+  for (int i = 0; i != kNumMirrors; ++i) {
+    AddMirror(0)->set_is_unavailable(true);
+  }
+  race_->set_stagger_ms(kHangMs * 10);
+
+  int winner = 0;
+  EXPECT_EQ(HRESULTFromHttpStatusCode(HTTP_STATUS_SERVICE_UNAVAIL),
+            race_->DownloadFile(urls_, filename_, &winner));
+  EXPECT_EQ(-1, winner);
+  EXPECT_FALSE(HasRacerFiles());
+
+  for (int i = 0; i != kNumMirrors; ++i) {
+    EXPECT_EQ(1, mirrors_[i]->num_requests());
+  }
+  EXPECT_EQ(kNumMirrors, race_->download_metrics().size());
+}
+
+TEST_F(MirrorRaceTest, Cancel) {
+  for (int i = 0; i != kNumMirrors; ++i) {
+    AddMirror(kHangMs);
+  }
+  race_->set_stagger_ms(0);
+
+  // Cancels the race once all the racers wait for their mirrors.
+  class CancelThread : public Runnable {
+   public:
+    CancelThread(MirrorRace* race, const std::vector<MirrorServer*>& mirrors)
+        : race_(race), mirrors_(mirrors) {}
+
+    void Run() override {
+      for (size_t i = 0; i != mirrors_.size(); ++i) {
+        while (!mirrors_[i]->num_requests()) {
+          ::Sleep(10);
+        }
+      }
+      EXPECT_HRESULT_SUCCEEDED(race_->Cancel());
+    }
+
+   private:
+    MirrorRace* race_;
+    const std::vector<MirrorServer*> mirrors_;
+  };
+
+  CancelThread cancel_thread(race_.get(), mirrors_);
+  Thread thread;
+  ASSERT_TRUE(thread.Start(&cancel_thread));
+
+  int winner = 0;
+  EXPECT_EQ(GOOPDATE_E_CANCELLED,
+            race_->DownloadFile(urls_, filename_, &winner));
+  EXPECT_TRUE(thread.WaitTillExit(kHangMs));
+  EXPECT_EQ(-1, winner);
+  EXPECT_FALSE(HasRacerFiles());
+
+  for (int i = 0; i != kNumMirrors; ++i) {
+    EXPECT_EQ(1, mirrors_[i]->num_canceled());
+  }
+  EXPECT_TRUE(race_->download_metrics().empty());
+}
+
+}  // namespace omaha
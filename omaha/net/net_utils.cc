@@ -80,6 +80,15 @@ CString VectorToPrintableString(const std::vector<uint8>& response) {
   return str;
 }
 
+CString ResponseBufferToPrintableString(const ResponseBuffer& response) {
+  CString str;
+  for (size_t i = 0; i != response.num_slabs(); ++i) {
+    str.Append(BufferToPrintableString(response.slab_data(i),
+                                       response.slab_size(i)));
+  }
+  return str;
+}
+
 bool IsHttpUrl(const CString& url) {
   return String_StartsWith(url, kHttpProto, true);
 }
@@ -106,5 +115,27 @@ CString MakeHttpsUrl(const CString& url) {
   return https_url;
 }
 
+CString GetUrlHost(const CString& url) {
+  CString authority(RemoveInternetProtocolHeader(url));
+  const int authority_end = authority.FindOneOf(_T("/?#"));
+  if (authority_end != -1) {
+    authority.Truncate(authority_end);
+  }
+
+  const int user_info_end = authority.ReverseFind(_T('@'));
+  if (user_info_end != -1) {
+    authority.Delete(0, user_info_end + 1);
+  }
+
+  // An IPv6 address is enclosed in brackets, and has colons of its own.
+  const bool is_ipv6 = !authority.IsEmpty() && authority[0] == _T('[');
+  const int host_end = is_ipv6 ? authority.Find(_T(']')) + 1 :
+                                 authority.Find(_T(':'));
+  if (host_end > 0) {
+    authority.Truncate(host_end);
+  }
+  return authority.MakeLower();
+}
+
 }  // namespace omaha
 
@@ -22,6 +22,7 @@
 
 #include "base/basictypes.h"
 #include "omaha/base/string.h"
+#include "omaha/net/response_buffer.h"
 
 namespace omaha {
 
@@ -35,6 +36,7 @@ bool IsMachineConnectedToNetwork();
 // Non-printable characters are converted to '.'.
 CString BufferToPrintableString(const void* buffer, size_t length);
 CString VectorToPrintableString(const std::vector<uint8>& response);
+CString ResponseBufferToPrintableString(const ResponseBuffer& response);
 
 // Returns true of the url starts with http://, case insensitive.
 bool IsHttpUrl(const CString& url);
@@ -48,6 +50,10 @@ CString MakeHttpUrl(const CString& url);
 // Changes the protocol scheme of an url to https.
 CString MakeHttpsUrl(const CString& url);
 
+// Returns the host name of an url in lower case, without the port and the user
+// info. Returns an empty string if the url has no host.
+CString GetUrlHost(const CString& url);
+
 }  // namespace omaha
 
 #endif  // OMAHA_NET_NET_UTILS_H__
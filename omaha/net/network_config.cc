@@ -44,6 +44,7 @@
 #include "omaha/base/utils.h"
 #include "omaha/common/config_manager.h"
 #include "omaha/common/const_goopdate.h"
+#include "omaha/net/connection_pool.h"
 #include "omaha/net/http_client.h"
 #include "omaha/net/winhttp.h"
 
@@ -82,6 +83,7 @@ NetworkConfig::NetworkConfig(bool is_machine)
 
 NetworkConfig::~NetworkConfig() {
   if (session_.session_handle && http_client_.get()) {
+    ConnectionPool::CloseSessionConnections(session_.session_handle);
     http_client_->Close(session_.session_handle);
     session_.session_handle = NULL;
   }
@@ -40,6 +40,13 @@ HRESULT NetworkRequest::Post(const CString& url,
   return impl_->Post(url, buffer, length, response);
 }
 
+HRESULT NetworkRequest::Post(const CString& url,
+                             const void* buffer,
+                             size_t length,
+                             ResponseBuffer* response) {
+  return impl_->Post(url, buffer, length, response);
+}
+
 HRESULT NetworkRequest::Get(const CString& url, std::vector<uint8>* response) {
   return impl_->Get(url, response);
 }
@@ -49,6 +56,39 @@ HRESULT NetworkRequest::DownloadFile(const CString& url,
   return impl_->DownloadFile(url, filename);
 }
 
+HRESULT NetworkRequest::PostAsync(const CString& url,
+                                  const void* buffer,
+                                  size_t length,
+                                  std::vector<uint8>* response,
+                                  NetworkRequestCompletion* completion) {
+  return impl_->PostAsync(url, buffer, length, response, completion);
+}
+
+HRESULT NetworkRequest::GetAsync(const CString& url,
+                                 std::vector<uint8>* response,
+                                 NetworkRequestCompletion* completion) {
+  return impl_->GetAsync(url, response, completion);
+}
+
+HRESULT NetworkRequest::DownloadFileAsync(
+    const CString& url,
+    const CString& filename,
+    NetworkRequestCompletion* completion) {
+  return impl_->DownloadFileAsync(url, filename, completion);
+}
+
+HRESULT NetworkRequest::Wait(DWORD timeout_ms) {
+  return impl_->Wait(timeout_ms);
+}
+
+HANDLE NetworkRequest::completion_event() const {
+  return impl_->completion_event();
+}
+
+bool NetworkRequest::is_pending() const {
+  return impl_->is_pending();
+}
+
 HRESULT NetworkRequest::Pause() {
   return impl_->Pause();
 }
@@ -101,6 +141,10 @@ std::vector<DownloadMetrics> NetworkRequest::download_metrics() const {
   return impl_->download_metrics();
 }
 
+bool NetworkRequest::download_digest(std::vector<uint8>* digest) const {
+  return impl_->download_digest(digest);
+}
+
 HRESULT NetworkRequest::QueryHeadersString(uint32 info_level,
                                            const TCHAR* name,
                                            CString* value) {
@@ -116,4 +160,8 @@ void NetworkRequest::set_proxy_configuration(
   return impl_->set_proxy_configuration(proxy_configuration);
 }
 
+void NetworkRequest::set_host_health(HostHealth* host_health) {
+  return impl_->set_host_health(host_health);
+}
+
 }  // namespace omaha
@@ -36,6 +36,8 @@ class NetworkRequestImpl;
 
 }   // namespace internal
 
+class ResponseBuffer;
+
 class NetworkRequestCallback {
  public:
   virtual ~NetworkRequestCallback() {}
@@ -53,12 +55,25 @@ class NetworkRequestCallback {
   //               is not available.
   // status - WinHttp status codes regarding the progress of the request.
   // status_text - Additional information, when available.
-  virtual void OnProgress(int bytes, int bytes_total,
+  virtual void OnProgress(uint64 bytes, uint64 bytes_total,
                           int status, const TCHAR* status_text) = 0;
 
   virtual void OnRequestRetryScheduled(time64 next_retry_time) = 0;
 };
 
+// Observes the completion of the asynchronous calls of NetworkRequest.
+class NetworkRequestCompletion {
+ public:
+  virtual ~NetworkRequestCompletion() {}
+
+  // Called on a thread of the NetworkRequestDispatcher when the call
+  // completes, with the value the blocking call would have returned. The
+  // waiters of the request are released before the call. The callee can
+  // query the request or delete it, but the completion must outlive the call.
+  virtual void OnRequestComplete(HRESULT hr) = 0;
+};
+
+class  HostHealth;
 class  HttpRequestInterface;
 
 // NetworkRequest is the main interface to the net module. The semantics of
@@ -66,8 +81,9 @@ class  HttpRequestInterface;
 // request body, to a destination specified as a memory buffer or a file.
 // NetworkRequest encapsulates the retry logic for a request, the fall back to
 // different network configurations, and ultimately the fallback to different
-// network mechanisms. The calls are blocking calls. One instance of the class
-// is responsible for one request only.
+// network mechanisms. The calls are blocking calls, unless the asynchronous
+// variants are used. One instance of the class is responsible for one request
+// only.
 // The client of NetworkRequest is responsible for configuring the network
 // fallbacks. This gives the caller a lot of flexibility over the fallbacks but
 // it requires more work to properly set the fallback chain.
@@ -110,6 +126,21 @@ class NetworkRequest {
     return Post(url, buffer, length, response);
   }
 
+  // Posts a buffer to a url. The response shares the bytes the http request
+  // received instead of copying them, and it has their SHA-256 digest.
+  HRESULT Post(const CString& url,
+               const void* buffer,
+               size_t length,
+               ResponseBuffer* response);
+
+  HRESULT PostUtf8String(const CString& url,
+                         const CStringA& request,
+                         ResponseBuffer* response) {
+    const uint8* buffer = reinterpret_cast<const uint8*>(request.GetString());
+    size_t length = request.GetLength();
+    return Post(url, buffer, length, response);
+  }
+
   // Posts a Unicode string to a url.
   HRESULT PostString(const CString& url,
                      const CString& request,
@@ -123,6 +154,41 @@ class NetworkRequest {
   // Downloads a url to a file.
   HRESULT DownloadFile(const CString& url, const CString& filename);
 
+  // PostAsync, GetAsync, and DownloadFileAsync start the request on a thread
+  // of the NetworkRequestDispatcher and return S_OK at once, so that several
+  // requests can be in flight on the same thread. The request runs as the
+  // caller, when the caller is impersonating. Its result is returned by Wait,
+  // and passed to |completion| if it is not NULL. The ownership of
+  // |completion| and of the buffers remains with the caller, and they must
+  // stay valid until the request completes. Only one call at a time is
+  // allowed. Cancel stops the request, and deleting the object cancels the
+  // request and waits for it to complete.
+  HRESULT PostAsync(const CString& url,
+                    const void* buffer,
+                    size_t length,
+                    std::vector<uint8>* response,
+                    NetworkRequestCompletion* completion);
+
+  HRESULT GetAsync(const CString& url,
+                   std::vector<uint8>* response,
+                   NetworkRequestCompletion* completion);
+
+  HRESULT DownloadFileAsync(const CString& url,
+                            const CString& filename,
+                            NetworkRequestCompletion* completion);
+
+  // Waits for the asynchronous call to complete and returns its result, or
+  // returns HRESULT_FROM_WIN32(ERROR_TIMEOUT) if it does not complete within
+  // |timeout_ms|. Returns E_UNEXPECTED if no call was started.
+  HRESULT Wait(DWORD timeout_ms);
+
+  // Returns a manual reset event, which is signaled when no asynchronous call
+  // is in progress. The event is owned by the request.
+  HANDLE completion_event() const;
+
+  // Returns true while an asynchronous call is in progress.
+  bool is_pending() const;
+
   // Enables a separate thread to temporarily stops the network downloading.
   // The downloading thread will be blocked inside NetworkRequest::Post/Get
   // infinitely by an event until Resume/Cancel/Close is called.
@@ -155,6 +221,10 @@ class NetworkRequest {
   // Returns the download metrics corresponding to a download request.
   std::vector<DownloadMetrics> download_metrics() const;
 
+  // Returns true if DownloadFile computed the SHA-256 digest of the file while
+  // writing it, and copies the digest in |digest|.
+  bool download_digest(std::vector<uint8>* digest) const;
+
   void set_proxy_auth_config(const ProxyAuthConfig& proxy_auth_config);
 
   // Sets the number of retries for the request. The retry mechanism uses
@@ -166,9 +236,11 @@ class NetworkRequest {
   // in network_request_impl.h -- currently, it is 5 seconds.)
   void set_time_between_retries(int time_between_retries_ms);
 
-  // Sets a +/- jitter, in milliseconds, to be applied to each retry delay.
-  // Set to 0 (or any negative value) to disable delay jittering.  (Default
-  // value is set in network_request_impl.h -- currently, it is 3 seconds.)
+  // Enables jittering of the retry delays when |jitter_ms| is positive. Each
+  // delay is then drawn at random between the initial delay and three times
+  // the previous delay, so that the clients that failed together do not retry
+  // together. Set to 0 (or any negative value) to double the delay on each
+  // retry instead. Jittering is enabled by default.
   void set_retry_delay_jitter(int jitter_ms);
 
   // Sets an external observer for the request. The ownership of the callback
@@ -185,6 +257,13 @@ class NetworkRequest {
   // automatically.
   void set_proxy_configuration(const ProxyConfig* proxy_configuration);
 
+  // Shares the health of the hosts the request is sent to with the other
+  // requests using |host_health|. The request fails at once with
+  // OMAHA_NET_E_HOST_UNAVAILABLE when the host is known to be down, and
+  // honors the X-Retry-After values other requests received from the host.
+  // The ownership of |host_health| remains with the caller.
+  void set_host_health(HostHealth* host_health);
+
  private:
   // Uses pimpl idiom to minimize dependencies on implementation details.
   std::unique_ptr<internal::NetworkRequestImpl> impl_;
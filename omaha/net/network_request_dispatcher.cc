@@ -0,0 +1,133 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/net/network_request_dispatcher.h"
+
+#include <objbase.h>
+#include <utility>
+
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/utils.h"
+#include "omaha/net/network_request_impl.h"
+
+namespace omaha {
+
+NetworkRequestDispatcher* NetworkRequestDispatcher::instance_ = NULL;
+LLock NetworkRequestDispatcher::instance_lock_;
+
+class NetworkRequestDispatcher::DispatchWorkItem : public UserWorkItem {
+ public:
+  DispatchWorkItem(NetworkRequestDispatcher* dispatcher,
+                   internal::NetworkRequestImpl* request)
+      : dispatcher_(dispatcher), request_(request) {
+    ASSERT1(dispatcher_);
+    ASSERT1(request_);
+  }
+
+ private:
+  void DoProcess() override {
+    dispatcher_->RunRequest(request_);
+  }
+
+  NetworkRequestDispatcher* dispatcher_;
+  internal::NetworkRequestImpl* request_;
+
+  DISALLOW_COPY_AND_ASSIGN(DispatchWorkItem);
+};
+
+NetworkRequestDispatcher::NetworkRequestDispatcher()
+    : is_shutting_down_(false),
+      thread_pool_(new ThreadPool) {
+  VERIFY_SUCCEEDED(thread_pool_->Initialize(kShutdownDelayMs));
+}
+
+NetworkRequestDispatcher::~NetworkRequestDispatcher() {
+  // Cancels the pending requests so that the thread pool does not wait for
+  // them to run to completion.
+  __mutexBlock(lock_) {
+    is_shutting_down_ = true;
+    for (std::set<internal::NetworkRequestImpl*>::const_iterator it =
+             pending_requests_.begin();
+         it != pending_requests_.end();
+         ++it) {
+      VERIFY_SUCCEEDED((*it)->Cancel());
+    }
+  }
+
+  thread_pool_->Stop();
+  thread_pool_.reset();
+}
+
+NetworkRequestDispatcher& NetworkRequestDispatcher::Instance() {
+  __mutexScope(instance_lock_);
+  if (!instance_) {
+    instance_ = new NetworkRequestDispatcher;
+  }
+  return *instance_;
+}
+
+void NetworkRequestDispatcher::DeleteInstance() {
+  NetworkRequestDispatcher* instance = omaha::interlocked_exchange_pointer(
+      &instance_, static_cast<NetworkRequestDispatcher*>(NULL));
+  delete instance;
+}
+
+HRESULT NetworkRequestDispatcher::Dispatch(
+    internal::NetworkRequestImpl* request) {
+  ASSERT1(request);
+
+  __mutexScope(lock_);
+  if (is_shutting_down_) {
+    return GOOPDATE_E_CANCELLED;
+  }
+
+  // Registers the request before it is queued, since it may complete before
+  // QueueUserWorkItem returns.
+  pending_requests_.insert(request);
+
+  // BITS requests need COM on the thread that runs them.
+  std::unique_ptr<UserWorkItem> work_item(new DispatchWorkItem(this, request));
+  HRESULT hr = thread_pool_->QueueUserWorkItem(std::move(work_item),
+                                               COINIT_MULTITHREADED,
+                                               WT_EXECUTELONGFUNCTION);
+  if (FAILED(hr)) {
+    NET_LOG(LE, (_T("[QueueUserWorkItem failed][0x%08x]"), hr));
+    pending_requests_.erase(request);
+  }
+  return hr;
+}
+
+int NetworkRequestDispatcher::num_pending_requests() const {
+  __mutexScope(lock_);
+  return static_cast<int>(pending_requests_.size());
+}
+
+void NetworkRequestDispatcher::RunRequest(
+    internal::NetworkRequestImpl* request) {
+  ASSERT1(request);
+
+  const HRESULT hr = request->DoAsyncRequest();
+
+  // The request is unregistered before it completes, since the owner of the
+  // request may delete it as soon as it completes.
+  __mutexBlock(lock_) {
+    pending_requests_.erase(request);
+  }
+  request->CompleteAsyncRequest(hr);
+}
+
+}  // namespace omaha
@@ -0,0 +1,81 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// NetworkRequestDispatcher runs the asynchronous NetworkRequest calls on the
+// threads of a thread pool shared by the process, so that the requests of a
+// session, such as the update check, the pings, and the downloads, overlap
+// without each caller creating a thread of its own.
+//
+// The dispatcher keeps track of the requests it runs. Deleting the dispatcher
+// cancels them and waits for them to complete, so the dispatcher must be
+// deleted before the network configuration it depends on.
+
+#ifndef OMAHA_NET_NETWORK_REQUEST_DISPATCHER_H_
+#define OMAHA_NET_NETWORK_REQUEST_DISPATCHER_H_
+
+#include <windows.h>
+#include <memory>
+#include <set>
+
+#include "base/basictypes.h"
+#include "omaha/base/synchronized.h"
+#include "omaha/base/thread_pool.h"
+
+namespace omaha {
+
+namespace internal {
+
+class NetworkRequestImpl;
+
+}   // namespace internal
+
+class NetworkRequestDispatcher {
+ public:
+  // How long the destructor waits for the canceled requests to complete.
+  static const int kShutdownDelayMs = 60 * 1000;
+
+  NetworkRequestDispatcher();
+  ~NetworkRequestDispatcher();
+
+  static NetworkRequestDispatcher& Instance();
+  static void DeleteInstance();
+
+  // Runs the asynchronous call of |request| on a thread of the pool. The
+  // request must stay alive until it completes.
+  HRESULT Dispatch(internal::NetworkRequestImpl* request);
+
+  // Returns the number of requests started and not completed.
+  int num_pending_requests() const;
+
+ private:
+  class DispatchWorkItem;
+
+  // Runs |request| in the context of a thread of the pool.
+  void RunRequest(internal::NetworkRequestImpl* request);
+
+  LLock lock_;
+  std::set<internal::NetworkRequestImpl*> pending_requests_;
+  bool is_shutting_down_;
+  std::unique_ptr<ThreadPool> thread_pool_;
+
+  static NetworkRequestDispatcher* instance_;
+  static LLock instance_lock_;
+
+  DISALLOW_COPY_AND_ASSIGN(NetworkRequestDispatcher);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_NET_NETWORK_REQUEST_DISPATCHER_H_
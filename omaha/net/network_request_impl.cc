@@ -21,6 +21,7 @@
 #include <algorithm>
 #include <cctype>
 #include <functional>
+#include <utility>
 #include <vector>
 #include "base/basictypes.h"
 #include "base/rand_util.h"
@@ -31,12 +32,14 @@
 #include "omaha/base/logging.h"
 #include "omaha/base/omaha_version.h"
 #include "omaha/base/safe_format.h"
+#include "omaha/base/scoped_impersonation.h"
 #include "omaha/base/string.h"
 #include "omaha/base/time.h"
 #include "omaha/base/user_info.h"
 #include "omaha/net/http_client.h"
 #include "omaha/net/net_utils.h"
 #include "omaha/net/network_config.h"
+#include "omaha/net/network_request_dispatcher.h"
 #include "omaha/third_party/smartany/scoped_any.h"
 
 namespace omaha {
@@ -92,8 +95,10 @@ NetworkRequestImpl::NetworkRequestImpl(
         low_priority_(false),
         initial_retry_delay_ms_(kDefaultTimeBetweenRetriesMs),
         retry_delay_jitter_ms_(kDefaultRetryTimeJitterMs),
+        host_health_(NULL),
         http_status_code_(0),
         response_(NULL),
+        response_buffer_(NULL),
         network_session_(network_session),
         callback_(NULL),
         cur_http_request_(NULL),
@@ -104,7 +109,9 @@ NetworkRequestImpl::NetworkRequestImpl(
         cur_retry_count_(0),
         cur_retry_delay_ms_(kDefaultTimeBetweenRetriesMs),
         http_attempts_(0),
-        is_canceled_(false) {
+        is_canceled_(false),
+        is_async_pending_(false),
+        async_result_(E_UNEXPECTED) {
   // NetworkConfig::Initialize must be called before using NetworkRequest.
   // If Winhttp cannot be loaded, this handle will be NULL.
   if (!network_session.session_handle) {
@@ -117,6 +124,10 @@ NetworkRequestImpl::NetworkRequestImpl(
   reset(event_cancel_, ::CreateEvent(NULL, true, false, NULL));
   ASSERT1(event_cancel_);
 
+  // The event is reset while an asynchronous call is in progress.
+  reset(event_async_complete_, ::CreateEvent(NULL, true, true, NULL));
+  ASSERT1(event_async_complete_);
+
   const CString mid(NetworkConfig::GetMID());
   if (!mid.IsEmpty()) {
     AddHeader(kHeaderXMID, mid);
@@ -129,6 +140,13 @@ NetworkRequestImpl::NetworkRequestImpl(
 }
 
 NetworkRequestImpl::~NetworkRequestImpl() {
+  // The thread of the dispatcher uses the object until the call completes.
+  if (is_async_pending_) {
+    VERIFY_SUCCEEDED(Cancel());
+    VERIFY1(::WaitForSingleObject(get(event_async_complete_), INFINITE) ==
+            WAIT_OBJECT_0);
+  }
+
   for (size_t i = 0; i != http_request_chain_.size(); ++i) {
     delete http_request_chain_[i];
   }
@@ -138,6 +156,9 @@ void NetworkRequestImpl::Reset() {
   if (response_) {
     response_->clear();
   }
+  if (response_buffer_) {
+    response_buffer_->Clear();
+  }
   response_headers_.Empty();
   http_status_code_      = 0;
   cur_http_request_      = NULL;
@@ -148,6 +169,7 @@ void NetworkRequestImpl::Reset() {
   last_hr_               = S_OK;
   last_http_status_code_ = 0;
   download_metrics_.clear();
+  download_digest_.clear();
 }
 
 HRESULT NetworkRequestImpl::Close() {
@@ -185,6 +207,20 @@ HRESULT NetworkRequestImpl::Post(const CString& url,
   request_buffer_ = buffer;
   request_buffer_length_ = length;
   response_ = response;
+  response_buffer_ = NULL;
+  return DoSendWithRetries();
+}
+
+HRESULT NetworkRequestImpl::Post(const CString& url,
+                                 const void* buffer,
+                                 size_t length,
+                                 ResponseBuffer* response) {
+  ASSERT1(response);
+  url_ = url;
+  request_buffer_ = buffer;
+  request_buffer_length_ = length;
+  response_ = NULL;
+  response_buffer_ = response;
   return DoSendWithRetries();
 }
 
@@ -195,6 +231,7 @@ HRESULT NetworkRequestImpl::Get(const CString& url,
   request_buffer_ = NULL;
   request_buffer_length_ = 0;
   response_ = response;
+  response_buffer_ = NULL;
   return DoSendWithRetries();
 }
 
@@ -205,9 +242,140 @@ HRESULT NetworkRequestImpl::DownloadFile(const CString& url,
   request_buffer_ = NULL;
   request_buffer_length_ = 0;
   response_ = NULL;
+  response_buffer_ = NULL;
   return DoSendWithRetries();
 }
 
+HRESULT NetworkRequestImpl::PostAsync(const CString& url,
+                                      const void* buffer,
+                                      size_t length,
+                                      std::vector<uint8>* response,
+                                      NetworkRequestCompletion* completion) {
+  ASSERT1(response);
+  std::unique_ptr<AsyncRequest> async_request(new AsyncRequest);
+  async_request->operation = ASYNC_POST;
+  async_request->url = url;
+  async_request->buffer = buffer;
+  async_request->length = length;
+  async_request->response = response;
+  async_request->completion = completion;
+  return SendAsync(std::move(async_request));
+}
+
+HRESULT NetworkRequestImpl::GetAsync(const CString& url,
+                                     std::vector<uint8>* response,
+                                     NetworkRequestCompletion* completion) {
+  ASSERT1(response);
+  std::unique_ptr<AsyncRequest> async_request(new AsyncRequest);
+  async_request->operation = ASYNC_GET;
+  async_request->url = url;
+  async_request->response = response;
+  async_request->completion = completion;
+  return SendAsync(std::move(async_request));
+}
+
+HRESULT NetworkRequestImpl::DownloadFileAsync(
+    const CString& url,
+    const CString& filename,
+    NetworkRequestCompletion* completion) {
+  std::unique_ptr<AsyncRequest> async_request(new AsyncRequest);
+  async_request->operation = ASYNC_DOWNLOAD_FILE;
+  async_request->url = url;
+  async_request->filename = filename;
+  async_request->completion = completion;
+  return SendAsync(std::move(async_request));
+}
+
+HRESULT NetworkRequestImpl::SendAsync(
+    std::unique_ptr<AsyncRequest> async_request) {
+  ASSERT1(async_request.get());
+  NET_LOG(L3, (_T("[NetworkRequestImpl::SendAsync][%s]"), async_request->url));
+
+  // Only one call at a time is allowed.
+  if (::InterlockedCompareExchange(&is_async_pending_, true, false)) {
+    ASSERT(false, (_T("[an asynchronous call is in progress]")));
+    return E_UNEXPECTED;
+  }
+
+  HANDLE token = NULL;
+  if (::OpenThreadToken(::GetCurrentThread(),
+                        TOKEN_QUERY | TOKEN_IMPERSONATE | TOKEN_DUPLICATE,
+                        true,
+                        &token)) {
+    reset(async_request->impersonation_token, token);
+  }
+
+  async_request_ = std::move(async_request);
+  VERIFY1(::ResetEvent(get(event_async_complete_)));
+
+  HRESULT hr = NetworkRequestDispatcher::Instance().Dispatch(this);
+  if (FAILED(hr)) {
+    NET_LOG(LE, (_T("[Dispatch failed][0x%08x]"), hr));
+    async_request_.reset();
+    async_result_ = hr;
+    ::InterlockedExchange(&is_async_pending_, false);
+    VERIFY1(::SetEvent(get(event_async_complete_)));
+  }
+  return hr;
+}
+
+HRESULT NetworkRequestImpl::DoAsyncRequest() {
+  ASSERT1(async_request_.get());
+
+  std::unique_ptr<scoped_impersonation> impersonate_user;
+  if (valid(async_request_->impersonation_token)) {
+    impersonate_user.reset(
+        new scoped_impersonation(get(async_request_->impersonation_token)));
+    if (FAILED(impersonate_user->result())) {
+      return impersonate_user->result();
+    }
+  }
+
+  switch (async_request_->operation) {
+    case ASYNC_POST:
+      return Post(async_request_->url,
+                  async_request_->buffer,
+                  async_request_->length,
+                  async_request_->response);
+    case ASYNC_GET:
+      return Get(async_request_->url, async_request_->response);
+    case ASYNC_DOWNLOAD_FILE:
+      return DownloadFile(async_request_->url, async_request_->filename);
+    default:
+      ASSERT1(false);
+      return E_UNEXPECTED;
+  }
+}
+
+void NetworkRequestImpl::CompleteAsyncRequest(HRESULT hr) {
+  ASSERT1(async_request_.get());
+  NET_LOG(L3, (_T("[NetworkRequestImpl::CompleteAsyncRequest][0x%08x]"), hr));
+
+  // The waiters are released before the completion runs, since the
+  // completion may delete the request. The object must not be used once the
+  // event is signaled.
+  NetworkRequestCompletion* completion = async_request_->completion;
+  async_request_.reset();
+  async_result_ = hr;
+  ::InterlockedExchange(&is_async_pending_, false);
+  VERIFY1(::SetEvent(get(event_async_complete_)));
+
+  if (completion) {
+    completion->OnRequestComplete(hr);
+  }
+}
+
+HRESULT NetworkRequestImpl::Wait(DWORD timeout_ms) {
+  switch (::WaitForSingleObject(get(event_async_complete_), timeout_ms)) {
+    case WAIT_OBJECT_0:
+      return async_result_;
+    case WAIT_TIMEOUT:
+      return HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+    default:
+      return HRESULTFromLastError();
+  }
+}
+
 HRESULT NetworkRequestImpl::Pause() {
   NET_LOG(L3, (_T("[NetworkRequestImpl::Pause]")));
   HRESULT hr = S_OK;
@@ -240,13 +408,13 @@ HRESULT NetworkRequestImpl::Resume() {
 
 HRESULT NetworkRequestImpl::DoSendWithRetries() {
   ASSERT1(num_retries_ >= 0);
-  ASSERT1(response_ || !filename_.IsEmpty());
+  ASSERT1(response_ || response_buffer_ || !filename_.IsEmpty());
 
   Reset();
 
   int http_status_code(0);
   CString response_headers;
-  std::vector<uint8> response;
+  ResponseBuffer response;
 
 #if DEBUG
   // Looking up account and domain information can block when the user info
@@ -266,6 +434,11 @@ HRESULT NetworkRequestImpl::DoSendWithRetries() {
   cur_retry_count_ = 0;
   http_attempts_ = 0;
 
+  host_.Empty();
+  if (host_health_) {
+    host_ = GetUrlHost(url_);
+  }
+
   while (CanRetryRequest()) {
     // Check early to see if we've been canceled.
     if (IsHandleSignaled(get(event_cancel_))) {
@@ -281,6 +454,22 @@ HRESULT NetworkRequestImpl::DoSendWithRetries() {
       return hr;
     }
 
+    // Fail fast if the host is known to be down, so that the caller can move
+    // on to another url. A retry returns the result of the previous attempt.
+    if (!host_.IsEmpty()) {
+      int wait_ms = 0;
+      HRESULT hr_health = host_health_->BeginRequest(host_, &wait_ms);
+      if (FAILED(hr_health)) {
+        NET_LOG(LW, (_T("[host unavailable][%s][%d ms]"), host_, wait_ms));
+        SafeCStringAppendFormat(&trace_, _T("Host unavailable for %d ms\r\n"),
+                                wait_ms);
+        if (cur_retry_count_ == 0) {
+          return hr_health;
+        }
+        break;
+      }
+    }
+
     // Do proxy detection, and attempt to do an HTTP request with every
     // configuration we've found.
     DetectProxyConfiguration(&proxy_configurations_);
@@ -289,6 +478,7 @@ HRESULT NetworkRequestImpl::DoSendWithRetries() {
                  NetworkConfig::ToString(proxy_configurations_)));
 
     hr = DoSend(&http_status_code, &response_headers, &response);
+    EndHostRequest(hr, http_status_code);
 
     // Exit from the loop if we got a successful request, or a HTTP 4xx error
     // (4xx implies that something has changed on the server and that this URL
@@ -328,8 +518,13 @@ HRESULT NetworkRequestImpl::DoSendWithRetries() {
   // update the object state with the result of the last successful request.
   http_status_code_ = http_status_code;
   response_headers_ = response_headers;
+  // The layers of the request chain share the bytes of the response, which
+  // are only made contiguous here, for the callers that want a vector.
   if (response_) {
-    response_->swap(response);
+    response.CopyTo(response_);
+  }
+  if (response_buffer_) {
+    response_buffer_->swap(response);
   }
 
   // Avoid returning generic errors from the network stack.
@@ -339,7 +534,7 @@ HRESULT NetworkRequestImpl::DoSendWithRetries() {
 
 HRESULT NetworkRequestImpl::DoSend(int* http_status_code,
                                    CString* response_headers,
-                                   std::vector<uint8>* response) {
+                                   ResponseBuffer* response) {
   ASSERT1(http_status_code);
   ASSERT1(response_headers);
   ASSERT1(response);
@@ -354,7 +549,7 @@ HRESULT NetworkRequestImpl::DoSend(int* http_status_code,
   HRESULT error_hr = S_OK;
   int     error_http_status_code = 0;
   CString error_response_headers;
-  std::vector<uint8> error_response;
+  ResponseBuffer error_response;
 
   // Tries out all the available configurations until one of them succeeds.
   // TODO(omaha): remember the last good configuration and prefer that for
@@ -397,7 +592,7 @@ HRESULT NetworkRequestImpl::DoSend(int* http_status_code,
   }
 
   OPT_LOG(L3, (_T("[Send response received][result 0x%x][status code %d][%s]"),
-      result, *http_status_code, VectorToPrintableString(*response)));
+      result, *http_status_code, ResponseBufferToPrintableString(*response)));
 
 #ifdef DEBUG
   if (!filename_.IsEmpty()) {
@@ -412,7 +607,7 @@ HRESULT NetworkRequestImpl::DoSend(int* http_status_code,
 HRESULT NetworkRequestImpl::DoSendWithConfig(
     int* http_status_code,
     CString* response_headers,
-    std::vector<uint8>* response) {
+    ResponseBuffer* response) {
   ASSERT1(response_headers);
   ASSERT1(response);
   ASSERT1(http_status_code);
@@ -421,7 +616,7 @@ HRESULT NetworkRequestImpl::DoSendWithConfig(
   HRESULT error_hr = S_OK;
   int     error_http_status_code = 0;
   CString error_response_headers;
-  std::vector<uint8> error_response;
+  ResponseBuffer error_response;
 
   ASSERT1(cur_proxy_config_);
 
@@ -454,7 +649,7 @@ HRESULT NetworkRequestImpl::DoSendWithConfig(
       error_hr = hr;
       error_http_status_code = cur_http_request_->GetHttpStatusCode();
       error_response_headers = cur_http_request_->GetResponseHeaders();
-      cur_http_request_->GetResponse().swap(error_response);
+      error_response = cur_http_request_->GetResponse();
       first_error_from_http_request_saved = true;
     }
 
@@ -501,7 +696,7 @@ HRESULT NetworkRequestImpl::DoSendWithConfig(
 HRESULT NetworkRequestImpl::DoSendHttpRequest(
     int* http_status_code,
     CString* response_headers,
-    std::vector<uint8>* response) {
+    ResponseBuffer* response) {
   ASSERT1(response_headers);
   ASSERT1(response);
   ASSERT1(http_status_code);
@@ -543,6 +738,11 @@ HRESULT NetworkRequestImpl::DoSendHttpRequest(
     download_metrics_.push_back(download_metrics);
   }
 
+  download_digest_.clear();
+  if (SUCCEEDED(last_hr_) && !filename_.IsEmpty()) {
+    cur_http_request_->download_digest(&download_digest_);
+  }
+
   if (last_hr_ == GOOPDATE_E_CANCELLED) {
     return last_hr_;
   }
@@ -551,7 +751,7 @@ HRESULT NetworkRequestImpl::DoSendHttpRequest(
 
   *http_status_code = cur_http_request_->GetHttpStatusCode();
   *response_headers = cur_http_request_->GetResponseHeaders();
-  cur_http_request_->GetResponse().swap(*response);
+  *response = cur_http_request_->GetResponse();
 
   CString retry_after_header;
   if (IsHttpsUrl(url_) &&
@@ -727,8 +927,68 @@ HRESULT NetworkRequestImpl::DoWaitBetweenRetries() {
   }
 }
 
+void NetworkRequestImpl::EndHostRequest(HRESULT hr, int http_status_code) {
+  if (host_.IsEmpty()) {
+    return;
+  }
+  ASSERT1(host_health_);
+
+  if (retry_after_seconds_ > 0) {
+    host_health_->SetRetryAfter(host_, retry_after_seconds_);
+  }
+
+  // Only the failures to reach the host and the server errors count against
+  // the host. A 4xx response means the host works.
+  HostHealth::Result result = HostHealth::RESULT_SUCCESS;
+  if (hr == GOOPDATE_E_CANCELLED ||
+      hr == GOOPDATE_E_NO_NETWORK ||
+      hr == CI_E_BITS_DISABLED) {
+    result = HostHealth::RESULT_NONE;
+  } else if (FAILED(hr) &&
+             (!http_status_code ||
+              HttpClient::GetStatusCodeClass(http_status_code) ==
+                  HttpClient::STATUS_CODE_SERVER_ERROR)) {
+    result = HostHealth::RESULT_FAILURE;
+  }
+  host_health_->EndRequest(host_, result);
+}
+
+int NetworkRequestImpl::GetJitteredRetryDelayMs(int base_delay_ms,
+                                                int cur_delay_ms,
+                                                uint32 random) {
+  ASSERT1(base_delay_ms > 0);
+
+  const int delay_ms = HostHealth::GetDecorrelatedJitterMs(
+      base_delay_ms,
+      std::max(cur_delay_ms, base_delay_ms),
+      random);
+  return std::min(delay_ms, static_cast<int>(kMaxTimeBetweenRetriesMs));
+}
+
 void NetworkRequestImpl::ComputeNextRetryDelay(
     HttpClient::StatusCodeClass previous_result) {
+  // With jittering, the next delay is drawn between the initial delay and three
+  // times the current delay. The draw is capped, so that the number of retries
+  // is set by num_retries_ and not by how high the draws happen to be.
+  if (retry_delay_jitter_ms_ > 0) {
+    int base_delay_ms = initial_retry_delay_ms_;
+    if (previous_result == HttpClient::STATUS_CODE_SERVER_ERROR) {
+      base_delay_ms = std::max(base_delay_ms,
+                               static_cast<int>(
+                                   kServerErrMinTimeBetweenRetriesMs));
+    }
+    base_delay_ms = std::max(base_delay_ms, 1);
+
+    unsigned int random = 0;
+    if (!RandUint32(&random)) {
+      random = static_cast<unsigned int>(::GetTickCount());
+    }
+    cur_retry_delay_ms_ = GetJitteredRetryDelayMs(base_delay_ms,
+                                                  cur_retry_delay_ms_,
+                                                  random);
+    return;
+  }
+
   // If the result of the previous attempt was an HTTP 5xx error, we need to
   // aggressively back off.
   if (previous_result == HttpClient::STATUS_CODE_SERVER_ERROR) {
@@ -746,19 +1006,6 @@ void NetworkRequestImpl::ComputeNextRetryDelay(
   }
 
   cur_retry_delay_ms_ *= kTimeBetweenRetriesMultiplier;
-
-  if (retry_delay_jitter_ms_ > 0 &&
-      cur_retry_delay_ms_ >= retry_delay_jitter_ms_) {
-    // Generate a random int containing 2x the jitter amount, add it, then
-    // subtract the jitter amount to produce +/- jitter.
-    unsigned int jitter_amount = 0;
-    if (!RandUint32(&jitter_amount)) {
-      jitter_amount = retry_delay_jitter_ms_;
-    }
-    cur_retry_delay_ms_ += jitter_amount % (2 * retry_delay_jitter_ms_);
-    cur_retry_delay_ms_ -= retry_delay_jitter_ms_;
-    ASSERT1(cur_retry_delay_ms_ > 0);
-  }
 }
 
 }   // namespace internal
@@ -18,13 +18,16 @@
 
 #include <windows.h>
 #include <atlstr.h>
+#include <memory>
 #include <vector>
 
 #include "base/basictypes.h"
 #include "omaha/base/synchronized.h"
+#include "omaha/net/host_health.h"
 #include "omaha/net/network_config.h"
 #include "omaha/net/network_request.h"
 #include "omaha/net/http_request.h"
+#include "omaha/net/response_buffer.h"
 #include "omaha/third_party/smartany/scoped_any.h"
 
 namespace omaha {
@@ -45,6 +48,13 @@ class NetworkRequestImpl {
   explicit NetworkRequestImpl(const NetworkConfig::Session& network_session);
   ~NetworkRequestImpl();
 
+  // Returns the delay before the next retry when jitter is enabled. The delay
+  // is drawn with |random| between |base_delay_ms| and three times
+  // |cur_delay_ms|, and capped at kMaxTimeBetweenRetriesMs.
+  static int GetJitteredRetryDelayMs(int base_delay_ms,
+                                     int cur_delay_ms,
+                                     uint32 random);
+
   HRESULT Close();
 
   void AddHttpRequest(HttpRequestInterface* http_request);
@@ -53,9 +63,35 @@ class NetworkRequestImpl {
                const void* buffer,
                size_t length,
                std::vector<uint8>* response);
+  HRESULT Post(const CString& url,
+               const void* buffer,
+               size_t length,
+               ResponseBuffer* response);
   HRESULT Get(const CString& url, std::vector<uint8>* response);
   HRESULT DownloadFile(const CString& url, const CString& filename);
 
+  HRESULT PostAsync(const CString& url,
+                    const void* buffer,
+                    size_t length,
+                    std::vector<uint8>* response,
+                    NetworkRequestCompletion* completion);
+  HRESULT GetAsync(const CString& url,
+                   std::vector<uint8>* response,
+                   NetworkRequestCompletion* completion);
+  HRESULT DownloadFileAsync(const CString& url,
+                            const CString& filename,
+                            NetworkRequestCompletion* completion);
+  HRESULT Wait(DWORD timeout_ms);
+
+  HANDLE completion_event() const { return get(event_async_complete_); }
+
+  bool is_pending() const { return !!is_async_pending_; }
+
+  // Called by the NetworkRequestDispatcher on a thread of its pool to run the
+  // asynchronous call, then to report its result.
+  HRESULT DoAsyncRequest();
+  void CompleteAsyncRequest(HRESULT hr);
+
   HRESULT Pause();
   HRESULT Resume();
   HRESULT Cancel();
@@ -99,18 +135,62 @@ class NetworkRequestImpl {
     }
   }
 
+  void set_host_health(HostHealth* host_health) {
+    host_health_ = host_health;
+  }
+
   CString trace() const { return trace_; }
 
   std::vector<DownloadMetrics> download_metrics() const {
     return download_metrics_;
   }
 
+  bool download_digest(std::vector<uint8>* digest) const {
+    if (download_digest_.empty()) {
+      return false;
+    }
+    *digest = download_digest_;
+    return true;
+  }
+
   // Detects the available proxy configurations and returns the chain of
   // configurations to be used.
   void DetectProxyConfiguration(
       std::vector<ProxyConfig>* proxy_configurations) const;
 
  private:
+  enum AsyncOperation {
+    ASYNC_POST,
+    ASYNC_GET,
+    ASYNC_DOWNLOAD_FILE,
+  };
+
+  // The arguments of the asynchronous call in progress. The buffers are owned
+  // by the caller.
+  struct AsyncRequest {
+    AsyncRequest()
+        : operation(ASYNC_GET),
+          buffer(NULL),
+          length(0),
+          response(NULL),
+          completion(NULL) {}
+
+    AsyncOperation operation;
+    CString url;
+    const void* buffer;
+    size_t length;
+    std::vector<uint8>* response;
+    CString filename;
+    NetworkRequestCompletion* completion;
+
+    // The impersonation token of the caller, if any. The call runs as the
+    // caller on the thread of the dispatcher.
+    scoped_handle impersonation_token;
+  };
+
+  // Starts |async_request| on the NetworkRequestDispatcher.
+  HRESULT SendAsync(std::unique_ptr<AsyncRequest> async_request);
+
   // Resets the state of the output data members.
   void Reset();
 
@@ -124,20 +204,20 @@ class NetworkRequestImpl {
   // Sends a single request and receives the response.
   HRESULT DoSend(int* http_status_code,
                  CString* response_headers,
-                 std::vector<uint8>* response);
+                 ResponseBuffer* response);
 
   // Sends the request using the current configuration. The request is tried for
   // each HttpRequestInterface in the fallback chain until one of them succeeds
   // or the end of the chain is reached.
   HRESULT DoSendWithConfig(int* http_status_code,
                            CString* response_headers,
-                           std::vector<uint8>* response);
+                           ResponseBuffer* response);
 
   // Sends an http request using the current HttpRequest interface over the
   // current network configuration.
   HRESULT DoSendHttpRequest(int* http_status_code,
                             CString* response_headers,
-                            std::vector<uint8>* response);
+                            ResponseBuffer* response);
 
   // Returns true if we should continue to retry a network request, false if
   // we should bail out early.
@@ -147,6 +227,9 @@ class NetworkRequestImpl {
   // beginning and end of the wait.
   HRESULT DoWaitBetweenRetries();
 
+  // Reports the result of the last attempt to the host health tracker.
+  void EndHostRequest(HRESULT hr, int http_status_code);
+
   // Adjusts the delay until the next retry, given the current retry status
   // and the result of the previous network attempt.
   void ComputeNextRetryDelay(HttpClient::StatusCodeClass previous_result);
@@ -177,11 +260,13 @@ class NetworkRequestImpl {
   bool     low_priority_;
   int      initial_retry_delay_ms_;
   int      retry_delay_jitter_ms_;
+  HostHealth* host_health_;        // Not owned. Can be NULL.
 
   // Output data members.
   int      http_status_code_;
   CString  response_headers_;      // Each header is separated by \r\n.
   std::vector<uint8>* response_;   // Contains the response for Post and Get.
+  ResponseBuffer* response_buffer_;  // Or this one, which is not copied.
 
   const NetworkConfig::Session  network_session_;
   NetworkRequestCallback*       callback_;
@@ -208,12 +293,22 @@ class NetworkRequestImpl {
   int cur_retry_count_;
   int cur_retry_delay_ms_;
 
+  // The host of the url, as tracked by |host_health_|.
+  CString host_;
+
   // Count of DoSendHttpRequest() calls.
   int http_attempts_;
 
   volatile LONG is_canceled_;
   scoped_event event_cancel_;
 
+  // The state of the asynchronous call. |event_async_complete_| is signaled
+  // when no call is in progress.
+  std::unique_ptr<AsyncRequest> async_request_;
+  volatile LONG is_async_pending_;
+  HRESULT async_result_;
+  scoped_event event_async_complete_;
+
   LLock lock_;
 
   // Contains the trace of the request as handled by the fallback chain.
@@ -221,11 +316,15 @@ class NetworkRequestImpl {
 
   std::vector<DownloadMetrics> download_metrics_;
 
+  // SHA-256 of the downloaded file, when the http request that downloaded it
+  // computed one.
+  std::vector<uint8> download_digest_;
+
   static const int kDefaultTimeBetweenRetriesMs      = 5000;    // 5 seconds.
   static const int kServerErrMinTimeBetweenRetriesMs = 20000;   // 20 seconds.
   static const int kMaxTimeBetweenRetriesMs          = 100000;  // 100 seconds.
   static const int kTimeBetweenRetriesMultiplier     = 2;
-  static const int kDefaultRetryTimeJitterMs         = 3000;    // +- 3 seconds.
+  static const int kDefaultRetryTimeJitterMs         = 3000;    // Enabled.
 
   DISALLOW_COPY_AND_ASSIGN(NetworkRequestImpl);
 };
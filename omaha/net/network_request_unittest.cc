@@ -15,6 +15,7 @@
 
 #include <windows.h>
 #include <winhttp.h>
+#include <limits.h>
 #include <memory>
 #include <vector>
 
@@ -30,14 +31,63 @@
 #include "omaha/base/vista_utils.h"
 #include "omaha/net/bits_request.h"
 #include "omaha/net/cup_ecdsa_request.h"
+#include "omaha/net/host_health.h"
 #include "omaha/net/network_config.h"
 #include "omaha/net/network_request.h"
+#include "omaha/net/network_request_dispatcher.h"
+#include "omaha/net/network_request_impl.h"
 #include "omaha/net/simple_request.h"
 #include "omaha/testing/unit_test.h"
 #include "omaha/third_party/smartany/scoped_any.h"
 
 namespace omaha {
 
+namespace {
+
+// Records the completion of an asynchronous request.
+class RequestCompletion : public NetworkRequestCompletion {
+ public:
+  RequestCompletion() : num_calls_(0), hr_(E_FAIL) {}
+
+  void OnRequestComplete(HRESULT hr) override {
+    ++num_calls_;
+    hr_ = hr;
+  }
+
+  int num_calls() const { return num_calls_; }
+  HRESULT hr() const { return hr_; }
+
+ private:
+  int num_calls_;
+  HRESULT hr_;
+
+  DISALLOW_COPY_AND_ASSIGN(RequestCompletion);
+};
+
+// Deletes the request it owns when the request completes.
+class DeletingCompletion : public NetworkRequestCompletion {
+ public:
+  explicit DeletingCompletion(NetworkRequest* request)
+      : request_(request),
+        event_deleted_(::CreateEvent(NULL, true, false, NULL)) {}
+
+  void OnRequestComplete(HRESULT hr) override {
+    UNREFERENCED_PARAMETER(hr);
+    request_.reset();
+    VERIFY1(::SetEvent(get(event_deleted_)));
+  }
+
+  HANDLE event_deleted() const { return get(event_deleted_); }
+
+ private:
+  std::unique_ptr<NetworkRequest> request_;
+  scoped_event event_deleted_;
+
+  DISALLOW_COPY_AND_ASSIGN(DeletingCompletion);
+};
+
+}  // namespace
+
 class NetworkRequestTest
     : public testing::Test,
       public NetworkRequestCallback {
@@ -84,10 +134,10 @@ class NetworkRequestTest
 
   virtual void TearDown() {}
 
-  virtual void OnProgress(int bytes, int bytes_total, int, const TCHAR*) {
+  virtual void OnProgress(uint64 bytes, uint64 bytes_total, int, const TCHAR*) {
     UNREFERENCED_PARAMETER(bytes);
     UNREFERENCED_PARAMETER(bytes_total);
-    NET_LOG(L3, (_T("[downloading %d of %d]"), bytes, bytes_total));
+    NET_LOG(L3, (_T("[downloading %I64u of %I64u]"), bytes, bytes_total));
   }
 
   virtual void OnRequestBegin() {
@@ -381,4 +431,189 @@ TEST_F(NetworkRequestTest, CancelTest_Get) {
   CancelTest_GetHelper();
 }
 
+// The highest draws of the jittered retry delay are capped at 100 seconds, the
+// longest delay between retries, so they never end the retries early.
+TEST(NetworkRequestImplTest, GetJitteredRetryDelayMs) {
+  const int kMaxTimeBetweenRetriesMs = 100000;
+
+  // The draw is between the base delay and three times the current delay, so
+  // the largest random value that matters is the width of that range.
+  EXPECT_EQ(kMaxTimeBetweenRetriesMs,
+            internal::NetworkRequestImpl::GetJitteredRetryDelayMs(
+                20000, 40000, 3 * 40000 - 20000));
+  EXPECT_EQ(kMaxTimeBetweenRetriesMs,
+            internal::NetworkRequestImpl::GetJitteredRetryDelayMs(
+                20000, kMaxTimeBetweenRetriesMs,
+                3 * kMaxTimeBetweenRetriesMs - 20000));
+  EXPECT_EQ(kMaxTimeBetweenRetriesMs,
+            internal::NetworkRequestImpl::GetJitteredRetryDelayMs(
+                5000, INT_MAX, INT_MAX - 5000));
+
+  for (int cur_delay_ms = 5000; cur_delay_ms <= kMaxTimeBetweenRetriesMs;
+       cur_delay_ms *= 2) {
+    EXPECT_GE(kMaxTimeBetweenRetriesMs,
+              internal::NetworkRequestImpl::GetJitteredRetryDelayMs(
+                  5000, cur_delay_ms, UINT_MAX));
+  }
+
+  // The lowest draw is the base delay.
+  EXPECT_EQ(20000,
+            internal::NetworkRequestImpl::GetJitteredRetryDelayMs(
+                20000, 40000, 0));
+}
+
+// The request fails without being sent while the host is unavailable.
+TEST_F(NetworkRequestTest, HostHealth_RetryAfter) {
+  HostHealth host_health(NULL);
+  host_health.SetRetryAfter(_T("www.google.com"), 60);
+
+  network_request_->AddHttpRequest(new SimpleRequest);
+  network_request_->set_host_health(&host_health);
+  std::vector<uint8> response;
+  EXPECT_EQ(OMAHA_NET_E_HOST_UNAVAILABLE,
+            network_request_->Get(_T("https://www.google.com/robots.txt"),
+                                  &response));
+  EXPECT_EQ(0, network_request_->http_status_code());
+}
+
+// The failures to reach a host open its circuit for the later requests.
+TEST_F(NetworkRequestTest, HostHealth_OpensOnFailures) {
+  HostHealth host_health(NULL);
+
+  ProxyConfig config;
+  network_request_->set_proxy_configuration(&config);
+  network_request_->AddHttpRequest(new SimpleRequest);
+  network_request_->set_host_health(&host_health);
+  network_request_->set_num_retries(HostHealth::kFailureThreshold - 1);
+  network_request_->set_time_between_retries(10);  // 10 miliseconds.
+  std::vector<uint8> response;
+
+  CString url = _T("http://nohost/nofile");
+  EXPECT_HRESULT_FAILED(network_request_->Get(url, &response));
+  EXPECT_EQ(HostHealth::STATE_OPEN, host_health.GetState(_T("nohost")));
+
+  EXPECT_EQ(OMAHA_NET_E_HOST_UNAVAILABLE,
+            network_request_->Get(url, &response));
+}
+
+TEST_F(NetworkRequestTest, Async_NoCall) {
+  EXPECT_FALSE(network_request_->is_pending());
+  EXPECT_EQ(E_UNEXPECTED, network_request_->Wait(0));
+}
+
+// The update check and the ping are in flight at the same time.
+TEST_F(NetworkRequestTest, Async_Concurrent) {
+  NetworkConfig* network_config = NULL;
+  EXPECT_HRESULT_SUCCEEDED(
+      NetworkConfigManager::Instance().GetUserNetworkConfig(&network_config));
+  NetworkRequest other_request(network_config->session());
+
+  network_request_->AddHttpRequest(new SimpleRequest);
+  other_request.AddHttpRequest(new SimpleRequest);
+
+  RequestCompletion completion;
+  RequestCompletion other_completion;
+  std::vector<uint8> response;
+  std::vector<uint8> other_response;
+  const char kRequest[] = "<o:gupdate xmlns:o=\"http://www.google.com/update2/request\" testsource=\"dev\"/>";  // NOLINT
+  EXPECT_HRESULT_SUCCEEDED(network_request_->PostAsync(
+      _T("https://tools.google.com/service/update2"),
+      kRequest,
+      strlen(kRequest),
+      &response,
+      &completion));
+  EXPECT_HRESULT_SUCCEEDED(other_request.GetAsync(
+      _T("https://www.google.com/robots.txt"),
+      &other_response,
+      &other_completion));
+
+  const HANDLE events[] = {network_request_->completion_event(),
+                           other_request.completion_event()};
+  EXPECT_EQ(WAIT_OBJECT_0, ::WaitForMultipleObjects(arraysize(events),
+                                                     events,
+                                                     true,
+                                                     INFINITE));
+  EXPECT_FALSE(network_request_->is_pending());
+  EXPECT_FALSE(other_request.is_pending());
+
+  EXPECT_HRESULT_SUCCEEDED(network_request_->Wait(0));
+  EXPECT_EQ(1, completion.num_calls());
+  EXPECT_HRESULT_SUCCEEDED(completion.hr());
+  EXPECT_FALSE(response.empty());
+
+  EXPECT_HRESULT_SUCCEEDED(other_request.Wait(0));
+  EXPECT_EQ(1, other_completion.num_calls());
+  EXPECT_EQ(HTTP_STATUS_OK, other_request.http_status_code());
+  EXPECT_FALSE(other_response.empty());
+}
+
+// The result of an asynchronous call is the result of the blocking call.
+TEST_F(NetworkRequestTest, Async_HostUnavailable) {
+  HostHealth host_health(NULL);
+  host_health.SetRetryAfter(_T("www.google.com"), 60);
+
+  network_request_->AddHttpRequest(new SimpleRequest);
+  network_request_->set_host_health(&host_health);
+  RequestCompletion completion;
+  std::vector<uint8> response;
+  EXPECT_HRESULT_SUCCEEDED(network_request_->GetAsync(
+      _T("https://www.google.com/robots.txt"), &response, &completion));
+  EXPECT_EQ(OMAHA_NET_E_HOST_UNAVAILABLE, network_request_->Wait(INFINITE));
+  EXPECT_EQ(OMAHA_NET_E_HOST_UNAVAILABLE, completion.hr());
+}
+
+// The completion can delete the request.
+TEST_F(NetworkRequestTest, Async_DeleteOnComplete) {
+  NetworkConfig* network_config = NULL;
+  EXPECT_HRESULT_SUCCEEDED(
+      NetworkConfigManager::Instance().GetUserNetworkConfig(&network_config));
+  NetworkRequest* request = new NetworkRequest(network_config->session());
+  DeletingCompletion completion(request);
+
+  HostHealth host_health(NULL);
+  host_health.SetRetryAfter(_T("www.google.com"), 60);
+  request->AddHttpRequest(new SimpleRequest);
+  request->set_host_health(&host_health);
+
+  std::vector<uint8> response;
+  EXPECT_HRESULT_SUCCEEDED(request->GetAsync(
+      _T("https://www.google.com/robots.txt"), &response, &completion));
+  EXPECT_EQ(WAIT_OBJECT_0,
+            ::WaitForSingleObject(completion.event_deleted(), INFINITE));
+}
+
+TEST_F(NetworkRequestTest, Async_Cancel) {
+  ProxyConfig config;
+  network_request_->set_proxy_configuration(&config);
+  network_request_->AddHttpRequest(new SimpleRequest);
+  network_request_->set_num_retries(10);
+  network_request_->set_time_between_retries(10000);  // 10 seconds.
+
+  EXPECT_HRESULT_SUCCEEDED(network_request_->DownloadFileAsync(
+      _T("http://nohost/nofile"), _T("c:\\foo"), NULL));
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_TIMEOUT), network_request_->Wait(100));
+  EXPECT_TRUE(network_request_->is_pending());
+
+  EXPECT_HRESULT_SUCCEEDED(network_request_->Cancel());
+  EXPECT_EQ(GOOPDATE_E_CANCELLED, network_request_->Wait(INFINITE));
+  EXPECT_FALSE(network_request_->is_pending());
+}
+
+// Deleting the dispatcher cancels the requests in flight.
+TEST_F(NetworkRequestTest, Async_DispatcherShutdown) {
+  ProxyConfig config;
+  network_request_->set_proxy_configuration(&config);
+  network_request_->AddHttpRequest(new SimpleRequest);
+  network_request_->set_num_retries(10);
+  network_request_->set_time_between_retries(10000);  // 10 seconds.
+
+  std::vector<uint8> response;
+  EXPECT_HRESULT_SUCCEEDED(network_request_->GetAsync(
+      _T("http://nohost/nofile"), &response, NULL));
+  EXPECT_EQ(1, NetworkRequestDispatcher::Instance().num_pending_requests());
+
+  NetworkRequestDispatcher::DeleteInstance();
+  EXPECT_EQ(GOOPDATE_E_CANCELLED, network_request_->Wait(0));
+}
+
 }  // namespace omaha
@@ -0,0 +1,320 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/net/response_buffer.h"
+
+#include <string.h>
+#include <atlbase.h>
+#include <atlcom.h>
+#include <algorithm>
+
+#include "omaha/base/debug.h"
+#include "omaha/base/security/sha256.h"
+#include "omaha/base/utils.h"
+
+namespace omaha {
+
+namespace {
+
+// Reads the bytes of a response buffer. The stream holds a copy of the
+// buffer, which shares the slabs of the buffer it was created from.
+class ATL_NO_VTABLE ResponseBufferStream
+    : public CComObjectRootEx<CComObjectThreadModel>,
+      public ISequentialStream {
+ public:
+  ResponseBufferStream() : position_(0) {}
+  virtual ~ResponseBufferStream() {}
+
+  static HRESULT Create(const ResponseBuffer& response,
+                        ISequentialStream** stream);
+
+  BEGIN_COM_MAP(ResponseBufferStream)
+    COM_INTERFACE_ENTRY(ISequentialStream)
+  END_COM_MAP()
+
+  // ISequentialStream methods.
+  STDMETHODIMP Read(void* data, ULONG length, ULONG* num_bytes_read);
+  STDMETHODIMP Write(const void* data, ULONG length, ULONG* num_bytes_written);
+
+ private:
+  ResponseBuffer response_;
+  size_t position_;
+
+  DISALLOW_COPY_AND_ASSIGN(ResponseBufferStream);
+};
+
+HRESULT ResponseBufferStream::Create(const ResponseBuffer& response,
+                                     ISequentialStream** stream) {
+  ASSERT1(stream);
+
+  *stream = NULL;
+  std::unique_ptr<CComObjectNoLock<ResponseBufferStream>> stream_obj(
+      new CComObjectNoLock<ResponseBufferStream>);
+  if (stream_obj == NULL) {
+    return E_OUTOFMEMORY;
+  }
+
+  stream_obj->AddRef();
+  stream_obj->response_ = response;
+  *stream = stream_obj.release();
+
+  return S_OK;
+}
+
+STDMETHODIMP ResponseBufferStream::Read(void* data,
+                                        ULONG length,
+                                        ULONG* num_bytes_read) {
+  if (!data) {
+    return STG_E_INVALIDPOINTER;
+  }
+
+  uint8* bytes = static_cast<uint8*>(data);
+  ULONG num_bytes = 0;
+  while (num_bytes != length && position_ != response_.size()) {
+    const size_t index = position_ / ResponseBuffer::kSlabSize;
+    const size_t offset = position_ % ResponseBuffer::kSlabSize;
+    const size_t count = std::min(static_cast<size_t>(length - num_bytes),
+                                  response_.slab_size(index) - offset);
+    memcpy(bytes + num_bytes, response_.slab_data(index) + offset, count);
+    num_bytes += static_cast<ULONG>(count);
+    position_ += count;
+  }
+
+  if (num_bytes_read) {
+    *num_bytes_read = num_bytes;
+  }
+  return num_bytes == length ? S_OK : S_FALSE;
+}
+
+STDMETHODIMP ResponseBufferStream::Write(const void* data,
+                                         ULONG length,
+                                         ULONG* num_bytes_written) {
+  UNREFERENCED_PARAMETER(data);
+  UNREFERENCED_PARAMETER(length);
+  if (num_bytes_written) {
+    *num_bytes_written = 0;
+  }
+  return STG_E_ACCESSDENIED;
+}
+
+}  // namespace
+
+// The slabs of a buffer, which go back to the pool when the last buffer that
+// refers to them is gone.
+struct ResponseBuffer::Rope {
+  Rope() : size(0) {
+    SHA256_init(&digest_ctx);
+  }
+
+  ~Rope() {
+    for (size_t i = 0; i != slabs.size(); ++i) {
+      SlabPool::Instance().Free(slabs[i]);
+    }
+  }
+
+  std::vector<uint8*> slabs;
+  size_t size;
+
+  // The digest of the bytes committed so far.
+  LITE_SHA256_CTX digest_ctx;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Rope);
+};
+
+ResponseBuffer::ResponseBuffer() {
+}
+
+ResponseBuffer::ResponseBuffer(const std::vector<uint8>& bytes) {
+  if (!bytes.empty()) {
+    Append(&bytes.front(), bytes.size());
+  }
+}
+
+uint8* ResponseBuffer::PrepareAppend(size_t* length) {
+  ASSERT1(length);
+
+  MakeUnique();
+  const size_t offset = rope_->size % kSlabSize;
+  if (rope_->slabs.size() * kSlabSize == rope_->size) {
+    rope_->slabs.push_back(SlabPool::Instance().Allocate());
+  }
+  *length = kSlabSize - offset;
+  return rope_->slabs.back() + offset;
+}
+
+void ResponseBuffer::CommitAppend(size_t length) {
+  ASSERT1(rope_.get() && rope_.unique());
+  ASSERT1(length <= rope_->slabs.size() * kSlabSize - rope_->size);
+  if (length) {
+    const uint8* slab = rope_->slabs[rope_->size / kSlabSize];
+    SHA256_update(&rope_->digest_ctx, slab + rope_->size % kSlabSize, length);
+  }
+  rope_->size += length;
+}
+
+void ResponseBuffer::Append(const void* data, size_t length) {
+  ASSERT1(data || !length);
+
+  const uint8* bytes = static_cast<const uint8*>(data);
+  while (length) {
+    size_t available = 0;
+    uint8* space = PrepareAppend(&available);
+    const size_t num_bytes = std::min(length, available);
+    memcpy(space, bytes, num_bytes);
+    CommitAppend(num_bytes);
+    bytes += num_bytes;
+    length -= num_bytes;
+  }
+}
+
+void ResponseBuffer::Clear() {
+  rope_.reset();
+}
+
+size_t ResponseBuffer::size() const {
+  return rope_.get() ? rope_->size : 0;
+}
+
+size_t ResponseBuffer::num_slabs() const {
+  // The space prepared and not committed is not part of the buffer.
+  return (size() + kSlabSize - 1) / kSlabSize;
+}
+
+const uint8* ResponseBuffer::slab_data(size_t index) const {
+  ASSERT1(index < num_slabs());
+  return rope_->slabs[index];
+}
+
+size_t ResponseBuffer::slab_size(size_t index) const {
+  ASSERT1(index < num_slabs());
+  return std::min(kSlabSize, rope_->size - index * kSlabSize);
+}
+
+void ResponseBuffer::CopyTo(std::vector<uint8>* bytes) const {
+  ASSERT1(bytes);
+
+  bytes->resize(size());
+  for (size_t i = 0; i != num_slabs(); ++i) {
+    memcpy(&(*bytes)[i * kSlabSize], slab_data(i), slab_size(i));
+  }
+}
+
+std::vector<uint8> ResponseBuffer::ToVector() const {
+  std::vector<uint8> bytes;
+  CopyTo(&bytes);
+  return bytes;
+}
+
+void ResponseBuffer::GetDigest(std::vector<uint8>* digest) const {
+  ASSERT1(digest);
+
+  // Finishes a copy of the digest, so that the buffer keeps hashing the bytes
+  // appended afterwards.
+  LITE_SHA256_CTX digest_ctx;
+  if (rope_.get()) {
+    digest_ctx = rope_->digest_ctx;
+  } else {
+    SHA256_init(&digest_ctx);
+  }
+  const uint8_t* hash = SHA256_final(&digest_ctx);
+  digest->assign(hash, hash + SHA256_DIGEST_SIZE);
+}
+
+HRESULT ResponseBuffer::CreateStream(ISequentialStream** stream) const {
+  return ResponseBufferStream::Create(*this, stream);
+}
+
+void ResponseBuffer::MakeUnique() {
+  if (!rope_.get()) {
+    rope_.reset(new Rope);
+    return;
+  }
+  if (rope_.unique()) {
+    return;
+  }
+
+  std::shared_ptr<Rope> rope(new Rope);
+  for (size_t i = 0; i != num_slabs(); ++i) {
+    rope->slabs.push_back(SlabPool::Instance().Allocate());
+    memcpy(rope->slabs.back(), slab_data(i), slab_size(i));
+  }
+  rope->size = rope_->size;
+  rope->digest_ctx = rope_->digest_ctx;
+  rope_.swap(rope);
+}
+
+SlabPool* SlabPool::instance_ = NULL;
+LLock SlabPool::instance_lock_;
+
+SlabPool::SlabPool() : num_allocations_(0) {
+}
+
+SlabPool::~SlabPool() {
+  for (size_t i = 0; i != free_slabs_.size(); ++i) {
+    delete[] free_slabs_[i];
+  }
+}
+
+SlabPool& SlabPool::Instance() {
+  __mutexScope(instance_lock_);
+  if (!instance_) {
+    instance_ = new SlabPool;
+  }
+  return *instance_;
+}
+
+void SlabPool::DeleteInstance() {
+  SlabPool* instance = omaha::interlocked_exchange_pointer(
+      &instance_, static_cast<SlabPool*>(NULL));
+  delete instance;
+}
+
+uint8* SlabPool::Allocate() {
+  uint8* slab = NULL;
+  __mutexBlock(lock_) {
+    if (free_slabs_.empty()) {
+      ++num_allocations_;
+    } else {
+      slab = free_slabs_.back();
+      free_slabs_.pop_back();
+    }
+  }
+  return slab ? slab : new uint8[ResponseBuffer::kSlabSize];
+}
+
+void SlabPool::Free(uint8* slab) {
+  ASSERT1(slab);
+
+  __mutexBlock(lock_) {
+    if (free_slabs_.size() < static_cast<size_t>(kMaxFreeSlabs)) {
+      free_slabs_.push_back(slab);
+      slab = NULL;
+    }
+  }
+  delete[] slab;
+}
+
+int SlabPool::num_allocations() const {
+  __mutexScope(lock_);
+  return num_allocations_;
+}
+
+int SlabPool::num_free_slabs() const {
+  __mutexScope(lock_);
+  return static_cast<int>(free_slabs_.size());
+}
+
+}  // namespace omaha
@@ -0,0 +1,139 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// ResponseBuffer holds the body of an http response as a rope of fixed-size
+// slabs. The http requests receive the body straight into the slabs, so the
+// bytes received so far are never reallocated or moved as the response grows.
+// The slabs come from SlabPool, which keeps the slabs of the responses that
+// are gone for the next ones.
+//
+// Copying a ResponseBuffer shares the slabs instead of copying the bytes, so
+// the layers of the request chain pass the response up as a view of the same
+// bytes. A buffer is copied on write: appending to a buffer whose slabs are
+// shared copies them first, so a view never changes once it is handed out.
+// The slabs are only made contiguous when a consumer asks for a vector.
+//
+// The buffer hashes the bytes as they are committed, so the SHA-256 digest of
+// a response is known as soon as the response is received, and consumers such
+// as CUP do not read the body again to verify it. Consumers that parse the
+// body read it as a stream over the slabs instead of a contiguous copy.
+
+#ifndef OMAHA_NET_RESPONSE_BUFFER_H_
+#define OMAHA_NET_RESPONSE_BUFFER_H_
+
+#include <windows.h>
+#include <objidl.h>
+#include <memory>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "omaha/base/synchronized.h"
+
+namespace omaha {
+
+class ResponseBuffer {
+ public:
+  // The size of a slab. Most update responses fit in a few slabs.
+  static const size_t kSlabSize = 16 * 1024;
+
+  ResponseBuffer();
+
+  // Copies |bytes|. This lets the http requests that produce a vector, such as
+  // the fakes of the unit tests, return it as a ResponseBuffer.
+  ResponseBuffer(const std::vector<uint8>& bytes);  // NOLINT
+
+  // Returns the space at the end of the buffer to receive bytes into, and its
+  // length in |length|, which is at least one byte. The bytes received are
+  // added to the buffer by CommitAppend.
+  uint8* PrepareAppend(size_t* length);
+  void CommitAppend(size_t length);
+
+  // Copies |length| bytes to the end of the buffer.
+  void Append(const void* data, size_t length);
+
+  void Clear();
+
+  void swap(ResponseBuffer& other) {  // NOLINT
+    rope_.swap(other.rope_);
+  }
+
+  size_t size() const;
+  bool empty() const { return !size(); }
+
+  // Returns the slabs of the buffer, in order. All the slabs but the last one
+  // are full.
+  size_t num_slabs() const;
+  const uint8* slab_data(size_t index) const;
+  size_t slab_size(size_t index) const;
+
+  // Copies the bytes to |bytes|, which makes them contiguous. This is the
+  // only copy of the response the request chain makes.
+  void CopyTo(std::vector<uint8>* bytes) const;
+  std::vector<uint8> ToVector() const;
+
+  // Returns the SHA-256 digest of the bytes committed so far. The buffer can
+  // still be appended to afterwards.
+  void GetDigest(std::vector<uint8>* digest) const;
+
+  // Creates a stream that reads the bytes of the buffer from the start. The
+  // stream shares the slabs, so appending to the buffer afterwards does not
+  // change what the stream reads.
+  HRESULT CreateStream(ISequentialStream** stream) const;
+
+ private:
+  struct Rope;
+
+  // Makes |rope_| refer to slabs no other buffer refers to.
+  void MakeUnique();
+
+  std::shared_ptr<Rope> rope_;
+};
+
+// Keeps the slabs of the response buffers that are gone, up to
+// kMaxFreeSlabs, so that the next responses do not allocate them again.
+class SlabPool {
+ public:
+  // The most free slabs kept, which is 1 MB of slabs.
+  static const int kMaxFreeSlabs = 64;
+
+  SlabPool();
+  ~SlabPool();
+
+  static SlabPool& Instance();
+  static void DeleteInstance();
+
+  // Returns a slab of ResponseBuffer::kSlabSize bytes.
+  uint8* Allocate();
+  void Free(uint8* slab);
+
+  // Returns the number of slabs allocated from the heap, for testing.
+  int num_allocations() const;
+
+  int num_free_slabs() const;
+
+ private:
+  LLock lock_;
+  std::vector<uint8*> free_slabs_;
+  int num_allocations_;
+
+  static SlabPool* instance_;
+  static LLock instance_lock_;
+
+  DISALLOW_COPY_AND_ASSIGN(SlabPool);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_NET_RESPONSE_BUFFER_H_
@@ -0,0 +1,396 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <string.h>
+#include <atlbase.h>
+#include <msxml.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "omaha/base/security/sha256.h"
+#include "omaha/base/xml_utils.h"
+#include "omaha/net/response_buffer.h"
+#include "omaha/testing/unit_test.h"
+#include "omaha/third_party/smartany/scoped_any.h"
+
+namespace omaha {
+
+namespace {
+
+// The size of the reads of the http requests.
+const size_t kReadSize = 8 * 1024;
+
+const size_t kOneMegabyte = 1024 * 1024;
+
+std::vector<uint8> MakeBytes(size_t size) {
+  std::vector<uint8> bytes(size);
+  for (size_t i = 0; i != bytes.size(); ++i) {
+    bytes[i] = static_cast<uint8>(i * 7 + i / 256);
+  }
+  return bytes;
+}
+
+std::vector<uint8> Sha256(const std::vector<uint8>& bytes) {
+  std::vector<uint8> digest(SHA256_DIGEST_SIZE);
+  SHA256_hash(bytes.empty() ? NULL : &bytes.front(),
+              bytes.size(),
+              &digest.front());
+  return digest;
+}
+
+// Receives |bytes| into |response| the way the http requests do, by reading
+// at most kReadSize bytes at a time straight into the buffer.
+void Receive(const std::vector<uint8>& bytes, ResponseBuffer* response) {
+  size_t offset = 0;
+  while (offset != bytes.size()) {
+    size_t length = 0;
+    uint8* space = response->PrepareAppend(&length);
+    length = std::min(std::min(length, kReadSize), bytes.size() - offset);
+    memcpy(space, &bytes[offset], length);
+    response->CommitAppend(length);
+    offset += length;
+  }
+}
+
+}  // namespace
+
+class ResponseBufferTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    // Starts each test with an empty pool.
+    SlabPool::DeleteInstance();
+  }
+
+  virtual void TearDown() {
+    SlabPool::DeleteInstance();
+  }
+};
+
+TEST_F(ResponseBufferTest, Empty) {
+  ResponseBuffer response;
+  EXPECT_TRUE(response.empty());
+  EXPECT_EQ(0u, response.size());
+  EXPECT_EQ(0u, response.num_slabs());
+  EXPECT_TRUE(response.ToVector().empty());
+
+  response.Append(NULL, 0);
+  EXPECT_TRUE(response.empty());
+
+  EXPECT_TRUE(ResponseBuffer(std::vector<uint8>()).empty());
+  EXPECT_EQ(0, SlabPool::Instance().num_allocations());
+}
+
+TEST_F(ResponseBufferTest, Append) {
+  const size_t slab_size = ResponseBuffer::kSlabSize;
+  const std::vector<uint8> bytes(MakeBytes(2 * slab_size + 10));
+
+  ResponseBuffer response;
+  response.Append(&bytes[0], 10);
+  response.Append(&bytes[10], slab_size);
+  response.Append(&bytes[10 + slab_size], bytes.size() - 10 - slab_size);
+
+  EXPECT_EQ(bytes.size(), response.size());
+  ASSERT_EQ(3u, response.num_slabs());
+  EXPECT_EQ(slab_size, response.slab_size(0));
+  EXPECT_EQ(slab_size, response.slab_size(1));
+  EXPECT_EQ(10u, response.slab_size(2));
+  EXPECT_EQ(0, memcmp(&bytes[slab_size], response.slab_data(1), slab_size));
+  EXPECT_TRUE(bytes == response.ToVector());
+}
+
+TEST_F(ResponseBufferTest, PrepareAppend) {
+  const size_t slab_size = ResponseBuffer::kSlabSize;
+  const std::vector<uint8> bytes(MakeBytes(3 * slab_size / 2));
+
+  ResponseBuffer response;
+  Receive(bytes, &response);
+  EXPECT_EQ(2u, response.num_slabs());
+  EXPECT_TRUE(bytes == response.ToVector());
+
+  // The space prepared and not committed is not part of the buffer.
+  size_t length = 0;
+  EXPECT_TRUE(response.PrepareAppend(&length));
+  EXPECT_EQ(slab_size / 2, length);
+  EXPECT_EQ(bytes.size(), response.size());
+
+  response.CommitAppend(0);
+  EXPECT_EQ(bytes.size(), response.size());
+}
+
+TEST_F(ResponseBufferTest, PrepareAppend_FullSlab) {
+  const size_t slab_size = ResponseBuffer::kSlabSize;
+  const std::vector<uint8> bytes(MakeBytes(slab_size));
+
+  ResponseBuffer response;
+  response.Append(&bytes[0], bytes.size());
+  EXPECT_EQ(1u, response.num_slabs());
+
+  size_t length = 0;
+  EXPECT_TRUE(response.PrepareAppend(&length));
+  EXPECT_EQ(slab_size, length);
+  response.CommitAppend(0);
+  EXPECT_EQ(1u, response.num_slabs());
+  EXPECT_TRUE(bytes == response.ToVector());
+}
+
+TEST_F(ResponseBufferTest, CopySharesSlabs) {
+  const std::vector<uint8> bytes(MakeBytes(100 * 1024));
+
+  ResponseBuffer response;
+  Receive(bytes, &response);
+  const int num_allocations = SlabPool::Instance().num_allocations();
+
+  ResponseBuffer view(response);
+  EXPECT_EQ(response.size(), view.size());
+  EXPECT_EQ(response.slab_data(0), view.slab_data(0));
+  EXPECT_EQ(num_allocations, SlabPool::Instance().num_allocations());
+
+  ResponseBuffer other;
+  other = view;
+  EXPECT_EQ(response.slab_data(0), other.slab_data(0));
+  EXPECT_EQ(num_allocations, SlabPool::Instance().num_allocations());
+}
+
+TEST_F(ResponseBufferTest, CopyOnWrite) {
+  const std::vector<uint8> bytes(MakeBytes(20 * 1024));
+
+  ResponseBuffer response;
+  response.Append(&bytes[0], bytes.size());
+  ResponseBuffer view(response);
+
+  const uint8 more[] = {1, 2, 3};
+  response.Append(more, arraysize(more));
+
+  EXPECT_NE(response.slab_data(0), view.slab_data(0));
+  EXPECT_EQ(bytes.size() + arraysize(more), response.size());
+  EXPECT_TRUE(bytes == view.ToVector());
+
+  std::vector<uint8> expected(bytes);
+  expected.insert(expected.end(), more, more + arraysize(more));
+  EXPECT_TRUE(expected == response.ToVector());
+}
+
+TEST_F(ResponseBufferTest, Clear) {
+  const std::vector<uint8> bytes(MakeBytes(1000));
+
+  ResponseBuffer response;
+  response.Append(&bytes[0], bytes.size());
+  ResponseBuffer view(response);
+
+  response.Clear();
+  EXPECT_TRUE(response.empty());
+  EXPECT_TRUE(bytes == view.ToVector());
+  EXPECT_EQ(0, SlabPool::Instance().num_free_slabs());
+
+  view.Clear();
+  EXPECT_EQ(1, SlabPool::Instance().num_free_slabs());
+}
+
+TEST_F(ResponseBufferTest, Swap) {
+  const std::vector<uint8> bytes(MakeBytes(1000));
+
+  ResponseBuffer response(bytes);
+  ResponseBuffer other;
+  response.swap(other);
+  EXPECT_TRUE(response.empty());
+  EXPECT_TRUE(bytes == other.ToVector());
+}
+
+TEST_F(ResponseBufferTest, CopyTo) {
+  const std::vector<uint8> bytes(MakeBytes(50 * 1024 + 1));
+
+  ResponseBuffer response(bytes);
+  std::vector<uint8> copy(10, 0xff);
+  response.CopyTo(&copy);
+  EXPECT_TRUE(bytes == copy);
+
+  ResponseBuffer().CopyTo(&copy);
+  EXPECT_TRUE(copy.empty());
+}
+
+TEST_F(ResponseBufferTest, GetDigest) {
+  std::vector<uint8> digest;
+  ResponseBuffer().GetDigest(&digest);
+  EXPECT_TRUE(Sha256(std::vector<uint8>()) == digest);
+
+  // The bytes are hashed as they are received, across the slabs.
+  const std::vector<uint8> bytes(MakeBytes(3 * ResponseBuffer::kSlabSize + 7));
+  ResponseBuffer response;
+  Receive(bytes, &response);
+  response.GetDigest(&digest);
+  EXPECT_TRUE(Sha256(bytes) == digest);
+
+  // Getting the digest does not stop the hashing of the bytes appended next.
+  const uint8 more[] = {1, 2, 3};
+  response.Append(more, arraysize(more));
+  std::vector<uint8> expected(bytes);
+  expected.insert(expected.end(), more, more + arraysize(more));
+  response.GetDigest(&digest);
+  EXPECT_TRUE(Sha256(expected) == digest);
+}
+
+TEST_F(ResponseBufferTest, GetDigest_CopyOnWrite) {
+  const std::vector<uint8> bytes(MakeBytes(20 * 1024));
+
+  ResponseBuffer response(bytes);
+  ResponseBuffer view(response);
+
+  const uint8 more[] = {1, 2, 3};
+  response.Append(more, arraysize(more));
+
+  std::vector<uint8> digest;
+  view.GetDigest(&digest);
+  EXPECT_TRUE(Sha256(bytes) == digest);
+
+  std::vector<uint8> expected(bytes);
+  expected.insert(expected.end(), more, more + arraysize(more));
+  response.GetDigest(&digest);
+  EXPECT_TRUE(Sha256(expected) == digest);
+}
+
+TEST_F(ResponseBufferTest, CreateStream) {
+  const std::vector<uint8> bytes(MakeBytes(2 * ResponseBuffer::kSlabSize + 5));
+
+  ResponseBuffer response(bytes);
+  CComPtr<ISequentialStream> stream;
+  ASSERT_HRESULT_SUCCEEDED(response.CreateStream(&stream));
+
+  // Appending to the buffer does not change what the stream reads.
+  const uint8 more[] = {1, 2, 3};
+  response.Append(more, arraysize(more));
+
+  // Reads across the slabs in odd sizes.
+  std::vector<uint8> read(bytes.size() + 100);
+  size_t offset = 0;
+  ULONG num_bytes_read = 0;
+  HRESULT hr = S_OK;
+  do {
+    hr = stream->Read(&read[offset], 1000, &num_bytes_read);
+    offset += num_bytes_read;
+  } while (hr == S_OK);
+
+  EXPECT_EQ(S_FALSE, hr);
+  read.resize(offset);
+  EXPECT_TRUE(bytes == read);
+
+  EXPECT_EQ(S_FALSE, stream->Read(&read[0], 1, &num_bytes_read));
+  EXPECT_EQ(0u, num_bytes_read);
+
+  ULONG num_bytes_written = 1;
+  EXPECT_EQ(STG_E_ACCESSDENIED,
+            stream->Write(more, arraysize(more), &num_bytes_written));
+  EXPECT_EQ(0u, num_bytes_written);
+}
+
+TEST_F(ResponseBufferTest, CreateStream_LoadXML) {
+  scoped_co_init co_init;
+
+  // Makes a document that spans several slabs.
+  CStringA xml("<?xml version=\"1.0\" encoding=\"UTF-8\"?><response>");
+  while (static_cast<size_t>(xml.GetLength()) < 3 * ResponseBuffer::kSlabSize) {
+    xml.Append("<app appid=\"{430FD4D0-B729-4F61-AA34-91526481799D}\"/>");
+  }
+  xml.Append("</response>");
+
+  ResponseBuffer response;
+  response.Append(xml.GetString(), xml.GetLength());
+  CComPtr<ISequentialStream> stream;
+  ASSERT_HRESULT_SUCCEEDED(response.CreateStream(&stream));
+
+  CComPtr<IXMLDOMDocument> xmldoc;
+  ASSERT_HRESULT_SUCCEEDED(LoadXMLFromStream(stream, false, &xmldoc));
+  CComPtr<IXMLDOMElement> root;
+  ASSERT_HRESULT_SUCCEEDED(xmldoc->get_documentElement(&root));
+  CComBSTR root_name;
+  ASSERT_HRESULT_SUCCEEDED(root->get_nodeName(&root_name));
+  EXPECT_STREQ(_T("response"), root_name);
+
+  // A truncated document does not parse.
+  ResponseBuffer truncated;
+  truncated.Append(xml.GetString(), xml.GetLength() / 2);
+  stream.Release();
+  ASSERT_HRESULT_SUCCEEDED(truncated.CreateStream(&stream));
+  xmldoc.Release();
+  EXPECT_HRESULT_FAILED(LoadXMLFromStream(stream, false, &xmldoc));
+  EXPECT_FALSE(xmldoc);
+}
+
+TEST_F(ResponseBufferTest, SlabPool_MaxFreeSlabs) {
+  const int max_free_slabs = SlabPool::kMaxFreeSlabs;
+  const std::vector<uint8> bytes(
+      MakeBytes((max_free_slabs + 2) * ResponseBuffer::kSlabSize));
+
+  ResponseBuffer response(bytes);
+  response.Clear();
+  EXPECT_EQ(max_free_slabs, SlabPool::Instance().num_free_slabs());
+}
+
+// Counts the heap allocations made to receive a 1 MB response, compared with
+// receiving it into a vector that grows as the bytes come in.
+TEST_F(ResponseBufferTest, Benchmark_OneMegabyteResponse) {
+  const std::vector<uint8> bytes(MakeBytes(kOneMegabyte));
+  const int num_slabs = static_cast<int>(
+      kOneMegabyte / ResponseBuffer::kSlabSize);
+
+  // The first response allocates its slabs and passing it up the request
+  // chain does not allocate more.
+  {
+    ResponseBuffer response;
+    Receive(bytes, &response);
+    ResponseBuffer cup_response(response);
+    ResponseBuffer network_request_response(cup_response);
+    EXPECT_EQ(num_slabs, SlabPool::Instance().num_allocations());
+    EXPECT_EQ(kOneMegabyte, network_request_response.size());
+  }
+
+  // The next response reuses the slabs of the first one.
+  {
+    ResponseBuffer response;
+    Receive(bytes, &response);
+    EXPECT_EQ(num_slabs, SlabPool::Instance().num_allocations());
+    EXPECT_TRUE(bytes == response.ToVector());
+  }
+
+  // A vector reallocates as it grows and moves the bytes received so far
+  // each time. Copying it up the request chain allocates once per layer.
+  int num_vector_allocations = 0;
+  size_t num_bytes_moved = 0;
+  std::vector<uint8> response;
+  for (size_t offset = 0; offset != bytes.size(); offset += kReadSize) {
+    if (response.size() + kReadSize > response.capacity()) {
+      ++num_vector_allocations;
+      num_bytes_moved += response.size();
+    }
+    response.insert(response.end(),
+                    bytes.begin() + offset,
+                    bytes.begin() + offset + kReadSize);
+  }
+  std::vector<uint8> cup_response(response);
+  std::vector<uint8> network_request_response(cup_response);
+  num_vector_allocations += 2;
+  num_bytes_moved += 2 * kOneMegabyte;
+
+  std::wcout << _T("\tResponse buffer: ") << num_slabs
+             << _T(" allocations for the first response, 0 after that.")
+             << std::endl;
+  std::wcout << _T("\tVector: ") << num_vector_allocations
+             << _T(" allocations and ") << num_bytes_moved
+             << _T(" bytes copied per response.") << std::endl;
+
+  EXPECT_LT(0u, num_bytes_moved);
+}
+
+}  // namespace omaha
@@ -0,0 +1,417 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/net/segmented_download.h"
+
+#include <winhttp.h>
+#include <algorithm>
+#include <memory>
+
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/safe_format.h"
+#include "omaha/base/thread.h"
+#include "omaha/base/time.h"
+#include "omaha/net/network_request.h"
+
+namespace omaha {
+
+namespace {
+
+// How many times a range is requested before the download fails.
+const int kMaxRangeAttempts = 3;
+
+CString FormatRange(uint64 first, uint64 last) {
+  CString range;
+  SafeCStringFormat(&range, _T("bytes=%I64u-%I64u"), first, last);
+  return range;
+}
+
+// Parses a Content-Range header of the form "bytes first-last/length".
+bool ParseContentRange(const CString& content_range,
+                       uint64* first,
+                       uint64* last,
+                       uint64* length) {
+  ASSERT1(first);
+  ASSERT1(last);
+  ASSERT1(length);
+  return _stscanf_s(content_range,
+                    _T("bytes %I64u-%I64u/%I64u"),
+                    first,
+                    last,
+                    length) == 3 &&
+         *first <= *last &&
+         *last < *length;
+}
+
+}  // namespace
+
+class SegmentedDownload::Connection : public Runnable {
+ public:
+  explicit Connection(SegmentedDownload* download) : download_(download) {}
+  virtual ~Connection() {}
+
+  Thread* thread() { return &thread_; }
+
+ private:
+  virtual void Run() {
+    download_->FetchRanges();
+  }
+
+  SegmentedDownload* download_;
+  Thread thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(Connection);
+};
+
+SegmentedDownload::SegmentedDownload(RequestFactory* factory,
+                                     int num_connections)
+    : factory_(factory),
+      num_connections_(num_connections),
+      range_size_(kDefaultRangeSize),
+      callback_(NULL),
+      file_size_(0),
+      num_ranges_(0),
+      next_range_(0),
+      bytes_downloaded_(0),
+      error_hr_(S_OK),
+      is_canceled_(false),
+      is_segmented_(false) {
+  ASSERT1(factory);
+  ASSERT1(num_connections > 0);
+}
+
+SegmentedDownload::~SegmentedDownload() {
+  ASSERT1(active_requests_.empty());
+}
+
+void SegmentedDownload::set_range_size(uint32 range_size) {
+  ASSERT1(range_size);
+  range_size_ = range_size;
+}
+
+HRESULT SegmentedDownload::DownloadFile(const CString& url,
+                                        uint64 file_size,
+                                        const CString& filename) {
+  NET_LOG(L3, (_T("[SegmentedDownload::DownloadFile][%s][%I64u]"),
+               url, file_size));
+  ASSERT1(file_size);
+
+  const uint64 begin_ms = GetCurrentMsTime();
+  url_ = url;
+  file_size_ = file_size;
+  num_ranges_ = (file_size - 1) / range_size_ + 1;
+  next_range_ = 1;
+  bytes_downloaded_ = 0;
+  error_hr_ = S_OK;
+  is_segmented_ = false;
+  download_metrics_.clear();
+  download_digest_.clear();
+
+  // The first range is downloaded to the file itself, in case the server
+  // answers with the whole file.
+  std::unique_ptr<NetworkRequest> probe(factory_->CreateRequest());
+  if (!AddActiveRequest(probe.get())) {
+    return GOOPDATE_E_CANCELLED;
+  }
+
+  const uint64 probe_last = std::min<uint64>(range_size_, file_size) - 1;
+  probe->AddHeader(_T("Range"), FormatRange(0, probe_last));
+  probe->set_callback(callback_);
+  HRESULT hr = probe->DownloadFile(url, filename);
+
+  CString accept_ranges;
+  CString content_range;
+  probe->QueryHeadersString(WINHTTP_QUERY_ACCEPT_RANGES, NULL, &accept_ranges);
+  probe->QueryHeadersString(WINHTTP_QUERY_CONTENT_RANGE, NULL, &content_range);
+  const int http_status_code = probe->http_status_code();
+  download_metrics_ = probe->download_metrics();
+  RemoveActiveRequest(probe.get());
+
+  if (FAILED(hr)) {
+    NET_LOG(LE, (_T("[range probe failed][0x%08x]"), hr));
+    return hr;
+  }
+
+  if (http_status_code != HTTP_STATUS_PARTIAL_CONTENT) {
+    NET_LOG(L3, (_T("[server sent the whole file][Accept-Ranges: %s]"),
+                 accept_ranges));
+    probe->download_digest(&download_digest_);
+    return S_OK;
+  }
+
+  uint64 first = 0;
+  uint64 last = 0;
+  uint64 length = 0;
+  if (!ParseContentRange(content_range, &first, &last, &length) ||
+      first != 0 || last != probe_last || length != file_size) {
+    NET_LOG(LE, (_T("[unexpected Content-Range][%s]"), content_range));
+    return HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE);
+  }
+
+  bytes_downloaded_ = probe_last + 1;
+  if (num_ranges_ == 1) {
+    return S_OK;
+  }
+
+  // The connections write the other ranges after the first one, at their
+  // offsets in the file, which is extended to its final size first.
+  reset(file_, ::CreateFile(filename,
+                            GENERIC_WRITE,
+                            FILE_SHARE_READ,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL,
+                            NULL));
+  if (!file_) {
+    return HRESULTFromLastError();
+  }
+
+  LARGE_INTEGER end_of_file = {0};
+  end_of_file.QuadPart = static_cast<LONGLONG>(file_size);
+  if (!::SetFilePointerEx(get(file_), end_of_file, NULL, FILE_BEGIN) ||
+      !::SetEndOfFile(get(file_))) {
+    hr = HRESULTFromLastError();
+    reset(file_);
+    return hr;
+  }
+
+  is_segmented_ = true;
+  const int num_connections = static_cast<int>(
+      std::min<uint64>(num_connections_, num_ranges_ - 1));
+  std::vector<Connection*> connections;
+  for (int i = 0; i != num_connections; ++i) {
+    std::unique_ptr<Connection> connection(new Connection(this));
+    if (!connection->thread()->Start(connection.get())) {
+      Fail(HRESULTFromLastError());
+      break;
+    }
+    connections.push_back(connection.release());
+  }
+
+  for (size_t i = 0; i != connections.size(); ++i) {
+    VERIFY1(connections[i]->thread()->WaitTillExit(INFINITE));
+    delete connections[i];
+  }
+  reset(file_);
+
+  __mutexBlock(lock_) {
+    hr = is_canceled_ ? GOOPDATE_E_CANCELLED : error_hr_;
+  }
+
+  if (download_metrics_.empty()) {
+    download_metrics_.push_back(DownloadMetrics());
+    download_metrics_.back().downloader = DownloadMetrics::kWinHttp;
+  }
+  DownloadMetrics& download_metrics = download_metrics_.back();
+  download_metrics.url = url;
+  download_metrics.error = hr;
+  download_metrics.downloaded_bytes = static_cast<int64>(bytes_downloaded_);
+  download_metrics.total_bytes = static_cast<int64>(file_size);
+  download_metrics.download_time_ms =
+      static_cast<int64>(GetCurrentMsTime() - begin_ms);
+
+  NET_LOG(L3, (_T("[SegmentedDownload::DownloadFile][0x%08x]")
+               _T("[%I64u ranges][%d connections]"),
+               hr, num_ranges_, num_connections));
+  return hr;
+}
+
+void SegmentedDownload::FetchRanges() {
+  for (;;) {
+    uint64 range = 0;
+    bool is_done = false;
+    __mutexBlock(lock_) {
+      is_done = is_canceled_ || FAILED(error_hr_) || next_range_ == num_ranges_;
+      range = next_range_;
+      if (!is_done) {
+        ++next_range_;
+      }
+    }
+    if (is_done) {
+      return;
+    }
+
+    const uint64 first = range * range_size_;
+    const uint64 last = std::min(first + range_size_, file_size_) - 1;
+    std::vector<uint8> response;
+    HRESULT hr = FetchRange(first, last, &response);
+    if (SUCCEEDED(hr)) {
+      hr = WriteRange(first, response);
+    }
+    if (FAILED(hr)) {
+      Fail(hr);
+      return;
+    }
+
+    ReportProgress(response.size());
+  }
+}
+
+HRESULT SegmentedDownload::FetchRange(uint64 first,
+                                      uint64 last,
+                                      std::vector<uint8>* response) {
+  ASSERT1(response);
+
+  HRESULT hr = S_OK;
+  for (int attempt = 0; attempt != kMaxRangeAttempts; ++attempt) {
+    std::unique_ptr<NetworkRequest> request(factory_->CreateRequest());
+    if (!AddActiveRequest(request.get())) {
+      return GOOPDATE_E_CANCELLED;
+    }
+
+    request->AddHeader(_T("Range"), FormatRange(first, last));
+    hr = request->Get(url_, response);
+    if (SUCCEEDED(hr)) {
+      hr = ValidateRange(request.get(), first, last, response->size());
+    }
+    RemoveActiveRequest(request.get());
+
+    if (SUCCEEDED(hr) || hr == GOOPDATE_E_CANCELLED) {
+      return hr;
+    }
+    NET_LOG(LW, (_T("[failed to fetch range][%I64u-%I64u][0x%08x]"),
+                 first, last, hr));
+  }
+
+  return hr;
+}
+
+HRESULT SegmentedDownload::ValidateRange(NetworkRequest* request,
+                                         uint64 first,
+                                         uint64 last,
+                                         size_t response_size) const {
+  ASSERT1(request);
+
+  // A server that supported the probe may still send another range, or the
+  // whole file, for instance if the request reached another server.
+  CString content_range;
+  request->QueryHeadersString(WINHTTP_QUERY_CONTENT_RANGE, NULL,
+                              &content_range);
+  uint64 range_first = 0;
+  uint64 range_last = 0;
+  uint64 length = 0;
+  if (request->http_status_code() != HTTP_STATUS_PARTIAL_CONTENT ||
+      !ParseContentRange(content_range, &range_first, &range_last, &length) ||
+      range_first != first ||
+      range_last != last ||
+      length != file_size_ ||
+      response_size != last - first + 1) {
+    NET_LOG(LW, (_T("[unexpected range][%d][%s][%Iu bytes]"),
+                 request->http_status_code(), content_range, response_size));
+    return HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE);
+  }
+
+  return S_OK;
+}
+
+HRESULT SegmentedDownload::WriteRange(uint64 offset,
+                                      const std::vector<uint8>& response) {
+  ASSERT1(!response.empty());
+
+  // Each connection writes at its own offset, so the handle is shared
+  // without locking.
+  OVERLAPPED overlapped = {0};
+  overlapped.Offset = static_cast<DWORD>(offset);
+  overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+  DWORD bytes_written = 0;
+  if (!::WriteFile(get(file_),
+                   &response.front(),
+                   static_cast<DWORD>(response.size()),
+                   &bytes_written,
+                   &overlapped)) {
+    return HRESULTFromLastError();
+  }
+
+  return bytes_written == response.size() ?
+      S_OK : HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+}
+
+bool SegmentedDownload::AddActiveRequest(NetworkRequest* request) {
+  ASSERT1(request);
+
+  __mutexScope(lock_);
+  if (is_canceled_ || FAILED(error_hr_)) {
+    return false;
+  }
+  active_requests_.push_back(request);
+  return true;
+}
+
+void SegmentedDownload::RemoveActiveRequest(NetworkRequest* request) {
+  __mutexScope(lock_);
+  active_requests_.erase(std::remove(active_requests_.begin(),
+                                     active_requests_.end(),
+                                     request),
+                         active_requests_.end());
+}
+
+void SegmentedDownload::Fail(HRESULT hr) {
+  ASSERT1(FAILED(hr));
+
+  __mutexScope(lock_);
+  if (SUCCEEDED(error_hr_)) {
+    error_hr_ = hr;
+  }
+  for (size_t i = 0; i != active_requests_.size(); ++i) {
+    active_requests_[i]->Cancel();
+  }
+}
+
+HRESULT SegmentedDownload::Cancel() {
+  NET_LOG(L3, (_T("[SegmentedDownload::Cancel]")));
+
+  __mutexScope(lock_);
+  is_canceled_ = true;
+  HRESULT hr = S_OK;
+  for (size_t i = 0; i != active_requests_.size(); ++i) {
+    hr = active_requests_[i]->Cancel();
+  }
+  return hr;
+}
+
+void SegmentedDownload::ReportProgress(size_t num_bytes) {
+  // The callback may take locks of its own, such as the lock of the model,
+  // while Cancel may be called with those locks held. Only the progress lock
+  // is held while the callback runs.
+  __mutexScope(progress_lock_);
+  uint64 bytes_downloaded = 0;
+  __mutexBlock(lock_) {
+    bytes_downloaded_ += num_bytes;
+    bytes_downloaded = bytes_downloaded_;
+  }
+  if (callback_) {
+    callback_->OnProgress(bytes_downloaded,
+                          file_size_,
+                          WINHTTP_CALLBACK_STATUS_READ_COMPLETE,
+                          NULL);
+  }
+}
+
+std::vector<DownloadMetrics> SegmentedDownload::download_metrics() const {
+  return download_metrics_;
+}
+
+bool SegmentedDownload::download_digest(std::vector<uint8>* digest) const {
+  ASSERT1(digest);
+  if (download_digest_.empty()) {
+    return false;
+  }
+  *digest = download_digest_;
+  return true;
+}
+
+}  // namespace omaha
@@ -0,0 +1,151 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// SegmentedDownload downloads a file over several connections at once from
+// servers that support range requests. The file is preallocated and split in
+// byte ranges, which the connections fetch concurrently and write at their
+// offsets in the file. The file is complete once all the ranges are.
+//
+// The request for the first range is also the probe for range support. A
+// server that ignores the Range header answers it with the whole file, which
+// completes the download over a single connection.
+//
+// Like the files downloaded by NetworkRequest, the file is not verified. The
+// caller verifies it as a whole once the download completes.
+
+#ifndef OMAHA_NET_SEGMENTED_DOWNLOAD_H_
+#define OMAHA_NET_SEGMENTED_DOWNLOAD_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "omaha/base/synchronized.h"
+#include "omaha/common/ping_event_download_metrics.h"
+#include "omaha/third_party/smartany/scoped_any.h"
+
+namespace omaha {
+
+class NetworkRequest;
+class NetworkRequestCallback;
+
+class SegmentedDownload {
+ public:
+  // Creates the requests for the ranges. Each range is fetched by a request
+  // of its own, which is deleted once the range is fetched. Called from the
+  // threads of the connections.
+  class RequestFactory {
+   public:
+    virtual ~RequestFactory() {}
+    virtual NetworkRequest* CreateRequest() = 0;
+  };
+
+  // The size of the ranges, except for the last one, unless set otherwise.
+  static const uint32 kDefaultRangeSize = 4 * 1024 * 1024;
+
+  // |factory| is not owned and must outlive this object.
+  SegmentedDownload(RequestFactory* factory, int num_connections);
+  ~SegmentedDownload();
+
+  // Downloads |url|, which is |file_size| bytes long, to |filename|. A range
+  // is fetched again a few times if it fails; the download fails once any
+  // range fails for good.
+  HRESULT DownloadFile(const CString& url,
+                       uint64 file_size,
+                       const CString& filename);
+
+  // Cancels the download. Cancel can be called from a different thread, and
+  // makes DownloadFile return GOOPDATE_E_CANCELLED. The object can't be
+  // reused once it is canceled.
+  HRESULT Cancel();
+
+  // Returns true if the last download fetched the file in several ranges.
+  bool is_segmented() const { return is_segmented_; }
+
+  // Returns the metrics of the last download, which count all its ranges.
+  std::vector<DownloadMetrics> download_metrics() const;
+
+  // Returns true if the server sent the whole file in answer to the probe,
+  // and the SHA-256 digest of the file was computed as it was written.
+  bool download_digest(std::vector<uint8>* digest) const;
+
+  // Sets an external observer of the progress of the whole download.
+  void set_callback(NetworkRequestCallback* callback) { callback_ = callback; }
+
+  void set_range_size(uint32 range_size);
+
+ private:
+  // Fetches ranges on a thread of its own until none is left.
+  class Connection;
+
+  // Fetches the ranges of the file that no connection has taken yet.
+  void FetchRanges();
+
+  // Fetches the range from |first| to |last| into |response|, with as many
+  // attempts as allowed.
+  HRESULT FetchRange(uint64 first, uint64 last, std::vector<uint8>* response);
+
+  // Returns an error unless |request| fetched the range from |first| to
+  // |last| of the file in |response|.
+  HRESULT ValidateRange(NetworkRequest* request,
+                        uint64 first,
+                        uint64 last,
+                        size_t response_size) const;
+
+  // Writes the fetched range at |offset| in the file.
+  HRESULT WriteRange(uint64 offset, const std::vector<uint8>& response);
+
+  // Tracks the requests in flight so that they can be canceled. Returns
+  // false if the download is canceled or failed.
+  bool AddActiveRequest(NetworkRequest* request);
+  void RemoveActiveRequest(NetworkRequest* request);
+
+  // Records the first error of the download and cancels the other requests.
+  void Fail(HRESULT hr);
+
+  void ReportProgress(size_t num_bytes);
+
+  RequestFactory* factory_;
+  const int num_connections_;
+  uint32 range_size_;
+  NetworkRequestCallback* callback_;
+
+  CString url_;
+  uint64 file_size_;
+  scoped_hfile file_;
+
+  // Serializes the progress reports of the connections.
+  LLock progress_lock_;
+
+  // The state below is shared by the connections.
+  LLock lock_;
+  uint64 num_ranges_;
+  uint64 next_range_;
+  uint64 bytes_downloaded_;
+  HRESULT error_hr_;
+  bool is_canceled_;
+  std::vector<NetworkRequest*> active_requests_;
+
+  bool is_segmented_;
+  std::vector<DownloadMetrics> download_metrics_;
+  std::vector<uint8> download_digest_;
+
+  DISALLOW_COPY_AND_ASSIGN(SegmentedDownload);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_NET_SEGMENTED_DOWNLOAD_H_
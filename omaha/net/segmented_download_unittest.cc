@@ -0,0 +1,412 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <windows.h>
+#include <winhttp.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "omaha/base/app_util.h"
+#include "omaha/base/error.h"
+#include "omaha/base/synchronized.h"
+#include "omaha/base/utils.h"
+#include "omaha/net/http_request.h"
+#include "omaha/net/network_config.h"
+#include "omaha/net/network_request.h"
+#include "omaha/net/segmented_download.h"
+#include "omaha/testing/unit_test.h"
+#include "omaha/third_party/smartany/scoped_any.h"
+
+namespace omaha {
+
+namespace {
+
+const uint32 kRangeSize = 1024;
+const int kNumRanges = 10;
+
+// Stands in for an HTTP server that supports range requests, and fails the
+// requests for the ranges after the first one as told.
+class RangeServer {
+ public:
+  enum Fault {
+    FAULT_NONE,
+    FAULT_SEND,           // The request fails before any response.
+    FAULT_UNAVAILABLE,    // The server answers 503.
+    FAULT_SHORT_BODY,     // The response is missing its last byte.
+    FAULT_IGNORE_RANGE,   // The server answers 200 with the whole file.
+    FAULT_HANG,           // The server does not answer until canceled.
+  };
+
+  explicit RangeServer(const std::vector<uint8>& content)
+      : content_(content),
+        supports_ranges_(true),
+        fault_(FAULT_NONE),
+        num_faults_(0),
+        num_requests_(0),
+        download_(NULL) {}
+
+  void set_supports_ranges(bool supports_ranges) {
+    supports_ranges_ = supports_ranges;
+  }
+
+  // Fails the next |num_faults| requests for ranges other than the first one
+  // with |fault|.
+  void InjectFault(Fault fault, int num_faults) {
+    __mutexScope(lock_);
+    fault_ = fault;
+    num_faults_ = num_faults;
+  }
+
+  // Cancels |download| once a request hangs.
+  void set_download(SegmentedDownload* download) { download_ = download; }
+
+  int num_requests() const {
+    __mutexScope(lock_);
+    return num_requests_;
+  }
+
+  // Answers the request with |headers|. |cancel_event| is signaled when the
+  // request is canceled.
+  HRESULT Serve(const CString& headers,
+                HANDLE cancel_event,
+                int* http_status_code,
+                CString* content_range,
+                std::vector<uint8>* body) {
+    uint64 first = 0;
+    uint64 last = 0;
+    const int range_pos = headers.Find(_T("Range: bytes="));
+    const bool has_range =
+        supports_ranges_ && range_pos != -1 &&
+        _stscanf_s(headers.Mid(range_pos), _T("Range: bytes=%I64u-%I64u"),
+                   &first, &last) == 2;
+
+    Fault fault = FAULT_NONE;
+    __mutexBlock(lock_) {
+      ++num_requests_;
+      if (has_range && first != 0 && num_faults_ > 0) {
+        fault = fault_;
+        --num_faults_;
+      }
+    }
+
+    switch (fault) {
+      case FAULT_SEND:
+        return HRESULT_FROM_WIN32(ERROR_WINHTTP_CONNECTION_ERROR);
+      case FAULT_UNAVAILABLE:
+        *http_status_code = HTTP_STATUS_SERVICE_UNAVAIL;
+        return S_OK;
+      case FAULT_HANG:
+        EXPECT_TRUE(download_);
+        EXPECT_HRESULT_SUCCEEDED(download_->Cancel());
+        EXPECT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(cancel_event, 10000));
+        return GOOPDATE_E_CANCELLED;
+      default:
+        break;
+    }
+
+    if (!has_range || fault == FAULT_IGNORE_RANGE) {
+      *http_status_code = HTTP_STATUS_OK;
+      *body = content_;
+      return S_OK;
+    }
+
+    last = std::min<uint64>(last, content_.size() - 1);
+    *http_status_code = HTTP_STATUS_PARTIAL_CONTENT;
+    content_range->Format(_T("bytes %I64u-%I64u/%Iu"),
+                          first, last, content_.size());
+    body->assign(content_.begin() + static_cast<size_t>(first),
+                 content_.begin() + static_cast<size_t>(last) + 1);
+    if (fault == FAULT_SHORT_BODY) {
+      body->pop_back();
+    }
+    return S_OK;
+  }
+
+ private:
+  const std::vector<uint8> content_;
+  bool supports_ranges_;
+
+  LLock lock_;
+  Fault fault_;
+  int num_faults_;
+  int num_requests_;
+
+  SegmentedDownload* download_;
+
+  DISALLOW_COPY_AND_ASSIGN(RangeServer);
+};
+
+// An HttpRequestInterface that sends its requests to a RangeServer.
+class RangeServerRequest : public HttpRequestInterface {
+ public:
+  explicit RangeServerRequest(RangeServer* server)
+      : server_(server),
+        callback_(NULL),
+        http_status_code_(0),
+        cancel_event_(::CreateEvent(NULL, true, false, NULL)) {
+    EXPECT_TRUE(cancel_event_);
+  }
+
+  virtual HRESULT Close() { return S_OK; }
+
+  virtual HRESULT Send() {
+    http_status_code_ = 0;
+    content_range_.Empty();
+    response_.clear();
+
+    HRESULT hr = server_->Serve(additional_headers_,
+                                get(cancel_event_),
+                                &http_status_code_,
+                                &content_range_,
+                                &response_);
+    if (FAILED(hr) || filename_.IsEmpty() || response_.empty()) {
+      return hr;
+    }
+
+    hr = WriteEntireFile(filename_, response_);
+    if (SUCCEEDED(hr) && callback_) {
+      const uint64 size = response_.size();
+      callback_->OnProgress(size, size,
+                            WINHTTP_CALLBACK_STATUS_READ_COMPLETE, NULL);
+    }
+    response_.clear();
+    return hr;
+  }
+
+  virtual HRESULT Cancel() {
+    return ::SetEvent(get(cancel_event_)) ? S_OK : HRESULTFromLastError();
+  }
+
+  virtual HRESULT Pause() { return E_NOTIMPL; }
+  virtual HRESULT Resume() { return E_NOTIMPL; }
+
+  virtual ResponseBuffer GetResponse() const { return response_; }
+
+  virtual int GetHttpStatusCode() const { return http_status_code_; }
+
+  virtual HRESULT QueryHeadersString(uint32 info_level,
+                                     const TCHAR* name,
+                                     CString* value) const {
+    UNREFERENCED_PARAMETER(name);
+    if (info_level == WINHTTP_QUERY_CONTENT_RANGE &&
+        !content_range_.IsEmpty()) {
+      *value = content_range_;
+      return S_OK;
+    }
+    return HRESULT_FROM_WIN32(ERROR_WINHTTP_HEADER_NOT_FOUND);
+  }
+
+  virtual CString GetResponseHeaders() const { return CString(); }
+  virtual CString ToString() const { return _T("range server"); }
+
+  virtual void set_session_handle(HINTERNET) {}
+  virtual void set_url(const CString&) {}
+  virtual void set_request_buffer(const void*, size_t) {}
+  virtual void set_proxy_configuration(const ProxyConfig&) {}
+
+  virtual void set_filename(const CString& filename) { filename_ = filename; }
+
+  virtual void set_low_priority(bool) {}
+
+  virtual void set_callback(NetworkRequestCallback* callback) {
+    callback_ = callback;
+  }
+
+  virtual void set_additional_headers(const CString& additional_headers) {
+    additional_headers_ = additional_headers;
+  }
+
+  virtual CString user_agent() const { return CString(); }
+  virtual void set_user_agent(const CString&) {}
+  virtual void set_proxy_auth_config(const ProxyAuthConfig&) {}
+
+  virtual bool download_metrics(DownloadMetrics*) const { return false; }
+  virtual bool download_digest(std::vector<uint8>*) const { return false; }
+
+ private:
+  RangeServer* server_;
+  CString filename_;
+  CString additional_headers_;
+  NetworkRequestCallback* callback_;
+
+  int http_status_code_;
+  CString content_range_;
+  std::vector<uint8> response_;
+  scoped_event cancel_event_;
+
+  DISALLOW_COPY_AND_ASSIGN(RangeServerRequest);
+};
+
+class RangeServerRequestFactory : public SegmentedDownload::RequestFactory {
+ public:
+  RangeServerRequestFactory(const NetworkConfig::Session& session,
+                            RangeServer* server)
+      : session_(session), server_(server) {}
+
+  virtual NetworkRequest* CreateRequest() {
+    NetworkRequest* network_request(new NetworkRequest(session_));
+    network_request->AddHttpRequest(new RangeServerRequest(server_));
+    network_request->set_num_retries(0);
+
+    ProxyConfig direct_config;
+    network_request->set_proxy_configuration(&direct_config);
+    return network_request;
+  }
+
+ private:
+  const NetworkConfig::Session session_;
+  RangeServer* server_;
+
+  DISALLOW_COPY_AND_ASSIGN(RangeServerRequestFactory);
+};
+
+}  // namespace
+
+class SegmentedDownloadTest : public testing::Test {
+ protected:
+  SegmentedDownloadTest() {
+    // The last range is shorter than the others.
+    for (size_t i = 0; i != (kNumRanges - 1) * kRangeSize + 100; ++i) {
+      content_.push_back(static_cast<uint8>(i * 7 % 251));
+    }
+  }
+
+  virtual void SetUp() {
+    NetworkConfig* network_config = NULL;
+    EXPECT_HRESULT_SUCCEEDED(
+        NetworkConfigManager::Instance().GetUserNetworkConfig(&network_config));
+
+    server_.reset(new RangeServer(content_));
+    factory_.reset(new RangeServerRequestFactory(network_config->session(),
+                                                 server_.get()));
+    download_.reset(new SegmentedDownload(factory_.get(), 4));
+    download_->set_range_size(kRangeSize);
+    server_->set_download(download_.get());
+
+    filename_ = GetTempFilenameAt(app_util::GetModuleDirectory(NULL),
+                                  _T("SDT"));
+    ASSERT_FALSE(filename_.IsEmpty());
+  }
+
+  virtual void TearDown() {
+    ::DeleteFile(filename_);
+  }
+
+  HRESULT DownloadFile() {
+    return download_->DownloadFile(_T("http://localhost/package"),
+                                   content_.size(),
+                                   filename_);
+  }
+
+  void ExpectFileIsContent() const {
+    std::vector<uint8> file;
+    EXPECT_HRESULT_SUCCEEDED(ReadEntireFile(filename_, 0, &file));
+    EXPECT_TRUE(file == content_);
+  }
+
+  std::vector<uint8> content_;
+  std::unique_ptr<RangeServer> server_;
+  std::unique_ptr<RangeServerRequestFactory> factory_;
+  std::unique_ptr<SegmentedDownload> download_;
+  CString filename_;
+};
+
+TEST_F(SegmentedDownloadTest, DownloadFile) {
+  EXPECT_HRESULT_SUCCEEDED(DownloadFile());
+  ExpectFileIsContent();
+  EXPECT_TRUE(download_->is_segmented());
+  EXPECT_EQ(kNumRanges, server_->num_requests());
+
+  const std::vector<DownloadMetrics> download_metrics(
+      download_->download_metrics());
+  ASSERT_EQ(1, download_metrics.size());
+  EXPECT_EQ(S_OK, download_metrics[0].error);
+  const int64 size = static_cast<int64>(content_.size());
+  EXPECT_EQ(size, download_metrics[0].downloaded_bytes);
+  EXPECT_EQ(size, download_metrics[0].total_bytes);
+
+  std::vector<uint8> digest;
+  EXPECT_FALSE(download_->download_digest(&digest));
+}
+
+TEST_F(SegmentedDownloadTest, DownloadFile_SingleRange) {
+  content_.resize(kRangeSize / 2);
+  TearDown();
+  SetUp();
+
+  EXPECT_HRESULT_SUCCEEDED(DownloadFile());
+  ExpectFileIsContent();
+  EXPECT_FALSE(download_->is_segmented());
+  EXPECT_EQ(1, server_->num_requests());
+}
+
+TEST_F(SegmentedDownloadTest, DownloadFile_ServerIgnoresRanges) {
+  server_->set_supports_ranges(false);
+
+  EXPECT_HRESULT_SUCCEEDED(DownloadFile());
+  ExpectFileIsContent();
+  EXPECT_FALSE(download_->is_segmented());
+  EXPECT_EQ(1, server_->num_requests());
+}
+
+TEST_F(SegmentedDownloadTest, DownloadFile_RetriesFailedRanges) {
+  const RangeServer::Fault kFaults[] = {
+    RangeServer::FAULT_SEND,
+    RangeServer::FAULT_UNAVAILABLE,
+    RangeServer::FAULT_SHORT_BODY,
+    RangeServer::FAULT_IGNORE_RANGE,
+  };
+
+  for (size_t i = 0; i != arraysize(kFaults); ++i) {
+    TearDown();
+    SetUp();
+
+    // Each range is attempted three times, so that two faults in a row are
+    // recovered from even if they hit the same range.
+    server_->InjectFault(kFaults[i], 2);
+    EXPECT_HRESULT_SUCCEEDED(DownloadFile()) << kFaults[i];
+    ExpectFileIsContent();
+    EXPECT_EQ(kNumRanges + 2, server_->num_requests());
+  }
+}
+
+TEST_F(SegmentedDownloadTest, DownloadFile_RangeFailsForGood) {
+  server_->InjectFault(RangeServer::FAULT_UNAVAILABLE, 1000);
+  EXPECT_EQ(HRESULTFromHttpStatusCode(HTTP_STATUS_SERVICE_UNAVAIL),
+            DownloadFile());
+  EXPECT_TRUE(download_->is_segmented());
+
+  const std::vector<DownloadMetrics> download_metrics(
+      download_->download_metrics());
+  ASSERT_EQ(1, download_metrics.size());
+  EXPECT_EQ(HRESULTFromHttpStatusCode(HTTP_STATUS_SERVICE_UNAVAIL),
+            download_metrics[0].error);
+}
+
+TEST_F(SegmentedDownloadTest, DownloadFile_ServerIgnoresRangesAfterProbe) {
+  server_->InjectFault(RangeServer::FAULT_IGNORE_RANGE, 1000);
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE),
+            DownloadFile());
+}
+
+TEST_F(SegmentedDownloadTest, Cancel) {
+  server_->InjectFault(RangeServer::FAULT_HANG, 1);
+  EXPECT_EQ(GOOPDATE_E_CANCELLED, DownloadFile());
+  EXPECT_EQ(GOOPDATE_E_CANCELLED, DownloadFile());
+}
+
+}  // namespace omaha
@@ -29,6 +29,7 @@
 #include "omaha/net/simple_request.h"
 #include <atlconv.h>
 #include <intsafe.h>
+#include <algorithm>
 #include <climits>
 #include <memory>
 #include <vector>
@@ -41,9 +42,12 @@
 #include "omaha/base/scope_guard.h"
 #include "omaha/base/string.h"
 #include "omaha/common/ping_event_download_metrics.h"
+#include "omaha/net/connection_pool.h"
+#include "omaha/net/download_checkpoint.h"
 #include "omaha/net/network_config.h"
 #include "omaha/net/network_request.h"
 #include "omaha/net/proxy_auth.h"
+#include "omaha/net/transfer_scheduler.h"
 #include "omaha/net/winhttp_adapter.h"
 #include "omaha/third_party/smartany/scoped_any.h"
 
@@ -54,6 +58,28 @@ namespace {
 // How many times should we retry when we get ERROR_WINHTTP_RESEND_REQUEST.
 constexpr const int kMaxResendAttempts = 3;
 
+// How many bytes a resumable download receives between checkpoints. Each
+// checkpoint flushes the file to disk.
+constexpr const int kCheckpointIntervalBytes = 4 * 1024 * 1024;
+
+// The response to a range request that starts past the end of the file.
+constexpr const int kHttpStatusRangeNotSatisfiable = 416;
+
+// Reserves the disk space of a file of |size| bytes without moving the end of
+// the file, so that the file is not fragmented and its metadata is not updated
+// each time it grows. The space not written is released when the file closes.
+HRESULT PreallocateFile(HANDLE file_handle, int64 size) {
+  FILE_ALLOCATION_INFO allocation_info = {0};
+  allocation_info.AllocationSize.QuadPart = size;
+  if (!::SetFileInformationByHandle(file_handle,
+                                    FileAllocationInfo,
+                                    &allocation_info,
+                                    sizeof(allocation_info))) {
+    return HRESULTFromLastError();
+  }
+  return S_OK;
+}
+
 }  // namespace
 
 SimpleRequest::TransientRequestState::TransientRequestState()
@@ -64,7 +90,10 @@ SimpleRequest::TransientRequestState::TransientRequestState()
       content_length(0),
       current_bytes(0),
       request_begin_ms(0),
-      request_end_ms(0) {
+      request_end_ms(0),
+      digest_bytes(0),
+      checkpoint_bytes(0) {
+  SHA256_init(&digest_ctx);
 }
 
 SimpleRequest::TransientRequestState::~TransientRequestState() {
@@ -81,7 +110,8 @@ SimpleRequest::SimpleRequest()
       low_priority_(false),
       callback_(NULL),
       download_completed_(false),
-      resend_count_(0) {
+      resend_count_(0),
+      resumable_(false) {
   SafeCStringFormat(&user_agent_, _T("%s;winhttp"),
                     NetworkConfig::GetUserAgent());
 
@@ -101,8 +131,10 @@ SimpleRequest::~SimpleRequest() {
   Close();
   callback_ = NULL;
 
-  // If download failed, try to clean up the target file.
-  if (!download_completed_ && !filename_.IsEmpty()) {
+  // If download failed, try to clean up the target file, unless a later
+  // download can resume it.
+  if (!download_completed_ && !filename_.IsEmpty() &&
+      !(resumable_ && DownloadCheckpoint::Exists(filename_))) {
     if (!::DeleteFile(filename_) && ::GetLastError() != ERROR_FILE_NOT_FOUND) {
       NET_LOG(LW, (_T("[SimpleRequest][Failed to delete file: %s][0x%08x]."),
                    filename_.GetString(), HRESULTFromLastError()));
@@ -243,6 +275,11 @@ HRESULT SimpleRequest::Send() {
         auto request_state = std::make_unique<TransientRequestState>();
         request_state->content_length = request_state_->content_length;
         request_state->current_bytes = request_state_->current_bytes;
+        request_state->digest_ctx = request_state_->digest_ctx;
+        request_state->digest_bytes = request_state_->digest_bytes;
+        request_state->etag = request_state_->etag;
+        request_state->last_modified = request_state_->last_modified;
+        request_state->checkpoint_bytes = request_state_->checkpoint_bytes;
 
         request_state_.swap(request_state);
       }
@@ -300,6 +337,15 @@ HRESULT SimpleRequest::DoSend() {
           request_state_->current_bytes < request_state_->content_length) {
         hr = RequestData(get(file_handle));
       }
+
+      // A failed download keeps what it received for the next attempt.
+      if (resumable_ && !filename_.IsEmpty()) {
+        if (SUCCEEDED(hr)) {
+          VERIFY_SUCCEEDED(DownloadCheckpoint::Delete(filename_));
+        } else {
+          SaveCheckpoint(get(file_handle));
+        }
+      }
     }
   }
 
@@ -321,9 +367,16 @@ HRESULT SimpleRequest::Connect() {
   ASSERT1(!request_state_->scheme.CompareNoCase(kHttpProtoScheme) ||
           !request_state_->scheme.CompareNoCase(kHttpsProtoScheme));
 
-  hr = winhttp_adapter_->Connect(session_handle_,
-                                 request_state_->server,
-                                 request_state_->port);
+  // Requests to the same server, through the same proxy configuration, share
+  // the connections of the process.
+  ConnectionPool::Key connection_key;
+  connection_key.session_handle = session_handle_;
+  connection_key.scheme = request_state_->scheme;
+  connection_key.server = request_state_->server;
+  connection_key.port = request_state_->port;
+  connection_key.proxy = NetworkConfig::ToString(proxy_config_);
+  hr = winhttp_adapter_->ConnectPooled(&ConnectionPool::Instance(),
+                                       connection_key);
   if (FAILED(hr)) {
     return hr;
   }
@@ -358,8 +411,17 @@ HRESULT SimpleRequest::Connect() {
   if (request_state_->current_bytes != 0 &&
       request_state_->current_bytes != request_state_->content_length) {
     ASSERT1(request_state_->current_bytes < request_state_->content_length);
-    SafeCStringAppendFormat(&additional_headers, _T("Range: bytes=%d-\r\n"),
+    SafeCStringAppendFormat(&additional_headers, _T("Range: bytes=%I64d-\r\n"),
                             request_state_->current_bytes);
+
+    // The server sends the whole file instead if it changed since the
+    // download started.
+    const CString if_range(DownloadCheckpoint::GetIfRangeValue(
+        request_state_->etag, request_state_->last_modified));
+    if (!if_range.IsEmpty()) {
+      SafeCStringAppendFormat(&additional_headers, _T("If-Range: %s\r\n"),
+                              if_range);
+    }
   }
   if (!additional_headers.IsEmpty()) {
     uint32 header_flags = WINHTTP_ADDREQ_FLAG_ADD | WINHTTP_ADDREQ_FLAG_REPLACE;
@@ -383,6 +445,12 @@ HRESULT SimpleRequest::OpenDestinationFile(HANDLE* file_handle) {
   ASSERT1(!filename_.IsEmpty());
   ASSERT1(file_handle);
 
+  if (resumable_ &&
+      request_state_->content_length == 0 &&
+      OpenCheckpointedFile(file_handle)) {
+    return S_OK;
+  }
+
   DWORD create_disposition = request_state_->content_length == 0 ?
                              CREATE_ALWAYS : OPEN_ALWAYS;
 
@@ -395,11 +463,11 @@ HRESULT SimpleRequest::OpenDestinationFile(HANDLE* file_handle) {
   }
 
   if (request_state_->content_length != 0) {
-    DWORD raw_file_size = ::GetFileSize(get(file), NULL);
-    if (INVALID_FILE_SIZE == raw_file_size || raw_file_size > INT_MAX) {
+    LARGE_INTEGER raw_file_size = {0};
+    if (!::GetFileSizeEx(get(file), &raw_file_size)) {
       return E_FAIL;
     }
-    int file_size = static_cast<int>(raw_file_size);
+    const int64 file_size = raw_file_size.QuadPart;
 
     // Local file size should not be greater than remote file size and file
     // size must match the number of bytes we previously downloaded. If not,
@@ -417,9 +485,8 @@ HRESULT SimpleRequest::OpenDestinationFile(HANDLE* file_handle) {
         return HRESULTFromLastError();
       }
     } else {
-      LARGE_INTEGER start_pos;
-      start_pos.LowPart = static_cast<DWORD>(request_state_->current_bytes);
-      start_pos.HighPart = 0;
+      LARGE_INTEGER start_pos = {0};
+      start_pos.QuadPart = request_state_->current_bytes;
       if (!::SetFilePointerEx(get(file), start_pos, NULL, FILE_BEGIN)) {
         return HRESULTFromLastError();
       }
@@ -433,6 +500,95 @@ HRESULT SimpleRequest::OpenDestinationFile(HANDLE* file_handle) {
   return S_OK;
 }
 
+bool SimpleRequest::OpenCheckpointedFile(HANDLE* file_handle) {
+  ASSERT1(file_handle);
+
+  DownloadCheckpoint checkpoint;
+  if (FAILED(checkpoint.Load(filename_)) ||
+      checkpoint.url != url_ ||
+      checkpoint.committed_bytes == 0 ||
+      checkpoint.committed_bytes >= checkpoint.content_length ||
+      DownloadCheckpoint::GetIfRangeValue(checkpoint.etag,
+                                          checkpoint.last_modified).IsEmpty()) {
+    return false;
+  }
+
+  scoped_hfile file(::CreateFile(filename_, GENERIC_WRITE, 0, NULL,
+                                 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+  if (!file) {
+    return false;
+  }
+
+  // The file may have more bytes than the checkpoint, which were written
+  // after it and may not have reached the disk. They are downloaded again.
+  LARGE_INTEGER file_size = {0};
+  LARGE_INTEGER committed_size = {0};
+  committed_size.QuadPart = checkpoint.committed_bytes;
+  if (!::GetFileSizeEx(get(file), &file_size) ||
+      file_size.QuadPart < committed_size.QuadPart ||
+      !::SetFilePointerEx(get(file), committed_size, NULL, FILE_BEGIN) ||
+      !::SetEndOfFile(get(file))) {
+    return false;
+  }
+
+  NET_LOG(L3, (_T("[resuming download][%s][%I64d of %I64d bytes]"),
+               url_, checkpoint.committed_bytes, checkpoint.content_length));
+
+  request_state_->content_length = checkpoint.content_length;
+  request_state_->current_bytes = checkpoint.committed_bytes;
+  request_state_->checkpoint_bytes = checkpoint.committed_bytes;
+  request_state_->etag = checkpoint.etag;
+  request_state_->last_modified = checkpoint.last_modified;
+  request_state_->digest_ctx = checkpoint.digest_ctx;
+  request_state_->digest_bytes =
+      checkpoint.has_digest ? checkpoint.committed_bytes : -1;
+
+  *file_handle = release(file);
+  return true;
+}
+
+void SimpleRequest::SaveCheckpoint(HANDLE file_handle) {
+  // The file on the server no longer has the bytes the download resumes
+  // from, so the next download starts over.
+  if (request_state_->http_status_code == kHttpStatusRangeNotSatisfiable) {
+    VERIFY_SUCCEEDED(DownloadCheckpoint::Delete(filename_));
+    return;
+  }
+
+  // The body of an error response is not part of the file. The next download
+  // resumes from the previous checkpoint, which drops it.
+  const bool is_http_success =
+      request_state_->http_status_code == HTTP_STATUS_OK ||
+      request_state_->http_status_code == HTTP_STATUS_PARTIAL_CONTENT;
+  if (!is_http_success ||
+      file_handle == INVALID_HANDLE_VALUE ||
+      request_state_->content_length == 0 ||
+      request_state_->current_bytes == request_state_->checkpoint_bytes ||
+      DownloadCheckpoint::GetIfRangeValue(
+          request_state_->etag, request_state_->last_modified).IsEmpty()) {
+    return;
+  }
+
+  if (!::FlushFileBuffers(file_handle)) {
+    NET_LOG(LW, (_T("[FlushFileBuffers failed][0x%08x]"),
+                 HRESULTFromLastError()));
+    return;
+  }
+
+  DownloadCheckpoint checkpoint;
+  checkpoint.url = url_;
+  checkpoint.etag = request_state_->etag;
+  checkpoint.last_modified = request_state_->last_modified;
+  checkpoint.content_length = request_state_->content_length;
+  checkpoint.committed_bytes = request_state_->current_bytes;
+  checkpoint.has_digest =
+      request_state_->digest_bytes == request_state_->current_bytes;
+  checkpoint.digest_ctx = request_state_->digest_ctx;
+  if (SUCCEEDED(checkpoint.Save(filename_))) {
+    request_state_->checkpoint_bytes = request_state_->current_bytes;
+  }
+}
+
 HRESULT SimpleRequest::SendRequest() {
   int proxy_retry_count = 0;
   int max_proxy_retries = 1;
@@ -613,51 +769,125 @@ HRESULT SimpleRequest::ReceiveData(HANDLE file_handle) {
   // condition is not handled here explicitly, WinHttp will timeout when
   // waiting for the data instead of returning right away.
   if (request_state_->http_status_code == HTTP_STATUS_NO_CONTENT) {
+    MarkConnectionReusable();
     return S_OK;
   }
 
-  int content_length = 0;
-  winhttp_adapter_->QueryRequestHeadersInt(WINHTTP_QUERY_CONTENT_LENGTH,
-                                           WINHTTP_HEADER_NAME_BY_INDEX,
-                                           &content_length,
-                                           WINHTTP_NO_HEADER_INDEX);
+  // The content length is parsed from the header string, since WinHttp only
+  // returns 32-bit numbers.
+  CString content_length_string;
+  int64 content_length = 0;
+  if (SUCCEEDED(winhttp_adapter_->QueryRequestHeadersString(
+          WINHTTP_QUERY_CONTENT_LENGTH,
+          WINHTTP_HEADER_NAME_BY_INDEX,
+          &content_length_string,
+          WINHTTP_NO_HEADER_INDEX))) {
+    content_length = std::max(String_StringToInt64(content_length_string),
+                              static_cast<int64>(0));
+  }
+
+  // A server that ignores the range, or whose file changed since the download
+  // started, sends the whole file, which replaces the partial one.
+  if (request_state_->http_status_code == HTTP_STATUS_OK) {
+    if (request_state_->current_bytes != 0 &&
+        file_handle != INVALID_HANDLE_VALUE) {
+      NET_LOG(L3, (_T("[range not honored, restarting download]")));
+      LARGE_INTEGER start_pos = {0};
+      if (!::SetFilePointerEx(file_handle, start_pos, NULL, FILE_BEGIN) ||
+          !::SetEndOfFile(file_handle)) {
+        return HRESULTFromLastError();
+      }
+      request_state_->content_length = 0;
+      request_state_->checkpoint_bytes = 0;
+      if (resumable_) {
+        VERIFY_SUCCEEDED(DownloadCheckpoint::Delete(filename_));
+      }
+    }
+
+    request_state_->etag.Empty();
+    request_state_->last_modified.Empty();
+    winhttp_adapter_->QueryRequestHeadersString(WINHTTP_QUERY_ETAG,
+                                                WINHTTP_HEADER_NAME_BY_INDEX,
+                                                &request_state_->etag,
+                                                WINHTTP_NO_HEADER_INDEX);
+    winhttp_adapter_->QueryRequestHeadersString(WINHTTP_QUERY_LAST_MODIFIED,
+                                                WINHTTP_HEADER_NAME_BY_INDEX,
+                                                &request_state_->last_modified,
+                                                WINHTTP_NO_HEADER_INDEX);
+  }
+
   if (request_state_->content_length == 0) {
     request_state_->content_length = content_length;
     request_state_->current_bytes = 0;
   }
 
+  // Hash the file as it is written. A download that starts over restarts the
+  // hash; one that resumes at a different offset than the hash cannot be
+  // hashed.
+  if (request_state_->current_bytes == 0) {
+    SHA256_init(&request_state_->digest_ctx);
+    request_state_->digest_bytes = 0;
+  } else if (request_state_->digest_bytes != request_state_->current_bytes) {
+    request_state_->digest_bytes = -1;
+  }
+
   const bool is_http_success =
       request_state_->http_status_code == HTTP_STATUS_OK ||
       request_state_->http_status_code == HTTP_STATUS_PARTIAL_CONTENT;
 
+  if (is_http_success &&
+      file_handle != INVALID_HANDLE_VALUE &&
+      request_state_->content_length) {
+    HRESULT preallocate_hr =
+        PreallocateFile(file_handle, request_state_->content_length);
+    if (FAILED(preallocate_hr)) {
+      NET_LOG(LW, (_T("[PreallocateFile failed][0x%08x]"), preallocate_hr));
+    }
+  }
+
+  // The bytes of a file are read into |buffer|, which only grows. The bytes
+  // of a response in memory are read straight into the slabs of the response.
   std::vector<uint8> buffer;
+  DWORD bytes_available(0);
   do  {
-    DWORD bytes_available(0);
     winhttp_adapter_->QueryDataAvailable(&bytes_available);
-    buffer.resize(1 + bytes_available);
-    hr = winhttp_adapter_->ReadData(&buffer.front(),
-                                    static_cast<DWORD>(buffer.size()),
+
+    uint8* data = NULL;
+    size_t data_length = 0;
+    if (filename_.IsEmpty()) {
+      data = request_state_->response.PrepareAppend(&data_length);
+    } else {
+      if (buffer.size() < 1 + bytes_available) {
+        buffer.resize(1 + bytes_available);
+      }
+      data = &buffer.front();
+      data_length = buffer.size();
+    }
+    hr = winhttp_adapter_->ReadData(data,
+                                    static_cast<DWORD>(data_length),
                                     &bytes_available);
     if (FAILED(hr)) {
       return hr;
     }
 
-    buffer.resize(bytes_available);
-    if (!buffer.empty()) {
+    if (bytes_available) {
       if (!filename_.IsEmpty()) {
         DWORD num_bytes(0);
         if (!::WriteFile(file_handle,
-                         reinterpret_cast<const char*>(&buffer.front()),
-                         static_cast<DWORD>(buffer.size()),
+                         reinterpret_cast<const char*>(data),
+                         bytes_available,
                          &num_bytes,
                          NULL)) {
           return HRESULTFromLastError();
         }
-        ASSERT1(num_bytes == buffer.size());
+        ASSERT1(num_bytes == bytes_available);
+
+        if (request_state_->digest_bytes >= 0) {
+          SHA256_update(&request_state_->digest_ctx, data, bytes_available);
+          request_state_->digest_bytes += bytes_available;
+        }
       } else {
-        request_state_->response.insert(request_state_->response.end(),
-                                        buffer.begin(),
-                                        buffer.end());
+        request_state_->response.CommitAppend(bytes_available);
       }
     }
 
@@ -669,20 +899,37 @@ HRESULT SimpleRequest::ReceiveData(HANDLE file_handle) {
       ASSERT1(request_state_->current_bytes <= request_state_->content_length);
     }
 
+    if (resumable_ && is_http_success && !filename_.IsEmpty() &&
+        request_state_->current_bytes - request_state_->checkpoint_bytes >=
+            kCheckpointIntervalBytes) {
+      SaveCheckpoint(file_handle);
+    }
+
     // The callback is called only for 200 or 206 http codes.
     if (callback_ && request_state_->content_length && is_http_success) {
-      callback_->OnProgress(request_state_->current_bytes,
-                            request_state_->content_length,
-                            WINHTTP_CALLBACK_STATUS_READ_COMPLETE,
-                            NULL);
+      callback_->OnProgress(
+          static_cast<uint64>(request_state_->current_bytes),
+          static_cast<uint64>(request_state_->content_length),
+          WINHTTP_CALLBACK_STATUS_READ_COMPLETE,
+          NULL);
     }
-  } while (!buffer.empty());
 
-  NET_LOG(L3, (_T("[bytes downloaded %d]"), request_state_->current_bytes));
+    if (bytes_available) {
+      WaitForTransferBudget(
+          GetHttpRequestTrafficClass(IsPostRequest(), low_priority_),
+          static_cast<int>(bytes_available),
+          &is_canceled_);
+    }
+  } while (bytes_available);
+
+  NET_LOG(L3, (_T("[bytes downloaded %I64d]"), request_state_->current_bytes));
   if (file_handle != INVALID_HANDLE_VALUE) {
     // All bytes must be written to the file in the file download case.
-    ASSERT1(::SetFilePointer(file_handle, 0, NULL, FILE_CURRENT) ==
-            static_cast<DWORD>(request_state_->current_bytes));
+    LARGE_INTEGER distance = {0};
+    LARGE_INTEGER position = {0};
+    ASSERT1(::SetFilePointerEx(file_handle, distance, &position,
+                               FILE_CURRENT) &&
+            position.QuadPart == request_state_->current_bytes);
   }
 
   if (request_state_->content_length &&
@@ -690,10 +937,31 @@ HRESULT SimpleRequest::ReceiveData(HANDLE file_handle) {
     return HRESULT_FROM_WIN32(ERROR_WINHTTP_CONNECTION_ERROR);
   }
 
+  if (!filename_.IsEmpty() &&
+      request_state_->digest_bytes == request_state_->current_bytes) {
+    const uint8_t* digest = SHA256_final(&request_state_->digest_ctx);
+    request_state_->download_digest.assign(digest,
+                                           digest + SHA256_DIGEST_SIZE);
+  }
+
+  MarkConnectionReusable();
   download_completed_ = true;
   return hr;
 }
 
+void SimpleRequest::MarkConnectionReusable() {
+  // The response has been read in full, so the connection can carry the next
+  // request to the server unless the server is closing it.
+  CString connection;
+  winhttp_adapter_->QueryRequestHeadersString(WINHTTP_QUERY_CONNECTION,
+                                              WINHTTP_HEADER_NAME_BY_INDEX,
+                                              &connection,
+                                              WINHTTP_NO_HEADER_INDEX);
+  if (connection.CompareNoCase(_T("close"))) {
+    winhttp_adapter_->MarkConnectionReusable();
+  }
+}
+
 HRESULT SimpleRequest::PrepareRequest(HANDLE* file_handle) {
   // Read the remaining bytes of the body. If we have a file to save the
   // response into, create the file.
@@ -706,7 +974,7 @@ HRESULT SimpleRequest::PrepareRequest(HANDLE* file_handle) {
   } else {
     // Always restarts if downloading to memory.
     request_state_->current_bytes = 0;
-    request_state_->response.clear();
+    request_state_->response.Clear();
   }
 
   return Connect();
@@ -736,9 +1004,8 @@ HRESULT SimpleRequest::RequestData(HANDLE file_handle) {
   return ReceiveData(file_handle);
 }
 
-std::vector<uint8> SimpleRequest::GetResponse() const {
-  return request_state_.get() ? request_state_->response :
-                                std::vector<uint8>();
+ResponseBuffer SimpleRequest::GetResponse() const {
+  return request_state_.get() ? request_state_->response : ResponseBuffer();
 }
 
 HRESULT SimpleRequest::QueryHeadersString(uint32 info_level,
@@ -895,9 +1162,28 @@ DownloadMetrics SimpleRequest::MakeDownloadMetrics(HRESULT hr) const {
   download_metrics.total_bytes = request_state_->content_length;
   download_metrics.download_time_ms =
       request_state_->request_end_ms - request_state_->request_begin_ms;
+
+  if (winhttp_adapter_.get()) {
+    const WinHttpAdapter::Timings timings(winhttp_adapter_->GetTimings());
+    download_metrics.dns_time_ms = timings.dns_time_ms;
+    download_metrics.connect_time_ms = timings.connect_time_ms;
+    download_metrics.tls_time_ms = timings.tls_time_ms;
+    download_metrics.ttfb_ms = timings.ttfb_ms;
+    download_metrics.is_connection_reused = timings.is_connection_reused;
+  }
   return download_metrics;
 }
 
+bool SimpleRequest::download_digest(std::vector<uint8>* digest) const {
+  ASSERT1(digest);
+  if (request_state_.get() && !request_state_->download_digest.empty()) {
+    *digest = request_state_->download_digest;
+    return true;
+  } else {
+    return false;
+  }
+}
+
 bool SimpleRequest::download_metrics(DownloadMetrics* dm) const {
   ASSERT1(dm);
   if (request_state_.get() && request_state_->download_metrics.get()) {
@@ -30,8 +30,10 @@
 #include "base/basictypes.h"
 #include "omaha/base/debug.h"
 #include "omaha/base/synchronized.h"
+#include "omaha/base/security/sha256.h"
 #include "omaha/net/http_request.h"
 #include "omaha/net/network_config.h"
+#include "omaha/net/transfer_scheduler.h"
 #include "omaha/third_party/smartany/scoped_any.h"
 
 namespace omaha {
@@ -54,7 +56,7 @@ class SimpleRequest : public HttpRequestInterface {
 
   virtual HRESULT Resume();
 
-  virtual std::vector<uint8> GetResponse() const;
+  virtual ResponseBuffer GetResponse() const;
 
   virtual int GetHttpStatusCode() const {
     return request_state_.get() ? request_state_->http_status_code : 0;
@@ -110,14 +112,36 @@ class SimpleRequest : public HttpRequestInterface {
 
   virtual bool download_metrics(DownloadMetrics* download_metrics) const;
 
+  virtual bool download_digest(std::vector<uint8>* digest) const;
+
+  // Makes file downloads keep a DownloadCheckpoint next to the file as they
+  // progress. A later download of the same url to the same file resumes from
+  // the checkpoint, even in another process, and the partial file is kept
+  // when the download fails.
+  void set_resumable(bool resumable) { resumable_ = resumable; }
+
  private:
   HRESULT DoSend();
   HRESULT OpenDestinationFile(HANDLE* file_handle);
+
+  // Opens the file of a download that can resume from its checkpoint and
+  // restores the state of the download. Returns false if the download must
+  // start over.
+  bool OpenCheckpointedFile(HANDLE* file_handle);
+
+  // Flushes the bytes downloaded so far and records them in the checkpoint.
+  void SaveCheckpoint(HANDLE file_handle);
+
   HRESULT PrepareRequest(HANDLE* file_handle);
   HRESULT Connect();
   HRESULT SendRequest();
   HRESULT ReceiveData(HANDLE file_handle);
   HRESULT RequestData(HANDLE file_handle);
+
+  // Lets the connection go back to the ConnectionPool once the response has
+  // been read, unless the server is closing it.
+  void MarkConnectionReusable();
+
   bool IsResumeNeeded() const;
   bool IsPauseSupported() const;
 
@@ -153,16 +177,29 @@ class SimpleRequest : public HttpRequestInterface {
     CString url_path;
     bool    is_https;
 
-    std::vector<uint8> response;
+    ResponseBuffer response;
     int http_status_code;
     uint32 proxy_authentication_scheme;
     CString proxy;
     CString proxy_bypass;
-    int content_length;
-    int current_bytes;
+    int64 content_length;
+    int64 current_bytes;
     uint64 request_begin_ms;
     uint64 request_end_ms;
     std::unique_ptr<DownloadMetrics> download_metrics;
+
+    // Hash of the bytes written to the file so far. It carries over to a
+    // resumed request as long as |digest_bytes| equals current_bytes;
+    // otherwise |digest_bytes| is -1 and no digest is produced.
+    LITE_SHA256_CTX digest_ctx;
+    int64 digest_bytes;
+    std::vector<uint8> download_digest;
+
+    // The validators of the response, which a resumed request sends back in
+    // its If-Range header, and the bytes recorded by the last checkpoint.
+    CString etag;
+    CString last_modified;
+    int64 checkpoint_bytes;
   };
 
   LLock lock_;
@@ -186,6 +223,7 @@ class SimpleRequest : public HttpRequestInterface {
   scoped_event event_resume_;
   bool download_completed_;
   int resend_count_;
+  bool resumable_;
 
   DISALLOW_COPY_AND_ASSIGN(SimpleRequest);
 };
@@ -26,6 +26,7 @@
 #include "omaha/base/const_addresses.h"
 #include "omaha/base/error.h"
 #include "omaha/base/scope_guard.h"
+#include "omaha/base/signatures.h"
 #include "omaha/base/string.h"
 #include "omaha/base/utils.h"
 #include "omaha/common/ping_event_download_metrics.h"
@@ -146,7 +147,8 @@ void SimpleRequestTest::SimpleGet(const CString& url,
 
   EXPECT_HRESULT_SUCCEEDED(hr);
   EXPECT_EQ(HTTP_STATUS_OK, simple_request.GetHttpStatusCode());
-  CString response = Utf8BufferToWideChar(simple_request.GetResponse());
+  CString response =
+      Utf8BufferToWideChar(simple_request.GetResponse().ToVector());
 
   // robots.txt response contains "User-agent: *". This is not the "User-Agent"
   // http header.
@@ -193,6 +195,13 @@ void SimpleRequestTest::SimpleDownloadFile(const CString& url,
   int http_status = simple_request.GetHttpStatusCode();
   EXPECT_TRUE(http_status == HTTP_STATUS_OK ||
               http_status == HTTP_STATUS_PARTIAL_CONTENT);
+
+  // The digest computed while downloading matches the file on disk.
+  std::vector<uint8> download_digest;
+  EXPECT_TRUE(simple_request.download_digest(&download_digest));
+  std::vector<byte> file_digest;
+  EXPECT_HRESULT_SUCCEEDED(CryptoHash().Compute(filename, 0, &file_digest));
+  EXPECT_TRUE(download_digest == file_digest);
 }
 
 void SimpleRequestTest::SimpleDownloadFilePauseAndResume(
@@ -0,0 +1,431 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/net/socket_connection.h"
+
+#include <limits.h>
+#include <algorithm>
+
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/safe_format.h"
+#include "omaha/base/time.h"
+#include "omaha/base/utils.h"
+
+namespace omaha {
+
+namespace {
+
+HRESULT HRESULTFromLastWSAError() {
+  const int error = ::WSAGetLastError();
+  return error ? HRESULT_FROM_WIN32(error) : E_FAIL;
+}
+
+}  // namespace
+
+SocketConnection::SocketConnection()
+    : is_winsock_initialized_(false),
+      socket_(INVALID_SOCKET),
+      event_(WSA_INVALID_EVENT),
+      dns_time_ms_(-1),
+      connect_time_ms_(-1) {
+  WSADATA wsa_data = {0};
+  const int error = ::WSAStartup(MAKEWORD(2, 2), &wsa_data);
+  if (error) {
+    NET_LOG(LE, (_T("[WSAStartup failed][%d]"), error));
+    return;
+  }
+  is_winsock_initialized_ = true;
+
+  event_ = ::WSACreateEvent();
+  if (event_ == WSA_INVALID_EVENT) {
+    NET_LOG(LE, (_T("[WSACreateEvent failed][0x%08x]"),
+                 HRESULTFromLastWSAError()));
+  }
+}
+
+SocketConnection::~SocketConnection() {
+  Close();
+  if (event_ != WSA_INVALID_EVENT) {
+    VERIFY1(::WSACloseEvent(event_));
+  }
+  if (is_winsock_initialized_) {
+    ::WSACleanup();
+  }
+}
+
+void SocketConnection::Close() {
+  if (socket_ != INVALID_SOCKET) {
+    ::closesocket(socket_);
+    socket_ = INVALID_SOCKET;
+  }
+}
+
+HRESULT SocketConnection::Connect(const CString& host,
+                                  int port,
+                                  HANDLE cancel_event,
+                                  int timeout_ms) {
+  ASSERT1(!host.IsEmpty());
+  ASSERT1(!is_connected());
+
+  if (!is_winsock_initialized_ || event_ == WSA_INVALID_EVENT) {
+    return HRESULT_FROM_WIN32(WSANOTINITIALISED);
+  }
+
+  CString service;
+  SafeCStringFormat(&service, _T("%d"), port);
+
+  ADDRINFOW hints = {0};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+
+  // The name resolution blocks. It can't be canceled.
+  const uint64 dns_begin_ms = GetCurrentMsTime();
+  ADDRINFOW* addresses = NULL;
+  const int error = ::GetAddrInfoW(host, service, &hints, &addresses);
+  dns_time_ms_ = GetCurrentMsTime() - dns_begin_ms;
+  if (error) {
+    NET_LOG(LW, (_T("[GetAddrInfoW failed][%s][%d]"), host, error));
+    return HRESULT_FROM_WIN32(error);
+  }
+
+  const uint64 connect_begin_ms = GetCurrentMsTime();
+  HRESULT hr = HRESULT_FROM_WIN32(WSAHOST_NOT_FOUND);
+  for (const ADDRINFOW* address = addresses;
+       address;
+       address = address->ai_next) {
+    hr = ConnectToAddress(*address, cancel_event, timeout_ms);
+    if (SUCCEEDED(hr) || hr == GOOPDATE_E_CANCELLED) {
+      break;
+    }
+    NET_LOG(L3, (_T("[ConnectToAddress failed][%s][0x%08x]"), host, hr));
+  }
+  ::FreeAddrInfoW(addresses);
+  connect_time_ms_ = GetCurrentMsTime() - connect_begin_ms;
+
+  NET_LOG(L3, (_T("[SocketConnection::Connect][%s:%d][0x%08x]"),
+               host, port, hr));
+  return hr;
+}
+
+HRESULT SocketConnection::ConnectToAddress(const ADDRINFOW& address,
+                                           HANDLE cancel_event,
+                                           int timeout_ms) {
+  ASSERT1(!is_connected());
+
+  socket_ = ::WSASocketW(address.ai_family,
+                         address.ai_socktype,
+                         address.ai_protocol,
+                         NULL,
+                         0,
+                         WSA_FLAG_OVERLAPPED);
+  if (socket_ == INVALID_SOCKET) {
+    return HRESULTFromLastWSAError();
+  }
+
+  // Associating the socket with the event also makes the socket non-blocking.
+  if (::WSAEventSelect(socket_,
+                       event_,
+                       FD_CONNECT | FD_READ | FD_WRITE | FD_CLOSE)) {
+    const HRESULT hr = HRESULTFromLastWSAError();
+    Close();
+    return hr;
+  }
+
+  // Requests are written in one go, so there is nothing to gain from
+  // coalescing the segments.
+  const BOOL no_delay = TRUE;
+  VERIFY1(!::setsockopt(socket_,
+                        IPPROTO_TCP,
+                        TCP_NODELAY,
+                        reinterpret_cast<const char*>(&no_delay),
+                        static_cast<int>(sizeof(no_delay))));
+
+  if (!::connect(socket_,
+                 address.ai_addr,
+                 static_cast<int>(address.ai_addrlen))) {
+    return S_OK;
+  }
+  if (::WSAGetLastError() != WSAEWOULDBLOCK) {
+    const HRESULT hr = HRESULTFromLastWSAError();
+    Close();
+    return hr;
+  }
+
+  WSANETWORKEVENTS network_events = {0};
+  HRESULT hr = WaitForEvents(FD_CONNECT | FD_CLOSE,
+                             cancel_event,
+                             timeout_ms,
+                             &network_events);
+  if (SUCCEEDED(hr)) {
+    if (network_events.lNetworkEvents & FD_CONNECT) {
+      const int error = network_events.iErrorCode[FD_CONNECT_BIT];
+      hr = error ? HRESULT_FROM_WIN32(error) : S_OK;
+    } else {
+      hr = HRESULT_FROM_WIN32(WSAECONNRESET);
+    }
+  }
+  if (FAILED(hr)) {
+    Close();
+  }
+  return hr;
+}
+
+HRESULT SocketConnection::Send(const void* buffer,
+                               size_t length,
+                               HANDLE cancel_event,
+                               int timeout_ms) {
+  ASSERT1(buffer || !length);
+
+  if (!is_connected()) {
+    return HRESULT_FROM_WIN32(WSAENOTCONN);
+  }
+
+  const char* data = static_cast<const char*>(buffer);
+  while (length) {
+    const int chunk_length = static_cast<int>(std::min<size_t>(length,
+                                                               INT_MAX));
+    const int result = ::send(socket_, data, chunk_length, 0);
+    if (result != SOCKET_ERROR) {
+      data += result;
+      length -= static_cast<size_t>(result);
+      continue;
+    }
+
+    if (::WSAGetLastError() != WSAEWOULDBLOCK) {
+      return HRESULTFromLastWSAError();
+    }
+
+    // The send buffer of the socket is full. The next send attempt fails
+    // with the error of the connection if the server closed it.
+    HRESULT hr = WaitForEvents(FD_WRITE | FD_CLOSE,
+                               cancel_event,
+                               timeout_ms,
+                               NULL);
+    if (FAILED(hr)) {
+      return hr;
+    }
+  }
+
+  return S_OK;
+}
+
+HRESULT SocketConnection::Receive(void* buffer,
+                                  size_t length,
+                                  size_t* bytes_received,
+                                  HANDLE cancel_event,
+                                  int timeout_ms) {
+  ASSERT1(buffer);
+  ASSERT1(length);
+  ASSERT1(bytes_received);
+
+  *bytes_received = 0;
+
+  if (!is_connected()) {
+    return HRESULT_FROM_WIN32(WSAENOTCONN);
+  }
+
+  const int buffer_length = static_cast<int>(std::min<size_t>(length,
+                                                              INT_MAX));
+  for (;;) {
+    const int result = ::recv(socket_,
+                              static_cast<char*>(buffer),
+                              buffer_length,
+                              0);
+    if (result > 0) {
+      *bytes_received = static_cast<size_t>(result);
+      return S_OK;
+    }
+    if (!result) {
+      return S_FALSE;
+    }
+
+    if (::WSAGetLastError() != WSAEWOULDBLOCK) {
+      return HRESULTFromLastWSAError();
+    }
+
+    HRESULT hr = WaitForEvents(FD_READ | FD_CLOSE,
+                               cancel_event,
+                               timeout_ms,
+                               NULL);
+    if (FAILED(hr)) {
+      return hr;
+    }
+  }
+}
+
+bool SocketConnection::IsIdle() const {
+  if (!is_connected()) {
+    return false;
+  }
+
+  // A connection the server closed reads as the end of the stream. Bytes the
+  // client did not ask for mean the connection is out of sync.
+  char byte = 0;
+  return ::recv(socket_, &byte, 1, MSG_PEEK) == SOCKET_ERROR &&
+         ::WSAGetLastError() == WSAEWOULDBLOCK;
+}
+
+HRESULT SocketConnection::WaitForEvents(long events,
+                                        HANDLE cancel_event,
+                                        int timeout_ms,
+                                        WSANETWORKEVENTS* network_events) {
+  ASSERT1(is_connected());
+
+  const HANDLE handles[] = {event_, cancel_event};
+  const DWORD num_handles =
+      cancel_event ? static_cast<DWORD>(arraysize(handles)) : 1;
+  const uint64 deadline_ms = GetCurrentMsTime() + std::max(timeout_ms, 0);
+
+  for (;;) {
+    const uint64 now_ms = GetCurrentMsTime();
+    const DWORD wait_ms = deadline_ms > now_ms ?
+        static_cast<DWORD>(deadline_ms - now_ms) : 0;
+    const DWORD result = ::WaitForMultipleObjects(num_handles,
+                                                  handles,
+                                                  false,
+                                                  wait_ms);
+    switch (result) {
+      case WAIT_OBJECT_0:
+        break;
+
+      case WAIT_OBJECT_0 + 1:
+        return GOOPDATE_E_CANCELLED;
+
+      case WAIT_TIMEOUT:
+        return HRESULT_FROM_WIN32(WSAETIMEDOUT);
+
+      case WAIT_FAILED:
+        return HRESULTFromLastError();
+
+      default:
+        return E_UNEXPECTED;
+    }
+
+    // Reading the events resets the event of the socket.
+    WSANETWORKEVENTS occurred_events = {0};
+    if (::WSAEnumNetworkEvents(socket_, event_, &occurred_events)) {
+      return HRESULTFromLastWSAError();
+    }
+    if (occurred_events.lNetworkEvents & events) {
+      if (network_events) {
+        *network_events = occurred_events;
+      }
+      return S_OK;
+    }
+  }
+}
+
+SocketConnectionPool* SocketConnectionPool::instance_ = NULL;
+LLock SocketConnectionPool::instance_lock_;
+
+SocketConnectionPool::SocketConnectionPool() {
+}
+
+SocketConnectionPool::~SocketConnectionPool() {
+  for (IdleConnectionMap::iterator it = connections_.begin();
+       it != connections_.end();
+       ++it) {
+    delete it->second.connection;
+  }
+}
+
+SocketConnectionPool& SocketConnectionPool::Instance() {
+  __mutexScope(instance_lock_);
+  if (!instance_) {
+    instance_ = new SocketConnectionPool;
+  }
+  return *instance_;
+}
+
+void SocketConnectionPool::DeleteInstance() {
+  SocketConnectionPool* instance = omaha::interlocked_exchange_pointer(
+      &instance_, static_cast<SocketConnectionPool*>(NULL));
+  delete instance;
+}
+
+SocketConnection* SocketConnectionPool::Take(const CString& key) {
+  const uint64 now_ms = GetCurrentMsTime();
+
+  __mutexScope(lock_);
+
+  // The most recently used connections are the likeliest to be still open.
+  while (true) {
+    std::pair<IdleConnectionMap::iterator, IdleConnectionMap::iterator> range =
+        connections_.equal_range(key);
+    if (range.first == range.second) {
+      return NULL;
+    }
+
+    IdleConnectionMap::iterator newest = range.first;
+    for (IdleConnectionMap::iterator it = range.first;
+         it != range.second;
+         ++it) {
+      if (it->second.idle_since_ms > newest->second.idle_since_ms) {
+        newest = it;
+      }
+    }
+
+    IdleConnection idle_connection = newest->second;
+    connections_.erase(newest);
+
+    if (now_ms >= idle_connection.idle_since_ms &&
+        now_ms - idle_connection.idle_since_ms <
+            static_cast<uint64>(kIdleTimeoutMs) &&
+        idle_connection.connection->IsIdle()) {
+      NET_LOG(L3, (_T("[SocketConnectionPool::Take][%s]"), key));
+      return idle_connection.connection;
+    }
+    delete idle_connection.connection;
+  }
+}
+
+void SocketConnectionPool::Put(const CString& key,
+                               SocketConnection* connection) {
+  ASSERT1(connection);
+
+  __mutexScope(lock_);
+
+  // Makes room for the connection by closing the connection that has been
+  // idle the longest.
+  const int max_idle_connections_per_key = kMaxIdleConnectionsPerKey;
+  if (static_cast<int>(connections_.count(key)) >=
+      max_idle_connections_per_key) {
+    std::pair<IdleConnectionMap::iterator, IdleConnectionMap::iterator> range =
+        connections_.equal_range(key);
+    IdleConnectionMap::iterator oldest = range.first;
+    for (IdleConnectionMap::iterator it = range.first;
+         it != range.second;
+         ++it) {
+      if (it->second.idle_since_ms < oldest->second.idle_since_ms) {
+        oldest = it;
+      }
+    }
+    delete oldest->second.connection;
+    connections_.erase(oldest);
+  }
+
+  IdleConnection idle_connection = {connection, GetCurrentMsTime()};
+  connections_.insert(std::make_pair(key, idle_connection));
+}
+
+int SocketConnectionPool::num_idle_connections() const {
+  __mutexScope(lock_);
+  return static_cast<int>(connections_.size());
+}
+
+}  // namespace omaha
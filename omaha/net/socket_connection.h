@@ -0,0 +1,146 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// SocketConnection is the non-blocking TCP connection SocketRequest sends its
+// requests over. Its i/o is event driven: each operation runs until the
+// socket would block, then waits for the socket to become ready, as signaled
+// by WSAEventSelect, together with the cancel event of the request. Since no
+// call blocks inside Winsock, canceling a request takes effect at once at any
+// stage of the transfer, except while the name of the server is resolved.
+//
+// SocketConnectionPool keeps the connections that carried a complete response
+// so that the next request to the same server skips connecting, as HTTP/1.1
+// keep-alive allows.
+
+#ifndef OMAHA_NET_SOCKET_CONNECTION_H_
+#define OMAHA_NET_SOCKET_CONNECTION_H_
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <atlstr.h>
+#include <map>
+
+#include "base/basictypes.h"
+#include "omaha/base/synchronized.h"
+
+namespace omaha {
+
+class SocketConnection {
+ public:
+  SocketConnection();
+  ~SocketConnection();
+
+  // Resolves |host| and connects to the first of its addresses that accepts
+  // the connection within |timeout_ms|. Returns GOOPDATE_E_CANCELLED if
+  // |cancel_event| is signaled first.
+  HRESULT Connect(const CString& host,
+                  int port,
+                  HANDLE cancel_event,
+                  int timeout_ms);
+
+  // Sends the |length| bytes of |buffer|.
+  HRESULT Send(const void* buffer,
+               size_t length,
+               HANDLE cancel_event,
+               int timeout_ms);
+
+  // Receives at most |length| bytes in |buffer|. Returns S_FALSE when the
+  // server has closed the connection. |timeout_ms| is the longest time to wait
+  // for the first byte.
+  HRESULT Receive(void* buffer,
+                  size_t length,
+                  size_t* bytes_received,
+                  HANDLE cancel_event,
+                  int timeout_ms);
+
+  // Returns true if the connection is open and the server has sent nothing,
+  // which is how an idle keep-alive connection looks.
+  bool IsIdle() const;
+
+  void Close();
+
+  bool is_connected() const { return socket_ != INVALID_SOCKET; }
+
+  // The time spent resolving the name of the server and connecting to it, or
+  // -1 if the connection was not made by this object.
+  int64 dns_time_ms() const { return dns_time_ms_; }
+  int64 connect_time_ms() const { return connect_time_ms_; }
+
+ private:
+  HRESULT ConnectToAddress(const ADDRINFOW& address,
+                           HANDLE cancel_event,
+                           int timeout_ms);
+
+  // Waits for one of the network |events| to happen on the socket. Returns
+  // the events that happened in |network_events|.
+  HRESULT WaitForEvents(long events,
+                        HANDLE cancel_event,
+                        int timeout_ms,
+                        WSANETWORKEVENTS* network_events);
+
+  bool is_winsock_initialized_;
+  SOCKET socket_;
+  WSAEVENT event_;
+  int64 dns_time_ms_;
+  int64 connect_time_ms_;
+
+  DISALLOW_COPY_AND_ASSIGN(SocketConnection);
+};
+
+class SocketConnectionPool {
+ public:
+  // The most idle connections kept for a server.
+  static const int kMaxIdleConnectionsPerKey = 6;
+
+  // Idle connections older than this are closed instead of being reused,
+  // since servers close them on their side after a while.
+  static const int kIdleTimeoutMs = 30 * 1000;
+
+  SocketConnectionPool();
+  ~SocketConnectionPool();
+
+  static SocketConnectionPool& Instance();
+  static void DeleteInstance();
+
+  // Returns an idle connection to the server identified by |key|, or NULL if
+  // there is none. The caller takes ownership of the connection.
+  SocketConnection* Take(const CString& key);
+
+  // Keeps |connection| for the next request to the server identified by
+  // |key|. Takes ownership of |connection|.
+  void Put(const CString& key, SocketConnection* connection);
+
+  int num_idle_connections() const;
+
+ private:
+  struct IdleConnection {
+    SocketConnection* connection;
+    uint64 idle_since_ms;
+  };
+  typedef std::multimap<CString, IdleConnection> IdleConnectionMap;
+
+  LLock lock_;
+  IdleConnectionMap connections_;
+
+  static SocketConnectionPool* instance_;
+  static LLock instance_lock_;
+
+  DISALLOW_COPY_AND_ASSIGN(SocketConnectionPool);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_NET_SOCKET_CONNECTION_H_
@@ -0,0 +1,987 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+// As with SimpleRequest, the object does not allow concurrent calls, except
+// for Cancel(), which signals the event the i/o of the request waits on.
+
+#include "omaha/net/socket_request.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "omaha/base/const_addresses.h"
+#include "omaha/base/constants.h"
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/safe_format.h"
+#include "omaha/base/string.h"
+#include "omaha/base/time.h"
+#include "omaha/common/ping_event_download_metrics.h"
+#include "omaha/net/network_request.h"
+#include "omaha/net/socket_connection.h"
+
+namespace omaha {
+
+namespace {
+
+const int kDefaultHttpPort = 80;
+
+// How many bytes are read from the socket at a time.
+const size_t kReceiveBufferSize = 64 * 1024;
+
+// The longest status line and headers, or chunk size line, accepted.
+const size_t kMaxHeadersSize = 64 * 1024;
+
+const char kCrLf[] = "\r\n";
+const char kEndOfHeaders[] = "\r\n\r\n";
+
+// Splits |authority| in its host and port. The brackets of IPv6 literals are
+// removed from the host.
+HRESULT ParseAuthority(const CString& authority, CString* host, int* port) {
+  ASSERT1(host);
+  ASSERT1(port);
+
+  CString port_string;
+  if (authority.Left(1) == _T("[")) {
+    const int bracket = authority.Find(_T(']'));
+    if (bracket < 0) {
+      return E_INVALIDARG;
+    }
+    *host = authority.Mid(1, bracket - 1);
+    const CString rest(authority.Mid(bracket + 1));
+    if (!rest.IsEmpty()) {
+      if (rest.Left(1) != _T(":")) {
+        return E_INVALIDARG;
+      }
+      port_string = rest.Mid(1);
+    }
+  } else {
+    const int colon = authority.ReverseFind(_T(':'));
+    *host = colon >= 0 ? authority.Left(colon) : authority;
+    if (colon >= 0) {
+      port_string = authority.Mid(colon + 1);
+    }
+  }
+
+  *port = kDefaultHttpPort;
+  if (!port_string.IsEmpty()) {
+    if (port_string.SpanIncluding(_T("0123456789")) != port_string) {
+      return E_INVALIDARG;
+    }
+    *port = String_StringToInt(port_string);
+  }
+
+  return host->IsEmpty() || *port <= 0 || *port > USHRT_MAX ? E_INVALIDARG :
+                                                               S_OK;
+}
+
+// Returns the value of the Host header, or of the target of CONNECT.
+CString FormatAuthority(const CString& host, int port, bool include_port) {
+  CString authority(host.Find(_T(':')) >= 0 ? _T("[") + host + _T("]") :
+                                               host);
+  if (include_port || port != kDefaultHttpPort) {
+    SafeCStringAppendFormat(&authority, _T(":%d"), port);
+  }
+  return authority;
+}
+
+// Parses the "name: value" lines of |text| into |headers|. Lines without a
+// colon, such as the status line, are skipped.
+void ParseHeaderLines(const CString& text,
+                      std::vector<std::pair<CString, CString> >* headers) {
+  ASSERT1(headers);
+
+  headers->clear();
+  int position = 0;
+  for (CString line = text.Tokenize(_T("\r\n"), position);
+       position != -1;
+       line = text.Tokenize(_T("\r\n"), position)) {
+    const int colon = line.Find(_T(':'));
+    if (colon <= 0) {
+      continue;
+    }
+    CString name(line.Left(colon));
+    CString value(line.Mid(colon + 1));
+    headers->push_back(std::make_pair(name.Trim(), value.Trim()));
+  }
+}
+
+// Returns the name of the header WinHttp returns for |query|, or NULL if the
+// query is not supported.
+const TCHAR* GetHeaderName(uint32 query, const TCHAR* name) {
+  switch (query) {
+    case WINHTTP_QUERY_CUSTOM:
+      return name;
+    case WINHTTP_QUERY_ACCEPT_RANGES:
+      return _T("Accept-Ranges");
+    case WINHTTP_QUERY_CONNECTION:
+      return _T("Connection");
+    case WINHTTP_QUERY_CONTENT_LENGTH:
+      return _T("Content-Length");
+    case WINHTTP_QUERY_CONTENT_RANGE:
+      return _T("Content-Range");
+    case WINHTTP_QUERY_CONTENT_TYPE:
+      return _T("Content-Type");
+    case WINHTTP_QUERY_ETAG:
+      return _T("ETag");
+    case WINHTTP_QUERY_LAST_MODIFIED:
+      return _T("Last-Modified");
+    case WINHTTP_QUERY_LOCATION:
+      return _T("Location");
+    case WINHTTP_QUERY_SERVER:
+      return _T("Server");
+    case WINHTTP_QUERY_TRANSFER_ENCODING:
+      return _T("Transfer-Encoding");
+    case WINHTTP_QUERY_USER_AGENT:
+      return _T("User-Agent");
+    default:
+      return NULL;
+  }
+}
+
+}  // namespace
+
+SocketRequest::TransientRequestState::TransientRequestState()
+    : port(0),
+      http_status_code(0),
+      http_minor_version(0),
+      content_length(-1),
+      current_bytes(0),
+      is_connection_reused(false),
+      dns_time_ms(-1),
+      connect_time_ms(-1),
+      request_begin_ms(0),
+      request_sent_ms(0),
+      response_begin_ms(0),
+      request_end_ms(0) {
+  SHA256_init(&digest_ctx);
+}
+
+SocketRequest::SocketRequest()
+    : is_canceled_(false),
+      request_buffer_(NULL),
+      request_buffer_length_(0),
+      proxy_auth_config_(NULL, CString()),
+      low_priority_(false),
+      callback_(NULL),
+      timeout_ms_(kDefaultTimeoutMs),
+      download_completed_(false) {
+  SafeCStringFormat(&user_agent_, _T("%s;socket"),
+                    NetworkConfig::GetUserAgent());
+
+  // The event is signaled by Cancel() to break out of the network i/o.
+  reset(event_cancel_, ::CreateEvent(NULL, true, false, NULL));
+  ASSERT1(valid(event_cancel_));
+}
+
+SocketRequest::~SocketRequest() {
+  Close();
+  callback_ = NULL;
+
+  // If download failed, try to clean up the target file.
+  if (!download_completed_ && !filename_.IsEmpty()) {
+    if (!::DeleteFile(filename_) && ::GetLastError() != ERROR_FILE_NOT_FOUND) {
+      NET_LOG(LW, (_T("[SocketRequest][Failed to delete file: %s][0x%08x]."),
+                   filename_.GetString(), HRESULTFromLastError()));
+    }
+  }
+}
+
+void SocketRequest::set_url(const CString& url) {
+  __mutexScope(lock_);
+  if (url_ != url) {
+    url_ = url;
+    request_state_.reset();
+  }
+}
+
+void SocketRequest::set_filename(const CString& filename) {
+  __mutexScope(lock_);
+  if (filename_ != filename) {
+    filename_ = filename;
+    request_state_.reset();
+  }
+}
+
+HRESULT SocketRequest::Close() {
+  NET_LOG(L3, (_T("[SocketRequest::Close]")));
+
+  __mutexScope(lock_);
+  connection_.reset();
+  receive_buffer_.clear();
+  request_state_.reset();
+  return S_OK;
+}
+
+HRESULT SocketRequest::Cancel() {
+  NET_LOG(L3, (_T("[SocketRequest::Cancel]")));
+
+  __mutexScope(lock_);
+  is_canceled_ = true;
+  return ::SetEvent(get(event_cancel_)) ? S_OK : HRESULTFromLastError();
+}
+
+HRESULT SocketRequest::Pause() {
+  NET_LOG(L3, (_T("[SocketRequest::Pause]")));
+  return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+}
+
+HRESULT SocketRequest::Resume() {
+  NET_LOG(L3, (_T("[SocketRequest::Resume]")));
+  return S_OK;
+}
+
+HRESULT SocketRequest::Send() {
+  NET_LOG(L3, (_T("[SocketRequest::Send][%s]"), url_));
+
+  ASSERT1(!url_.IsEmpty());
+  if (is_canceled_) {
+    return GOOPDATE_E_CANCELLED;
+  }
+
+  __mutexBlock(lock_) {
+    request_state_.reset(new TransientRequestState);
+  }
+  request_state_->request_begin_ms = GetCurrentMsTime();
+
+  HRESULT hr = CrackUrl(url_,
+                        &request_state_->host,
+                        &request_state_->port,
+                        &request_state_->path);
+
+  scoped_hfile file_handle;
+  if (SUCCEEDED(hr) && !filename_.IsEmpty()) {
+    reset(file_handle, ::CreateFile(filename_, GENERIC_WRITE, 0, NULL,
+                                    CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+                                    NULL));
+    if (!file_handle) {
+      hr = HRESULTFromLastError();
+    }
+  }
+
+  if (SUCCEEDED(hr)) {
+    hr = DoSend(get(file_handle));
+  }
+
+  // A connection in the middle of a transaction can't carry another one.
+  if (FAILED(hr)) {
+    connection_.reset();
+    receive_buffer_.clear();
+    if (is_canceled_) {
+      hr = GOOPDATE_E_CANCELLED;
+    }
+  }
+
+  request_state_->request_end_ms = GetCurrentMsTime();
+  request_state_->download_metrics.reset(
+      new DownloadMetrics(MakeDownloadMetrics(hr)));
+
+  NET_LOG(L3, (_T("[SocketRequest::Send][0x%x][%d]"), hr, GetHttpStatusCode()));
+  return hr;
+}
+
+HRESULT SocketRequest::DoSend(HANDLE file_handle) {
+  ASSERT1(request_state_.get());
+
+  HRESULT hr = Connect(true);
+  if (FAILED(hr) || request_state_->http_status_code) {
+    return hr;
+  }
+
+  hr = SendRequest();
+  if (SUCCEEDED(hr)) {
+    hr = ReceiveHeaders();
+  }
+
+  // The server may close an idle connection just as it is reused. The request
+  // is sent again over a new connection then.
+  if (FAILED(hr) && request_state_->is_connection_reused && !is_canceled_) {
+    NET_LOG(L3, (_T("[reused connection failed][0x%08x]"), hr));
+    connection_.reset();
+    receive_buffer_.clear();
+
+    hr = Connect(false);
+    if (FAILED(hr) || request_state_->http_status_code) {
+      return hr;
+    }
+    hr = SendRequest();
+    if (SUCCEEDED(hr)) {
+      hr = ReceiveHeaders();
+    }
+  }
+
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+#if DEBUG
+  NET_LOG(L3, (_T("[response headers...]\r\n%s"),
+               request_state_->raw_headers));
+#endif
+
+  return ReceiveBody(file_handle);
+}
+
+HRESULT SocketRequest::Connect(bool can_reuse) {
+  CString proxy_host;
+  int proxy_port = 0;
+  switch (NetworkConfig::GetAccessType(proxy_config_)) {
+    case WINHTTP_ACCESS_TYPE_NAMED_PROXY: {
+      HRESULT hr = ParseProxy(proxy_config_.proxy, &proxy_host, &proxy_port);
+      if (FAILED(hr)) {
+        NET_LOG(LW, (_T("[ParseProxy failed][%s]"), proxy_config_.proxy));
+        return hr;
+      }
+      break;
+    }
+
+    case WINHTTP_ACCESS_TYPE_AUTO_DETECT:
+      NET_LOG(L3, (_T("[proxy auto-detection is not supported]")));
+      return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+
+    default:
+      break;
+  }
+
+  const CString& host = request_state_->host;
+  const int port = request_state_->port;
+
+  SafeCStringFormat(&connection_key_, _T("%s"),
+                    FormatAuthority(host, port, true));
+  if (!proxy_host.IsEmpty()) {
+    SafeCStringAppendFormat(&connection_key_, _T(" via %s"),
+                            FormatAuthority(proxy_host, proxy_port, true));
+  }
+
+  if (can_reuse) {
+    connection_.reset(SocketConnectionPool::Instance().Take(connection_key_));
+    if (connection_.get()) {
+      request_state_->is_connection_reused = true;
+      return S_OK;
+    }
+  }
+
+  request_state_->is_connection_reused = false;
+  connection_.reset(new SocketConnection);
+  HRESULT hr = proxy_host.IsEmpty() ?
+      connection_->Connect(host, port, get(event_cancel_), timeout_ms_) :
+      connection_->Connect(proxy_host,
+                           proxy_port,
+                           get(event_cancel_),
+                           timeout_ms_);
+  request_state_->dns_time_ms = connection_->dns_time_ms();
+  request_state_->connect_time_ms = connection_->connect_time_ms();
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  if (!proxy_host.IsEmpty()) {
+    NET_LOG(L3, (_T("[using proxy %s:%d]"), proxy_host, proxy_port));
+    return OpenTunnel();
+  }
+
+  NET_LOG(L3, (_T("[using direct]")));
+  return S_OK;
+}
+
+HRESULT SocketRequest::OpenTunnel() {
+  const CString authority(FormatAuthority(request_state_->host,
+                                          request_state_->port,
+                                          true));
+  CString request;
+  SafeCStringFormat(&request,
+                    _T("CONNECT %s HTTP/1.1\r\nHost: %s\r\n%s: %s\r\n\r\n"),
+                    authority, authority, kHeaderUserAgent, user_agent_);
+  const CStringA request_utf8(WideToUtf8(request));
+  HRESULT hr = connection_->Send(request_utf8.GetString(),
+                                 request_utf8.GetLength(),
+                                 get(event_cancel_),
+                                 timeout_ms_);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  hr = ReceiveHeaders();
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  // As with WinHttp, the status of a proxy that refuses to open the tunnel is
+  // the status of the request. The connection is not reused.
+  if (request_state_->http_status_code != HTTP_STATUS_OK) {
+    NET_LOG(LW, (_T("[CONNECT failed][%d]"),
+                 request_state_->http_status_code));
+    connection_.reset();
+    receive_buffer_.clear();
+    return S_OK;
+  }
+
+  request_state_->http_status_code = 0;
+  request_state_->raw_headers.Empty();
+  request_state_->headers.clear();
+  request_state_->response_begin_ms = 0;
+  return S_OK;
+}
+
+HRESULT SocketRequest::SendRequest() {
+  const TCHAR* verb = IsPostRequest() ? _T("POST") : _T("GET");
+
+  CString headers;
+  SafeCStringFormat(&headers, _T("Host: %s\r\n"),
+                    FormatAuthority(request_state_->host,
+                                    request_state_->port,
+                                    false));
+  headers.Append(additional_headers_);
+  if (!additional_headers_.IsEmpty() &&
+      additional_headers_.Right(2) != _T("\r\n")) {
+    headers.Append(_T("\r\n"));
+  }
+  if (IsPostRequest()) {
+    SafeCStringAppendFormat(&headers, _T("Content-Length: %llu\r\n"),
+                            static_cast<uint64>(request_buffer_length_));
+  }
+  request_state_->request_headers = headers;
+
+  CString request;
+  SafeCStringFormat(&request, _T("%s %s HTTP/1.1\r\n%s\r\n"),
+                    verb, request_state_->path, headers);
+  const CStringA request_utf8(WideToUtf8(request));
+
+  std::vector<char> data(request_utf8.GetString(),
+                         request_utf8.GetString() + request_utf8.GetLength());
+  if (IsPostRequest()) {
+    const char* body = static_cast<const char*>(request_buffer_);
+    data.insert(data.end(), body, body + request_buffer_length_);
+  }
+
+  HRESULT hr = connection_->Send(&data.front(),
+                                 data.size(),
+                                 get(event_cancel_),
+                                 timeout_ms_);
+  request_state_->request_sent_ms = GetCurrentMsTime();
+  return hr;
+}
+
+HRESULT SocketRequest::ReceiveHeaders() {
+  for (;;) {
+    std::vector<char>::iterator end_of_headers;
+    for (;;) {
+      end_of_headers = std::search(receive_buffer_.begin(),
+                                   receive_buffer_.end(),
+                                   kEndOfHeaders,
+                                   kEndOfHeaders + strlen(kEndOfHeaders));
+      if (end_of_headers != receive_buffer_.end()) {
+        break;
+      }
+      if (receive_buffer_.size() > kMaxHeadersSize) {
+        return HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE);
+      }
+
+      HRESULT hr = ReceiveMore();
+      if (FAILED(hr)) {
+        return hr;
+      }
+      if (hr == S_FALSE) {
+        return HRESULT_FROM_WIN32(ERROR_WINHTTP_CONNECTION_ERROR);
+      }
+    }
+
+    const size_t headers_length =
+        end_of_headers - receive_buffer_.begin() + strlen(kEndOfHeaders);
+    HRESULT hr = ParseHeaders(&receive_buffer_.front(), headers_length);
+    receive_buffer_.erase(receive_buffer_.begin(),
+                          receive_buffer_.begin() + headers_length);
+    if (FAILED(hr)) {
+      return hr;
+    }
+
+    // Interim responses, such as 100 Continue, precede the final response.
+    if (request_state_->http_status_code >= HTTP_STATUS_OK) {
+      return S_OK;
+    }
+  }
+}
+
+HRESULT SocketRequest::ParseHeaders(const char* headers, size_t length) {
+  ASSERT1(headers);
+
+  const CString raw_headers(AnsiToWideString(headers,
+                                             static_cast<int>(length)));
+
+  int major_version = 0;
+  int minor_version = 0;
+  int status_code = 0;
+  if (_stscanf_s(raw_headers,
+                 _T("HTTP/%d.%d %d"),
+                 &major_version,
+                 &minor_version,
+                 &status_code) != 3 ||
+      status_code < HTTP_STATUS_FIRST ||
+      status_code > HTTP_STATUS_LAST) {
+    NET_LOG(LE, (_T("[invalid status line][%s]"), raw_headers));
+    return HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE);
+  }
+
+  request_state_->http_status_code = status_code;
+  request_state_->http_minor_version = major_version > 1 ? 1 : minor_version;
+  request_state_->raw_headers = raw_headers;
+  ParseHeaderLines(raw_headers, &request_state_->headers);
+  return S_OK;
+}
+
+HRESULT SocketRequest::ReceiveBody(HANDLE file_handle) {
+  const int status_code = request_state_->http_status_code;
+
+  CString content_length;
+  if (FindHeader(request_state_->headers,
+                 _T("Content-Length"),
+                 &content_length)) {
+    request_state_->content_length = String_StringToInt64(content_length);
+    if (request_state_->content_length < 0) {
+      return HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE);
+    }
+  }
+
+  CString transfer_encoding;
+  FindHeader(request_state_->headers,
+             _T("Transfer-Encoding"),
+             &transfer_encoding);
+  const bool is_chunked =
+      transfer_encoding.MakeLower().Find(_T("chunked")) >= 0;
+
+  HRESULT hr = S_OK;
+  bool is_body_delimited = true;
+  if (status_code == HTTP_STATUS_NO_CONTENT ||
+      status_code == HTTP_STATUS_NOT_MODIFIED) {
+    // These responses never have a body.
+    request_state_->content_length = 0;
+  } else if (is_chunked) {
+    request_state_->content_length = -1;
+    hr = ReceiveChunkedBody(file_handle);
+  } else if (request_state_->content_length >= 0) {
+    hr = ReceiveBodyBytes(request_state_->content_length, file_handle);
+  } else {
+    // The body ends when the server closes the connection.
+    is_body_delimited = false;
+    hr = ReceiveBodyBytes(-1, file_handle);
+  }
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  NET_LOG(L3, (_T("[bytes downloaded %lld]"), request_state_->current_bytes));
+
+  if (!filename_.IsEmpty()) {
+    const uint8_t* digest = SHA256_final(&request_state_->digest_ctx);
+    request_state_->download_digest.assign(digest,
+                                           digest + SHA256_DIGEST_SIZE);
+  }
+
+  ReleaseConnection(is_body_delimited);
+  download_completed_ = true;
+  return S_OK;
+}
+
+HRESULT SocketRequest::ReceiveChunkedBody(HANDLE file_handle) {
+  for (;;) {
+    CStringA line;
+    HRESULT hr = ReceiveLine(&line);
+    if (FAILED(hr)) {
+      return hr;
+    }
+
+    // Chunk extensions follow the size of the chunk after a semicolon.
+    const int extensions = line.Find(';');
+    if (extensions >= 0) {
+      line.Truncate(extensions);
+    }
+    line.Trim();
+
+    char* end = NULL;
+    const uint64 chunk_size = _strtoui64(line, &end, 16);
+    if (line.IsEmpty() || *end || chunk_size > LLONG_MAX) {
+      NET_LOG(LE, (_T("[invalid chunk size][%S]"), line.GetString()));
+      return HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE);
+    }
+    if (!chunk_size) {
+      break;
+    }
+
+    hr = ReceiveBodyBytes(static_cast<int64>(chunk_size), file_handle);
+    if (FAILED(hr)) {
+      return hr;
+    }
+
+    // The data of the chunk is followed by a CRLF.
+    hr = ReceiveLine(&line);
+    if (FAILED(hr)) {
+      return hr;
+    }
+    if (!line.IsEmpty()) {
+      return HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE);
+    }
+  }
+
+  // The trailers, if any, end with an empty line.
+  for (;;) {
+    CStringA line;
+    HRESULT hr = ReceiveLine(&line);
+    if (FAILED(hr)) {
+      return hr;
+    }
+    if (line.IsEmpty()) {
+      return S_OK;
+    }
+  }
+}
+
+HRESULT SocketRequest::ReceiveBodyBytes(int64 num_bytes, HANDLE file_handle) {
+  // A negative |num_bytes| reads until the end of the stream.
+  int64 remaining_bytes = num_bytes;
+  while (remaining_bytes) {
+    if (receive_buffer_.empty()) {
+      HRESULT hr = ReceiveMore();
+      if (FAILED(hr)) {
+        return hr;
+      }
+      if (hr == S_FALSE) {
+        return remaining_bytes < 0 ?
+            S_OK : HRESULT_FROM_WIN32(ERROR_WINHTTP_CONNECTION_ERROR);
+      }
+    }
+
+    size_t length = receive_buffer_.size();
+    if (remaining_bytes > 0) {
+      length = static_cast<size_t>(
+          std::min(remaining_bytes, static_cast<int64>(length)));
+      remaining_bytes -= static_cast<int64>(length);
+    }
+
+    HRESULT hr = WriteBody(reinterpret_cast<const uint8*>(
+                               &receive_buffer_.front()),
+                           length,
+                           file_handle);
+    receive_buffer_.erase(receive_buffer_.begin(),
+                          receive_buffer_.begin() + length);
+    if (FAILED(hr)) {
+      return hr;
+    }
+  }
+
+  return S_OK;
+}
+
+HRESULT SocketRequest::ReceiveLine(CStringA* line) {
+  ASSERT1(line);
+
+  for (;;) {
+    std::vector<char>::iterator end_of_line =
+        std::search(receive_buffer_.begin(),
+                    receive_buffer_.end(),
+                    kCrLf,
+                    kCrLf + strlen(kCrLf));
+    if (end_of_line != receive_buffer_.end()) {
+      const int length = static_cast<int>(end_of_line -
+                                           receive_buffer_.begin());
+      line->SetString(length ? &receive_buffer_.front() : "", length);
+      receive_buffer_.erase(receive_buffer_.begin(),
+                            end_of_line + strlen(kCrLf));
+      return S_OK;
+    }
+    if (receive_buffer_.size() > kMaxHeadersSize) {
+      return HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE);
+    }
+
+    HRESULT hr = ReceiveMore();
+    if (FAILED(hr)) {
+      return hr;
+    }
+    if (hr == S_FALSE) {
+      return HRESULT_FROM_WIN32(ERROR_WINHTTP_CONNECTION_ERROR);
+    }
+  }
+}
+
+HRESULT SocketRequest::ReceiveMore() {
+  ASSERT1(connection_.get());
+
+  const size_t size = receive_buffer_.size();
+  receive_buffer_.resize(size + kReceiveBufferSize);
+  size_t bytes_received = 0;
+  HRESULT hr = connection_->Receive(&receive_buffer_[size],
+                                    kReceiveBufferSize,
+                                    &bytes_received,
+                                    get(event_cancel_),
+                                    timeout_ms_);
+  receive_buffer_.resize(size + bytes_received);
+
+  if (bytes_received && !request_state_->response_begin_ms) {
+    request_state_->response_begin_ms = GetCurrentMsTime();
+  }
+  return hr;
+}
+
+HRESULT SocketRequest::WriteBody(const uint8* data,
+                                 size_t length,
+                                 HANDLE file_handle) {
+  ASSERT1(data);
+
+  if (!filename_.IsEmpty()) {
+    DWORD num_bytes(0);
+    if (!::WriteFile(file_handle,
+                     data,
+                     static_cast<DWORD>(length),
+                     &num_bytes,
+                     NULL)) {
+      return HRESULTFromLastError();
+    }
+    ASSERT1(num_bytes == length);
+    SHA256_update(&request_state_->digest_ctx, data, length);
+  } else {
+    request_state_->response.Append(data, length);
+  }
+  request_state_->current_bytes += length;
+
+  // The callback is called only for 200 or 206 http codes.
+  const bool is_http_success =
+      request_state_->http_status_code == HTTP_STATUS_OK ||
+      request_state_->http_status_code == HTTP_STATUS_PARTIAL_CONTENT;
+  if (callback_ && request_state_->content_length > 0 && is_http_success) {
+    callback_->OnProgress(static_cast<uint64>(request_state_->current_bytes),
+                          static_cast<uint64>(request_state_->content_length),
+                          WINHTTP_CALLBACK_STATUS_READ_COMPLETE,
+                          NULL);
+  }
+
+  WaitForTransferBudget(
+      GetHttpRequestTrafficClass(IsPostRequest(), low_priority_),
+      static_cast<int>(length),
+      &is_canceled_);
+  return S_OK;
+}
+
+void SocketRequest::ReleaseConnection(bool is_body_delimited) {
+  // HTTP/1.1 connections stay open unless the server says otherwise. HTTP/1.0
+  // connections stay open only if the server says so.
+  CString connection;
+  FindHeader(request_state_->headers, _T("Connection"), &connection);
+  connection.MakeLower();
+  const bool is_keep_alive = request_state_->http_minor_version >= 1 ?
+      connection.Find(_T("close")) < 0 :
+      connection.Find(_T("keep-alive")) >= 0;
+
+  if (connection_.get() &&
+      is_keep_alive &&
+      is_body_delimited &&
+      receive_buffer_.empty()) {
+    SocketConnectionPool::Instance().Put(connection_key_,
+                                         connection_.release());
+  } else {
+    connection_.reset();
+  }
+  receive_buffer_.clear();
+}
+
+bool SocketRequest::FindHeader(const HeaderList& headers,
+                               const CString& name,
+                               CString* value) const {
+  ASSERT1(value);
+
+  for (size_t i = 0; i != headers.size(); ++i) {
+    if (!headers[i].first.CompareNoCase(name)) {
+      *value = headers[i].second;
+      return true;
+    }
+  }
+  return false;
+}
+
+HRESULT SocketRequest::CrackUrl(const CString& url,
+                                CString* host,
+                                int* port,
+                                CString* path) {
+  ASSERT1(host);
+  ASSERT1(port);
+  ASSERT1(path);
+
+  const int scheme_end = url.Find(_T("://"));
+  if (scheme_end <= 0) {
+    return E_INVALIDARG;
+  }
+  if (url.Left(scheme_end).CompareNoCase(kHttpProtoScheme)) {
+    NET_LOG(L3, (_T("[only http urls are supported][%s]"), url));
+    return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+  }
+
+  const CString rest(url.Mid(scheme_end + 3));
+  const int path_begin = rest.FindOneOf(_T("/?#"));
+  CString authority(path_begin >= 0 ? rest.Left(path_begin) : rest);
+  CString url_path(path_begin >= 0 ? rest.Mid(path_begin) : CString());
+
+  // The fragment is not sent to the server.
+  const int fragment = url_path.Find(_T('#'));
+  if (fragment >= 0) {
+    url_path.Truncate(fragment);
+  }
+  if (url_path.Left(1) != _T("/")) {
+    url_path = _T("/") + url_path;
+  }
+
+  const int user_info_end = authority.ReverseFind(_T('@'));
+  if (user_info_end >= 0) {
+    authority = authority.Mid(user_info_end + 1);
+  }
+
+  HRESULT hr = ParseAuthority(authority, host, port);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  *path = url_path;
+  return S_OK;
+}
+
+HRESULT SocketRequest::ParseProxy(const CString& proxy_list,
+                                  CString* host,
+                                  int* port) {
+  ASSERT1(host);
+  ASSERT1(port);
+
+  // Prefers the proxy for http urls over the proxy for all urls.
+  CString proxy;
+  int position = 0;
+  for (CString entry = proxy_list.Tokenize(_T("; \t"), position);
+       position != -1;
+       entry = proxy_list.Tokenize(_T("; \t"), position)) {
+    const int equal_sign = entry.Find(_T('='));
+    if (equal_sign < 0) {
+      if (proxy.IsEmpty()) {
+        proxy = entry;
+      }
+    } else if (!entry.Left(equal_sign).CompareNoCase(kHttpProtoScheme)) {
+      proxy = entry.Mid(equal_sign + 1);
+      break;
+    }
+  }
+
+  const int scheme_end = proxy.Find(_T("://"));
+  if (scheme_end >= 0) {
+    proxy = proxy.Mid(scheme_end + 3);
+  }
+  proxy.TrimRight(_T('/'));
+
+  return proxy.IsEmpty() ? E_INVALIDARG : ParseAuthority(proxy, host, port);
+}
+
+ResponseBuffer SocketRequest::GetResponse() const {
+  return request_state_.get() ? request_state_->response : ResponseBuffer();
+}
+
+HRESULT SocketRequest::QueryHeadersString(uint32 info_level,
+                                          const TCHAR* name,
+                                          CString* value) const {
+  ASSERT1(value);
+
+  if (!request_state_.get()) {
+    return E_UNEXPECTED;
+  }
+
+  const uint32 query = info_level & ~WINHTTP_QUERY_MODIFIER_FLAGS_MASK;
+  const bool is_request_header =
+      (info_level & WINHTTP_QUERY_FLAG_REQUEST_HEADERS) != 0;
+
+  if (!is_request_header && query == WINHTTP_QUERY_RAW_HEADERS_CRLF) {
+    *value = request_state_->raw_headers;
+    return S_OK;
+  }
+  if (!is_request_header && query == WINHTTP_QUERY_STATUS_CODE) {
+    SafeCStringFormat(value, _T("%d"), request_state_->http_status_code);
+    return S_OK;
+  }
+
+  const TCHAR* header_name = GetHeaderName(query, name);
+  if (!header_name) {
+    return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+  }
+
+  HeaderList request_headers;
+  if (is_request_header) {
+    ParseHeaderLines(request_state_->request_headers, &request_headers);
+  }
+  return FindHeader(is_request_header ? request_headers :
+                                        request_state_->headers,
+                    header_name,
+                    value) ?
+      S_OK : HRESULT_FROM_WIN32(ERROR_WINHTTP_HEADER_NOT_FOUND);
+}
+
+CString SocketRequest::GetResponseHeaders() const {
+  return request_state_.get() ? request_state_->raw_headers : CString();
+}
+
+DownloadMetrics SocketRequest::MakeDownloadMetrics(HRESULT hr) const {
+  ASSERT1(request_state_.get());
+
+  // The error is reported as SimpleRequest reports it.
+  const int status_code = request_state_->http_status_code;
+  const int error = status_code == HTTP_STATUS_OK ?
+      0 : (SUCCEEDED(hr) ? HRESULTFromHttpStatusCode(status_code) : hr);
+
+  DownloadMetrics download_metrics;
+  download_metrics.url = url_;
+  download_metrics.downloader = DownloadMetrics::kSocket;
+  download_metrics.error = error;
+  download_metrics.downloaded_bytes = request_state_->current_bytes;
+  download_metrics.total_bytes =
+      std::max(request_state_->content_length, static_cast<int64>(0));
+  download_metrics.download_time_ms =
+      request_state_->request_end_ms - request_state_->request_begin_ms;
+
+  download_metrics.is_connection_reused =
+      request_state_->is_connection_reused;
+  if (!request_state_->is_connection_reused) {
+    download_metrics.dns_time_ms = request_state_->dns_time_ms;
+    download_metrics.connect_time_ms = request_state_->connect_time_ms;
+  }
+  if (request_state_->request_sent_ms &&
+      request_state_->response_begin_ms >= request_state_->request_sent_ms) {
+    download_metrics.ttfb_ms =
+        request_state_->response_begin_ms - request_state_->request_sent_ms;
+  }
+  return download_metrics;
+}
+
+bool SocketRequest::download_digest(std::vector<uint8>* digest) const {
+  ASSERT1(digest);
+  if (request_state_.get() && !request_state_->download_digest.empty()) {
+    *digest = request_state_->download_digest;
+    return true;
+  } else {
+    return false;
+  }
+}
+
+bool SocketRequest::download_metrics(DownloadMetrics* dm) const {
+  ASSERT1(dm);
+  if (request_state_.get() && request_state_->download_metrics.get()) {
+    *dm = *(request_state_->download_metrics);
+    return true;
+  } else {
+    return false;
+  }
+}
+
+}  // namespace omaha
@@ -0,0 +1,246 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// SocketRequest provides for http transactions over plain sockets, without
+// WinHttp. It speaks HTTP/1.1 itself: it keeps connections alive across
+// requests, decodes chunked responses, passes Range requests through, and
+// tunnels through named proxies with CONNECT. It plugs into the fallback chain
+// of NetworkRequest like SimpleRequest does, so the code above NetworkRequest
+// can be run and load tested against a stand-in server on the loopback
+// interface.
+//
+// Only http urls are supported. Https and the proxy configurations that need
+// WinHttp to be resolved, auto-detection and PAC scripts, fail with
+// ERROR_NOT_SUPPORTED so that NetworkRequest moves on to the next http
+// request or proxy configuration. Proxy authentication is not supported.
+
+#ifndef OMAHA_NET_SOCKET_REQUEST_H_
+#define OMAHA_NET_SOCKET_REQUEST_H_
+
+#include <atlstr.h>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "omaha/base/security/sha256.h"
+#include "omaha/base/synchronized.h"
+#include "omaha/net/http_request.h"
+#include "omaha/net/network_config.h"
+#include "omaha/net/transfer_scheduler.h"
+#include "omaha/third_party/smartany/scoped_any.h"
+
+namespace omaha {
+
+struct DownloadMetrics;
+class SocketConnection;
+
+class SocketRequest : public HttpRequestInterface {
+ public:
+  // The longest the request waits on the network before giving up.
+  static const int kDefaultTimeoutMs = 60 * 1000;
+
+  SocketRequest();
+  ~SocketRequest() override;
+
+  HRESULT Close() override;
+
+  HRESULT Send() override;
+
+  HRESULT Cancel() override;
+
+  HRESULT Pause() override;
+
+  HRESULT Resume() override;
+
+  ResponseBuffer GetResponse() const override;
+
+  int GetHttpStatusCode() const override {
+    return request_state_.get() ? request_state_->http_status_code : 0;
+  }
+
+  HRESULT QueryHeadersString(uint32 info_level,
+                             const TCHAR* name,
+                             CString* value) const override;
+
+  CString GetResponseHeaders() const override;
+
+  CString ToString() const override { return _T("socket"); }
+
+  // The request does not use WinHttp sessions.
+  void set_session_handle(HINTERNET session_handle) override {
+    UNREFERENCED_PARAMETER(session_handle);
+  }
+
+  void set_url(const CString& url) override;
+
+  void set_request_buffer(const void* buffer, size_t buffer_length) override {
+    request_buffer_ = buffer;
+    request_buffer_length_ = buffer_length;
+  }
+
+  void set_proxy_configuration(const ProxyConfig& proxy_config) override {
+    proxy_config_ = proxy_config;
+  }
+
+  void set_filename(const CString& filename) override;
+
+  void set_low_priority(bool low_priority) override {
+    low_priority_ = low_priority;
+  }
+
+  void set_callback(NetworkRequestCallback* callback) override {
+    callback_ = callback;
+  }
+
+  void set_additional_headers(const CString& additional_headers) override {
+    additional_headers_ = additional_headers;
+  }
+
+  CString user_agent() const override { return user_agent_; }
+
+  void set_user_agent(const CString& user_agent) override {
+    user_agent_ = user_agent;
+  }
+
+  void set_proxy_auth_config(const ProxyAuthConfig& proxy_auth_config)
+      override {
+    proxy_auth_config_ = proxy_auth_config;
+  }
+
+  bool download_metrics(DownloadMetrics* download_metrics) const override;
+
+  bool download_digest(std::vector<uint8>* digest) const override;
+
+  void set_timeout(int timeout_ms) { timeout_ms_ = timeout_ms; }
+
+  // Splits an http url in its host, port, and path. Exposed for testing.
+  static HRESULT CrackUrl(const CString& url,
+                          CString* host,
+                          int* port,
+                          CString* path);
+
+  // Returns the host and port of the proxy for http urls in a WinHttp proxy
+  // list, such as "proxy:8080" or "http=proxy:8080;https=proxy:8443".
+  // Exposed for testing.
+  static HRESULT ParseProxy(const CString& proxy_list,
+                            CString* host,
+                            int* port);
+
+ private:
+  typedef std::vector<std::pair<CString, CString> > HeaderList;
+
+  // The state of a single http transaction.
+  struct TransientRequestState {
+    TransientRequestState();
+
+    CString host;
+    int port;
+    CString path;
+
+    int http_status_code;
+    int http_minor_version;
+    CString raw_headers;
+    HeaderList headers;
+    CString request_headers;
+
+    ResponseBuffer response;
+    int64 content_length;     // -1 when the server does not tell.
+    int64 current_bytes;
+
+    bool is_connection_reused;
+    int64 dns_time_ms;
+    int64 connect_time_ms;
+    uint64 request_begin_ms;
+    uint64 request_sent_ms;
+    uint64 response_begin_ms;
+    uint64 request_end_ms;
+    std::unique_ptr<DownloadMetrics> download_metrics;
+
+    LITE_SHA256_CTX digest_ctx;
+    std::vector<uint8> download_digest;
+  };
+
+  HRESULT DoSend(HANDLE file_handle);
+
+  // Returns a connection to the server, or to the proxy with a tunnel to the
+  // server open, in |connection_|. Takes an idle connection from the
+  // SocketConnectionPool if |can_reuse| is true.
+  HRESULT Connect(bool can_reuse);
+  HRESULT OpenTunnel();
+
+  HRESULT SendRequest();
+
+  // Receives the status line and the headers of the response, skipping the
+  // interim 1xx responses.
+  HRESULT ReceiveHeaders();
+  HRESULT ParseHeaders(const char* headers, size_t length);
+
+  HRESULT ReceiveBody(HANDLE file_handle);
+  HRESULT ReceiveChunkedBody(HANDLE file_handle);
+  HRESULT ReceiveBodyBytes(int64 num_bytes, HANDLE file_handle);
+
+  // Receives until a CRLF and returns the line without it.
+  HRESULT ReceiveLine(CStringA* line);
+
+  // Receives more bytes into |receive_buffer_|. Returns S_FALSE at the end of
+  // the stream.
+  HRESULT ReceiveMore();
+
+  HRESULT WriteBody(const uint8* data, size_t length, HANDLE file_handle);
+
+  // Keeps the connection for the next request to the server, unless the
+  // server is closing it.
+  void ReleaseConnection(bool is_body_delimited);
+
+  bool FindHeader(const HeaderList& headers,
+                  const CString& name,
+                  CString* value) const;
+
+  DownloadMetrics MakeDownloadMetrics(HRESULT hr) const;
+
+  bool IsPostRequest() const { return request_buffer_ != NULL; }
+
+  LLock lock_;
+  volatile bool is_canceled_;
+  scoped_event event_cancel_;
+  CString url_;
+  CString filename_;
+  const void* request_buffer_;          // Contains the request body for POST.
+  size_t      request_buffer_length_;   // Length of the request body.
+  CString additional_headers_;
+  CString user_agent_;
+  ProxyAuthConfig proxy_auth_config_;
+  ProxyConfig proxy_config_;
+  bool low_priority_;
+  NetworkRequestCallback* callback_;
+  int timeout_ms_;
+  bool download_completed_;
+
+  // The key of |connection_| in the SocketConnectionPool.
+  CString connection_key_;
+  std::unique_ptr<SocketConnection> connection_;
+
+  // The bytes received and not consumed yet.
+  std::vector<char> receive_buffer_;
+
+  std::unique_ptr<TransientRequestState> request_state_;
+
+  DISALLOW_COPY_AND_ASSIGN(SocketRequest);
+};
+
+}   // namespace omaha
+
+#endif  // OMAHA_NET_SOCKET_REQUEST_H_
@@ -0,0 +1,662 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Runs SocketRequest against a server on the loopback interface, which
+// answers with canned responses and records the requests it receives.
+
+#include <winsock2.h>
+#include <windows.h>
+#include <winhttp.h>
+#include <atlstr.h>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "omaha/base/app_util.h"
+#include "omaha/base/error.h"
+#include "omaha/base/file.h"
+#include "omaha/base/safe_format.h"
+#include "omaha/base/security/sha256.h"
+#include "omaha/base/synchronized.h"
+#include "omaha/base/thread.h"
+#include "omaha/base/utils.h"
+#include "omaha/common/ping_event_download_metrics.h"
+#include "omaha/net/network_config.h"
+#include "omaha/net/network_request.h"
+#include "omaha/net/socket_connection.h"
+#include "omaha/net/socket_request.h"
+#include "omaha/testing/unit_test.h"
+#include "omaha/third_party/smartany/scoped_any.h"
+
+namespace omaha {
+
+namespace {
+
+// The longest a test waits for the server thread to exit.
+const int kServerExitTimeoutMs = 10000;
+
+// Serves the canned responses in the order they are added, one for each
+// request it receives. Connections are served one at a time, and each is kept
+// open until the client closes it, unless the response says otherwise.
+class LoopbackServer : public Runnable {
+ public:
+  LoopbackServer()
+      : listen_socket_(INVALID_SOCKET),
+        port_(0),
+        num_connections_(0) {
+    WSADATA wsa_data = {0};
+    VERIFY1(!::WSAStartup(MAKEWORD(2, 2), &wsa_data));
+    reset(stop_event_, ::CreateEvent(NULL, true, false, NULL));
+  }
+
+  ~LoopbackServer() override {
+    Stop();
+    ::WSACleanup();
+  }
+
+  bool Start() {
+    listen_socket_ = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listen_socket_ == INVALID_SOCKET) {
+      return false;
+    }
+
+    sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+    int address_length = sizeof(address);
+    if (::bind(listen_socket_,
+               reinterpret_cast<sockaddr*>(&address),
+               sizeof(address)) ||
+        ::listen(listen_socket_, SOMAXCONN) ||
+        ::getsockname(listen_socket_,
+                      reinterpret_cast<sockaddr*>(&address),
+                      &address_length)) {
+      return false;
+    }
+    port_ = ::ntohs(address.sin_port);
+    return thread_.Start(this);
+  }
+
+  // Closes the listening socket, which ends the thread once the connection
+  // being served is closed.
+  void Stop() {
+    ::SetEvent(get(stop_event_));
+    if (listen_socket_ != INVALID_SOCKET) {
+      ::closesocket(listen_socket_);
+      listen_socket_ = INVALID_SOCKET;
+    }
+    EXPECT_TRUE(thread_.WaitTillExit(kServerExitTimeoutMs));
+  }
+
+  // Adds a response. The server closes the connection after sending it if
+  // |close| is true, or keeps the connection silent until the server stops
+  // if |hang| is true.
+  void AddResponse(const std::string& response, bool close, bool hang) {
+    __mutexScope(lock_);
+    Response canned_response = {response, close, hang};
+    responses_.push_back(canned_response);
+  }
+
+  void AddResponse(const std::string& response) {
+    AddResponse(response, false, false);
+  }
+
+  CString GetUrl(const TCHAR* path) const {
+    CString url;
+    SafeCStringFormat(&url, _T("http://127.0.0.1:%d%s"), port_, path);
+    return url;
+  }
+
+  int port() const { return port_; }
+
+  int num_connections() const {
+    __mutexScope(lock_);
+    return num_connections_;
+  }
+
+  std::vector<std::string> requests() const {
+    __mutexScope(lock_);
+    return requests_;
+  }
+
+  void Run() override {
+    for (;;) {
+      SOCKET connection = ::accept(listen_socket_, NULL, NULL);
+      if (connection == INVALID_SOCKET) {
+        return;
+      }
+      __mutexBlock(lock_) {
+        ++num_connections_;
+      }
+      ServeConnection(connection);
+      ::closesocket(connection);
+    }
+  }
+
+ private:
+  struct Response {
+    std::string data;
+    bool close;
+    bool hang;
+  };
+
+  void ServeConnection(SOCKET connection) {
+    std::string buffer;
+    for (;;) {
+      std::string request;
+      if (!ReceiveRequest(connection, &buffer, &request)) {
+        return;
+      }
+
+      Response response = {"HTTP/1.1 500 No Response\r\n"
+                           "Content-Length: 0\r\n\r\n", true, false};
+      __mutexBlock(lock_) {
+        requests_.push_back(request);
+        if (!responses_.empty()) {
+          response = responses_.front();
+          responses_.pop_front();
+        }
+      }
+
+      ::send(connection,
+             response.data.c_str(),
+             static_cast<int>(response.data.size()),
+             0);
+      if (response.hang) {
+        ::WaitForSingleObject(get(stop_event_), INFINITE);
+        return;
+      }
+      if (response.close) {
+        return;
+      }
+    }
+  }
+
+  // Receives the headers of a request and its body, as the Content-Length
+  // header tells.
+  static bool ReceiveRequest(SOCKET connection,
+                             std::string* buffer,
+                             std::string* request) {
+    size_t end_of_headers = std::string::npos;
+    while ((end_of_headers = buffer->find("\r\n\r\n")) == std::string::npos) {
+      if (!ReceiveMore(connection, buffer)) {
+        return false;
+      }
+    }
+    end_of_headers += 4;
+
+    size_t content_length = 0;
+    const std::string headers(buffer->substr(0, end_of_headers));
+    const size_t header = headers.find("Content-Length:");
+    if (header != std::string::npos) {
+      content_length = atoi(headers.c_str() + header + 15);
+    }
+
+    while (buffer->size() < end_of_headers + content_length) {
+      if (!ReceiveMore(connection, buffer)) {
+        return false;
+      }
+    }
+
+    *request = buffer->substr(0, end_of_headers + content_length);
+    buffer->erase(0, end_of_headers + content_length);
+    return true;
+  }
+
+  static bool ReceiveMore(SOCKET connection, std::string* buffer) {
+    char data[4096] = {0};
+    const int bytes_received = ::recv(connection, data, sizeof(data), 0);
+    if (bytes_received <= 0) {
+      return false;
+    }
+    buffer->append(data, bytes_received);
+    return true;
+  }
+
+  SOCKET listen_socket_;
+  int port_;
+  scoped_event stop_event_;
+  Thread thread_;
+
+  LLock lock_;
+  std::deque<Response> responses_;
+  std::vector<std::string> requests_;
+  int num_connections_;
+
+  DISALLOW_COPY_AND_ASSIGN(LoopbackServer);
+};
+
+std::string ToString(const std::vector<uint8>& bytes) {
+  return std::string(bytes.begin(), bytes.end());
+}
+
+std::string ToString(const ResponseBuffer& response) {
+  return ToString(response.ToVector());
+}
+
+}  // namespace
+
+class SocketRequestTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    server_.reset(new LoopbackServer);
+    ASSERT_TRUE(server_->Start());
+    request_.reset(new SocketRequest);
+    request_->set_timeout(kServerExitTimeoutMs);
+  }
+
+  virtual void TearDown() {
+    request_.reset();
+
+    // Closes the idle connections so that the server thread can exit.
+    SocketConnectionPool::DeleteInstance();
+    server_.reset();
+  }
+
+  HRESULT Get(const TCHAR* path) {
+    request_->set_url(server_->GetUrl(path));
+    return request_->Send();
+  }
+
+  std::unique_ptr<LoopbackServer> server_;
+  std::unique_ptr<SocketRequest> request_;
+};
+
+TEST(SocketRequestCrackUrlTest, CrackUrl) {
+  CString host;
+  int port = 0;
+  CString path;
+
+  EXPECT_HRESULT_SUCCEEDED(SocketRequest::CrackUrl(
+      _T("http://tools.google.com/service/update2"), &host, &port, &path));
+  EXPECT_STREQ(_T("tools.google.com"), host);
+  EXPECT_EQ(80, port);
+  EXPECT_STREQ(_T("/service/update2"), path);
+
+  EXPECT_HRESULT_SUCCEEDED(SocketRequest::CrackUrl(
+      _T("HTTP://user:pw@127.0.0.1:8080?a=b#fragment"), &host, &port, &path));
+  EXPECT_STREQ(_T("127.0.0.1"), host);
+  EXPECT_EQ(8080, port);
+  EXPECT_STREQ(_T("/?a=b"), path);
+
+  EXPECT_HRESULT_SUCCEEDED(SocketRequest::CrackUrl(
+      _T("http://[::1]:81/a"), &host, &port, &path));
+  EXPECT_STREQ(_T("::1"), host);
+  EXPECT_EQ(81, port);
+  EXPECT_STREQ(_T("/a"), path);
+
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED),
+            SocketRequest::CrackUrl(_T("https://tools.google.com/"),
+                                    &host, &port, &path));
+  EXPECT_EQ(E_INVALIDARG,
+            SocketRequest::CrackUrl(_T("tools.google.com"),
+                                    &host, &port, &path));
+  EXPECT_EQ(E_INVALIDARG,
+            SocketRequest::CrackUrl(_T("http://tools.google.com:99999/"),
+                                    &host, &port, &path));
+  EXPECT_EQ(E_INVALIDARG,
+            SocketRequest::CrackUrl(_T("http://:80/"), &host, &port, &path));
+}
+
+TEST(SocketRequestParseProxyTest, ParseProxy) {
+  CString host;
+  int port = 0;
+
+  EXPECT_HRESULT_SUCCEEDED(
+      SocketRequest::ParseProxy(_T("proxy:8080"), &host, &port));
+  EXPECT_STREQ(_T("proxy"), host);
+  EXPECT_EQ(8080, port);
+
+  EXPECT_HRESULT_SUCCEEDED(SocketRequest::ParseProxy(
+      _T("https=secure:8443;http=http://plain:3128/"), &host, &port));
+  EXPECT_STREQ(_T("plain"), host);
+  EXPECT_EQ(3128, port);
+
+  EXPECT_HRESULT_SUCCEEDED(
+      SocketRequest::ParseProxy(_T("https=secure:8443 any"), &host, &port));
+  EXPECT_STREQ(_T("any"), host);
+  EXPECT_EQ(80, port);
+
+  EXPECT_EQ(E_INVALIDARG,
+            SocketRequest::ParseProxy(_T("https=secure:8443"), &host, &port));
+  EXPECT_EQ(E_INVALIDARG, SocketRequest::ParseProxy(_T(""), &host, &port));
+}
+
+TEST_F(SocketRequestTest, Get_ContentLength) {
+  server_->AddResponse("HTTP/1.1 200 OK\r\n"
+                       "Content-Type: text/plain\r\n"
+                       "Content-Length: 5\r\n\r\n"
+                       "hello");
+
+  EXPECT_HRESULT_SUCCEEDED(Get(_T("/file")));
+  EXPECT_EQ(HTTP_STATUS_OK, request_->GetHttpStatusCode());
+  EXPECT_STREQ("hello", ToString(request_->GetResponse()).c_str());
+
+  CString content_type;
+  EXPECT_HRESULT_SUCCEEDED(request_->QueryHeadersString(
+      WINHTTP_QUERY_CONTENT_TYPE, NULL, &content_type));
+  EXPECT_STREQ(_T("text/plain"), content_type);
+
+  CString etag;
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_WINHTTP_HEADER_NOT_FOUND),
+            request_->QueryHeadersString(WINHTTP_QUERY_ETAG, NULL, &etag));
+
+  CString host;
+  EXPECT_HRESULT_SUCCEEDED(request_->QueryHeadersString(
+      WINHTTP_QUERY_CUSTOM | WINHTTP_QUERY_FLAG_REQUEST_HEADERS,
+      _T("Host"),
+      &host));
+  EXPECT_EQ(server_->GetUrl(_T("")).Mid(7), host);
+
+  const std::vector<std::string> requests(server_->requests());
+  ASSERT_EQ(1, requests.size());
+  EXPECT_EQ(0, requests[0].find("GET /file HTTP/1.1\r\n"));
+
+  DownloadMetrics download_metrics;
+  EXPECT_TRUE(request_->download_metrics(&download_metrics));
+  EXPECT_EQ(DownloadMetrics::kSocket, download_metrics.downloader);
+  EXPECT_EQ(0, download_metrics.error);
+  EXPECT_EQ(5, download_metrics.downloaded_bytes);
+  EXPECT_EQ(5, download_metrics.total_bytes);
+  EXPECT_FALSE(download_metrics.is_connection_reused);
+  EXPECT_LE(0, download_metrics.connect_time_ms);
+  EXPECT_LE(0, download_metrics.ttfb_ms);
+}
+
+TEST_F(SocketRequestTest, Get_Chunked) {
+  server_->AddResponse("HTTP/1.1 100 Continue\r\n\r\n"
+                       "HTTP/1.1 200 OK\r\n"
+                       "Transfer-Encoding: chunked\r\n\r\n"
+                       "5;name=value\r\nhello\r\n"
+                       "1\r\n \r\n"
+                       "5\r\nworld\r\n"
+                       "0\r\n"
+                       "Trailer: value\r\n\r\n");
+
+  EXPECT_HRESULT_SUCCEEDED(Get(_T("/")));
+  EXPECT_EQ(HTTP_STATUS_OK, request_->GetHttpStatusCode());
+  EXPECT_STREQ("hello world", ToString(request_->GetResponse()).c_str());
+
+  // The connection is kept since the response is complete.
+  EXPECT_EQ(1, SocketConnectionPool::Instance().num_idle_connections());
+}
+
+TEST_F(SocketRequestTest, Get_InvalidChunk) {
+  server_->AddResponse("HTTP/1.1 200 OK\r\n"
+                       "Transfer-Encoding: chunked\r\n\r\n"
+                       "xyz\r\nhello\r\n0\r\n\r\n");
+
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE),
+            Get(_T("/")));
+  EXPECT_EQ(0, SocketConnectionPool::Instance().num_idle_connections());
+}
+
+TEST_F(SocketRequestTest, KeepAlive) {
+  server_->AddResponse("HTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\none");
+  server_->AddResponse("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+  server_->AddResponse("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nthree");
+
+  EXPECT_HRESULT_SUCCEEDED(Get(_T("/1")));
+  EXPECT_STREQ("one", ToString(request_->GetResponse()).c_str());
+
+  EXPECT_HRESULT_SUCCEEDED(Get(_T("/2")));
+  EXPECT_EQ(HTTP_STATUS_NOT_FOUND, request_->GetHttpStatusCode());
+
+  EXPECT_HRESULT_SUCCEEDED(Get(_T("/3")));
+  EXPECT_STREQ("three", ToString(request_->GetResponse()).c_str());
+
+  EXPECT_EQ(1, server_->num_connections());
+  EXPECT_EQ(3, server_->requests().size());
+
+  DownloadMetrics download_metrics;
+  EXPECT_TRUE(request_->download_metrics(&download_metrics));
+  EXPECT_TRUE(download_metrics.is_connection_reused);
+  EXPECT_EQ(-1, download_metrics.dns_time_ms);
+  EXPECT_EQ(-1, download_metrics.connect_time_ms);
+}
+
+TEST_F(SocketRequestTest, ConnectionClose) {
+  // The body of the first response ends when the server closes the
+  // connection.
+  server_->AddResponse("HTTP/1.0 200 OK\r\n\r\nuntil close", true, false);
+  server_->AddResponse("HTTP/1.1 200 OK\r\n"
+                       "Connection: close\r\n"
+                       "Content-Length: 2\r\n\r\nok",
+                       true,
+                       false);
+
+  EXPECT_HRESULT_SUCCEEDED(Get(_T("/1")));
+  EXPECT_STREQ("until close", ToString(request_->GetResponse()).c_str());
+
+  DownloadMetrics download_metrics;
+  EXPECT_TRUE(request_->download_metrics(&download_metrics));
+  EXPECT_EQ(0, download_metrics.total_bytes);
+
+  EXPECT_HRESULT_SUCCEEDED(Get(_T("/2")));
+  EXPECT_STREQ("ok", ToString(request_->GetResponse()).c_str());
+
+  EXPECT_EQ(2, server_->num_connections());
+  EXPECT_EQ(0, SocketConnectionPool::Instance().num_idle_connections());
+}
+
+// A connection the server closed while it was idle in the pool is not reused.
+TEST_F(SocketRequestTest, IdleConnectionClosedByServer) {
+  server_->AddResponse("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok",
+                       true,
+                       false);
+  server_->AddResponse("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+
+  EXPECT_HRESULT_SUCCEEDED(Get(_T("/1")));
+  EXPECT_EQ(1, SocketConnectionPool::Instance().num_idle_connections());
+
+  EXPECT_HRESULT_SUCCEEDED(Get(_T("/2")));
+  EXPECT_STREQ("ok", ToString(request_->GetResponse()).c_str());
+  EXPECT_EQ(2, server_->num_connections());
+}
+
+TEST_F(SocketRequestTest, Post) {
+  server_->AddResponse("HTTP/1.1 200 OK\r\nContent-Length: 8\r\n\r\nresponse");
+
+  const char kBody[] = "<request/>";
+  request_->set_request_buffer(kBody, strlen(kBody));
+  request_->set_additional_headers(_T("X-Goog-Update-AppId: {1}"));
+  EXPECT_HRESULT_SUCCEEDED(Get(_T("/service/update2")));
+  EXPECT_STREQ("response", ToString(request_->GetResponse()).c_str());
+
+  const std::vector<std::string> requests(server_->requests());
+  ASSERT_EQ(1, requests.size());
+  EXPECT_EQ(0, requests[0].find("POST /service/update2 HTTP/1.1\r\n"));
+  EXPECT_NE(std::string::npos,
+            requests[0].find("X-Goog-Update-AppId: {1}\r\n"));
+  EXPECT_NE(std::string::npos, requests[0].find("Content-Length: 10\r\n"));
+  EXPECT_NE(std::string::npos, requests[0].find("\r\n\r\n<request/>"));
+}
+
+TEST_F(SocketRequestTest, Range) {
+  server_->AddResponse("HTTP/1.1 206 Partial Content\r\n"
+                       "Content-Range: bytes 2-4/10\r\n"
+                       "Content-Length: 3\r\n\r\n"
+                       "cde");
+
+  request_->set_additional_headers(_T("Range: bytes=2-4\r\n"));
+  EXPECT_HRESULT_SUCCEEDED(Get(_T("/file")));
+  EXPECT_EQ(HTTP_STATUS_PARTIAL_CONTENT, request_->GetHttpStatusCode());
+  EXPECT_STREQ("cde", ToString(request_->GetResponse()).c_str());
+
+  CString content_range;
+  EXPECT_HRESULT_SUCCEEDED(request_->QueryHeadersString(
+      WINHTTP_QUERY_CONTENT_RANGE, NULL, &content_range));
+  EXPECT_STREQ(_T("bytes 2-4/10"), content_range);
+
+  const std::vector<std::string> requests(server_->requests());
+  ASSERT_EQ(1, requests.size());
+  EXPECT_NE(std::string::npos, requests[0].find("\r\nRange: bytes=2-4\r\n"));
+}
+
+TEST_F(SocketRequestTest, ProxyConnect) {
+  server_->AddResponse("HTTP/1.1 200 Connection Established\r\n\r\n");
+  server_->AddResponse("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+
+  ProxyConfig proxy_config;
+  SafeCStringFormat(&proxy_config.proxy, _T("http=127.0.0.1:%d"),
+                    server_->port());
+  request_->set_proxy_configuration(proxy_config);
+  request_->set_url(_T("http://update.example.com/file"));
+  EXPECT_HRESULT_SUCCEEDED(request_->Send());
+  EXPECT_EQ(HTTP_STATUS_OK, request_->GetHttpStatusCode());
+  EXPECT_STREQ("ok", ToString(request_->GetResponse()).c_str());
+
+  const std::vector<std::string> requests(server_->requests());
+  ASSERT_EQ(2, requests.size());
+  EXPECT_EQ(0, requests[0].find("CONNECT update.example.com:80 HTTP/1.1\r\n"));
+  EXPECT_EQ(0, requests[1].find("GET /file HTTP/1.1\r\n"));
+  EXPECT_NE(std::string::npos,
+            requests[1].find("\r\nHost: update.example.com\r\n"));
+}
+
+TEST_F(SocketRequestTest, ProxyConnectRefused) {
+  server_->AddResponse("HTTP/1.1 407 Proxy Authentication Required\r\n"
+                       "Content-Length: 0\r\n\r\n");
+
+  ProxyConfig proxy_config;
+  SafeCStringFormat(&proxy_config.proxy, _T("127.0.0.1:%d"), server_->port());
+  request_->set_proxy_configuration(proxy_config);
+  request_->set_url(_T("http://update.example.com/file"));
+  EXPECT_HRESULT_SUCCEEDED(request_->Send());
+  EXPECT_EQ(HTTP_STATUS_PROXY_AUTH_REQ, request_->GetHttpStatusCode());
+  EXPECT_EQ(0, SocketConnectionPool::Instance().num_idle_connections());
+}
+
+TEST_F(SocketRequestTest, ProxyAutoDetectNotSupported) {
+  ProxyConfig proxy_config;
+  proxy_config.auto_detect = true;
+  request_->set_proxy_configuration(proxy_config);
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED), Get(_T("/")));
+  EXPECT_EQ(0, server_->num_connections());
+}
+
+TEST_F(SocketRequestTest, DownloadFile) {
+  server_->AddResponse("HTTP/1.1 200 OK\r\nContent-Length: 7\r\n\r\ncontent");
+
+  const CString filename(GetTempFilenameAt(app_util::GetModuleDirectory(NULL),
+                                           _T("SRT")));
+  ASSERT_FALSE(filename.IsEmpty());
+  request_->set_filename(filename);
+  EXPECT_HRESULT_SUCCEEDED(Get(_T("/file")));
+  EXPECT_TRUE(request_->GetResponse().empty());
+
+  std::vector<byte> content;
+  EXPECT_HRESULT_SUCCEEDED(ReadEntireFile(filename, 0, &content));
+  EXPECT_STREQ("content", ToString(content).c_str());
+
+  uint8 expected_digest[SHA256_DIGEST_SIZE] = {0};
+  SHA256_hash("content", 7, expected_digest);
+  std::vector<uint8> digest;
+  EXPECT_TRUE(request_->download_digest(&digest));
+  EXPECT_TRUE(digest == std::vector<uint8>(
+      expected_digest, expected_digest + arraysize(expected_digest)));
+
+  request_.reset();
+  EXPECT_TRUE(File::Exists(filename));
+  EXPECT_TRUE(::DeleteFile(filename));
+}
+
+// The partial file of a download that does not complete is deleted.
+TEST_F(SocketRequestTest, DownloadFile_Truncated) {
+  server_->AddResponse("HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\npart",
+                       true,
+                       false);
+
+  const CString filename(GetTempFilenameAt(app_util::GetModuleDirectory(NULL),
+                                           _T("SRT")));
+  ASSERT_FALSE(filename.IsEmpty());
+  request_->set_filename(filename);
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_WINHTTP_CONNECTION_ERROR),
+            Get(_T("/file")));
+
+  request_.reset();
+  EXPECT_FALSE(File::Exists(filename));
+}
+
+TEST_F(SocketRequestTest, Cancel) {
+  server_->AddResponse("HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\npart",
+                       false,
+                       true);
+
+  // Cancels the request once the server has answered with part of the body.
+  class CancelThread : public Runnable {
+   public:
+    CancelThread(LoopbackServer* server, SocketRequest* request)
+        : server_(server), request_(request) {}
+
+    void Run() override {
+      while (server_->requests().empty()) {
+        ::Sleep(10);
+      }
+      ::Sleep(100);
+      EXPECT_HRESULT_SUCCEEDED(request_->Cancel());
+    }
+
+   private:
+    LoopbackServer* server_;
+    SocketRequest* request_;
+  };
+
+  CancelThread cancel_thread(server_.get(), request_.get());
+  Thread thread;
+  ASSERT_TRUE(thread.Start(&cancel_thread));
+
+  EXPECT_EQ(GOOPDATE_E_CANCELLED, Get(_T("/file")));
+  EXPECT_TRUE(thread.WaitTillExit(kServerExitTimeoutMs));
+
+  // A canceled request stays canceled.
+  EXPECT_EQ(GOOPDATE_E_CANCELLED, Get(_T("/file")));
+}
+
+// NetworkRequest drives the request as it drives the WinHttp requests.
+TEST_F(SocketRequestTest, NetworkRequest) {
+  server_->AddResponse("HTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\none");
+  server_->AddResponse("HTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\ntwo");
+
+  NetworkConfig* network_config = NULL;
+  EXPECT_HRESULT_SUCCEEDED(
+      NetworkConfigManager::Instance().GetUserNetworkConfig(&network_config));
+
+  NetworkRequest network_request(network_config->session());
+  network_request.AddHttpRequest(new SocketRequest);
+  ProxyConfig proxy_config;
+  network_request.set_proxy_configuration(&proxy_config);
+
+  std::vector<uint8> response;
+  EXPECT_HRESULT_SUCCEEDED(
+      network_request.Get(server_->GetUrl(_T("/1")), &response));
+  EXPECT_STREQ("one", ToString(response).c_str());
+  EXPECT_EQ(HTTP_STATUS_OK, network_request.http_status_code());
+
+  EXPECT_HRESULT_SUCCEEDED(
+      network_request.PostString(server_->GetUrl(_T("/2")),
+                                 _T("<request/>"),
+                                 &response));
+  EXPECT_STREQ("two", ToString(response).c_str());
+
+  const std::vector<std::string> requests(server_->requests());
+  ASSERT_EQ(2, requests.size());
+  EXPECT_NE(std::string::npos, requests[1].find("\r\n\r\n<request/>"));
+  EXPECT_EQ(1, server_->num_connections());
+}
+
+}  // namespace omaha
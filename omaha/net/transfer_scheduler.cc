@@ -0,0 +1,219 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/net/transfer_scheduler.h"
+
+#include <limits.h>
+#include <algorithm>
+
+#include "omaha/base/debug.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/time.h"
+#include "omaha/base/utils.h"
+#include "omaha/common/config_manager.h"
+
+namespace omaha {
+
+namespace {
+
+// The longest a request waits for transfer budget before checking whether it
+// has been canceled.
+const int kMaxTransferWaitMs = 100;
+
+}  // namespace
+
+class TransferScheduler::SystemClock : public TransferScheduler::Clock {
+ public:
+  SystemClock() {}
+
+  uint64 GetTimeMs() override {
+    return GetCurrentMsTime();
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SystemClock);
+};
+
+TrafficClass GetHttpRequestTrafficClass(bool is_post, bool low_priority) {
+  if (is_post) {
+    return TRAFFIC_CLASS_PING;
+  }
+  return low_priority ? TRAFFIC_CLASS_BACKGROUND : TRAFFIC_CLASS_FOREGROUND;
+}
+
+void WaitForTransferBudget(TrafficClass traffic_class,
+                           int bytes,
+                           const volatile bool* is_canceled) {
+  ASSERT1(is_canceled);
+
+  int wait_ms = TransferScheduler::Instance().Consume(traffic_class, bytes);
+  while (wait_ms > 0 && !*is_canceled) {
+    const int sleep_ms = std::min(wait_ms, kMaxTransferWaitMs);
+    ::Sleep(sleep_ms);
+    wait_ms -= sleep_ms;
+  }
+}
+
+TransferScheduler* TransferScheduler::instance_ = NULL;
+LLock TransferScheduler::instance_lock_;
+
+TransferScheduler::Bucket::Bucket()
+    : rate_limit(0),
+      tokens(0),
+      last_refill_ms(0) {
+}
+
+TransferScheduler::TransferScheduler(Clock* clock)
+    : clock_(clock ? clock : new SystemClock),
+      last_time_ms_(0),
+      window_start_ms_(0),
+      window_bytes_(0),
+      link_rate_(0),
+      has_foreground_traffic_(false),
+      last_foreground_ms_(0) {
+  window_start_ms_ = GetTimeMs();
+  for (int i = 0; i != TRAFFIC_CLASS_COUNT; ++i) {
+    buckets_[i].last_refill_ms = window_start_ms_;
+  }
+}
+
+TransferScheduler::~TransferScheduler() {
+}
+
+TransferScheduler& TransferScheduler::Instance() {
+  __mutexScope(instance_lock_);
+  if (!instance_) {
+    const int rate_limit_kbps =
+        ConfigManager::Instance()->GetBackgroundDownloadRateLimitKBps(NULL);
+    NET_LOG(L3, (_T("[TransferScheduler::Instance][background limit %d KB/s]"),
+                 rate_limit_kbps));
+
+    instance_ = new TransferScheduler(NULL);
+    instance_->SetRateLimit(TRAFFIC_CLASS_BACKGROUND, rate_limit_kbps * 1024);
+  }
+  return *instance_;
+}
+
+void TransferScheduler::DeleteInstance() {
+  TransferScheduler* instance = omaha::interlocked_exchange_pointer(
+      &instance_, static_cast<TransferScheduler*>(NULL));
+  delete instance;
+}
+
+void TransferScheduler::SetRateLimit(TrafficClass traffic_class,
+                                     int bytes_per_sec) {
+  ASSERT1(traffic_class >= 0 && traffic_class < TRAFFIC_CLASS_COUNT);
+  ASSERT1(bytes_per_sec >= 0);
+
+  __mutexScope(lock_);
+  buckets_[traffic_class].rate_limit = bytes_per_sec;
+}
+
+int TransferScheduler::GetRateLimit(TrafficClass traffic_class) {
+  ASSERT1(traffic_class >= 0 && traffic_class < TRAFFIC_CLASS_COUNT);
+
+  __mutexScope(lock_);
+  return GetRateLimitAt(traffic_class, GetTimeMs());
+}
+
+int TransferScheduler::Consume(TrafficClass traffic_class, int bytes) {
+  ASSERT1(traffic_class >= 0 && traffic_class < TRAFFIC_CLASS_COUNT);
+  ASSERT1(bytes >= 0);
+
+  __mutexScope(lock_);
+
+  const uint64 now_ms = GetTimeMs();
+  UpdateLinkRate(now_ms, bytes);
+  if (traffic_class == TRAFFIC_CLASS_FOREGROUND && bytes) {
+    has_foreground_traffic_ = true;
+    last_foreground_ms_ = now_ms;
+  }
+
+  Bucket& bucket = buckets_[traffic_class];
+  const int rate_limit = GetRateLimitAt(traffic_class, now_ms);
+  if (!rate_limit) {
+    bucket.tokens = 0;
+    bucket.last_refill_ms = now_ms;
+    return 0;
+  }
+
+  // The bucket refills at the rate in effect now, up to its capacity. Debt
+  // is carried over, so that the requests of the class together never get
+  // more than the rate over time.
+  const int64 capacity = static_cast<int64>(rate_limit) * kBurstMs;
+  const int64 refill =
+      static_cast<int64>(now_ms - bucket.last_refill_ms) * rate_limit;
+  bucket.tokens = std::min(capacity, bucket.tokens + refill);
+  bucket.last_refill_ms = now_ms;
+
+  bucket.tokens -= static_cast<int64>(bytes) * 1000;
+  if (bucket.tokens >= 0) {
+    return 0;
+  }
+
+  const int64 wait_ms = (-bucket.tokens + rate_limit - 1) / rate_limit;
+  return static_cast<int>(std::min<int64>(wait_ms, INT_MAX));
+}
+
+int TransferScheduler::link_rate() const {
+  __mutexScope(lock_);
+  return link_rate_;
+}
+
+uint64 TransferScheduler::GetTimeMs() {
+  // The system time may be set back. The scheduler only needs its time to
+  // move forward.
+  last_time_ms_ = std::max(last_time_ms_, clock_->GetTimeMs());
+  return last_time_ms_;
+}
+
+void TransferScheduler::UpdateLinkRate(uint64 now_ms, int bytes) {
+  window_bytes_ += bytes;
+
+  const uint64 elapsed_ms = now_ms - window_start_ms_;
+  if (elapsed_ms < kLinkRateWindowMs) {
+    return;
+  }
+
+  // The estimate rises to a faster window at once, and decays by an eighth
+  // for each slower one, so that idle or throttled windows do not make the
+  // link look slow.
+  const int window_rate = static_cast<int>(
+      std::min<int64>(window_bytes_ * 1000 / elapsed_ms, INT_MAX));
+  link_rate_ = std::max(window_rate, link_rate_ - link_rate_ / 8);
+
+  window_start_ms_ = now_ms;
+  window_bytes_ = 0;
+}
+
+int TransferScheduler::GetRateLimitAt(TrafficClass traffic_class,
+                                      uint64 now_ms) const {
+  const int rate_limit = buckets_[traffic_class].rate_limit;
+  if (traffic_class != TRAFFIC_CLASS_BACKGROUND ||
+      !has_foreground_traffic_ ||
+      now_ms - last_foreground_ms_ >= kForegroundIdleMs ||
+      !link_rate_) {
+    return rate_limit;
+  }
+
+  int share = static_cast<int>(
+      static_cast<int64>(link_rate_) * kBackgroundLinkSharePercent / 100);
+  if (share < kMinBackgroundBytesPerSec) {
+    share = kMinBackgroundBytesPerSec;
+  }
+  return rate_limit ? std::min(rate_limit, share) : share;
+}
+
+}  // namespace omaha
@@ -0,0 +1,142 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// TransferScheduler meters the bytes the http requests of the process receive,
+// so that background updates leave the network to the user and to the
+// installs the user is waiting for.
+//
+// Each class of traffic draws from a token bucket which all the requests of
+// the class share, however many of them run at once. A request that receives
+// more than the bucket holds goes into debt, and waits until the bucket
+// refills before it receives more.
+//
+// Background downloads are limited by policy. While foreground downloads are
+// running, background downloads are also limited to a share of the rate of
+// the link, which the scheduler estimates from the bytes all the requests
+// receive.
+
+#ifndef OMAHA_NET_TRANSFER_SCHEDULER_H_
+#define OMAHA_NET_TRANSFER_SCHEDULER_H_
+
+#include <windows.h>
+#include <memory>
+
+#include "base/basictypes.h"
+#include "omaha/base/synchronized.h"
+
+namespace omaha {
+
+enum TrafficClass {
+  TRAFFIC_CLASS_FOREGROUND = 0,   // Downloads of installs.
+  TRAFFIC_CLASS_BACKGROUND,       // Downloads of background updates.
+  TRAFFIC_CLASS_PING,             // Update checks and pings.
+  TRAFFIC_CLASS_COUNT,
+};
+
+// Returns the class of the traffic of an http request. Update checks and pings
+// are posts. Gets are downloads, whether they go to a file or to memory, as
+// the ranges of a segmented download do, and they are background downloads
+// when they run at low priority.
+TrafficClass GetHttpRequestTrafficClass(bool is_post, bool low_priority);
+
+// Charges |bytes| received by an http request of |traffic_class| to the
+// scheduler of the process, and blocks as long as the scheduler asks for, or
+// until |*is_canceled| is set.
+void WaitForTransferBudget(TrafficClass traffic_class,
+                           int bytes,
+                           const volatile bool* is_canceled);
+
+class TransferScheduler {
+ public:
+  // Provides the time to the scheduler. Tests use a clock they advance.
+  class Clock {
+   public:
+    virtual ~Clock() {}
+    virtual uint64 GetTimeMs() = 0;
+  };
+
+  // A bucket holds up to this much time worth of bytes at its rate.
+  static const int kBurstMs = 1000;
+
+  // The link rate is measured over windows of this length.
+  static const int kLinkRateWindowMs = 1000;
+
+  // Foreground downloads are running if they received bytes in this time.
+  static const int kForegroundIdleMs = 2000;
+
+  // While foreground downloads are running, background downloads are limited
+  // to this share of the link rate, but not below the minimum rate.
+  static const int kBackgroundLinkSharePercent = 25;
+  static const int kMinBackgroundBytesPerSec = 16 * 1024;
+
+  // Takes ownership of |clock|. Uses the system time if |clock| is NULL.
+  explicit TransferScheduler(Clock* clock);
+  ~TransferScheduler();
+
+  // Returns the scheduler of the process. Its background rate limit comes
+  // from policy when it is created.
+  static TransferScheduler& Instance();
+  static void DeleteInstance();
+
+  // Limits |traffic_class| to |bytes_per_sec|, or removes the limit if 0.
+  void SetRateLimit(TrafficClass traffic_class, int bytes_per_sec);
+
+  // Returns the rate limit of |traffic_class| in effect now, or 0 if the
+  // class is not limited.
+  int GetRateLimit(TrafficClass traffic_class);
+
+  // Charges |bytes| received by a request of |traffic_class|. Returns the
+  // time in milliseconds the request must wait before receiving more.
+  int Consume(TrafficClass traffic_class, int bytes);
+
+  // Returns the estimated rate of the link in bytes per second, or 0 if it is
+  // not known yet.
+  int link_rate() const;
+
+ private:
+  struct Bucket {
+    Bucket();
+
+    int rate_limit;         // Bytes per second, or 0 if not limited.
+    int64 tokens;           // Bytes times 1000, negative when in debt.
+    uint64 last_refill_ms;
+  };
+
+  uint64 GetTimeMs();
+  void UpdateLinkRate(uint64 now_ms, int bytes);
+  int GetRateLimitAt(TrafficClass traffic_class, uint64 now_ms) const;
+
+  class SystemClock;
+
+  std::unique_ptr<Clock> clock_;
+
+  LLock lock_;
+  Bucket buckets_[TRAFFIC_CLASS_COUNT];
+  uint64 last_time_ms_;
+  uint64 window_start_ms_;
+  int64 window_bytes_;
+  int link_rate_;
+  bool has_foreground_traffic_;
+  uint64 last_foreground_ms_;
+
+  static TransferScheduler* instance_;
+  static LLock instance_lock_;
+
+  DISALLOW_COPY_AND_ASSIGN(TransferScheduler);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_NET_TRANSFER_SCHEDULER_H_
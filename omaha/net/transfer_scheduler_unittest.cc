@@ -0,0 +1,186 @@
+// Copyright 2026 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <memory>
+
+#include "omaha/net/transfer_scheduler.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+const int kRateLimit = 10000;
+
+class FakeClock : public TransferScheduler::Clock {
+ public:
+  FakeClock() : now_ms_(1000000) {}
+
+  uint64 GetTimeMs() override { return now_ms_; }
+
+  void Advance(uint64 ms) { now_ms_ += ms; }
+  void SetBack(uint64 ms) { now_ms_ -= ms; }
+
+ private:
+  uint64 now_ms_;
+
+  DISALLOW_COPY_AND_ASSIGN(FakeClock);
+};
+
+}  // namespace
+
+class TransferSchedulerTest : public testing::Test {
+ protected:
+  TransferSchedulerTest() : clock_(NULL) {}
+
+  virtual void SetUp() {
+    clock_ = new FakeClock;
+    scheduler_.reset(new TransferScheduler(clock_));
+  }
+
+  virtual void TearDown() {
+    scheduler_.reset();
+    clock_ = NULL;
+  }
+
+  FakeClock* clock_;    // Owned by |scheduler_|.
+  std::unique_ptr<TransferScheduler> scheduler_;
+};
+
+TEST(GetHttpRequestTrafficClassTest, GetHttpRequestTrafficClass) {
+  // A get is metered as a download whether it goes to a file or to memory, as
+  // the ranges of a segmented download do.
+  EXPECT_EQ(TRAFFIC_CLASS_BACKGROUND, GetHttpRequestTrafficClass(false, true));
+  EXPECT_EQ(TRAFFIC_CLASS_FOREGROUND, GetHttpRequestTrafficClass(false, false));
+
+  EXPECT_EQ(TRAFFIC_CLASS_PING, GetHttpRequestTrafficClass(true, true));
+  EXPECT_EQ(TRAFFIC_CLASS_PING, GetHttpRequestTrafficClass(true, false));
+}
+
+TEST_F(TransferSchedulerTest, NotLimited) {
+  EXPECT_EQ(0, scheduler_->GetRateLimit(TRAFFIC_CLASS_FOREGROUND));
+  EXPECT_EQ(0, scheduler_->GetRateLimit(TRAFFIC_CLASS_BACKGROUND));
+  EXPECT_EQ(0, scheduler_->GetRateLimit(TRAFFIC_CLASS_PING));
+
+  for (int i = 0; i != 10; ++i) {
+    EXPECT_EQ(0, scheduler_->Consume(TRAFFIC_CLASS_FOREGROUND, 1000000));
+    EXPECT_EQ(0, scheduler_->Consume(TRAFFIC_CLASS_BACKGROUND, 1000000));
+    EXPECT_EQ(0, scheduler_->Consume(TRAFFIC_CLASS_PING, 1000000));
+  }
+}
+
+TEST_F(TransferSchedulerTest, RateLimit) {
+  scheduler_->SetRateLimit(TRAFFIC_CLASS_BACKGROUND, kRateLimit);
+  EXPECT_EQ(kRateLimit, scheduler_->GetRateLimit(TRAFFIC_CLASS_BACKGROUND));
+
+  EXPECT_EQ(500, scheduler_->Consume(TRAFFIC_CLASS_BACKGROUND, 5000));
+
+  // Once the debt is paid off, the next bytes are charged from empty.
+  clock_->Advance(500);
+  EXPECT_EQ(1000, scheduler_->Consume(TRAFFIC_CLASS_BACKGROUND, 10000));
+
+  // The other classes are not limited.
+  EXPECT_EQ(0, scheduler_->Consume(TRAFFIC_CLASS_FOREGROUND, 10000));
+  EXPECT_EQ(0, scheduler_->Consume(TRAFFIC_CLASS_PING, 10000));
+
+  // Removing the limit lets the class through at once.
+  scheduler_->SetRateLimit(TRAFFIC_CLASS_BACKGROUND, 0);
+  EXPECT_EQ(0, scheduler_->Consume(TRAFFIC_CLASS_BACKGROUND, 10000));
+}
+
+// The concurrent requests of a class share the budget of the class.
+TEST_F(TransferSchedulerTest, SharedBudget) {
+  scheduler_->SetRateLimit(TRAFFIC_CLASS_BACKGROUND, kRateLimit);
+
+  EXPECT_EQ(500, scheduler_->Consume(TRAFFIC_CLASS_BACKGROUND, 5000));
+  EXPECT_EQ(1000, scheduler_->Consume(TRAFFIC_CLASS_BACKGROUND, 5000));
+  EXPECT_EQ(1500, scheduler_->Consume(TRAFFIC_CLASS_BACKGROUND, 5000));
+
+  clock_->Advance(1500);
+  EXPECT_EQ(0, scheduler_->Consume(TRAFFIC_CLASS_BACKGROUND, 0));
+}
+
+// An idle bucket fills up to one burst worth of bytes.
+TEST_F(TransferSchedulerTest, Burst) {
+  scheduler_->SetRateLimit(TRAFFIC_CLASS_BACKGROUND, kRateLimit);
+
+  clock_->Advance(60000);
+  const int burst_bytes = kRateLimit * TransferScheduler::kBurstMs / 1000;
+  EXPECT_EQ(0, scheduler_->Consume(TRAFFIC_CLASS_BACKGROUND, burst_bytes));
+  EXPECT_EQ(1, scheduler_->Consume(TRAFFIC_CLASS_BACKGROUND, 1));
+}
+
+// Background downloads yield to foreground downloads while they are running.
+TEST_F(TransferSchedulerTest, BackgroundYieldsToForeground) {
+  const int kLinkRate = 400 * 1024;
+  const int share =
+      kLinkRate * TransferScheduler::kBackgroundLinkSharePercent / 100;
+  EXPECT_EQ(0, scheduler_->link_rate());
+
+  clock_->Advance(TransferScheduler::kLinkRateWindowMs);
+  EXPECT_EQ(0, scheduler_->Consume(TRAFFIC_CLASS_FOREGROUND, kLinkRate));
+  EXPECT_EQ(kLinkRate, scheduler_->link_rate());
+  EXPECT_EQ(share, scheduler_->GetRateLimit(TRAFFIC_CLASS_BACKGROUND));
+
+  // A lower limit set by policy still applies.
+  scheduler_->SetRateLimit(TRAFFIC_CLASS_BACKGROUND, share / 2);
+  EXPECT_EQ(share / 2, scheduler_->GetRateLimit(TRAFFIC_CLASS_BACKGROUND));
+  scheduler_->SetRateLimit(TRAFFIC_CLASS_BACKGROUND, 0);
+
+  // Once foreground downloads stop, background downloads get the whole link.
+  clock_->Advance(TransferScheduler::kForegroundIdleMs);
+  EXPECT_EQ(0, scheduler_->GetRateLimit(TRAFFIC_CLASS_BACKGROUND));
+}
+
+TEST_F(TransferSchedulerTest, LinkRate) {
+  // A slower window lowers the estimate by an eighth.
+  clock_->Advance(TransferScheduler::kLinkRateWindowMs);
+  scheduler_->Consume(TRAFFIC_CLASS_FOREGROUND, 80000);
+  EXPECT_EQ(80000, scheduler_->link_rate());
+  clock_->Advance(TransferScheduler::kLinkRateWindowMs);
+  scheduler_->Consume(TRAFFIC_CLASS_BACKGROUND, 1000);
+  EXPECT_EQ(70000, scheduler_->link_rate());
+
+  // A faster window raises it at once.
+  clock_->Advance(TransferScheduler::kLinkRateWindowMs);
+  scheduler_->Consume(TRAFFIC_CLASS_PING, 200000);
+  EXPECT_EQ(200000, scheduler_->link_rate());
+
+  // Background downloads get at least the minimum rate on a slow link.
+  clock_->Advance(TransferScheduler::kLinkRateWindowMs * 100);
+  scheduler_->Consume(TRAFFIC_CLASS_FOREGROUND, 1);
+  EXPECT_EQ(175000, scheduler_->link_rate());
+  for (int i = 0; i != 40; ++i) {
+    clock_->Advance(TransferScheduler::kLinkRateWindowMs);
+    scheduler_->Consume(TRAFFIC_CLASS_FOREGROUND, 1);
+  }
+  const int min_rate = TransferScheduler::kMinBackgroundBytesPerSec;
+  EXPECT_GT(4 * min_rate, scheduler_->link_rate());
+  EXPECT_EQ(min_rate, scheduler_->GetRateLimit(TRAFFIC_CLASS_BACKGROUND));
+}
+
+// The scheduler ignores the clock going backwards.
+TEST_F(TransferSchedulerTest, ClockSetBack) {
+  scheduler_->SetRateLimit(TRAFFIC_CLASS_BACKGROUND, kRateLimit);
+  EXPECT_EQ(500, scheduler_->Consume(TRAFFIC_CLASS_BACKGROUND, 5000));
+
+  clock_->SetBack(10000);
+  EXPECT_EQ(500, scheduler_->Consume(TRAFFIC_CLASS_BACKGROUND, 0));
+
+  clock_->Advance(10500);
+  EXPECT_EQ(0, scheduler_->Consume(TRAFFIC_CLASS_BACKGROUND, 0));
+}
+
+}  // namespace omaha
@@ -17,20 +17,33 @@
 
 #include "omaha/base/debug.h"
 #include "omaha/base/error.h"
+#include "omaha/base/highres_timer-win32.h"
 #include "omaha/base/logging.h"
 #include "omaha/base/safe_format.h"
 
 namespace omaha {
 
+WinHttpAdapter::Timings::Timings()
+    : dns_time_ms(-1),
+      connect_time_ms(-1),
+      tls_time_ms(-1),
+      ttfb_ms(-1),
+      is_connection_reused(false) {
+}
+
 WinHttpAdapter::WinHttpAdapter()
     : connection_handle_(NULL),
       request_handle_(NULL),
+      connection_pool_(NULL),
+      is_connection_reusable_(false),
+      is_secure_request_(false),
       async_call_type_(0),
       async_call_is_error_(0),
       async_bytes_available_(0),
       async_bytes_read_(0),
       secure_status_flag_(0) {
   memset(&async_call_result_, 0, sizeof(async_call_result_));
+  memset(event_ticks_, 0, sizeof(event_ticks_));
   NET_LOG(L3, (_T("[WinHttpAdapter::WinHttpAdapter][0x%p]"), this));
 }
 
@@ -71,9 +84,15 @@ void WinHttpAdapter::CloseHandles() {
     request_handle_ = NULL;
   }
   if (connection_handle_) {
-    VERIFY_SUCCEEDED(http_client_->Close(connection_handle_));
+    if (connection_pool_ && is_connection_reusable_) {
+      connection_pool_->Return(connection_key_, connection_handle_);
+    } else {
+      VERIFY_SUCCEEDED(http_client_->Close(connection_handle_));
+    }
     connection_handle_ = NULL;
   }
+  connection_pool_ = NULL;
+  is_connection_reusable_ = false;
 }
 
 HRESULT WinHttpAdapter::Connect(HINTERNET session_handle,
@@ -90,6 +109,37 @@ HRESULT WinHttpAdapter::Connect(HINTERNET session_handle,
   return hr;
 }
 
+HRESULT WinHttpAdapter::ConnectPooled(ConnectionPool* pool,
+                                      const ConnectionPool::Key& key) {
+  ASSERT1(pool);
+
+  __mutexScope(lock_);
+
+  connection_handle_ = pool->Borrow(key);
+  HRESULT hr = S_OK;
+  if (!connection_handle_) {
+    hr = http_client_->Connect(key.session_handle,
+                               key.server,
+                               key.port,
+                               &connection_handle_);
+  }
+  NET_LOG(L3, (_T("[WinHttpAdapter::ConnectPooled][0x%p][0x%x][0x%x]"),
+              this, connection_handle_, hr));
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  connection_pool_ = pool;
+  connection_key_ = key;
+  is_connection_reusable_ = false;
+  return S_OK;
+}
+
+void WinHttpAdapter::MarkConnectionReusable() {
+  __mutexScope(lock_);
+  is_connection_reusable_ = connection_pool_ != NULL;
+}
+
 HRESULT WinHttpAdapter::OpenRequest(const TCHAR* verb,
                                     const TCHAR* uri,
                                     const TCHAR* version,
@@ -113,6 +163,9 @@ HRESULT WinHttpAdapter::OpenRequest(const TCHAR* verb,
   NET_LOG(L3, (_T("[WinHttpAdapter::OpenRequest][0x%p][0x%x]"),
               this, request_handle_));
 
+  is_secure_request_ = (flags & WINHTTP_FLAG_SECURE) != 0;
+  memset(event_ticks_, 0, sizeof(event_ticks_));
+
   HttpClient::StatusCallback old_callback =
       http_client_->SetStatusCallback(request_handle_,
                                       &WinHttpAdapter::WinHttpStatusCallback,
@@ -441,16 +494,19 @@ void __stdcall WinHttpAdapter::WinHttpStatusCallback(HINTERNET handle,
       break;
     case WINHTTP_CALLBACK_STATUS_RESOLVING_NAME:
       status_string = _T("resolving");
+      http_adapter->RecordEvent(TIMED_EVENT_RESOLVING_NAME);
       info_string.SetString(static_cast<TCHAR*>(info), info_len);  // host name
       http_adapter->server_name_ = info_string;
       break;
     case WINHTTP_CALLBACK_STATUS_NAME_RESOLVED:
       status_string = _T("resolved");
+      http_adapter->RecordEvent(TIMED_EVENT_NAME_RESOLVED);
       info_string.SetString(static_cast<TCHAR*>(info), info_len);  // host ip
       http_adapter->server_ip_ = info_string;
       break;
     case WINHTTP_CALLBACK_STATUS_CONNECTING_TO_SERVER:
       status_string = _T("connecting");
+      http_adapter->RecordEvent(TIMED_EVENT_CONNECTING);
       info_string.SetString(static_cast<TCHAR*>(info), info_len);  // host ip
 
       // Server name resolving may be skipped in some cases. So populate server
@@ -464,19 +520,23 @@ void __stdcall WinHttpAdapter::WinHttpStatusCallback(HINTERNET handle,
       break;
     case WINHTTP_CALLBACK_STATUS_CONNECTED_TO_SERVER:
       status_string = _T("connected");
+      http_adapter->RecordEvent(TIMED_EVENT_CONNECTED);
       info_string.SetString(static_cast<TCHAR*>(info), info_len);  // host ip
       break;
     case WINHTTP_CALLBACK_STATUS_SENDING_REQUEST:
       status_string = _T("sending");
+      http_adapter->RecordEvent(TIMED_EVENT_SENDING_REQUEST);
       break;
     case WINHTTP_CALLBACK_STATUS_REQUEST_SENT:
       status_string = _T("sent");
+      http_adapter->RecordEvent(TIMED_EVENT_REQUEST_SENT);
       break;
     case WINHTTP_CALLBACK_STATUS_RECEIVING_RESPONSE:
       status_string = _T("receiving");
       break;
     case WINHTTP_CALLBACK_STATUS_RESPONSE_RECEIVED:
       status_string = _T("received");
+      http_adapter->RecordEvent(TIMED_EVENT_RESPONSE_RECEIVED);
       break;
     case WINHTTP_CALLBACK_STATUS_CLOSING_CONNECTION:
       status_string = _T("connection closing");
@@ -564,5 +624,51 @@ HRESULT WinHttpAdapter::GetErrorFromSecureStatusFlag() const {
   return HRESULT_FROM_WIN32(status);
 }
 
+WinHttpAdapter::Timings WinHttpAdapter::GetTimings() const {
+  Timings timings;
+
+  // WinHttp does not resolve the name nor connect when it sends the request
+  // on an idle keep-alive connection.
+  timings.is_connection_reused =
+      event_ticks_[TIMED_EVENT_SENDING_REQUEST] != 0 &&
+      event_ticks_[TIMED_EVENT_CONNECTING] == 0;
+
+  timings.dns_time_ms = GetEventTimeMs(TIMED_EVENT_RESOLVING_NAME,
+                                       TIMED_EVENT_NAME_RESOLVED);
+  timings.connect_time_ms = GetEventTimeMs(TIMED_EVENT_CONNECTING,
+                                           TIMED_EVENT_CONNECTED);
+
+  // WinHttp has no notification for the TLS handshake. It happens between
+  // connecting and sending the request.
+  if (is_secure_request_) {
+    timings.tls_time_ms = GetEventTimeMs(TIMED_EVENT_CONNECTED,
+                                         TIMED_EVENT_SENDING_REQUEST);
+  }
+
+  timings.ttfb_ms = GetEventTimeMs(TIMED_EVENT_REQUEST_SENT,
+                                   TIMED_EVENT_RESPONSE_RECEIVED);
+  return timings;
+}
+
+void WinHttpAdapter::RecordEvent(TimedEvent timed_event) {
+  ASSERT1(timed_event >= 0 && timed_event < TIMED_EVENT_COUNT);
+
+  // Only the first notification counts. WinHttp sends some notifications
+  // again for each read, and for each send after a proxy authentication.
+  if (!event_ticks_[timed_event]) {
+    event_ticks_[timed_event] = HighresTimer::GetCurrentTicks();
+  }
+}
+
+int64 WinHttpAdapter::GetEventTimeMs(TimedEvent begin, TimedEvent end) const {
+  const ULONGLONG begin_ticks = event_ticks_[begin];
+  const ULONGLONG end_ticks = event_ticks_[end];
+  if (!begin_ticks || !end_ticks || end_ticks < begin_ticks) {
+    return -1;
+  }
+  return static_cast<int64>((end_ticks - begin_ticks) * 1000 /
+                            HighresTimer::GetTimerFrequency());
+}
+
 }  // namespace omaha
 
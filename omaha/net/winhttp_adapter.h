@@ -21,6 +21,7 @@
 
 #include "base/basictypes.h"
 #include "omaha/base/synchronized.h"
+#include "omaha/net/connection_pool.h"
 #include "omaha/net/winhttp.h"
 #include "omaha/third_party/smartany/scoped_any.h"
 
@@ -46,6 +47,18 @@ class WinHttpAdapterTest;
 // to manage the WinHttp session handle.
 class WinHttpAdapter {
  public:
+  // The latency breakdown of the request, in milliseconds. A step that did
+  // not happen is -1.
+  struct Timings {
+    Timings();
+
+    int64 dns_time_ms;
+    int64 connect_time_ms;
+    int64 tls_time_ms;
+    int64 ttfb_ms;
+    bool is_connection_reused;
+  };
+
   WinHttpAdapter();
   ~WinHttpAdapter();
 
@@ -53,6 +66,15 @@ class WinHttpAdapter {
 
   HRESULT Connect(HINTERNET session_handle, const TCHAR* server, int port);
 
+  // Borrows a connection for |key| from |pool|, or connects to the server of
+  // |key| if the pool has none. The connection goes back to the pool when the
+  // handles are closed, if MarkConnectionReusable() was called.
+  HRESULT ConnectPooled(ConnectionPool* pool, const ConnectionPool::Key& key);
+
+  // Called when the response has been read in full and the server keeps the
+  // connection open.
+  void MarkConnectionReusable();
+
   HRESULT OpenRequest(const TCHAR* verb,
                       const TCHAR* uri,
                       const TCHAR* version,
@@ -120,7 +142,28 @@ class WinHttpAdapter {
 
   HRESULT GetErrorFromSecureStatusFlag() const;
 
+  // Returns the latency breakdown of the last request sent.
+  Timings GetTimings() const;
+
  private:
+  // The WinHttp notifications the latency breakdown is computed from.
+  enum TimedEvent {
+    TIMED_EVENT_RESOLVING_NAME = 0,
+    TIMED_EVENT_NAME_RESOLVED,
+    TIMED_EVENT_CONNECTING,
+    TIMED_EVENT_CONNECTED,
+    TIMED_EVENT_SENDING_REQUEST,
+    TIMED_EVENT_REQUEST_SENT,
+    TIMED_EVENT_RESPONSE_RECEIVED,
+    TIMED_EVENT_COUNT,
+  };
+
+  // Records the time of the first notification of |timed_event|.
+  void RecordEvent(TimedEvent timed_event);
+
+  // Returns the time between two notifications, or -1 if either did not
+  // arrive.
+  int64 GetEventTimeMs(TimedEvent begin, TimedEvent end) const;
 
   HRESULT AsyncCallBegin(DWORD async_call_type);
   HRESULT AsyncCallEnd(DWORD async_call_type);
@@ -141,6 +184,12 @@ class WinHttpAdapter {
   HINTERNET              connection_handle_;
   HINTERNET              request_handle_;
 
+  ConnectionPool*        connection_pool_;
+  ConnectionPool::Key    connection_key_;
+  bool                   is_connection_reusable_;
+  bool                   is_secure_request_;
+  ULONGLONG              event_ticks_[TIMED_EVENT_COUNT];
+
   CString                server_name_;
   CString                server_ip_;
 
@@ -16,7 +16,13 @@
 #include "omaha/base/vistautil.h"
 #include "omaha/base/reg_key.h"
 #include "omaha/common/const_goopdate.h"
+#include "omaha/net/connection_pool.h"
+#include "omaha/net/host_health.h"
+#include "omaha/net/network_request_dispatcher.h"
+#include "omaha/net/response_buffer.h"
+#include "omaha/net/socket_connection.h"
 #include "omaha/net/network_config.h"
+#include "omaha/net/transfer_scheduler.h"
 #include "omaha/testing/omaha_unittest.h"
 #include "omaha/testing/unit_test.h"
 
@@ -56,7 +62,13 @@ int InitializeNetwork() {
 }
 
 int DeinitializeNetwork() {
+  NetworkRequestDispatcher::DeleteInstance();
   NetworkConfigManager::DeleteInstance();
+  TransferScheduler::DeleteInstance();
+  ConnectionPool::DeleteInstance();
+  HostHealth::DeleteInstance();
+  SocketConnectionPool::DeleteInstance();
+  SlabPool::DeleteInstance();
   return 0;
 }
 